@@ -0,0 +1,104 @@
+#ifndef __ASM_QSPINLOCK_H
+#define __ASM_QSPINLOCK_H
+
+/*
+ * Queue spinlock support for ARMv6K and later.
+ *
+ * The generic queue spinlock code is used with the following changes:
+ *  - the unlock is a byte store of the locked byte followed by SEV, like
+ *    the ticket lock unlock, to wake up the waiters sleeping in WFE;
+ *  - there is no halfword xchg, the tail is exchanged with an
+ *    ldrexh/strexh loop on the tail halfword;
+ *  - the waiters for the owner sleep in WFE.
+ *
+ * set_locked() and clear_pending_set_locked() are plain byte and halfword
+ * stores (strb/strh) and need no override.
+ */
+#include <asm-generic/qspinlock_types.h>
+#include <asm/barrier.h>
+
+/*
+ * The locked byte is the least significant byte of the lock word and the
+ * tail is its most significant halfword.
+ */
+#ifdef __ARMEB__
+#define _Q_LOCKED_BYTE	3
+#define _Q_TAIL_HALF	0
+#else
+#define _Q_LOCKED_BYTE	0
+#define _Q_TAIL_HALF	2
+#endif
+
+#define queue_spin_unlock queue_spin_unlock
+/**
+ * queue_spin_unlock - release a queue spinlock
+ * @lock : Pointer to queue spinlock structure
+ */
+static inline void queue_spin_unlock(struct qspinlock *lock)
+{
+	smp_mb();
+	ACCESS_ONCE(*((u8 *)lock + _Q_LOCKED_BYTE)) = 0;
+	dsb_sev();
+}
+
+#define queue_spin_xchg_tail queue_spin_xchg_tail
+/**
+ * queue_spin_xchg_tail - exchange the tail of the lock word
+ * @lock: Pointer to queue spinlock structure
+ * @tail: The new queue tail code word
+ * Return: The previous queue tail code word
+ *
+ * The barriers are the same as the ones of xchg().
+ */
+static __always_inline u32
+queue_spin_xchg_tail(struct qspinlock *lock, u32 tail)
+{
+	u16 *p = (u16 *)lock + _Q_TAIL_HALF / 2;
+	unsigned long prev, tmp;
+
+	smp_mb();
+	prefetchw(p);
+	__asm__ __volatile__(
+"1:	ldrexh	%0, [%3]\n"
+"	strexh	%1, %2, [%3]\n"
+"	teq	%1, #0\n"
+"	bne	1b"
+	: "=&r" (prev), "=&r" (tmp)
+	: "r" (tail >> _Q_TAIL_OFFSET), "r" (p)
+	: "memory", "cc");
+	smp_mb();
+
+	return (u32)prev << _Q_TAIL_OFFSET;
+}
+
+#define queue_spin_wait_clear queue_spin_wait_clear
+/**
+ * queue_spin_wait_clear - wait until the given bits of the lock are clear
+ * @lock: Pointer to queue spinlock structure
+ * @mask: The bits of the lock word to wait for
+ * Return: the last lock value read, with the given bits cleared
+ *
+ * Sleep in WFE while the lock is held: the unlock always sends an event.
+ * The pending bit can be cleared without one, so spin while only the
+ * pending bit is set. An event sent before the WFE is not lost, it makes
+ * the WFE return at once.
+ */
+static __always_inline u32
+queue_spin_wait_clear(struct qspinlock *lock, u32 mask)
+{
+	u32 val;
+
+	while ((val = ACCESS_ONCE(lock->val.counter)) & mask) {
+		if (val & mask & _Q_LOCKED_MASK)
+			wfe();
+		else
+			cpu_relax();
+	}
+	smp_mb();
+
+	return val;
+}
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* __ASM_QSPINLOCK_H */
@@ -42,6 +42,9 @@ static inline void dsb_sev(void)
 	__asm__(SEV);
 }
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+#include <asm/qspinlock.h>
+#else
 /*
  * ARMv6 ticket-based spin-locking.
  *
@@ -129,6 +132,7 @@ static inline int arch_spin_is_contended(arch_spinlock_t *lock)
 	return (tickets.next - tickets.owner) > 1;
 }
 #define arch_spin_is_contended	arch_spin_is_contended
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 /*
  * RWLOCKS
@@ -5,6 +5,9 @@
 # error "please don't include this file directly"
 #endif
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+#include <asm-generic/qspinlock_types.h>
+#else
 #define TICKET_SHIFT	16
 
 typedef struct {
@@ -23,6 +26,7 @@ typedef struct {
 } arch_spinlock_t;
 
 #define __ARCH_SPIN_LOCK_UNLOCKED	{ { 0 } }
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 typedef struct {
 	u32 lock;
@@ -0,0 +1,43 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ASM_MCS_SPINLOCK_H
+#define __ASM_MCS_SPINLOCK_H
+
+#ifdef CONFIG_SMP
+/*
+ * MCS spin-locking.
+ *
+ * The waiter arms the exclusive monitor on its node with an exclusive
+ * load-acquire and waits for an event. The store-release in
+ * arch_mcs_spin_unlock_contended() clears the monitor and so generates
+ * the event. Unlike 32-bit ARM, no explicit SEV is needed.
+ */
+static __always_inline void arm64_mcs_spin_lock_contended(int *l)
+{
+	unsigned int tmp;
+
+	asm volatile(
+	"	sevl\n"
+	"1:	wfe\n"
+	"	ldaxr	%w0, %1\n"
+	"	cbz	%w0, 1b\n"
+	: "=&r" (tmp)
+	: "Q" (*l)
+	: "memory");
+}
+
+#define arch_mcs_spin_lock_contended(l)	arm64_mcs_spin_lock_contended(l)
+
+#endif	/* CONFIG_SMP */
+#endif	/* __ASM_MCS_SPINLOCK_H */
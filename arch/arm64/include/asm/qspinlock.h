@@ -0,0 +1,73 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ASM_QSPINLOCK_H
+#define __ASM_QSPINLOCK_H
+
+#include <asm-generic/qspinlock_types.h>
+#include <asm/barrier.h>
+
+/*
+ * The locked byte is the least significant byte of the lock word.
+ */
+#ifdef __AARCH64EB__
+#define _Q_LOCKED_BYTE	3
+#else
+#define _Q_LOCKED_BYTE	0
+#endif
+
+#define queue_spin_unlock queue_spin_unlock
+/**
+ * queue_spin_unlock - release a queue spinlock
+ * @lock : Pointer to queue spinlock structure
+ *
+ * A store-release (stlrb) of the locked byte. It also clears the exclusive
+ * monitor of the waiters in queue_spin_wait_clear() and so wakes them up.
+ */
+static inline void queue_spin_unlock(struct qspinlock *lock)
+{
+	smp_store_release((u8 *)lock + _Q_LOCKED_BYTE, 0);
+}
+
+#define queue_spin_wait_clear queue_spin_wait_clear
+/**
+ * queue_spin_wait_clear - wait until the given bits of the lock are clear
+ * @lock: Pointer to queue spinlock structure
+ * @mask: The bits of the lock word to wait for
+ * Return: the last lock value read, with the given bits cleared
+ *
+ * The exclusive load-acquire arms the exclusive monitor so that any store
+ * to the lock word will generate the event that WFE waits for. A local
+ * event is sent first to avoid missing a store before the exclusive load.
+ */
+static __always_inline u32
+queue_spin_wait_clear(struct qspinlock *lock, u32 mask)
+{
+	u32 val;
+
+	asm volatile(
+	"	sevl\n"
+	"1:	wfe\n"
+	"	ldaxr	%w0, %1\n"
+	"	tst	%w0, %w2\n"
+	"	b.ne	1b\n"
+	: "=&r" (val)
+	: "Q" (lock->val.counter), "r" (mask)
+	: "memory");
+
+	return val;
+}
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* __ASM_QSPINLOCK_H */
@@ -26,6 +26,9 @@
  * instructions.
  */
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+#include <asm/qspinlock.h>
+#else
 #define arch_spin_unlock_wait(lock) \
 	do { while (arch_spin_is_locked(lock)) cpu_relax(); } while (0)
 
@@ -108,6 +111,7 @@ static inline int arch_spin_is_contended(arch_spinlock_t *lock)
 	return (lockval.next - lockval.owner) > 1;
 }
 #define arch_spin_is_contended	arch_spin_is_contended
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 /*
  * Write lock implementation.
@@ -0,0 +1,170 @@
+#ifndef _ASM_POWERPC_QSPINLOCK_H
+#define _ASM_POWERPC_QSPINLOCK_H
+#ifdef __KERNEL__
+
+/*
+ * Queue spinlock support for powerpc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The generic queue spinlock code is used with the following changes:
+ *  - the unlock is a release store of the locked byte which has to
+ *    flush any pending MMIO writes first, just like arch_spin_unlock();
+ *  - there is no byte or halfword xchg, so the tail is exchanged with a
+ *    lwarx/stwcx. loop on the lock word that keeps the locked and
+ *    pending bytes intact;
+ *  - on a shared processor LPAR, the waiters confer their cycles to a
+ *    preempted lock holder like the old spinlock code did, and the PV
+ *    slowpath can be used with H_CONFER and H_PROD to wait and kick.
+ */
+#include <asm-generic/qspinlock_types.h>
+#include <asm/barrier.h>
+#include <asm/synch.h>
+#include <asm/asm-compat.h>
+
+/*
+ * The locked byte is the least significant byte of the lock word.
+ */
+#ifdef __BIG_ENDIAN__
+#define _Q_LOCKED_BYTE	3
+#else
+#define _Q_LOCKED_BYTE	0
+#endif
+
+static __always_inline void native_spin_unlock(struct qspinlock *lock)
+{
+	SYNC_IO;
+	smp_store_release((u8 *)lock + _Q_LOCKED_BYTE, 0);
+}
+
+#define queue_spin_unlock queue_spin_unlock
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+#include <asm-generic/qspinlock_paravirt.h>
+
+#define queue_spin_lock	queue_spin_lock
+/**
+ * queue_spin_lock - acquire a queue spinlock
+ * @lock: Pointer to queue spinlock structure
+ */
+static __always_inline void queue_spin_lock(struct qspinlock *lock)
+{
+	u32 val;
+
+	val = atomic_cmpxchg(&lock->val, 0, _Q_LOCKED_VAL);
+	if (likely(val == 0))
+		return;
+	if (static_key_false(&paravirt_spinlocks_enabled))
+		pv_queue_spin_lock_slowpath(lock, val);
+	else
+		queue_spin_lock_slowpath(lock, val);
+}
+
+/**
+ * queue_spin_unlock - release a queue spinlock
+ * @lock : Pointer to queue spinlock structure
+ *
+ * With the PV spinlocks enabled, the lock byte has to be cleared with a
+ * cmpxchg of the lock word to see if the queue head has set the
+ * _Q_LOCKED_SLOWPATH flag before halting itself.
+ */
+static inline void queue_spin_unlock(struct qspinlock *lock)
+{
+	u32 old, val;
+
+	if (!static_key_false(&paravirt_spinlocks_enabled)) {
+		native_spin_unlock(lock);
+		return;
+	}
+
+	SYNC_IO;
+	val = atomic_read(&lock->val);
+	while ((val & _Q_LOCKED_MASK) == _Q_LOCKED_VAL) {
+		old = atomic_cmpxchg(&lock->val, val, val & ~_Q_LOCKED_MASK);
+		if (old == val)
+			return;
+		val = old;
+	}
+	queue_spin_unlock_slowpath(lock);
+}
+#else
+/**
+ * queue_spin_unlock - release a queue spinlock
+ * @lock : Pointer to queue spinlock structure
+ */
+static inline void queue_spin_unlock(struct qspinlock *lock)
+{
+	native_spin_unlock(lock);
+}
+#endif /* CONFIG_PARAVIRT_SPINLOCKS */
+
+#define queue_spin_xchg_tail queue_spin_xchg_tail
+/**
+ * queue_spin_xchg_tail - exchange the tail of the lock word
+ * @lock: Pointer to queue spinlock structure
+ * @tail: The new queue tail code word
+ * Return: The previous queue tail code word
+ *
+ * The reservation covers the whole word, so a concurrent change of the
+ * locked or pending byte just makes the stwcx. fail and the loop retry.
+ * The barriers are the same as the ones of xchg().
+ */
+static __always_inline u32
+queue_spin_xchg_tail(struct qspinlock *lock, u32 tail)
+{
+	u32 prev, tmp;
+
+	__asm__ __volatile__(
+	PPC_ATOMIC_ENTRY_BARRIER
+"1:	lwarx	%0,0,%2\n\
+	andi.	%1,%0,%3\n\
+	or	%1,%1,%4\n"
+	PPC405_ERR77(0,%2)
+"	stwcx.	%1,0,%2\n\
+	bne-	1b"
+	PPC_ATOMIC_EXIT_BARRIER
+	: "=&r" (prev), "=&r" (tmp)
+	: "r" (&lock->val.counter), "i" (_Q_LOCKED_MASK | _Q_PENDING_MASK),
+	  "r" (tail)
+	: "cr0", "memory");
+
+	return prev & _Q_TAIL_MASK;
+}
+
+#ifdef CONFIG_PPC_SPLPAR
+#define queue_spin_wait_clear queue_spin_wait_clear
+/**
+ * queue_spin_wait_clear - wait until the given bits of the lock are clear
+ * @lock: Pointer to queue spinlock structure
+ * @mask: The bits of the lock word to wait for
+ * Return: the last lock value read, with the given bits cleared
+ *
+ * Spin at low SMT priority. On a shared processor, the remaining time
+ * slice is given to the lock holder if its virtual processor has been
+ * preempted.
+ */
+static __always_inline u32
+queue_spin_wait_clear(struct qspinlock *lock, u32 mask)
+{
+	u32 val;
+
+	if (!((val = smp_load_acquire(&lock->val.counter)) & mask))
+		return val;
+
+	do {
+		HMT_low();
+		if (SHARED_PROCESSOR)
+			__spin_yield(lock);
+	} while ((val = smp_load_acquire(&lock->val.counter)) & mask);
+	HMT_medium();
+
+	return val;
+}
+#endif /* CONFIG_PPC_SPLPAR */
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* __KERNEL__ */
+#endif /* _ASM_POWERPC_QSPINLOCK_H */
@@ -17,12 +17,104 @@
 #include <linux/export.h>
 #include <linux/stringify.h>
 #include <linux/smp.h>
+#include <linux/init.h>
 
 /* waiting for a spinlock... */
 #if defined(CONFIG_PPC_SPLPAR)
 #include <asm/hvcall.h>
 #include <asm/smp.h>
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+void __spin_yield(arch_spinlock_t *lock)
+{
+	unsigned int yield_count;
+	int holder_cpu;
+
+	holder_cpu = queue_spin_owner(lock);
+	if (holder_cpu < 0)
+		return;
+	yield_count = be32_to_cpu(lppaca_of(holder_cpu).yield_count);
+	if ((yield_count & 1) == 0)
+		return;		/* virtual cpu is currently running */
+	rmb();
+	if (queue_spin_owner(lock) != holder_cpu)
+		return;		/* something has changed */
+	plpar_hcall_norets(H_CONFER,
+		get_hard_smp_processor_id(holder_cpu), yield_count);
+}
+
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+/*
+ * The pv_lock_ops of shared processor LPARs
+ */
+static bool splpar_vcpu_is_preempted(int cpu)
+{
+	return be32_to_cpu(lppaca_of(cpu).yield_count) & 1;
+}
+
+static bool splpar_yield_to_cpu(int cpu)
+{
+	unsigned int yield_count;
+
+	yield_count = be32_to_cpu(lppaca_of(cpu).yield_count);
+	if ((yield_count & 1) == 0)
+		return false;	/* virtual cpu is currently running */
+	plpar_hcall_norets(H_CONFER,
+		get_hard_smp_processor_id(cpu), yield_count);
+	return true;
+}
+
+/*
+ * Confer the rest of our timeslice to the other virtual processors of
+ * the partition until they have all been dispatched or we are prodded.
+ * A prod that comes in before the confer makes it return right away, so
+ * there is no lost wakeup.
+ */
+static void splpar_lockwait(u8 *lockbyte)
+{
+	if (lockbyte && !ACCESS_ONCE(*lockbyte))
+		return;
+	plpar_hcall_norets(H_CONFER, -1, 0);
+}
+
+static void splpar_kick_cpu(int cpu)
+{
+	plpar_hcall_norets(H_PROD, get_hard_smp_processor_id(cpu));
+}
+
+static bool splpar_pv_spinlocks;
+
+/*
+ * Setup pv_lock_ops when running on a shared processor. It is called from
+ * setup_arch after the VPA of the boot cpu has been registered.
+ */
+void __init splpar_spinlock_init(void)
+{
+	if (!SHARED_PROCESSOR)
+		return;
+
+	pv_init_lock_hash();
+	pv_lock_ops.lockwait = splpar_lockwait;
+	pv_lock_ops.kick_cpu = splpar_kick_cpu;
+	pv_lock_ops.vcpu_is_preempted = splpar_vcpu_is_preempted;
+	pv_lock_ops.yield_to_cpu = splpar_yield_to_cpu;
+	splpar_pv_spinlocks = true;
+}
+
+static __init int splpar_spinlock_init_jump(void)
+{
+	if (!splpar_pv_spinlocks)
+		return 0;
+
+	static_key_slow_inc(&paravirt_spinlocks_enabled);
+	pr_info("SPLPAR setup paravirtual spinlock\n");
+
+	return 0;
+}
+early_initcall(splpar_spinlock_init_jump);
+#endif /* CONFIG_PARAVIRT_SPINLOCKS */
+
+#else
 void __spin_yield(arch_spinlock_t *lock)
 {
 	unsigned int lock_value, holder_cpu, yield_count;
@@ -41,6 +133,7 @@ void __spin_yield(arch_spinlock_t *lock)
 	plpar_hcall_norets(H_CONFER,
 		get_hard_smp_processor_id(holder_cpu), yield_count);
 }
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 /*
  * Waiting for a read lock or a write lock on a rwlock...
@@ -68,11 +161,12 @@ void __rw_yield(arch_rwlock_t *rw)
 }
 #endif
 
+#ifndef CONFIG_QUEUE_SPINLOCK
 void arch_spin_unlock_wait(arch_spinlock_t *lock)
 {
 	smp_mb();
 
-	while (lock->slock) {
+	while (!arch_spin_value_unlocked(ACCESS_ONCE(*lock))) {
 		HMT_low();
 		if (SHARED_PROCESSOR)
 			__spin_yield(lock);
@@ -83,3 +177,4 @@ void arch_spin_unlock_wait(arch_spinlock_t *lock)
 }
 
 EXPORT_SYMBOL(arch_spin_unlock_wait);
+#endif
@@ -0,0 +1,61 @@
+/*
+ *  S390 queue spinlock support
+ *
+ *  The generic queue spinlock code is used with a waiting loop that
+ *  does a directed yield to the lock holder with diagnose 0x9c instead
+ *  of the diagnose 0x44 of cpu_relax() on every iteration.
+ */
+
+#ifndef __ASM_QSPINLOCK_H
+#define __ASM_QSPINLOCK_H
+
+#include <asm-generic/qspinlock_types.h>
+#include <asm/barrier.h>
+
+/*
+ * The locked byte is the least significant byte of the lock word.
+ */
+#define _Q_LOCKED_BYTE	3
+
+extern int spin_retry;
+
+void arch_spin_relax(arch_spinlock_t *lock);
+
+#define queue_spin_unlock queue_spin_unlock
+/**
+ * queue_spin_unlock - release a queue spinlock
+ * @lock : Pointer to queue spinlock structure
+ */
+static inline void queue_spin_unlock(struct qspinlock *lock)
+{
+	smp_store_release((u8 *)lock + _Q_LOCKED_BYTE, 0);
+}
+
+#define queue_spin_wait_clear queue_spin_wait_clear
+/**
+ * queue_spin_wait_clear - wait until the given bits of the lock are clear
+ * @lock: Pointer to queue spinlock structure
+ * @mask: The bits of the lock word to wait for
+ * Return: the last lock value read, with the given bits cleared
+ *
+ * Loop spin_retry times on the lock value, then yield to the lock holder
+ * if its virtual cpu isn't running.
+ */
+static __always_inline u32
+queue_spin_wait_clear(struct qspinlock *lock, u32 mask)
+{
+	int count = spin_retry;
+	u32 val;
+
+	while ((val = smp_load_acquire(&lock->val.counter)) & mask) {
+		if (count-- > 0)
+			continue;
+		arch_spin_relax(lock);
+		count = spin_retry;
+	}
+	return val;
+}
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* __ASM_QSPINLOCK_H */
@@ -39,6 +39,15 @@ _raw_compare_and_swap(unsigned int *lock, unsigned int old, unsigned int new)
 
 void arch_lock_relax(unsigned int cpu);
 
+static inline u32 arch_spin_lockval(int cpu)
+{
+	return ~cpu;
+}
+
+#ifdef CONFIG_QUEUE_SPINLOCK
+#include <asm/qspinlock.h>
+#else
+
 void arch_spin_lock_wait(arch_spinlock_t *);
 int arch_spin_trylock_retry(arch_spinlock_t *);
 void arch_spin_lock_wait_flags(arch_spinlock_t *, unsigned long flags);
@@ -48,11 +57,6 @@ static inline void arch_spin_relax(arch_spinlock_t *lock)
 	arch_lock_relax(lock->lock);
 }
 
-static inline u32 arch_spin_lockval(int cpu)
-{
-	return ~cpu;
-}
-
 static inline int arch_spin_value_unlocked(arch_spinlock_t lock)
 {
 	return lock.lock == 0;
@@ -106,6 +110,7 @@ static inline void arch_spin_unlock_wait(arch_spinlock_t *lock)
 	while (arch_spin_is_locked(lock))
 		arch_spin_relax(lock);
 }
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 /*
  * Read-write spinlocks, allowing multiple readers
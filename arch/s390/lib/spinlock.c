@@ -24,6 +24,20 @@ static int __init spin_retry_setup(char *str)
 }
 __setup("spin_retry=", spin_retry_setup);
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+/*
+ * Yield to the holder of a queue spinlock. The holder is only known if
+ * the lock has been taken in the slowpath.
+ */
+void arch_spin_relax(arch_spinlock_t *lp)
+{
+	int owner = queue_spin_owner(lp);
+
+	if (owner >= 0)
+		arch_lock_relax(arch_spin_lockval(owner));
+}
+EXPORT_SYMBOL(arch_spin_relax);
+#else
 void arch_spin_lock_wait(arch_spinlock_t *lp)
 {
 	unsigned int cpu = SPINLOCK_LOCKVAL;
@@ -108,6 +122,7 @@ int arch_spin_trylock_retry(arch_spinlock_t *lp)
 	return 0;
 }
 EXPORT_SYMBOL(arch_spin_trylock_retry);
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 void _raw_read_lock_wait(arch_rwlock_t *rw)
 {
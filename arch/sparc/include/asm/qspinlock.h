@@ -0,0 +1,98 @@
+/* qspinlock.h: 64-bit Sparc queue spinlock support.
+ *
+ * The generic queue spinlock code is used with the following changes:
+ *  - the unlock is a plain store of the locked byte, the kernel runs in
+ *    TSO so no membar is needed for the release;
+ *  - there are no byte or halfword atomics other than ldstub, so the tail
+ *    is exchanged with a cas loop on the lock word that keeps the locked
+ *    and pending bytes intact;
+ *  - the queue head and the pending waiter back off exponentially between
+ *    the reads of the lock word. With up to 8 strands per core, a strand
+ *    spinning flat out takes issue slots from its siblings, one of which
+ *    may well be the lock holder.
+ */
+
+#ifndef __SPARC64_QSPINLOCK_H
+#define __SPARC64_QSPINLOCK_H
+
+#include <asm-generic/qspinlock_types.h>
+#include <asm/barrier.h>
+
+/*
+ * The locked byte is the least significant byte of the lock word.
+ */
+#define _Q_LOCKED_BYTE	3
+
+#define queue_spin_unlock queue_spin_unlock
+/**
+ * queue_spin_unlock - release a queue spinlock
+ * @lock : Pointer to queue spinlock structure
+ */
+static inline void queue_spin_unlock(struct qspinlock *lock)
+{
+	smp_store_release((u8 *)lock + _Q_LOCKED_BYTE, 0);
+}
+
+#define queue_spin_xchg_tail queue_spin_xchg_tail
+/**
+ * queue_spin_xchg_tail - exchange the tail of the lock word
+ * @lock: Pointer to queue spinlock structure
+ * @tail: The new queue tail code word
+ * Return: The previous queue tail code word
+ *
+ * A concurrent change of the locked or pending byte makes the cas fail
+ * and the loop retry with the new value.
+ */
+static __always_inline u32
+queue_spin_xchg_tail(struct qspinlock *lock, u32 tail)
+{
+	unsigned long prev, tmp;
+
+	__asm__ __volatile__(
+"1:	lduw		[%2], %0\n"
+"	and		%0, %3, %1\n"
+"	or		%1, %4, %1\n"
+"	cas		[%2], %0, %1\n"
+"	cmp		%0, %1\n"
+"	bne,pn		%%icc, 1b\n"
+"	 nop"
+	: "=&r" (prev), "=&r" (tmp)
+	: "r" (&lock->val.counter), "r" (_Q_LOCKED_MASK | _Q_PENDING_MASK),
+	  "r" (tail)
+	: "cc", "memory");
+
+	return prev & _Q_TAIL_MASK;
+}
+
+/*
+ * Maximum number of cpu_relax() between two reads of the lock word. It is
+ * a pause of 128 cycles on the chips that have one, so the handover to a
+ * waiting queue head is delayed by about a thousand cycles at most.
+ */
+#define QSPIN_BACKOFF_MAX	8
+
+#define queue_spin_wait_clear queue_spin_wait_clear
+/**
+ * queue_spin_wait_clear - wait until the given bits of the lock are clear
+ * @lock: Pointer to queue spinlock structure
+ * @mask: The bits of the lock word to wait for
+ * Return: the last lock value read, with the given bits cleared
+ */
+static __always_inline u32
+queue_spin_wait_clear(struct qspinlock *lock, u32 mask)
+{
+	unsigned int backoff = 1, i;
+	u32 val;
+
+	while ((val = smp_load_acquire(&lock->val.counter)) & mask) {
+		for (i = 0; i < backoff; i++)
+			cpu_relax();
+		if (backoff < QSPIN_BACKOFF_MAX)
+			backoff <<= 1;
+	}
+	return val;
+}
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* !(__SPARC64_QSPINLOCK_H) */
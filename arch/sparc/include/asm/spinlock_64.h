@@ -21,6 +21,10 @@
  * the spinner sections must be pre-V9 branches.
  */
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+#include <asm/qspinlock.h>
+#else
+
 #define arch_spin_is_locked(lp)	((lp)->lock != 0)
 
 #define arch_spin_unlock_wait(lp)	\
@@ -89,6 +93,7 @@ static inline void arch_spin_lock_flags(arch_spinlock_t *lock, unsigned long fla
 	: "r"(lock), "r"(flags)
 	: "memory");
 }
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 /* Multi-reader locks, these are much saner than the 32-bit Sparc ones... */
 
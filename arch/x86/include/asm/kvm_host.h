@@ -43,6 +43,8 @@
 #define KVM_PIO_PAGE_OFFSET 1
 #define KVM_COALESCED_MMIO_PAGE_OFFSET 2
 
+#define __KVM_HAVE_ARCH_SPIN_YIELD
+
 #define KVM_IRQCHIP_NUM_PINS  KVM_IOAPIC_NUM_PINS
 
 #define CR0_RESERVED_BITS                                               \
@@ -440,6 +442,9 @@ struct kvm_vcpu_arch {
 		u64 accum_steal;
 		struct gfn_to_hva_cache stime;
 		struct kvm_steal_time steal;
+		u64 grace_start;	/* lock holder grace period start */
+		bool grace_used;	/* not scheduled out since a grace */
+		bool qhead;		/* preempted as a lock queue head */
 	} st;
 
 	u64 last_guest_tsc;
@@ -526,6 +531,9 @@ struct kvm_vcpu_arch {
 	/* pv related host specific info */
 	struct {
 		bool pv_unhalted;
+		u64 kick_ns;	/* time of the last direct PV kick */
+		u64 halt_ns;	/* time of the last PV lock wait block */
+		unsigned int poll_ns;	/* PV lock wait poll window */
 	} pv;
 };
 
@@ -600,6 +608,9 @@ struct kvm_arch {
 	struct delayed_work kvmclock_update_work;
 	struct delayed_work kvmclock_sync_work;
 
+	/* max preemption delay of a vCPU holding a contended spinlock */
+	u32 lock_holder_grace_ns;
+
 	struct kvm_xen_hvm_config xen_hvm_config;
 
 	/* fields used by HYPER-V emulation */
@@ -639,6 +650,10 @@ struct kvm_vcpu_stat {
 	u32 nmi_window_exits;
 	u32 halt_exits;
 	u32 halt_wakeup;
+	u32 pv_halt_poll;
+	u32 spin_waitfor_yield;
+	u32 lock_holder_grace;
+	u32 qhead_boost;
 	u32 request_irq_exits;
 	u32 irq_exits;
 	u32 host_state_reload;
@@ -0,0 +1,66 @@
+#ifndef _ASM_X86_MCS_SPINLOCK_H
+#define _ASM_X86_MCS_SPINLOCK_H
+
+#ifdef CONFIG_SMP
+#include <linux/jump_label.h>
+#include <asm/barrier.h>
+#include <asm/mwait.h>
+
+extern struct static_key mcs_mwait_enabled;
+extern struct static_key mcs_smt_backoff_enabled;
+
+/*
+ * Upper bound of the number of PAUSEs between two checks of the node in
+ * the SMT backoff mode, which also bounds the added handoff latency.
+ */
+#define MCS_SMT_BACKOFF_MAX	64
+
+/*
+ * MCS spin-locking.
+ *
+ * When enabled, the waiters arm MONITOR on the cacheline of their own
+ * queue node and MWAIT in C1 until the lock is passed to them. The store
+ * to node->locked in arch_mcs_spin_unlock_contended() will break them out
+ * of MWAIT, so the unlock side is unchanged. This saves power on deep
+ * queues and gives the pipeline to the SMT sibling.
+ *
+ * The lock value is checked again after arming MONITOR so that a store
+ * that happens in between won't be missed.
+ *
+ * Without MWAIT, the SMT backoff mode doubles the number of PAUSEs between
+ * two checks of the node, up to MCS_SMT_BACKOFF_MAX, so that the waiters
+ * behind the queue head leave most of the issue slots to their SMT
+ * siblings. They can't get the lock before the queue head anyway, which
+ * spins on the lock word in the qspinlock slowpath and isn't slowed down.
+ */
+static __always_inline void x86_mcs_spin_lock_contended(int *l)
+{
+	unsigned int i, delay = 1;
+
+	if (static_key_false(&mcs_mwait_enabled)) {
+		while (!(smp_load_acquire(l))) {
+			__monitor(l, 0, 0);
+			if (!ACCESS_ONCE(*l))
+				__mwait(0, 0);
+		}
+		return;
+	}
+
+	if (static_key_false(&mcs_smt_backoff_enabled)) {
+		while (!(smp_load_acquire(l))) {
+			for (i = 0; i < delay; i++)
+				cpu_relax();
+			if (delay < MCS_SMT_BACKOFF_MAX)
+				delay <<= 1;
+		}
+		return;
+	}
+
+	while (!(smp_load_acquire(l)))
+		cpu_relax_lowlatency();
+}
+
+#define arch_mcs_spin_lock_contended(l)	x86_mcs_spin_lock_contended(l)
+
+#endif	/* CONFIG_SMP */
+#endif	/* _ASM_X86_MCS_SPINLOCK_H */
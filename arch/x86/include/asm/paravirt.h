@@ -714,11 +714,29 @@ static inline void __set_fixmap(unsigned /* enum fixed_addresses */ idx,
 
 #ifdef CONFIG_QUEUE_SPINLOCK
 
+extern bool pv_is_native_queue_unlock(void);
+
+static __always_inline void pv_queue_lock_slowpath(struct qspinlock *lock,
+						   u32 val)
+{
+	PVOP_VCALL2(pv_lock_ops.queue_lock_slowpath, lock, val);
+}
+
+static __always_inline void pv_queue_spin_unlock(struct qspinlock *lock)
+{
+	PVOP_VCALLEE1(pv_lock_ops.queue_unlock, lock);
+}
+
 static __always_inline void pv_kick_cpu(int cpu)
 {
 	PVOP_VCALLEE1(pv_lock_ops.kick_cpu, cpu);
 }
 
+static __always_inline void pv_kick_cpus(int *cpus, int nr)
+{
+	PVOP_VCALL2(pv_lock_ops.kick_cpus, cpus, nr);
+}
+
 static __always_inline void pv_lockwait(u8 *lockbyte)
 {
 	PVOP_VCALLEE1(pv_lock_ops.lockwait, lockbyte);
@@ -729,6 +747,26 @@ static __always_inline void pv_lockstat(enum pv_lock_stats type)
 	PVOP_VCALLEE1(pv_lock_ops.lockstat, type);
 }
 
+static __always_inline bool pv_vcpu_is_preempted(int cpu)
+{
+	return PVOP_CALLEE1(bool, pv_lock_ops.vcpu_is_preempted, cpu);
+}
+
+static __always_inline bool pv_yield_to_cpu(int cpu)
+{
+	return PVOP_CALLEE1(bool, pv_lock_ops.yield_to_cpu, cpu);
+}
+
+static __always_inline void pv_wait_for_cpu(int cpu, bool qhead)
+{
+	PVOP_VCALLEE2(pv_lock_ops.wait_for_cpu, cpu, qhead);
+}
+
+static __always_inline void pv_lock_held(int nr)
+{
+	PVOP_VCALLEE1(pv_lock_ops.lock_held, nr);
+}
+
 #else
 static __always_inline void __ticket_lock_spinning(struct arch_spinlock *lock,
 							__ticket_t ticket)
@@ -336,22 +336,18 @@ struct arch_spinlock;
 typedef u16 __ticket_t;
 #endif
 
-#ifdef CONFIG_QUEUE_SPINLOCK
-enum pv_lock_stats {
-	PV_HALT_QHEAD,		/* Queue head halting	    */
-	PV_HALT_QNODE,		/* Other queue node halting */
-	PV_HALT_ABORT,		/* Halting aborted	    */
-	PV_WAKE_KICKED,		/* Wakeup by kicking	    */
-	PV_WAKE_SPURIOUS,	/* Spurious wakeup	    */
-	PV_KICK_NOHALT		/* Kick but CPU not halted  */
-};
-#endif
-
 struct pv_lock_ops {
 #ifdef CONFIG_QUEUE_SPINLOCK
+	void (*queue_lock_slowpath)(struct qspinlock *lock, u32 val);
+	struct paravirt_callee_save queue_unlock;
 	struct paravirt_callee_save kick_cpu;
 	struct paravirt_callee_save lockstat;
 	struct paravirt_callee_save lockwait;
+	struct paravirt_callee_save vcpu_is_preempted;
+	struct paravirt_callee_save yield_to_cpu;
+	struct paravirt_callee_save wait_for_cpu;
+	struct paravirt_callee_save lock_held;
+	void (*kick_cpus)(int *cpus, int nr);
 #else
 	struct paravirt_callee_save lock_spinning;
 	void (*unlock_kick)(struct arch_spinlock *lock, __ticket_t ticket);
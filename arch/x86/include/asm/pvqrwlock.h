@@ -0,0 +1,98 @@
+#ifndef _ASM_X86_PVQRWLOCK_H
+#define _ASM_X86_PVQRWLOCK_H
+
+/*
+ *	Queue Read/Write Lock Para-Virtualization (PV) Support
+ *
+ * Only the head of the rwlock wait queue, i.e. the holder of the internal
+ * queue spinlock, spins on the lock word. The other waiters spin on the
+ * internal queue spinlock which is already PV aware. So only the queue
+ * head needs to be taken care of here. After spinning for a while, the
+ * queue head will halt in one of the following cases:
+ *  1) A writer waiting for the readers to drain.
+ *  2) A writer waiting for another writer to release the lock.
+ *  3) A reader waiting for a writer to release the lock.
+ *
+ * As the rwlock can be released in the unlock fastpath, a halted queue
+ * head is advertised by setting the _QW_PVHALT flag in the lock word.
+ * The writer unlocker as well as the last reader leaving the lock will
+ * check for that flag and kick the halted CPU. The flag is only set and
+ * cleared by the queue head.
+ *
+ * The halted queue head is found by scanning the (normally very small)
+ * set of CPUs that are currently halted on a rwlock.
+ *
+ * There is a race between the halting of the queue head and the kicking
+ * by the unlocker. The queue head records the lock that it waits on
+ * before atomically setting the _QW_PVHALT flag with the lock word value
+ * that it last sees. So either the unlocker will see the flag and find
+ * the halting CPU, or the queue head will see the lock word change and
+ * not halt. A kick that comes before the actual halt will make the halt
+ * return immediately.
+ */
+
+static DEFINE_PER_CPU(struct qrwlock *, pv_rwlock_waiting);
+static struct cpumask pv_rwlock_halted;
+
+/**
+ * pv_rwlock_halt - halt the queue head until kicked by the unlocker
+ * @lock: Pointer to queue rwlock structure
+ * @cnts: The lock word value that the queue head is waiting on
+ */
+static void pv_rwlock_halt(struct qrwlock *lock, u32 cnts)
+{
+	int cpu = smp_processor_id();
+
+	this_cpu_write(pv_rwlock_waiting, lock);
+	cpumask_set_cpu(cpu, &pv_rwlock_halted);
+	smp_mb__after_atomic();
+
+	/*
+	 * Don't halt if the lock word has been changed, even if the flag has
+	 * been set in a previous round of halting.
+	 */
+	if (atomic_cmpxchg(&lock->cnts, cnts, cnts | _QW_PVHALT) == cnts)
+		pv_lockwait(NULL);
+
+	cpumask_clear_cpu(cpu, &pv_rwlock_halted);
+	this_cpu_write(pv_rwlock_waiting, NULL);
+}
+
+/**
+ * pv_rwlock_wait - spin or halt while waiting for the lock word to change
+ * @lock : Pointer to queue rwlock structure
+ * @cnts : The current lock word value
+ * @count: Pointer to the spin loop count
+ */
+static __always_inline void
+pv_rwlock_wait(struct qrwlock *lock, u32 cnts, int *count)
+{
+	if (likely(++(*count) < SPIN_THRESHOLD)) {
+		cpu_relax_lowlatency();
+		return;
+	}
+	pv_rwlock_halt(lock, cnts);
+	*count = 0;
+}
+
+/**
+ * queue_rwlock_unlock_slowpath - kick up the halted queue head
+ * @lock : Pointer to queue rwlock structure
+ *
+ * Called by the unlocker when the _QW_PVHALT flag is seen after the lock
+ * word is changed.
+ */
+void queue_rwlock_unlock_slowpath(struct qrwlock *lock)
+{
+	int cpu;
+
+	for_each_cpu(cpu, &pv_rwlock_halted) {
+		if (ACCESS_ONCE(per_cpu(pv_rwlock_waiting, cpu)) == lock) {
+			pv_kick_cpu(cpu);
+			break;
+		}
+	}
+}
+EXPORT_SYMBOL(queue_rwlock_unlock_slowpath);
+
+#endif /* _ASM_X86_PVQRWLOCK_H */
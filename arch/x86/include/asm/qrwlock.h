@@ -3,7 +3,19 @@
 
 #include <asm-generic/qrwlock_types.h>
 
-#ifndef CONFIG_X86_PPRO_FENCE
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUE_SPINLOCK)
+/*
+ * The unlockers have to check for a halted queue head when the PV
+ * spinlocks are enabled. The functions are defined after the generic
+ * header as the lock word definitions are needed.
+ */
+#define queue_read_unlock queue_read_unlock
+#define queue_write_unlock queue_write_unlock
+static inline void queue_read_unlock(struct qrwlock *lock);
+static inline void queue_write_unlock(struct qrwlock *lock);
+
+extern void queue_rwlock_unlock_slowpath(struct qrwlock *lock);
+#elif !defined(CONFIG_X86_PPRO_FENCE)
 #define queue_write_unlock queue_write_unlock
 static inline void queue_write_unlock(struct qrwlock *lock)
 {
@@ -14,4 +26,47 @@ static inline void queue_write_unlock(struct qrwlock *lock)
 
 #include <asm-generic/qrwlock.h>
 
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUE_SPINLOCK)
+/**
+ * queue_read_unlock - release read lock of a queue rwlock
+ * @lock : Pointer to queue rwlock structure
+ *
+ * The last reader will kick the halted queue head, if any.
+ */
+static inline void queue_read_unlock(struct qrwlock *lock)
+{
+	u32 cnts;
+
+	if (!static_key_false(&paravirt_spinlocks_enabled)) {
+		smp_mb__before_atomic();
+		atomic_sub(_QR_BIAS, &lock->cnts);
+		return;
+	}
+
+	cnts = atomic_sub_return(_QR_BIAS, &lock->cnts);
+	if (unlikely((cnts & ~_QW_WMASK) == _QW_PVHALT))
+		queue_rwlock_unlock_slowpath(lock);
+}
+
+/**
+ * queue_write_unlock - release write lock of a queue rwlock
+ * @lock : Pointer to queue rwlock structure
+ *
+ * An atomic subtraction is needed instead of a byte store to see if the
+ * queue head has halted.
+ */
+static inline void queue_write_unlock(struct qrwlock *lock)
+{
+	if (!IS_ENABLED(CONFIG_X86_PPRO_FENCE) &&
+	    !static_key_false(&paravirt_spinlocks_enabled)) {
+		barrier();
+		ACCESS_ONCE(*(u8 *)&lock->cnts) = 0;
+		return;
+	}
+
+	if (unlikely(atomic_sub_return(_QW_LOCKED, &lock->cnts) & _QW_PVHALT))
+		queue_rwlock_unlock_slowpath(lock);
+}
+#endif /* CONFIG_PARAVIRT_SPINLOCKS && CONFIG_QUEUE_SPINLOCK */
+
 #endif /* _ASM_X86_QRWLOCK_H */
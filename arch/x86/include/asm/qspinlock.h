@@ -19,14 +19,7 @@ static __always_inline void native_spin_unlock(struct qspinlock *lock)
 
 #define	queue_spin_unlock queue_spin_unlock
 #ifdef CONFIG_PARAVIRT_SPINLOCKS
-/*
- * The lock byte can have a value of _Q_LOCKED_SLOWPATH to indicate
- * that it needs to go through the slowpath to do the unlocking.
- */
-#define _Q_LOCKED_SLOWPATH	(_Q_LOCKED_VAL | 2)
-
-extern void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val);
-extern void pv_queue_spin_lock_slowpath(struct qspinlock *lock, u32 val);
+#include <asm-generic/qspinlock_paravirt.h>
 
 /*
  * Paravirtualized versions of queue_spin_lock and queue_spin_unlock
@@ -37,7 +30,10 @@ extern void pv_queue_spin_lock_slowpath(struct qspinlock *lock, u32 val);
  * queue_spin_lock - acquire a queue spinlock
  * @lock: Pointer to queue spinlock structure
  *
- * N.B. INLINE_SPIN_LOCK should not be enabled when PARAVIRT_SPINLOCK is on.
+ * The slowpath is a pv_lock_ops call site that is patched into a direct
+ * call to queue_spin_lock_slowpath(), or to pv_queue_spin_lock_slowpath()
+ * once a PV backend has called pv_init_queue_spinlock(), so the fastpath
+ * is the same as without CONFIG_PARAVIRT_SPINLOCKS.
  */
 static __always_inline void queue_spin_lock(struct qspinlock *lock)
 {
@@ -46,38 +42,38 @@ static __always_inline void queue_spin_lock(struct qspinlock *lock)
 	val = atomic_cmpxchg(&lock->val, 0, _Q_LOCKED_VAL);
 	if (likely(val == 0))
 		return;
-	if (static_key_false(&paravirt_spinlocks_enabled))
-		pv_queue_spin_lock_slowpath(lock, val);
-	else
-		queue_spin_lock_slowpath(lock, val);
+	pv_queue_lock_slowpath(lock, val);
 }
 
-extern void queue_spin_unlock_slowpath(struct qspinlock *lock);
+extern void pv_init_queue_spinlock(void);
+
+/*
+ * The queue nodes behind the head spin on their own cacheline and halt
+ * shortly. Under a hypervisor, they do so without PAUSE so that they don't
+ * take pause loop exits, which would only boost other vCPUs at random.
+ */
+static __always_inline void pv_queue_relax(void)
+{
+	if (static_cpu_has(X86_FEATURE_HYPERVISOR))
+		barrier();
+	else
+		cpu_relax();
+}
+#define pv_queue_relax pv_queue_relax
 
 /**
  * queue_spin_unlock - release a queue spinlock
  * @lock : Pointer to queue spinlock structure
  *
- * An effective smp_store_release() on the least-significant byte.
- *
- * Inlining of the unlock function is disabled when CONFIG_PARAVIRT_SPINLOCKS
- * is defined. So _raw_spin_unlock() will be the only call site that will
- * have to be patched.
+ * The unlock is a pv_lock_ops call site that is patched into the plain
+ * byte store of native_spin_unlock() unless a PV backend has installed
+ * the unlock with the slowpath flag check by pv_init_queue_spinlock().
+ * Every call site is patched, in modules too, so the unlock may be
+ * inlined as without CONFIG_PARAVIRT_SPINLOCKS.
  */
 static inline void queue_spin_unlock(struct qspinlock *lock)
 {
-	barrier();
-	if (!static_key_false(&paravirt_spinlocks_enabled)) {
-		native_spin_unlock(lock);
-		return;
-	}
-
-	/*
-	 * Need to atomically clear the lock byte to avoid racing with
-	 * queue head waiter trying to set _QLOCK_LOCKED_SLOWPATH.
-	 */
-	if (unlikely(cmpxchg((u8 *)lock, _Q_LOCKED_VAL, 0) != _Q_LOCKED_VAL))
-		queue_spin_unlock_slowpath(lock);
+	pv_queue_spin_unlock(lock);
 }
 #else
 static inline void queue_spin_unlock(struct qspinlock *lock)
@@ -86,11 +82,32 @@ static inline void queue_spin_unlock(struct qspinlock *lock)
 }
 #endif /* CONFIG_PARAVIRT_SPINLOCKS */
 
+/*
+ * Lock stealing modes of guests running without PV spinlocks, selected
+ * with the "virt_spinlock" kernel parameter.
+ */
+enum virt_spin_mode {
+	VIRT_SPIN_UNFAIR,	/* Test-and-set lock			*/
+	VIRT_SPIN_HYBRID,	/* Queue lock with bounded stealing	*/
+	VIRT_SPIN_FAIR,		/* Queue lock without stealing		*/
+};
+
+extern enum virt_spin_mode virt_spin_mode;
+
+#define virt_queue_spin_steal virt_queue_spin_steal
+
+static inline bool virt_queue_spin_steal(void)
+{
+	return static_cpu_has(X86_FEATURE_HYPERVISOR) &&
+	       (virt_spin_mode == VIRT_SPIN_HYBRID);
+}
+
 #define virt_queue_spin_lock virt_queue_spin_lock
 
 static inline bool virt_queue_spin_lock(struct qspinlock *lock)
 {
-	if (!static_cpu_has(X86_FEATURE_HYPERVISOR))
+	if (!static_cpu_has(X86_FEATURE_HYPERVISOR) ||
+	    (virt_spin_mode != VIRT_SPIN_UNFAIR))
 		return false;
 
 	while (atomic_cmpxchg(&lock->val, 0, _Q_LOCKED_VAL) != 0)
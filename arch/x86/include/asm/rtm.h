@@ -0,0 +1,53 @@
+#ifndef _ASM_X86_RTM_H
+#define _ASM_X86_RTM_H
+
+/*
+ * Restricted Transactional Memory instructions, encoded as bytes so that
+ * they don't depend on the assembler version.
+ *
+ * rtm_xbegin() returns _XBEGIN_STARTED when the transaction has started,
+ * and the abort status when it has been aborted. After an abort, all the
+ * memory and register state of the transaction is rolled back and the
+ * execution resumes as if rtm_xbegin() had just returned the status.
+ */
+#include <linux/compiler.h>
+#include <asm/cpufeature.h>
+
+#define arch_has_rtm()		static_cpu_has(X86_FEATURE_RTM)
+
+#define _XBEGIN_STARTED		(~0u)
+#define _XABORT_EXPLICIT	(1 << 0)
+#define _XABORT_RETRY		(1 << 1)
+#define _XABORT_CONFLICT	(1 << 2)
+#define _XABORT_CAPACITY	(1 << 3)
+#define _XABORT_DEBUG		(1 << 4)
+#define _XABORT_NESTED		(1 << 5)
+#define _XABORT_CODE(x)		(((x) >> 24) & 0xff)
+
+static __always_inline unsigned int rtm_xbegin(void)
+{
+	unsigned int status = _XBEGIN_STARTED;
+
+	asm volatile(".byte 0xc7,0xf8 ; .long 0" : "+a" (status) : : "memory");
+	return status;
+}
+
+static __always_inline void rtm_xend(void)
+{
+	asm volatile(".byte 0x0f,0x01,0xd5" : : : "memory");
+}
+
+/* The abort code has to be a constant */
+#define rtm_xabort(code)						\
+	asm volatile(".byte 0xc6,0xf8,%P0" : : "i" (code) : "memory")
+
+static __always_inline bool rtm_xtest(void)
+{
+	unsigned char in_tx;
+
+	asm volatile(".byte 0x0f,0x01,0xd6 ; setnz %0"
+		     : "=r" (in_tx) : : "memory");
+	return in_tx;
+}
+
+#endif /* _ASM_X86_RTM_H */
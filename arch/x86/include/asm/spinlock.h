@@ -42,6 +42,12 @@
 extern struct static_key paravirt_spinlocks_enabled;
 static __always_inline bool static_key_false(struct static_key *key);
 
+#ifdef CONFIG_QUEUE_SPINLOCK_IDLE_WAIT
+extern void qspinlock_idle_init(void);
+#else
+static inline void qspinlock_idle_init(void) { }
+#endif
+
 #ifdef CONFIG_QUEUE_SPINLOCK
 #include <asm/qspinlock.h>
 #else
@@ -184,13 +190,13 @@ static __always_inline void arch_spin_lock_flags(arch_spinlock_t *lock,
 {
 	arch_spin_lock(lock);
 }
-#endif /* CONFIG_QUEUE_SPINLOCK */
 
 static inline void arch_spin_unlock_wait(arch_spinlock_t *lock)
 {
 	while (arch_spin_is_locked(lock))
 		cpu_relax();
 }
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 /*
  * Read-write spinlocks, allowing multiple readers
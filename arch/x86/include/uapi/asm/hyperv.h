@@ -158,6 +158,12 @@
 /* MSR used to retrieve the local APIC timer frequency */
 #define HV_X64_MSR_APIC_FREQUENCY		0x40000023
 
+/*
+ * MSR used to put the vCPU into an idle state that is ended by the next
+ * interrupt, even if interrupts are disabled in the guest
+ */
+#define HV_X64_MSR_GUEST_IDLE			0x400000F0
+
 /* Define the virtual APIC registers */
 #define HV_X64_MSR_EOI				0x40000070
 #define HV_X64_MSR_ICR				0x40000071
@@ -193,6 +199,12 @@
 #define HV_X64_MSR_HYPERCALL_PAGE_ADDRESS_MASK	\
 		(~((1ull << HV_X64_MSR_HYPERCALL_PAGE_ADDRESS_SHIFT) - 1))
 
+/*
+ * Recommended number of spinlock retries (EBX of the enlightenment info
+ * leaf) meaning that the hypervisor should never be notified
+ */
+#define HV_X64_SPINLOCK_RETRY_NEVER		0xFFFFFFFF
+
 /* Declare the various hypercall operations. */
 #define HV_X64_HV_NOTIFY_LONG_SPIN_WAIT		0x0008
 
@@ -24,6 +24,13 @@
 #define KVM_FEATURE_STEAL_TIME		5
 #define KVM_FEATURE_PV_EOI		6
 #define KVM_FEATURE_PV_UNHALT		7
+#define KVM_FEATURE_PV_YIELD		8
+#define KVM_FEATURE_PV_LOCKWAIT_HALT	9
+#define KVM_FEATURE_PV_KICK_CPUS	10
+#define KVM_FEATURE_PV_SPIN_WAITFOR	11
+#define KVM_FEATURE_PV_LOCK_HOLDER	12
+#define KVM_FEATURE_PV_QHEAD_BOOST	13
+#define KVM_FEATURE_PV_TLB_FLUSH	14
 
 /* The last 8 bits are used to indicate how to interpret the flags field
  * in pvclock structure. If no bits are set, all flags are ignored.
@@ -45,9 +52,20 @@ struct kvm_steal_time {
 	__u64 steal;
 	__u32 version;
 	__u32 flags;
-	__u32 pad[12];
+	__u8  preempted;
+	__u8  lock_held;	/* # of contended spinlocks held by the vCPU */
+	__u8  preempt_delayed;	/* preemption delayed for lock_held */
+	__u8  u8_pad[1];
+	__u32 spin_waitfor;	/* APIC id + 1 of the awaited lock vCPU, or 0 */
+	__u32 pad[10];
 };
 
+#define KVM_VCPU_PREEMPTED	(1 << 0)
+#define KVM_VCPU_FLUSH_TLB	(1 << 1)	/* flush the TLB on the next entry */
+
+/* spin_waitfor flag of the queue head of a PV spinlock */
+#define KVM_SPIN_WAITFOR_QHEAD	(1U << 31)
+
 #define KVM_STEAL_ALIGNMENT_BITS 5
 #define KVM_STEAL_VALID_BITS ((-1ULL << (KVM_STEAL_ALIGNMENT_BITS + 1)))
 #define KVM_STEAL_RESERVED_MASK (((1 << KVM_STEAL_ALIGNMENT_BITS) - 1 ) << 1)
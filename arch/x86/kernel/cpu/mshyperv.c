@@ -28,6 +28,8 @@
 #include <asm/i8259.h>
 #include <asm/apic.h>
 #include <asm/timer.h>
+#include <asm/paravirt.h>
+#include <asm/smp.h>
 
 struct ms_hyperv_info ms_hyperv;
 EXPORT_SYMBOL_GPL(ms_hyperv);
@@ -109,12 +111,98 @@ static struct clocksource hyperv_cs = {
 	.mask		= CLOCKSOURCE_MASK(64),
 };
 
+#if defined(CONFIG_SMP) && defined(CONFIG_PARAVIRT_SPINLOCKS)
+static bool hv_pvspin = true;
+static bool hv_pvspin_enabled;
+
+/*
+ * Halt the current CPU until kicked. Reading the guest idle MSR makes the
+ * hypervisor deschedule the vCPU until the next interrupt, which also
+ * works with interrupts disabled. The pending kick interrupt is taken
+ * when interrupts are enabled again.
+ */
+__visible void hv_halt_cpu(u8 *lockbyte)
+{
+	unsigned long flags;
+	u64 msr_val;
+
+	if (in_nmi())
+		return;
+
+	local_irq_save(flags);
+	/*
+	 * Don't halt if the lock byte is defined and is free
+	 */
+	if (!lockbyte || ACCESS_ONCE(*lockbyte))
+		rdmsrl(HV_X64_MSR_GUEST_IDLE, msr_val);
+	local_irq_restore(flags);
+}
+PV_CALLEE_SAVE_REGS_THUNK(hv_halt_cpu);
+
+/*
+ * Kick a halted CPU with an IPI to the otherwise unused platform vector.
+ * With the APIC enlightenment, the ICR write is a synthetic MSR access
+ * instead of a trapped MMIO access.
+ */
+__visible void hv_kick_cpu(int cpu)
+{
+	apic->send_IPI_mask(cpumask_of(cpu), X86_PLATFORM_IPI_VECTOR);
+}
+PV_CALLEE_SAVE_REGS_THUNK(hv_kick_cpu);
+
+/*
+ * Setup pv_lock_ops if the hypervisor recommends notifying it of long
+ * spin waits and the guest idle state is available.
+ */
+static void __init hv_init_spinlocks(void)
+{
+	if (!hv_pvspin ||
+	    !(ms_hyperv.misc_features & HV_X64_GUEST_IDLE_STATE_AVAILABLE) ||
+	    (cpuid_ebx(HYPERV_CPUID_ENLIGHTMENT_INFO) ==
+	     HV_X64_SPINLOCK_RETRY_NEVER)) {
+		pr_info("HyperV: PV spinlocks disabled\n");
+		return;
+	}
+	pr_info("HyperV: PV spinlocks enabled\n");
+
+	pv_init_lock_hash();
+	pv_init_queue_spinlock();
+	pv_lock_ops.kick_cpu = PV_CALLEE_SAVE(hv_kick_cpu);
+	pv_lock_ops.lockwait = PV_CALLEE_SAVE(hv_halt_cpu);
+	hv_pvspin_enabled = true;
+}
+
+static void __init hv_smp_prepare_boot_cpu(void)
+{
+	native_smp_prepare_boot_cpu();
+	hv_init_spinlocks();
+}
+
+static __init int hv_init_spinlocks_jump(void)
+{
+	if (!hv_pvspin_enabled)
+		return 0;
+
+	static_key_slow_inc(&paravirt_spinlocks_enabled);
+	return 0;
+}
+early_initcall(hv_init_spinlocks_jump);
+
+static __init int hv_parse_nopvspin(char *arg)
+{
+	hv_pvspin = false;
+	return 0;
+}
+early_param("hv_nopvspin", hv_parse_nopvspin);
+#endif /* CONFIG_SMP && CONFIG_PARAVIRT_SPINLOCKS */
+
 static void __init ms_hyperv_init_platform(void)
 {
 	/*
 	 * Extract the features and hints
 	 */
 	ms_hyperv.features = cpuid_eax(HYPERV_CPUID_FEATURES);
+	ms_hyperv.misc_features = cpuid_edx(HYPERV_CPUID_FEATURES);
 	ms_hyperv.hints    = cpuid_eax(HYPERV_CPUID_ENLIGHTMENT_INFO);
 
 	printk(KERN_INFO "HyperV: features 0x%x, hints 0x%x\n",
@@ -142,6 +230,9 @@ static void __init ms_hyperv_init_platform(void)
 	no_timer_check = 1;
 #endif
 
+#if defined(CONFIG_SMP) && defined(CONFIG_PARAVIRT_SPINLOCKS)
+	smp_ops.smp_prepare_boot_cpu = hv_smp_prepare_boot_cpu;
+#endif
 }
 
 const __refconst struct hypervisor_x86 x86_hyper_ms_hyperv = {
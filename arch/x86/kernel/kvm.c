@@ -35,7 +35,9 @@
 #include <linux/slab.h>
 #include <linux/kprobes.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/nmi.h>
+#include <linux/u64_stats_sync.h>
 #include <asm/timer.h>
 #include <asm/cpu.h>
 #include <asm/traps.h>
@@ -79,6 +81,38 @@ static DEFINE_PER_CPU(struct kvm_vcpu_pv_apf_data, apf_reason) __aligned(64);
 static DEFINE_PER_CPU(struct kvm_steal_time, steal_time) __aligned(64);
 static int has_steal_clock = 0;
 
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUE_SPINLOCK)
+/*
+ * Time spent halted in the PV qspinlock slowpath that the host did not
+ * already report as steal time. It is added to the steal clock, so that
+ * the lock wait halts are not charged to the runtime of the waiting task.
+ */
+struct kvm_lockwait_steal {
+	u64			time;
+	struct u64_stats_sync	syncp;
+};
+static DEFINE_PER_CPU(struct kvm_lockwait_steal, lockwait_steal);
+
+static u64 kvm_lockwait_steal_read(int cpu)
+{
+	struct kvm_lockwait_steal *ls = &per_cpu(lockwait_steal, cpu);
+	unsigned int start;
+	u64 time;
+
+	do {
+		start = u64_stats_fetch_begin(&ls->syncp);
+		time = ls->time;
+	} while (u64_stats_fetch_retry(&ls->syncp, start));
+
+	return time;
+}
+#else
+static inline u64 kvm_lockwait_steal_read(int cpu)
+{
+	return 0;
+}
+#endif
+
 /*
  * No need for any "IO delay" on KVM
  */
@@ -392,7 +426,7 @@ static struct notifier_block kvm_pv_reboot_nb = {
 	.notifier_call = kvm_pv_reboot_notify,
 };
 
-static u64 kvm_steal_clock(int cpu)
+static u64 kvm_host_steal_clock(int cpu)
 {
 	u64 steal;
 	struct kvm_steal_time *src;
@@ -409,6 +443,63 @@ static u64 kvm_steal_clock(int cpu)
 	return steal;
 }
 
+static u64 kvm_steal_clock(int cpu)
+{
+	return kvm_host_steal_clock(cpu) + kvm_lockwait_steal_read(cpu);
+}
+
+#ifdef CONFIG_SMP
+static DEFINE_PER_CPU(cpumask_var_t, kvm_flush_tlb_mask);
+
+/*
+ * Don't IPI the preempted vCPUs and wait for them to run again: have the
+ * host flush their TLB before they do (KVM_FEATURE_PV_TLB_FLUSH). The flag
+ * is only set while the host still reports the vCPU as preempted, the
+ * host clears both atomically before the vCPU enters the guest again.
+ */
+static void kvm_flush_tlb_others(const struct cpumask *cpumask,
+				 struct mm_struct *mm, unsigned long start,
+				 unsigned long end)
+{
+	struct cpumask *flushmask = this_cpu_cpumask_var_ptr(kvm_flush_tlb_mask);
+	struct kvm_steal_time *src;
+	u8 state;
+	int cpu;
+
+	/* Not allocated yet, see kvm_setup_pv_tlb_flush() */
+	if (unlikely(!flushmask)) {
+		native_flush_tlb_others(cpumask, mm, start, end);
+		return;
+	}
+
+	cpumask_copy(flushmask, cpumask);
+	for_each_cpu(cpu, flushmask) {
+		src = &per_cpu(steal_time, cpu);
+		state = ACCESS_ONCE(src->preempted);
+		if ((state & KVM_VCPU_PREEMPTED) &&
+		    cmpxchg(&src->preempted, state,
+			    state | KVM_VCPU_FLUSH_TLB) == state)
+			cpumask_clear_cpu(cpu, flushmask);
+	}
+
+	native_flush_tlb_others(flushmask, mm, start, end);
+}
+
+static int __init kvm_setup_pv_tlb_flush(void)
+{
+	int cpu;
+
+	if (pv_mmu_ops.flush_tlb_others != kvm_flush_tlb_others)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		zalloc_cpumask_var_node(per_cpu_ptr(&kvm_flush_tlb_mask, cpu),
+					GFP_KERNEL, cpu_to_node(cpu));
+	return 0;
+}
+arch_initcall(kvm_setup_pv_tlb_flush);
+#endif
+
 void kvm_disable_steal_time(void)
 {
 	if (!has_steal_clock)
@@ -488,6 +579,13 @@ void __init kvm_guest_init(void)
 		pv_time_ops.steal_clock = kvm_steal_clock;
 	}
 
+#ifdef CONFIG_SMP
+	/* Set before the paravirt call sites are patched */
+	if (kvm_para_has_feature(KVM_FEATURE_PV_TLB_FLUSH) &&
+	    kvm_para_has_feature(KVM_FEATURE_STEAL_TIME))
+		pv_mmu_ops.flush_tlb_others = kvm_flush_tlb_others;
+#endif
+
 	if (kvm_para_has_feature(KVM_FEATURE_PV_EOI))
 		apic_set_eoi_write(kvm_guest_apic_eoi_write);
 
@@ -811,13 +909,32 @@ static void kvm_unlock_kick(struct arch_spinlock *lock, __ticket_t ticket)
 #ifdef CONFIG_KVM_DEBUG_FS
 static struct dentry *d_spin_debug;
 static struct dentry *d_kvm_debug;
-static u32 kick_nohlt_stats;	/* Kick but not halt count	*/
-static u32 halt_qhead_stats;	/* Queue head halting count	*/
-static u32 halt_qnode_stats;	/* Queue node halting count	*/
-static u32 halt_abort_stats;	/* Halting abort count		*/
-static u32 wake_kick_stats;	/* Wakeup by kicking count	*/
-static u32 wake_spur_stats;	/* Spurious wakeup count	*/
-static u64 time_blocked;	/* Total blocking time		*/
+
+static int kvm_spin_threshold_show(struct seq_file *m, void *v)
+{
+	struct pv_spin_adapt sa;
+	int cpu;
+
+	seq_puts(m, "cpu   threshold       grow     shrink    wake_ns\n");
+	for_each_online_cpu(cpu) {
+		pv_get_spin_adapt(cpu, &sa);
+		seq_printf(m, "%3d %11u %10u %10u %10llu\n", cpu,
+			   sa.threshold, sa.grow, sa.shrink, sa.wake_ns);
+	}
+	return 0;
+}
+
+static int kvm_spin_threshold_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kvm_spin_threshold_show, NULL);
+}
+
+static const struct file_operations kvm_spin_threshold_fops = {
+	.open		= kvm_spin_threshold_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
 static int __init kvm_spinlock_debugfs(void)
 {
@@ -829,41 +946,20 @@ static int __init kvm_spinlock_debugfs(void)
 	}
 	d_spin_debug = debugfs_create_dir("spinlocks", d_kvm_debug);
 
-	debugfs_create_u32("kick_nohlt_stats",
-			   0644, d_spin_debug, &kick_nohlt_stats);
-	debugfs_create_u32("halt_qhead_stats",
-			   0644, d_spin_debug, &halt_qhead_stats);
-	debugfs_create_u32("halt_qnode_stats",
-			   0644, d_spin_debug, &halt_qnode_stats);
-	debugfs_create_u32("halt_abort_stats",
-			   0644, d_spin_debug, &halt_abort_stats);
-	debugfs_create_u32("wake_kick_stats",
-			   0644, d_spin_debug, &wake_kick_stats);
-	debugfs_create_u32("wake_spur_stats",
-			   0644, d_spin_debug, &wake_spur_stats);
-	debugfs_create_u64("time_blocked",
-			   0644, d_spin_debug, &time_blocked);
+	pv_lockstat_debugfs(d_spin_debug);
+	debugfs_create_file("spin_threshold",
+			    0444, d_spin_debug, NULL, &kvm_spin_threshold_fops);
 	return 0;
 }
 
 static inline void kvm_halt_stats(enum pv_lock_stats type)
 {
-	if (type == PV_HALT_QHEAD)
-		add_smp(&halt_qhead_stats, 1);
-	else if (type == PV_HALT_QNODE)
-		add_smp(&halt_qnode_stats, 1);
-	else /* type == PV_HALT_ABORT */
-		add_smp(&halt_abort_stats, 1);
+	pv_lockstat_inc(type);
 }
 
 void kvm_lock_stats(enum pv_lock_stats type)
 {
-	if (type == PV_WAKE_KICKED)
-		add_smp(&wake_kick_stats, 1);
-	else if (type == PV_WAKE_SPURIOUS)
-		add_smp(&wake_spur_stats, 1);
-	else /* type == PV_KICK_NOHALT */
-		add_smp(&kick_nohlt_stats, 1);
+	pv_lockstat_inc(type);
 }
 PV_CALLEE_SAVE_REGS_THUNK(kvm_lock_stats);
 
@@ -874,10 +970,7 @@ static inline u64 spin_time_start(void)
 
 static inline void spin_time_accum_blocked(u64 start)
 {
-	u64 delta;
-
-	delta = sched_clock() - start;
-	add_smp(&time_blocked, delta);
+	pv_lockstat_blocked(sched_clock() - start);
 }
 
 fs_initcall(kvm_spinlock_debugfs);
@@ -897,13 +990,59 @@ static inline void spin_time_accum_blocked(u64 start)
 }
 #endif /* CONFIG_KVM_DEBUG_FS */
 
+static bool kvm_lockwait_halt;
+
+/*
+ * Halt with KVM_HC_LOCKWAIT_HALT so that the host can poll for the kick
+ * before blocking. Like safe_halt(), the sti shadow covers the hypercall
+ * if interrupts have to be enabled.
+ */
+static inline void kvm_lockwait_hypercall(bool irqs_on)
+{
+	long ret;
+
+	if (irqs_on)
+		asm volatile("sti; " KVM_HYPERCALL
+			     : "=a"(ret)
+			     : "a"(KVM_HC_LOCKWAIT_HALT)
+			     : "memory");
+	else
+		asm volatile(KVM_HYPERCALL
+			     : "=a"(ret)
+			     : "a"(KVM_HC_LOCKWAIT_HALT)
+			     : "memory");
+}
+
+/*
+ * Account the time halted in kvm_halt_cpu() as steal time. The part of it
+ * that the host spent with the vCPU runnable but not running, e.g. after
+ * the kick, is in the host steal clock already and mustn't count twice.
+ */
+static inline void kvm_lockwait_steal_add(u64 start, u64 host_steal)
+{
+	struct kvm_lockwait_steal *ls = this_cpu_ptr(&lockwait_steal);
+	s64 delta;
+
+	delta = sched_clock() - start;
+	delta -= kvm_host_steal_clock(smp_processor_id()) - host_steal;
+	if (delta <= 0)
+		return;
+
+	u64_stats_update_begin(&ls->syncp);
+	ls->time += delta;
+	u64_stats_update_end(&ls->syncp);
+}
+
 /*
  * Halt the current CPU & release it back to the host
+ *
+ * Never in NMI context, where the queue spinlock waiters back off instead
+ * (see pv_nmi_backoff()). The check is only a safety net.
  */
 void kvm_halt_cpu(u8 *lockbyte)
 {
 	unsigned long flags;
-	u64 start;
+	u64 start, wait = 0, host_steal = 0;
 
 	if (in_nmi())
 		return;
@@ -921,16 +1060,103 @@ void kvm_halt_cpu(u8 *lockbyte)
 		goto out;
 	}
 	start = spin_time_start();
+	if (has_steal_clock) {
+		wait = sched_clock();
+		host_steal = kvm_host_steal_clock(smp_processor_id());
+	}
 	kvm_halt_stats(lockbyte ? PV_HALT_QHEAD : PV_HALT_QNODE);
-	if (arch_irqs_disabled_flags(flags))
+	if (kvm_lockwait_halt)
+		kvm_lockwait_hypercall(!arch_irqs_disabled_flags(flags));
+	else if (arch_irqs_disabled_flags(flags))
 		halt();
 	else
 		safe_halt();
+	if (has_steal_clock)
+		kvm_lockwait_steal_add(wait, host_steal);
 	spin_time_accum_blocked(start);
 out:
 	local_irq_restore(flags);
 }
 PV_CALLEE_SAVE_REGS_THUNK(kvm_halt_cpu);
+
+/*
+ * Kick a number of vCPUs with one KVM_HC_KICK_CPUS hypercall for each
+ * run of apicids that fits into a bitmap of BITS_PER_LONG bits.
+ */
+static void kvm_kick_cpus(int *cpus, int nr)
+{
+	unsigned long map = 0;
+	int i, apicid, min = 0;
+
+	for (i = 0; i < nr; i++) {
+		apicid = per_cpu(x86_cpu_to_apicid, cpus[i]);
+		if (map && (apicid < min || apicid >= min + BITS_PER_LONG)) {
+			kvm_hypercall2(KVM_HC_KICK_CPUS, map, min);
+			map = 0;
+		}
+		if (!map)
+			min = apicid;
+		__set_bit(apicid - min, &map);
+	}
+	if (map)
+		kvm_hypercall2(KVM_HC_KICK_CPUS, map, min);
+}
+
+/*
+ * Check the preempted flag that the host sets in the steal time area
+ * when the vCPU is scheduled out.
+ */
+__visible bool __kvm_vcpu_is_preempted(int cpu)
+{
+	struct kvm_steal_time *src = &per_cpu(steal_time, cpu);
+
+	return !!(ACCESS_ONCE(src->preempted) & KVM_VCPU_PREEMPTED);
+}
+PV_CALLEE_SAVE_REGS_THUNK(__kvm_vcpu_is_preempted);
+
+/*
+ * Directed yield to the given vCPU, normally a preempted lock holder
+ */
+__visible bool kvm_yield_to_cpu(int cpu)
+{
+	int apicid = per_cpu(x86_cpu_to_apicid, cpu);
+
+	return kvm_hypercall2(KVM_HC_YIELD_TO_CPU, 0, apicid) > 0;
+}
+PV_CALLEE_SAVE_REGS_THUNK(kvm_yield_to_cpu);
+
+static bool kvm_qhead_boost __read_mostly;
+
+/*
+ * Publish the vCPU that the lock waiter spins on in the steal time area,
+ * for the host to boost it on a pause loop exit of this vCPU. The queue
+ * head is flagged as such, for the host to run it next when it gets
+ * preempted (KVM_FEATURE_PV_QHEAD_BOOST).
+ */
+__visible void kvm_wait_for_cpu(int cpu, bool qhead)
+{
+	u32 waitfor = (cpu < 0) ? 0 : per_cpu(x86_cpu_to_apicid, cpu) + 1;
+
+	if (qhead && kvm_qhead_boost)
+		waitfor |= KVM_SPIN_WAITFOR_QHEAD;
+	this_cpu_write(steal_time.spin_waitfor, waitfor);
+}
+PV_CALLEE_SAVE_REGS_THUNK(kvm_wait_for_cpu);
+
+/*
+ * Publish the number of contended locks held by this vCPU. The host may
+ * delay preempting us while it is non-zero, and sets preempt_delayed if
+ * it did so; give the CPU back as soon as the last lock is released.
+ */
+__visible void kvm_lock_held(int nr)
+{
+	this_cpu_write(steal_time.lock_held, nr);
+	if (!nr && unlikely(this_cpu_read(steal_time.preempt_delayed))) {
+		this_cpu_write(steal_time.preempt_delayed, 0);
+		kvm_hypercall0(KVM_HC_LOCK_HOLDER_YIELD);
+	}
+}
+PV_CALLEE_SAVE_REGS_THUNK(kvm_lock_held);
 #endif /* !CONFIG_QUEUE_SPINLOCK */
 
 /*
@@ -945,8 +1171,29 @@ void __init kvm_spinlock_init(void)
 		return;
 
 #ifdef CONFIG_QUEUE_SPINLOCK
+	pv_init_lock_hash();
+	pv_init_queue_spinlock();
 	pv_lock_ops.kick_cpu = PV_CALLEE_SAVE(kvm_kick_cpu);
 	pv_lock_ops.lockwait = PV_CALLEE_SAVE(kvm_halt_cpu);
+	if (kvm_para_has_feature(KVM_FEATURE_STEAL_TIME)) {
+		pv_lock_ops.vcpu_is_preempted =
+			PV_CALLEE_SAVE(__kvm_vcpu_is_preempted);
+		if (kvm_para_has_feature(KVM_FEATURE_PV_SPIN_WAITFOR))
+			pv_lock_ops.wait_for_cpu =
+				PV_CALLEE_SAVE(kvm_wait_for_cpu);
+		if (kvm_para_has_feature(KVM_FEATURE_PV_QHEAD_BOOST))
+			kvm_qhead_boost = true;
+		if (kvm_para_has_feature(KVM_FEATURE_PV_LOCK_HOLDER)) {
+			pv_lock_ops.lock_held = PV_CALLEE_SAVE(kvm_lock_held);
+			pv_init_lock_hint();
+		}
+	}
+	if (kvm_para_has_feature(KVM_FEATURE_PV_YIELD))
+		pv_lock_ops.yield_to_cpu = PV_CALLEE_SAVE(kvm_yield_to_cpu);
+	if (kvm_para_has_feature(KVM_FEATURE_PV_LOCKWAIT_HALT))
+		kvm_lockwait_halt = true;
+	if (kvm_para_has_feature(KVM_FEATURE_PV_KICK_CPUS))
+		pv_lock_ops.kick_cpus = kvm_kick_cpus;
 #ifdef CONFIG_KVM_DEBUG_FS
 	pv_lock_ops.lockstat = PV_CALLEE_SAVE(kvm_lock_stats);
 #endif
@@ -8,12 +8,74 @@
 
 #include <asm/paravirt.h>
 
+#if defined(CONFIG_SMP) && defined(CONFIG_QUEUE_SPINLOCK)
+__visible void __native_queue_spin_unlock(struct qspinlock *lock)
+{
+	native_spin_unlock(lock);
+}
+PV_CALLEE_SAVE_REGS_THUNK(__native_queue_spin_unlock);
+
+bool pv_is_native_queue_unlock(void)
+{
+	return pv_lock_ops.queue_unlock.func ==
+		__raw_callee_save___native_queue_spin_unlock;
+}
+
+/*
+ * Need to atomically clear the lock byte to avoid racing with the queue
+ * head waiter trying to set _Q_LOCKED_SLOWPATH.
+ */
+__visible void __pv_queue_spin_unlock(struct qspinlock *lock)
+{
+	if (unlikely(cmpxchg((u8 *)lock, _Q_LOCKED_VAL, 0) != _Q_LOCKED_VAL))
+		queue_spin_unlock_slowpath(lock);
+	pv_lock_released(lock);
+}
+PV_CALLEE_SAVE_REGS_THUNK(__pv_queue_spin_unlock);
+
+/*
+ * Called by the PV backends with the rest of their pv_lock_ops setup,
+ * before the call sites are patched. Without it, the lock slowpath and
+ * unlock call sites are patched into those of the native build.
+ */
+void __init pv_init_queue_spinlock(void)
+{
+	pv_lock_ops.queue_lock_slowpath = pv_queue_spin_lock_slowpath;
+	pv_lock_ops.queue_unlock = PV_CALLEE_SAVE(__pv_queue_spin_unlock);
+}
+
+__visible bool __native_vcpu_is_preempted(int cpu)
+{
+	return false;
+}
+PV_CALLEE_SAVE_REGS_THUNK(__native_vcpu_is_preempted);
+
+__visible bool __native_yield_to_cpu(int cpu)
+{
+	return false;
+}
+PV_CALLEE_SAVE_REGS_THUNK(__native_yield_to_cpu);
+
+static void native_kick_cpus(int *cpus, int nr)
+{
+	while (nr--)
+		pv_kick_cpu(*cpus++);
+}
+#endif
+
 struct pv_lock_ops pv_lock_ops = {
 #ifdef CONFIG_SMP
 #ifdef CONFIG_QUEUE_SPINLOCK
+	.queue_lock_slowpath = queue_spin_lock_slowpath,
+	.queue_unlock = PV_CALLEE_SAVE(__native_queue_spin_unlock),
 	.kick_cpu = __PV_IS_CALLEE_SAVE(paravirt_nop),
 	.lockstat = __PV_IS_CALLEE_SAVE(paravirt_nop),
 	.lockwait = __PV_IS_CALLEE_SAVE(paravirt_nop),
+	.vcpu_is_preempted = PV_CALLEE_SAVE(__native_vcpu_is_preempted),
+	.yield_to_cpu = PV_CALLEE_SAVE(__native_yield_to_cpu),
+	.wait_for_cpu = __PV_IS_CALLEE_SAVE(paravirt_nop),
+	.lock_held = __PV_IS_CALLEE_SAVE(paravirt_nop),
+	.kick_cpus = native_kick_cpus,
 #else
 	.lock_spinning = __PV_IS_CALLEE_SAVE(paravirt_nop),
 	.unlock_kick = paravirt_nop,
@@ -12,6 +12,11 @@ DEF_NATIVE(pv_mmu_ops, read_cr3, "mov %cr3, %eax");
 DEF_NATIVE(pv_cpu_ops, clts, "clts");
 DEF_NATIVE(pv_cpu_ops, read_tsc, "rdtsc");
 
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUE_SPINLOCK) && \
+	!defined(CONFIG_X86_PPRO_FENCE)
+DEF_NATIVE(pv_lock_ops, queue_unlock, "movb $0, (%eax)");
+#endif
+
 unsigned paravirt_patch_ident_32(void *insnbuf, unsigned len)
 {
 	/* arg in %eax, return in %eax */
@@ -48,11 +53,22 @@ unsigned native_patch(u8 type, u16 clobbers, void *ibuf,
 		PATCH_SITE(pv_cpu_ops, clts);
 		PATCH_SITE(pv_cpu_ops, read_tsc);
 
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUE_SPINLOCK) && \
+	!defined(CONFIG_X86_PPRO_FENCE)
+		case PARAVIRT_PATCH(pv_lock_ops.queue_unlock):
+			if (!pv_is_native_queue_unlock())
+				goto patch_default;
+			start = start_pv_lock_ops_queue_unlock;
+			end = end_pv_lock_ops_queue_unlock;
+			goto patch_site;
+#endif
+
 	patch_site:
 		ret = paravirt_patch_insns(ibuf, len, start, end);
 		break;
 
 	default:
+patch_default: __maybe_unused
 		ret = paravirt_patch_default(type, clobbers, ibuf, addr, len);
 		break;
 	}
@@ -19,6 +19,7 @@
 #include <linux/cpuidle.h>
 #include <trace/events/power.h>
 #include <linux/hw_breakpoint.h>
+#include <linux/jump_label.h>
 #include <asm/cpu.h>
 #include <asm/apic.h>
 #include <asm/syscalls.h>
@@ -456,6 +457,87 @@ static int __init idle_setup(char *str)
 }
 early_param("idle", idle_setup);
 
+#ifdef CONFIG_SMP
+/*
+ * MONITOR/MWAIT based waiting of the MCS lock queue nodes, see
+ * asm/mcs_spinlock.h. It is off by default and can be turned on with the
+ * "mcs_mwait=on" boot option on bare metal CPUs with a working MWAIT.
+ */
+struct static_key mcs_mwait_enabled = STATIC_KEY_INIT_FALSE;
+static bool mcs_mwait_option __initdata;
+
+static int __init mcs_mwait_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+	if (!strcmp(str, "on"))
+		mcs_mwait_option = true;
+	else if (!strcmp(str, "off"))
+		mcs_mwait_option = false;
+	else
+		return -EINVAL;
+	return 0;
+}
+early_param("mcs_mwait", mcs_mwait_setup);
+
+static int __init mcs_mwait_init(void)
+{
+	if (!mcs_mwait_option)
+		return 0;
+
+	if (!boot_cpu_has(X86_FEATURE_MWAIT) ||
+	    boot_cpu_has(X86_FEATURE_HYPERVISOR) ||
+	    boot_cpu_has_bug(X86_BUG_CLFLUSH_MONITOR) ||
+	    boot_option_idle_override == IDLE_NOMWAIT) {
+		pr_info("MCS lock MWAIT waiting not supported\n");
+		return 0;
+	}
+
+	static_key_slow_inc(&mcs_mwait_enabled);
+	pr_info("MCS lock waiters use MONITOR/MWAIT\n");
+	return 0;
+}
+early_initcall(mcs_mwait_init);
+
+/*
+ * Exponential backoff of the MCS lock queue nodes, see asm/mcs_spinlock.h.
+ * It is turned on with the "mcs_smt_backoff=on" boot option, and only
+ * takes effect on CPUs with SMT siblings.
+ */
+struct static_key mcs_smt_backoff_enabled = STATIC_KEY_INIT_FALSE;
+static bool mcs_smt_backoff_option __initdata;
+
+static int __init mcs_smt_backoff_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+	if (!strcmp(str, "on"))
+		mcs_smt_backoff_option = true;
+	else if (!strcmp(str, "off"))
+		mcs_smt_backoff_option = false;
+	else
+		return -EINVAL;
+	return 0;
+}
+early_param("mcs_smt_backoff", mcs_smt_backoff_setup);
+
+static int __init mcs_smt_backoff_init(void)
+{
+	if (!mcs_smt_backoff_option)
+		return 0;
+
+	if (smp_num_siblings < 2) {
+		pr_info("MCS lock SMT backoff not needed without SMT\n");
+		return 0;
+	}
+
+	static_key_slow_inc(&mcs_smt_backoff_enabled);
+	pr_info("MCS lock waiters back off for their SMT siblings\n");
+	return 0;
+}
+early_initcall(mcs_smt_backoff_init);
+#endif
+
 unsigned long arch_align_stack(unsigned long sp)
 {
 	if (!(current->personality & ADDR_NO_RANDOMIZE) && randomize_va_space)
@@ -0,0 +1,127 @@
+/*
+ * Idle waiting for the queue spinlock on bare metal
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A backend of the PV lockwait and kick hooks that lets the waiters of
+ * the PV slowpath idle their CPU instead of spinning, once they have
+ * spun past the adaptive threshold. The spinlock waiters are in atomic
+ * context and can't sleep, so the CPU is put in a shallow idle state
+ * while staying on the waiting task:
+ *
+ *  - With MONITOR/MWAIT, the waiter monitors a per-cpu kick word which
+ *    the kicker writes. No IPI is needed, and interrupts still break the
+ *    wait when they are disabled.
+ *  - Otherwise, the waiter halts and is kicked with a reschedule IPI. As
+ *    the IPI can't wake up a CPU halted with interrupts disabled, those
+ *    waiters keep spinning.
+ *
+ * It is enabled with the "qspinlock_idle" kernel parameter and only when
+ * not running under a hypervisor, whose own backend is used instead.
+ */
+#include <linux/hardirq.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/smp.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include <asm/mwait.h>
+#include <asm/paravirt.h>
+#include <asm/processor.h>
+
+static bool qidle_enabled __initdata;
+static bool qidle_mwait __read_mostly;
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(int, qidle_kick);
+
+/*
+ * Idle the current CPU until kicked or interrupted
+ */
+__visible void qidle_wait(u8 *lockbyte)
+{
+	int *kick = this_cpu_ptr(&qidle_kick);
+	unsigned long flags;
+
+	if (in_nmi())
+		return;
+
+	local_irq_save(flags);
+	if (qidle_mwait) {
+		__monitor(kick, 0, 0);
+		/*
+		 * Don't wait if already kicked or if the lock byte is
+		 * defined and is free
+		 */
+		if (!ACCESS_ONCE(*kick) && (!lockbyte || ACCESS_ONCE(*lockbyte)))
+			__mwait(0, MWAIT_ECX_INTERRUPT_BREAK);
+		ACCESS_ONCE(*kick) = 0;
+	} else if (!arch_irqs_disabled_flags(flags) &&
+		   (!lockbyte || ACCESS_ONCE(*lockbyte))) {
+		safe_halt();
+	}
+	local_irq_restore(flags);
+}
+PV_CALLEE_SAVE_REGS_THUNK(qidle_wait);
+
+/*
+ * Kick an idle CPU, the write alone wakes it up from MWAIT
+ */
+__visible void qidle_kick_cpu(int cpu)
+{
+	if (qidle_mwait)
+		ACCESS_ONCE(per_cpu(qidle_kick, cpu)) = 1;
+	else
+		smp_send_reschedule(cpu);
+}
+PV_CALLEE_SAVE_REGS_THUNK(qidle_kick_cpu);
+
+/*
+ * Setup pv_lock_ops for the idle waiting if it has been asked for on bare
+ * metal. MWAIT is only used if interrupts can break it when masked.
+ */
+void __init qspinlock_idle_init(void)
+{
+	if (!qidle_enabled || boot_cpu_has(X86_FEATURE_HYPERVISOR))
+		return;
+
+	qidle_mwait = boot_cpu_has(X86_FEATURE_MWAIT) &&
+		      !boot_cpu_has_bug(X86_BUG_CLFLUSH_MONITOR) &&
+		      boot_cpu_data.cpuid_level >= CPUID_MWAIT_LEAF &&
+		      (cpuid_ecx(CPUID_MWAIT_LEAF) & CPUID5_ECX_INTERRUPT_BREAK);
+	printk(KERN_INFO "Queue spinlock idle waiting with %s\n",
+	       qidle_mwait ? "mwait" : "halt");
+
+	pv_init_lock_hash();
+	pv_init_queue_spinlock();
+	pv_lock_ops.kick_cpu = PV_CALLEE_SAVE(qidle_kick_cpu);
+	pv_lock_ops.lockwait = PV_CALLEE_SAVE(qidle_wait);
+}
+
+static __init int qspinlock_idle_init_jump(void)
+{
+	if (!qidle_enabled || boot_cpu_has(X86_FEATURE_HYPERVISOR))
+		return 0;
+
+	static_key_slow_inc(&paravirt_spinlocks_enabled);
+	return 0;
+}
+early_initcall(qspinlock_idle_init_jump);
+
+static __init int qspinlock_idle_setup(char *str)
+{
+	if (!str)
+		qidle_enabled = true;
+	else if (strtobool(str, &qidle_enabled))
+		return -EINVAL;
+	return 0;
+}
+early_param("qspinlock_idle", qspinlock_idle_setup);
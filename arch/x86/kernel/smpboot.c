@@ -1177,6 +1177,7 @@ void __init native_smp_prepare_boot_cpu(void)
 	/* already set me in cpu_online_mask in boot_cpu_init() */
 	cpumask_set_cpu(me, cpu_callout_mask);
 	per_cpu(cpu_state, me) = CPU_ONLINE;
+	qspinlock_idle_init();
 }
 
 void __init native_smp_cpus_done(unsigned int max_cpus)
@@ -486,10 +486,17 @@ static inline int __do_cpuid_ent(struct kvm_cpuid_entry2 *entry, u32 function,
 			     (1 << KVM_FEATURE_ASYNC_PF) |
 			     (1 << KVM_FEATURE_PV_EOI) |
 			     (1 << KVM_FEATURE_CLOCKSOURCE_STABLE_BIT) |
-			     (1 << KVM_FEATURE_PV_UNHALT);
+			     (1 << KVM_FEATURE_PV_UNHALT) |
+			     (1 << KVM_FEATURE_PV_YIELD) |
+			     (1 << KVM_FEATURE_PV_LOCKWAIT_HALT) |
+			     (1 << KVM_FEATURE_PV_KICK_CPUS) |
+			     (1 << KVM_FEATURE_PV_SPIN_WAITFOR) |
+			     (1 << KVM_FEATURE_PV_LOCK_HOLDER) |
+			     (1 << KVM_FEATURE_PV_QHEAD_BOOST);
 
 		if (sched_info_on())
-			entry->eax |= (1 << KVM_FEATURE_STEAL_TIME);
+			entry->eax |= (1 << KVM_FEATURE_STEAL_TIME) |
+				      (1 << KVM_FEATURE_PV_TLB_FLUSH);
 
 		entry->ebx = 0;
 		entry->ecx = 0;
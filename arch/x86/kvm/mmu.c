@@ -2793,13 +2793,34 @@ static bool page_fault_can_be_fast(u32 error_code)
 	if (unlikely(error_code & PFERR_RSVD_MASK))
 		return false;
 
-	/*
-	 * #PF can be fast only if the shadow page table is present and it
-	 * is caused by write-protect, that means we just need change the
-	 * W bit of the spte which can be done out of mmu-lock.
-	 */
-	if (!(error_code & PFERR_PRESENT_MASK) ||
-	      !(error_code & PFERR_WRITE_MASK))
+	return true;
+}
+
+/*
+ * #PF can be fixed out of mmu-lock only if the shadow page table is
+ * present and it is caused by write-protect, that means we just need
+ * change the W bit of the spte.
+ */
+static bool page_fault_is_write_protect(u32 error_code)
+{
+	return (error_code & PFERR_PRESENT_MASK) &&
+	       (error_code & PFERR_WRITE_MASK);
+}
+
+/*
+ * Check whether @spte already allows the faulting access: either the TLB
+ * was lazily flushed, or another vcpu faulting on the same address has
+ * installed the spte meanwhile.  The upper level entries of a direct map
+ * are always ACC_ALL.
+ */
+static bool spte_allows_access(u64 spte, u32 error_code)
+{
+	if ((error_code & PFERR_WRITE_MASK) && !is_writable_pte(spte))
+		return false;
+
+	if ((error_code & PFERR_FETCH_MASK) &&
+	    ((spte & shadow_nx_mask) ||
+	     (shadow_x_mask && !(spte & shadow_x_mask))))
 		return false;
 
 	return true;
@@ -2851,10 +2872,11 @@ static bool fast_page_fault(struct kvm_vcpu *vcpu, gva_t gva, int level,
 
 	/*
 	 * If the mapping has been changed, let the vcpu fault on the
-	 * same address again.
+	 * same address again.  For a not-present fault a missing spte is
+	 * what we expect, and the slow path has to install it.
 	 */
 	if (!is_rmap_spte(spte)) {
-		ret = true;
+		ret = page_fault_is_write_protect(error_code);
 		goto exit;
 	}
 
@@ -2863,16 +2885,18 @@ static bool fast_page_fault(struct kvm_vcpu *vcpu, gva_t gva, int level,
 		goto exit;
 
 	/*
-	 * Check if it is a spurious fault caused by TLB lazily flushed.
-	 *
-	 * Need not check the access of upper level table entries since
-	 * they are always ACC_ALL.
+	 * Check if it is a spurious fault.  When many vcpus touch fresh
+	 * memory at once, all but the first find the spte installed here
+	 * and are spared mmu_lock and the pfn lookup.
 	 */
-	 if (is_writable_pte(spte)) {
+	if (spte_allows_access(spte, error_code)) {
 		ret = true;
 		goto exit;
 	}
 
+	if (!page_fault_is_write_protect(error_code))
+		goto exit;
+
 	/*
 	 * Currently, to simplify the code, only the spte write-protected
 	 * by dirty-log can be fast fixed.
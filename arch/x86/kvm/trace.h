@@ -877,6 +877,27 @@ TRACE_EVENT(kvm_ple_window,
 #define trace_kvm_ple_window_shrink(vcpu_id, new, old) \
 	trace_kvm_ple_window(false, vcpu_id, new, old)
 
+/*
+ * Tracepoint for the time from a PV kick to the kicked vCPU leaving halt
+ */
+TRACE_EVENT(kvm_pv_kick_latency,
+	TP_PROTO(unsigned int vcpu_id, u64 delta_ns),
+	TP_ARGS(vcpu_id, delta_ns),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	vcpu_id		)
+		__field(	u64,		delta_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->vcpu_id	= vcpu_id;
+		__entry->delta_ns	= delta_ns;
+	),
+
+	TP_printk("vcpu %u: kicked %llu ns ago",
+		  __entry->vcpu_id, __entry->delta_ns)
+);
+
 #endif /* _TRACE_KVM_H */
 
 #undef TRACE_INCLUDE_PATH
@@ -109,6 +109,19 @@ module_param(tsc_tolerance_ppm, uint, S_IRUGO | S_IWUSR);
 
 static bool backwards_tsc_observed = false;
 
+/* max time in ns to poll for a PV kick before blocking a lock waiter */
+static unsigned int pv_halt_poll_ns = 200000;
+module_param(pv_halt_poll_ns, uint, S_IRUGO | S_IWUSR);
+
+#define PV_HALT_POLL_NS_MIN	10000
+
+/*
+ * max time in ns to delay the preemption of a vCPU holding a contended
+ * spinlock, for the VMs created afterwards
+ */
+static unsigned int lock_holder_grace_ns = 50000;
+module_param(lock_holder_grace_ns, uint, S_IRUGO | S_IWUSR);
+
 #define KVM_NR_SHARED_MSRS 16
 
 struct kvm_shared_msrs_global {
@@ -141,6 +154,10 @@ struct kvm_stats_debugfs_item debugfs_entries[] = {
 	{ "nmi_window", VCPU_STAT(nmi_window_exits) },
 	{ "halt_exits", VCPU_STAT(halt_exits) },
 	{ "halt_wakeup", VCPU_STAT(halt_wakeup) },
+	{ "pv_halt_poll", VCPU_STAT(pv_halt_poll) },
+	{ "spin_waitfor_yield", VCPU_STAT(spin_waitfor_yield) },
+	{ "lock_holder_grace", VCPU_STAT(lock_holder_grace) },
+	{ "qhead_boost", VCPU_STAT(qhead_boost) },
 	{ "hypercalls", VCPU_STAT(hypercalls) },
 	{ "request_irq", VCPU_STAT(request_irq_exits) },
 	{ "irq_exits", VCPU_STAT(irq_exits) },
@@ -2064,6 +2081,31 @@ static void accumulate_steal_time(struct kvm_vcpu *vcpu)
 	vcpu->arch.st.accum_steal = delta;
 }
 
+/*
+ * Clear the preempted flag in the steal time area of the guest and return
+ * its old value. The guest sets KVM_VCPU_FLUSH_TLB in it with a cmpxchg
+ * while it is preempted, so it must be cleared with an atomic exchange on
+ * the guest page rather than written back from the cached copy.
+ */
+static u8 kvm_steal_time_clear_preempted(struct kvm_vcpu *vcpu)
+{
+	gpa_t gpa = vcpu->arch.st.stime.gpa +
+		    offsetof(struct kvm_steal_time, preempted);
+	struct page *page;
+	u8 *preempted, flags;
+
+	page = gfn_to_page(vcpu->kvm, gpa >> PAGE_SHIFT);
+	if (is_error_page(page))
+		return 0;
+
+	preempted = kmap_atomic(page) + offset_in_page(gpa);
+	flags = xchg(preempted, 0);
+	kunmap_atomic(preempted);
+	kvm_release_page_dirty(page);
+
+	return flags;
+}
+
 static void record_steal_time(struct kvm_vcpu *vcpu)
 {
 	if (!(vcpu->arch.st.msr_val & KVM_MSR_ENABLED))
@@ -2073,8 +2115,19 @@ static void record_steal_time(struct kvm_vcpu *vcpu)
 		&vcpu->arch.st.steal, sizeof(struct kvm_steal_time))))
 		return;
 
+	/*
+	 * The guest only requests a flush while the preempted flag is set,
+	 * which only kvm_steal_time_set_preempted() does. Do the flushes
+	 * other vCPUs requested instead of sending us an IPI
+	 * (KVM_FEATURE_PV_TLB_FLUSH).
+	 */
+	if (vcpu->arch.st.steal.preempted &&
+	    (kvm_steal_time_clear_preempted(vcpu) & KVM_VCPU_FLUSH_TLB))
+		kvm_make_request(KVM_REQ_TLB_FLUSH, vcpu);
+
 	vcpu->arch.st.steal.steal += vcpu->arch.st.accum_steal;
 	vcpu->arch.st.steal.version += 2;
+	vcpu->arch.st.steal.preempted = 0;
 	vcpu->arch.st.accum_steal = 0;
 
 	kvm_write_guest_cached(vcpu->kvm, &vcpu->arch.st.stime,
@@ -2909,8 +2962,148 @@ void kvm_arch_vcpu_load(struct kvm_vcpu *vcpu, int cpu)
 	kvm_make_request(KVM_REQ_STEAL_UPDATE, vcpu);
 }
 
+/*
+ * Let the guest know that the vCPU is not running so that it won't waste
+ * time spinning on a lock held or queued by this vCPU.
+ */
+static void kvm_steal_time_set_preempted(struct kvm_vcpu *vcpu)
+{
+	vcpu->arch.st.qhead = false;
+	if (!(vcpu->arch.st.msr_val & KVM_MSR_ENABLED))
+		return;
+
+	/*
+	 * The guest updates spin_waitfor while running, don't write back
+	 * the stale copy of record_steal_time().
+	 */
+	if (unlikely(kvm_read_guest_cached(vcpu->kvm, &vcpu->arch.st.stime,
+		&vcpu->arch.st.steal, sizeof(struct kvm_steal_time))))
+		return;
+
+	/* Remember a preempted queue head for kvm_arch_vcpu_spin_yield() */
+	vcpu->arch.st.qhead =
+		!!(vcpu->arch.st.steal.spin_waitfor & KVM_SPIN_WAITFOR_QHEAD);
+
+	/*
+	 * Preempted again before record_steal_time(): the guest may be
+	 * setting KVM_VCPU_FLUSH_TLB, don't write back over it.
+	 */
+	if (vcpu->arch.st.steal.preempted & KVM_VCPU_PREEMPTED)
+		return;
+	vcpu->arch.st.steal.preempted = KVM_VCPU_PREEMPTED;
+	vcpu->arch.st.steal.preempt_delayed = 0;
+	kvm_write_guest_cached(vcpu->kvm, &vcpu->arch.st.stime,
+		&vcpu->arch.st.steal, sizeof(struct kvm_steal_time));
+}
+
+/*
+ * A vCPU holding a contended spinlock, as the guest publishes in the
+ * steal time area (KVM_FEATURE_PV_LOCK_HOLDER), is let run for up to the
+ * lock holder grace period of the VM past a reschedule request, rather
+ * than leaving the lock waiters to spin behind it. So is the queue head
+ * of a lock whose holder is running (KVM_FEATURE_PV_QHEAD_BOOST), which
+ * is next in line and would stall the whole queue once the lock is
+ * released. The guest is told with the preempt_delayed flag and yields
+ * with KVM_HC_LOCK_HOLDER_YIELD once it has released its last contended
+ * lock. The grace period is checked on every exit, so a guest that
+ * doesn't yield is preempted on the first exit after it, at the latest on
+ * the next host timer tick. A vCPU gets no new grace period until it has
+ * been scheduled out.
+ */
+static bool kvm_lock_holder_grace_active(struct kvm_vcpu *vcpu)
+{
+	u64 start = vcpu->arch.st.grace_start;
+
+	return start &&
+	       get_kernel_ns() - start < vcpu->kvm->arch.lock_holder_grace_ns;
+}
+
+/*
+ * The vCPU published in the steal time area of the given one, see
+ * KVM_FEATURE_PV_SPIN_WAITFOR. @qhead tells whether the given vCPU is
+ * the queue head of the lock, waiting for its holder.
+ */
+static struct kvm_vcpu *kvm_spin_waitfor_vcpu(struct kvm_vcpu *vcpu,
+					      bool *qhead)
+{
+	u64 msr_val = ACCESS_ONCE(vcpu->arch.st.msr_val);
+	u32 waitfor;
+
+	*qhead = false;
+	if (!(msr_val & KVM_MSR_ENABLED))
+		return NULL;
+	if (kvm_read_guest(vcpu->kvm, (msr_val & KVM_STEAL_VALID_BITS) +
+			   offsetof(struct kvm_steal_time, spin_waitfor),
+			   &waitfor, sizeof(waitfor)))
+		return NULL;
+
+	*qhead = !!(waitfor & KVM_SPIN_WAITFOR_QHEAD);
+	waitfor &= ~KVM_SPIN_WAITFOR_QHEAD;
+	if (!waitfor)
+		return NULL;
+
+	return kvm_apicid_to_vcpu(vcpu->kvm, waitfor - 1);
+}
+
+/*
+ * Is the vCPU the queue head of a lock held by a running vCPU?
+ */
+static bool kvm_vcpu_is_qhead(struct kvm_vcpu *vcpu)
+{
+	struct kvm_vcpu *owner;
+	bool qhead;
+
+	owner = kvm_spin_waitfor_vcpu(vcpu, &qhead);
+	return qhead && owner && owner != vcpu && !ACCESS_ONCE(owner->preempted);
+}
+
+static bool kvm_lock_holder_grace(struct kvm_vcpu *vcpu)
+{
+	u64 msr_val = vcpu->arch.st.msr_val;
+	gpa_t gpa = msr_val & KVM_STEAL_VALID_BITS;
+	u8 held, delayed = 1;
+
+	if (vcpu->arch.st.grace_start) {
+		if (kvm_lock_holder_grace_active(vcpu))
+			return true;
+		vcpu->arch.st.grace_start = 0;
+		return false;
+	}
+
+	if (vcpu->arch.st.grace_used || !vcpu->kvm->arch.lock_holder_grace_ns ||
+	    !(msr_val & KVM_MSR_ENABLED))
+		return false;
+	if (kvm_read_guest(vcpu->kvm,
+			   gpa + offsetof(struct kvm_steal_time, lock_held),
+			   &held, sizeof(held)))
+		return false;
+	if (!held && !kvm_vcpu_is_qhead(vcpu))
+		return false;
+	if (kvm_write_guest(vcpu->kvm,
+			    gpa + offsetof(struct kvm_steal_time, preempt_delayed),
+			    &delayed, sizeof(delayed)))
+		return false;
+
+	vcpu->arch.st.grace_start = get_kernel_ns();
+	vcpu->arch.st.grace_used = true;
+	++vcpu->stat.lock_holder_grace;
+	return true;
+}
+
 void kvm_arch_vcpu_put(struct kvm_vcpu *vcpu)
 {
+	/*
+	 * Page faults are disabled as we may be called from the preempt
+	 * notifier in atomic context. The preempted flag is just a hint,
+	 * so it is fine if the write doesn't go through.
+	 */
+	if (vcpu->preempted) {
+		pagefault_disable();
+		kvm_steal_time_set_preempted(vcpu);
+		pagefault_enable();
+		vcpu->arch.st.grace_start = 0;
+		vcpu->arch.st.grace_used = false;
+	}
 	kvm_x86_ops->vcpu_put(vcpu);
 	kvm_put_guest_fpu(vcpu);
 	vcpu->arch.last_host_tsc = native_read_tsc();
@@ -5821,11 +6014,34 @@ int kvm_hv_hypercall(struct kvm_vcpu *vcpu)
 }
 
 /*
- * kvm_pv_kick_cpu_op:  Kick a vcpu.
- *
- * @apicid - apicid of vcpu to be kicked.
+ * Unhalt a vcpu halted on a PV spinlock and record the kick time.
  */
-static void kvm_pv_kick_cpu_op(struct kvm *kvm, unsigned long flags, int apicid)
+static void kvm_pv_unhalt_vcpu(struct kvm_vcpu *target)
+{
+	target->arch.pv.kick_ns = get_kernel_ns();
+	target->arch.pv.pv_unhalted = 1;
+	kvm_make_request(KVM_REQ_EVENT, target);
+	kvm_vcpu_kick(target);
+}
+
+/*
+ * Look the target up in the physical APIC map, the caller must hold the
+ * RCU read lock.
+ */
+static struct kvm_vcpu *kvm_pv_kick_target(struct kvm_apic_map *map,
+					   unsigned long apicid)
+{
+	if (likely(map) && apicid < ARRAY_SIZE(map->phys_map) &&
+	    map->phys_map[apicid])
+		return map->phys_map[apicid]->vcpu;
+	return NULL;
+}
+
+/*
+ * Kick a vcpu whose apicid isn't in the physical APIC map through the
+ * generic interrupt delivery.
+ */
+static void kvm_pv_kick_apic(struct kvm *kvm, int apicid)
 {
 	struct kvm_lapic_irq lapic_irq;
 
@@ -5837,6 +6053,212 @@ static void kvm_pv_kick_cpu_op(struct kvm *kvm, unsigned long flags, int apicid)
 	kvm_irq_delivery_to_apic(kvm, 0, &lapic_irq, NULL);
 }
 
+/*
+ * kvm_pv_kick_cpu_op:  Kick a vcpu.
+ *
+ * @apicid - apicid of vcpu to be kicked.
+ *
+ * The target is unhalted directly instead of going through the generic
+ * interrupt delivery whenever it can be found in the physical APIC map.
+ */
+static void kvm_pv_kick_cpu_op(struct kvm *kvm, unsigned long flags, int apicid)
+{
+	struct kvm_vcpu *target;
+
+	rcu_read_lock();
+	target = kvm_pv_kick_target(rcu_dereference(kvm->arch.apic_map),
+				    (unsigned int)apicid);
+	if (target)
+		kvm_pv_unhalt_vcpu(target);
+	rcu_read_unlock();
+
+	if (!target)
+		kvm_pv_kick_apic(kvm, apicid);
+}
+
+/*
+ * kvm_pv_kick_cpus_op:  Kick a number of vcpus.
+ *
+ * @map - bitmap of the apicids to be kicked, relative to @min
+ * @min - apicid of bit 0 of @map
+ *
+ * With x2APIC, @min is the first apicid of a cluster and @map the mask of
+ * the cluster members. The APIC map is looked up only once for all the
+ * targets.
+ *
+ * Return: the number of vcpus kicked.
+ */
+static int kvm_pv_kick_cpus_op(struct kvm *kvm, unsigned long map,
+			       unsigned long min)
+{
+	struct kvm_apic_map *apic_map;
+	struct kvm_vcpu *target;
+	int i, count = 0;
+
+	rcu_read_lock();
+	apic_map = rcu_dereference(kvm->arch.apic_map);
+	for_each_set_bit(i, &map, BITS_PER_LONG) {
+		if (min + i > INT_MAX)
+			break;
+		target = kvm_pv_kick_target(apic_map, min + i);
+		if (target)
+			kvm_pv_unhalt_vcpu(target);
+		else
+			kvm_pv_kick_apic(kvm, min + i);
+		count++;
+	}
+	rcu_read_unlock();
+
+	return count;
+}
+
+/*
+ * kvm_pv_lockwait_halt_op: Halt a vCPU waiting for a PV spinlock kick.
+ *
+ * Lock hold times are usually much shorter than a block and wakeup round
+ * trip, so poll for the kick for up to the per-vCPU window first. A kick
+ * that arrives while polling is consumed here.
+ */
+static void kvm_pv_lockwait_halt_op(struct kvm_vcpu *vcpu)
+{
+	u64 stop;
+
+	if (!irqchip_in_kernel(vcpu->kvm))
+		return;
+
+	stop = get_kernel_ns() + min(vcpu->arch.pv.poll_ns, pv_halt_poll_ns);
+	while (!ACCESS_ONCE(vcpu->arch.pv.pv_unhalted)) {
+		if (kvm_arch_interrupt_allowed(vcpu) &&
+		    kvm_cpu_has_interrupt(vcpu))
+			return;
+		if (need_resched() || signal_pending(current) ||
+		    get_kernel_ns() >= stop) {
+			++vcpu->stat.halt_exits;
+			vcpu->arch.pv.halt_ns = get_kernel_ns();
+			vcpu->arch.mp_state = KVM_MP_STATE_HALTED;
+			return;
+		}
+		cpu_relax();
+	}
+	vcpu->arch.pv.pv_unhalted = false;
+	++vcpu->stat.pv_halt_poll;
+}
+
+/*
+ * Adjust the poll window after a PV lock waiter woke up from blocking:
+ * grow it if the wait was short enough to be covered by polling, shrink
+ * it otherwise.
+ */
+static void kvm_pv_update_halt_poll(struct kvm_vcpu *vcpu)
+{
+	u64 block_ns = get_kernel_ns() - vcpu->arch.pv.halt_ns;
+	unsigned int poll_ns = vcpu->arch.pv.poll_ns;
+
+	if (block_ns > pv_halt_poll_ns)
+		poll_ns /= 2;
+	else
+		poll_ns = min(max(poll_ns * 2, (unsigned int)PV_HALT_POLL_NS_MIN),
+			      pv_halt_poll_ns);
+
+	vcpu->arch.pv.poll_ns = poll_ns;
+	vcpu->arch.pv.halt_ns = 0;
+}
+
+/*
+ * kvm_pv_yield_to_cpu_op: Yield to the given vCPU if it is not running.
+ *
+ * @apicid - apicid of the vcpu to be yielded to, normally a preempted
+ * lock holder.
+ *
+ * Return: 1 if the yield happened, 0 otherwise.
+ */
+static struct kvm_vcpu *kvm_apicid_to_vcpu(struct kvm *kvm,
+					    unsigned long apicid)
+{
+	struct kvm_vcpu *target = NULL;
+	struct kvm_apic_map *map;
+
+	if (apicid >= ARRAY_SIZE(map->phys_map))
+		return NULL;
+
+	rcu_read_lock();
+	map = rcu_dereference(kvm->arch.apic_map);
+	if (likely(map) && map->phys_map[apicid])
+		target = map->phys_map[apicid]->vcpu;
+	rcu_read_unlock();
+
+	return target;
+}
+
+static int kvm_pv_yield_to_cpu_op(struct kvm_vcpu *vcpu, unsigned long apicid)
+{
+	struct kvm_vcpu *target = kvm_apicid_to_vcpu(vcpu->kvm, apicid);
+
+	if (!target || target == vcpu || !ACCESS_ONCE(target->preempted))
+		return 0;
+
+	return kvm_vcpu_yield_to(target) > 0;
+}
+
+/*
+ * Number of spin_waitfor links followed from the spinning vCPU. The lock
+ * waiters point to the previous queue node and the queue head to the
+ * lock holder, so a few hops get to the vCPU that holds everybody up.
+ */
+#define KVM_SPIN_WAITFOR_HOPS	4
+
+/*
+ * Yield to a queue head vCPU that was preempted, so that it runs next:
+ * every other waiter of its lock stalls until it does.
+ */
+static bool kvm_qhead_yield(struct kvm_vcpu *me)
+{
+	struct kvm_vcpu *vcpu;
+	int i;
+
+	kvm_for_each_vcpu(i, vcpu, me->kvm) {
+		if (vcpu == me || !ACCESS_ONCE(vcpu->preempted) ||
+		    !ACCESS_ONCE(vcpu->arch.st.qhead))
+			continue;
+		if (kvm_vcpu_yield_to(vcpu) > 0) {
+			++me->stat.qhead_boost;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * kvm_arch_vcpu_spin_yield - directed yield on a pause loop exit
+ * @me: the spinning vCPU
+ * Return: true if yielded, false to fall back to the round robin
+ *
+ * Follow the chain of the vCPUs that the PV spinlock waiters wait for,
+ * starting from the spinning one, and boost the first preempted vCPU.
+ * Failing that, boost a preempted queue head. Reading the guest memory of
+ * other vCPUs can race with their updates, the chain is a hint like the
+ * rest of the PLE heuristics.
+ */
+bool kvm_arch_vcpu_spin_yield(struct kvm_vcpu *me)
+{
+	struct kvm_vcpu *target = me;
+	bool qhead;
+	int hops;
+
+	for (hops = 0; hops < KVM_SPIN_WAITFOR_HOPS; hops++) {
+		target = kvm_spin_waitfor_vcpu(target, &qhead);
+		if (!target || target == me)
+			break;
+		if (!ACCESS_ONCE(target->preempted))
+			continue;
+		if (kvm_vcpu_yield_to(target) <= 0)
+			break;
+		++me->stat.spin_waitfor_yield;
+		return true;
+	}
+	return kvm_qhead_yield(me);
+}
+
 int kvm_emulate_hypercall(struct kvm_vcpu *vcpu)
 {
 	unsigned long nr, a0, a1, a2, a3, ret;
@@ -5875,6 +6297,21 @@ int kvm_emulate_hypercall(struct kvm_vcpu *vcpu)
 		kvm_pv_kick_cpu_op(vcpu->kvm, a0, a1);
 		ret = 0;
 		break;
+	case KVM_HC_YIELD_TO_CPU:
+		ret = kvm_pv_yield_to_cpu_op(vcpu, a1);
+		break;
+	case KVM_HC_KICK_CPUS:
+		ret = kvm_pv_kick_cpus_op(vcpu->kvm, a0, a1);
+		break;
+	case KVM_HC_LOCKWAIT_HALT:
+		kvm_pv_lockwait_halt_op(vcpu);
+		ret = 0;
+		break;
+	case KVM_HC_LOCK_HOLDER_YIELD:
+		/* The run loop reschedules on the way back to the guest */
+		vcpu->arch.st.grace_start = 0;
+		ret = 0;
+		break;
 	default:
 		ret = -KVM_ENOSYS;
 		break;
@@ -6204,7 +6641,8 @@ static int vcpu_enter_guest(struct kvm_vcpu *vcpu)
 	local_irq_disable();
 
 	if (vcpu->mode == EXITING_GUEST_MODE || vcpu->requests
-	    || need_resched() || signal_pending(current)) {
+	    || (need_resched() && !kvm_lock_holder_grace_active(vcpu))
+	    || signal_pending(current)) {
 		vcpu->mode = OUTSIDE_GUEST_MODE;
 		smp_wmb();
 		local_irq_enable();
@@ -6327,6 +6765,16 @@ static int __vcpu_run(struct kvm_vcpu *vcpu)
 				kvm_apic_accept_events(vcpu);
 				switch(vcpu->arch.mp_state) {
 				case KVM_MP_STATE_HALTED:
+					if (vcpu->arch.pv.pv_unhalted &&
+					    vcpu->arch.pv.kick_ns) {
+						trace_kvm_pv_kick_latency(
+							vcpu->vcpu_id,
+							get_kernel_ns() -
+							vcpu->arch.pv.kick_ns);
+						vcpu->arch.pv.kick_ns = 0;
+					}
+					if (vcpu->arch.pv.halt_ns)
+						kvm_pv_update_halt_poll(vcpu);
 					vcpu->arch.pv.pv_unhalted = false;
 					vcpu->arch.mp_state =
 						KVM_MP_STATE_RUNNABLE;
@@ -6362,7 +6810,7 @@ static int __vcpu_run(struct kvm_vcpu *vcpu)
 			vcpu->run->exit_reason = KVM_EXIT_INTR;
 			++vcpu->stat.signal_exits;
 		}
-		if (need_resched()) {
+		if (need_resched() && !kvm_lock_holder_grace(vcpu)) {
 			srcu_read_unlock(&kvm->srcu, vcpu->srcu_idx);
 			cond_resched();
 			vcpu->srcu_idx = srcu_read_lock(&kvm->srcu);
@@ -7273,6 +7721,8 @@ int kvm_arch_init_vm(struct kvm *kvm, unsigned long type)
 
 	pvclock_update_vm_gtod_copy(kvm);
 
+	kvm->arch.lock_holder_grace_ns = lock_holder_grace_ns;
+
 	INIT_DELAYED_WORK(&kvm->arch.kvmclock_update_work, kvmclock_update_fn);
 	INIT_DELAYED_WORK(&kvm->arch.kvmclock_sync_work, kvmclock_sync_fn);
 
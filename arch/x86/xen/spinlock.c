@@ -20,6 +20,7 @@
 static DEFINE_PER_CPU(int, lock_kicker_irq) = -1;
 static DEFINE_PER_CPU(char *, irq_name);
 static bool xen_pvspin = true;
+static bool xen_pvspin_ops __initdata;
 
 #ifndef CONFIG_QUEUE_SPINLOCK
 
@@ -219,32 +220,14 @@ static void xen_unlock_kick(struct arch_spinlock *lock, __ticket_t next)
 #else /* CONFIG_QUEUE_SPINLOCK */
 
 #ifdef CONFIG_XEN_DEBUG_FS
-static u32 kick_nohlt_stats;		/* Kick but not halt count	*/
-static u32 halt_qhead_stats;		/* Queue head halting count	*/
-static u32 halt_qnode_stats;		/* Queue node halting count	*/
-static u32 halt_abort_stats;		/* Halting abort count		*/
-static u32 wake_kick_stats;		/* Wakeup by kicking count	*/
-static u32 wake_spur_stats;		/* Spurious wakeup count	*/
-static u64 time_blocked;		/* Total blocking time		*/
-
 static inline void xen_halt_stats(enum pv_lock_stats type)
 {
-	if (type == PV_HALT_QHEAD)
-		add_smp(&halt_qhead_stats, 1);
-	else if (type == PV_HALT_QNODE)
-		add_smp(&halt_qnode_stats, 1);
-	else /* type == PV_HALT_ABORT */
-		add_smp(&halt_abort_stats, 1);
+	pv_lockstat_inc(type);
 }
 
 void xen_lock_stats(enum pv_lock_stats type)
 {
-	if (type == PV_WAKE_KICKED)
-		add_smp(&wake_kick_stats, 1);
-	else if (type == PV_WAKE_SPURIOUS)
-		add_smp(&wake_spur_stats, 1);
-	else /* type == PV_KICK_NOHALT */
-		add_smp(&kick_nohlt_stats, 1);
+	pv_lockstat_inc(type);
 }
 PV_CALLEE_SAVE_REGS_THUNK(xen_lock_stats);
 
@@ -255,10 +238,7 @@ static inline u64 spin_time_start(void)
 
 static inline void spin_time_accum_blocked(u64 start)
 {
-	u64 delta;
-
-	delta = sched_clock() - start;
-	add_smp(&time_blocked, delta);
+	pv_lockstat_blocked(sched_clock() - start);
 }
 #else /* CONFIG_XEN_DEBUG_FS */
 static inline void xen_halt_stats(enum pv_lock_stats type)
@@ -283,6 +263,12 @@ PV_CALLEE_SAVE_REGS_THUNK(xen_kick_cpu);
 
 /*
  * Halt the current CPU & release it back to the host
+ *
+ * The kick is a Xen event channel IPI that stays pending until cleared.
+ * The queue head clears it before checking the lock byte. The other
+ * callers, the queue nodes and the rwlock queue head, have published that
+ * they are halting before getting here, so a kick may already be pending
+ * and must not be cleared before polling: it is consumed afterwards.
  */
 void xen_halt_cpu(u8 *lockbyte)
 {
@@ -302,18 +288,25 @@ void xen_halt_cpu(u8 *lockbyte)
 	start = spin_time_start();
 
 	xen_halt_stats(lockbyte ? PV_HALT_QHEAD : PV_HALT_QNODE);
-	/* clear pending */
-	xen_clear_irq_pending(irq);
+	if (lockbyte) {
+		/* clear pending */
+		xen_clear_irq_pending(irq);
+
+		/*
+		 * Don't halt if the lock is now available. The check is done
+		 * after clearing the pending kick and before enabling
+		 * interrupts, so the kick that comes with a release can't get
+		 * lost in between.
+		 */
+		if (!ACCESS_ONCE(*lockbyte)) {
+			local_irq_restore(flags);
+			xen_halt_stats(PV_HALT_ABORT);
+			return;
+		}
+	}
 
 	/* Allow interrupts while blocked */
 	local_irq_restore(flags);
-	/*
-	 * Don't halt if the lock is now available
-	 */
-	if (lockbyte && !ACCESS_ONCE(*lockbyte)) {
-		xen_halt_stats(PV_HALT_ABORT);
-		return;
-	}
 	/*
 	 * If an interrupt happens here, it will leave the wakeup irq
 	 * pending, which will cause xen_poll_irq() to return
@@ -322,6 +315,25 @@ void xen_halt_cpu(u8 *lockbyte)
 
 	/* Block until irq becomes pending (or perhaps a spurious wakeup) */
 	xen_poll_irq(irq);
+
+	/*
+	 * The queue head is only woken up by an unlocker that sees the
+	 * _Q_LOCKED_SLOWPATH flag, so a wakeup without a pending kick while
+	 * that flag is still there comes from an interrupt that has already
+	 * been serviced. Poll again rather than going back to spinning.
+	 */
+	while (lockbyte && !xen_test_irq_pending(irq) &&
+	       (ACCESS_ONCE(*lockbyte) == _Q_LOCKED_SLOWPATH)) {
+		xen_halt_stats(PV_HALT_REPOLL);
+		xen_poll_irq(irq);
+	}
+
+	/*
+	 * Consume the kick. The caller checks its wait condition again
+	 * before the next halt, so a kick that comes in after this point
+	 * is seen there or leaves the next poll returning at once.
+	 */
+	xen_clear_irq_pending(irq);
 	spin_time_accum_blocked(start);
 }
 PV_CALLEE_SAVE_REGS_THUNK(xen_halt_cpu);
@@ -391,6 +403,8 @@ void __init xen_init_spinlocks(void)
 	printk(KERN_DEBUG "xen: PV spinlocks enabled\n");
 
 #ifdef CONFIG_QUEUE_SPINLOCK
+	pv_init_lock_hash();
+	pv_init_queue_spinlock();
 	pv_lock_ops.kick_cpu = PV_CALLEE_SAVE(xen_kick_cpu);
 	pv_lock_ops.lockwait = PV_CALLEE_SAVE(xen_halt_cpu);
 #ifdef CONFIG_XEN_DEBUG_FS
@@ -400,6 +414,7 @@ void __init xen_init_spinlocks(void)
 	pv_lock_ops.lock_spinning = PV_CALLEE_SAVE(xen_lock_spinning);
 	pv_lock_ops.unlock_kick = xen_unlock_kick;
 #endif
+	xen_pvspin_ops = true;
 }
 
 /*
@@ -416,6 +431,14 @@ static __init int xen_init_spinlocks_jump(void)
 	if (!xen_domain())
 		return 0;
 
+	/*
+	 * HVM guests without the vector callback have no kicker IPI and
+	 * don't set up the lock ops. The PV lock slowpaths would just spin
+	 * with the native nops then, the rwlock queue head without bound.
+	 */
+	if (!xen_pvspin_ops)
+		return 0;
+
 	static_key_slow_inc(&paravirt_spinlocks_enabled);
 	return 0;
 }
@@ -465,20 +488,7 @@ static int __init xen_spinlock_debugfs(void)
 	debugfs_create_u32_array("histo_blocked", 0444, d_spin_debug,
 				spinlock_stats.histo_spin_blocked, HISTO_BUCKETS + 1);
 #else /* CONFIG_QUEUE_SPINLOCK */
-	debugfs_create_u32("kick_nohlt_stats",
-			   0644, d_spin_debug, &kick_nohlt_stats);
-	debugfs_create_u32("halt_qhead_stats",
-			   0644, d_spin_debug, &halt_qhead_stats);
-	debugfs_create_u32("halt_qnode_stats",
-			   0644, d_spin_debug, &halt_qnode_stats);
-	debugfs_create_u32("halt_abort_stats",
-			   0644, d_spin_debug, &halt_abort_stats);
-	debugfs_create_u32("wake_kick_stats",
-			   0644, d_spin_debug, &wake_kick_stats);
-	debugfs_create_u32("wake_spur_stats",
-			   0644, d_spin_debug, &wake_spur_stats);
-	debugfs_create_u64("time_blocked",
-			   0644, d_spin_debug, &time_blocked);
+	pv_lockstat_debugfs(d_spin_debug);
 #endif /* CONFIG_QUEUE_SPINLOCK */
 	return 0;
 }
@@ -303,6 +303,20 @@ void __blk_run_queue(struct request_queue *q)
 }
 EXPORT_SYMBOL(__blk_run_queue);
 
+/*
+ * Run @q once requests were inserted, unless its request_fn is running on
+ * another CPU with the queue lock dropped and will peek at them itself
+ * before returning, which lets the inserting CPU drop the queue lock
+ * without going through the dispatch. Must be called with the queue lock
+ * held and interrupts disabled.
+ */
+static void blk_run_queue_inserted(struct request_queue *q)
+{
+	if (blk_queue_repeek(q) && q->request_fn_active)
+		return;
+	__blk_run_queue(q);
+}
+
 /**
  * blk_run_queue_async - run a single device queue in workqueue context
  * @q:	The queue to run
@@ -1644,7 +1658,7 @@ get_rq:
 	} else {
 		spin_lock_irq(q->queue_lock);
 		add_acct_request(q, req, where);
-		__blk_run_queue(q);
+		blk_run_queue_inserted(q);
 out_unlock:
 		spin_unlock_irq(q->queue_lock);
 	}
@@ -3033,10 +3047,45 @@ static void queue_unplugged(struct request_queue *q, unsigned int depth,
 	if (from_schedule)
 		blk_run_queue_async(q);
 	else
-		__blk_run_queue(q);
+		blk_run_queue_inserted(q);
 	spin_unlock(q->queue_lock);
 }
 
+/*
+ * Merge the contiguous requests of the sorted plug @list before taking the
+ * queue locks, moving the requests merged away to @merged in list order.
+ */
+static void plug_merge_list(struct list_head *list, struct list_head *merged)
+{
+	struct request *rq = NULL, *next, *tmp;
+
+	list_for_each_entry_safe(next, tmp, list, queuelist) {
+		if (rq && rq->q == next->q &&
+		    blk_attempt_plug_req_merge(rq->q, rq, next)) {
+			list_move_tail(&next->queuelist, merged);
+			continue;
+		}
+		rq = next;
+	}
+}
+
+/*
+ * Release the requests of @q at the head of @merged, called with the
+ * queue lock held.
+ */
+static void plug_put_merged(struct request_queue *q, struct list_head *merged)
+{
+	struct request *rq;
+
+	while (!list_empty(merged)) {
+		rq = list_entry_rq(merged->next);
+		if (rq->q != q)
+			break;
+		list_del_init(&rq->queuelist);
+		__blk_put_request(q, rq);
+	}
+}
+
 static void flush_plug_callbacks(struct blk_plug *plug, bool from_schedule)
 {
 	LIST_HEAD(callbacks);
@@ -3085,6 +3134,7 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	unsigned long flags;
 	struct request *rq;
 	LIST_HEAD(list);
+	LIST_HEAD(merged);
 	unsigned int depth;
 
 	flush_plug_callbacks(plug, from_schedule);
@@ -3098,6 +3148,7 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	list_splice_init(&plug->list, &list);
 
 	list_sort(NULL, &list, plug_rq_cmp);
+	plug_merge_list(&list, &merged);
 
 	q = NULL;
 	depth = 0;
@@ -3115,8 +3166,10 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 			/*
 			 * This drops the queue lock
 			 */
-			if (q)
+			if (q) {
+				plug_put_merged(q, &merged);
 				queue_unplugged(q, depth, from_schedule);
+			}
 			q = rq->q;
 			depth = 0;
 			spin_lock(q->queue_lock);
@@ -3144,8 +3197,10 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	/*
 	 * This drops the queue lock
 	 */
-	if (q)
+	if (q) {
+		plug_put_merged(q, &merged);
 		queue_unplugged(q, depth, from_schedule);
+	}
 
 	local_irq_restore(flags);
 }
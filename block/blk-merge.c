@@ -470,31 +470,32 @@ static void blk_account_io_merge(struct request *req)
 }
 
 /*
- * Has to be called with the request spinlock acquired
+ * Append the bios of @next to @req if the two can be merged. @next is left
+ * to be released by the caller, the elevator isn't told about the merge.
  */
-static int attempt_merge(struct request_queue *q, struct request *req,
-			  struct request *next)
+static bool merge_requests(struct request_queue *q, struct request *req,
+			   struct request *next)
 {
 	if (!rq_mergeable(req) || !rq_mergeable(next))
-		return 0;
+		return false;
 
 	if (!blk_check_merge_flags(req->cmd_flags, next->cmd_flags))
-		return 0;
+		return false;
 
 	/*
 	 * not contiguous
 	 */
 	if (blk_rq_pos(req) + blk_rq_sectors(req) != blk_rq_pos(next))
-		return 0;
+		return false;
 
 	if (rq_data_dir(req) != rq_data_dir(next)
 	    || req->rq_disk != next->rq_disk
 	    || req_no_special_merge(next))
-		return 0;
+		return false;
 
 	if (req->cmd_flags & REQ_WRITE_SAME &&
 	    !blk_write_same_mergeable(req->bio, next->bio))
-		return 0;
+		return false;
 
 	/*
 	 * If we are allowed to merge, then append bio list
@@ -503,7 +504,7 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	 * counts here.
 	 */
 	if (!ll_merge_requests_fn(q, req, next))
-		return 0;
+		return false;
 
 	/*
 	 * If failfast settings disagree or any of the two is already
@@ -532,6 +533,21 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 
 	req->__data_len += blk_rq_bytes(next);
 
+	req->ioprio = ioprio_best(req->ioprio, next->ioprio);
+	if (blk_rq_cpu_valid(next))
+		req->cpu = next->cpu;
+	return true;
+}
+
+/*
+ * Has to be called with the request spinlock acquired
+ */
+static int attempt_merge(struct request_queue *q, struct request *req,
+			  struct request *next)
+{
+	if (!merge_requests(q, req, next))
+		return 0;
+
 	elv_merge_requests(q, req, next);
 
 	/*
@@ -539,10 +555,6 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	 */
 	blk_account_io_merge(next);
 
-	req->ioprio = ioprio_best(req->ioprio, next->ioprio);
-	if (blk_rq_cpu_valid(next))
-		req->cpu = next->cpu;
-
 	/* owner-ship of bio passed from next to req */
 	next->bio = NULL;
 	__blk_put_request(q, next);
@@ -575,6 +587,21 @@ int blk_attempt_req_merge(struct request_queue *q, struct request *rq,
 	return attempt_merge(q, rq, next);
 }
 
+/*
+ * Merge @next into @rq, both on a plug list and not inserted yet, without
+ * the queue lock. The caller releases @next with the queue lock held.
+ */
+bool blk_attempt_plug_req_merge(struct request_queue *q, struct request *rq,
+				struct request *next)
+{
+	if (blk_queue_nomerges(q) || !merge_requests(q, rq, next))
+		return false;
+
+	blk_account_io_merge(next);
+	next->bio = NULL;
+	return true;
+}
+
 bool blk_rq_merge_ok(struct request *rq, struct bio *bio)
 {
 	struct request_queue *q = rq->q;
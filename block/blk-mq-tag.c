@@ -35,12 +35,27 @@ static bool bt_has_free_tags(struct blk_mq_bitmap_tags *bt)
 	return false;
 }
 
+static unsigned int bt_cached_tags(struct blk_mq_bitmap_tags *bt)
+{
+	unsigned int cached = 0;
+	int cpu;
+
+	if (!bt->cache)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		cached += ACCESS_ONCE(per_cpu_ptr(bt->cache, cpu)->nr);
+
+	return cached;
+}
+
 bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
 {
 	if (!tags)
 		return true;
 
-	return bt_has_free_tags(&tags->bitmap_tags);
+	return bt_has_free_tags(&tags->bitmap_tags) ||
+	       bt_cached_tags(&tags->bitmap_tags);
 }
 
 static inline int bt_index_inc(int index)
@@ -161,6 +176,124 @@ restart:
 	return tag;
 }
 
+/*
+ * Claim up to nr free tags of a word with a single atomic operation.
+ */
+static unsigned int bt_claim_word(struct blk_align_bitmap *bm,
+				  unsigned int nr, unsigned long *claimed)
+{
+	unsigned long word, free, take;
+	unsigned int n;
+
+	do {
+		word = ACCESS_ONCE(bm->word);
+		free = ~word;
+		if (bm->depth < BITS_PER_LONG)
+			free &= (1UL << bm->depth) - 1;
+		if (!free)
+			return 0;
+
+		for (n = 0, take = 0; n < nr && free; n++) {
+			take |= free & -free;
+			free &= free - 1;
+		}
+	} while (cmpxchg(&bm->word, word, word | take) != word);
+
+	*claimed = take;
+	return n;
+}
+
+/*
+ * Refill an empty cache with half its size of tags, taken from as few
+ * words as possible, starting from the word of the last tag of the
+ * software queue.
+ */
+static void bt_cache_refill(struct blk_mq_bitmap_tags *bt,
+			    struct bt_tag_cache *cache, unsigned int last_tag)
+{
+	unsigned int batch = bt->cache_size / 2;
+	unsigned long claimed;
+	int index, i, bit;
+
+	index = TAG_TO_INDEX(bt, last_tag);
+	if (index >= bt->map_nr)
+		index = 0;
+
+	for (i = 0; i < bt->map_nr && cache->nr < batch; i++) {
+		if (bt_claim_word(&bt->map[index], batch - cache->nr,
+				  &claimed)) {
+			for_each_set_bit(bit, &claimed, BITS_PER_LONG)
+				cache->tags[cache->nr++] =
+					(index << bt->bits_per_word) + bit;
+		}
+
+		if (++index >= bt->map_nr)
+			index = 0;
+	}
+}
+
+/*
+ * Take a tag from the cache of this cpu, refilled from the bitmap when
+ * empty. The tags beyond a reduced depth are released on the way.
+ */
+static int bt_cache_get(struct blk_mq_bitmap_tags *bt, unsigned int last_tag)
+{
+	struct bt_tag_cache *cache;
+	unsigned long flags;
+	int tag = -1;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bt->cache);
+	spin_lock(&cache->lock);
+
+	if (!cache->nr)
+		bt_cache_refill(bt, cache, last_tag);
+	while (cache->nr) {
+		tag = cache->tags[--cache->nr];
+		if (tag < bt->depth)
+			break;
+		clear_bit_unlock(TAG_TO_BIT(bt, tag),
+				 &bt->map[TAG_TO_INDEX(bt, tag)].word);
+		tag = -1;
+	}
+
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+	return tag;
+}
+
+/*
+ * The bitmap is exhausted, take a tag from the cache of another cpu.
+ */
+static int bt_cache_steal(struct blk_mq_bitmap_tags *bt)
+{
+	struct bt_tag_cache *cache;
+	unsigned long flags;
+	int cpu, tag = -1;
+
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(bt->cache, cpu);
+		if (!ACCESS_ONCE(cache->nr))
+			continue;
+
+		spin_lock_irqsave(&cache->lock, flags);
+		while (cache->nr) {
+			tag = cache->tags[--cache->nr];
+			if (tag < bt->depth)
+				break;
+			clear_bit_unlock(TAG_TO_BIT(bt, tag),
+					 &bt->map[TAG_TO_INDEX(bt, tag)].word);
+			tag = -1;
+		}
+		spin_unlock_irqrestore(&cache->lock, flags);
+
+		if (tag != -1)
+			break;
+	}
+
+	return tag;
+}
+
 /*
  * Straight forward bitmap tag implementation, where each bit is a tag
  * (cleared == free, and set == busy). The small twist is using per-cpu
@@ -171,6 +304,10 @@ restart:
  * of that, each word of tags is in a separate cacheline. This means that
  * multiple users will tend to stick to different cachelines, at least
  * until the map is exhausted.
+ *
+ * With enough tags per cpu, the tags are allocated from per-cpu caches
+ * refilled in batches, and freed to them, see bt_cache_put(). The shared
+ * bitmap words are then only touched once per batch.
  */
 static int __bt_get(struct blk_mq_hw_ctx *hctx, struct blk_mq_bitmap_tags *bt,
 		    unsigned int *tag_cache)
@@ -181,6 +318,13 @@ static int __bt_get(struct blk_mq_hw_ctx *hctx, struct blk_mq_bitmap_tags *bt,
 	if (!hctx_may_queue(hctx, bt))
 		return -1;
 
+	if (bt->cache_size) {
+		tag = bt_cache_get(bt, *tag_cache);
+		if (tag == -1)
+			tag = bt_cache_steal(bt);
+		return tag;
+	}
+
 	last_tag = org_last_tag = *tag_cache;
 	index = TAG_TO_INDEX(bt, last_tag);
 
@@ -360,11 +504,66 @@ static void bt_clear_tag(struct blk_mq_bitmap_tags *bt, unsigned int tag)
 	}
 }
 
+static void bt_cache_drain(struct blk_mq_bitmap_tags *bt,
+			   struct bt_tag_cache *cache)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	while (cache->nr)
+		bt_clear_tag(bt, cache->tags[--cache->nr]);
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Free a tag to the cache of this cpu, half of a full cache is freed to
+ * the bitmap first. Once the tag is in the cache, a waiter that missed it
+ * is seen, the cache is then drained so that the waiters are woken up.
+ */
+static void bt_cache_put(struct blk_mq_bitmap_tags *bt, unsigned int tag)
+{
+	unsigned int size = ACCESS_ONCE(bt->cache_size);
+	struct bt_tag_cache *cache;
+	struct bt_wait_state *bs;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bt->cache);
+	spin_lock(&cache->lock);
+
+	if (cache->nr >= size) {
+		while (cache->nr > size / 2)
+			bt_clear_tag(bt, cache->tags[--cache->nr]);
+	}
+	if (cache->nr < size)
+		cache->tags[cache->nr++] = tag;
+	else
+		bt_clear_tag(bt, tag);
+
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+
+	/* Pairs with the barrier of prepare_to_wait() in bt_get() */
+	smp_mb();
+	if (!bt_wake_ptr(bt))
+		return;
+
+	bt_cache_drain(bt, cache);
+	bs = bt_wake_ptr(bt);
+	if (bs)
+		wake_up(&bs->wait);
+}
+
 static void __blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
 {
+	struct blk_mq_bitmap_tags *bt = &tags->bitmap_tags;
+
 	BUG_ON(tag >= tags->nr_tags);
 
-	bt_clear_tag(&tags->bitmap_tags, tag);
+	if (bt->cache_size)
+		bt_cache_put(bt, tag);
+	else
+		bt_clear_tag(bt, tag);
 }
 
 static void __blk_mq_put_reserved_tag(struct blk_mq_tags *tags,
@@ -456,8 +655,31 @@ static void bt_update_count(struct blk_mq_bitmap_tags *bt,
 		bt->wake_cnt = max(1U, depth / BT_WAIT_QUEUES);
 
 	bt->depth = depth;
+
+	/*
+	 * Only cache the tags when there are enough of them for the caches
+	 * to hold a small part of the depth.
+	 */
+	if (bt->cache) {
+		bt->cache_size = min_t(unsigned int, BT_CACHE_MAX,
+				       depth / (4 * num_possible_cpus()));
+		if (bt->cache_size < 2)
+			bt->cache_size = 0;
+	}
+}
+
+static void bt_cache_drain_all(struct blk_mq_bitmap_tags *bt)
+{
+	int cpu;
+
+	if (!bt->cache)
+		return;
+
+	for_each_possible_cpu(cpu)
+		bt_cache_drain(bt, per_cpu_ptr(bt->cache, cpu));
 }
 
+
 static int bt_alloc(struct blk_mq_bitmap_tags *bt, unsigned int depth,
 			int node, bool reserved)
 {
@@ -502,6 +724,18 @@ static int bt_alloc(struct blk_mq_bitmap_tags *bt, unsigned int depth,
 		return -ENOMEM;
 	}
 
+	if (!reserved && depth) {
+		bt->cache = alloc_percpu(struct bt_tag_cache);
+		if (!bt->cache) {
+			kfree(bt->bs);
+			kfree(bt->map);
+			return -ENOMEM;
+		}
+
+		for_each_possible_cpu(i)
+			spin_lock_init(&per_cpu_ptr(bt->cache, i)->lock);
+	}
+
 	bt_update_count(bt, depth);
 
 	for (i = 0; i < BT_WAIT_QUEUES; i++) {
@@ -514,6 +748,7 @@ static int bt_alloc(struct blk_mq_bitmap_tags *bt, unsigned int depth,
 
 static void bt_free(struct blk_mq_bitmap_tags *bt)
 {
+	free_percpu(bt->cache);
 	kfree(bt->map);
 	kfree(bt->bs);
 }
@@ -580,6 +815,7 @@ int blk_mq_tag_update_depth(struct blk_mq_tags *tags, unsigned int tdepth)
 	 * static and should never need resizing.
 	 */
 	bt_update_count(&tags->bitmap_tags, tdepth);
+	bt_cache_drain_all(&tags->bitmap_tags);
 	blk_mq_tag_wakeup_all(tags);
 	return 0;
 }
@@ -597,7 +833,8 @@ ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page)
 			tags->nr_tags, tags->nr_reserved_tags,
 			tags->bitmap_tags.bits_per_word);
 
-	free = bt_unused_tags(&tags->bitmap_tags);
+	free = bt_unused_tags(&tags->bitmap_tags) +
+	       bt_cached_tags(&tags->bitmap_tags);
 	res = bt_unused_tags(&tags->breserved_tags);
 
 	page += sprintf(page, "nr_free=%u, nr_reserved=%u\n", free, res);
@@ -635,6 +635,24 @@ static bool blk_mq_attempt_merge(struct request_queue *q,
 	return false;
 }
 
+/*
+ * Move the lockless inserts of a software queue to the tail of @list, in
+ * the order they were made.
+ */
+static void blk_mq_splice_submit_list(struct blk_mq_ctx *ctx,
+				      struct list_head *list)
+{
+	struct llist_node *node;
+	struct request *rq, *next;
+
+	if (llist_empty(&ctx->submit_list))
+		return;
+
+	node = llist_reverse_order(llist_del_all(&ctx->submit_list));
+	llist_for_each_entry_safe(rq, next, node, csd.llist)
+		list_add_tail(&rq->queuelist, list);
+}
+
 /*
  * Process software queues that have been marked busy, splicing them
  * to the for-dispatch
@@ -660,9 +678,18 @@ static void flush_busy_ctxs(struct blk_mq_hw_ctx *hctx, struct list_head *list)
 
 			ctx = hctx->ctxs[bit + off];
 			clear_bit(bit, &bm->word);
-			spin_lock(&ctx->lock);
-			list_splice_tail_init(&ctx->rq_list, list);
-			spin_unlock(&ctx->lock);
+			/*
+			 * Pairs with the barrier before the pending bit is
+			 * tested in the inserts, so that either we see the new
+			 * requests or the bit gets set again.
+			 */
+			smp_mb__after_atomic();
+			if (!list_empty_careful(&ctx->rq_list)) {
+				spin_lock(&ctx->lock);
+				list_splice_tail_init(&ctx->rq_list, list);
+				spin_unlock(&ctx->lock);
+			}
+			blk_mq_splice_submit_list(ctx, list);
 
 			bit++;
 		} while (1);
@@ -913,6 +940,26 @@ static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
 	else
 		list_add_tail(&rq->queuelist, &ctx->rq_list);
 
+	/* flush_busy_ctxs() checks rq_list without the lock */
+	smp_mb();
+	blk_mq_hctx_mark_pending(hctx, ctx);
+}
+
+/*
+ * Insert a request at the tail of its software queue without taking
+ * ctx->lock. The request goes to ctx->submit_list, which flush_busy_ctxs()
+ * drains in batches; the csd of the request isn't used before it is
+ * completed. The full barrier of llist_add() orders the insert before the
+ * test of the pending bit.
+ */
+static void blk_mq_insert_request_lockless(struct blk_mq_hw_ctx *hctx,
+					   struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	llist_add(&rq->csd.llist, &ctx->submit_list);
 	blk_mq_hctx_mark_pending(hctx, ctx);
 }
 
@@ -961,16 +1008,14 @@ static void blk_mq_insert_requests(struct request_queue *q,
 	 * preemption doesn't flush plug list, so it's possible ctx->cpu is
 	 * offline now
 	 */
-	spin_lock(&ctx->lock);
 	while (!list_empty(list)) {
 		struct request *rq;
 
 		rq = list_first_entry(list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
 		rq->mq_ctx = ctx;
-		__blk_mq_insert_request(hctx, rq, false);
+		blk_mq_insert_request_lockless(hctx, rq);
 	}
-	spin_unlock(&ctx->lock);
 
 	blk_mq_run_hw_queue(hctx, from_schedule);
 	blk_mq_put_ctx(current_ctx);
@@ -1053,18 +1098,19 @@ static inline bool blk_mq_merge_queue_io(struct blk_mq_hw_ctx *hctx,
 {
 	if (!hctx_allow_merges(hctx)) {
 		blk_mq_bio_to_request(rq, bio);
-		spin_lock(&ctx->lock);
-insert_rq:
-		__blk_mq_insert_request(hctx, rq, false);
-		spin_unlock(&ctx->lock);
+		blk_mq_insert_request_lockless(hctx, rq);
 		return false;
 	} else {
 		struct request_queue *q = hctx->queue;
 
 		spin_lock(&ctx->lock);
+		/* Let the merge see the lockless inserts too */
+		blk_mq_splice_submit_list(ctx, &ctx->rq_list);
 		if (!blk_mq_attempt_merge(q, ctx, bio)) {
 			blk_mq_bio_to_request(rq, bio);
-			goto insert_rq;
+			__blk_mq_insert_request(hctx, rq, false);
+			spin_unlock(&ctx->lock);
+			return false;
 		}
 
 		spin_unlock(&ctx->lock);
@@ -1433,6 +1479,7 @@ static int blk_mq_hctx_cpu_offline(struct blk_mq_hw_ctx *hctx, int cpu)
 	ctx = __blk_mq_get_ctx(q, cpu);
 
 	spin_lock(&ctx->lock);
+	blk_mq_splice_submit_list(ctx, &ctx->rq_list);
 	if (!list_empty(&ctx->rq_list)) {
 		list_splice_init(&ctx->rq_list, &tmp);
 		blk_mq_hctx_clear_pending(hctx, ctx);
@@ -1648,6 +1695,7 @@ static void blk_mq_init_cpu_queues(struct request_queue *q,
 		__ctx->cpu = i;
 		spin_lock_init(&__ctx->lock);
 		INIT_LIST_HEAD(&__ctx->rq_list);
+		init_llist_head(&__ctx->submit_list);
 		__ctx->queue = q;
 
 		/* If the cpu isn't online, the cpu is mapped to first hctx */
@@ -7,6 +7,8 @@ struct blk_mq_ctx {
 	struct {
 		spinlock_t		lock;
 		struct list_head	rq_list;
+		/* Lockless inserts, see blk_mq_insert_request_lockless() */
+		struct llist_head	submit_list;
 	}  ____cacheline_aligned_in_smp;
 
 	unsigned int		cpu;
@@ -17,6 +17,9 @@
 #define PART_BITS 4
 #define VQ_NAME_LEN 16
 
+/* Requests completed at once, out of the vq lock */
+#define VIRTBLK_DONE_BATCH 16
+
 static int major;
 static DEFINE_IDA(vd_index_ida);
 
@@ -132,30 +135,54 @@ static inline void virtblk_request_done(struct request *req)
 	blk_mq_end_request(req, error);
 }
 
+static void virtblk_complete_batch(struct virtblk_req **done, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		blk_mq_complete_request(done[i]->req);
+}
+
+/*
+ * The buffers are taken off the ring under the vq lock, but the requests
+ * are completed out of it, so that the submitters don't wait for the
+ * completions to run.
+ */
 static void virtblk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
+	struct virtblk_req *done[VIRTBLK_DONE_BATCH];
 	bool req_done = false;
 	int qid = vq->index;
 	struct virtblk_req *vbr;
 	unsigned long flags;
 	unsigned int len;
+	int nr = 0;
 
 	spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
 	do {
 		virtqueue_disable_cb(vq);
 		while ((vbr = virtqueue_get_buf(vblk->vqs[qid].vq, &len)) != NULL) {
-			blk_mq_complete_request(vbr->req);
+			done[nr++] = vbr;
 			req_done = true;
+			if (nr == VIRTBLK_DONE_BATCH) {
+				spin_unlock_irqrestore(&vblk->vqs[qid].lock,
+						       flags);
+				virtblk_complete_batch(done, nr);
+				nr = 0;
+				spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
+			}
 		}
 		if (unlikely(virtqueue_is_broken(vq)))
 			break;
 	} while (!virtqueue_enable_cb(vq));
+	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
+
+	virtblk_complete_batch(done, nr);
 
 	/* In case queue is stopped waiting for more buffers. */
 	if (req_done)
 		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
-	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
 }
 
 static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req,
@@ -212,9 +239,12 @@ static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req,
 	spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
 	err = __virtblk_add_req(vblk->vqs[qid].vq, vbr, vbr->sg, num);
 	if (err) {
-		virtqueue_kick(vblk->vqs[qid].vq);
+		notify = virtqueue_kick_prepare(vblk->vqs[qid].vq);
 		blk_mq_stop_hw_queue(hctx);
 		spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
+		/* The notification traps to the host, out of the lock too */
+		if (notify)
+			virtqueue_notify(vblk->vqs[qid].vq);
 		/* Out of mem doesn't actually happen, since we fall back
 		 * to direct descriptors */
 		if (err == -ENOMEM || err == -ENOSPC)
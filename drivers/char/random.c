@@ -260,6 +260,7 @@
 #include <linux/irq.h>
 #include <linux/syscalls.h>
 #include <linux/completion.h>
+#include <crypto/chacha20.h>
 
 #include <asm/processor.h>
 #include <asm/uaccess.h>
@@ -439,6 +440,7 @@ struct entropy_store {
 };
 
 static void push_to_pool(struct work_struct *work);
+static unsigned long crng_generation;
 static __u32 input_pool_data[INPUT_POOL_WORDS];
 static __u32 blocking_pool_data[OUTPUT_POOL_WORDS];
 static __u32 nonblocking_pool_data[OUTPUT_POOL_WORDS];
@@ -659,6 +661,7 @@ retry:
 		r->initialized = 1;
 		r->entropy_total = 0;
 		if (r == &nonblocking_pool) {
+			crng_generation++;
 			prandom_reseed_late();
 			wake_up_interruptible(&urandom_init_wait);
 			pr_notice("random: %s pool is initialized\n", r->name);
@@ -1223,6 +1226,177 @@ static ssize_t extract_entropy_user(struct entropy_store *r, void __user *buf,
 	return ret;
 }
 
+/*********************************************************************
+ *
+ * Per-CPU output generators
+ *
+ *********************************************************************/
+
+/*
+ * Once the nonblocking pool is initialized, get_random_bytes() and
+ * /dev/urandom are served by a ChaCha20 generator per CPU instead of
+ * extracting from the nonblocking pool, which takes its lock and hashes
+ * the whole pool for every 10 bytes. A generator is seeded with bytes
+ * extracted from the nonblocking pool, itself fed by the input pool, and
+ * reseeded every CRNG_RESEED_INTERVAL. Generating only disables the
+ * interrupts of the CPU. After each request, the key is overwritten with
+ * a block of output so that the state doesn't reveal the previous
+ * outputs.
+ *
+ * With fips_enabled, the pools are still used for their continuous test.
+ */
+#define CRNG_RESEED_INTERVAL	(300 * HZ)
+
+struct crng_state {
+	__u32		state[16];
+	unsigned long	init_time;
+	unsigned long	generation;	/* of crng_generation when seeded */
+};
+
+static DEFINE_PER_CPU(struct crng_state, crng_state);
+
+static bool crng_ready(void)
+{
+	return nonblocking_pool.initialized && !fips_enabled;
+}
+
+static bool crng_need_reseed(struct crng_state *crng)
+{
+	return crng->generation != ACCESS_ONCE(crng_generation) ||
+	       time_after(jiffies, crng->init_time + CRNG_RESEED_INTERVAL);
+}
+
+/*
+ * Seed the generator of the current CPU. The entropy is extracted before
+ * disabling the interrupts, we may be running on another CPU by then, its
+ * generator is seeded instead.
+ */
+static void crng_reseed(void)
+{
+	union {
+		__u32	w[12];
+		__u8	b[12 * sizeof(__u32)];
+	} seed;
+	struct crng_state *crng;
+	unsigned long flags, rv;
+	unsigned long generation = ACCESS_ONCE(crng_generation);
+	int i;
+
+	extract_entropy(&nonblocking_pool, seed.b, sizeof(seed), 0, 0);
+
+	local_irq_save(flags);
+	crng = this_cpu_ptr(&crng_state);
+	/* "expand 32-byte k" */
+	crng->state[0] = 0x61707865;
+	crng->state[1] = 0x3320646e;
+	crng->state[2] = 0x79622d32;
+	crng->state[3] = 0x6b206574;
+	/* Keep what the previous seed had on top of the new one */
+	for (i = 0; i < ARRAY_SIZE(seed.w); i++) {
+		if (!arch_get_random_long(&rv))
+			rv = 0;
+		crng->state[i + 4] ^= seed.w[i] ^ (__u32)rv;
+	}
+	crng->init_time = jiffies;
+	crng->generation = generation;
+	local_irq_restore(flags);
+
+	memzero_explicit(&seed, sizeof(seed));
+}
+
+/*
+ * Generate the next block of the generator of the current CPU, reseeding
+ * it first if needed.
+ */
+static void crng_block(__u8 out[CHACHA20_BLOCK_SIZE])
+{
+	struct crng_state *crng;
+	unsigned long flags;
+
+	for (;;) {
+		local_irq_save(flags);
+		crng = this_cpu_ptr(&crng_state);
+		if (!crng_need_reseed(crng))
+			break;
+		local_irq_restore(flags);
+		crng_reseed();
+	}
+	chacha20_block(crng->state, out);
+	local_irq_restore(flags);
+}
+
+/*
+ * Replace the key of the generator of the current CPU, after a request.
+ */
+static void crng_backtrack_protect(void)
+{
+	union {
+		__u32	w[CHACHA20_BLOCK_SIZE / sizeof(__u32)];
+		__u8	b[CHACHA20_BLOCK_SIZE];
+	} tmp;
+	struct crng_state *crng;
+	unsigned long flags;
+	int i;
+
+	local_irq_save(flags);
+	crng = this_cpu_ptr(&crng_state);
+	chacha20_block(crng->state, tmp.b);
+	for (i = 0; i < CHACHA20_KEY_SIZE / sizeof(__u32); i++)
+		crng->state[i + 4] ^= tmp.w[i];
+	local_irq_restore(flags);
+
+	memzero_explicit(&tmp, sizeof(tmp));
+}
+
+static void crng_get_bytes(void *buf, int nbytes)
+{
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	int i;
+
+	while (nbytes > 0) {
+		crng_block(tmp);
+		i = min_t(int, nbytes, CHACHA20_BLOCK_SIZE);
+		memcpy(buf, tmp, i);
+		nbytes -= i;
+		buf += i;
+	}
+	crng_backtrack_protect();
+	memzero_explicit(tmp, sizeof(tmp));
+}
+
+static ssize_t crng_get_bytes_user(void __user *buf, size_t nbytes)
+{
+	ssize_t ret = 0, i;
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	int large_request = (nbytes > 256);
+
+	while (nbytes) {
+		if (large_request && need_resched()) {
+			if (signal_pending(current)) {
+				if (ret == 0)
+					ret = -ERESTARTSYS;
+				break;
+			}
+			schedule();
+		}
+
+		crng_block(tmp);
+		i = min_t(size_t, nbytes, CHACHA20_BLOCK_SIZE);
+		if (copy_to_user(buf, tmp, i)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		nbytes -= i;
+		buf += i;
+		ret += i;
+	}
+	crng_backtrack_protect();
+	memzero_explicit(tmp, sizeof(tmp));
+
+	return ret;
+}
+
 /*
  * This function is the exported kernel interface.  It returns some
  * number of good random numbers, suitable for key generation, seeding
@@ -1240,7 +1414,10 @@ void get_random_bytes(void *buf, int nbytes)
 		       nonblocking_pool.entropy_total);
 #endif
 	trace_get_random_bytes(nbytes, _RET_IP_);
-	extract_entropy(&nonblocking_pool, buf, nbytes, 0, 0);
+	if (crng_ready())
+		crng_get_bytes(buf, nbytes);
+	else
+		extract_entropy(&nonblocking_pool, buf, nbytes, 0, 0);
 }
 EXPORT_SYMBOL(get_random_bytes);
 
@@ -1271,7 +1448,9 @@ void get_random_bytes_arch(void *buf, int nbytes)
 		nbytes -= chunk;
 	}
 
-	if (nbytes)
+	if (nbytes && crng_ready())
+		crng_get_bytes(p, nbytes);
+	else if (nbytes)
 		extract_entropy(&nonblocking_pool, p, nbytes, 0, 0);
 }
 EXPORT_SYMBOL(get_random_bytes_arch);
@@ -1387,7 +1566,10 @@ urandom_read(struct file *file, char __user *buf, size_t nbytes, loff_t *ppos)
 			    current->comm, nonblocking_pool.entropy_total);
 
 	nbytes = min_t(size_t, nbytes, INT_MAX >> (ENTROPY_SHIFT + 3));
-	ret = extract_entropy_user(&nonblocking_pool, buf, nbytes);
+	if (crng_ready())
+		ret = crng_get_bytes_user(buf, nbytes);
+	else
+		ret = extract_entropy_user(&nonblocking_pool, buf, nbytes);
 
 	trace_urandom_read(8 * nbytes, ENTROPY_BITS(&nonblocking_pool),
 			   ENTROPY_BITS(&input_pool));
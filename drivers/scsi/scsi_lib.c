@@ -2049,6 +2049,8 @@ struct request_queue *scsi_alloc_queue(struct scsi_device *sdev)
 	blk_queue_softirq_done(q, scsi_softirq_done);
 	blk_queue_rq_timed_out(q, scsi_times_out);
 	blk_queue_lld_busy(q, scsi_lld_busy);
+	/* scsi_request_fn() peeks again after each dispatch */
+	queue_flag_set_unlocked(QUEUE_FLAG_REPEEK, q);
 	return q;
 }
 
@@ -2011,7 +2011,7 @@ void ll_umount_begin(struct super_block *sb)
 	struct obd_ioctl_data *ioc_data;
 
 	CDEBUG(D_VFSTRACE, "VFS Op: superblock %p count %d active %d\n", sb,
-	       sb->s_count, atomic_read(&sb->s_active));
+	       sb->s_lockref.count, atomic_read(&sb->s_active));
 
 	obd = class_exp2obd(sbi->ll_md_exp);
 	if (obd == NULL) {
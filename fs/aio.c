@@ -49,6 +49,10 @@
 #define AIO_RING_MAGIC			0xa10a10a1
 #define AIO_RING_COMPAT_FEATURES	1
 #define AIO_RING_INCOMPAT_FEATURES	0
+
+/* set in kioctx->tail_reserved while the ring pages are being migrated */
+#define AIO_TAIL_FROZEN			(1U << 31)
+
 struct aio_ring {
 	unsigned	id;	/* kernel internal index number */
 	unsigned	nr;	/* number of io_events */
@@ -139,9 +143,16 @@ struct kioctx {
 		wait_queue_head_t wait;
 	} ____cacheline_aligned_in_smp;
 
+	/*
+	 * aio_complete() reserves ring slots with a cmpxchg on tail_reserved
+	 * and publishes them in reservation order by advancing tail; see
+	 * aio_ring_reserve().  completion_lock only serialises the
+	 * reqs_available refill and ring page migration.
+	 */
 	struct {
 		unsigned	tail;
-		unsigned	completed_events;
+		unsigned	tail_reserved;
+		atomic_t	completed_events;
 		spinlock_t	completion_lock;
 	} ____cacheline_aligned_in_smp;
 
@@ -286,12 +297,94 @@ static int aio_set_page_dirty(struct page *page)
 	return 0;
 }
 
+/* aio_ring_reserve
+ *	Reserve the next ring slot for a completion event.  Completions run
+ *	on many CPUs at once, so the slot is claimed with a cmpxchg on
+ *	ctx->tail_reserved instead of under a lock.  There is always room:
+ *	reqs_available never lets more requests be in flight than the ring
+ *	holds.  Must be called with interrupts disabled, so that a slot
+ *	reserved here is published before this CPU reserves another one.
+ */
+static unsigned aio_ring_reserve(struct kioctx *ctx)
+{
+	unsigned old, new;
+
+	for (;;) {
+		old = ACCESS_ONCE(ctx->tail_reserved);
+		if (unlikely(old & AIO_TAIL_FROZEN)) {
+			cpu_relax();
+			continue;
+		}
+
+		new = old + 1;
+		if (new >= ctx->nr_events)
+			new = 0;
+		if (cmpxchg(&ctx->tail_reserved, old, new) == old)
+			return old;
+	}
+}
+
+/* aio_ring_publish
+ *	Make the event in @slot visible to userspace by moving the ring tail
+ *	past it.  Slots are published in the order they were reserved, so we
+ *	wait for the completions that reserved before us, which are only
+ *	ever in the middle of writing one event.  Returns the ring head.
+ */
+static unsigned aio_ring_publish(struct kioctx *ctx, unsigned slot,
+				 unsigned tail)
+{
+	struct aio_ring *ring;
+	unsigned head;
+
+	while (ACCESS_ONCE(ctx->tail) != slot)
+		cpu_relax();
+
+	ring = kmap_atomic(ctx->ring_pages[0]);
+	head = ring->head;
+	ring->tail = tail;
+	kunmap_atomic(ring);
+	flush_dcache_page(ctx->ring_pages[0]);
+
+	smp_wmb();	/* ring->tail before handing over to the next slot */
+	ACCESS_ONCE(ctx->tail) = tail;
+
+	return head;
+}
+
 #if IS_ENABLED(CONFIG_MIGRATION)
+/* aio_ring_freeze
+ *	Stop new slot reservations and wait for the ones handed out to be
+ *	published, so the ring pages can be copied.  Called with
+ *	completion_lock held and interrupts disabled.  Returns the tail to
+ *	pass to aio_ring_thaw().
+ */
+static unsigned aio_ring_freeze(struct kioctx *ctx)
+{
+	unsigned old;
+
+	do {
+		old = ACCESS_ONCE(ctx->tail_reserved);
+	} while (cmpxchg(&ctx->tail_reserved, old, old | AIO_TAIL_FROZEN) != old);
+
+	while (ACCESS_ONCE(ctx->tail) != old)
+		cpu_relax();
+	smp_mb();	/* published events before the page copy */
+
+	return old;
+}
+
+static void aio_ring_thaw(struct kioctx *ctx, unsigned tail)
+{
+	smp_mb();	/* page copy before reopening the ring */
+	ACCESS_ONCE(ctx->tail_reserved) = tail;
+}
+
 static int aio_migratepage(struct address_space *mapping, struct page *new,
 			struct page *old, enum migrate_mode mode)
 {
 	struct kioctx *ctx;
 	unsigned long flags;
+	unsigned tail;
 	pgoff_t idx;
 	int rc;
 
@@ -335,14 +428,16 @@ static int aio_migratepage(struct address_space *mapping, struct page *new,
 		goto out_unlock;
 	}
 
-	/* Take completion_lock to prevent other writes to the ring buffer
+	/* Freeze the ring tail to prevent other writes to the ring buffer
 	 * while the old page is copied to the new.  This prevents new
 	 * events from being lost.
 	 */
 	spin_lock_irqsave(&ctx->completion_lock, flags);
+	tail = aio_ring_freeze(ctx);
 	migrate_page_copy(new, old);
 	BUG_ON(ctx->ring_pages[idx] != old);
 	ctx->ring_pages[idx] = new;
+	aio_ring_thaw(ctx, tail);
 	spin_unlock_irqrestore(&ctx->completion_lock, flags);
 
 	/* The old page is no longer accessible. */
@@ -869,11 +964,18 @@ out:
  *	from aio_complete() (to optimistically update reqs_available) or
  *	from aio_get_req() (the we're out of events case).  It must be
  *	called holding ctx->completion_lock.
+ *
+ *	completed_events is sampled before the published tail, and
+ *	aio_complete() only counts an event once it is published, so an
+ *	event racing with us can only make us undercount the consumed ones.
  */
-static void refill_reqs_available(struct kioctx *ctx, unsigned head,
-                                  unsigned tail)
+static void refill_reqs_available(struct kioctx *ctx, unsigned head)
 {
-	unsigned events_in_ring, completed;
+	unsigned events_in_ring, completed, tail;
+
+	completed = atomic_read(&ctx->completed_events);
+	smp_rmb();
+	tail = ACCESS_ONCE(ctx->tail);
 
 	/* Clamp head since userland can write to it. */
 	head %= ctx->nr_events;
@@ -882,7 +984,6 @@ static void refill_reqs_available(struct kioctx *ctx, unsigned head,
 	else
 		events_in_ring = ctx->nr_events - (head - tail);
 
-	completed = ctx->completed_events;
 	if (events_in_ring < completed)
 		completed -= events_in_ring;
 	else
@@ -891,7 +992,7 @@ static void refill_reqs_available(struct kioctx *ctx, unsigned head,
 	if (!completed)
 		return;
 
-	ctx->completed_events -= completed;
+	atomic_sub(completed, &ctx->completed_events);
 	put_reqs_available(ctx, completed);
 }
 
@@ -902,24 +1003,23 @@ static void refill_reqs_available(struct kioctx *ctx, unsigned head,
 static void user_refill_reqs_available(struct kioctx *ctx)
 {
 	spin_lock_irq(&ctx->completion_lock);
-	if (ctx->completed_events) {
+	if (atomic_read(&ctx->completed_events)) {
 		struct aio_ring *ring;
 		unsigned head;
 
 		/* Access of ring->head may race with aio_read_events_ring()
 		 * here, but that's okay since whether we read the old version
 		 * or the new version, and either will be valid.  The important
-		 * part is that head cannot pass tail since we prevent
-		 * aio_complete() from updating tail by holding
-		 * ctx->completion_lock.  Even if head is invalid, the check
-		 * against ctx->completed_events below will make sure we do the
-		 * safe/right thing.
+		 * part is that head cannot pass the tail we sample afterwards,
+		 * as aio_complete() only ever moves the tail forward.  Even if
+		 * head is invalid, the check against ctx->completed_events
+		 * will make sure we do the safe/right thing.
 		 */
 		ring = kmap_atomic(ctx->ring_pages[0]);
 		head = ring->head;
 		kunmap_atomic(ring);
 
-		refill_reqs_available(ctx, head, ctx->tail);
+		refill_reqs_available(ctx, head);
 	}
 
 	spin_unlock_irq(&ctx->completion_lock);
@@ -996,7 +1096,7 @@ void aio_complete(struct kiocb *iocb, long res, long res2)
 	struct kioctx	*ctx = iocb->ki_ctx;
 	struct aio_ring	*ring;
 	struct io_event	*ev_page, *event;
-	unsigned tail, pos, head;
+	unsigned tail, pos, head, slot;
 	unsigned long	flags;
 
 	/*
@@ -1023,13 +1123,14 @@ void aio_complete(struct kiocb *iocb, long res, long res2)
 	}
 
 	/*
-	 * Add a completion event to the ring buffer. Must be done holding
-	 * ctx->completion_lock to prevent other code from messing with the tail
-	 * pointer since we might be called from irq context.
+	 * Add a completion event to the ring buffer. Interrupts stay disabled
+	 * from reserving the slot to publishing it, since a completion from
+	 * irq context on this CPU would otherwise wait for us to publish.
 	 */
-	spin_lock_irqsave(&ctx->completion_lock, flags);
+	local_irq_save(flags);
 
-	tail = ctx->tail;
+	slot = aio_ring_reserve(ctx);
+	tail = slot;
 	pos = tail + AIO_EVENTS_OFFSET;
 
 	if (++tail >= ctx->nr_events)
@@ -1055,18 +1156,19 @@ void aio_complete(struct kiocb *iocb, long res, long res2)
 	 */
 	smp_wmb();	/* make event visible before updating tail */
 
-	ctx->tail = tail;
+	head = aio_ring_publish(ctx, slot, tail);
 
-	ring = kmap_atomic(ctx->ring_pages[0]);
-	head = ring->head;
-	ring->tail = tail;
-	kunmap_atomic(ring);
-	flush_dcache_page(ctx->ring_pages[0]);
-
-	ctx->completed_events++;
-	if (ctx->completed_events > 1)
-		refill_reqs_available(ctx, head, tail);
-	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+	/*
+	 * Only count the event once it is published, see
+	 * refill_reqs_available().  The refill is opportunistic: whoever
+	 * holds completion_lock already does it for us.
+	 */
+	if (atomic_inc_return(&ctx->completed_events) > ctx->req_batch &&
+	    spin_trylock(&ctx->completion_lock)) {
+		refill_reqs_available(ctx, head);
+		spin_unlock(&ctx->completion_lock);
+	}
+	local_irq_restore(flags);
 
 	pr_debug("added to ring %p at [%u]\n", iocb, tail);
 
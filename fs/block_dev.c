@@ -1722,35 +1722,39 @@ EXPORT_SYMBOL(__invalidate_device);
 void iterate_bdevs(void (*func)(struct block_device *, void *), void *arg)
 {
 	struct inode *inode, *old_inode = NULL;
-
-	spin_lock(&inode_sb_list_lock);
-	list_for_each_entry(inode, &blockdev_superblock->s_inodes, i_sb_list) {
-		struct address_space *mapping = inode->i_mapping;
-
-		spin_lock(&inode->i_lock);
-		if (inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW) ||
-		    mapping->nrpages == 0) {
+	struct pcpu_list_head *ph;
+	int cpu;
+
+	for_each_pcpu_list(ph, blockdev_superblock->s_inodes, cpu) {
+		spin_lock(&ph->lock);
+		list_for_each_entry(inode, &ph->list, i_sb_list.list) {
+			struct address_space *mapping = inode->i_mapping;
+
+			spin_lock(&inode->i_lock);
+			if (inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW) ||
+			    mapping->nrpages == 0) {
+				spin_unlock(&inode->i_lock);
+				continue;
+			}
+			__iget(inode);
 			spin_unlock(&inode->i_lock);
-			continue;
-		}
-		__iget(inode);
-		spin_unlock(&inode->i_lock);
-		spin_unlock(&inode_sb_list_lock);
-		/*
-		 * We hold a reference to 'inode' so it couldn't have been
-		 * removed from s_inodes list while we dropped the
-		 * inode_sb_list_lock.  We cannot iput the inode now as we can
-		 * be holding the last reference and we cannot iput it under
-		 * inode_sb_list_lock. So we keep the reference and iput it
-		 * later.
-		 */
-		iput(old_inode);
-		old_inode = inode;
+			spin_unlock(&ph->lock);
+			/*
+			 * We hold a reference to 'inode' so it couldn't have
+			 * been removed from s_inodes list while we dropped the
+			 * sublist lock.  We cannot iput the inode now as we
+			 * can be holding the last reference and we cannot
+			 * iput it under the sublist lock. So we keep the
+			 * reference and iput it later.
+			 */
+			iput(old_inode);
+			old_inode = inode;
 
-		func(I_BDEV(inode), arg);
+			func(I_BDEV(inode), arg);
 
-		spin_lock(&inode_sb_list_lock);
+			spin_lock(&ph->lock);
+		}
+		spin_unlock(&ph->lock);
 	}
-	spin_unlock(&inode_sb_list_lock);
 	iput(old_inode);
 }
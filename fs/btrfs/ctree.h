@@ -1169,6 +1169,13 @@ struct btrfs_space_info {
 	 */
 	struct percpu_counter total_bytes_pinned;
 
+	/*
+	 * Data space only: per-cpu bytes that are already accounted in
+	 * bytes_may_use but not handed out to any inode yet, so that
+	 * ordinary data reservations and releases don't need the lock.
+	 */
+	atomic64_t __percpu *may_use_cache;
+
 	struct list_head list;
 
 	struct rw_semaphore groups_sem;
@@ -3500,6 +3500,15 @@ static int update_space_info(struct btrfs_fs_info *info, u64 flags,
 		return ret;
 	}
 
+	if ((flags & BTRFS_BLOCK_GROUP_TYPE_MASK) == BTRFS_BLOCK_GROUP_DATA) {
+		found->may_use_cache = alloc_percpu(atomic64_t);
+		if (!found->may_use_cache) {
+			percpu_counter_destroy(&found->total_bytes_pinned);
+			kfree(found);
+			return -ENOMEM;
+		}
+	}
+
 	for (i = 0; i < BTRFS_NR_RAID_TYPES; i++)
 		INIT_LIST_HEAD(&found->block_groups[i]);
 	init_rwsem(&found->groups_sem);
@@ -3523,6 +3532,7 @@ static int update_space_info(struct btrfs_fs_info *info, u64 flags,
 				    info->space_info_kobj, "%s",
 				    alloc_name(found->flags));
 	if (ret) {
+		free_percpu(found->may_use_cache);
 		kfree(found);
 		return ret;
 	}
@@ -3670,6 +3680,77 @@ u64 btrfs_get_alloc_profile(struct btrfs_root *root, int data)
 	return ret;
 }
 
+/*
+ * Data reservations are handed out from a small per-cpu cache of bytes that
+ * have already been added to bytes_may_use, and returned to it on release.
+ * The cache is refilled in DATA_RESERVE_BATCH chunks while the space is far
+ * from full, and drained back into the space_info before we decide that we
+ * are out of space.
+ */
+#define DATA_RESERVE_BATCH	(256 * 1024)
+
+static int data_cache_take(struct btrfs_space_info *sinfo, u64 bytes)
+{
+	atomic64_t *cache;
+	s64 old, cur;
+	int ret = 0;
+
+	if (!sinfo->may_use_cache)
+		return 0;
+
+	cache = get_cpu_ptr(sinfo->may_use_cache);
+	cur = atomic64_read(cache);
+	while (cur >= bytes) {
+		old = atomic64_cmpxchg(cache, cur, cur - bytes);
+		if (old == cur) {
+			ret = 1;
+			break;
+		}
+		cur = old;
+	}
+	put_cpu_ptr(sinfo->may_use_cache);
+	return ret;
+}
+
+static int data_cache_put(struct btrfs_space_info *sinfo, u64 bytes)
+{
+	atomic64_t *cache;
+	int ret = 0;
+
+	if (!sinfo->may_use_cache)
+		return 0;
+
+	cache = get_cpu_ptr(sinfo->may_use_cache);
+	if (atomic64_read(cache) + bytes <= 2 * DATA_RESERVE_BATCH) {
+		atomic64_add(bytes, cache);
+		ret = 1;
+	}
+	put_cpu_ptr(sinfo->may_use_cache);
+	return ret;
+}
+
+/*
+ * Give every cpu's cached reservation back to the space_info, returns the
+ * number of bytes removed from bytes_may_use.
+ *
+ * Called with sinfo->lock held.
+ */
+static u64 data_cache_drain(struct btrfs_space_info *sinfo)
+{
+	u64 drained = 0;
+	int cpu;
+
+	if (!sinfo->may_use_cache)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		drained += atomic64_xchg(per_cpu_ptr(sinfo->may_use_cache, cpu),
+					 0);
+	WARN_ON(sinfo->bytes_may_use < drained);
+	sinfo->bytes_may_use -= drained;
+	return drained;
+}
+
 /*
  * This will check the space that the inode allocates from to make sure we have
  * enough space for bytes.
@@ -3694,6 +3775,12 @@ int btrfs_check_data_free_space(struct inode *inode, u64 bytes)
 	if (!data_sinfo)
 		goto alloc;
 
+	if (data_cache_take(data_sinfo, bytes)) {
+		trace_btrfs_space_reservation(root->fs_info, "space_info",
+					      data_sinfo->flags, bytes, 1);
+		return 0;
+	}
+
 again:
 	/* make sure we have enough space to handle the data first */
 	spin_lock(&data_sinfo->lock);
@@ -3704,6 +3791,12 @@ again:
 	if (used + bytes > data_sinfo->total_bytes) {
 		struct btrfs_trans_handle *trans;
 
+		/* the per-cpu caches may be holding what we need */
+		if (data_cache_drain(data_sinfo)) {
+			spin_unlock(&data_sinfo->lock);
+			goto again;
+		}
+
 		/*
 		 * if we don't have enough free bytes in this space then we need
 		 * to alloc a new chunk.
@@ -3778,6 +3871,12 @@ commit_trans:
 	data_sinfo->bytes_may_use += bytes;
 	trace_btrfs_space_reservation(root->fs_info, "space_info",
 				      data_sinfo->flags, bytes, 1);
+
+	/* refill this cpu's cache while there is plenty of room */
+	if (data_sinfo->may_use_cache &&
+	    used + bytes + DATA_RESERVE_BATCH <= data_sinfo->total_bytes &&
+	    data_cache_put(data_sinfo, DATA_RESERVE_BATCH))
+		data_sinfo->bytes_may_use += DATA_RESERVE_BATCH;
 	spin_unlock(&data_sinfo->lock);
 
 	return 0;
@@ -3795,6 +3894,12 @@ void btrfs_free_reserved_data_space(struct inode *inode, u64 bytes)
 	bytes = ALIGN(bytes, root->sectorsize);
 
 	data_sinfo = root->fs_info->data_sinfo;
+	if (data_cache_put(data_sinfo, bytes)) {
+		trace_btrfs_space_reservation(root->fs_info, "space_info",
+					      data_sinfo->flags, bytes, 0);
+		return;
+	}
+
 	spin_lock(&data_sinfo->lock);
 	WARN_ON(data_sinfo->bytes_may_use < bytes);
 	data_sinfo->bytes_may_use -= bytes;
@@ -8510,6 +8615,7 @@ static int set_block_group_ro(struct btrfs_block_group_cache *cache, int force)
 		min_allocable_bytes = 0;
 
 	spin_lock(&sinfo->lock);
+	data_cache_drain(sinfo);
 	spin_lock(&cache->lock);
 
 	if (cache->ro) {
@@ -8927,6 +9033,9 @@ int btrfs_free_block_groups(struct btrfs_fs_info *info)
 		space_info = list_entry(info->space_info.next,
 					struct btrfs_space_info,
 					list);
+		spin_lock(&space_info->lock);
+		data_cache_drain(space_info);
+		spin_unlock(&space_info->lock);
 		if (btrfs_test_opt(info->tree_root, ENOSPC_DEBUG)) {
 			if (WARN_ON(space_info->bytes_pinned > 0 ||
 			    space_info->bytes_reserved > 0 ||
@@ -344,6 +344,7 @@ static void space_info_release(struct kobject *kobj)
 {
 	struct btrfs_space_info *sinfo = to_space_info(kobj);
 	percpu_counter_destroy(&sinfo->total_bytes_pinned);
+	free_percpu(sinfo->may_use_cache);
 	kfree(sinfo);
 }
 
@@ -38,6 +38,8 @@
 #include <linux/prefetch.h>
 #include <linux/ratelimit.h>
 #include <linux/list_lru.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "internal.h"
 #include "mount.h"
 
@@ -117,6 +119,18 @@ struct dentry_stat_t dentry_stat = {
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 
+/*
+ * How often the lockless lookups had to retry, mostly because of the
+ * renames. Only counted on the slow paths, and shown in the debugfs file
+ * dcache_retries.
+ */
+static DEFINE_PER_CPU(unsigned long, dcache_retries[NR_DCACHE_RETRY]);
+
+void dcache_count_retry(enum dcache_retry retry)
+{
+	this_cpu_inc(dcache_retries[retry]);
+}
+
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
 /*
@@ -608,6 +622,63 @@ again:
  * Real recursion would eat up our stack space.
  */
 
+/*
+ * Try to drop a reference without d_lock. Returns true if it was dropped,
+ * false with d_lock held and the count at 1 if dput() has to decide whether
+ * to retain or kill the dentry.
+ *
+ * Only the dentries that are freed after a grace period are dropped to
+ * zero locklessly, those that never were RCU-visible could be killed and
+ * freed by someone else before we take their lock. Called under
+ * rcu_read_lock().
+ */
+static inline bool fast_dput(struct dentry *dentry)
+{
+	unsigned int d_flags;
+	int ret;
+
+	d_flags = ACCESS_ONCE(dentry->d_flags);
+	if (unlikely((d_flags & (DCACHE_OP_DELETE | DCACHE_RCUACCESS)) !=
+		     DCACHE_RCUACCESS))
+		return lockref_put_or_lock(&dentry->d_lockref);
+
+	ret = lockref_put_return(&dentry->d_lockref);
+	if (unlikely(ret < 0)) {
+		spin_lock(&dentry->d_lock);
+		if (dentry->d_lockref.count > 1) {
+			dentry->d_lockref.count--;
+			spin_unlock(&dentry->d_lock);
+			return true;
+		}
+		return false;
+	}
+	if (ret)
+		return true;
+
+	/*
+	 * We dropped the last reference. If the dentry is hashed, referenced
+	 * and on the LRU, the locked path would leave it as it is anyway.
+	 */
+	smp_rmb();
+	d_flags = ACCESS_ONCE(dentry->d_flags);
+	d_flags &= DCACHE_REFERENCED | DCACHE_LRU_LIST;
+	if (d_flags == (DCACHE_REFERENCED | DCACHE_LRU_LIST) &&
+	    !d_unhashed(dentry))
+		return true;
+
+	/*
+	 * Otherwise take the last reference back under the lock, unless
+	 * somebody got a new one or killed the dentry meanwhile.
+	 */
+	spin_lock(&dentry->d_lock);
+	if (dentry->d_lockref.count) {
+		spin_unlock(&dentry->d_lock);
+		return true;
+	}
+	dentry->d_lockref.count = 1;
+	return false;
+}
+
 /*
  * dput - release a dentry
  * @dentry: dentry to release 
@@ -623,8 +694,12 @@ void dput(struct dentry *dentry)
 		return;
 
 repeat:
-	if (lockref_put_or_lock(&dentry->d_lockref))
+	rcu_read_lock();
+	if (likely(fast_dput(dentry))) {
+		rcu_read_unlock();
 		return;
+	}
+	rcu_read_unlock();
 
 	/* Unreachable? Get rid of it */
 	if (unlikely(d_unhashed(dentry)))
@@ -2095,15 +2170,18 @@ seqretry:
  */
 struct dentry *d_lookup(const struct dentry *parent, const struct qstr *name)
 {
+	static DEFINE_SEQLOCK_SITE(site);
+	struct seqlock_read sr = SEQLOCK_READ_INIT;
 	struct dentry *dentry;
-	unsigned seq;
 
-	do {
-		seq = read_seqbegin(&rename_lock);
+	for (;;) {
+		read_seqbegin_adaptive(&rename_lock, &sr);
 		dentry = __d_lookup(parent, name);
-		if (dentry)
+		if (dentry || !read_seqretry_adaptive(&rename_lock, &sr, &site))
 			break;
-	} while (read_seqretry(&rename_lock, seq));
+		dcache_count_retry(DCACHE_RETRY_D_LOOKUP);
+	}
+	done_seqretry_adaptive(&rename_lock, &sr, &site);
 	return dentry;
 }
 EXPORT_SYMBOL(d_lookup);
@@ -2465,10 +2543,10 @@ static void dentry_unlock_for_move(struct dentry *dentry, struct dentry *target)
  * to rehash it without giving it a new name/hash key - whether
  * we swap or overwrite the names here, resulting name won't match
  * the reality in filesystem; it's only there for d_path() purposes.
- * Note that all of this is happening under rename_lock, so the
- * any hash lookup seeing it in the middle of manipulations will
- * be discarded anyway.  So we do not care what happens to the hash
- * key in that case.
+ * Note that all of this is happening within a write section of
+ * rename_lock, so the any hash lookup seeing it in the middle of
+ * manipulations will be discarded anyway.  So we do not care what
+ * happens to the hash key in that case.
  */
 /*
  * __d_move - move a dentry
@@ -2478,12 +2556,19 @@ static void dentry_unlock_for_move(struct dentry *dentry, struct dentry *target)
  *
  * Update the dcache to reflect the move of a file name. Negative
  * dcache entries should not be moved in this way. Caller must hold
- * rename_lock, the i_mutex of the source and target directories,
- * and the sb->s_vfs_rename_mutex if they differ. See lock_rename().
+ * rename_lock with read_seqlock_excl(), the i_mutex of the source and
+ * target directories, and the sb->s_vfs_rename_mutex if they differ.
+ * See lock_rename().
+ *
+ * The rename_lock sequence, which makes the lockless lookups and d_path()
+ * retry, is only bumped around the changes of the hashes, names and
+ * parents, not while the d_locks are taken.
  */
 static void __d_move(struct dentry *dentry, struct dentry *target,
 		     bool exchange)
 {
+	bool spliced;
+
 	if (!dentry->d_inode)
 		printk(KERN_WARNING "VFS: moving negative dcache entry\n");
 
@@ -2492,6 +2577,8 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
 
 	dentry_lock_for_move(dentry, target);
 
+	/* The exclusion of the other writers is provided by rename_lock */
+	write_seqcount_begin(&rename_lock.seqcount);
 	write_seqcount_begin(&dentry->d_seq);
 	write_seqcount_begin_nested(&target->d_seq, DENTRY_D_LOCK_NESTED);
 
@@ -2521,7 +2608,8 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
 		copy_name(dentry, target);
 
 	/* ... and switch them in the tree */
-	if (IS_ROOT(dentry)) {
+	spliced = IS_ROOT(dentry);
+	if (spliced) {
 		/* splicing a tree */
 		dentry->d_parent = target->d_parent;
 		target->d_parent = target;
@@ -2532,13 +2620,17 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
 		swap(dentry->d_parent, target->d_parent);
 		list_move(&target->d_u.d_child, &target->d_parent->d_subdirs);
 		list_move(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
-		if (exchange)
-			fsnotify_d_move(target);
-		fsnotify_d_move(dentry);
 	}
 
 	write_seqcount_end(&target->d_seq);
 	write_seqcount_end(&dentry->d_seq);
+	write_seqcount_end(&rename_lock.seqcount);
+
+	if (!spliced) {
+		if (exchange)
+			fsnotify_d_move(target);
+		fsnotify_d_move(dentry);
+	}
 
 	dentry_unlock_for_move(dentry, target);
 }
@@ -2554,9 +2646,9 @@ static void __d_move(struct dentry *dentry, struct dentry *target,
  */
 void d_move(struct dentry *dentry, struct dentry *target)
 {
-	write_seqlock(&rename_lock);
+	read_seqlock_excl(&rename_lock);
 	__d_move(dentry, target, false);
-	write_sequnlock(&rename_lock);
+	read_sequnlock_excl(&rename_lock);
 }
 EXPORT_SYMBOL(d_move);
 
@@ -2567,7 +2659,7 @@ EXPORT_SYMBOL(d_move);
  */
 void d_exchange(struct dentry *dentry1, struct dentry *dentry2)
 {
-	write_seqlock(&rename_lock);
+	read_seqlock_excl(&rename_lock);
 
 	WARN_ON(!dentry1->d_inode);
 	WARN_ON(!dentry2->d_inode);
@@ -2576,7 +2668,7 @@ void d_exchange(struct dentry *dentry1, struct dentry *dentry2)
 
 	__d_move(dentry1, dentry2, true);
 
-	write_sequnlock(&rename_lock);
+	read_sequnlock_excl(&rename_lock);
 }
 
 /**
@@ -2602,7 +2694,8 @@ struct dentry *d_ancestor(struct dentry *p1, struct dentry *p2)
  * This helper attempts to cope with remotely renamed directories
  *
  * It assumes that the caller is already holding
- * dentry->d_parent->d_inode->i_mutex, inode->i_lock and rename_lock
+ * dentry->d_parent->d_inode->i_mutex, inode->i_lock and rename_lock (with
+ * read_seqlock_excl())
  *
  * Note: If ever the locking in lock_rename() changes, then please
  * remember to update this too...
@@ -2682,9 +2775,9 @@ struct dentry *d_splice_alias(struct inode *inode, struct dentry *dentry)
 				iput(inode);
 				return ERR_PTR(-EIO);
 			}
-			write_seqlock(&rename_lock);
+			read_seqlock_excl(&rename_lock);
 			__d_move(new, dentry, false);
-			write_sequnlock(&rename_lock);
+			read_sequnlock_excl(&rename_lock);
 			spin_unlock(&inode->i_lock);
 			security_d_instantiate(new, inode);
 			iput(inode);
@@ -2735,7 +2828,7 @@ struct dentry *d_materialise_unique(struct dentry *dentry, struct inode *inode)
 		alias = __d_find_alias(inode);
 		if (alias) {
 			actual = alias;
-			write_seqlock(&rename_lock);
+			read_seqlock_excl(&rename_lock);
 
 			if (d_ancestor(alias, dentry)) {
 				/* Check for loops */
@@ -2745,14 +2838,14 @@ struct dentry *d_materialise_unique(struct dentry *dentry, struct inode *inode)
 				/* Is this an anonymous mountpoint that we
 				 * could splice into our tree? */
 				__d_move(alias, dentry, false);
-				write_sequnlock(&rename_lock);
+				read_sequnlock_excl(&rename_lock);
 				goto found;
 			} else {
 				/* Nope, but we must(!) avoid directory
 				 * aliasing. This drops inode->i_lock */
 				actual = __d_unalias(inode, dentry, alias);
 			}
-			write_sequnlock(&rename_lock);
+			read_sequnlock_excl(&rename_lock);
 			if (IS_ERR(actual)) {
 				if (PTR_ERR(actual) == -ELOOP)
 					pr_warn_ratelimited(
@@ -2916,6 +3009,7 @@ restart:
 	if (!(seq & 1))
 		rcu_read_unlock();
 	if (need_seqretry(&rename_lock, seq)) {
+		dcache_count_retry(DCACHE_RETRY_D_PATH);
 		seq = 1;
 		goto restart;
 	}
@@ -3140,6 +3234,7 @@ restart:
 	if (!(seq & 1))
 		rcu_read_unlock();
 	if (need_seqretry(&rename_lock, seq)) {
+		dcache_count_retry(DCACHE_RETRY_D_PATH);
 		seq = 1;
 		goto restart;
 	}
@@ -3272,15 +3367,16 @@ out:
   
 int is_subdir(struct dentry *new_dentry, struct dentry *old_dentry)
 {
+	static DEFINE_SEQLOCK_SITE(site);
+	struct seqlock_read sr = SEQLOCK_READ_INIT;
 	int result;
-	unsigned seq;
 
 	if (new_dentry == old_dentry)
 		return 1;
 
 	do {
 		/* for restarting inner loop in case of seq retry */
-		seq = read_seqbegin(&rename_lock);
+		read_seqbegin_adaptive(&rename_lock, &sr);
 		/*
 		 * Need rcu_readlock to protect against the d_parent trashing
 		 * due to d_move
@@ -3291,7 +3387,8 @@ int is_subdir(struct dentry *new_dentry, struct dentry *old_dentry)
 		else
 			result = 0;
 		rcu_read_unlock();
-	} while (read_seqretry(&rename_lock, seq));
+	} while (read_seqretry_adaptive(&rename_lock, &sr, &site));
+	done_seqretry_adaptive(&rename_lock, &sr, &site);
 
 	return result;
 }
@@ -3398,6 +3495,48 @@ static void __init dcache_init(void)
 		INIT_HLIST_BL_HEAD(dentry_hashtable + loop);
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int dcache_retries_show(struct seq_file *m, void *v)
+{
+	static const char * const names[NR_DCACHE_RETRY] = {
+		[DCACHE_RETRY_D_LOOKUP]	= "d_lookup",
+		[DCACHE_RETRY_D_PATH]	= "d_path",
+		[DCACHE_RETRY_RCU_WALK]	= "rcu_walk",
+	};
+	int cpu, i;
+
+	for (i = 0; i < NR_DCACHE_RETRY; i++) {
+		unsigned long sum = 0;
+
+		for_each_possible_cpu(cpu)
+			sum += per_cpu(dcache_retries[i], cpu);
+		seq_printf(m, "%s %lu\n", names[i], sum);
+	}
+	return 0;
+}
+
+static int dcache_retries_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dcache_retries_show, NULL);
+}
+
+static const struct file_operations dcache_retries_fops = {
+	.open		= dcache_retries_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init dcache_debugfs_init(void)
+{
+	if (!debugfs_create_file("dcache_retries", 0444, NULL, NULL,
+				 &dcache_retries_fops))
+		return -ENOMEM;
+	return 0;
+}
+fs_initcall(dcache_debugfs_init);
+#endif
+
 /* SLAB cache for __getname() consumers */
 struct kmem_cache *names_cachep __read_mostly;
 EXPORT_SYMBOL(names_cachep);
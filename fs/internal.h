@@ -110,7 +110,6 @@ extern int open_check_o_direct(struct file *f);
 /*
  * inode.c
  */
-extern spinlock_t inode_sb_list_lock;
 extern long prune_icache_sb(struct super_block *sb, unsigned long nr_to_scan,
 			    int nid);
 extern void inode_add_lru(struct inode *inode);
@@ -129,6 +128,14 @@ extern int invalidate_inodes(struct super_block *, bool);
  */
 extern struct dentry *__d_alloc(struct super_block *, const struct qstr *);
 extern int d_set_mounted(struct dentry *dentry);
+
+enum dcache_retry {
+	DCACHE_RETRY_D_LOOKUP,		/* d_lookup() missed across a rename */
+	DCACHE_RETRY_D_PATH,		/* d_path() raced with a rename */
+	DCACHE_RETRY_RCU_WALK,		/* path walk fell back to ref-walk */
+	NR_DCACHE_RETRY,
+};
+extern void dcache_count_retry(enum dcache_retry retry);
 extern long prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
 			    int nid);
 
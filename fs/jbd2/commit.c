@@ -470,6 +470,12 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	J_ASSERT (atomic_read(&commit_transaction->t_outstanding_credits) <=
 			journal->j_max_transaction_buffers);
 
+	/*
+	 * No handle can refile buffers on this transaction any more: gather
+	 * the sharded reserved and metadata lists back onto the transaction.
+	 */
+	jbd2_journal_merge_shards(commit_transaction);
+
 	/*
 	 * First thing we are allowed to do is to discard any remaining
 	 * BJ_Reserved buffers.  Note, it is _not_ permissible to assume
@@ -28,11 +28,14 @@
 #include <linux/hrtimer.h>
 #include <linux/backing-dev.h>
 #include <linux/bug.h>
+#include <linux/hash.h>
 #include <linux/module.h>
 
 #include <trace/events/jbd2.h>
 
 static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh);
+static int __jbd2_journal_file_metadata_shard(struct journal_head *jh,
+					      transaction_t *transaction);
 static void __jbd2_journal_unfile_buffer(struct journal_head *jh);
 
 static struct kmem_cache *transaction_cache;
@@ -82,6 +85,8 @@ void jbd2_journal_free_transaction(transaction_t *transaction)
 static transaction_t *
 jbd2_get_transaction(journal_t *journal, transaction_t *transaction)
 {
+	int i;
+
 	transaction->t_journal = journal;
 	transaction->t_state = T_RUNNING;
 	transaction->t_start_time = ktime_get();
@@ -94,6 +99,9 @@ jbd2_get_transaction(journal_t *journal, transaction_t *transaction)
 	atomic_set(&transaction->t_handle_count, 0);
 	INIT_LIST_HEAD(&transaction->t_inode_list);
 	INIT_LIST_HEAD(&transaction->t_private_list);
+	for (i = 0; i < JBD2_LIST_SHARDS; i++)
+		spin_lock_init(&transaction->t_shards[i].s_lock);
+	transaction->t_sharded = 1;
 
 	/* Set up the commit timer for the new transaction. */
 	journal->j_commit_timer.expires = round_jiffies_up(transaction->t_expires);
@@ -1360,6 +1368,14 @@ int jbd2_journal_dirty_metadata(handle_t *handle, struct buffer_head *bh)
 	J_ASSERT_JH(jh, jh->b_frozen_data == NULL);
 
 	JBUFFER_TRACE(jh, "file as BJ_Metadata");
+	/*
+	 * A buffer reserved by do_get_write_access() only moves between
+	 * lists of its shard, so j_list_lock is not needed for that.
+	 */
+	if (jh->b_transaction == transaction && jh->b_jlist == BJ_Reserved &&
+	    __jbd2_journal_file_metadata_shard(jh, transaction))
+		goto out_unlock_bh;
+
 	spin_lock(&journal->j_list_lock);
 	__jbd2_journal_file_buffer(jh, transaction, BJ_Metadata);
 	spin_unlock(&journal->j_list_lock);
@@ -1722,6 +1738,108 @@ __blist_del_buffer(struct journal_head **list, struct journal_head *jh)
 	jh->b_tnext->b_tprev = jh->b_tprev;
 }
 
+static inline struct jbd2_list_shard *
+jbd2_jh_shard(transaction_t *transaction, struct journal_head *jh)
+{
+	return &transaction->t_shards[hash_ptr(jh, JBD2_LIST_SHARD_BITS)];
+}
+
+/*
+ * Move all buffers of list *from to the tail of list *list.
+ *
+ * j_list_lock and the lock protecting *from are held.
+ */
+static inline void
+__blist_splice(struct journal_head **list, struct journal_head **from)
+{
+	struct journal_head *first = *from, *last, *head;
+
+	if (!first)
+		return;
+	*from = NULL;
+	if (!*list) {
+		*list = first;
+		return;
+	}
+	head = *list;
+	last = first->b_tprev;
+	head->b_tprev->b_tnext = first;
+	first->b_tprev = head->b_tprev;
+	last->b_tnext = head;
+	head->b_tprev = last;
+}
+
+/*
+ * Refile a BJ_Reserved buffer of the running transaction as BJ_Metadata
+ * without taking j_list_lock.  b_transaction does not change, and b_jlist
+ * is protected by the bh_state lock alone, so only the shard lock is
+ * needed to move the buffer between the shard's lists.
+ *
+ * Returns 0 if the transaction's shards have already been merged, in
+ * which case the caller must fall back to __jbd2_journal_file_buffer().
+ *
+ * jbd_lock_bh_state(jh2bh(jh)) is held.
+ */
+static int __jbd2_journal_file_metadata_shard(struct journal_head *jh,
+					      transaction_t *transaction)
+{
+	struct jbd2_list_shard *shard = jbd2_jh_shard(transaction, jh);
+	struct buffer_head *bh = jh2bh(jh);
+
+	J_ASSERT_JH(jh, jbd_is_locked_bh_state(bh));
+
+	spin_lock(&shard->s_lock);
+	if (!transaction->t_sharded) {
+		spin_unlock(&shard->s_lock);
+		return 0;
+	}
+
+	/* See the comment in __jbd2_journal_file_buffer() */
+	if (buffer_dirty(bh)) {
+		warn_dirty_buffer(bh);
+		clear_buffer_dirty(bh);
+		set_buffer_jbddirty(bh);
+	}
+
+	__blist_del_buffer(&shard->s_reserved, jh);
+	__blist_add_buffer(&shard->s_buffers, jh);
+	shard->s_nr_buffers++;
+	jh->b_jlist = BJ_Metadata;
+	spin_unlock(&shard->s_lock);
+	return 1;
+}
+
+/**
+ * void jbd2_journal_merge_shards() - move sharded buffer lists to the transaction
+ * @transaction: transaction being locked down for commit
+ *
+ * Splice every shard's reserved and metadata buffers onto t_reserved_list
+ * and t_buffers.  Called by the commit code once t_updates has dropped to
+ * zero, so no handle can be refiling buffers on the shards any more;
+ * anybody racing with us under j_list_lock sees t_sharded cleared and
+ * uses the transaction's own lists from then on.
+ */
+void jbd2_journal_merge_shards(transaction_t *transaction)
+{
+	journal_t *journal = transaction->t_journal;
+	struct jbd2_list_shard *shard;
+	int i;
+
+	spin_lock(&journal->j_list_lock);
+	transaction->t_sharded = 0;
+	for (i = 0; i < JBD2_LIST_SHARDS; i++) {
+		shard = &transaction->t_shards[i];
+		spin_lock(&shard->s_lock);
+		__blist_splice(&transaction->t_reserved_list,
+			       &shard->s_reserved);
+		__blist_splice(&transaction->t_buffers, &shard->s_buffers);
+		transaction->t_nr_buffers += shard->s_nr_buffers;
+		shard->s_nr_buffers = 0;
+		spin_unlock(&shard->s_lock);
+	}
+	spin_unlock(&journal->j_list_lock);
+}
+
 /*
  * Remove a buffer from the appropriate transaction list.
  *
@@ -1736,6 +1854,7 @@ __blist_del_buffer(struct journal_head **list, struct journal_head *jh)
 static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh)
 {
 	struct journal_head **list = NULL;
+	struct jbd2_list_shard *shard = NULL;
 	transaction_t *transaction;
 	struct buffer_head *bh = jh2bh(jh);
 
@@ -1752,6 +1871,14 @@ static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh)
 	case BJ_None:
 		return;
 	case BJ_Metadata:
+		if (transaction->t_sharded) {
+			shard = jbd2_jh_shard(transaction, jh);
+			spin_lock(&shard->s_lock);
+			shard->s_nr_buffers--;
+			J_ASSERT_JH(jh, shard->s_nr_buffers >= 0);
+			list = &shard->s_buffers;
+			break;
+		}
 		transaction->t_nr_buffers--;
 		J_ASSERT_JH(jh, transaction->t_nr_buffers >= 0);
 		list = &transaction->t_buffers;
@@ -1763,11 +1890,19 @@ static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh)
 		list = &transaction->t_shadow_list;
 		break;
 	case BJ_Reserved:
+		if (transaction->t_sharded) {
+			shard = jbd2_jh_shard(transaction, jh);
+			spin_lock(&shard->s_lock);
+			list = &shard->s_reserved;
+			break;
+		}
 		list = &transaction->t_reserved_list;
 		break;
 	}
 
 	__blist_del_buffer(list, jh);
+	if (shard)
+		spin_unlock(&shard->s_lock);
 	jh->b_jlist = BJ_None;
 	if (test_clear_buffer_jbddirty(bh))
 		mark_buffer_dirty(bh);	/* Expose it to the VM */
@@ -2220,6 +2355,7 @@ void __jbd2_journal_file_buffer(struct journal_head *jh,
 			transaction_t *transaction, int jlist)
 {
 	struct journal_head **list = NULL;
+	struct jbd2_list_shard *shard = NULL;
 	int was_dirty = 0;
 	struct buffer_head *bh = jh2bh(jh);
 
@@ -2261,6 +2397,13 @@ void __jbd2_journal_file_buffer(struct journal_head *jh,
 		J_ASSERT_JH(jh, !jh->b_frozen_data);
 		return;
 	case BJ_Metadata:
+		if (transaction->t_sharded) {
+			shard = jbd2_jh_shard(transaction, jh);
+			spin_lock(&shard->s_lock);
+			shard->s_nr_buffers++;
+			list = &shard->s_buffers;
+			break;
+		}
 		transaction->t_nr_buffers++;
 		list = &transaction->t_buffers;
 		break;
@@ -2271,11 +2414,19 @@ void __jbd2_journal_file_buffer(struct journal_head *jh,
 		list = &transaction->t_shadow_list;
 		break;
 	case BJ_Reserved:
+		if (transaction->t_sharded) {
+			shard = jbd2_jh_shard(transaction, jh);
+			spin_lock(&shard->s_lock);
+			list = &shard->s_reserved;
+			break;
+		}
 		list = &transaction->t_reserved_list;
 		break;
 	}
 
 	__blist_add_buffer(list, jh);
+	if (shard)
+		spin_unlock(&shard->s_lock);
 	jh->b_jlist = jlist;
 
 	if (was_dirty)
@@ -128,7 +128,7 @@
 #include <linux/pid_namespace.h>
 #include <linux/hashtable.h>
 #include <linux/percpu.h>
-#include <linux/lglock.h>
+#include <linux/rculist.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/filelock.h>
@@ -162,11 +162,13 @@ int lease_break_time = 45;
 
 /*
  * The global file_lock_list is only used for displaying /proc/locks, so we
- * keep a list on each CPU, with each list protected by its own spinlock via
- * the file_lock_lglock. Note that alterations to the list also require that
- * the relevant i_lock is held.
+ * keep a list on each CPU, with each list protected by its own spinlock.
+ * Note that alterations to the list also require that the relevant i_lock
+ * is held. The /proc/locks readers don't take any of the list locks, they
+ * walk the lists under RCU, and a lock that was on one of them is freed
+ * after a grace period.
  */
-DEFINE_STATIC_LGLOCK(file_lock_lglock);
+static DEFINE_PER_CPU(spinlock_t, file_lock_list_lock);
 static DEFINE_PER_CPU(struct hlist_head, file_lock_list);
 
 /*
@@ -207,6 +209,7 @@ static struct kmem_cache *filelock_cache __read_mostly;
 static void locks_init_lock_heads(struct file_lock *fl)
 {
 	INIT_HLIST_NODE(&fl->fl_link);
+	fl->fl_link_cpu = -1;
 	INIT_LIST_HEAD(&fl->fl_block);
 	init_waitqueue_head(&fl->fl_wait);
 }
@@ -239,6 +242,15 @@ void locks_release_private(struct file_lock *fl)
 }
 EXPORT_SYMBOL_GPL(locks_release_private);
 
+static void locks_free_lock_rcu(struct rcu_head *head)
+{
+	struct file_lock *fl = container_of(head, struct file_lock, fl_rcu);
+
+	/* struct pid is not RCU freed, lock_get_status() may still use it */
+	put_pid(fl->fl_nspid);
+	kmem_cache_free(filelock_cache, fl);
+}
+
 /* Free a lock which is not in use. */
 void locks_free_lock(struct file_lock *fl)
 {
@@ -247,7 +259,14 @@ void locks_free_lock(struct file_lock *fl)
 	BUG_ON(!hlist_unhashed(&fl->fl_link));
 
 	locks_release_private(fl);
-	kmem_cache_free(filelock_cache, fl);
+	/*
+	 * A /proc/locks reader may still be looking at a listed lock. Only
+	 * those have a namespace reference, see locks_insert_lock().
+	 */
+	if (fl->fl_link_cpu >= 0)
+		call_rcu(&fl->fl_rcu, locks_free_lock_rcu);
+	else
+		kmem_cache_free(filelock_cache, fl);
 }
 EXPORT_SYMBOL(locks_free_lock);
 
@@ -516,10 +535,14 @@ static int posix_same_owner(struct file_lock *fl1, struct file_lock *fl2)
 /* Must be called with the i_lock held! */
 static void locks_insert_global_locks(struct file_lock *fl)
 {
-	lg_local_lock(&file_lock_lglock);
+	spinlock_t *lock;
+
+	/* Preemption is disabled by the i_lock */
 	fl->fl_link_cpu = smp_processor_id();
-	hlist_add_head(&fl->fl_link, this_cpu_ptr(&file_lock_list));
-	lg_local_unlock(&file_lock_lglock);
+	lock = per_cpu_ptr(&file_lock_list_lock, fl->fl_link_cpu);
+	spin_lock(lock);
+	hlist_add_head_rcu(&fl->fl_link, this_cpu_ptr(&file_lock_list));
+	spin_unlock(lock);
 }
 
 /* Must be called with the i_lock held! */
@@ -532,9 +555,9 @@ static void locks_delete_global_locks(struct file_lock *fl)
 	 */
 	if (hlist_unhashed(&fl->fl_link))
 		return;
-	lg_local_lock_cpu(&file_lock_lglock, fl->fl_link_cpu);
-	hlist_del_init(&fl->fl_link);
-	lg_local_unlock_cpu(&file_lock_lglock, fl->fl_link_cpu);
+	spin_lock(per_cpu_ptr(&file_lock_list_lock, fl->fl_link_cpu));
+	hlist_del_init_rcu(&fl->fl_link);
+	spin_unlock(per_cpu_ptr(&file_lock_list_lock, fl->fl_link_cpu));
 }
 
 static unsigned long
@@ -642,7 +665,9 @@ static void locks_wake_up_blocks(struct file_lock *blocker)
  */
 static void locks_insert_lock(struct file_lock **pos, struct file_lock *fl)
 {
-	fl->fl_nspid = get_pid(task_tgid(current));
+	/* A lock that was unlinked keeps its namespace reference until freed */
+	if (!fl->fl_nspid)
+		fl->fl_nspid = get_pid(task_tgid(current));
 
 	/* insert into file's list */
 	fl->fl_next = *pos;
@@ -656,9 +681,10 @@ static void locks_insert_lock(struct file_lock **pos, struct file_lock *fl)
  * @thisfl_p: pointer that points to the fl_next field of the previous
  * 	      inode->i_flock list entry
  *
- * Unlink a lock from all lists and free the namespace reference, but don't
- * free it yet. Wake up processes that are blocked waiting for this lock and
- * notify the FS that the lock has been cleared.
+ * Unlink a lock from all lists, but don't free it yet. Its namespace
+ * reference is only dropped when it is freed, after an RCU grace period.
+ * Wake up processes that are blocked waiting for this lock and notify the
+ * FS that the lock has been cleared.
  *
  * Must be called with the i_lock held!
  */
@@ -671,11 +697,6 @@ static void locks_unlink_lock(struct file_lock **thisfl_p)
 	*thisfl_p = fl->fl_next;
 	fl->fl_next = NULL;
 
-	if (fl->fl_nspid) {
-		put_pid(fl->fl_nspid);
-		fl->fl_nspid = NULL;
-	}
-
 	locks_wake_up_blocks(fl);
 }
 
@@ -2471,15 +2492,23 @@ static void lock_get_status(struct seq_file *f, struct file_lock *fl,
 			    loff_t id, char *pfx)
 {
 	struct inode *inode = NULL;
+	struct file *file;
+	struct pid *nspid;
 	unsigned int fl_pid;
 
-	if (fl->fl_nspid)
-		fl_pid = pid_vnr(fl->fl_nspid);
+	/*
+	 * The lock may be unlinked under us, the pid, file and inode are all
+	 * freed after a grace period.
+	 */
+	nspid = ACCESS_ONCE(fl->fl_nspid);
+	if (nspid)
+		fl_pid = pid_vnr(nspid);
 	else
 		fl_pid = fl->fl_pid;
 
-	if (fl->fl_file != NULL)
-		inode = file_inode(fl->fl_file);
+	file = ACCESS_ONCE(fl->fl_file);
+	if (file != NULL)
+		inode = file_inode(file);
 
 	seq_printf(f, "%lld:%s ", id, pfx);
 	if (IS_POSIX(fl)) {
@@ -2557,21 +2586,23 @@ static int locks_show(struct seq_file *f, void *v)
 
 	lock_get_status(f, fl, iter->li_pos, "");
 
+	/* An unlinked lock has had its blocked waiters woken and removed */
+	spin_lock(&blocked_lock_lock);
 	list_for_each_entry(bfl, &fl->fl_block, fl_block)
 		lock_get_status(f, bfl, iter->li_pos, " ->");
+	spin_unlock(&blocked_lock_lock);
 
 	return 0;
 }
 
 static void *locks_start(struct seq_file *f, loff_t *pos)
-	__acquires(&blocked_lock_lock)
+	__acquires(RCU)
 {
 	struct locks_iterator *iter = f->private;
 
 	iter->li_pos = *pos + 1;
-	lg_global_lock(&file_lock_lglock);
-	spin_lock(&blocked_lock_lock);
-	return seq_hlist_start_percpu(&file_lock_list, &iter->li_cpu, *pos);
+	rcu_read_lock();
+	return seq_hlist_start_percpu_rcu(&file_lock_list, &iter->li_cpu, *pos);
 }
 
 static void *locks_next(struct seq_file *f, void *v, loff_t *pos)
@@ -2579,14 +2610,14 @@ static void *locks_next(struct seq_file *f, void *v, loff_t *pos)
 	struct locks_iterator *iter = f->private;
 
 	++iter->li_pos;
-	return seq_hlist_next_percpu(v, &file_lock_list, &iter->li_cpu, pos);
+	return seq_hlist_next_percpu_rcu(v, &file_lock_list, &iter->li_cpu,
+					 pos);
 }
 
 static void locks_stop(struct seq_file *f, void *v)
-	__releases(&blocked_lock_lock)
+	__releases(RCU)
 {
-	spin_unlock(&blocked_lock_lock);
-	lg_global_unlock(&file_lock_lglock);
+	rcu_read_unlock();
 }
 
 static const struct seq_operations locks_seq_operations = {
@@ -2624,10 +2655,10 @@ static int __init filelock_init(void)
 	filelock_cache = kmem_cache_create("file_lock_cache",
 			sizeof(struct file_lock), 0, SLAB_PANIC, NULL);
 
-	lg_lock_init(&file_lock_lglock, "file_lock_lglock");
-
-	for_each_possible_cpu(i)
+	for_each_possible_cpu(i) {
+		spin_lock_init(per_cpu_ptr(&file_lock_list_lock, i));
 		INIT_HLIST_HEAD(per_cpu_ptr(&file_lock_list, i));
+	}
 
 	return 0;
 }
@@ -101,6 +101,14 @@ static inline void get_mnt_ns(struct mnt_namespace *ns)
 	atomic_inc(&ns->count);
 }
 
+/*
+ * The lockless walks of the mount tree (lookup_mnt(), the RCU path walk,
+ * d_path()) retry whenever the mount_lock sequence changes, on all the
+ * namespaces. Take it with lock_mount_hash() only to change the tree or the
+ * hash; the changes the walks don't look at, the flags, propagation and
+ * s_mounts, or mounts nobody can reach yet, only need the exclusion of
+ * read_seqlock_excl().
+ */
 extern seqlock_t mount_lock;
 
 static inline void lock_mount_hash(void)
@@ -512,6 +512,8 @@ static int unlazy_walk(struct nameidata *nd, struct dentry *dentry)
 {
 	struct fs_struct *fs = current->fs;
 	struct dentry *parent = nd->path.dentry;
+	struct lockref *refs[2];
+	int nr = 0;
 
 	BUG_ON(!(nd->flags & LOOKUP_RCU));
 
@@ -527,8 +529,13 @@ static int unlazy_walk(struct nameidata *nd, struct dentry *dentry)
 		return -ECHILD;
 	nd->flags &= ~LOOKUP_RCU;
 
-	if (!lockref_get_not_dead(&parent->d_lockref)) {
-		nd->path.dentry = NULL;	
+	/* Take the parent and dentry references in one pass */
+	refs[nr++] = &parent->d_lockref;
+	if (dentry)
+		refs[nr++] = &dentry->d_lockref;
+	nr = lockref_get_not_dead_chain(refs, nr);
+	if (!nr) {
+		nd->path.dentry = NULL;
 		goto out;
 	}
 
@@ -548,7 +555,7 @@ static int unlazy_walk(struct nameidata *nd, struct dentry *dentry)
 			goto out;
 		BUG_ON(nd->inode != parent->d_inode);
 	} else {
-		if (!lockref_get_not_dead(&dentry->d_lockref))
+		if (nr < 2)
 			goto out;
 		if (read_seqcount_retry(&dentry->d_seq, nd->seq))
 			goto drop_dentry;
@@ -1998,8 +2005,10 @@ static int filename_lookup(int dfd, struct filename *name,
 				unsigned int flags, struct nameidata *nd)
 {
 	int retval = path_lookupat(dfd, name->name, flags | LOOKUP_RCU, nd);
-	if (unlikely(retval == -ECHILD))
+	if (unlikely(retval == -ECHILD)) {
+		dcache_count_retry(DCACHE_RETRY_RCU_WALK);
 		retval = path_lookupat(dfd, name->name, flags, nd);
+	}
 	if (unlikely(retval == -ESTALE))
 		retval = path_lookupat(dfd, name->name,
 						flags | LOOKUP_REVAL, nd);
@@ -2339,8 +2348,10 @@ filename_mountpoint(int dfd, struct filename *s, struct path *path,
 			unsigned int flags)
 {
 	int error = path_mountpoint(dfd, s->name, path, flags | LOOKUP_RCU);
-	if (unlikely(error == -ECHILD))
+	if (unlikely(error == -ECHILD)) {
+		dcache_count_retry(DCACHE_RETRY_RCU_WALK);
 		error = path_mountpoint(dfd, s->name, path, flags);
+	}
 	if (unlikely(error == -ESTALE))
 		error = path_mountpoint(dfd, s->name, path, flags | LOOKUP_REVAL);
 	if (likely(!error))
@@ -3256,8 +3267,10 @@ struct file *do_filp_open(int dfd, struct filename *pathname,
 	struct file *filp;
 
 	filp = path_openat(dfd, pathname, &nd, op, flags | LOOKUP_RCU);
-	if (unlikely(filp == ERR_PTR(-ECHILD)))
+	if (unlikely(filp == ERR_PTR(-ECHILD))) {
+		dcache_count_retry(DCACHE_RETRY_RCU_WALK);
 		filp = path_openat(dfd, pathname, &nd, op, flags);
+	}
 	if (unlikely(filp == ERR_PTR(-ESTALE)))
 		filp = path_openat(dfd, pathname, &nd, op, flags | LOOKUP_REVAL);
 	return filp;
@@ -3278,8 +3291,10 @@ struct file *do_file_open_root(struct dentry *dentry, struct vfsmount *mnt,
 		return ERR_PTR(-ELOOP);
 
 	file = path_openat(-1, &filename, &nd, op, flags | LOOKUP_RCU);
-	if (unlikely(file == ERR_PTR(-ECHILD)))
+	if (unlikely(file == ERR_PTR(-ECHILD))) {
+		dcache_count_retry(DCACHE_RETRY_RCU_WALK);
 		file = path_openat(-1, &filename, &nd, op, flags);
+	}
 	if (unlikely(file == ERR_PTR(-ESTALE)))
 		file = path_openat(-1, &filename, &nd, op, flags | LOOKUP_REVAL);
 	return file;
@@ -485,7 +485,7 @@ static int mnt_make_readonly(struct mount *mnt)
 {
 	int ret = 0;
 
-	lock_mount_hash();
+	read_seqlock_excl(&mount_lock);
 	mnt->mnt.mnt_flags |= MNT_WRITE_HOLD;
 	/*
 	 * After storing MNT_WRITE_HOLD, we'll read the counters. This store
@@ -519,15 +519,15 @@ static int mnt_make_readonly(struct mount *mnt)
 	 */
 	smp_wmb();
 	mnt->mnt.mnt_flags &= ~MNT_WRITE_HOLD;
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 	return ret;
 }
 
 static void __mnt_unmake_readonly(struct mount *mnt)
 {
-	lock_mount_hash();
+	read_seqlock_excl(&mount_lock);
 	mnt->mnt.mnt_flags &= ~MNT_READONLY;
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 }
 
 int sb_prepare_remount_readonly(struct super_block *sb)
@@ -539,7 +539,7 @@ int sb_prepare_remount_readonly(struct super_block *sb)
 	if (atomic_long_read(&sb->s_remove_count))
 		return -EBUSY;
 
-	lock_mount_hash();
+	read_seqlock_excl(&mount_lock);
 	list_for_each_entry(mnt, &sb->s_mounts, mnt_instance) {
 		if (!(mnt->mnt.mnt_flags & MNT_READONLY)) {
 			mnt->mnt.mnt_flags |= MNT_WRITE_HOLD;
@@ -561,7 +561,7 @@ int sb_prepare_remount_readonly(struct super_block *sb)
 		if (mnt->mnt.mnt_flags & MNT_WRITE_HOLD)
 			mnt->mnt.mnt_flags &= ~MNT_WRITE_HOLD;
 	}
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 
 	return err;
 }
@@ -654,16 +654,27 @@ out:
  */
 struct vfsmount *lookup_mnt(struct path *path)
 {
+	static DEFINE_SEQLOCK_SITE(site);
+	struct seqlock_read sr = SEQLOCK_READ_INIT;
 	struct mount *child_mnt;
 	struct vfsmount *m;
-	unsigned seq;
 
 	rcu_read_lock();
-	do {
-		seq = read_seqbegin(&mount_lock);
+	for (;;) {
+		read_seqbegin_adaptive(&mount_lock, &sr);
 		child_mnt = __lookup_mnt(path->mnt, path->dentry);
 		m = child_mnt ? &child_mnt->mnt : NULL;
-	} while (!legitimize_mnt(m, seq));
+		if (seqlock_read_locked(&sr)) {
+			/* No umount can get to it while we hold mount_lock */
+			if (child_mnt)
+				mnt_add_count(child_mnt, 1);
+			break;
+		}
+		if (legitimize_mnt(m, sr.seq))
+			break;
+		seqlock_read_retry(&sr, &site);
+	}
+	done_seqretry_adaptive(&mount_lock, &sr, &site);
 	rcu_read_unlock();
 	return m;
 }
@@ -800,7 +811,7 @@ static void detach_mnt(struct mount *mnt, struct path *old_path)
 }
 
 /*
- * vfsmount lock must be held for write
+ * vfsmount lock must be held, for write if child_mnt can be reached
  */
 void mnt_set_mountpoint(struct mount *mnt,
 			struct mountpoint *mp,
@@ -915,9 +926,9 @@ vfs_kern_mount(struct file_system_type *type, int flags, const char *name, void
 	mnt->mnt.mnt_sb = root->d_sb;
 	mnt->mnt_mountpoint = mnt->mnt.mnt_root;
 	mnt->mnt_parent = mnt;
-	lock_mount_hash();
+	read_seqlock_excl(&mount_lock);
 	list_add_tail(&mnt->mnt_instance, &root->d_sb->s_mounts);
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 	return &mnt->mnt;
 }
 EXPORT_SYMBOL_GPL(vfs_kern_mount);
@@ -971,9 +982,9 @@ static struct mount *clone_mnt(struct mount *old, struct dentry *root,
 	mnt->mnt.mnt_root = dget(root);
 	mnt->mnt_mountpoint = mnt->mnt.mnt_root;
 	mnt->mnt_parent = mnt;
-	lock_mount_hash();
+	read_seqlock_excl(&mount_lock);
 	list_add_tail(&mnt->mnt_instance, &sb->s_mounts);
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 
 	if ((flag & CL_SLAVE) ||
 	    ((flag & CL_SHARED_TO_SLAVE) && IS_MNT_SHARED(old))) {
@@ -1241,13 +1252,13 @@ int may_umount_tree(struct vfsmount *m)
 	struct mount *p;
 	BUG_ON(!m);
 
-	/* write lock needed for mnt_get_count */
-	lock_mount_hash();
+	/* exclusive lock needed for mnt_get_count */
+	read_seqlock_excl(&mount_lock);
 	for (p = mnt; p; p = next_mnt(p, mnt)) {
 		actual_refs += mnt_get_count(p);
 		minimum_refs += 2;
 	}
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 
 	if (actual_refs > minimum_refs)
 		return 0;
@@ -1274,10 +1285,10 @@ int may_umount(struct vfsmount *mnt)
 {
 	int ret = 1;
 	down_read(&namespace_sem);
-	lock_mount_hash();
+	read_seqlock_excl(&mount_lock);
 	if (propagate_mount_busy(real_mount(mnt), 2))
 		ret = 0;
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 	up_read(&namespace_sem);
 	return ret;
 }
@@ -1640,7 +1651,12 @@ struct mount *copy_tree(struct mount *mnt, struct dentry *dentry,
 			q = clone_mnt(p, p->mnt.mnt_root, flag);
 			if (IS_ERR(q))
 				goto out;
-			lock_mount_hash();
+			/*
+			 * The copy can't be reached by the lockless walks
+			 * until it is attached, don't make them all retry
+			 * for each of its mounts.
+			 */
+			read_seqlock_excl(&mount_lock);
 			list_add_tail(&q->mnt_list, &res->mnt_list);
 			mnt_set_mountpoint(parent, p->mnt_mp, q);
 			if (!list_empty(&parent->mnt_mounts)) {
@@ -1650,7 +1666,7 @@ struct mount *copy_tree(struct mount *mnt, struct dentry *dentry,
 					t = NULL;
 			}
 			attach_shadowed(q, parent, t);
-			unlock_mount_hash();
+			read_sequnlock_excl(&mount_lock);
 		}
 	}
 	return res;
@@ -1965,10 +1981,10 @@ static int do_change_type(struct path *path, int flag)
 			goto out_unlock;
 	}
 
-	lock_mount_hash();
+	read_seqlock_excl(&mount_lock);
 	for (m = mnt; m; m = (recurse ? next_mnt(m, mnt) : NULL))
 		change_mnt_propagation(m, type);
-	unlock_mount_hash();
+	read_sequnlock_excl(&mount_lock);
 
  out_unlock:
 	namespace_unlock();
@@ -2125,11 +2141,11 @@ static int do_remount(struct path *path, int flags, int mnt_flags,
 	else
 		err = do_remount_sb(sb, flags, data, 0);
 	if (!err) {
-		lock_mount_hash();
+		read_seqlock_excl(&mount_lock);
 		mnt_flags |= mnt->mnt.mnt_flags & ~MNT_USER_SETTABLE_MASK;
 		mnt->mnt.mnt_flags = mnt_flags;
 		touch_mnt_namespace(mnt->mnt_ns);
-		unlock_mount_hash();
+		read_sequnlock_excl(&mount_lock);
 	}
 	up_write(&sb->s_umount);
 	return err;
@@ -911,42 +911,46 @@ static int dqinit_needed(struct inode *inode, int type)
 static void add_dquot_ref(struct super_block *sb, int type)
 {
 	struct inode *inode, *old_inode = NULL;
+	struct pcpu_list_head *ph;
+	int cpu;
 #ifdef CONFIG_QUOTA_DEBUG
 	int reserved = 0;
 #endif
 
-	spin_lock(&inode_sb_list_lock);
-	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
-		spin_lock(&inode->i_lock);
-		if ((inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) ||
-		    !atomic_read(&inode->i_writecount) ||
-		    !dqinit_needed(inode, type)) {
+	for_each_pcpu_list(ph, sb->s_inodes, cpu) {
+		spin_lock(&ph->lock);
+		list_for_each_entry(inode, &ph->list, i_sb_list.list) {
+			spin_lock(&inode->i_lock);
+			if ((inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) ||
+			    !atomic_read(&inode->i_writecount) ||
+			    !dqinit_needed(inode, type)) {
+				spin_unlock(&inode->i_lock);
+				continue;
+			}
+			__iget(inode);
 			spin_unlock(&inode->i_lock);
-			continue;
-		}
-		__iget(inode);
-		spin_unlock(&inode->i_lock);
-		spin_unlock(&inode_sb_list_lock);
+			spin_unlock(&ph->lock);
 
 #ifdef CONFIG_QUOTA_DEBUG
-		if (unlikely(inode_get_rsv_space(inode) > 0))
-			reserved = 1;
+			if (unlikely(inode_get_rsv_space(inode) > 0))
+				reserved = 1;
 #endif
-		iput(old_inode);
-		__dquot_initialize(inode, type);
+			iput(old_inode);
+			__dquot_initialize(inode, type);
 
-		/*
-		 * We hold a reference to 'inode' so it couldn't have been
-		 * removed from s_inodes list while we dropped the
-		 * inode_sb_list_lock We cannot iput the inode now as we can be
-		 * holding the last reference and we cannot iput it under
-		 * inode_sb_list_lock. So we keep the reference and iput it
-		 * later.
-		 */
-		old_inode = inode;
-		spin_lock(&inode_sb_list_lock);
+			/*
+			 * We hold a reference to 'inode' so it couldn't have
+			 * been removed from s_inodes list while we dropped the
+			 * sublist lock. We cannot iput the inode now as we can
+			 * be holding the last reference and we cannot iput it
+			 * under the sublist lock. So we keep the reference
+			 * and iput it later.
+			 */
+			old_inode = inode;
+			spin_lock(&ph->lock);
+		}
+		spin_unlock(&ph->lock);
 	}
-	spin_unlock(&inode_sb_list_lock);
 	iput(old_inode);
 
 #ifdef CONFIG_QUOTA_DEBUG
@@ -1012,25 +1016,29 @@ static void remove_dquot_ref(struct super_block *sb, int type,
 		struct list_head *tofree_head)
 {
 	struct inode *inode;
+	struct pcpu_list_head *ph;
 	int reserved = 0;
+	int cpu;
 
-	spin_lock(&inode_sb_list_lock);
-	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
-		/*
-		 *  We have to scan also I_NEW inodes because they can already
-		 *  have quota pointer initialized. Luckily, we need to touch
-		 *  only quota pointers and these have separate locking
-		 *  (dq_data_lock).
-		 */
-		spin_lock(&dq_data_lock);
-		if (!IS_NOQUOTA(inode)) {
-			if (unlikely(inode_get_rsv_space(inode) > 0))
-				reserved = 1;
-			remove_inode_dquot_ref(inode, type, tofree_head);
+	for_each_pcpu_list(ph, sb->s_inodes, cpu) {
+		spin_lock(&ph->lock);
+		list_for_each_entry(inode, &ph->list, i_sb_list.list) {
+			/*
+			 *  We have to scan also I_NEW inodes because they can
+			 *  already have quota pointer initialized. Luckily, we
+			 *  need to touch only quota pointers and these have
+			 *  separate locking (dq_data_lock).
+			 */
+			spin_lock(&dq_data_lock);
+			if (!IS_NOQUOTA(inode)) {
+				if (unlikely(inode_get_rsv_space(inode) > 0))
+					reserved = 1;
+				remove_inode_dquot_ref(inode, type, tofree_head);
+			}
+			spin_unlock(&dq_data_lock);
 		}
-		spin_unlock(&dq_data_lock);
+		spin_unlock(&ph->lock);
 	}
-	spin_unlock(&inode_sb_list_lock);
 #ifdef CONFIG_QUOTA_DEBUG
 	if (reserved) {
 		printk(KERN_WARNING "VFS (%s): Writes happened after quota"
@@ -1005,3 +1005,68 @@ seq_hlist_next_percpu(void *v, struct hlist_head __percpu *head,
 	return NULL;
 }
 EXPORT_SYMBOL(seq_hlist_next_percpu);
+
+/**
+ * seq_hlist_start_percpu_rcu - start an iteration of a percpu hlist array
+ * protected by RCU
+ * @head: pointer to percpu array of struct hlist_heads
+ * @cpu:  pointer to cpu "cursor"
+ * @pos:  start position of sequence
+ *
+ * Called at seq_file->op->start().
+ *
+ * This list-traversal primitive may safely run concurrently with
+ * the _rcu list-mutation primitives such as hlist_add_head_rcu()
+ * as long as the traversal is guarded by rcu_read_lock().
+ */
+struct hlist_node *
+seq_hlist_start_percpu_rcu(struct hlist_head __percpu *head, int *cpu,
+			   loff_t pos)
+{
+	struct hlist_node *node;
+
+	for_each_possible_cpu(*cpu) {
+		__hlist_for_each_rcu(node, per_cpu_ptr(head, *cpu)) {
+			if (pos-- == 0)
+				return node;
+		}
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(seq_hlist_start_percpu_rcu);
+
+/**
+ * seq_hlist_next_percpu_rcu - move to the next position of the percpu hlist
+ * array protected by RCU
+ * @v:    pointer to current hlist_node
+ * @head: pointer to percpu array of struct hlist_heads
+ * @cpu:  pointer to cpu "cursor"
+ * @pos:  start position of sequence
+ *
+ * Called at seq_file->op->next().
+ *
+ * This list-traversal primitive may safely run concurrently with
+ * the _rcu list-mutation primitives such as hlist_add_head_rcu()
+ * as long as the traversal is guarded by rcu_read_lock().
+ */
+struct hlist_node *
+seq_hlist_next_percpu_rcu(void *v, struct hlist_head __percpu *head,
+			  int *cpu, loff_t *pos)
+{
+	struct hlist_node *node = v, *next;
+
+	++*pos;
+
+	next = rcu_dereference(hlist_next_rcu(node));
+	if (next)
+		return next;
+
+	for (*cpu = cpumask_next(*cpu, cpu_possible_mask); *cpu < nr_cpu_ids;
+	     *cpu = cpumask_next(*cpu, cpu_possible_mask)) {
+		next = rcu_dereference(hlist_first_rcu(per_cpu_ptr(head, *cpu)));
+		if (next)
+			return next;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(seq_hlist_next_percpu_rcu);
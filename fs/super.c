@@ -29,6 +29,7 @@
 #include <linux/idr.h>
 #include <linux/mutex.h>
 #include <linux/backing-dev.h>
+#include <linux/rculist.h>
 #include <linux/rculist_bl.h>
 #include <linux/cleancache.h>
 #include <linux/fsnotify.h>
@@ -36,6 +37,13 @@
 #include "internal.h"
 
 
+/*
+ * sb_lock serializes the insertions into and removals from super_blocks
+ * and the fs_supers lists of the filesystem types. super_blocks is walked
+ * under RCU, superblocks being freed after a grace period, and the passive
+ * references of s_lockref keep a superblock on it while it is used out of
+ * the RCU read side.
+ */
 LIST_HEAD(super_blocks);
 DEFINE_SPINLOCK(sb_lock);
 
@@ -145,6 +153,7 @@ static void destroy_super(struct super_block *s)
 	int i;
 	list_lru_destroy(&s->s_dentry_lru);
 	list_lru_destroy(&s->s_inode_lru);
+	free_pcpu_list_head(&s->s_inodes);
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_counter_destroy(&s->s_writers.counter[i]);
 	security_sb_free(s);
@@ -189,11 +198,12 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags)
 	s->s_bdi = &default_backing_dev_info;
 	INIT_HLIST_NODE(&s->s_instances);
 	INIT_HLIST_BL_HEAD(&s->s_anon);
-	INIT_LIST_HEAD(&s->s_inodes);
+	if (alloc_pcpu_list_head(&s->s_inodes))
+		goto fail;
 
-	if (list_lru_init(&s->s_dentry_lru))
+	if (list_lru_init_pcp(&s->s_dentry_lru))
 		goto fail;
-	if (list_lru_init(&s->s_inode_lru))
+	if (list_lru_init_pcp(&s->s_inode_lru))
 		goto fail;
 
 	init_rwsem(&s->s_umount);
@@ -214,7 +224,8 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags)
 	 * subclass.
 	 */
 	down_write_nested(&s->s_umount, SINGLE_DEPTH_NESTING);
-	s->s_count = 1;
+	s->s_lockref.count = 1;
+	spin_lock_init(&s->s_lockref.lock);
 	atomic_set(&s->s_active, 1);
 	mutex_init(&s->s_vfs_rename_mutex);
 	lockdep_set_class(&s->s_vfs_rename_mutex, &type->s_vfs_rename_key);
@@ -239,29 +250,26 @@ fail:
 
 /* Superblock refcounting  */
 
-/*
- * Drop a superblock's refcount.  The caller must hold sb_lock.
- */
-static void __put_super(struct super_block *sb)
-{
-	if (!--sb->s_count) {
-		list_del_init(&sb->s_list);
-		destroy_super(sb);
-	}
-}
-
 /**
  *	put_super	-	drop a temporary reference to superblock
  *	@sb: superblock in question
  *
  *	Drops a temporary reference, frees superblock if there's no
- *	references left.
+ *	references left.  Only the last reference takes sb_lock, to take
+ *	the superblock off super_blocks; it doesn't sleep and may be called
+ *	under rcu_read_lock().
  */
 static void put_super(struct super_block *sb)
 {
+	if (lockref_put_or_lock(&sb->s_lockref))
+		return;
+	lockref_mark_dead(&sb->s_lockref);
+	spin_unlock(&sb->s_lockref.lock);
+
 	spin_lock(&sb_lock);
-	__put_super(sb);
+	list_del_rcu(&sb->s_list);
 	spin_unlock(&sb_lock);
+	destroy_super(sb);
 }
 
 
@@ -318,16 +326,12 @@ EXPORT_SYMBOL(deactivate_super);
  *	Tries to acquire an active reference.  grab_super() is used when we
  * 	had just found a superblock in super_blocks or fs_type->fs_supers
  *	and want to turn it into a full-blown active reference.  grab_super()
- *	is called with sb_lock held and drops it.  Returns 1 in case of
- *	success, 0 if we had failed (superblock contents was already dead or
- *	dying when grab_super() had been called).  Note that this is only
- *	called for superblocks not in rundown mode (== ones still on ->fs_supers
- *	of their type), so increment of ->s_count is OK here.
+ *	is called with a passive reference held and drops it.  Returns 1 in
+ *	case of success, 0 if we had failed (superblock contents was already
+ *	dead or dying when grab_super() had been called).
  */
-static int grab_super(struct super_block *s) __releases(sb_lock)
+static int grab_super(struct super_block *s)
 {
-	s->s_count++;
-	spin_unlock(&sb_lock);
 	down_write(&s->s_umount);
 	if ((s->s_flags & MS_BORN) && atomic_inc_not_zero(&s->s_active)) {
 		put_super(s);
@@ -352,14 +356,10 @@ static int grab_super(struct super_block *s) __releases(sb_lock)
  */
 bool grab_super_passive(struct super_block *sb)
 {
-	spin_lock(&sb_lock);
-	if (hlist_unhashed(&sb->s_instances)) {
-		spin_unlock(&sb_lock);
+	if (hlist_unhashed(&sb->s_instances))
+		return false;
+	if (!lockref_get_not_dead(&sb->s_lockref))
 		return false;
-	}
-
-	sb->s_count++;
-	spin_unlock(&sb_lock);
 
 	if (down_read_trylock(&sb->s_umount)) {
 		if (sb->s_root && (sb->s_flags & MS_BORN))
@@ -394,7 +394,7 @@ void generic_shutdown_super(struct super_block *sb)
 		sync_filesystem(sb);
 		sb->s_flags &= ~MS_ACTIVE;
 
-		fsnotify_unmount_inodes(&sb->s_inodes);
+		fsnotify_unmount_inodes(sb);
 
 		evict_inodes(sb);
 
@@ -406,7 +406,7 @@ void generic_shutdown_super(struct super_block *sb)
 		if (sop->put_super)
 			sop->put_super(sb);
 
-		if (!list_empty(&sb->s_inodes)) {
+		if (!pcpu_list_empty(sb->s_inodes)) {
 			printk("VFS: Busy inodes after unmount of %s. "
 			   "Self-destruct in 5 seconds.  Have a nice day...\n",
 			   sb->s_id);
@@ -445,6 +445,9 @@ retry:
 		hlist_for_each_entry(old, &type->fs_supers, s_instances) {
 			if (!test(old, data))
 				continue;
+			/* still on ->fs_supers, so not dead yet */
+			lockref_get(&old->s_lockref);
+			spin_unlock(&sb_lock);
 			if (!grab_super(old))
 				goto retry;
 			if (s) {
@@ -472,7 +475,7 @@ retry:
 	}
 	s->s_type = type;
 	strlcpy(s->s_id, type->name, sizeof(s->s_id));
-	list_add_tail(&s->s_list, &super_blocks);
+	list_add_tail_rcu(&s->s_list, &super_blocks);
 	hlist_add_head(&s->s_instances, &type->fs_supers);
 	spin_unlock(&sb_lock);
 	get_filesystem(type);
@@ -500,28 +503,26 @@ EXPORT_SYMBOL(drop_super);
  */
 void iterate_supers(void (*f)(struct super_block *, void *), void *arg)
 {
-	struct super_block *sb, *p = NULL;
+	struct super_block *sb;
 
-	spin_lock(&sb_lock);
-	list_for_each_entry(sb, &super_blocks, s_list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sb, &super_blocks, s_list) {
 		if (hlist_unhashed(&sb->s_instances))
 			continue;
-		sb->s_count++;
-		spin_unlock(&sb_lock);
+		if (!lockref_get_not_dead(&sb->s_lockref))
+			continue;
+		rcu_read_unlock();
 
 		down_read(&sb->s_umount);
 		if (sb->s_root && (sb->s_flags & MS_BORN))
 			f(sb, arg);
 		up_read(&sb->s_umount);
 
-		spin_lock(&sb_lock);
-		if (p)
-			__put_super(p);
-		p = sb;
+		/* our reference kept sb on the list, carry on from it */
+		rcu_read_lock();
+		put_super(sb);
 	}
-	if (p)
-		__put_super(p);
-	spin_unlock(&sb_lock);
+	rcu_read_unlock();
 }
 
 /**
@@ -531,31 +532,32 @@ void iterate_supers(void (*f)(struct super_block *, void *), void *arg)
  *	@arg: argument to pass to it
  *
  *	Scans the superblock list and calls given function, passing it
- *	locked superblock and given argument.
+ *	locked superblock and given argument.  This walks super_blocks rather
+ *	than ->fs_supers: a superblock is taken off ->fs_supers while we may
+ *	hold a reference to it, and we couldn't carry on from it then.
  */
 void iterate_supers_type(struct file_system_type *type,
 	void (*f)(struct super_block *, void *), void *arg)
 {
-	struct super_block *sb, *p = NULL;
+	struct super_block *sb;
 
-	spin_lock(&sb_lock);
-	hlist_for_each_entry(sb, &type->fs_supers, s_instances) {
-		sb->s_count++;
-		spin_unlock(&sb_lock);
+	rcu_read_lock();
+	list_for_each_entry_rcu(sb, &super_blocks, s_list) {
+		if (sb->s_type != type || hlist_unhashed(&sb->s_instances))
+			continue;
+		if (!lockref_get_not_dead(&sb->s_lockref))
+			continue;
+		rcu_read_unlock();
 
 		down_read(&sb->s_umount);
 		if (sb->s_root && (sb->s_flags & MS_BORN))
 			f(sb, arg);
 		up_read(&sb->s_umount);
 
-		spin_lock(&sb_lock);
-		if (p)
-			__put_super(p);
-		p = sb;
+		rcu_read_lock();
+		put_super(sb);
 	}
-	if (p)
-		__put_super(p);
-	spin_unlock(&sb_lock);
+	rcu_read_unlock();
 }
 
 EXPORT_SYMBOL(iterate_supers_type);
@@ -575,26 +577,26 @@ struct super_block *get_super(struct block_device *bdev)
 	if (!bdev)
 		return NULL;
 
-	spin_lock(&sb_lock);
 rescan:
-	list_for_each_entry(sb, &super_blocks, s_list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sb, &super_blocks, s_list) {
 		if (hlist_unhashed(&sb->s_instances))
 			continue;
 		if (sb->s_bdev == bdev) {
-			sb->s_count++;
-			spin_unlock(&sb_lock);
+			if (!lockref_get_not_dead(&sb->s_lockref))
+				continue;
+			rcu_read_unlock();
 			down_read(&sb->s_umount);
 			/* still alive? */
 			if (sb->s_root && (sb->s_flags & MS_BORN))
 				return sb;
 			up_read(&sb->s_umount);
 			/* nope, got unmounted */
-			spin_lock(&sb_lock);
-			__put_super(sb);
+			put_super(sb);
 			goto rescan;
 		}
 	}
-	spin_unlock(&sb_lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -639,18 +641,21 @@ struct super_block *get_active_super(struct block_device *bdev)
 		return NULL;
 
 restart:
-	spin_lock(&sb_lock);
-	list_for_each_entry(sb, &super_blocks, s_list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sb, &super_blocks, s_list) {
 		if (hlist_unhashed(&sb->s_instances))
 			continue;
 		if (sb->s_bdev == bdev) {
+			if (!lockref_get_not_dead(&sb->s_lockref))
+				continue;
+			rcu_read_unlock();
 			if (!grab_super(sb))
 				goto restart;
 			up_write(&sb->s_umount);
 			return sb;
 		}
 	}
-	spin_unlock(&sb_lock);
+	rcu_read_unlock();
 	return NULL;
 }
  
@@ -658,26 +663,26 @@ struct super_block *user_get_super(dev_t dev)
 {
 	struct super_block *sb;
 
-	spin_lock(&sb_lock);
 rescan:
-	list_for_each_entry(sb, &super_blocks, s_list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sb, &super_blocks, s_list) {
 		if (hlist_unhashed(&sb->s_instances))
 			continue;
 		if (sb->s_dev ==  dev) {
-			sb->s_count++;
-			spin_unlock(&sb_lock);
+			if (!lockref_get_not_dead(&sb->s_lockref))
+				continue;
+			rcu_read_unlock();
 			down_read(&sb->s_umount);
 			/* still alive? */
 			if (sb->s_root && (sb->s_flags & MS_BORN))
 				return sb;
 			up_read(&sb->s_umount);
 			/* nope, got unmounted */
-			spin_lock(&sb_lock);
-			__put_super(sb);
+			put_super(sb);
 			goto rescan;
 		}
 	}
-	spin_unlock(&sb_lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -766,14 +771,15 @@ cancel_readonly:
 
 static void do_emergency_remount(struct work_struct *work)
 {
-	struct super_block *sb, *p = NULL;
+	struct super_block *sb;
 
-	spin_lock(&sb_lock);
-	list_for_each_entry(sb, &super_blocks, s_list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sb, &super_blocks, s_list) {
 		if (hlist_unhashed(&sb->s_instances))
 			continue;
-		sb->s_count++;
-		spin_unlock(&sb_lock);
+		if (!lockref_get_not_dead(&sb->s_lockref))
+			continue;
+		rcu_read_unlock();
 		down_write(&sb->s_umount);
 		if (sb->s_root && sb->s_bdev && (sb->s_flags & MS_BORN) &&
 		    !(sb->s_flags & MS_RDONLY)) {
@@ -783,14 +789,10 @@ static void do_emergency_remount(struct work_struct *work)
 			do_remount_sb(sb, MS_RDONLY, NULL, 1);
 		}
 		up_write(&sb->s_umount);
-		spin_lock(&sb_lock);
-		if (p)
-			__put_super(p);
-		p = sb;
+		rcu_read_lock();
+		put_super(sb);
 	}
-	if (p)
-		__put_super(p);
-	spin_unlock(&sb_lock);
+	rcu_read_unlock();
 	kfree(work);
 	printk("Emergency Remount complete\n");
 }
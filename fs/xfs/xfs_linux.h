@@ -77,6 +77,7 @@ typedef __uint64_t __psunsigned_t;
 #include <linux/seq_file.h>
 #include <linux/init.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/proc_fs.h>
 #include <linux/sort.h>
 #include <linux/cpu.h>
@@ -724,9 +724,8 @@ xfs_log_item_batch_insert(
 {
 	int	i;
 
-	spin_lock(&ailp->xa_lock);
-	/* xfs_trans_ail_update_bulk drops ailp->xa_lock */
-	xfs_trans_ail_update_bulk(ailp, cur, log_items, nr_items, commit_lsn);
+	xfs_trans_ail_update_combine(ailp, cur, log_items, nr_items,
+				     commit_lsn);
 
 	for (i = 0; i < nr_items; i++) {
 		struct xfs_log_item *lip = log_items[i];
@@ -799,16 +798,13 @@ xfs_trans_committed_bulk(
 
 			/*
 			 * Not a bulk update option due to unusual item_lsn.
-			 * Push into AIL immediately, rechecking the lsn once
-			 * we have the ail lock. Then unpin the item. This does
-			 * not affect the AIL cursor the bulk insert path is
-			 * using.
+			 * Push into AIL immediately; the LSN is rechecked once
+			 * the update runs under the ail lock. Then unpin the
+			 * item. This does not affect the AIL cursor the bulk
+			 * insert path is using.
 			 */
-			spin_lock(&ailp->xa_lock);
-			if (XFS_LSN_CMP(item_lsn, lip->li_lsn) > 0)
-				xfs_trans_ail_update(ailp, lip, item_lsn);
-			else
-				spin_unlock(&ailp->xa_lock);
+			xfs_trans_ail_update_combine(ailp, NULL, &lip, 1,
+						     item_lsn);
 			lip->li_ops->iop_unpin(lip, 0);
 			continue;
 		}
@@ -614,37 +614,20 @@ xfs_ail_push_all_sync(
 }
 
 /*
- * xfs_trans_ail_update - bulk AIL insertion operation.
- *
- * @xfs_trans_ail_update takes an array of log items that all need to be
- * positioned at the same LSN in the AIL. If an item is not in the AIL, it will
- * be added.  Otherwise, it will be repositioned  by removing it and re-adding
- * it to the AIL. If we move the first item in the AIL, update the log tail to
- * match the new minimum LSN in the AIL.
- *
- * This function takes the AIL lock once to execute the update operations on
- * all the items in the array, and as such should not be called with the AIL
- * lock held. As a result, once we have the AIL lock, we need to check each log
- * item LSN to confirm it needs to be moved forward in the AIL.
- *
- * To optimise the insert operation, we delete all the items from the AIL in
- * the first pass, moving them into a temporary list, then splice the temporary
- * list into the correct position in the AIL. This avoids needing to do an
- * insert operation on every item.
- *
- * This function must be called with the AIL lock held.  The lock is dropped
- * before returning.
+ * Insert or move an array of log items to @lsn in the AIL with the AIL lock
+ * held.  Returns true if the minimum item of the AIL was moved, in which case
+ * the caller has to update the log tail and wake log space waiters.
  */
-void
-xfs_trans_ail_update_bulk(
+static bool
+xfs_ail_update_locked(
 	struct xfs_ail		*ailp,
 	struct xfs_ail_cursor	*cur,
 	struct xfs_log_item	**log_items,
 	int			nr_items,
-	xfs_lsn_t		lsn) __releases(ailp->xa_lock)
+	xfs_lsn_t		lsn)
 {
 	xfs_log_item_t		*mlip;
-	int			mlip_changed = 0;
+	bool			mlip_changed = false;
 	int			i;
 	LIST_HEAD(tmp);
 
@@ -661,7 +644,7 @@ xfs_trans_ail_update_bulk(
 			trace_xfs_ail_move(lip, lip->li_lsn, lsn);
 			xfs_ail_delete(ailp, lip);
 			if (mlip == lip)
-				mlip_changed = 1;
+				mlip_changed = true;
 		} else {
 			lip->li_flags |= XFS_LI_IN_AIL;
 			trace_xfs_ail_insert(lip, 0, lsn);
@@ -673,6 +656,18 @@ xfs_trans_ail_update_bulk(
 	if (!list_empty(&tmp))
 		xfs_ail_splice(ailp, cur, &tmp, lsn);
 
+	return mlip_changed;
+}
+
+/*
+ * Drop the AIL lock after an update, moving the log tail forward first if
+ * the minimum item of the AIL was moved.
+ */
+static void
+xfs_ail_update_unlock(
+	struct xfs_ail		*ailp,
+	bool			mlip_changed) __releases(ailp->xa_lock)
+{
 	if (mlip_changed) {
 		if (!XFS_FORCED_SHUTDOWN(ailp->xa_mount))
 			xlog_assign_tail_lsn_locked(ailp->xa_mount);
@@ -684,6 +679,111 @@ xfs_trans_ail_update_bulk(
 	}
 }
 
+/*
+ * xfs_trans_ail_update - bulk AIL insertion operation.
+ *
+ * @xfs_trans_ail_update takes an array of log items that all need to be
+ * positioned at the same LSN in the AIL. If an item is not in the AIL, it will
+ * be added.  Otherwise, it will be repositioned  by removing it and re-adding
+ * it to the AIL. If we move the first item in the AIL, update the log tail to
+ * match the new minimum LSN in the AIL.
+ *
+ * This function takes the AIL lock once to execute the update operations on
+ * all the items in the array, and as such should not be called with the AIL
+ * lock held. As a result, once we have the AIL lock, we need to check each log
+ * item LSN to confirm it needs to be moved forward in the AIL.
+ *
+ * To optimise the insert operation, we delete all the items from the AIL in
+ * the first pass, moving them into a temporary list, then splice the temporary
+ * list into the correct position in the AIL. This avoids needing to do an
+ * insert operation on every item.
+ *
+ * This function must be called with the AIL lock held.  The lock is dropped
+ * before returning.
+ */
+void
+xfs_trans_ail_update_bulk(
+	struct xfs_ail		*ailp,
+	struct xfs_ail_cursor	*cur,
+	struct xfs_log_item	**log_items,
+	int			nr_items,
+	xfs_lsn_t		lsn) __releases(ailp->xa_lock)
+{
+	bool			mlip_changed;
+
+	mlip_changed = xfs_ail_update_locked(ailp, cur, log_items, nr_items,
+					     lsn);
+	xfs_ail_update_unlock(ailp, mlip_changed);
+}
+
+/*
+ * Run every queued AIL update with the AIL lock held, in the order they were
+ * queued.  Each update is positioned by its own LSN (and cursor), so the
+ * result is the same as if the submitters had taken the lock one by one.
+ */
+static bool
+xfs_ail_update_pending(
+	struct xfs_ail		*ailp)
+{
+	struct llist_node	*node;
+	bool			mlip_changed = false;
+
+	node = llist_reverse_order(llist_del_all(&ailp->xa_pending));
+	while (node) {
+		struct xfs_ail_update	*upd;
+
+		upd = llist_entry(node, struct xfs_ail_update, node);
+		node = node->next;
+		if (xfs_ail_update_locked(ailp, upd->cur, upd->log_items,
+					  upd->nr_items, upd->lsn))
+			mlip_changed = true;
+		/* @upd may go away as soon as the submitter sees this */
+		smp_store_release(&upd->done, true);
+	}
+	return mlip_changed;
+}
+
+/*
+ * xfs_trans_ail_update_combine - AIL insertion with combining.
+ *
+ * Like xfs_trans_ail_update_bulk(), but called without the AIL lock held.
+ * The update is queued on the AIL and whoever gets the AIL lock next via
+ * this function applies all queued updates in one lock hold, so concurrent
+ * log completions do not each have to bounce the AIL lock cacheline.  The
+ * caller returns only once its items are in the AIL, so it may unpin them
+ * straight away.
+ */
+void
+xfs_trans_ail_update_combine(
+	struct xfs_ail		*ailp,
+	struct xfs_ail_cursor	*cur,
+	struct xfs_log_item	**log_items,
+	int			nr_items,
+	xfs_lsn_t		lsn)
+{
+	struct xfs_ail_update	upd = {
+		.cur		= cur,
+		.log_items	= log_items,
+		.nr_items	= nr_items,
+		.lsn		= lsn,
+	};
+
+	llist_add(&upd.node, &ailp->xa_pending);
+	while (!smp_load_acquire(&upd.done)) {
+		if (spin_trylock(&ailp->xa_lock)) {
+			xfs_ail_update_unlock(ailp,
+					      xfs_ail_update_pending(ailp));
+			/*
+			 * Our update was either run by us, or by a previous
+			 * combiner before it dropped the lock.
+			 */
+			ASSERT(upd.done);
+			break;
+		}
+		cpu_relax();
+	}
+}
+
 /*
  * xfs_trans_ail_delete_bulk - remove multiple log items from the AIL
  *
@@ -770,6 +870,7 @@ xfs_trans_ail_init(
 	spin_lock_init(&ailp->xa_lock);
 	INIT_LIST_HEAD(&ailp->xa_buf_list);
 	init_waitqueue_head(&ailp->xa_empty);
+	init_llist_head(&ailp->xa_pending);
 
 	ailp->xa_task = kthread_run(xfsaild, ailp, "xfsaild/%s",
 			ailp->xa_mount->m_fsname);
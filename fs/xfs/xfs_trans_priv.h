@@ -76,6 +76,20 @@ struct xfs_ail {
 	int			xa_log_flush;
 	struct list_head	xa_buf_list;
 	wait_queue_head_t	xa_empty;
+	struct llist_head	xa_pending;
+};
+
+/*
+ * A queued AIL insertion, see xfs_trans_ail_update_combine().  Lives on the
+ * stack of the submitter, which waits for @done before returning.
+ */
+struct xfs_ail_update {
+	struct llist_node	node;
+	struct xfs_ail_cursor	*cur;
+	struct xfs_log_item	**log_items;
+	int			nr_items;
+	xfs_lsn_t		lsn;
+	bool			done;
 };
 
 /*
@@ -85,6 +99,10 @@ void	xfs_trans_ail_update_bulk(struct xfs_ail *ailp,
 				struct xfs_ail_cursor *cur,
 				struct xfs_log_item **log_items, int nr_items,
 				xfs_lsn_t lsn) __releases(ailp->xa_lock);
+void	xfs_trans_ail_update_combine(struct xfs_ail *ailp,
+				struct xfs_ail_cursor *cur,
+				struct xfs_log_item **log_items, int nr_items,
+				xfs_lsn_t lsn);
 /*
  * Return a pointer to the first item in the AIL.  If the AIL is empty, then
  * return NULL.
@@ -19,7 +19,9 @@
 #define __ASM_GENERIC_QRWLOCK_H
 
 #include <linux/atomic.h>
+#include <linux/irqflags.h>
 #include <asm/barrier.h>
+#include <asm/percpu.h>
 #include <asm/processor.h>
 
 #include <asm-generic/qrwlock_types.h>
@@ -30,7 +32,8 @@
 #define	_QW_WAITING	1		/* A writer is waiting	   */
 #define	_QW_LOCKED	0xff		/* A writer holds the lock */
 #define	_QW_WMASK	0xff		/* Writer mask		   */
-#define	_QR_SHIFT	8		/* Reader count shift	   */
+#define	_QW_PVHALT	0x100		/* A PV queue head halted  */
+#define	_QR_SHIFT	9		/* Reader count shift	   */
 #define _QR_BIAS	(1U << _QR_SHIFT)
 
 /*
@@ -57,6 +60,21 @@ static inline int queue_write_can_lock(struct qrwlock *lock)
 	return !atomic_read(&lock->cnts);
 }
 
+#ifndef queue_read_unlock
+/**
+ * queue_read_unlock - release read lock of a queue rwlock
+ * @lock : Pointer to queue rwlock structure
+ */
+static inline void queue_read_unlock(struct qrwlock *lock)
+{
+	/*
+	 * Atomically decrement the reader count
+	 */
+	smp_mb__before_atomic();
+	atomic_sub(_QR_BIAS, &lock->cnts);
+}
+#endif
+
 /**
  * queue_read_trylock - try to acquire read lock of a queue rwlock
  * @lock : Pointer to queue rwlock structure
@@ -71,7 +89,8 @@ static inline int queue_read_trylock(struct qrwlock *lock)
 		cnts = (u32)atomic_add_return(_QR_BIAS, &lock->cnts);
 		if (likely(!(cnts & _QW_WMASK)))
 			return 1;
-		atomic_sub(_QR_BIAS, &lock->cnts);
+		/* Back out like an unlock, a halted writer may be waiting */
+		queue_read_unlock(lock);
 	}
 	return 0;
 }
@@ -121,19 +140,6 @@ static inline void queue_write_lock(struct qrwlock *lock)
 	queue_write_lock_slowpath(lock);
 }
 
-/**
- * queue_read_unlock - release read lock of a queue rwlock
- * @lock : Pointer to queue rwlock structure
- */
-static inline void queue_read_unlock(struct qrwlock *lock)
-{
-	/*
-	 * Atomically decrement the reader count
-	 */
-	smp_mb__before_atomic();
-	atomic_sub(_QR_BIAS, &lock->cnts);
-}
-
 #ifndef queue_write_unlock
 /**
  * queue_write_unlock - release write lock of a queue rwlock
@@ -163,4 +169,235 @@ static inline void queue_write_unlock(struct qrwlock *lock)
 #define arch_read_unlock(l)	queue_read_unlock(l)
 #define arch_write_unlock(l)	queue_write_unlock(l)
 
+/*
+ * Per-cpu reader (brlock) mode of the queue rwlock
+ *
+ * The readers of a read-mostly lock only increment a per-cpu counter and
+ * so don't bounce a shared cacheline across the system. A writer takes the
+ * embedded queue rwlock for write, which also stops the new readers, sets
+ * the writer flag and waits for the per-cpu counters to drain. The writers
+ * are thus very slow and should be rare.
+ *
+ * A reader that sees the writer flag backs out and gets into the lock by
+ * acquiring the embedded queue rwlock for read while it raises its per-cpu
+ * count again. A reader nested in another reader of the same cpu, in
+ * interrupt context for example, doesn't look at the writer flag at all as
+ * no writer can get past the count of the outer reader. For this to work,
+ * the count and writer flag check of the outer reader is done with the
+ * interrupts disabled.
+ *
+ * Like the other arch_*() rwlock functions, these have to be called with
+ * preemption disabled; a read lock must be released on the cpu that has
+ * acquired it.
+ */
+struct percpu_qrwlock {
+	struct qrwlock		rwlock;
+	int			writer;
+	unsigned int __percpu	*readers;
+};
+
+#define DEFINE_PERCPU_QRWLOCK(name)					\
+	static DEFINE_PER_CPU(unsigned int, name ## _readers);		\
+	struct percpu_qrwlock name = {					\
+		.rwlock  = __ARCH_RW_LOCK_UNLOCKED,			\
+		.readers = &name ## _readers,				\
+	}
+
+#define DEFINE_STATIC_PERCPU_QRWLOCK(name)				\
+	static DEFINE_PER_CPU(unsigned int, name ## _readers);		\
+	static struct percpu_qrwlock name = {				\
+		.rwlock  = __ARCH_RW_LOCK_UNLOCKED,			\
+		.readers = &name ## _readers,				\
+	}
+
+extern void queue_read_lock_percpu_slowpath(struct percpu_qrwlock *lock);
+extern int queue_read_trylock_percpu_slowpath(struct percpu_qrwlock *lock);
+extern void queue_write_lock_percpu(struct percpu_qrwlock *lock);
+extern int queue_write_trylock_percpu(struct percpu_qrwlock *lock);
+
+/**
+ * queue_read_lock_percpu_fast - try the per-cpu count of a percpu qrwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ * Return: true if the read lock is acquired, false if a writer is present
+ */
+static __always_inline bool
+queue_read_lock_percpu_fast(struct percpu_qrwlock *lock)
+{
+	unsigned long flags;
+	bool ret = true;
+
+	if (__this_cpu_read(*lock->readers)) {
+		/* Nested in a reader of this cpu */
+		this_cpu_inc(*lock->readers);
+		return true;
+	}
+
+	local_irq_save(flags);
+	__this_cpu_inc(*lock->readers);
+	smp_mb();
+	if (unlikely(ACCESS_ONCE(lock->writer))) {
+		__this_cpu_dec(*lock->readers);
+		ret = false;
+	}
+	local_irq_restore(flags);
+	return ret;
+}
+
+/**
+ * queue_read_lock_percpu - acquire read lock of a percpu queue rwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ */
+static inline void queue_read_lock_percpu(struct percpu_qrwlock *lock)
+{
+	if (likely(queue_read_lock_percpu_fast(lock)))
+		return;
+
+	queue_read_lock_percpu_slowpath(lock);
+}
+
+/**
+ * queue_read_trylock_percpu - try to acquire read lock of a percpu qrwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ * Return: 1 if lock acquired, 0 if failed
+ */
+static inline int queue_read_trylock_percpu(struct percpu_qrwlock *lock)
+{
+	if (likely(queue_read_lock_percpu_fast(lock)))
+		return 1;
+
+	return queue_read_trylock_percpu_slowpath(lock);
+}
+
+/**
+ * queue_read_unlock_percpu - release read lock of a percpu queue rwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ */
+static inline void queue_read_unlock_percpu(struct percpu_qrwlock *lock)
+{
+	smp_mb();
+	this_cpu_dec(*lock->readers);
+}
+
+/**
+ * queue_write_unlock_percpu - release write lock of a percpu queue rwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ */
+static inline void queue_write_unlock_percpu(struct percpu_qrwlock *lock)
+{
+	smp_store_release(&lock->writer, 0);
+	queue_write_unlock(&lock->rwlock);
+}
+
+/*
+ * The percpu counterparts of the arch rwlock functions above, so that a
+ * call site can be switched over by just changing the lock type and
+ * adding the _percpu suffix.
+ */
+#define arch_read_lock_percpu(l)	queue_read_lock_percpu(l)
+#define arch_write_lock_percpu(l)	queue_write_lock_percpu(l)
+#define arch_read_trylock_percpu(l)	queue_read_trylock_percpu(l)
+#define arch_write_trylock_percpu(l)	queue_write_trylock_percpu(l)
+#define arch_read_unlock_percpu(l)	queue_read_unlock_percpu(l)
+#define arch_write_unlock_percpu(l)	queue_write_unlock_percpu(l)
+
+/*
+ * Queue rwlock with a reader/writer policy
+ *
+ * The readers in process context are normally queued in fifo order with
+ * the writers while the readers in interrupt context, which may be nested
+ * in a reader of the same cpu, get the lock ahead of a waiting writer.
+ *  - QRW_POLICY_FAIR		: the default behavior above;
+ *  - QRW_POLICY_READER		: all the readers get ahead of a waiting
+ *				  writer, they only wait for a writer that
+ *				  holds the lock;
+ *  - QRW_POLICY_WRITER		: the readers in interrupt context first let
+ *				  a waiting writer through by dropping their
+ *				  count for a bounded time. The bound keeps a
+ *				  nested reader from deadlocking.
+ *
+ * The readers queued behind a reader queue head of a policy_qrwlock are
+ * also admitted as a group, see queue_read_lock_policy_slowpath(). The
+ * state for both lives in this wrapper, so that the plain queue rwlock
+ * keeps the size of its lock word and internal spinlock. A plain queue
+ * rwlock behaves as QRW_POLICY_FAIR.
+ */
+enum qrwlock_policy {
+	QRW_POLICY_FAIR,
+	QRW_POLICY_READER,
+	QRW_POLICY_WRITER,
+};
+
+struct policy_qrwlock {
+	struct qrwlock		rwlock;
+	u8			policy;		/* enum qrwlock_policy */
+	u16			rgrant;		/* Readers admitted in advance */
+	atomic_t		rwaiting;	/* Readers arrived in the queue */
+};
+
+#define __POLICY_QRWLOCK_UNLOCKED(p) {					\
+	.rwlock   = __ARCH_RW_LOCK_UNLOCKED,				\
+	.policy   = (p),						\
+	.rwaiting = ATOMIC_INIT(0),					\
+}
+
+#define DEFINE_POLICY_QRWLOCK(name, p)					\
+	struct policy_qrwlock name = __POLICY_QRWLOCK_UNLOCKED(p)
+
+extern void queue_read_lock_policy_slowpath(struct policy_qrwlock *lock);
+extern void queue_write_lock_policy_slowpath(struct policy_qrwlock *lock);
+
+/**
+ * queue_rwlock_set_policy - set the reader/writer policy of a queue rwlock
+ * @lock  : Pointer to policy queue rwlock structure
+ * @policy: The new policy
+ *
+ * The policy is expected to be set at init time before the lock is used.
+ */
+static inline void
+queue_rwlock_set_policy(struct policy_qrwlock *lock,
+			enum qrwlock_policy policy)
+{
+	ACCESS_ONCE(lock->policy) = policy;
+}
+
+/**
+ * queue_read_lock_policy - acquire read lock of a policy queue rwlock
+ * @lock: Pointer to policy queue rwlock structure
+ */
+static inline void queue_read_lock_policy(struct policy_qrwlock *lock)
+{
+	u32 cnts;
+
+	cnts = atomic_add_return(_QR_BIAS, &lock->rwlock.cnts);
+	if (likely(!(cnts & _QW_WMASK)))
+		return;
+
+	/* The slowpath will decrement the reader count, if necessary. */
+	queue_read_lock_policy_slowpath(lock);
+}
+
+/**
+ * queue_write_lock_policy - acquire write lock of a policy queue rwlock
+ * @lock : Pointer to policy queue rwlock structure
+ */
+static inline void queue_write_lock_policy(struct policy_qrwlock *lock)
+{
+	if (atomic_cmpxchg(&lock->rwlock.cnts, 0, _QW_LOCKED) == 0)
+		return;
+
+	queue_write_lock_policy_slowpath(lock);
+}
+
+/*
+ * The trylocks and unlocks are those of the embedded queue rwlock: the
+ * readers admitted in advance hold reader counts in the lock word.
+ */
+#define arch_rwlock_set_policy(l, p)	queue_rwlock_set_policy(l, p)
+#define arch_read_lock_policy(l)	queue_read_lock_policy(l)
+#define arch_write_lock_policy(l)	queue_write_lock_policy(l)
+#define arch_read_trylock_policy(l)	queue_read_trylock(&(l)->rwlock)
+#define arch_write_trylock_policy(l)	queue_write_trylock(&(l)->rwlock)
+#define arch_read_unlock_policy(l)	queue_read_unlock(&(l)->rwlock)
+#define arch_write_unlock_policy(l)	queue_write_unlock(&(l)->rwlock)
+
 #endif /* __ASM_GENERIC_QRWLOCK_H */
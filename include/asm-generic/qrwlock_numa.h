@@ -0,0 +1,143 @@
+/*
+ * Queue read/write lock with per-node reader counts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __ASM_GENERIC_QRWLOCK_NUMA_H
+#define __ASM_GENERIC_QRWLOCK_NUMA_H
+
+/*
+ * A middle ground between the single reader count of the queue rwlock and
+ * the per-cpu counts of the percpu_qrwlock. Each NUMA node has its own
+ * reader count on its own cacheline, so the readers only bounce the line
+ * of their node while the memory cost is proportional to nr_node_ids.
+ * Unlike the percpu_qrwlock, it can be embedded into dynamically allocated
+ * structures; the reader counts are allocated by numa_qrwlock_init().
+ *
+ * A writer takes the embedded queue rwlock for write to keep the other
+ * writers and the new readers out, and goes through two states:
+ *  - NQRW_WAITING: the writer waits for the node counts to drain. The
+ *    readers in process context back out and wait on the embedded rwlock
+ *    while the ones in interrupt context, which may be nested in a reader
+ *    of the same node, still get the lock.
+ *  - NQRW_LOCKED : the writer checks the node counts again after setting
+ *    it and goes back to waiting if a reader has come in meanwhile. The
+ *    readers in interrupt context spin until it goes away.
+ *
+ * The functions have to be called with preemption disabled like the other
+ * arch rwlock functions.
+ */
+#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/gfp.h>
+#include <linux/hardirq.h>
+#include <linux/spinlock.h>
+#include <linux/topology.h>
+
+#define NQRW_WAITING	1
+#define NQRW_LOCKED	2
+
+struct numa_qrwlock_node {
+	atomic_t		readers;
+} ____cacheline_aligned_in_smp;
+
+struct numa_qrwlock {
+	struct qrwlock			rwlock;
+	int				writer;
+	struct numa_qrwlock_node	*nodes;
+};
+
+extern int numa_qrwlock_init(struct numa_qrwlock *lock, gfp_t gfp);
+extern void numa_qrwlock_free(struct numa_qrwlock *lock);
+extern void queue_read_lock_numa_slowpath(struct numa_qrwlock *lock);
+extern int queue_read_trylock_numa_slowpath(struct numa_qrwlock *lock);
+extern void queue_write_lock_numa(struct numa_qrwlock *lock);
+extern int queue_write_trylock_numa(struct numa_qrwlock *lock);
+
+static __always_inline atomic_t *numa_qrwlock_readers(struct numa_qrwlock *lock)
+{
+	return &lock->nodes[numa_node_id()].readers;
+}
+
+/**
+ * queue_read_lock_numa_fast - try the node reader count of a numa qrwlock
+ * @lock : Pointer to numa queue rwlock structure
+ * Return: true if the read lock is acquired, false if a writer is present
+ */
+static __always_inline bool
+queue_read_lock_numa_fast(struct numa_qrwlock *lock)
+{
+	atomic_t *readers = numa_qrwlock_readers(lock);
+	int writer;
+
+	atomic_inc(readers);
+	smp_mb__after_atomic();
+	writer = ACCESS_ONCE(lock->writer);
+	if (likely(!writer || (writer == NQRW_WAITING && in_interrupt())))
+		return true;
+
+	atomic_dec(readers);
+	return false;
+}
+
+/**
+ * queue_read_lock_numa - acquire read lock of a numa queue rwlock
+ * @lock : Pointer to numa queue rwlock structure
+ */
+static inline void queue_read_lock_numa(struct numa_qrwlock *lock)
+{
+	if (likely(queue_read_lock_numa_fast(lock)))
+		return;
+
+	queue_read_lock_numa_slowpath(lock);
+}
+
+/**
+ * queue_read_trylock_numa - try to acquire read lock of a numa qrwlock
+ * @lock : Pointer to numa queue rwlock structure
+ * Return: 1 if lock acquired, 0 if failed
+ */
+static inline int queue_read_trylock_numa(struct numa_qrwlock *lock)
+{
+	if (likely(queue_read_lock_numa_fast(lock)))
+		return 1;
+
+	return queue_read_trylock_numa_slowpath(lock);
+}
+
+/**
+ * queue_read_unlock_numa - release read lock of a numa queue rwlock
+ * @lock : Pointer to numa queue rwlock structure
+ */
+static inline void queue_read_unlock_numa(struct numa_qrwlock *lock)
+{
+	smp_mb__before_atomic();
+	atomic_dec(numa_qrwlock_readers(lock));
+}
+
+/**
+ * queue_write_unlock_numa - release write lock of a numa queue rwlock
+ * @lock : Pointer to numa queue rwlock structure
+ */
+static inline void queue_write_unlock_numa(struct numa_qrwlock *lock)
+{
+	smp_store_release(&lock->writer, 0);
+	queue_write_unlock(&lock->rwlock);
+}
+
+#define arch_read_lock_numa(l)		queue_read_lock_numa(l)
+#define arch_write_lock_numa(l)		queue_write_lock_numa(l)
+#define arch_read_trylock_numa(l)	queue_read_trylock_numa(l)
+#define arch_write_trylock_numa(l)	queue_write_trylock_numa(l)
+#define arch_read_unlock_numa(l)	queue_read_unlock_numa(l)
+#define arch_write_unlock_numa(l)	queue_write_unlock_numa(l)
+
+#endif /* __ASM_GENERIC_QRWLOCK_NUMA_H */
@@ -45,6 +45,23 @@ static __always_inline int queue_spin_value_unlocked(struct qspinlock lock)
 	return !atomic_read(&lock.val);
 }
 
+#ifdef CONFIG_QUEUE_SPINLOCK_LOCKREF
+/**
+ * queue_spin_value_lockref - can the lockref count be changed locklessly?
+ * @lock: queue spinlock structure
+ * Return: 1 if the lock isn't held, whether or not there are waiters
+ *
+ * The slowpath has a full barrier after setting the locked byte, so the
+ * new lock holder sees any count change made before it took the lock and
+ * the lockref cmpxchg fails on any made after.
+ */
+static __always_inline int queue_spin_value_lockref(struct qspinlock lock)
+{
+	return !(atomic_read(&lock.val) & _Q_LOCKED_MASK);
+}
+#define arch_spin_value_lockref(l)	queue_spin_value_lockref(l)
+#endif
+
 /**
  * queue_spin_is_contended - check if the lock is contended
  * @lock : Pointer to queue spinlock structure
@@ -100,6 +117,101 @@ static __always_inline void queue_spin_unlock(struct qspinlock *lock)
 }
 #endif
 
+#ifdef CONFIG_QUEUE_SPINLOCK_IRQ_WAIT
+extern void queue_spin_lock_flags_slowpath(struct qspinlock *lock, u32 val,
+					   unsigned long flags);
+
+/**
+ * queue_spin_lock_flags - acquire a queue spinlock in spin_lock_irqsave()
+ * @lock : Pointer to queue spinlock structure
+ * @flags: The interrupt state saved by the caller
+ *
+ * If @flags has interrupts enabled, they are enabled again while waiting
+ * in the queue behind other waiters.
+ */
+static __always_inline void queue_spin_lock_flags(struct qspinlock *lock,
+						  unsigned long flags)
+{
+	u32 val;
+
+	if (arch_irqs_disabled_flags(flags)) {
+		queue_spin_lock(lock);
+		return;
+	}
+	val = atomic_cmpxchg(&lock->val, 0, _Q_LOCKED_VAL);
+	if (likely(val == 0))
+		return;
+	queue_spin_lock_flags_slowpath(lock, val, flags);
+}
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_TIMEOUT
+extern int queue_spin_trylock_for_slowpath(struct qspinlock *lock, u64 cycles);
+
+/**
+ * queue_spin_trylock_for - acquire the queue spinlock with a timeout
+ * @lock  : Pointer to queue spinlock structure
+ * @cycles: The maximum number of get_cycles() cycles to wait
+ * Return: 1 if lock acquired, 0 if timed out
+ *
+ * The waiter queues up like queue_spin_lock() does, but leaves the queue
+ * without disturbing the other waiters once the time is up.
+ */
+static __always_inline int queue_spin_trylock_for(struct qspinlock *lock,
+						  u64 cycles)
+{
+	if (likely(atomic_cmpxchg(&lock->val, 0, _Q_LOCKED_VAL) == 0))
+		return 1;
+	return queue_spin_trylock_for_slowpath(lock, cycles);
+}
+#define arch_spin_trylock_for(l, c)	queue_spin_trylock_for(l, c)
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_OWNER
+extern int queue_spin_owner(struct qspinlock *lock);
+extern void queue_spin_init_owner(void);
+#else
+static inline int queue_spin_owner(struct qspinlock *lock)	{ return -1; }
+static inline void queue_spin_init_owner(void)			{ }
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_LOCKSTAT
+extern struct static_key queue_lockstat_key;
+static __always_inline bool static_key_false(struct static_key *key);
+extern void __queue_lockstat_release(struct qspinlock *lock);
+
+/*
+ * Pick up the hold time of the lock if its acquisition has been sampled
+ */
+static __always_inline void queue_lockstat_release(struct qspinlock *lock)
+{
+	if (static_key_false(&queue_lockstat_key))
+		__queue_lockstat_release(lock);
+}
+#endif
+
+extern void queue_spin_unlock_wait(struct qspinlock *lock);
+
+#ifndef queue_spin_wait_clear
+/**
+ * queue_spin_wait_clear - wait until the given bits of the lock are clear
+ * @lock: Pointer to queue spinlock structure
+ * @mask: The bits of the lock word to wait for
+ * Return: the last lock value read, with the given bits cleared
+ *
+ * The load-acquire orders the following accesses after the wait.
+ */
+static __always_inline u32
+queue_spin_wait_clear(struct qspinlock *lock, u32 mask)
+{
+	u32 val;
+
+	while ((val = smp_load_acquire(&lock->val.counter)) & mask)
+		cpu_relax();
+	return val;
+}
+#endif
+
 #ifndef virt_queue_spin_lock
 static __always_inline bool virt_queue_spin_lock(struct qspinlock *lock)
 {
@@ -119,9 +231,22 @@ static __always_inline bool virt_queue_spin_lock(struct qspinlock *lock)
 #define arch_spin_is_locked(l)		queue_spin_is_locked(l)
 #define arch_spin_is_contended(l)	queue_spin_is_contended(l)
 #define arch_spin_value_unlocked(l)	queue_spin_value_unlocked(l)
+#define arch_spin_unlock_wait(l)	queue_spin_unlock_wait(l)
 #define arch_spin_lock(l)		queue_spin_lock(l)
 #define arch_spin_trylock(l)		queue_spin_trylock(l)
+#ifdef CONFIG_QUEUE_SPINLOCK_LOCKSTAT
+#define arch_spin_unlock(l)				\
+do {							\
+	queue_lockstat_release(l);			\
+	queue_spin_unlock(l);				\
+} while (0)
+#else
 #define arch_spin_unlock(l)		queue_spin_unlock(l)
+#endif
+#ifdef CONFIG_QUEUE_SPINLOCK_IRQ_WAIT
+#define arch_spin_lock_flags(l, f)	queue_spin_lock_flags(l, f)
+#else
 #define arch_spin_lock_flags(l, f)	queue_spin_lock(l)
+#endif
 
 #endif /* __ASM_GENERIC_QSPINLOCK_H */
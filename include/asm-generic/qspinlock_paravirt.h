@@ -0,0 +1,162 @@
+/*
+ * Queue spinlock para-virtualization interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __ASM_GENERIC_QSPINLOCK_PARAVIRT_H
+#define __ASM_GENERIC_QSPINLOCK_PARAVIRT_H
+
+/*
+ * The PV slowpath is in kernel/locking/qspinlock_paravirt.h. An
+ * architecture that supports CONFIG_PARAVIRT_SPINLOCKS includes this file
+ * from its asm/qspinlock.h and provides:
+ *  - native_spin_unlock(), the unlock without the slowpath flag check;
+ *  - queue_spin_lock() and queue_spin_unlock() that go to
+ *    pv_queue_spin_lock_slowpath() and queue_spin_unlock_slowpath()
+ *    respectively when paravirt_spinlocks_enabled is on.
+ *
+ * The hypervisor specific code fills in pv_lock_ops, calls
+ * pv_init_lock_hash() and then turns on paravirt_spinlocks_enabled.
+ * x86 has its own pv_lock_ops with patched call sites for the slowpath
+ * and the unlock, and the accessors in asm/paravirt.h. The other architectures use the plain
+ * function table below.
+ */
+#include <linux/jump_label.h>
+#include <asm/percpu.h>
+#include <asm-generic/qspinlock_types.h>
+
+/*
+ * The lock byte can have a value of _Q_LOCKED_SLOWPATH to indicate
+ * that it needs to go through the slowpath to do the unlocking.
+ */
+#define _Q_LOCKED_SLOWPATH	(_Q_LOCKED_VAL | 2)
+
+extern struct static_key paravirt_spinlocks_enabled;
+
+extern void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val);
+extern void pv_queue_spin_lock_slowpath(struct qspinlock *lock, u32 val);
+extern void queue_spin_unlock_slowpath(struct qspinlock *lock);
+extern void pv_init_lock_hash(void);
+
+/*
+ * Contended lock holder hint: the locks taken in the PV slowpath are
+ * counted in pv_locks_held and the count is passed to pv_lock_held(),
+ * for the hypervisor to delay the preemption of the lock holder. An
+ * architecture whose unlock calls pv_lock_released() lets its backend
+ * turn the tracking on with pv_init_lock_hint().
+ */
+DECLARE_PER_CPU(unsigned int, pv_locks_held);
+extern void pv_init_lock_hint(void);
+extern void __pv_lock_released(struct qspinlock *lock);
+
+static __always_inline void pv_lock_released(struct qspinlock *lock)
+{
+	if (unlikely(this_cpu_read(pv_locks_held)))
+		__pv_lock_released(lock);
+}
+
+/*
+ * The kicks of halted queue heads done by the lock releases between
+ * pv_kick_batch_start() and pv_kick_batch_end() are deferred and issued
+ * together at the end with pv_kick_cpus(). Preemption has to be disabled
+ * in between.
+ */
+#define pv_kick_batch_start pv_kick_batch_start
+extern void pv_kick_batch_start(void);
+extern void pv_kick_batch_end(void);
+
+/*
+ * Per-cpu adaptive spin threshold data of the PV slowpath
+ */
+struct pv_spin_adapt {
+	u32	threshold;	/* Current spin threshold	*/
+	u32	grow;		/* # of threshold increases	*/
+	u32	shrink;		/* # of threshold decreases	*/
+	u64	wake_ns;	/* Average halt to wakeup time	*/
+};
+
+extern void pv_get_spin_adapt(int cpu, struct pv_spin_adapt *sa);
+
+/*
+ * Per-cpu PV halt and wakeup statistics for the hypervisor backends, see
+ * kernel/locking/qspinlock_pvstat.h.
+ */
+struct dentry;
+extern void pv_lockstat_inc(enum pv_lock_stats type);
+extern void pv_lockstat_blocked(u64 ns);
+extern void pv_lockstat_debugfs(struct dentry *dir);
+
+#ifndef CONFIG_PARAVIRT
+struct pv_lock_ops {
+	/* Halt until kicked, unless the lock byte (if given) is free */
+	void (*lockwait)(u8 *lockbyte);
+	/* Wake up the CPU halted in lockwait() */
+	void (*kick_cpu)(int cpu);
+	/* Wake up a number of halted CPUs at once */
+	void (*kick_cpus)(int *cpus, int nr);
+	/* Count a halt or wakeup event */
+	void (*lockstat)(enum pv_lock_stats type);
+	/* Is the vCPU of the given CPU not running? */
+	bool (*vcpu_is_preempted)(int cpu);
+	/* Directed yield to the given CPU, true if done */
+	bool (*yield_to_cpu)(int cpu);
+	/* Tell the hypervisor which CPU we wait for, -1 for none */
+	void (*wait_for_cpu)(int cpu, bool qhead);
+	/* Tell the hypervisor how many contended locks we hold */
+	void (*lock_held)(int nr);
+};
+
+extern struct pv_lock_ops pv_lock_ops;
+
+static __always_inline void pv_kick_cpu(int cpu)
+{
+	pv_lock_ops.kick_cpu(cpu);
+}
+
+static __always_inline void pv_kick_cpus(int *cpus, int nr)
+{
+	pv_lock_ops.kick_cpus(cpus, nr);
+}
+
+static __always_inline void pv_lockwait(u8 *lockbyte)
+{
+	pv_lock_ops.lockwait(lockbyte);
+}
+
+static __always_inline void pv_lockstat(enum pv_lock_stats type)
+{
+	pv_lock_ops.lockstat(type);
+}
+
+static __always_inline bool pv_vcpu_is_preempted(int cpu)
+{
+	return pv_lock_ops.vcpu_is_preempted(cpu);
+}
+
+static __always_inline bool pv_yield_to_cpu(int cpu)
+{
+	return pv_lock_ops.yield_to_cpu(cpu);
+}
+
+static __always_inline void pv_wait_for_cpu(int cpu, bool qhead)
+{
+	pv_lock_ops.wait_for_cpu(cpu, qhead);
+}
+
+static __always_inline void pv_lock_held(int nr)
+{
+	pv_lock_ops.lock_held(nr);
+}
+#endif /* !CONFIG_PARAVIRT */
+
+#define vcpu_is_preempted(cpu)	pv_vcpu_is_preempted(cpu)
+
+#endif /* __ASM_GENERIC_QSPINLOCK_PARAVIRT_H */
@@ -76,4 +76,21 @@ typedef struct qspinlock {
 #define _Q_LOCKED_VAL		(1U << _Q_LOCKED_OFFSET)
 #define _Q_PENDING_VAL		(1U << _Q_PENDING_OFFSET)
 
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+/*
+ * The PV halt and wakeup events passed to pv_lockstat()
+ */
+enum pv_lock_stats {
+	PV_HALT_QHEAD,		/* Queue head halting	    */
+	PV_HALT_QNODE,		/* Other queue node halting */
+	PV_HALT_ABORT,		/* Halting aborted	    */
+	PV_HALT_REPOLL,		/* Wakeup filtered, halting */
+	PV_WAKE_KICKED,		/* Wakeup by kicking	    */
+	PV_WAKE_SPURIOUS,	/* Spurious wakeup	    */
+	PV_KICK_NOHALT,		/* Kick but CPU not halted  */
+	PV_NMI_WAIT,		/* Back-off wait in NMI	    */
+	PV_NR_LOCK_STATS
+};
+#endif
+
 #endif /* __ASM_GENERIC_QSPINLOCK_TYPES_H */
@@ -182,6 +182,10 @@
 	MEM_KEEP(init.data)						\
 	MEM_KEEP(exit.data)						\
 	*(.data.unlikely)						\
+	. = ALIGN(8);							\
+	VMLINUX_SYMBOL(__start_contended_spinlocks) = .;		\
+	*(.data..contended_spinlock)					\
+	VMLINUX_SYMBOL(__stop_contended_spinlocks) = .;			\
 	STRUCT_ALIGN();							\
 	*(__tracepoints)						\
 	/* implement dynamic printk debug */				\
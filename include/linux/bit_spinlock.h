@@ -12,6 +12,17 @@
  * Don't use this unless you really need to: spin_lock() and spin_unlock()
  * are significantly faster.
  */
+#ifdef CONFIG_QUEUED_BIT_SPINLOCK
+extern void __bit_spin_lock_slowpath(int bitnum, unsigned long *addr);
+
+static inline void bit_spin_lock(int bitnum, unsigned long *addr)
+{
+	preempt_disable();
+	if (unlikely(test_and_set_bit_lock(bitnum, addr)))
+		__bit_spin_lock_slowpath(bitnum, addr);
+	__acquire(bitlock);
+}
+#else
 static inline void bit_spin_lock(int bitnum, unsigned long *addr)
 {
 	/*
@@ -33,6 +44,7 @@ static inline void bit_spin_lock(int bitnum, unsigned long *addr)
 #endif
 	__acquire(bitlock);
 }
+#endif /* CONFIG_QUEUED_BIT_SPINLOCK */
 
 /*
  * Return true if it was acquired
@@ -0,0 +1,73 @@
+#ifndef __LINUX_COMBINING_LOCK_H
+#define __LINUX_COMBINING_LOCK_H
+
+/*
+ * Combining lock
+ *
+ * A queue lock whose critical sections are passed as operations: a CPU
+ * queues an MCS node carrying its operation, and the lock holder runs the
+ * operations queued behind it before releasing the lock. Under contention
+ * a single CPU then runs a whole batch of critical sections with the
+ * protected data hot in its cache, instead of handing the lock and the
+ * data over to each waiter in turn.
+ *
+ * The operations may run on another CPU than the one that queued them,
+ * with preemption disabled, and must not look at the current CPU or task.
+ * The waiters spin with preemption disabled until their operation is done,
+ * so the operation and the data it refers to can live on their stack. A
+ * lock used from interrupts must be run with them disabled, as a spinlock.
+ */
+#include <linux/compiler.h>
+#include <linux/lockdep.h>
+#include <linux/types.h>
+
+struct combining_node;
+
+struct combining_op {
+	void (*func)(struct combining_op *op);
+	bool contended;		/* set while func runs if the op was queued */
+};
+
+struct combining_lock {
+	struct combining_node	*tail;
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+	struct lockdep_map	dep_map;
+#endif
+};
+
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+# define __COMBINING_DEP_MAP_INIT(lockname)	, .dep_map = { .name = #lockname }
+#else
+# define __COMBINING_DEP_MAP_INIT(lockname)
+#endif
+
+#define __COMBINING_LOCK_UNLOCKED(lockname)			\
+	{ .tail = NULL __COMBINING_DEP_MAP_INIT(lockname) }
+
+#define DEFINE_COMBINING_LOCK(x)				\
+	struct combining_lock x = __COMBINING_LOCK_UNLOCKED(x)
+
+extern void __combining_lock_init(struct combining_lock *lock,
+				  const char *name,
+				  struct lock_class_key *key);
+
+#define combining_lock_init(lock)				\
+do {								\
+	static struct lock_class_key __key;			\
+								\
+	__combining_lock_init((lock), #lock, &__key);		\
+} while (0)
+
+extern void combining_lock_run(struct combining_lock *lock,
+			       struct combining_op *op);
+
+/**
+ * combining_lock_is_locked - is the combining lock held or queued on?
+ * @lock: Pointer to the combining lock
+ */
+static inline bool combining_lock_is_locked(struct combining_lock *lock)
+{
+	return ACCESS_ONCE(lock->tail) != NULL;
+}
+
+#endif /* __LINUX_COMBINING_LOCK_H */
@@ -0,0 +1,111 @@
+/*
+ * Elided spinlock
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __LINUX_ELIDED_SPINLOCK_H
+#define __LINUX_ELIDED_SPINLOCK_H
+
+/*
+ * A spinlock whose critical sections are run as hardware transactions
+ * when the CPU supports it, so that the holders of the lock that don't
+ * touch the same data run concurrently. It is meant to be used explicitly
+ * for short critical sections that rarely conflict, hash bucket locks for
+ * example.
+ *
+ * The transaction reads the lock word, so it is aborted whenever the lock
+ * is taken for real, and elision is given up in favour of a normal lock
+ * acquisition if the lock is held. After a failed elision, the lock is
+ * taken normally for the next ELISION_SKIP acquisitions before elision is
+ * tried again, so that the locks whose critical sections keep aborting
+ * don't pay for it all the time.
+ *
+ * The critical sections must not do anything that always aborts, like
+ * I/O or sleeping, and nothing in them may rely on the lock word being
+ * written. Without CONFIG_ELIDED_SPINLOCK or RTM support, an elided
+ * spinlock is a plain spinlock. Lockdep does not see the elided
+ * acquisitions, so elision is not available with the lock debugging.
+ */
+#include <linux/preempt.h>
+#include <linux/spinlock.h>
+
+typedef struct elided_spinlock {
+	spinlock_t	lock;
+#ifdef CONFIG_ELIDED_SPINLOCK
+	int		skip;	/* Acquisitions left without elision */
+#endif
+} elided_spinlock_t;
+
+#define __ELIDED_SPIN_LOCK_UNLOCKED(x)					\
+	{ .lock = __SPIN_LOCK_UNLOCKED(x.lock) }
+
+#define DEFINE_ELIDED_SPINLOCK(x)					\
+	elided_spinlock_t x = __ELIDED_SPIN_LOCK_UNLOCKED(x)
+
+#ifdef CONFIG_ELIDED_SPINLOCK
+#define elided_spin_lock_init(l)					\
+do {									\
+	spin_lock_init(&(l)->lock);					\
+	(l)->skip = 0;							\
+} while (0)
+
+extern bool __elided_spin_begin(elided_spinlock_t *lock);
+extern void __elided_spin_end(void);
+
+static inline void elided_spin_lock(elided_spinlock_t *lock)
+{
+	preempt_disable();
+	if (__elided_spin_begin(lock))
+		return;
+	preempt_enable();
+	spin_lock(&lock->lock);
+}
+
+/*
+ * Inside a transaction the lock can't be held, it would have been
+ * aborted otherwise.
+ */
+static inline void elided_spin_unlock(elided_spinlock_t *lock)
+{
+	if (!spin_is_locked(&lock->lock)) {
+		__elided_spin_end();
+		preempt_enable();
+		return;
+	}
+	spin_unlock(&lock->lock);
+}
+#else
+#define elided_spin_lock_init(l)	spin_lock_init(&(l)->lock)
+
+static inline void elided_spin_lock(elided_spinlock_t *lock)
+{
+	spin_lock(&lock->lock);
+}
+
+static inline void elided_spin_unlock(elided_spinlock_t *lock)
+{
+	spin_unlock(&lock->lock);
+}
+#endif
+
+#define elided_spin_lock_irqsave(lock, flags)		\
+do {							\
+	local_irq_save(flags);				\
+	elided_spin_lock(lock);				\
+} while (0)
+
+#define elided_spin_unlock_irqrestore(lock, flags)	\
+do {							\
+	elided_spin_unlock(lock);			\
+	local_irq_restore(flags);			\
+} while (0)
+
+#endif /* __LINUX_ELIDED_SPINLOCK_H */
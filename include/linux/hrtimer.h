@@ -168,6 +168,10 @@ enum  hrtimer_base_type {
  * @cpu:		cpu number
  * @active_bases:	Bitfield to mark bases with active timers
  * @clock_was_set:	Indicates that clock was set from irq context.
+ * @running:		the timer whose callback is running on this cpu
+ * @rearm:		@running was restarted from its callback
+ * @rearm_expires:	the expiry time requested by that restart
+ * @rearm_delta:	the slack requested by that restart
  * @expires_next:	absolute time of the next event which was scheduled
  *			via clock_set_next_event()
  * @hres_active:	State of high resolution mode
@@ -183,6 +187,10 @@ struct hrtimer_cpu_base {
 	unsigned int			cpu;
 	unsigned int			active_bases;
 	unsigned int			clock_was_set;
+	struct hrtimer			*running;
+	int				rearm;
+	ktime_t				rearm_expires;
+	unsigned long			rearm_delta;
 #ifdef CONFIG_HIGH_RES_TIMERS
 	ktime_t				expires_next;
 	int				hres_active;
@@ -32,6 +32,8 @@ struct ipc_namespace {
 
 	int		sem_ctls[4];
 	int		used_sems;
+	int		sem_multi_lock;
+	atomic_long_t	sem_lock_fallbacks;
 
 	unsigned int	msg_ctlmax;
 	unsigned int	msg_ctlmnb;
@@ -35,6 +35,10 @@ struct pt_regs;
  * @affinity_hint:	hint to user space for preferred irq affinity
  * @affinity_notify:	context for notification of affinity changes
  * @pending_mask:	pending rebalanced interrupts
+ * @fast_cpu:		cpu handling this edge irq without desc->lock, or -1
+ * @fast_last_cpu:	cpu which may still run a lockless handler, or -1
+ * @fast_block:		nesting count of affinity changes forbidding @fast_cpu
+ * @fast_running:	set while the lockless handler runs
  * @threads_oneshot:	bitfield to handle shared oneshot threads
  * @threads_active:	number of irqaction threads currently running
  * @wait_for_threads:	wait queue for sync_irq to wait for threaded handlers
@@ -71,6 +75,10 @@ struct irq_desc {
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_var_t		pending_mask;
 #endif
+	int			fast_cpu;
+	int			fast_last_cpu;
+	unsigned int		fast_block;
+	unsigned int		fast_running;
 #endif
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
@@ -497,8 +497,38 @@ struct transaction_chp_stats_s {
  *    j_state_lock
  *    ->j_list_lock			(journal_unmap_buffer)
  *
+ *    j_list_lock
+ *    ->s_lock				(jbd2_list_shard)
+ *
+ *    jbd_lock_bh_state()
+ *    ->s_lock				(jbd2_journal_dirty_metadata)
+ *
  */
 
+/*
+ * While a transaction is running, its reserved and metadata buffers are
+ * spread over a small number of shards so that handles refiling buffers
+ * from BJ_Reserved to BJ_Metadata do not all serialise on j_list_lock.
+ * The shards are spliced back onto t_reserved_list and t_buffers by
+ * jbd2_journal_merge_shards() once the transaction is locked down for
+ * commit.
+ */
+#define JBD2_LIST_SHARD_BITS	3
+#define JBD2_LIST_SHARDS	(1 << JBD2_LIST_SHARD_BITS)
+
+struct jbd2_list_shard {
+	spinlock_t		s_lock;
+
+	/* Number of buffers on s_buffers [s_lock] */
+	int			s_nr_buffers;
+
+	/* Reserved but not yet modified buffers [s_lock] */
+	struct journal_head	*s_reserved;
+
+	/* Metadata buffers [s_lock] */
+	struct journal_head	*s_buffers;
+} ____cacheline_aligned_in_smp;
+
 struct transaction_s
 {
 	/* Pointer to the journal for this transaction. [no locking] */
@@ -536,13 +566,15 @@ struct transaction_s
 
 	/*
 	 * Doubly-linked circular list of all buffers reserved but not yet
-	 * modified by this transaction [j_list_lock]
+	 * modified by this transaction.  Empty until the shards have been
+	 * merged at commit time. [j_list_lock]
 	 */
 	struct journal_head	*t_reserved_list;
 
 	/*
 	 * Doubly-linked circular list of all metadata buffers owned by this
-	 * transaction [j_list_lock]
+	 * transaction.  Empty until the shards have been merged at commit
+	 * time. [j_list_lock]
 	 */
 	struct journal_head	*t_buffers;
 
@@ -651,6 +683,16 @@ struct transaction_s
 	 * structures associated with the transaction
 	 */
 	struct list_head	t_private_list;
+
+	/*
+	 * Set while BJ_Reserved and BJ_Metadata buffers are filed on
+	 * t_shards rather than on t_reserved_list and t_buffers.  Cleared
+	 * under j_list_lock by jbd2_journal_merge_shards(). [j_list_lock]
+	 */
+	int			t_sharded;
+
+	/* Per-shard reserved and metadata lists while t_sharded is set */
+	struct jbd2_list_shard	t_shards[JBD2_LIST_SHARDS];
 };
 
 struct transaction_run_stats_s {
@@ -1020,6 +1062,7 @@ extern void jbd2_journal_refile_buffer(journal_t *, struct journal_head *);
 extern void __jbd2_journal_file_buffer(struct journal_head *, transaction_t *, int);
 extern void __journal_free_buffer(struct journal_head *bh);
 extern void jbd2_journal_file_buffer(struct journal_head *, transaction_t *, int);
+extern void jbd2_journal_merge_shards(transaction_t *);
 extern void __journal_clean_data_list(transaction_t *transaction);
 static inline void jbd2_file_log_bh(struct list_head *head, struct buffer_head *bh)
 {
@@ -687,6 +687,15 @@ static inline bool kvm_arch_has_noncoherent_dma(struct kvm *kvm)
 }
 #endif
 
+#ifdef __KVM_HAVE_ARCH_SPIN_YIELD
+bool kvm_arch_vcpu_spin_yield(struct kvm_vcpu *me);
+#else
+static inline bool kvm_arch_vcpu_spin_yield(struct kvm_vcpu *me)
+{
+	return false;
+}
+#endif
+
 static inline wait_queue_head_t *kvm_arch_vcpu_wq(struct kvm_vcpu *vcpu)
 {
 #ifdef __KVM_HAVE_ARCH_WQP
@@ -23,6 +23,7 @@
 #include <linux/lockdep.h>
 #include <linux/percpu.h>
 #include <linux/cpu.h>
+#include <linux/mutex.h>
 #include <linux/notifier.h>
 
 #ifdef CONFIG_SMP
@@ -59,6 +60,63 @@ void lg_local_unlock_cpu(struct lglock *lg, int cpu);
 void lg_global_lock(struct lglock *lg);
 void lg_global_unlock(struct lglock *lg);
 
+/*
+ * lglock variant with a constant time global lock for machines with many
+ * CPUs, where taking the lock of every CPU in turn gets very slow.
+ *
+ * The global lock raises a counter and waits for an RCU-sched grace
+ * period, after which all the local lockers see it and go into a slowpath
+ * that also read-locks an rwlock. The global lock then only has to take
+ * that rwlock for write. The local lockers that raced with the counter
+ * are done by the end of the grace period, as they hold preemption
+ * disabled all along. The grace period is skipped by a global locker if
+ * the counter has stayed up since the last one.
+ *
+ * The local lock is a per-CPU spinlock as with the plain lglock, and its
+ * fastpath doesn't touch any shared cacheline. The global lock may sleep.
+ */
+struct lglock_rcu_cpu {
+	arch_spinlock_t	lock;
+	bool		slow;	/* Taken in the slowpath */
+};
+
+struct lglock_rcu {
+	struct lglock_rcu_cpu __percpu *lock;
+	atomic_t	global;	/* Global lockers, holding or waiting */
+	bool		synced;	/* Grace period done for the global lockers */
+	struct mutex	mutex;	/* Serializes the global lockers */
+	arch_rwlock_t	rwlock;
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+	struct lock_class_key lock_key;
+	struct lockdep_map    lock_dep_map;
+#endif
+};
+
+#define __LGLOCK_RCU_INIT(name) {					\
+	.lock	= &name ## _lock,					\
+	.global	= ATOMIC_INIT(0),					\
+	.mutex	= __MUTEX_INITIALIZER(name.mutex),			\
+	.rwlock	= __ARCH_RW_LOCK_UNLOCKED,				\
+}
+
+#define DEFINE_LGLOCK_RCU(name)						\
+	static DEFINE_PER_CPU(struct lglock_rcu_cpu, name ## _lock)	\
+	= { .lock = __ARCH_SPIN_LOCK_UNLOCKED };			\
+	struct lglock_rcu name = __LGLOCK_RCU_INIT(name)
+
+#define DEFINE_STATIC_LGLOCK_RCU(name)					\
+	static DEFINE_PER_CPU(struct lglock_rcu_cpu, name ## _lock)	\
+	= { .lock = __ARCH_SPIN_LOCK_UNLOCKED };			\
+	static struct lglock_rcu name = __LGLOCK_RCU_INIT(name)
+
+void lg_rcu_lock_init(struct lglock_rcu *lg, char *name);
+void lg_rcu_local_lock(struct lglock_rcu *lg);
+void lg_rcu_local_unlock(struct lglock_rcu *lg);
+void lg_rcu_local_lock_cpu(struct lglock_rcu *lg, int cpu);
+void lg_rcu_local_unlock_cpu(struct lglock_rcu *lg, int cpu);
+void lg_rcu_global_lock(struct lglock_rcu *lg);
+void lg_rcu_global_unlock(struct lglock_rcu *lg);
+
 #else
 /* When !CONFIG_SMP, map lglock to spinlock */
 #define lglock spinlock
@@ -71,6 +129,17 @@ void lg_global_unlock(struct lglock *lg);
 #define lg_local_unlock_cpu(lg, cpu) spin_unlock(lg)
 #define lg_global_lock spin_lock
 #define lg_global_unlock spin_unlock
+
+#define lglock_rcu spinlock
+#define DEFINE_LGLOCK_RCU(name) DEFINE_SPINLOCK(name)
+#define DEFINE_STATIC_LGLOCK_RCU(name) static DEFINE_SPINLOCK(name)
+#define lg_rcu_lock_init(lg, name) spin_lock_init(lg)
+#define lg_rcu_local_lock spin_lock
+#define lg_rcu_local_unlock spin_unlock
+#define lg_rcu_local_lock_cpu(lg, cpu) spin_lock(lg)
+#define lg_rcu_local_unlock_cpu(lg, cpu) spin_unlock(lg)
+#define lg_rcu_global_lock spin_lock
+#define lg_rcu_global_unlock spin_unlock
 #endif
 
 #endif
@@ -28,16 +28,45 @@ struct list_lru_node {
 	long			nr_items;
 } ____cacheline_aligned_in_smp;
 
+/*
+ * Per-cpu cache of the items added to a list_lru set up with
+ * list_lru_init_pcp(). The items are moved to their node lists in batches,
+ * so that adding and deleting an item that doesn't live long on the lru
+ * doesn't take the node lock at all. An item on the cache has its next
+ * pointer set to LIST_LRU_PCP_POISON and its prev pointer to the cpu, and
+ * must only be touched through list_lru_del(). The cached items aren't
+ * counted until they reach the node lists; list_lru_walk_node() moves them
+ * there first.
+ */
+#define LIST_LRU_PCP_BATCH	16
+
+struct list_lru_pcp {
+	spinlock_t		lock;
+	unsigned int		nr;
+	struct list_head	*items[LIST_LRU_PCP_BATCH];
+};
+
 struct list_lru {
 	struct list_lru_node	*node;
+	struct list_lru_pcp __percpu *pcp;
 	nodemask_t		active_nodes;
 };
 
 void list_lru_destroy(struct list_lru *lru);
-int list_lru_init_key(struct list_lru *lru, struct lock_class_key *key);
+int __list_lru_init(struct list_lru *lru, struct lock_class_key *key,
+		    bool pcp);
+static inline int list_lru_init_key(struct list_lru *lru,
+				    struct lock_class_key *key)
+{
+	return __list_lru_init(lru, key, false);
+}
 static inline int list_lru_init(struct list_lru *lru)
 {
-	return list_lru_init_key(lru, NULL);
+	return __list_lru_init(lru, NULL, false);
+}
+static inline int list_lru_init_pcp(struct list_lru *lru)
+{
+	return __list_lru_init(lru, NULL, true);
 }
 
 /**
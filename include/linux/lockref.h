@@ -37,9 +37,15 @@ extern void lockref_get(struct lockref *);
 extern int lockref_get_not_zero(struct lockref *);
 extern int lockref_get_or_lock(struct lockref *);
 extern int lockref_put_or_lock(struct lockref *);
+extern int lockref_put_return(struct lockref *);
+
+extern void lockref_get_many(struct lockref *, unsigned int);
+extern int lockref_put_many_or_lock(struct lockref *, unsigned int);
 
 extern void lockref_mark_dead(struct lockref *);
 extern int lockref_get_not_dead(struct lockref *);
+extern int lockref_get_many_not_dead(struct lockref *, unsigned int);
+extern int lockref_get_not_dead_chain(struct lockref **, int);
 
 /* Must be called under spinlock for reliable results */
 static inline int __lockref_is_dead(const struct lockref *l)
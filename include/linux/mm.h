@@ -1592,6 +1592,48 @@ static inline spinlock_t *pmd_lock(struct mm_struct *mm, pmd_t *pmd)
 	return ptl;
 }
 
+/*
+ * The pmd tables are installed under the lock of the pud table they are
+ * installed in, so that the page faults populating different parts of
+ * the address space don't serialize on mm->page_table_lock. The kernel
+ * pud tables aren't allocated with pud_alloc_one(), the callers use
+ * mm->page_table_lock for init_mm.
+ */
+#if USE_SPLIT_PUD_PTLOCKS
+
+static struct page *pud_to_page(pud_t *pud)
+{
+	unsigned long mask = ~(PTRS_PER_PUD * sizeof(pud_t) - 1);
+	return virt_to_page((void *)((unsigned long) pud & mask));
+}
+
+static inline spinlock_t *pud_lockptr(struct mm_struct *mm, pud_t *pud)
+{
+	return ptlock_ptr(pud_to_page(pud));
+}
+
+static inline bool pgtable_pud_page_ctor(struct page *page)
+{
+	return ptlock_init(page);
+}
+
+static inline void pgtable_pud_page_dtor(struct page *page)
+{
+	ptlock_free(page);
+}
+
+#else
+
+static inline spinlock_t *pud_lockptr(struct mm_struct *mm, pud_t *pud)
+{
+	return &mm->page_table_lock;
+}
+
+static inline bool pgtable_pud_page_ctor(struct page *page) { return true; }
+static inline void pgtable_pud_page_dtor(struct page *page) {}
+
+#endif
+
 extern void free_area_init(unsigned long * zones_size);
 extern void free_area_init_node(int nid, unsigned long * zones_size,
 		unsigned long zone_start_pfn, unsigned long *zholes_size);
@@ -6,6 +6,7 @@
 
 #include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/wait.h>
 #include <linux/bitops.h>
 #include <linux/cache.h>
@@ -468,6 +469,8 @@ struct zone {
 
 	/* Write-intensive fields used from the page allocator */
 	spinlock_t		lock;
+	/* Bulk pcp free and refill requests of the CPUs waiting for lock */
+	struct llist_head	lock_requests;
 
 	/* free areas of different sizes */
 	struct free_area	free_area[MAX_ORDER];
@@ -481,6 +484,8 @@ struct zone {
 
 	/* Fields commonly accessed by the page reclaim scanner */
 	spinlock_t		lru_lock;
+	/* Pagevec moves of the CPUs waiting for lru_lock */
+	struct llist_head	lru_requests;
 	struct lruvec		lruvec;
 
 	/* Evictions & activations on the inactive file list */
@@ -57,6 +57,7 @@ struct mutex {
 #endif
 #ifdef CONFIG_MUTEX_SPIN_ON_OWNER
 	struct optimistic_spin_queue osq; /* Spinner MCS lock */
+	struct task_struct	*handoff; /* Top waiter to hand the lock to */
 #endif
 #ifdef CONFIG_DEBUG_MUTEXES
 	const char 		*name;
@@ -74,6 +75,7 @@ struct mutex {
 struct mutex_waiter {
 	struct list_head	list;
 	struct task_struct	*task;
+	unsigned int		attempts; /* Failed lock attempts */
 #ifdef CONFIG_DEBUG_MUTEXES
 	void			*magic;
 #endif
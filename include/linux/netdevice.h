@@ -2336,7 +2336,6 @@ struct softnet_data {
 	struct softnet_data	*rps_ipi_next;
 	unsigned int		cpu;
 	unsigned int		input_queue_head;
-	unsigned int		input_queue_tail;
 #endif
 	unsigned int		dropped;
 	struct sk_buff_head	input_pkt_queue;
@@ -2345,6 +2344,15 @@ struct softnet_data {
 #ifdef CONFIG_NET_FLOW_LIMIT
 	struct sd_flow_limit __rcu *flow_limit;
 #endif
+#ifdef CONFIG_RPS
+	/*
+	 * The packets steered here by the other CPUs, pushed without a lock
+	 * on a LIFO list of skbs linked by ->next. They get a line of their
+	 * own, only written by the steering CPUs and the backlog poll.
+	 */
+	struct sk_buff		*rps_inbox ____cacheline_aligned_in_smp;
+	atomic_t		input_queue_tail;
+#endif
 };
 
 static inline void input_queue_head_incr(struct softnet_data *sd)
@@ -2358,7 +2366,7 @@ static inline void input_queue_tail_incr_save(struct softnet_data *sd,
 					      unsigned int *qtail)
 {
 #ifdef CONFIG_RPS
-	*qtail = ++sd->input_queue_tail;
+	*qtail = atomic_inc_return(&sd->input_queue_tail);
 #endif
 }
 
@@ -3363,6 +3371,7 @@ void netdev_stats_to_stats64(struct rtnl_link_stats64 *stats64,
 extern int		netdev_max_backlog;
 extern int		netdev_tstamp_prequeue;
 extern int		weight_p;
+extern int		sysctl_qdisc_combining;
 extern int		bpf_jit_enable;
 
 bool netdev_has_upper_dev(struct net_device *dev, struct net_device *upper_dev);
@@ -0,0 +1,73 @@
+/*
+ * Per-cpu list
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __LINUX_PERCPU_LIST_H
+#define __LINUX_PERCPU_LIST_H
+
+/*
+ * A list split in one sublist per possible CPU, each with its own lock,
+ * for the unordered sets of objects that are added and removed much
+ * more often than they are walked, like the inodes of a superblock.
+ *
+ * An entry is added to the sublist of the current CPU and records the
+ * lock of that sublist, so that it can be deleted from any CPU later on.
+ * The walkers go through the sublists one after the other with
+ * for_each_pcpu_list(), taking the lock of each in turn; they see all the
+ * entries that were on the list before the walk started and are still on
+ * it, in no particular order.
+ */
+#include <linux/list.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+
+struct pcpu_list_head {
+	struct list_head	list;
+	spinlock_t		lock;
+};
+
+struct pcpu_list_node {
+	struct list_head	list;
+	spinlock_t		*lockptr;	/* Lock of the sublist, if on one */
+};
+
+static inline void init_pcpu_list_node(struct pcpu_list_node *node)
+{
+	INIT_LIST_HEAD(&node->list);
+	node->lockptr = NULL;
+}
+
+static inline bool pcpu_list_node_empty(struct pcpu_list_node *node)
+{
+	return !ACCESS_ONCE(node->lockptr);
+}
+
+/**
+ * for_each_pcpu_list - iterate over the sublists of a per-cpu list
+ * @ph:		&struct pcpu_list_head pointer to the current sublist
+ * @head:	the per-cpu list
+ * @cpu:	int cursor
+ *
+ * The caller takes and releases @ph->lock around the walk of @ph->list.
+ */
+#define for_each_pcpu_list(ph, head, cpu)				\
+	for_each_possible_cpu(cpu)					\
+		if (((ph) = per_cpu_ptr(head, cpu)), 0) {} else
+
+extern int alloc_pcpu_list_head(struct pcpu_list_head __percpu **phead);
+extern void free_pcpu_list_head(struct pcpu_list_head __percpu **phead);
+extern bool pcpu_list_empty(struct pcpu_list_head __percpu *head);
+extern void pcpu_list_add(struct pcpu_list_node *node,
+			  struct pcpu_list_head __percpu *head);
+extern void pcpu_list_del(struct pcpu_list_node *node);
+
+#endif /* __LINUX_PERCPU_LIST_H */
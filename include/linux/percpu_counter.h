@@ -7,6 +7,7 @@
  */
 
 #include <linux/spinlock.h>
+#include <linux/combining_lock.h>
 #include <linux/smp.h>
 #include <linux/list.h>
 #include <linux/threads.h>
@@ -16,9 +17,18 @@
 
 #ifdef CONFIG_SMP
 
+/*
+ * The batch is scaled up by 1 << batch_shift while the folds into count
+ * find the lock contended, and back down when they stop finding it.
+ */
+#define PERCPU_COUNTER_SHIFT_MAX	4
+
 struct percpu_counter {
-	raw_spinlock_t lock;
+	struct combining_lock lock;	/* serializes the updates of count */
 	s64 count;
+	u8 batch_shift;
+	u8 batch_shift_max;	/* largest batch_shift used so far */
+	u8 folds_uncontended;
 #ifdef CONFIG_HOTPLUG_CPU
 	struct list_head list;	/* All percpu_counters are on a list */
 #endif
@@ -41,6 +51,7 @@ void percpu_counter_destroy(struct percpu_counter *fbc);
 void percpu_counter_set(struct percpu_counter *fbc, s64 amount);
 void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch);
 s64 __percpu_counter_sum(struct percpu_counter *fbc);
+s64 percpu_counter_sum_approx(struct percpu_counter *fbc);
 int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs);
 
 static inline void percpu_counter_add(struct percpu_counter *fbc, s64 amount)
@@ -154,6 +165,11 @@ static inline s64 percpu_counter_sum(struct percpu_counter *fbc)
 	return percpu_counter_read(fbc);
 }
 
+static inline s64 percpu_counter_sum_approx(struct percpu_counter *fbc)
+{
+	return percpu_counter_read(fbc);
+}
+
 static inline int percpu_counter_initialized(struct percpu_counter *fbc)
 {
 	return 1;
@@ -1,6 +1,7 @@
 #ifndef _LINUX_PID_H
 #define _LINUX_PID_H
 
+#include <linux/list_bl.h>
 #include <linux/rcupdate.h>
 
 enum pid_type
@@ -51,7 +52,7 @@ struct upid {
 	/* Try to keep pid_chain in the same cacheline as nr for find_vpid */
 	int nr;
 	struct pid_namespace *ns;
-	struct hlist_node pid_chain;
+	struct hlist_bl_node pid_chain;
 };
 
 struct pid
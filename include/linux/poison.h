@@ -22,6 +22,9 @@
 #define LIST_POISON1  ((void *) 0x00100100 + POISON_POINTER_DELTA)
 #define LIST_POISON2  ((void *) 0x00200200 + POISON_POINTER_DELTA)
 
+/* Item on a per-cpu list_lru cache, see mm/list_lru.c */
+#define LIST_LRU_PCP_POISON  ((void *) 0x00300300 + POISON_POINTER_DELTA)
+
 /********** include/linux/timer.h **********/
 /*
  * Magic number "tsta" to indicate a static timer initializer
@@ -0,0 +1,153 @@
+/*
+ * 64-bit queue spinlock
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __LINUX_QSPINLOCK64_H
+#define __LINUX_QSPINLOCK64_H
+
+/*
+ * With CONFIG_NR_CPUS >= 16K, the 32-bit queue spinlock has to shrink the
+ * pending field to a single bit, and the pending to locked handoff as well
+ * as the tail exchange become cmpxchg loops. The 64-bit queue spinlock
+ * keeps byte sized locked and pending fields and a full 32-bit tail for
+ * any number of CPUs so that the byte store and the xchg paths can always
+ * be used. It is meant to be used explicitly for selected hot locks on
+ * very large systems where the size growth is acceptable.
+ *
+ * The lock word layout is:
+ *
+ *  0- 7: locked byte
+ *  8-15: pending byte
+ * 16-31: unused
+ * 32-33: tail index
+ * 34-63: tail cpu (+1)
+ */
+#include <linux/atomic.h>
+#include <linux/irqflags.h>
+#include <linux/preempt.h>
+#include <linux/types.h>
+#include <asm/byteorder.h>
+
+typedef struct qspinlock64 {
+	atomic64_t	val;
+} qspinlock64_t;
+
+#define	_Q64_LOCKED_VAL		1ULL
+#define	_Q64_PENDING_VAL	(1ULL << 8)
+#define	_Q64_LOCKED_MASK	0xffULL
+#define	_Q64_PENDING_MASK	(0xffULL << 8)
+#define	_Q64_TAIL_OFFSET	32
+#define	_Q64_TAIL_IDX_BITS	2
+#define	_Q64_TAIL_MASK		(~0ULL << _Q64_TAIL_OFFSET)
+
+#ifdef __LITTLE_ENDIAN
+#define	_Q64_LOCKED_BYTE	0
+#else
+#define	_Q64_LOCKED_BYTE	7
+#endif
+
+#define	__QSPINLOCK64_UNLOCKED	{ ATOMIC64_INIT(0) }
+#define	DEFINE_QSPINLOCK64(x)	qspinlock64_t x = __QSPINLOCK64_UNLOCKED
+
+extern void queue_spin_lock64_slowpath(struct qspinlock64 *lock, u64 val);
+
+static inline void qspinlock64_init(struct qspinlock64 *lock)
+{
+	atomic64_set(&lock->val, 0);
+}
+
+/**
+ * queue_spin_is_locked64 - is the 64-bit queue spinlock locked?
+ * @lock: Pointer to the 64-bit queue spinlock structure
+ * Return: 1 if it is locked, 0 otherwise
+ */
+static __always_inline int queue_spin_is_locked64(struct qspinlock64 *lock)
+{
+	return atomic64_read(&lock->val) != 0;
+}
+
+/**
+ * queue_spin_trylock64 - try to acquire the 64-bit queue spinlock
+ * @lock: Pointer to the 64-bit queue spinlock structure
+ * Return: 1 if lock acquired, 0 if failed
+ */
+static __always_inline int queue_spin_trylock64(struct qspinlock64 *lock)
+{
+	if (!atomic64_read(&lock->val) &&
+	   (atomic64_cmpxchg(&lock->val, 0, _Q64_LOCKED_VAL) == 0))
+		return 1;
+	return 0;
+}
+
+/**
+ * queue_spin_lock64 - acquire the 64-bit queue spinlock
+ * @lock: Pointer to the 64-bit queue spinlock structure
+ */
+static __always_inline void queue_spin_lock64(struct qspinlock64 *lock)
+{
+	u64 val;
+
+	val = atomic64_cmpxchg(&lock->val, 0, _Q64_LOCKED_VAL);
+	if (likely(val == 0))
+		return;
+	queue_spin_lock64_slowpath(lock, val);
+}
+
+/**
+ * queue_spin_unlock64 - release the 64-bit queue spinlock
+ * @lock: Pointer to the 64-bit queue spinlock structure
+ *
+ * An effective smp_store_release() on the locked byte.
+ */
+static __always_inline void queue_spin_unlock64(struct qspinlock64 *lock)
+{
+	smp_store_release((u8 *)lock + _Q64_LOCKED_BYTE, 0);
+}
+
+/*
+ * The lock API with preemption and interrupt handling. Lockdep does not
+ * cover the 64-bit queue spinlock.
+ */
+static inline void qspin_lock64(qspinlock64_t *lock)
+{
+	preempt_disable();
+	queue_spin_lock64(lock);
+}
+
+static inline int qspin_trylock64(qspinlock64_t *lock)
+{
+	preempt_disable();
+	if (queue_spin_trylock64(lock))
+		return 1;
+	preempt_enable();
+	return 0;
+}
+
+static inline void qspin_unlock64(qspinlock64_t *lock)
+{
+	queue_spin_unlock64(lock);
+	preempt_enable();
+}
+
+#define qspin_lock64_irqsave(lock, flags)		\
+do {							\
+	local_irq_save(flags);				\
+	qspin_lock64(lock);				\
+} while (0)
+
+#define qspin_unlock64_irqrestore(lock, flags)		\
+do {							\
+	qspin_unlock64(lock);				\
+	local_irq_restore(flags);			\
+} while (0)
+
+#endif /* __LINUX_QSPINLOCK64_H */
@@ -0,0 +1,83 @@
+#ifndef _LINUX_RANGE_LOCK_H
+#define _LINUX_RANGE_LOCK_H
+
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+
+/*
+ * Range locks: reader/writer locks on ranges of an address space.
+ *
+ * A range lock only excludes holders whose range overlaps its own and
+ * where at least one of the two is a writer, so e.g. page faults in one
+ * region of an mm need not wait for an munmap() of another.  Ranges are
+ * granted in the order they were requested: a new range waits for every
+ * conflicting range queued before it, whether or not that one already
+ * holds the lock, so writers cannot be starved by a stream of readers.
+ */
+struct range_lock_tree {
+	struct rb_root		root;
+	spinlock_t		lock;
+	unsigned long		seq;
+};
+
+struct range_lock {
+	struct rb_node		node;
+	unsigned long		start;		/* first address in range */
+	unsigned long		last;		/* last address in range */
+	unsigned long		__subtree_last;
+	unsigned long		seq;		/* queueing order [tree lock] */
+	unsigned int		blocking;	/* ranges we wait for [tree lock] */
+	bool			reader;
+	struct task_struct	*task;
+};
+
+#define RANGE_LOCK_FULL		(~0UL)
+
+#define __RANGE_LOCK_TREE_INITIALIZER(name)			\
+	{ .root = RB_ROOT,					\
+	  .lock = __SPIN_LOCK_UNLOCKED(name.lock) }
+
+#define DEFINE_RANGE_LOCK_TREE(name)				\
+	struct range_lock_tree name = __RANGE_LOCK_TREE_INITIALIZER(name)
+
+static inline void range_lock_tree_init(struct range_lock_tree *tree)
+{
+	tree->root = RB_ROOT;
+	spin_lock_init(&tree->lock);
+	tree->seq = 0;
+}
+
+/* Describe the range [@start, @last], both ends inclusive */
+static inline void range_lock_init(struct range_lock *lock,
+				   unsigned long start, unsigned long last)
+{
+	lock->start = start;
+	lock->last = last;
+	lock->blocking = 0;
+	lock->task = NULL;
+}
+
+static inline void range_lock_init_full(struct range_lock *lock)
+{
+	range_lock_init(lock, 0, RANGE_LOCK_FULL);
+}
+
+extern void range_read_lock(struct range_lock_tree *tree,
+			    struct range_lock *lock);
+extern int range_read_lock_killable(struct range_lock_tree *tree,
+				    struct range_lock *lock);
+extern int range_read_trylock(struct range_lock_tree *tree,
+			      struct range_lock *lock);
+extern void range_read_unlock(struct range_lock_tree *tree,
+			      struct range_lock *lock);
+
+extern void range_write_lock(struct range_lock_tree *tree,
+			     struct range_lock *lock);
+extern int range_write_lock_killable(struct range_lock_tree *tree,
+				     struct range_lock *lock);
+extern int range_write_trylock(struct range_lock_tree *tree,
+			       struct range_lock *lock);
+extern void range_write_unlock(struct range_lock_tree *tree,
+			       struct range_lock *lock);
+
+#endif /* _LINUX_RANGE_LOCK_H */
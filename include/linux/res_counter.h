@@ -14,6 +14,7 @@
  */
 
 #include <linux/spinlock.h>
+#include <linux/atomic.h>
 #include <linux/errno.h>
 
 /*
@@ -24,27 +25,32 @@
 
 struct res_counter {
 	/*
-	 * the current resource consumption level
+	 * the current resource consumption level, charged and uncharged
+	 * without taking the lock
 	 */
-	unsigned long long usage;
+	atomic64_t usage;
 	/*
-	 * the maximal value of the usage from the counter creation
+	 * the maximal value of the usage from the counter creation,
+	 * updated racily by the chargers
 	 */
 	unsigned long long max_usage;
 	/*
-	 * the limit that usage cannot exceed
+	 * the limit that usage cannot exceed, read locklessly by the
+	 * chargers and changed under the lock
 	 */
-	unsigned long long limit;
+	atomic64_t limit;
 	/*
 	 * the limit that usage can be exceed
 	 */
 	unsigned long long soft_limit;
 	/*
-	 * the number of unsuccessful attempts to consume the resource
+	 * the number of unsuccessful attempts to consume the resource,
+	 * updated racily by the chargers
 	 */
 	unsigned long long failcnt;
 	/*
-	 * the lock to protect all of the above.
+	 * the lock to serialize changes to the limits and resets of the
+	 * statistics.  Charging and uncharging do not take it.
 	 * the routines below consider this to be IRQ-safe
 	 */
 	spinlock_t lock;
@@ -141,16 +147,12 @@ u64 res_counter_uncharge_until(struct res_counter *counter,
  */
 static inline unsigned long long res_counter_margin(struct res_counter *cnt)
 {
-	unsigned long long margin;
-	unsigned long flags;
+	unsigned long long usage = atomic64_read(&cnt->usage);
+	unsigned long long limit = atomic64_read(&cnt->limit);
 
-	spin_lock_irqsave(&cnt->lock, flags);
-	if (cnt->limit > cnt->usage)
-		margin = cnt->limit - cnt->usage;
-	else
-		margin = 0;
-	spin_unlock_irqrestore(&cnt->lock, flags);
-	return margin;
+	if (limit > usage)
+		return limit - usage;
+	return 0;
 }
 
 /**
@@ -163,16 +165,12 @@ static inline unsigned long long res_counter_margin(struct res_counter *cnt)
 static inline unsigned long long
 res_counter_soft_limit_excess(struct res_counter *cnt)
 {
-	unsigned long long excess;
-	unsigned long flags;
+	unsigned long long usage = atomic64_read(&cnt->usage);
+	unsigned long long soft_limit = ACCESS_ONCE(cnt->soft_limit);
 
-	spin_lock_irqsave(&cnt->lock, flags);
-	if (cnt->usage <= cnt->soft_limit)
-		excess = 0;
-	else
-		excess = cnt->usage - cnt->soft_limit;
-	spin_unlock_irqrestore(&cnt->lock, flags);
-	return excess;
+	if (usage <= soft_limit)
+		return 0;
+	return usage - soft_limit;
 }
 
 static inline void res_counter_reset_max(struct res_counter *cnt)
@@ -180,7 +178,7 @@ static inline void res_counter_reset_max(struct res_counter *cnt)
 	unsigned long flags;
 
 	spin_lock_irqsave(&cnt->lock, flags);
-	cnt->max_usage = cnt->usage;
+	cnt->max_usage = atomic64_read(&cnt->usage);
 	spin_unlock_irqrestore(&cnt->lock, flags);
 }
 
@@ -193,16 +191,26 @@ static inline void res_counter_reset_failcnt(struct res_counter *cnt)
 	spin_unlock_irqrestore(&cnt->lock, flags);
 }
 
+/*
+ * Chargers do not take the lock, so a charge can race with the limit
+ * being lowered below the new usage.  Publish the new limit first and
+ * check the usage afterwards: a charger either sees the new limit, or
+ * its charge is visible here and the old limit is put back.
+ */
 static inline int res_counter_set_limit(struct res_counter *cnt,
 		unsigned long long limit)
 {
+	unsigned long long old;
 	unsigned long flags;
 	int ret = -EBUSY;
 
 	spin_lock_irqsave(&cnt->lock, flags);
-	if (cnt->usage <= limit) {
-		cnt->limit = limit;
-		ret = 0;
+	if (atomic64_read(&cnt->usage) <= limit) {
+		old = atomic64_xchg(&cnt->limit, limit);
+		if (atomic64_read(&cnt->usage) <= limit)
+			ret = 0;
+		else
+			atomic64_set(&cnt->limit, old);
 	}
 	spin_unlock_irqrestore(&cnt->lock, flags);
 	return ret;
@@ -36,6 +36,19 @@ struct anon_vma {
 	 */
 	atomic_t refcount;
 
+	/*
+	 * Count of child anon_vmas, i.e. of all anon_vmas whose ->parent
+	 * points to this one, including itself for a root.  Used together
+	 * with num_active_vmas to decide whether fork can reuse this
+	 * anon_vma instead of allocating a new one, see anon_vma_clone().
+	 * [root->rwsem]
+	 */
+	unsigned long num_children;
+	/* Count of VMAs whose ->anon_vma points to this one [root->rwsem] */
+	unsigned long num_active_vmas;
+
+	struct anon_vma *parent;	/* Parent of this anon_vma */
+
 	/*
 	 * NOTE: the LSB of the rb_root.rb_node is set by
 	 * mm_take_all_locks() _after_ taking the above lock. So the
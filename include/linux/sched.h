@@ -462,6 +462,7 @@ struct sighand_struct {
 	atomic_t		count;
 	struct k_sigaction	action[_NSIG];
 	spinlock_t		siglock;
+	seqcount_t		action_seq;	/* action[] writes, under siglock */
 	wait_queue_head_t	signalfd_wqh;
 };
 
@@ -1225,6 +1226,43 @@ union rcu_special {
 };
 struct rcu_node;
 
+/*
+ * Wake-queues are lists of tasks with a pending wakeup, whose callers have
+ * already done the state change and the checks under a lock, and want to
+ * issue the wakeups only once that lock has been released:
+ *
+ *	WAKE_Q(wake_q);
+ *
+ *	spin_lock(&lock);
+ *	...
+ *	wake_q_add(&wake_q, task);
+ *	...
+ *	spin_unlock(&lock);
+ *
+ *	wake_up_q(&wake_q);
+ *
+ * A task can only be on one wake-queue at a time: when it is already
+ * queued by someone else, wake_q_add() leaves it there, and that other
+ * waker's wakeup will do. The queue holds a reference on the tasks.
+ */
+struct wake_q_node {
+	struct wake_q_node *next;
+};
+
+struct wake_q_head {
+	struct wake_q_node *first;
+	struct wake_q_node **lastp;
+};
+
+#define WAKE_Q_TAIL ((struct wake_q_node *) 0x01)
+
+#define WAKE_Q(name)					\
+	struct wake_q_head name = { WAKE_Q_TAIL, &name.first }
+
+extern void wake_q_add(struct wake_q_head *head,
+		       struct task_struct *task);
+extern void wake_up_q(struct wake_q_head *head);
+
 enum perf_event_task_context {
 	perf_invalid_context = -1,
 	perf_hw_context = 0,
@@ -1423,6 +1461,8 @@ struct task_struct {
 	sigset_t blocked, real_blocked;
 	sigset_t saved_sigmask;	/* restored if set_restore_sigmask() was used */
 	struct sigpending pending;
+	/* thread-directed kernel signals queued without siglock */
+	unsigned long sigfast_pending;
 
 	unsigned long sas_ss_sp;
 	size_t sas_ss_size;
@@ -1448,6 +1488,8 @@ struct task_struct {
 	/* Protection of the PI data structures: */
 	raw_spinlock_t pi_lock;
 
+	struct wake_q_node wake_q;
+
 #ifdef CONFIG_RT_MUTEXES
 	/* PI waiters blocked on a rt_mutex held by this task */
 	struct rb_root pi_waiters;
@@ -2949,6 +2991,15 @@ static inline void set_task_cpu(struct task_struct *p, unsigned int cpu)
 
 #endif /* CONFIG_SMP */
 
+/*
+ * Is the virtual CPU of the given CPU currently not running on the host?
+ * Optimistic spinners use it to stop waiting for a preempted lock owner.
+ * Architectures with PV spinlocks override it.
+ */
+#ifndef vcpu_is_preempted
+# define vcpu_is_preempted(cpu)	false
+#endif
+
 extern long sched_setaffinity(pid_t pid, const struct cpumask *new_mask);
 extern long sched_getaffinity(pid_t pid, struct cpumask *mask);
 
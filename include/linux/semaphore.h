@@ -9,21 +9,33 @@
 #ifndef __LINUX_SEMAPHORE_H
 #define __LINUX_SEMAPHORE_H
 
+#include <linux/atomic.h>
 #include <linux/list.h>
+#include <linux/osq_lock.h>
 #include <linux/spinlock.h>
 
 /* Please don't access any members of this structure directly */
 struct semaphore {
+	atomic_t		count;
 	raw_spinlock_t		lock;
-	unsigned int		count;
 	struct list_head	wait_list;
+#ifdef CONFIG_SEMAPHORE_SPIN
+	struct optimistic_spin_queue osq; /* Spinner MCS lock */
+#endif
 };
 
+#ifdef CONFIG_SEMAPHORE_SPIN
+#define __SEMAPHORE_OPT_INIT(name)	, .osq = OSQ_LOCK_UNLOCKED
+#else
+#define __SEMAPHORE_OPT_INIT(name)
+#endif
+
 #define __SEMAPHORE_INITIALIZER(name, n)				\
 {									\
+	.count		= ATOMIC_INIT(n),				\
 	.lock		= __RAW_SPIN_LOCK_UNLOCKED((name).lock),	\
-	.count		= n,						\
-	.wait_list	= LIST_HEAD_INIT((name).wait_list),		\
+	.wait_list	= LIST_HEAD_INIT((name).wait_list)		\
+	__SEMAPHORE_OPT_INIT(name)					\
 }
 
 #define DEFINE_SEMAPHORE(name)	\
@@ -194,4 +194,8 @@ extern struct hlist_node *seq_hlist_start_percpu(struct hlist_head __percpu *hea
 
 extern struct hlist_node *seq_hlist_next_percpu(void *v, struct hlist_head __percpu *head, int *cpu, loff_t *pos);
 
+extern struct hlist_node *seq_hlist_start_percpu_rcu(struct hlist_head __percpu *head, int *cpu, loff_t pos);
+
+extern struct hlist_node *seq_hlist_next_percpu_rcu(void *v, struct hlist_head __percpu *head, int *cpu, loff_t *pos);
+
 #endif
@@ -419,6 +419,106 @@ static inline void done_seqretry(seqlock_t *lock, int seq)
 		read_sequnlock_excl(lock);
 }
 
+/*
+ * Adaptive readers
+ *
+ * Like read_seqbegin_or_lock(), but the reader retries optimistically up to
+ * SEQLOCK_READ_MAX_RETRIES times before taking the lock, and only once if
+ * its call site has been retrying a lot lately. The call site keeps a
+ * decaying average of the retries of its reads, which is only updated by
+ * the reads that retried or while it is not back to zero, and the counts
+ * shown in the debugfs file seqlock_sites.
+ *
+ * Expected usage:
+ *	static DEFINE_SEQLOCK_SITE(site);
+ *	struct seqlock_read sr = SEQLOCK_READ_INIT;
+ *
+ *	do {
+ *		read_seqbegin_adaptive(&foo, &sr);
+ *		...
+ *	} while (read_seqretry_adaptive(&foo, &sr, &site));
+ *	done_seqretry_adaptive(&foo, &sr, &site);
+ *
+ * The sites are never unregistered, so this is for built-in code only.
+ */
+#define SEQLOCK_READ_MAX_RETRIES	4
+#define SEQLOCK_RATE_SHIFT		3	/* average over ~8 reads */
+#define SEQLOCK_RATE_LOCK		(2 << SEQLOCK_RATE_SHIFT)
+
+struct seqlock_site {
+	const char		*func;
+	int			line;
+	unsigned int		rate;		/* retries per read << SHIFT */
+	struct seqlock_site	*next;		/* on the list of the sites */
+	int			registered;
+	atomic_long_t		retried;	/* reads that retried */
+	atomic_long_t		retries;
+	atomic_long_t		locked;		/* reads that took the lock */
+};
+
+#define DEFINE_SEQLOCK_SITE(x)						\
+	struct seqlock_site x = { .func = __func__, .line = __LINE__ }
+
+struct seqlock_read {
+	int		seq;		/* odd once the lock is taken */
+	unsigned int	retries;
+};
+
+#define SEQLOCK_READ_INIT	{ .seq = 0, .retries = 0 }
+
+extern void seqlock_site_account(struct seqlock_site *site,
+				 struct seqlock_read *sr);
+
+static inline bool seqlock_read_locked(struct seqlock_read *sr)
+{
+	return sr->seq & 1;
+}
+
+static inline void read_seqbegin_adaptive(seqlock_t *lock,
+					  struct seqlock_read *sr)
+{
+	if (!seqlock_read_locked(sr))
+		sr->seq = read_seqbegin(lock);
+	else
+		read_seqlock_excl(lock);
+}
+
+/**
+ * seqlock_read_retry - account for a failed optimistic read
+ * @sr  : The state of the read
+ * @site: The call site of the read
+ *
+ * Make the next read_seqbegin_adaptive() take the lock if the read retried
+ * too often, or if the site keeps retrying.
+ */
+static inline void seqlock_read_retry(struct seqlock_read *sr,
+				      struct seqlock_site *site)
+{
+	if (++sr->retries >= SEQLOCK_READ_MAX_RETRIES ||
+	    ACCESS_ONCE(site->rate) >= SEQLOCK_RATE_LOCK)
+		sr->seq = 1;
+}
+
+static inline bool read_seqretry_adaptive(seqlock_t *lock,
+					  struct seqlock_read *sr,
+					  struct seqlock_site *site)
+{
+	if (seqlock_read_locked(sr) || !read_seqretry(lock, sr->seq))
+		return false;
+	seqlock_read_retry(sr, site);
+	return true;
+}
+
+static inline void done_seqretry_adaptive(seqlock_t *lock,
+					  struct seqlock_read *sr,
+					  struct seqlock_site *site)
+{
+	if (seqlock_read_locked(sr))
+		read_sequnlock_excl(lock);
+	if (unlikely(sr->retries || ACCESS_ONCE(site->rate)))
+		seqlock_site_account(site, sr);
+}
+
 static inline void read_seqlock_excl_bh(seqlock_t *sl)
 {
 	spin_lock_bh(&sl->lock);
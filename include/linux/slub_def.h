@@ -68,6 +68,7 @@ struct kmem_cache {
 	int object_size;	/* The size of an object without meta data */
 	int offset;		/* Free pointer offset. */
 	int cpu_partial;	/* Number of per cpu partial objects to keep around */
+	int cpu_partial_shift;	/* cpu_partial boost under list_lock contention */
 	struct kmem_cache_order_objects oo;
 
 	/* Allocation and freeing of slabs */
@@ -50,6 +50,9 @@ void on_each_cpu_cond(bool (*cond_func)(int cpu, void *info),
 
 int smp_call_function_single_async(int cpu, struct call_single_data *csd);
 
+int smp_call_function_batch(int cpu, struct call_single_data *csd,
+			    unsigned int nr, int wait);
+
 #ifdef CONFIG_SMP
 
 #include <linux/preempt.h>
@@ -89,6 +89,14 @@
 # include <linux/spinlock_up.h>
 #endif
 
+/*
+ * Kick batching around bulk lock releases, only needed by the PV spinlocks
+ */
+#ifndef pv_kick_batch_start
+static inline void pv_kick_batch_start(void) { }
+static inline void pv_kick_batch_end(void) { }
+#endif
+
 #ifdef CONFIG_DEBUG_SPINLOCK
   extern void __raw_spin_lock_init(raw_spinlock_t *lock, const char *name,
 				   struct lock_class_key *key);
@@ -106,7 +114,7 @@ do {								\
 
 #define raw_spin_is_locked(lock)	arch_spin_is_locked(&(lock)->raw_lock)
 
-#ifdef CONFIG_GENERIC_LOCKBREAK
+#ifdef CONFIG_SPIN_LOCKBREAK
 #define raw_spin_is_contended(lock) ((lock)->break_lock)
 #else
 
@@ -146,10 +154,21 @@ do {								\
  */
 #define raw_spin_unlock_wait(lock)	arch_spin_unlock_wait(&(lock)->raw_lock)
 
+/*
+ * The architectures without a bounded wait in their lock slowpath get one
+ * that spins with trylock.
+ */
+#ifndef arch_spin_trylock_for
+#define GENERIC_SPIN_TRYLOCK_FOR
+extern int generic_spin_trylock_for(arch_spinlock_t *lock, u64 cycles);
+#define arch_spin_trylock_for(l, c)	generic_spin_trylock_for(l, c)
+#endif
+
 #ifdef CONFIG_DEBUG_SPINLOCK
  extern void do_raw_spin_lock(raw_spinlock_t *lock) __acquires(lock);
 #define do_raw_spin_lock_flags(lock, flags) do_raw_spin_lock(lock)
  extern int do_raw_spin_trylock(raw_spinlock_t *lock);
+ extern int do_raw_spin_lock_timeout(raw_spinlock_t *lock, u64 cycles);
  extern void do_raw_spin_unlock(raw_spinlock_t *lock) __releases(lock);
 #else
 static inline void do_raw_spin_lock(raw_spinlock_t *lock) __acquires(lock)
@@ -170,6 +189,11 @@ static inline int do_raw_spin_trylock(raw_spinlock_t *lock)
 	return arch_spin_trylock(&(lock)->raw_lock);
 }
 
+static inline int do_raw_spin_lock_timeout(raw_spinlock_t *lock, u64 cycles)
+{
+	return arch_spin_trylock_for(&(lock)->raw_lock, cycles);
+}
+
 static inline void do_raw_spin_unlock(raw_spinlock_t *lock) __releases(lock)
 {
 	arch_spin_unlock(&lock->raw_lock);
@@ -185,8 +209,22 @@ static inline void do_raw_spin_unlock(raw_spinlock_t *lock) __releases(lock)
  */
 #define raw_spin_trylock(lock)	__cond_lock(lock, _raw_spin_trylock(lock))
 
+/*
+ * raw_spin_lock_timeout() waits for the lock for at most the given number
+ * of get_cycles() cycles, returning 1 if it has got it and 0 otherwise.
+ */
+#define raw_spin_lock_timeout(lock, cycles) \
+	__cond_lock(lock, _raw_spin_lock_timeout(lock, cycles))
+
 #define raw_spin_lock(lock)	_raw_spin_lock(lock)
 
+/*
+ * raw_spin_lock_pair() takes two distinct locks without ordering deadlocks
+ * against the other double locks, which take the lock of lower address
+ * first. It tries not to hold one of them while waiting for the other.
+ */
+#define raw_spin_lock_pair(l1, l2)	_raw_spin_lock_pair(l1, l2)
+
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 # define raw_spin_lock_nested(lock, subclass) \
 	_raw_spin_lock_nested(lock, subclass)
@@ -319,6 +357,16 @@ static inline int spin_trylock(spinlock_t *lock)
 	return raw_spin_trylock(&lock->rlock);
 }
 
+static inline int spin_lock_timeout(spinlock_t *lock, u64 cycles)
+{
+	return raw_spin_lock_timeout(&lock->rlock, cycles);
+}
+
+static inline void spin_lock_pair(spinlock_t *l1, spinlock_t *l2)
+{
+	raw_spin_lock_pair(&l1->rlock, &l2->rlock);
+}
+
 #define spin_lock_nested(lock, subclass)			\
 do {								\
 	raw_spin_lock_nested(spinlock_check(lock), subclass);	\
@@ -72,6 +72,9 @@
 #define _raw_read_trylock(lock)			({ __LOCK(lock); 1; })
 #define _raw_write_trylock(lock)			({ __LOCK(lock); 1; })
 #define _raw_spin_trylock_bh(lock)		({ __LOCK_BH(lock); 1; })
+#define _raw_spin_lock_timeout(lock, cycles)	({ __LOCK(lock); 1; })
+#define _raw_spin_lock_pair(l1, l2)		\
+	do { __LOCK(l1); __LOCK(l2); } while (0)
 #define _raw_spin_unlock(lock)			__UNLOCK(lock)
 #define _raw_read_unlock(lock)			__UNLOCK(lock)
 #define _raw_write_unlock(lock)			__UNLOCK(lock)
@@ -15,11 +15,12 @@
 # include <linux/spinlock_types_up.h>
 #endif
 
+#include <linux/cache.h>
 #include <linux/lockdep.h>
 
 typedef struct raw_spinlock {
 	arch_spinlock_t raw_lock;
-#ifdef CONFIG_GENERIC_LOCKBREAK
+#ifdef CONFIG_SPIN_LOCKBREAK
 	unsigned int break_lock;
 #endif
 #ifdef CONFIG_DEBUG_SPINLOCK
@@ -83,6 +84,29 @@ typedef struct spinlock {
 
 #define DEFINE_SPINLOCK(x)	spinlock_t x = __SPIN_LOCK_UNLOCKED(x)
 
+/*
+ * A lock known to be heavily contended, for which the queue spinlock
+ * waiters queue up right away. Only for the locks built into the kernel.
+ */
+#define DEFINE_CONTENDED_SPINLOCK(x)					\
+	spinlock_t x __section(.data..contended_spinlock) =		\
+		__SPIN_LOCK_UNLOCKED(x)
+
+/*
+ * A spinlock on a cacheline of its own, so that the stores of the lock
+ * holder don't bounce the line of the data or of the other hot locks
+ * next to it. The lock is used through its member, spin_lock(&x.lock).
+ */
+typedef struct {
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp spinlock_padded_t;
+
+#define __SPIN_LOCK_PADDED_UNLOCKED(lockname) \
+	(spinlock_padded_t) { .lock = __SPIN_LOCK_INITIALIZER(lockname.lock) }
+
+#define DEFINE_SPINLOCK_PADDED(x) \
+	spinlock_padded_t x = __SPIN_LOCK_PADDED_UNLOCKED(x)
+
 #include <linux/rwlock_types.h>
 
 #endif /* __LINUX_SPINLOCK_TYPES_H */
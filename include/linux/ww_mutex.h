@@ -337,6 +337,13 @@ ww_mutex_lock_slow_interruptible(struct ww_mutex *lock,
 	return ww_mutex_lock_interruptible(lock, ctx);
 }
 
+extern int __must_check ww_mutex_lock_many(struct ww_mutex **locks,
+					   unsigned int count,
+					   struct ww_acquire_ctx *ctx);
+extern int __must_check
+ww_mutex_lock_many_interruptible(struct ww_mutex **locks, unsigned int count,
+				 struct ww_acquire_ctx *ctx);
+
 extern void ww_mutex_unlock(struct ww_mutex *lock);
 
 /**
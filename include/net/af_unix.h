@@ -17,13 +17,14 @@ struct sock *unix_peer_get(struct sock *);
 #define UNIX_HASH_BITS	8
 
 extern unsigned int unix_tot_inflight;
-extern spinlock_t unix_table_lock;
-extern struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
+extern spinlock_t unix_table_locks[2 * UNIX_HASH_SIZE];
+extern struct hlist_nulls_head unix_socket_table[2 * UNIX_HASH_SIZE];
 
 struct unix_address {
 	atomic_t	refcnt;
 	int		len;
 	unsigned int	hash;
+	struct rcu_head	rcu;
 	struct sockaddr_un name[0];
 };
 
@@ -53,6 +54,7 @@ struct unix_sock {
 	struct sock		sk;
 	struct unix_address     *addr;
 	struct path		path;
+	unsigned int		slot;	/* in unix_socket_table */
 	struct mutex		readlock;
 	struct sock		*peer;
 	struct list_head	link;
@@ -276,6 +276,7 @@ static inline void inet_csk_reqsk_queue_add(struct sock *sk,
 
 void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
 				   unsigned long timeout);
+bool inet_csk_reqsk_queue_unlocked(struct sock *sk);
 
 static inline void inet_csk_reqsk_queue_removed(struct sock *sk,
 						struct request_sock *req)
@@ -113,6 +113,10 @@ struct inet_listen_hashbucket {
 	struct hlist_nulls_head	head;
 };
 
+#if defined(CONFIG_DEBUG_FS) && defined(CONFIG_SMP)
+#define INET_EHASH_LOCK_STAT
+#endif
+
 /* This is for listening sockets, thus all sockets which possess wildcards. */
 #define INET_LHTABLE_SIZE	32	/* Yes, really, this is all you need. */
 
@@ -127,6 +131,10 @@ struct inet_hashinfo {
 	spinlock_t			*ehash_locks;
 	unsigned int			ehash_mask;
 	unsigned int			ehash_locks_mask;
+#ifdef INET_EHASH_LOCK_STAT
+	/* Contended acquisitions of each ehash lock, see inet_ehash_lock() */
+	unsigned int			*ehash_locks_contended;
+#endif
 
 	/* Ok, let's try this, I give up, we do need a local binding
 	 * TCP hash as well as the others for fast bind/connect.
@@ -168,53 +176,36 @@ static inline spinlock_t *inet_ehash_lockp(
 	return &hashinfo->ehash_locks[hash & hashinfo->ehash_locks_mask];
 }
 
-static inline int inet_ehash_locks_alloc(struct inet_hashinfo *hashinfo)
+/*
+ * Take the ehash lock of a bucket, for the insertions and removals. The
+ * contended acquisitions are counted for the ehash_locks debugfs file of
+ * the table, if it has one. The counts are racy, they only show how the
+ * contention is distributed over the locks.
+ */
+static inline void inet_ehash_lock(struct inet_hashinfo *hashinfo,
+				   spinlock_t *lock)
 {
-	unsigned int i, size = 256;
-#if defined(CONFIG_PROVE_LOCKING)
-	unsigned int nr_pcpus = 2;
-#else
-	unsigned int nr_pcpus = num_possible_cpus();
-#endif
-	if (nr_pcpus >= 4)
-		size = 512;
-	if (nr_pcpus >= 8)
-		size = 1024;
-	if (nr_pcpus >= 16)
-		size = 2048;
-	if (nr_pcpus >= 32)
-		size = 4096;
-	if (sizeof(spinlock_t) != 0) {
-#ifdef CONFIG_NUMA
-		if (size * sizeof(spinlock_t) > PAGE_SIZE)
-			hashinfo->ehash_locks = vmalloc(size * sizeof(spinlock_t));
-		else
+#ifdef INET_EHASH_LOCK_STAT
+	if (likely(spin_trylock(lock)))
+		return;
+	if (hashinfo->ehash_locks_contended)
+		hashinfo->ehash_locks_contended[lock - hashinfo->ehash_locks]++;
 #endif
-		hashinfo->ehash_locks =	kmalloc(size * sizeof(spinlock_t),
-						GFP_KERNEL);
-		if (!hashinfo->ehash_locks)
-			return ENOMEM;
-		for (i = 0; i < size; i++)
-			spin_lock_init(&hashinfo->ehash_locks[i]);
-	}
-	hashinfo->ehash_locks_mask = size - 1;
-	return 0;
+	spin_lock(lock);
 }
 
-static inline void inet_ehash_locks_free(struct inet_hashinfo *hashinfo)
+int inet_ehash_locks_alloc(struct inet_hashinfo *hashinfo);
+void inet_ehash_locks_free(struct inet_hashinfo *hashinfo);
+
+#ifdef INET_EHASH_LOCK_STAT
+int inet_ehash_locks_debugfs(struct inet_hashinfo *hashinfo, const char *name);
+#else
+static inline int inet_ehash_locks_debugfs(struct inet_hashinfo *hashinfo,
+					   const char *name)
 {
-	if (hashinfo->ehash_locks) {
-#ifdef CONFIG_NUMA
-		unsigned int size = (hashinfo->ehash_locks_mask + 1) *
-							sizeof(spinlock_t);
-		if (size > PAGE_SIZE)
-			vfree(hashinfo->ehash_locks);
-		else
-#endif
-		kfree(hashinfo->ehash_locks);
-		hashinfo->ehash_locks = NULL;
-	}
+	return 0;
 }
+#endif
 
 struct inet_bind_bucket *
 inet_bind_bucket_create(struct kmem_cache *cachep, struct net *net,
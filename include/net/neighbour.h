@@ -166,11 +166,12 @@ struct neigh_ops {
 };
 
 struct pneigh_entry {
-	struct pneigh_entry	*next;
+	struct pneigh_entry __rcu *next;
 #ifdef CONFIG_NET_NS
 	struct net		*net;
 #endif
 	struct net_device	*dev;
+	struct rcu_head		rcu;
 	u8			flags;
 	u8			key[0];
 };
@@ -180,10 +181,12 @@ struct pneigh_entry {
  */
 
 #define NEIGH_NUM_HASH_RND	4
+#define NEIGH_HASH_LOCKS	64
 
 struct neigh_hash_table {
 	struct neighbour __rcu	**hash_buckets;
 	unsigned int		hash_shift;
+	bool			moving;	/* being replaced by a resize */
 	__u32			hash_rnd[NEIGH_NUM_HASH_RND];
 	struct rcu_head		rcu;
 };
@@ -216,7 +219,8 @@ struct neigh_table {
 	unsigned long		last_rand;
 	struct neigh_statistics	__percpu *stats;
 	struct neigh_hash_table __rcu *nht;
-	struct pneigh_entry	**phash_buckets;
+	spinlock_t		hash_locks[NEIGH_HASH_LOCKS];
+	struct pneigh_entry __rcu **phash_buckets;
 };
 
 static inline int neigh_parms_family(struct neigh_parms *p)
@@ -77,12 +77,17 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
             const struct nf_conntrack_l3proto *l3proto,
             const struct nf_conntrack_l4proto *proto);
 
-#ifdef CONFIG_LOCKDEP
-# define CONNTRACK_LOCKS 8
-#else
-# define CONNTRACK_LOCKS 1024
-#endif
-extern spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
+/*
+ * The stripe locks of the conntrack hash buckets, a power of two of them
+ * sized at init time from the number of CPUs, see nf_conntrack_core.c
+ */
+extern spinlock_t *nf_conntrack_locks;
+extern unsigned int nf_conntrack_locks_mask;
+
+static inline spinlock_t *nf_conntrack_lockp(unsigned int bucket)
+{
+	return &nf_conntrack_locks[bucket & nf_conntrack_locks_mask];
+}
 
 extern spinlock_t nf_conntrack_expect_lock;
 
@@ -91,19 +91,34 @@ extern int sysctl_max_syn_backlog;
 /** struct listen_sock - listen state
  *
  * @max_qlen_log - log_2 of maximal queued SYNs/REQUESTs
+ * @syn_locks - serialize the insertions at the head of the syn_table chains
+ *
+ * The SYNs that open a new connection may be processed without the lock of
+ * the listener, see inet_csk_reqsk_queue_unlocked(): they only push their
+ * request at the head of a chain, under the lock of its bucket, and count it
+ * in the atomic qlen and qlen_young. They hold the syn_wait_lock in read mode
+ * meanwhile. Everything else, the removal of the requests in particular, is
+ * still done under the listener lock.
  */
 struct listen_sock {
 	u8			max_qlen_log;
 	u8			synflood_warned;
 	/* 2 bytes hole, try to use */
-	int			qlen;
-	int			qlen_young;
+	atomic_t		qlen;
+	atomic_t		qlen_young;
 	int			clock_hand;
 	u32			hash_rnd;
 	u32			nr_table_entries;
+	u32			syn_locks_mask;
+	spinlock_t		*syn_locks;
 	struct request_sock	*syn_table[0];
 };
 
+static inline spinlock_t *reqsk_syn_lock(struct listen_sock *lopt, u32 hash)
+{
+	return &lopt->syn_locks[hash & lopt->syn_locks_mask];
+}
+
 /*
  * For a TCP Fast Open listener -
  *	lock - protects the access to all the reqsk, which is co-owned by
@@ -142,11 +157,14 @@ struct fastopen_queue {
  * %syn_wait_lock is necessary only to avoid proc interface having to grab the main
  * lock sock while browsing the listening hash (otherwise it's deadlock prone).
  *
- * This lock is acquired in read mode only from listening_get_next() seq_file
- * op and it's acquired in write mode _only_ from code that is actively
- * changing rskq_accept_head. All readers that are holding the master sock lock
- * don't need to grab this lock in read mode too as rskq_accept_head. writes
- * are always protected from the main sock lock.
+ * This lock is acquired in read mode from listening_get_next() seq_file
+ * op and by the SYNs processed without the listener lock, and it's acquired
+ * in write mode _only_ from code that is actively changing rskq_accept_head
+ * or removing requests from the syn_table. All readers that are holding the
+ * master sock lock don't need to grab this lock in read mode too as
+ * rskq_accept_head. writes are always protected from the main sock lock.
+ * The insertions in the syn_table don't take it, the readers see the new
+ * request at the head of its chain or not at all.
  */
 struct request_sock_queue {
 	struct request_sock	*rskq_accept_head;
@@ -189,9 +207,13 @@ static inline void reqsk_queue_unlink(struct request_sock_queue *queue,
 				      struct request_sock *req,
 				      struct request_sock **prev_req)
 {
-	write_lock(&queue->syn_wait_lock);
+	/*
+	 * Waits for the SYNs processed without the listener lock: they may
+	 * walk the chain of req, or push a new request in front of it.
+	 */
+	write_lock_bh(&queue->syn_wait_lock);
 	*prev_req = req->dl_next;
-	write_unlock(&queue->syn_wait_lock);
+	write_unlock_bh(&queue->syn_wait_lock);
 }
 
 static inline void reqsk_queue_add(struct request_sock_queue *queue,
@@ -230,34 +252,34 @@ static inline int reqsk_queue_removed(struct request_sock_queue *queue,
 	struct listen_sock *lopt = queue->listen_opt;
 
 	if (req->num_timeout == 0)
-		--lopt->qlen_young;
+		atomic_dec(&lopt->qlen_young);
 
-	return --lopt->qlen;
+	return atomic_dec_return(&lopt->qlen);
 }
 
 static inline int reqsk_queue_added(struct request_sock_queue *queue)
 {
 	struct listen_sock *lopt = queue->listen_opt;
-	const int prev_qlen = lopt->qlen;
 
-	lopt->qlen_young++;
-	lopt->qlen++;
-	return prev_qlen;
+	atomic_inc(&lopt->qlen_young);
+	return atomic_inc_return(&lopt->qlen) - 1;
 }
 
 static inline int reqsk_queue_len(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt != NULL ? queue->listen_opt->qlen : 0;
+	return queue->listen_opt != NULL ?
+	       atomic_read(&queue->listen_opt->qlen) : 0;
 }
 
 static inline int reqsk_queue_len_young(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen_young;
+	return atomic_read(&queue->listen_opt->qlen_young);
 }
 
 static inline int reqsk_queue_is_full(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen >> queue->listen_opt->max_qlen_log;
+	return atomic_read(&queue->listen_opt->qlen) >>
+	       queue->listen_opt->max_qlen_log;
 }
 
 static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
@@ -270,11 +292,13 @@ static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
 	req->num_retrans = 0;
 	req->num_timeout = 0;
 	req->sk = NULL;
-	req->dl_next = lopt->syn_table[hash];
 
-	write_lock(&queue->syn_wait_lock);
+	spin_lock(reqsk_syn_lock(lopt, hash));
+	req->dl_next = lopt->syn_table[hash];
+	/* The lockless readers of the chain see req initialized */
+	smp_wmb();
 	lopt->syn_table[hash] = req;
-	write_unlock(&queue->syn_wait_lock);
+	spin_unlock(reqsk_syn_lock(lopt, hash));
 }
 
 #endif /* _REQUEST_SOCK_H */
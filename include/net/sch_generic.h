@@ -100,6 +100,7 @@ struct Qdisc {
 	atomic_t		refcnt;
 
 	spinlock_t		busylock ____cacheline_aligned_in_smp;
+	struct sk_buff		*defer_list;	/* See qdisc_defer_skb() */
 };
 
 static inline bool qdisc_is_running(const struct Qdisc *qdisc)
@@ -120,6 +121,27 @@ static inline void qdisc_run_end(struct Qdisc *qdisc)
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
+/*
+ * With net.core.qdisc_combining, a sender that finds the qdisc running
+ * doesn't wait for the root lock to enqueue its skb: it pushes the skb on
+ * the lockless defer_list and leaves, and the running owner enqueues the
+ * deferred skbs in __qdisc_run() along with the transmits it does anyway.
+ * The sender rechecks that the qdisc is running after the push, and the
+ * owner checks the list after qdisc_run_end(), so that one of them always
+ * sees the skb.
+ */
+static inline void qdisc_defer_skb(struct Qdisc *qdisc, struct sk_buff *skb)
+{
+	struct sk_buff *head;
+
+	do {
+		head = ACCESS_ONCE(qdisc->defer_list);
+		skb->next = head;
+	} while (cmpxchg(&qdisc->defer_list, head, skb) != head);
+}
+
+void qdisc_enqueue_deferred(struct Qdisc *qdisc);
+
 static inline bool qdisc_may_bulk(const struct Qdisc *qdisc)
 {
 	return qdisc->flags & TCQ_F_ONETXQUEUE;
@@ -253,6 +253,8 @@ struct cg_proto;
   *	@sk_gso_max_segs: Maximum number of GSO segments
   *	@sk_lingertime: %SO_LINGER l_linger setting
   *	@sk_backlog: always used with the per-socket spinlock held
+  *	@sk_rx_defer: lockless stack of the skbs received while the per-socket
+  *		      spinlock was busy, see sk_defer_rcv_skb()
   *	@sk_callback_lock: used with the callbacks in the end of this struct
   *	@sk_error_queue: rarely used
   *	@sk_prot_creator: sk_prot of original sock creator (see ipv6_setsockopt,
@@ -275,6 +277,7 @@ struct cg_proto;
   *	@sk_rxhash: flow hash received from netif layer
   *	@sk_txhash: computed flow hash for use on transmit
   *	@sk_filter: socket filtering instructions
+  *	@sk_reuseport_cb: the SO_REUSEPORT group of the socket
   *	@sk_protinfo: private area, net family specific, when not using slab
   *	@sk_timer: sock cleanup timer
   *	@sk_stamp: time stamp of last packet received
@@ -346,6 +349,10 @@ struct sock {
 		struct sk_buff	*tail;
 	} sk_backlog;
 #define sk_rmem_alloc sk_backlog.rmem_alloc
+	struct {
+		struct sk_buff	*head;
+		atomic_t	len;
+	} sk_rx_defer;
 	int			sk_forward_alloc;
 #ifdef CONFIG_RPS
 	__u32			sk_rxhash;
@@ -360,6 +367,7 @@ struct sock {
 
 	struct sk_filter __rcu	*sk_filter;
 	struct socket_wq __rcu	*sk_wq;
+	struct sock_reuseport __rcu	*sk_reuseport_cb;
 
 #ifdef CONFIG_XFRM
 	struct xfrm_policy	*sk_policy[2];
@@ -712,6 +720,7 @@ enum sock_flags {
 		     */
 	SOCK_FILTER_LOCKED, /* Filter cannot be changed anymore */
 	SOCK_SELECT_ERR_QUEUE, /* Wake select on error queue */
+	SOCK_RX_DEFER, /* softirq may use sk_defer_rcv_skb() */
 };
 
 static inline void sock_copy_flags(struct sock *nsk, struct sock *osk)
@@ -806,7 +815,8 @@ static inline void __sk_add_backlog(struct sock *sk, struct sk_buff *skb)
  */
 static inline bool sk_rcvqueues_full(const struct sock *sk, unsigned int limit)
 {
-	unsigned int qsize = sk->sk_backlog.len + atomic_read(&sk->sk_rmem_alloc);
+	unsigned int qsize = sk->sk_backlog.len + atomic_read(&sk->sk_rmem_alloc) +
+			     atomic_read(&sk->sk_rx_defer.len);
 
 	return qsize > limit;
 }
@@ -825,6 +835,20 @@ static inline __must_check int sk_add_backlog(struct sock *sk, struct sk_buff *s
 
 int __sk_backlog_rcv(struct sock *sk, struct sk_buff *skb);
 
+int sk_defer_rcv_skb(struct sock *sk, struct sk_buff *skb, unsigned int limit);
+void __sk_rx_defer_flush(struct sock *sk);
+void sk_rx_defer_trylock(struct sock *sk);
+
+/*
+ * To be called after releasing the per-socket spinlock, with softirqs
+ * disabled, for the sockets whose receive path may defer skbs
+ */
+static inline void sk_rx_defer_flush(struct sock *sk)
+{
+	if (sock_flag(sk, SOCK_RX_DEFER))
+		sk_rx_defer_trylock(sk);
+}
+
 static inline int sk_backlog_rcv(struct sock *sk, struct sk_buff *skb)
 {
 	if (sk_memalloc_socks() && skb_pfmemalloc(skb))
@@ -1551,10 +1575,13 @@ bool lock_sock_fast(struct sock *sk);
  */
 static inline void unlock_sock_fast(struct sock *sk, bool slow)
 {
-	if (slow)
+	if (slow) {
 		release_sock(sk);
-	else
-		spin_unlock_bh(&sk->sk_lock.slock);
+	} else {
+		spin_unlock(&sk->sk_lock.slock);
+		sk_rx_defer_flush(sk);
+		local_bh_enable();
+	}
 }
 
 
@@ -0,0 +1,40 @@
+#ifndef _SOCK_REUSEPORT_H
+#define _SOCK_REUSEPORT_H
+
+#include <linux/types.h>
+#include <linux/rcupdate.h>
+#include <net/sock.h>
+
+/*
+ * A group of SO_REUSEPORT sockets bound to the same port and address, so
+ * that the receive path picks one with a hash of the flow without walking
+ * all of them. The group is updated by its protocol under a lock covering
+ * all its members, e.g. the UDP primary hash slot lock, and read under RCU.
+ */
+struct sock_reuseport {
+	struct rcu_head		rcu;
+
+	u16			max_socks;	/* length of socks */
+	u16			num_socks;	/* elements in socks */
+	bool			has_conns;	/* a member was connected */
+	struct sock		*socks[0];	/* array of sock pointers */
+};
+
+extern int reuseport_alloc(struct sock *sk);
+extern int reuseport_add_sock(struct sock *sk, struct sock *sk2);
+extern void reuseport_detach_sock(struct sock *sk);
+extern struct sock *reuseport_select_sock(struct sock *sk, u32 hash);
+
+extern void __reuseport_set_conns(struct sock *sk);
+
+/*
+ * A connected member scores higher than the group in the lookups, the
+ * group then can't be used to shortcut them anymore.
+ */
+static inline void reuseport_set_conns(struct sock *sk)
+{
+	if (rcu_access_pointer(sk->sk_reuseport_cb))
+		__reuseport_set_conns(sk);
+}
+
+#endif  /* _SOCK_REUSEPORT_H */
@@ -717,7 +717,7 @@ struct tcp_skb_cb {
 				TCPCB_REPAIRED)
 
 	__u8		ip_dsfield;	/* IPv4 tos or IPv6 dsfield	*/
-	/* 1 byte hole */
+	__u8		syn_unlocked;	/* SYN w/o the listener lock	*/
 	__u32		ack_seq;	/* Sequence number ACK'd	*/
 	union {
 		struct inet_skb_parm	h4;
@@ -729,6 +729,16 @@ struct tcp_skb_cb {
 
 #define TCP_SKB_CB(__skb)	((struct tcp_skb_cb *)&((__skb)->cb[0]))
 
+/* May the segment received by the listener sk skip its lock? Only a SYN
+ * may, see inet_csk_reqsk_queue_unlocked().
+ */
+static inline bool tcp_syn_unlocked(struct sock *sk, const struct sk_buff *skb)
+{
+	if ((TCP_SKB_CB(skb)->tcp_flags &
+	     (TCPHDR_SYN | TCPHDR_ACK | TCPHDR_RST | TCPHDR_FIN)) != TCPHDR_SYN)
+		return false;
+	return inet_csk_reqsk_queue_unlocked(sk);
+}
 
 #if IS_ENABLED(CONFIG_IPV6)
 /* This is the variant of inet6_iif() that must be used by TCP,
@@ -112,19 +112,30 @@ TRACE_EVENT(mm_compaction_begin,
 );
 
 TRACE_EVENT(mm_compaction_end,
-	TP_PROTO(int status),
+	TP_PROTO(int status, unsigned long zone_contended,
+		unsigned long zone_combined, unsigned long lru_contended),
 
-	TP_ARGS(status),
+	TP_ARGS(status, zone_contended, zone_combined, lru_contended),
 
 	TP_STRUCT__entry(
 		__field(int, status)
+		__field(unsigned long, zone_contended)
+		__field(unsigned long, zone_combined)
+		__field(unsigned long, lru_contended)
 	),
 
 	TP_fast_assign(
 		__entry->status = status;
+		__entry->zone_contended = zone_contended;
+		__entry->zone_combined = zone_combined;
+		__entry->lru_contended = lru_contended;
 	),
 
-	TP_printk("status=%d", __entry->status)
+	TP_printk("status=%d zone_contended=%lu zone_combined=%lu lru_contended=%lu",
+		__entry->status,
+		__entry->zone_contended,
+		__entry->zone_combined,
+		__entry->lru_contended)
 );
 
 #endif /* _TRACE_COMPACTION_H */
@@ -0,0 +1,169 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM qspinlock
+
+#if !defined(_TRACE_QSPINLOCK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_QSPINLOCK_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * The queue spinlock slowpath events. The timeline of a contended lock
+ * acquisition is slowpath, then either pending or queued and head, then
+ * acquired. With the PV spinlocks, the waiters may halt and be kicked and
+ * woken in between. Like all the tracepoints, they are behind static keys
+ * and only cost a patched-out jump in the slowpath when not enabled.
+ */
+TRACE_EVENT(qspinlock_slowpath,
+
+	TP_PROTO(struct qspinlock *lock, u32 val),
+
+	TP_ARGS(lock, val),
+
+	TP_STRUCT__entry(
+		__field(	void *,		lock	)
+		__field(	u32,		val	)
+	),
+
+	TP_fast_assign(
+		__entry->lock	= lock;
+		__entry->val	= val;
+	),
+
+	TP_printk("lock=%p val=0x%x", __entry->lock, __entry->val)
+);
+
+DECLARE_EVENT_CLASS(qspinlock,
+
+	TP_PROTO(struct qspinlock *lock),
+
+	TP_ARGS(lock),
+
+	TP_STRUCT__entry(
+		__field(	void *,		lock	)
+	),
+
+	TP_fast_assign(
+		__entry->lock	= lock;
+	),
+
+	TP_printk("lock=%p", __entry->lock)
+);
+
+/* Got the pending bit, waiting for the owner to go away */
+DEFINE_EVENT(qspinlock, qspinlock_pending,
+
+	TP_PROTO(struct qspinlock *lock),
+
+	TP_ARGS(lock)
+);
+
+/* Reached the head of the wait queue */
+DEFINE_EVENT(qspinlock, qspinlock_head,
+
+	TP_PROTO(struct qspinlock *lock),
+
+	TP_ARGS(lock)
+);
+
+/* Slowpath acquisition of the lock */
+DEFINE_EVENT(qspinlock, qspinlock_acquired,
+
+	TP_PROTO(struct qspinlock *lock),
+
+	TP_ARGS(lock)
+);
+
+/* Gave up waiting in queue_spin_trylock_for() */
+DEFINE_EVENT(qspinlock, qspinlock_timeout,
+
+	TP_PROTO(struct qspinlock *lock),
+
+	TP_ARGS(lock)
+);
+
+/*
+ * Queued behind the waiter on prev_cpu, or at the head of an empty queue
+ * if prev_cpu is -1. pos is the approximate number of waiters ahead.
+ */
+TRACE_EVENT(qspinlock_queued,
+
+	TP_PROTO(struct qspinlock *lock, int idx, int prev_cpu, int pos),
+
+	TP_ARGS(lock, idx, prev_cpu, pos),
+
+	TP_STRUCT__entry(
+		__field(	void *,		lock		)
+		__field(	int,		idx		)
+		__field(	int,		prev_cpu	)
+		__field(	int,		pos		)
+	),
+
+	TP_fast_assign(
+		__entry->lock		= lock;
+		__entry->idx		= idx;
+		__entry->prev_cpu	= prev_cpu;
+		__entry->pos		= pos;
+	),
+
+	TP_printk("lock=%p idx=%d prev_cpu=%d pos=%d", __entry->lock,
+		  __entry->idx, __entry->prev_cpu, __entry->pos)
+);
+
+TRACE_EVENT(qspinlock_pv_halt,
+
+	TP_PROTO(bool head),
+
+	TP_ARGS(head),
+
+	TP_STRUCT__entry(
+		__field(	bool,		head	)
+	),
+
+	TP_fast_assign(
+		__entry->head	= head;
+	),
+
+	TP_printk("%s", __entry->head ? "head" : "node")
+);
+
+TRACE_EVENT(qspinlock_pv_kick,
+
+	TP_PROTO(int cpu),
+
+	TP_ARGS(cpu),
+
+	TP_STRUCT__entry(
+		__field(	int,		cpu	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu	= cpu;
+	),
+
+	TP_printk("cpu=%d", __entry->cpu)
+);
+
+TRACE_EVENT(qspinlock_pv_wake,
+
+	TP_PROTO(bool kicked, u64 halt_ns),
+
+	TP_ARGS(kicked, halt_ns),
+
+	TP_STRUCT__entry(
+		__field(	bool,		kicked	)
+		__field(	u64,		halt_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->kicked		= kicked;
+		__entry->halt_ns	= halt_ns;
+	),
+
+	TP_printk("%s halt_ns=%llu", __entry->kicked ? "kicked" : "spurious",
+		  (unsigned long long)__entry->halt_ns)
+);
+
+#endif /* _TRACE_QSPINLOCK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -62,6 +62,69 @@ TRACE_EVENT(workqueue_queue_work,
 		  __entry->req_cpu, __entry->cpu)
 );
 
+/**
+ * workqueue_queue_contended - called when queueing finds the pool locked
+ * @req_cpu:	the requested cpu
+ * @pwq:	pointer to struct pool_workqueue
+ * @work:	pointer to struct work_struct
+ *
+ * This event occurs when a work is queued on an unbound pool whose lock
+ * is taken.  The work is posted to the lock holder and queued along with
+ * the other posted works, see workqueue_queue_combined.
+ */
+TRACE_EVENT(workqueue_queue_contended,
+
+	TP_PROTO(unsigned int req_cpu, struct pool_workqueue *pwq,
+		 struct work_struct *work),
+
+	TP_ARGS(req_cpu, pwq, work),
+
+	TP_STRUCT__entry(
+		__field( void *,	work	)
+		__field( void *,	workqueue)
+		__field( unsigned int,	req_cpu	)
+		__field( int,		pool_id	)
+	),
+
+	TP_fast_assign(
+		__entry->work		= work;
+		__entry->workqueue	= pwq->wq;
+		__entry->req_cpu	= req_cpu;
+		__entry->pool_id	= pwq->pool->id;
+	),
+
+	TP_printk("work struct=%p workqueue=%p req_cpu=%u pool=%d",
+		  __entry->work, __entry->workqueue, __entry->req_cpu,
+		  __entry->pool_id)
+);
+
+/**
+ * workqueue_queue_combined - called when the posted works get queued
+ * @pool_id:	the id of the worker pool
+ * @nr:		the number of works queued
+ *
+ * This event occurs when the holder of a pool lock queues the works
+ * posted while the lock was contended.
+ */
+TRACE_EVENT(workqueue_queue_combined,
+
+	TP_PROTO(int pool_id, int nr),
+
+	TP_ARGS(pool_id, nr),
+
+	TP_STRUCT__entry(
+		__field( int,		pool_id	)
+		__field( int,		nr	)
+	),
+
+	TP_fast_assign(
+		__entry->pool_id	= pool_id;
+		__entry->nr		= nr;
+	),
+
+	TP_printk("pool=%d nr=%d", __entry->pool_id, __entry->nr)
+);
+
 /**
  * workqueue_activate_work - called when a work gets activated
  * @work:	pointer to struct work_struct
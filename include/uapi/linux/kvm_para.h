@@ -23,6 +23,10 @@
 #define KVM_HC_MIPS_GET_CLOCK_FREQ	6
 #define KVM_HC_MIPS_EXIT_VM		7
 #define KVM_HC_MIPS_CONSOLE_OUTPUT	8
+#define KVM_HC_YIELD_TO_CPU		9
+#define KVM_HC_LOCKWAIT_HALT		10
+#define KVM_HC_KICK_CPUS		11
+#define KVM_HC_LOCK_HOLDER_YIELD	12
 
 /*
  * hypercalls use architecture specific
@@ -179,4 +179,13 @@ struct prctl_mm_map {
 #define PR_SET_THP_DISABLE	41
 #define PR_GET_THP_DISABLE	42
 
+/*
+ * Private futex hash table of the process, sized for the given number of
+ * threads, or back to the global one with 0. Can only be set while the
+ * process has a single thread. PR_GET_FUTEX_HASH returns the number of
+ * buckets, 0 for the global table.
+ */
+#define PR_SET_FUTEX_HASH	43
+#define PR_GET_FUTEX_HASH	44
+
 #endif /* _LINUX_PRCTL_H */
@@ -146,7 +146,21 @@ static int proc_ipcauto_dointvec_minmax(struct ctl_table *table, int write,
 	return rc;
 }
 
+static int proc_ipc_sem_lock_fallbacks(struct ctl_table *table, int write,
+	void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct ipc_namespace *ns = current->nsproxy->ipc_ns;
+	struct ctl_table ipc_table;
+	unsigned long fallbacks = atomic_long_read(&ns->sem_lock_fallbacks);
+
+	memcpy(&ipc_table, table, sizeof(ipc_table));
+	ipc_table.data = &fallbacks;
+
+	return proc_doulongvec_minmax(&ipc_table, write, buffer, lenp, ppos);
+}
+
 #else
+#define proc_ipc_sem_lock_fallbacks NULL
 #define proc_ipc_doulongvec_minmax NULL
 #define proc_ipc_dointvec	   NULL
 #define proc_ipc_dointvec_minmax   NULL
@@ -224,6 +238,22 @@ static struct ctl_table ipc_kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_ipc_dointvec,
 	},
+	{
+		.procname	= "sem_multi_lock",
+		.data		= &init_ipc_ns.sem_multi_lock,
+		.maxlen		= sizeof(init_ipc_ns.sem_multi_lock),
+		.mode		= 0644,
+		.proc_handler	= proc_ipc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
+	{
+		.procname	= "sem_lock_fallbacks",
+		.data		= &init_ipc_ns.sem_lock_fallbacks,
+		.maxlen		= sizeof(unsigned long),
+		.mode		= 0444,
+		.proc_handler	= proc_ipc_sem_lock_fallbacks,
+	},
 	{
 		.procname	= "auto_msgmni",
 		.data		= &init_ipc_ns.auto_msgmni,
@@ -153,6 +153,13 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
 #define SEMMSL_FAST	256 /* 512 bytes on stack */
 #define SEMOPM_FAST	64  /* ~ 372 bytes on stack */
 
+/*
+ * Complex operations on up to SEMOPM_MULTI_LOCK semaphores take the locks of
+ * these semaphores, one lockdep subclass each, rather than the global lock.
+ */
+#define SEMOPM_MULTI_LOCK	8   /* MAX_LOCKDEP_SUBCLASSES */
+#define SEM_LOCK_MULTI		-2
+
 /*
  * Locking:
  *	sem_undo.id_next,
@@ -163,6 +170,9 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
  *
  *	sem_array.sem_base[i].pending_{const,alter}:
  *		global or semaphore sem_lock() for read/write
+ *
+ *	A complex operation may only hold the semaphore locks of its
+ *	semaphores, see sem_lock_multi(): it then only touches those.
  */
 
 #define sc_semmsl	sem_ctls[0]
@@ -177,6 +187,8 @@ void sem_init_ns(struct ipc_namespace *ns)
 	ns->sc_semopm = SEMOPM;
 	ns->sc_semmni = SEMMNI;
 	ns->used_sems = 0;
+	ns->sem_multi_lock = 1;
+	atomic_long_set(&ns->sem_lock_fallbacks, 0);
 	ipc_init_ids(&ns->ids[IPC_SEM_IDS]);
 }
 
@@ -372,6 +384,89 @@ static inline void sem_unlock(struct sem_array *sma, int locknum)
 	}
 }
 
+/*
+ * Return the smallest semaphore number above @prev in @sops, or -1
+ */
+static int sem_next_num(struct sembuf *sops, int nsops, int prev)
+{
+	int i, num = -1;
+
+	for (i = 0; i < nsops; i++) {
+		int n = sops[i].sem_num;
+
+		if (n > prev && (num == -1 || n < num))
+			num = n;
+	}
+	return num;
+}
+
+static void sem_unlock_multi(struct sem_array *sma, struct sembuf *sops,
+			     int nsops)
+{
+	int num = -1;
+
+	while ((num = sem_next_num(sops, nsops, num)) != -1)
+		spin_unlock(&sma->sem_base[num].lock);
+}
+
+/*
+ * Lock only the semaphores of a complex operation, in ascending order.
+ * This follows the rules of the single semaphore fast path in sem_lock():
+ * with no complex operation pending and the global lock free once all of
+ * them are held, the operation can't conflict with another. It can't be
+ * queued this way though, the global queues need the global lock.
+ */
+static bool sem_lock_multi(struct sem_array *sma, struct sembuf *sops,
+			   int nsops)
+{
+	int num = -1, subclass = 0;
+
+	if (nsops > SEMOPM_MULTI_LOCK || sma->complex_count)
+		return false;
+
+	while ((num = sem_next_num(sops, nsops, num)) != -1)
+		spin_lock_nested(&sma->sem_base[num].lock, subclass++);
+
+	if (!spin_is_locked(&sma->sem_perm.lock)) {
+		/* spin_is_locked() is not a memory barrier */
+		smp_mb();
+
+		if (sma->complex_count == 0)
+			return true;
+	}
+	sem_unlock_multi(sma, sops, nsops);
+	return false;
+}
+
+/*
+ * Lock the semaphore array for a semtimedop(), returning SEM_LOCK_MULTI if
+ * only the locks of the semaphores of a complex operation were taken. The
+ * operations that end up with the global lock are accounted as fallbacks.
+ */
+static int sem_lock_ops(struct ipc_namespace *ns, struct sem_array *sma,
+			struct sembuf *sops, int nsops)
+{
+	int locknum;
+
+	if (nsops > 1 && ACCESS_ONCE(ns->sem_multi_lock) &&
+	    sem_lock_multi(sma, sops, nsops))
+		return SEM_LOCK_MULTI;
+
+	locknum = sem_lock(sma, sops, nsops);
+	if (locknum == -1)
+		atomic_long_inc(&ns->sem_lock_fallbacks);
+	return locknum;
+}
+
+static void sem_unlock_ops(struct sem_array *sma, int locknum,
+			   struct sembuf *sops, int nsops)
+{
+	if (locknum == SEM_LOCK_MULTI)
+		sem_unlock_multi(sma, sops, nsops);
+	else
+		sem_unlock(sma, locknum);
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rwsem
  * is not held.
@@ -389,7 +484,7 @@ static inline struct sem_array *sem_obtain_lock(struct ipc_namespace *ns,
 		return ERR_CAST(ipcp);
 
 	sma = container_of(ipcp, struct sem_array, sem_perm);
-	*locknum = sem_lock(sma, sops, nsops);
+	*locknum = sem_lock_ops(ns, sma, sops, nsops);
 
 	/* ipc_rmid() may have already freed the ID while sem_lock
 	 * was spinning: verify that the structure is still valid
@@ -397,7 +492,7 @@ static inline struct sem_array *sem_obtain_lock(struct ipc_namespace *ns,
 	if (ipc_valid_object(ipcp))
 		return container_of(ipcp, struct sem_array, sem_perm);
 
-	sem_unlock(sma, *locknum);
+	sem_unlock_ops(sma, *locknum, sops, nsops);
 	return ERR_PTR(-EINVAL);
 }
 
@@ -1856,8 +1951,9 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	if (error)
 		goto out_rcu_wakeup;
 
+	locknum = sem_lock_ops(ns, sma, sops, nsops);
+relocked:
 	error = -EIDRM;
-	locknum = sem_lock(sma, sops, nsops);
 	/*
 	 * We eventually might perform the following check in a lockless
 	 * fashion, considering ipc_valid_object() locking constraints.
@@ -1899,7 +1995,16 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 
 	/* We need to sleep on this operation, so we put the current
 	 * task into the pending queue and go to sleep.
+	 * Only the semaphore locks are held for a complex operation that
+	 * hasn't waited yet: retry it under the global lock, which the
+	 * queueing needs.
 	 */
+	if (locknum == SEM_LOCK_MULTI) {
+		sem_unlock_multi(sma, sops, nsops);
+		locknum = sem_lock(sma, sops, nsops);
+		atomic_long_inc(&ns->sem_lock_fallbacks);
+		goto relocked;
+	}
 
 	if (nsops == 1) {
 		struct sem *curr;
@@ -1996,7 +2101,7 @@ sleep_again:
 	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma, locknum);
+	sem_unlock_ops(sma, locknum, sops, nsops);
 out_rcu_wakeup:
 	rcu_read_unlock();
 	wake_up_sem_queue_do(&tasks);
@@ -2162,82 +2162,72 @@ err:
 }
 
 /**
- * cgroup_migrate - migrate a process or task to a cgroup
- * @cgrp: the destination cgroup
- * @leader: the leader of the process or the task to migrate
- * @threadgroup: whether @leader points to the whole process or a single task
+ * cgroup_migrate_add_task - add a migration target task to a taskset
+ * @task: target task
+ * @tset: the taskset being built
  *
- * Migrate a process or task denoted by @leader to @cgrp.  If migrating a
- * process, the caller must be holding threadgroup_lock of @leader.  The
- * caller is also responsible for invoking cgroup_migrate_add_src() and
- * cgroup_migrate_prepare_dst() on the targets before invoking this
- * function and following up with cgroup_migrate_finish().
+ * Queue @task on the mg_tasks of its css_set and the css_sets on @tset, if
+ * its css_set was preloaded with cgroup_migrate_add_src().  The first task
+ * added is the one cgroup_taskset_first() returns.
  *
- * As long as a controller's ->can_attach() doesn't fail, this function is
- * guaranteed to succeed.  This means that, excluding ->can_attach()
- * failure, when migrating multiple targets, the success or failure can be
- * decided for all targets by invoking group_migrate_prepare_dst() before
- * actually starting migrating.
+ * Called with css_set_rwsem held for writing and under rcu_read_lock().
  */
-static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
-			  bool threadgroup)
+static void cgroup_migrate_add_task(struct task_struct *task,
+				    struct cgroup_taskset *tset)
 {
-	struct cgroup_taskset tset = {
-		.src_csets	= LIST_HEAD_INIT(tset.src_csets),
-		.dst_csets	= LIST_HEAD_INIT(tset.dst_csets),
-		.csets		= &tset.src_csets,
-	};
-	struct cgroup_subsys_state *css, *failed_css = NULL;
-	struct css_set *cset, *tmp_cset;
-	struct task_struct *task, *tmp_task;
-	int i, ret;
+	struct css_set *cset;
 
-	/*
-	 * Prevent freeing of tasks while we take a snapshot. Tasks that are
-	 * already PF_EXITING could be freed from underneath us unless we
-	 * take an rcu_read_lock.
-	 */
-	down_write(&css_set_rwsem);
-	rcu_read_lock();
-	task = leader;
-	do {
-		/* @task either already exited or can't exit until the end */
-		if (task->flags & PF_EXITING)
-			goto next;
+	lockdep_assert_held(&css_set_rwsem);
 
-		/* leave @task alone if post_fork() hasn't linked it yet */
-		if (list_empty(&task->cg_list))
-			goto next;
+	/* @task either already exited or can't exit until the end */
+	if (task->flags & PF_EXITING)
+		return;
 
-		cset = task_css_set(task);
-		if (!cset->mg_src_cgrp)
-			goto next;
+	/* leave @task alone if post_fork() hasn't linked it yet */
+	if (list_empty(&task->cg_list))
+		return;
 
-		/*
-		 * cgroup_taskset_first() must always return the leader.
-		 * Take care to avoid disturbing the ordering.
-		 */
-		list_move_tail(&task->cg_list, &cset->mg_tasks);
-		if (list_empty(&cset->mg_node))
-			list_add_tail(&cset->mg_node, &tset.src_csets);
-		if (list_empty(&cset->mg_dst_cset->mg_node))
-			list_move_tail(&cset->mg_dst_cset->mg_node,
-				       &tset.dst_csets);
-	next:
-		if (!threadgroup)
-			break;
-	} while_each_thread(leader, task);
-	rcu_read_unlock();
-	up_write(&css_set_rwsem);
+	cset = task_css_set(task);
+	if (!cset->mg_src_cgrp)
+		return;
+
+	/*
+	 * cgroup_taskset_first() must always return the leader.
+	 * Take care to avoid disturbing the ordering.
+	 */
+	list_move_tail(&task->cg_list, &cset->mg_tasks);
+	if (list_empty(&cset->mg_node))
+		list_add_tail(&cset->mg_node, &tset->src_csets);
+	if (list_empty(&cset->mg_dst_cset->mg_node))
+		list_move_tail(&cset->mg_dst_cset->mg_node,
+			       &tset->dst_csets);
+}
+
+/**
+ * cgroup_migrate_execute - migrate the tasks of a taskset to a cgroup
+ * @cgrp: the destination cgroup
+ * @tset: taskset built with cgroup_migrate_add_task()
+ *
+ * Run the controllers' ->can_attach(), commit the migration of all the
+ * tasks of @tset under a single write acquisition of css_set_rwsem and
+ * run ->attach().  On ->can_attach() failure, nothing is migrated.
+ */
+static int cgroup_migrate_execute(struct cgroup *cgrp,
+				  struct cgroup_taskset *tset)
+{
+	struct cgroup_subsys_state *css, *failed_css = NULL;
+	struct css_set *cset, *tmp_cset;
+	struct task_struct *task, *tmp_task;
+	int i, ret;
 
 	/* methods shouldn't be called if no task is actually migrating */
-	if (list_empty(&tset.src_csets))
+	if (list_empty(&tset->src_csets))
 		return 0;
 
 	/* check that we can legitimately attach to the cgroup */
 	for_each_e_css(css, i, cgrp) {
 		if (css->ss->can_attach) {
-			ret = css->ss->can_attach(css, &tset);
+			ret = css->ss->can_attach(css, tset);
 			if (ret) {
 				failed_css = css;
 				goto out_cancel_attach;
@@ -2251,7 +2241,7 @@ static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
 	 * is the commit point.
 	 */
 	down_write(&css_set_rwsem);
-	list_for_each_entry(cset, &tset.src_csets, mg_node) {
+	list_for_each_entry(cset, &tset->src_csets, mg_node) {
 		list_for_each_entry_safe(task, tmp_task, &cset->mg_tasks, cg_list)
 			cgroup_task_migrate(cset->mg_src_cgrp, task,
 					    cset->mg_dst_cset);
@@ -2263,11 +2253,11 @@ static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
 	 * Nothing is sensitive to fork() after this point.  Notify
 	 * controllers that migration is complete.
 	 */
-	tset.csets = &tset.dst_csets;
+	tset->csets = &tset->dst_csets;
 
 	for_each_e_css(css, i, cgrp)
 		if (css->ss->attach)
-			css->ss->attach(css, &tset);
+			css->ss->attach(css, tset);
 
 	ret = 0;
 	goto out_release_tset;
@@ -2277,12 +2267,12 @@ out_cancel_attach:
 		if (css == failed_css)
 			break;
 		if (css->ss->cancel_attach)
-			css->ss->cancel_attach(css, &tset);
+			css->ss->cancel_attach(css, tset);
 	}
 out_release_tset:
 	down_write(&css_set_rwsem);
-	list_splice_init(&tset.dst_csets, &tset.src_csets);
-	list_for_each_entry_safe(cset, tmp_cset, &tset.src_csets, mg_node) {
+	list_splice_init(&tset->dst_csets, &tset->src_csets);
+	list_for_each_entry_safe(cset, tmp_cset, &tset->src_csets, mg_node) {
 		list_splice_tail_init(&cset->mg_tasks, &cset->tasks);
 		list_del_init(&cset->mg_node);
 	}
@@ -2290,6 +2280,85 @@ out_release_tset:
 	return ret;
 }
 
+#define CGROUP_TASKSET_INIT(tset)					\
+{									\
+	.src_csets	= LIST_HEAD_INIT(tset.src_csets),		\
+	.dst_csets	= LIST_HEAD_INIT(tset.dst_csets),		\
+	.csets		= &tset.src_csets,				\
+}
+
+/**
+ * cgroup_migrate - migrate a process or task to a cgroup
+ * @cgrp: the destination cgroup
+ * @leader: the leader of the process or the task to migrate
+ * @threadgroup: whether @leader points to the whole process or a single task
+ *
+ * Migrate a process or task denoted by @leader to @cgrp.  If migrating a
+ * process, the caller must be holding threadgroup_lock of @leader.  The
+ * caller is also responsible for invoking cgroup_migrate_add_src() and
+ * cgroup_migrate_prepare_dst() on the targets before invoking this
+ * function and following up with cgroup_migrate_finish().
+ *
+ * As long as a controller's ->can_attach() doesn't fail, this function is
+ * guaranteed to succeed.  This means that, excluding ->can_attach()
+ * failure, when migrating multiple targets, the success or failure can be
+ * decided for all targets by invoking group_migrate_prepare_dst() before
+ * actually starting migrating.
+ */
+static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
+			  bool threadgroup)
+{
+	struct cgroup_taskset tset = CGROUP_TASKSET_INIT(tset);
+	struct task_struct *task;
+
+	/*
+	 * Prevent freeing of tasks while we take a snapshot. Tasks that are
+	 * already PF_EXITING could be freed from underneath us unless we
+	 * take an rcu_read_lock.
+	 */
+	down_write(&css_set_rwsem);
+	rcu_read_lock();
+	task = leader;
+	do {
+		cgroup_migrate_add_task(task, &tset);
+		if (!threadgroup)
+			break;
+	} while_each_thread(leader, task);
+	rcu_read_unlock();
+	up_write(&css_set_rwsem);
+
+	return cgroup_migrate_execute(cgrp, &tset);
+}
+
+/**
+ * cgroup_migrate_tasks - migrate a batch of tasks to a cgroup
+ * @cgrp: the destination cgroup
+ * @tasks: the tasks to migrate
+ * @nr: number of entries in @tasks
+ *
+ * Like cgroup_migrate() for @nr single tasks, but the tasks share one
+ * taskset, so css_set_rwsem is taken for writing the same number of times
+ * as for a single task, and the controllers' methods run once for the
+ * whole batch.  The caller pins the tasks and is responsible for
+ * cgroup_migrate_add_src(), cgroup_migrate_prepare_dst() and
+ * cgroup_migrate_finish() covering all of them.
+ */
+static int cgroup_migrate_tasks(struct cgroup *cgrp,
+				struct task_struct **tasks, int nr)
+{
+	struct cgroup_taskset tset = CGROUP_TASKSET_INIT(tset);
+	int i;
+
+	down_write(&css_set_rwsem);
+	rcu_read_lock();
+	for (i = 0; i < nr; i++)
+		cgroup_migrate_add_task(tasks[i], &tset);
+	rcu_read_unlock();
+	up_write(&css_set_rwsem);
+
+	return cgroup_migrate_execute(cgrp, &tset);
+}
+
 /**
  * cgroup_attach_task - attach a task or a whole threadgroup to a cgroup
  * @dst_cgrp: the cgroup to attach to
@@ -3632,6 +3701,9 @@ void css_task_iter_end(struct css_task_iter *it)
 	up_read(&css_set_rwsem);
 }
 
+/* tasks moved per cgroup_migrate_tasks() call by cgroup_transfer_tasks() */
+#define CGROUP_MIGRATE_BATCH	32
+
 /**
  * cgroup_trasnsfer_tasks - move tasks from one cgroup to another
  * @to: cgroup to which the tasks will be moved
@@ -3646,10 +3718,11 @@ void css_task_iter_end(struct css_task_iter *it)
 int cgroup_transfer_tasks(struct cgroup *to, struct cgroup *from)
 {
 	LIST_HEAD(preloaded_csets);
+	struct task_struct *tasks[CGROUP_MIGRATE_BATCH];
 	struct cgrp_cset_link *link;
 	struct css_task_iter it;
 	struct task_struct *task;
-	int ret;
+	int nr, ret;
 
 	mutex_lock(&cgroup_mutex);
 
@@ -3664,20 +3737,23 @@ int cgroup_transfer_tasks(struct cgroup *to, struct cgroup *from)
 		goto out_err;
 
 	/*
-	 * Migrate tasks one-by-one until @form is empty.  This fails iff
+	 * Migrate tasks in batches until @from is empty.  This fails iff
 	 * ->can_attach() fails.
 	 */
 	do {
+		nr = 0;
 		css_task_iter_start(&from->self, &it);
-		task = css_task_iter_next(&it);
-		if (task)
+		while (nr < CGROUP_MIGRATE_BATCH &&
+		       (task = css_task_iter_next(&it))) {
 			get_task_struct(task);
+			tasks[nr++] = task;
+		}
 		css_task_iter_end(&it);
 
-		if (task) {
-			ret = cgroup_migrate(to, task, false);
-			put_task_struct(task);
-		}
+		if (nr)
+			ret = cgroup_migrate_tasks(to, tasks, nr);
+		while (nr)
+			put_task_struct(tasks[--nr]);
 	} while (task && !ret);
 out_err:
 	cgroup_migrate_finish(&preloaded_csets);
@@ -78,14 +78,17 @@ static void __unhash_process(struct task_struct *p, bool group_dead)
 }
 
 /*
- * This function expects the tasklist_lock write-locked.
+ * This function expects the tasklist_lock write-locked. It returns the
+ * sighand and sets *ttyp to the tty of a dead group, for release_task() to
+ * put them once the lock is dropped.
  */
-static void __exit_signal(struct task_struct *tsk)
+static struct sighand_struct *__exit_signal(struct task_struct *tsk,
+					    struct tty_struct **ttyp)
 {
 	struct signal_struct *sig = tsk->signal;
 	bool group_dead = thread_group_leader(tsk);
 	struct sighand_struct *sighand;
-	struct tty_struct *uninitialized_var(tty);
+	struct tty_struct *tty = NULL;
 	cputime_t utime, stime;
 
 	sighand = rcu_dereference_check(tsk->sighand,
@@ -151,12 +154,8 @@ static void __exit_signal(struct task_struct *tsk)
 	tsk->sighand = NULL;
 	spin_unlock(&sighand->siglock);
 
-	__cleanup_sighand(sighand);
-	clear_tsk_thread_flag(tsk, TIF_SIGPENDING);
-	if (group_dead) {
-		flush_sigqueue(&sig->shared_pending);
-		tty_kref_put(tty);
-	}
+	*ttyp = tty;
+	return sighand;
 }
 
 static void delayed_put_task_struct(struct rcu_head *rhp)
@@ -171,7 +170,10 @@ static void delayed_put_task_struct(struct rcu_head *rhp)
 
 void release_task(struct task_struct *p)
 {
+	struct sighand_struct *sighand;
 	struct task_struct *leader;
+	struct tty_struct *tty;
+	bool group_dead;
 	int zap_leader;
 repeat:
 	/* don't need to get the RCU readlock here - the process is dead and
@@ -182,9 +184,10 @@ repeat:
 
 	proc_flush_task(p);
 
+	group_dead = thread_group_leader(p);
 	write_lock_irq(&tasklist_lock);
 	ptrace_release_task(p);
-	__exit_signal(p);
+	sighand = __exit_signal(p, &tty);
 
 	/*
 	 * If we are the last non-leader member of the thread
@@ -206,6 +209,18 @@ repeat:
 	}
 
 	write_unlock_irq(&tasklist_lock);
+
+	/*
+	 * Nobody can find the sighand or queue a signal once the task is
+	 * unhashed and its ->sighand cleared: free them out of the lock.
+	 */
+	__cleanup_sighand(sighand);
+	clear_tsk_thread_flag(p, TIF_SIGPENDING);
+	if (group_dead) {
+		flush_sigqueue(&p->signal->shared_pending);
+		tty_kref_put(tty);
+	}
+
 	release_thread(p);
 	call_rcu(&p->rcu, delayed_put_task_struct);
 
@@ -462,6 +477,48 @@ static void exit_mm(struct task_struct *tsk)
 	clear_thread_flag(TIF_MEMDIE);
 }
 
+static struct task_struct *find_alive_thread(struct task_struct *p)
+{
+	struct task_struct *t = p;
+
+	while_each_thread(p, t) {
+		if (!(t->flags & PF_EXITING))
+			return t;
+	}
+	return NULL;
+}
+
+/*
+ * Hand the child_reaper role of our pid namespace over to another thread
+ * if we hold it, or tear the namespace down if we are its last thread.
+ */
+static struct task_struct *find_child_reaper(struct task_struct *father)
+	__releases(&tasklist_lock)
+	__acquires(&tasklist_lock)
+{
+	struct pid_namespace *pid_ns = task_active_pid_ns(father);
+	struct task_struct *reaper = pid_ns->child_reaper;
+
+	if (likely(reaper != father))
+		return reaper;
+
+	reaper = find_alive_thread(father);
+	if (reaper) {
+		pid_ns->child_reaper = reaper;
+		return reaper;
+	}
+
+	write_unlock_irq(&tasklist_lock);
+	if (unlikely(pid_ns == &init_pid_ns)) {
+		panic("Attempted to kill init! exitcode=0x%08x\n",
+			father->signal->group_exit_code ?: father->exit_code);
+	}
+	zap_pid_ns_processes(pid_ns);
+	write_lock_irq(&tasklist_lock);
+
+	return father;
+}
+
 /*
  * When we die, we re-parent all our children, and try to:
  * 1. give them to another thread in our thread group, if such a member exists
@@ -469,33 +526,16 @@ static void exit_mm(struct task_struct *tsk)
  *    child_subreaper for its children (like a service manager)
  * 3. give it to the init process (PID 1) in our pid namespace
  */
-static struct task_struct *find_new_reaper(struct task_struct *father)
-	__releases(&tasklist_lock)
-	__acquires(&tasklist_lock)
+static struct task_struct *find_new_reaper(struct task_struct *father,
+					   struct task_struct *child_reaper)
 {
-	struct pid_namespace *pid_ns = task_active_pid_ns(father);
 	struct task_struct *thread;
 
-	thread = father;
-	while_each_thread(father, thread) {
-		if (thread->flags & PF_EXITING)
-			continue;
-		if (unlikely(pid_ns->child_reaper == father))
-			pid_ns->child_reaper = thread;
+	thread = find_alive_thread(father);
+	if (thread)
 		return thread;
-	}
 
-	if (unlikely(pid_ns->child_reaper == father)) {
-		write_unlock_irq(&tasklist_lock);
-		if (unlikely(pid_ns == &init_pid_ns)) {
-			panic("Attempted to kill init! exitcode=0x%08x\n",
-				father->signal->group_exit_code ?:
-					father->exit_code);
-		}
-
-		zap_pid_ns_processes(pid_ns);
-		write_lock_irq(&tasklist_lock);
-	} else if (father->signal->has_child_subreaper) {
+	if (father->signal->has_child_subreaper) {
 		struct task_struct *reaper;
 
 		/*
@@ -520,7 +560,7 @@ static struct task_struct *find_new_reaper(struct task_struct *father)
 		}
 	}
 
-	return pid_ns->child_reaper;
+	return child_reaper;
 }
 
 /*
@@ -555,19 +595,25 @@ static void reparent_leader(struct task_struct *father, struct task_struct *p,
 	kill_orphaned_pgrp(p, father);
 }
 
-static void forget_original_parent(struct task_struct *father)
+/*
+ * Called with tasklist_lock held for writing. The children that need to be
+ * release_task'd are put on the @dead list.
+ */
+static void forget_original_parent(struct task_struct *father,
+				   struct list_head *dead)
 {
 	struct task_struct *p, *n, *reaper;
-	LIST_HEAD(dead_children);
 
-	write_lock_irq(&tasklist_lock);
 	/*
-	 * Note that exit_ptrace() and find_new_reaper() might
+	 * Note that exit_ptrace() and find_child_reaper() might
 	 * drop tasklist_lock and reacquire it.
 	 */
 	exit_ptrace(father);
-	reaper = find_new_reaper(father);
+	reaper = find_child_reaper(father);
+	if (list_empty(&father->children))
+		return;
 
+	reaper = find_new_reaper(father, reaper);
 	list_for_each_entry_safe(p, n, &father->children, sibling) {
 		struct task_struct *t = p;
 
@@ -581,16 +627,9 @@ static void forget_original_parent(struct task_struct *father)
 				group_send_sig_info(t->pdeath_signal,
 						    SEND_SIG_NOINFO, t);
 		} while_each_thread(p, t);
-		reparent_leader(father, p, &dead_children);
+		reparent_leader(father, p, dead);
 	}
-	write_unlock_irq(&tasklist_lock);
-
 	BUG_ON(!list_empty(&father->children));
-
-	list_for_each_entry_safe(p, n, &dead_children, sibling) {
-		list_del_init(&p->sibling);
-		release_task(p);
-	}
 }
 
 /*
@@ -599,6 +638,8 @@ static void forget_original_parent(struct task_struct *father)
  */
 static void exit_notify(struct task_struct *tsk, int group_dead)
 {
+	struct task_struct *p, *n;
+	LIST_HEAD(dead);
 	bool autoreap;
 
 	/*
@@ -609,9 +650,9 @@ static void exit_notify(struct task_struct *tsk, int group_dead)
 	 *	as a result of our exiting, and if they have any stopped
 	 *	jobs, send them a SIGHUP and then a SIGCONT.  (POSIX 3.2.2.2)
 	 */
-	forget_original_parent(tsk);
-
 	write_lock_irq(&tasklist_lock);
+	forget_original_parent(tsk, &dead);
+
 	if (group_dead)
 		kill_orphaned_pgrp(tsk->group_leader, NULL);
 
@@ -635,6 +676,11 @@ static void exit_notify(struct task_struct *tsk, int group_dead)
 		wake_up_process(tsk->signal->group_exit_task);
 	write_unlock_irq(&tasklist_lock);
 
+	list_for_each_entry_safe(p, n, &dead, sibling) {
+		list_del_init(&p->sibling);
+		release_task(p);
+	}
+
 	/* If the process is dead, release it - nobody will wait for it */
 	if (autoreap)
 		release_task(tsk);
@@ -64,10 +64,12 @@
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
+#include <linux/vmalloc.h>
 
 #include <asm/futex.h>
 
 #include "locking/rtmutex_common.h"
+#include "locking/mcs_spinlock.h"
 
 /*
  * READ this before attempting to hack on futexes!
@@ -253,12 +255,40 @@ struct futex_hash_bucket {
 	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
+	struct optimistic_spin_queue osq;	/* FUTEX_LOCK_SPIN spinners */
 } ____cacheline_aligned_in_smp;
 
 static unsigned long __read_mostly futex_hashsize;
 
 static struct futex_hash_bucket *futex_queues;
 
+#ifdef CONFIG_NUMA
+/*
+ * The process private futexes are hashed into a table on the node of their
+ * mm_struct, which is allocated on the node where the process was forked
+ * or exec'ed, so that the bucket lock and chain of a process mostly stay
+ * on the node where it runs. A node without its own table uses the global
+ * one.
+ */
+static unsigned long __read_mostly futex_hashsize_node;
+
+static struct futex_hash_bucket **futex_queues_node;
+#endif
+
+/*
+ * Opt-in private hash table of a process, see PR_SET_FUTEX_HASH. It keeps
+ * the private futexes of the process away from the buckets of the others.
+ * Only the threads of the process use it, so it is freed with the last
+ * mm_users reference.
+ */
+struct futex_private_hash {
+	unsigned long			hashsize;
+	struct futex_hash_bucket	queues[];
+};
+
+#define FUTEX_PRIVATE_HASH_MIN		16
+#define FUTEX_PRIVATE_HASH_PER_THREAD	4
+
 static inline void futex_get_mm(union futex_key *key)
 {
 	atomic_inc(&key->private.mm->mm_count);
@@ -312,6 +342,22 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+
+	if (!(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED))) {
+		struct futex_private_hash *fph = key->private.mm->futex_hash;
+
+		if (fph)
+			return &fph->queues[hash & (fph->hashsize - 1)];
+#ifdef CONFIG_NUMA
+		if (futex_queues_node) {
+			int node = page_to_nid(virt_to_page(key->private.mm));
+			struct futex_hash_bucket *queues = futex_queues_node[node];
+
+			if (queues)
+				return &queues[hash & (futex_hashsize_node - 1)];
+		}
+#endif
+	}
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
@@ -1177,14 +1223,10 @@ static int wake_futex_pi(u32 __user *uaddr, u32 uval, struct futex_q *this)
 static inline void
 double_lock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 {
-	if (hb1 <= hb2) {
+	if (hb1 == hb2)
 		spin_lock(&hb1->lock);
-		if (hb1 < hb2)
-			spin_lock_nested(&hb2->lock, SINGLE_DEPTH_NESTING);
-	} else { /* hb1 > hb2 */
-		spin_lock(&hb2->lock);
-		spin_lock_nested(&hb1->lock, SINGLE_DEPTH_NESTING);
-	}
+	else
+		spin_lock_pair(&hb1->lock, &hb2->lock);
 }
 
 static inline void
@@ -2246,6 +2288,205 @@ static long futex_wait_restart(struct restart_block *restart)
 }
 
 
+/*
+ * Adaptive spinning futex locks
+ *
+ * The futex word of a FUTEX_LOCK_SPIN lock holds the TID of its owner, as
+ * with the PI futexes: 0 when unlocked, the owner TID, possibly with
+ * FUTEX_WAITERS, when locked. Userspace locks with a 0 -> TID cmpxchg and
+ * calls FUTEX_LOCK_SPIN when that fails. It unlocks by exchanging the word
+ * with 0, and calls FUTEX_WAKE for one waiter if FUTEX_WAITERS was set.
+ *
+ * While the owner is running on a CPU, FUTEX_LOCK_SPIN spins in the kernel
+ * for the lock to be released. The spinners queue on the osq of the hash
+ * bucket so that only one of them at a time polls the futex word. When the
+ * owner isn't running, or can't be found in our pid namespace, the locker
+ * sets FUTEX_WAITERS and sleeps as FUTEX_WAIT does.
+ *
+ * A locker that has slept takes the lock with FUTEX_WAITERS set, as it
+ * can't tell whether other waiters still sleep. The FUTEX_OWNER_DIED bit
+ * left by the robust futex exit handling is kept for userspace to see.
+ */
+
+/*
+ * Try to take the lock from the unlocked value uval.
+ * Return: 1 if taken, 0 if the futex word changed, or -EFAULT
+ */
+static int futex_lock_spin_acquire(u32 __user *uaddr, u32 uval, u32 newval)
+{
+	u32 curval;
+
+	newval |= uval & (FUTEX_WAITERS | FUTEX_OWNER_DIED);
+	if (cmpxchg_futex_value_locked(&curval, uaddr, uval, newval))
+		return -EFAULT;
+	return curval == uval;
+}
+
+#ifdef CONFIG_SMP
+/*
+ * Spin while the owner of the lock runs, trying to take the lock with
+ * newval when it is released.
+ * Return: 1 if the lock was taken, 0 if the caller has to sleep, or -EFAULT
+ * if the futex word has to be faulted in.
+ */
+static int futex_spin_on_owner(u32 __user *uaddr, struct futex_hash_bucket *hb,
+			       u32 newval)
+{
+	struct task_struct *owner = NULL;
+	u32 uval, tid = 0;
+	int ret = 0;
+
+	preempt_disable();
+	if (!osq_lock(&hb->osq))
+		goto out;
+
+	rcu_read_lock();
+	for (;;) {
+		ret = get_futex_value_locked(&uval, uaddr);
+		if (ret)
+			break;
+
+		if (!(uval & FUTEX_TID_MASK)) {
+			ret = futex_lock_spin_acquire(uaddr, uval, newval);
+			if (ret)
+				break;
+			continue;
+		}
+
+		if ((uval & FUTEX_TID_MASK) != tid) {
+			tid = uval & FUTEX_TID_MASK;
+			owner = find_task_by_vpid(tid);
+			if (!owner || owner == current)
+				break;
+		}
+
+		/*
+		 * The owner is RCU protected, it doesn't matter if it dropped
+		 * the lock and exited since we read the futex word.
+		 */
+		if (!owner->on_cpu || vcpu_is_preempted(task_cpu(owner)) ||
+		    need_resched())
+			break;
+
+		cpu_relax_lowlatency();
+	}
+	rcu_read_unlock();
+	osq_unlock(&hb->osq);
+out:
+	preempt_enable();
+	return ret;
+}
+#else
+static inline int futex_spin_on_owner(u32 __user *uaddr,
+				      struct futex_hash_bucket *hb, u32 newval)
+{
+	return 0;
+}
+#endif
+
+static int futex_lock_spin(u32 __user *uaddr, unsigned int flags,
+			   ktime_t *time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_hash_bucket *hb;
+	struct futex_q q = futex_q_init;
+	u32 uval, curval, vpid = task_pid_vnr(current);
+	u32 waiters = 0;
+	int ret;
+
+	if (time) {
+		to = &timeout;
+		hrtimer_init_on_stack(&to->timer, CLOCK_REALTIME,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires(&to->timer, *time);
+	}
+
+retry:
+	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &q.key, VERIFY_WRITE);
+	if (unlikely(ret != 0))
+		goto out;
+
+	/* A fault is handled below */
+	if (futex_spin_on_owner(uaddr, hash_futex(&q.key), vpid | waiters) > 0) {
+		ret = 0;
+		goto out_put_key;
+	}
+
+retry_private:
+	hb = queue_lock(&q);
+
+	ret = get_futex_value_locked(&uval, uaddr);
+	if (unlikely(ret))
+		goto uaddr_faulted;
+
+	if (!(uval & FUTEX_TID_MASK)) {
+		ret = futex_lock_spin_acquire(uaddr, uval, vpid | waiters);
+		if (unlikely(ret < 0))
+			goto uaddr_faulted;
+		queue_unlock(hb);
+		if (!ret)
+			goto retry_private;
+		ret = 0;
+		goto out_put_key;
+	}
+
+	if (unlikely((uval & FUTEX_TID_MASK) == vpid)) {
+		queue_unlock(hb);
+		ret = -EDEADLK;
+		goto out_put_key;
+	}
+
+	if (!(uval & FUTEX_WAITERS)) {
+		ret = cmpxchg_futex_value_locked(&curval, uaddr, uval,
+						 uval | FUTEX_WAITERS);
+		if (unlikely(ret))
+			goto uaddr_faulted;
+		if (curval != uval) {
+			queue_unlock(hb);
+			goto retry_private;
+		}
+	}
+
+	/* queue_me and wait for the FUTEX_WAKE of the unlock */
+	futex_wait_queue_me(hb, &q, to);
+	waiters = FUTEX_WAITERS;
+
+	/* unqueue_me() drops q.key ref, a woken locker tries again */
+	if (!unqueue_me(&q))
+		goto retry;
+	ret = -ETIMEDOUT;
+	if (to && !to->task)
+		goto out;
+	if (!signal_pending(current))
+		goto retry;
+	/* The timeout is absolute, the syscall can be restarted as it is */
+	ret = -ERESTARTNOINTR;
+	goto out;
+
+uaddr_faulted:
+	queue_unlock(hb);
+
+	ret = fault_in_user_writeable(uaddr);
+	if (ret)
+		goto out_put_key;
+
+	if (!(flags & FLAGS_SHARED))
+		goto retry_private;
+
+	put_futex_key(&q.key);
+	goto retry;
+
+out_put_key:
+	put_futex_key(&q.key);
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+	return ret;
+}
+
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
  * and failed. The kernel side here does the whole locking operation:
@@ -2927,6 +3168,7 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	case FUTEX_TRYLOCK_PI:
 	case FUTEX_WAIT_REQUEUE_PI:
 	case FUTEX_CMP_REQUEUE_PI:
+	case FUTEX_LOCK_SPIN:
 		if (!futex_cmpxchg_enabled)
 			return -ENOSYS;
 	}
@@ -2958,6 +3200,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_LOCK_SPIN:
+		return futex_lock_spin(uaddr, flags, timeout);
 	}
 	return -ENOSYS;
 }
@@ -2974,7 +3218,8 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_LOCK_SPIN)) {
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&ts))
@@ -3016,6 +3261,120 @@ static void __init futex_detect_cmpxchg(void)
 #endif
 }
 
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+	osq_lock_init(&hb->osq);
+}
+
+/**
+ * futex_hash_set() - set up the private futex hash table of the process
+ * @nr_threads:	the number of threads the table is sized for, or 0 to go
+ *		back to the global table
+ *
+ * The table can be set and resized only while the process has a single
+ * thread, when no private futex of the process can be queued or looked up
+ * concurrently.
+ *
+ * Return: 0 on success, -EBUSY if the mm is shared, -ENOMEM.
+ */
+int futex_hash_set(unsigned long nr_threads)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_private_hash *fph = NULL;
+	unsigned long hashsize, i;
+
+	if (!mm)
+		return -EINVAL;
+	if (atomic_read(&mm->mm_users) != 1)
+		return -EBUSY;
+
+	if (nr_threads) {
+		nr_threads = min(nr_threads, futex_hashsize);
+		hashsize = roundup_pow_of_two(max_t(unsigned long,
+				nr_threads * FUTEX_PRIVATE_HASH_PER_THREAD,
+				FUTEX_PRIVATE_HASH_MIN));
+		hashsize = min(hashsize, futex_hashsize);
+
+		fph = kmalloc(sizeof(*fph) + hashsize * sizeof(fph->queues[0]),
+			      GFP_KERNEL | __GFP_NOWARN);
+		if (!fph)
+			fph = vmalloc(sizeof(*fph) +
+				      hashsize * sizeof(fph->queues[0]));
+		if (!fph)
+			return -ENOMEM;
+
+		fph->hashsize = hashsize;
+		for (i = 0; i < hashsize; i++)
+			futex_hash_bucket_init(&fph->queues[i]);
+	}
+
+	futex_hash_free(mm);
+	mm->futex_hash = fph;
+	return 0;
+}
+
+/**
+ * futex_hash_get() - the size of the private futex hash table
+ *
+ * Return: the number of buckets, 0 if the process uses the global table.
+ */
+int futex_hash_get(void)
+{
+	struct mm_struct *mm = current->mm;
+
+	if (!mm)
+		return -EINVAL;
+	return mm->futex_hash ? mm->futex_hash->hashsize : 0;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+
+#ifdef CONFIG_NUMA
+/*
+ * Split the private futexes across the per-node tables, each sized for the
+ * CPUs of one node. The global table keeps its size for the shared ones.
+ */
+static void __init futex_init_node(void)
+{
+	unsigned long i, size;
+	int node;
+
+	if (nr_node_ids == 1)
+		return;
+
+	futex_queues_node = kcalloc(nr_node_ids, sizeof(*futex_queues_node),
+				    GFP_KERNEL);
+	if (!futex_queues_node)
+		return;
+
+	futex_hashsize_node = max(16UL, futex_hashsize / nr_node_ids);
+	size = futex_hashsize_node * sizeof(struct futex_hash_bucket);
+
+	for_each_node_state(node, N_MEMORY) {
+		struct futex_hash_bucket *queues;
+
+		queues = kmalloc_node(size, GFP_KERNEL | __GFP_NOWARN, node);
+		if (!queues)
+			queues = vmalloc_node(size, node);
+		if (!queues)
+			continue;
+
+		for (i = 0; i < futex_hashsize_node; i++)
+			futex_hash_bucket_init(&queues[i]);
+		futex_queues_node[node] = queues;
+	}
+}
+#else
+static inline void futex_init_node(void) { }
+#endif
+
 static int __init futex_init(void)
 {
 	unsigned int futex_shift;
@@ -3036,11 +3395,10 @@ static int __init futex_init(void)
 
 	futex_detect_cmpxchg();
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	for (i = 0; i < futex_hashsize; i++)
+		futex_hash_bucket_init(&futex_queues[i]);
+
+	futex_init_node();
 
 	return 0;
 }
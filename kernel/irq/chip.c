@@ -191,6 +191,7 @@ int irq_startup(struct irq_desc *desc, bool resend)
 
 void irq_shutdown(struct irq_desc *desc)
 {
+	irq_fastpath_stop(desc);
 	irq_state_set_disabled(desc);
 	desc->depth = 1;
 	if (desc->irq_data.chip->irq_shutdown)
@@ -227,6 +228,7 @@ void irq_enable(struct irq_desc *desc)
  */
 void irq_disable(struct irq_desc *desc)
 {
+	irq_fastpath_stop(desc);
 	irq_state_set_disabled(desc);
 	if (desc->irq_data.chip->irq_disable) {
 		desc->irq_data.chip->irq_disable(&desc->irq_data);
@@ -556,10 +558,132 @@ EXPORT_SYMBOL_GPL(handle_fasteoi_irq);
  *	of the loop which handles the interrupts which have arrived while
  *	the handler was running. If all pending interrupts are handled, the
  *	loop is left.
+ *
+ *	Interrupts requested with IRQF_NOBALANCING whose affinity is a
+ *	single cpu are handled without desc->lock once the locked path has
+ *	seen them enabled on that cpu: only that cpu can receive them, so
+ *	the handler cannot race with itself. Anything which changes the
+ *	state of the interrupt stops the lockless mode under desc->lock
+ *	first, see irq_fastpath_stop(). The lockless handler does not set
+ *	IRQD_IRQ_INPROGRESS, so threaded and oneshot actions always take
+ *	the locked path.
+ */
+#ifdef CONFIG_SMP
+static void irq_fastpath_sync_fn(void *info)
+{
+}
+
+/**
+ *	irq_fastpath_sync - wait for lockless edge handlers to complete
+ *	@desc:	the interrupt description structure for this irq
+ *
+ *	The lockless handler runs with interrupts disabled on its cpu, so
+ *	once that cpu has handled an IPI it has left every handler which
+ *	might have seen the old desc->fast_cpu. From atomic context we can
+ *	only wait for desc->fast_running to clear.
  */
+void irq_fastpath_sync(struct irq_desc *desc)
+{
+	unsigned long flags;
+	int cpu;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	cpu = desc->fast_last_cpu;
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+	if (cpu < 0)
+		return;
+
+	if (irqs_disabled() || in_interrupt()) {
+		/*
+		 * Pairs with the barrier in handle_edge_irq_fast(): either
+		 * it sees fast_cpu cleared or we see fast_running set.
+		 */
+		smp_mb();
+		while (ACCESS_ONCE(desc->fast_running))
+			cpu_relax();
+		return;
+	}
+
+	smp_call_function_single(cpu, irq_fastpath_sync_fn, NULL, 1);
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	if (desc->fast_last_cpu == cpu)
+		desc->fast_last_cpu = -1;
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+}
+
+/* Called with desc->lock held at the end of the locked edge flow */
+static void irq_fastpath_start(struct irq_desc *desc)
+{
+	struct irqaction *action;
+	int cpu = smp_processor_id();
+
+	if (!irq_settings_has_no_balance_set(desc) || desc->fast_cpu >= 0 ||
+	    desc->fast_block)
+		return;
+
+	if (irqd_irq_disabled(&desc->irq_data) ||
+	    irqd_is_setaffinity_pending(&desc->irq_data) ||
+	    !desc->action || (desc->istate & IRQS_PENDING) ||
+	    desc->irq_data.chip->irq_bus_lock)
+		return;
+
+	if (!cpumask_equal(desc->irq_data.affinity, cpumask_of(cpu)))
+		return;
+
+	for (action = desc->action; action; action = action->next) {
+		if (action->thread_fn || (action->flags & IRQF_ONESHOT))
+			return;
+	}
+
+	ACCESS_ONCE(desc->fast_cpu) = cpu;
+}
+
+static bool handle_edge_irq_fast(unsigned int irq, struct irq_desc *desc)
+{
+	struct irqaction *action;
+
+	if (ACCESS_ONCE(desc->fast_cpu) != smp_processor_id())
+		return false;
+
+	/*
+	 * Pairs with the barrier in irq_fastpath_sync(): either it sees
+	 * fast_running set or we see fast_cpu cleared.
+	 */
+	ACCESS_ONCE(desc->fast_running) = 1;
+	smp_mb();
+	if (unlikely(ACCESS_ONCE(desc->fast_cpu) != smp_processor_id()))
+		goto out_locked;
+
+	action = ACCESS_ONCE(desc->action);
+	if (unlikely(!action))
+		goto out_locked;
+
+	kstat_incr_irqs_this_cpu(irq, desc);
+	desc->irq_data.chip->irq_ack(&desc->irq_data);
+	handle_irq_event_percpu(desc, action);
+	smp_store_release(&desc->fast_running, 0);
+	return true;
+
+out_locked:
+	ACCESS_ONCE(desc->fast_running) = 0;
+	return false;
+}
+#else
+static inline void irq_fastpath_start(struct irq_desc *desc) { }
+static inline bool handle_edge_irq_fast(unsigned int irq,
+					struct irq_desc *desc)
+{
+	return false;
+}
+#endif
+
 void
 handle_edge_irq(unsigned int irq, struct irq_desc *desc)
 {
+	if (handle_edge_irq_fast(irq, desc))
+		return;
+
 	raw_spin_lock(&desc->lock);
 
 	desc->istate &= ~(IRQS_REPLAY | IRQS_WAITING);
@@ -607,6 +731,7 @@ handle_edge_irq(unsigned int irq, struct irq_desc *desc)
 	} while ((desc->istate & IRQS_PENDING) &&
 		 !irqd_irq_disabled(&desc->irq_data));
 
+	irq_fastpath_start(desc);
 out_unlock:
 	raw_spin_unlock(&desc->lock);
 }
@@ -87,6 +87,22 @@ extern void init_kstat_irqs(struct irq_desc *desc, int node, int nr);
 irqreturn_t handle_irq_event_percpu(struct irq_desc *desc, struct irqaction *action);
 irqreturn_t handle_irq_event(struct irq_desc *desc);
 
+/* Lockless edge handling of pinned interrupts, see handle_edge_irq() */
+#ifdef CONFIG_SMP
+/* Called with desc->lock held */
+static inline void irq_fastpath_stop(struct irq_desc *desc)
+{
+	if (desc->fast_cpu >= 0) {
+		desc->fast_last_cpu = desc->fast_cpu;
+		ACCESS_ONCE(desc->fast_cpu) = -1;
+	}
+}
+extern void irq_fastpath_sync(struct irq_desc *desc);
+#else
+static inline void irq_fastpath_stop(struct irq_desc *desc) { }
+static inline void irq_fastpath_sync(struct irq_desc *desc) { }
+#endif
+
 /* Resending of interrupts :*/
 void check_irq_resend(struct irq_desc *desc, unsigned int irq);
 bool irq_wait_for_poll(struct irq_desc *desc);
@@ -57,6 +57,10 @@ static void desc_smp_init(struct irq_desc *desc, int node)
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_clear(desc->pending_mask);
 #endif
+	desc->fast_cpu = -1;
+	desc->fast_last_cpu = -1;
+	desc->fast_block = 0;
+	desc->fast_running = 0;
 }
 
 static inline int desc_node(struct irq_desc *desc)
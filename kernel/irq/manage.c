@@ -53,6 +53,9 @@ static void __synchronize_hardirq(struct irq_desc *desc)
 
 		/* Oops, that failed? */
 	} while (inprogress);
+
+	/* And for handlers which ran without taking desc->lock */
+	irq_fastpath_sync(desc);
 }
 
 /**
@@ -202,6 +205,8 @@ int irq_set_affinity_locked(struct irq_data *data, const struct cpumask *mask,
 	if (!chip || !chip->irq_set_affinity)
 		return -EINVAL;
 
+	irq_fastpath_stop(desc);
+
 	if (irq_can_move_pcntxt(data)) {
 		ret = irq_do_set_affinity(data, mask, force);
 	} else {
@@ -227,8 +232,20 @@ int __irq_set_affinity(unsigned int irq, const struct cpumask *mask, bool force)
 	if (!desc)
 		return -EINVAL;
 
+	/*
+	 * Make sure no lockless edge handler is still running on the old
+	 * cpu before the interrupt can arrive on the new one, and keep it
+	 * from being restarted until the new affinity is in place.
+	 */
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	desc->fast_block++;
+	irq_fastpath_stop(desc);
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+	irq_fastpath_sync(desc);
+
 	raw_spin_lock_irqsave(&desc->lock, flags);
 	ret = irq_set_affinity_locked(irq_desc_get_irq_data(desc), mask, force);
+	desc->fast_block--;
 	raw_spin_unlock_irqrestore(&desc->lock, flags);
 	return ret;
 }
@@ -1197,6 +1214,9 @@ __setup_irq(unsigned int irq, struct irq_desc *desc, struct irqaction *new)
 				   irq, nmsk, omsk);
 	}
 
+	/* A lockless edge handler must not run a threaded action */
+	irq_fastpath_stop(desc);
+
 	new->irq = irq;
 	*old_ptr = new;
 
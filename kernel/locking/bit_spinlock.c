@@ -0,0 +1,68 @@
+/*
+ * Queued bit spinlocks, see include/linux/bit_spinlock.h
+ *
+ * The waiters of a contended bit spinlock queue on the MCS tail of a small
+ * hashed table, keyed by the lock address and bit. Only the queue head
+ * spins on the word holding the bit; the others spin on their own queue
+ * node, so they stop pulling that cacheline, and the data it usually
+ * shares with the bit, away from the lock holder. The head takes the bit
+ * and passes the queue on before entering its critical section.
+ *
+ * Unrelated locks hashing to the same queue wait behind each other, so a
+ * waiter may only queue while it holds nothing the queue head may be
+ * waiting for: no spinlock, no other bit spinlock and no interrupt state.
+ * This is read from the preemption count, which the spinning locks raise.
+ * The other waiters spin on the bit as before.
+ *
+ * This file is released under the GPL v2.
+ */
+#include <linux/bit_spinlock.h>
+#include <linux/cache.h>
+#include <linux/export.h>
+#include <linux/hardirq.h>
+#include <linux/hash.h>
+#include "mcs_spinlock.h"
+
+#define BIT_SPIN_HASH_BITS	6
+
+static struct bit_spin_queue {
+	struct mcs_spinlock *tail;
+} ____cacheline_aligned_in_smp bit_spin_queues[1 << BIT_SPIN_HASH_BITS];
+
+static inline struct mcs_spinlock **bit_spin_tail(int bitnum,
+						  unsigned long *addr)
+{
+	unsigned long key = (unsigned long)addr + bitnum;
+
+	return &bit_spin_queues[hash_long(key, BIT_SPIN_HASH_BITS)].tail;
+}
+
+/*
+ * Called with preemption disabled once by bit_spin_lock(), after the bit
+ * was found set.
+ */
+void __bit_spin_lock_slowpath(int bitnum, unsigned long *addr)
+{
+	struct mcs_spinlock node, **tail;
+
+	if (preempt_count() != PREEMPT_CHECK_OFFSET || irqs_disabled()) {
+		while (unlikely(test_and_set_bit_lock(bitnum, addr))) {
+			preempt_enable();
+			do {
+				cpu_relax();
+			} while (test_bit(bitnum, addr));
+			preempt_disable();
+		}
+		return;
+	}
+
+	tail = bit_spin_tail(bitnum, addr);
+	mcs_spin_lock(tail, &node);
+	while (test_and_set_bit_lock(bitnum, addr)) {
+		do {
+			cpu_relax();
+		} while (test_bit(bitnum, addr));
+	}
+	mcs_spin_unlock(tail, &node);
+}
+EXPORT_SYMBOL(__bit_spin_lock_slowpath);
@@ -0,0 +1,109 @@
+/*
+ * Combining locks, see include/linux/combining_lock.h
+ *
+ * The lock is the tail of an MCS queue of nodes on the stacks of the CPUs
+ * running an operation, as in the queue of the queue spinlock. The CPU
+ * that finds the queue empty holds the lock: it runs its own operation,
+ * then follows the next pointers and runs the operations of the following
+ * nodes, marking each of them done as it goes. It releases the lock by
+ * clearing the tail once it catches up with it, or hands it over to the
+ * next node after COMBINING_MAX_OPS operations, to bound the time spent on
+ * the operations of others.
+ *
+ * A node is only marked done once its next pointer has been read, as its
+ * stack frame may be gone right after.
+ *
+ * This file is released under the GPL v2.
+ */
+#include <linux/combining_lock.h>
+#include <linux/export.h>
+#include <linux/preempt.h>
+#include <asm/processor.h>
+
+/* The operations run for the other CPUs in a single lock hold */
+#define COMBINING_MAX_OPS	64
+
+enum {
+	COMBINING_WAIT,		/* queued */
+	COMBINING_DONE,		/* the operation was run by the lock holder */
+	COMBINING_LOCKED,	/* the lock was handed over */
+};
+
+struct combining_node {
+	struct combining_node	*next;
+	struct combining_op	*op;
+	int			status;
+};
+
+void __combining_lock_init(struct combining_lock *lock, const char *name,
+			   struct lock_class_key *key)
+{
+	lock->tail = NULL;
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+	lockdep_init_map(&lock->dep_map, name, key, 0);
+#endif
+}
+EXPORT_SYMBOL(__combining_lock_init);
+
+static inline void combining_run_op(struct combining_op *op, bool contended)
+{
+	op->contended = contended;
+	op->func(op);
+}
+
+/**
+ * combining_lock_run - run an operation under a combining lock
+ * @lock: Pointer to the combining lock
+ * @op  : The operation, op->func is called with the lock held
+ *
+ * Return once the operation has been run, by this CPU or by the CPU that
+ * held the lock while it was queued.
+ */
+void combining_lock_run(struct combining_lock *lock, struct combining_op *op)
+{
+	struct combining_node node = { .op = op };
+	struct combining_node *prev, *cur, *next;
+	int status, nr = 0;
+
+	preempt_disable();
+	lock_map_acquire(&lock->dep_map);
+
+	prev = xchg(&lock->tail, &node);
+	if (prev) {
+		ACCESS_ONCE(prev->next) = &node;
+
+		while (!(status = smp_load_acquire(&node.status)))
+			cpu_relax_lowlatency();
+		if (status == COMBINING_DONE)
+			goto out;
+	}
+
+	/*
+	 * We hold the lock, run our operation and those queued behind it.
+	 */
+	combining_run_op(op, prev != NULL);
+	for (cur = &node; ; cur = next) {
+		next = ACCESS_ONCE(cur->next);
+		if (!next) {
+			if (cmpxchg(&lock->tail, cur, NULL) == cur)
+				break;
+			/* Wait for the next node to link itself */
+			while (!(next = ACCESS_ONCE(cur->next)))
+				cpu_relax_lowlatency();
+		}
+		if (cur != &node)
+			smp_store_release(&cur->status, COMBINING_DONE);
+
+		if (++nr > COMBINING_MAX_OPS) {
+			smp_store_release(&next->status, COMBINING_LOCKED);
+			goto out;
+		}
+		combining_run_op(next->op, true);
+	}
+	if (cur != &node)
+		smp_store_release(&cur->status, COMBINING_DONE);
+out:
+	lock_map_release(&lock->dep_map);
+	preempt_enable();
+}
+EXPORT_SYMBOL(combining_lock_run);
@@ -3,6 +3,7 @@
 #include <linux/lglock.h>
 #include <linux/cpu.h>
 #include <linux/string.h>
+#include <linux/rcupdate.h>
 
 /*
  * Note there is no uninit, so lglocks cannot be defined in
@@ -79,11 +80,114 @@ void lg_global_unlock(struct lglock *lg)
 	int i;
 
 	lock_release(&lg->lock_dep_map, 1, _RET_IP_);
+	pv_kick_batch_start();
 	for_each_possible_cpu(i) {
 		arch_spinlock_t *lock;
 		lock = per_cpu_ptr(lg->lock, i);
 		arch_spin_unlock(lock);
 	}
+	pv_kick_batch_end();
 	preempt_enable();
 }
 EXPORT_SYMBOL(lg_global_unlock);
+
+void lg_rcu_lock_init(struct lglock_rcu *lg, char *name)
+{
+	LOCKDEP_INIT_MAP(&lg->lock_dep_map, name, &lg->lock_key, 0);
+}
+EXPORT_SYMBOL(lg_rcu_lock_init);
+
+/*
+ * The acquire load of the global count pairs with the full barrier of its
+ * decrement in lg_rcu_global_unlock(), so that a fastpath local locker
+ * sees everything done under the last global lock.
+ */
+static inline void __lg_rcu_local_lock(struct lglock_rcu *lg,
+				       struct lglock_rcu_cpu *lc)
+{
+	if (likely(!smp_load_acquire(&lg->global.counter))) {
+		arch_spin_lock(&lc->lock);
+		lc->slow = false;
+		return;
+	}
+
+	arch_read_lock(&lg->rwlock);
+	arch_spin_lock(&lc->lock);
+	lc->slow = true;
+}
+
+static inline void __lg_rcu_local_unlock(struct lglock_rcu *lg,
+					 struct lglock_rcu_cpu *lc)
+{
+	bool slow = lc->slow;
+
+	arch_spin_unlock(&lc->lock);
+	if (slow)
+		arch_read_unlock(&lg->rwlock);
+}
+
+void lg_rcu_local_lock(struct lglock_rcu *lg)
+{
+	preempt_disable();
+	lock_acquire_shared(&lg->lock_dep_map, 0, 0, NULL, _RET_IP_);
+	__lg_rcu_local_lock(lg, this_cpu_ptr(lg->lock));
+}
+EXPORT_SYMBOL(lg_rcu_local_lock);
+
+void lg_rcu_local_unlock(struct lglock_rcu *lg)
+{
+	lock_release(&lg->lock_dep_map, 1, _RET_IP_);
+	__lg_rcu_local_unlock(lg, this_cpu_ptr(lg->lock));
+	preempt_enable();
+}
+EXPORT_SYMBOL(lg_rcu_local_unlock);
+
+void lg_rcu_local_lock_cpu(struct lglock_rcu *lg, int cpu)
+{
+	preempt_disable();
+	lock_acquire_shared(&lg->lock_dep_map, 0, 0, NULL, _RET_IP_);
+	__lg_rcu_local_lock(lg, per_cpu_ptr(lg->lock, cpu));
+}
+EXPORT_SYMBOL(lg_rcu_local_lock_cpu);
+
+void lg_rcu_local_unlock_cpu(struct lglock_rcu *lg, int cpu)
+{
+	lock_release(&lg->lock_dep_map, 1, _RET_IP_);
+	__lg_rcu_local_unlock(lg, per_cpu_ptr(lg->lock, cpu));
+	preempt_enable();
+}
+EXPORT_SYMBOL(lg_rcu_local_unlock_cpu);
+
+void lg_rcu_global_lock(struct lglock_rcu *lg)
+{
+	might_sleep();
+	atomic_inc(&lg->global);
+	mutex_lock(&lg->mutex);
+	/*
+	 * Wait for the local lockers that haven't seen the global count;
+	 * the ones that come later take the rwlock.
+	 */
+	if (!lg->synced) {
+		synchronize_sched();
+		lg->synced = true;
+	}
+	preempt_disable();
+	lock_acquire_exclusive(&lg->lock_dep_map, 0, 0, NULL, _RET_IP_);
+	arch_write_lock(&lg->rwlock);
+}
+EXPORT_SYMBOL(lg_rcu_global_lock);
+
+void lg_rcu_global_unlock(struct lglock_rcu *lg)
+{
+	lock_release(&lg->lock_dep_map, 1, _RET_IP_);
+	arch_write_unlock(&lg->rwlock);
+	preempt_enable();
+	/*
+	 * The next global locker needs a new grace period only if the local
+	 * lockers may have gone back to the fastpath in the meantime.
+	 */
+	if (!atomic_dec_return(&lg->global))
+		lg->synced = false;
+	mutex_unlock(&lg->mutex);
+}
+EXPORT_SYMBOL(lg_rcu_global_unlock);
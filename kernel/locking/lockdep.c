@@ -225,6 +225,9 @@ struct lock_class_stats lock_stats(struct lock_class *class)
 
 		for (i = 0; i < ARRAY_SIZE(stats.bounces); i++)
 			stats.bounces[i] += pcs->bounces[i];
+
+		for (i = 0; i < ARRAY_SIZE(stats.sleeps); i++)
+			stats.sleeps[i] += pcs->sleeps[i];
 	}
 
 	return stats;
@@ -305,6 +308,19 @@ static struct list_head classhash_table[CLASSHASH_SIZE];
 
 static struct list_head chainhash_table[CHAINHASH_SIZE];
 
+/*
+ * Each CPU also keeps the keys of the chains it has recently hit in a
+ * small direct-mapped cache, so that its common chains are found without
+ * walking the shared hash list. The chains are never removed once added,
+ * except by lockdep_reset(), so a cached key is always valid. 0 marks an
+ * empty entry. The cache is only accessed with interrupts disabled.
+ */
+#define CHAIN_CACHE_BITS	6
+#define CHAIN_CACHE_SIZE	(1UL << CHAIN_CACHE_BITS)
+#define chaincacheentry(chain)	hash_long(chain, CHAIN_CACHE_BITS)
+
+static DEFINE_PER_CPU(u64 [CHAIN_CACHE_SIZE], chain_cache);
+
 /*
  * The hash key of the lock dependency chains is a hash itself too:
  * it's a hash of all locks taken up to that lock, including that lock.
@@ -2018,13 +2034,20 @@ static inline int lookup_chain_cache(struct task_struct *curr,
 	 */
 	if (DEBUG_LOCKS_WARN_ON(!irqs_disabled()))
 		return 0;
+	if (chain_key &&
+	    __this_cpu_read(chain_cache[chaincacheentry(chain_key)]) == chain_key) {
+		debug_atomic_inc(chain_cache_hits);
+		return 0;
+	}
 	/*
 	 * We can walk it lock-free, because entries only get added
 	 * to the hash:
 	 */
-	list_for_each_entry(chain, hash_head, entry) {
+	list_for_each_entry_rcu(chain, hash_head, entry) {
 		if (chain->chain_key == chain_key) {
 cache_hit:
+			__this_cpu_write(chain_cache[chaincacheentry(chain_key)],
+					 chain_key);
 			debug_atomic_inc(chain_lookup_hits);
 			if (very_verbose(class))
 				printk("\nhash chain already cached, key: "
@@ -2081,6 +2104,7 @@ cache_hit:
 		chain_hlocks[chain->base + j] = class - lock_classes;
 	}
 	list_add_tail_rcu(&chain->entry, hash_head);
+	__this_cpu_write(chain_cache[chaincacheentry(chain_key)], chain_key);
 	debug_atomic_inc(chain_lookup_misses);
 	inc_chains();
 
@@ -3797,6 +3821,48 @@ found_it:
 	lock->ip = ip;
 }
 
+/*
+ * The contended acquisition of a sleeping lock that can also be obtained by
+ * spinning had to go to sleep. The difference with the contentions is the
+ * number of times the spinning did the job.
+ */
+static void
+__lock_slept(struct lockdep_map *lock)
+{
+	struct task_struct *curr = current;
+	struct held_lock *hlock, *prev_hlock;
+	struct lock_class_stats *stats;
+	unsigned int depth;
+	int i;
+
+	depth = curr->lockdep_depth;
+	if (DEBUG_LOCKS_WARN_ON(!depth))
+		return;
+
+	prev_hlock = NULL;
+	for (i = depth-1; i >= 0; i--) {
+		hlock = curr->held_locks + i;
+		/*
+		 * We must not cross into another context:
+		 */
+		if (prev_hlock && prev_hlock->irq_context != hlock->irq_context)
+			break;
+		if (match_held_lock(hlock, lock))
+			goto found_it;
+		prev_hlock = hlock;
+	}
+	print_lock_contention_bug(curr, lock, _RET_IP_);
+	return;
+
+found_it:
+	if (hlock->instance != lock)
+		return;
+
+	stats = get_lock_stats(hlock_class(hlock));
+	stats->sleeps[!!hlock->read]++;
+	put_lock_stats(stats);
+}
+
 void lock_contended(struct lockdep_map *lock, unsigned long ip)
 {
 	unsigned long flags;
@@ -3835,6 +3901,25 @@ void lock_acquired(struct lockdep_map *lock, unsigned long ip)
 	raw_local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(lock_acquired);
+
+void lock_slept(struct lockdep_map *lock)
+{
+	unsigned long flags;
+
+	if (unlikely(!lock_stat))
+		return;
+
+	if (unlikely(current->lockdep_recursion))
+		return;
+
+	raw_local_irq_save(flags);
+	check_flags(flags);
+	current->lockdep_recursion = 1;
+	__lock_slept(lock);
+	current->lockdep_recursion = 0;
+	raw_local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(lock_slept);
 #endif
 
 /*
@@ -3858,6 +3943,9 @@ void lockdep_reset(void)
 	debug_locks = 1;
 	for (i = 0; i < CHAINHASH_SIZE; i++)
 		INIT_LIST_HEAD(chainhash_table + i);
+	for_each_possible_cpu(i)
+		memset(per_cpu(chain_cache, i), 0,
+		       sizeof(u64) * CHAIN_CACHE_SIZE);
 	raw_local_irq_restore(flags);
 }
 
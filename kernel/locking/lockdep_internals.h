@@ -119,6 +119,7 @@ lockdep_count_backward_deps(struct lock_class *class)
  */
 struct lockdep_stats {
 	int	chain_lookup_hits;
+	int	chain_cache_hits;
 	int	chain_lookup_misses;
 	int	hardirqs_on_events;
 	int	hardirqs_off_events;
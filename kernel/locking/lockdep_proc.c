@@ -197,6 +197,8 @@ static void lockdep_stats_debug_show(struct seq_file *m)
 		debug_atomic_read(chain_lookup_misses));
 	seq_printf(m, " chain lookup hits:             %11llu\n",
 		debug_atomic_read(chain_lookup_hits));
+	seq_printf(m, " chain cache hits:              %11llu\n",
+		debug_atomic_read(chain_cache_hits));
 	seq_printf(m, " cyclic checks:                 %11llu\n",
 		debug_atomic_read(nr_cyclic_checks));
 	seq_printf(m, " find-mask forwards checks:     %11llu\n",
@@ -469,7 +471,7 @@ static void seq_stats(struct seq_file *m, struct lock_stat_data *data)
 		seq_lock_time(m, &stats->write_waittime);
 		seq_printf(m, " %14lu ", stats->bounces[bounce_acquired_write]);
 		seq_lock_time(m, &stats->write_holdtime);
-		seq_puts(m, "\n");
+		seq_printf(m, " %14lu\n", stats->sleeps[0]);
 	}
 
 	if (stats->read_holdtime.nr) {
@@ -478,7 +480,7 @@ static void seq_stats(struct seq_file *m, struct lock_stat_data *data)
 		seq_lock_time(m, &stats->read_waittime);
 		seq_printf(m, " %14lu ", stats->bounces[bounce_acquired_read]);
 		seq_lock_time(m, &stats->read_holdtime);
-		seq_puts(m, "\n");
+		seq_printf(m, " %14lu\n", stats->sleeps[1]);
 	}
 
 	if (stats->read_waittime.nr + stats->write_waittime.nr == 0)
@@ -519,21 +521,21 @@ static void seq_stats(struct seq_file *m, struct lock_stat_data *data)
 	}
 	if (i) {
 		seq_puts(m, "\n");
-		seq_line(m, '.', 0, 40 + 1 + 12 * (14 + 1));
+		seq_line(m, '.', 0, 40 + 1 + 13 * (14 + 1));
 		seq_puts(m, "\n");
 	}
 }
 
 static void seq_header(struct seq_file *m)
 {
-	seq_puts(m, "lock_stat version 0.4\n");
+	seq_puts(m, "lock_stat version 0.5\n");
 
 	if (unlikely(!debug_locks))
 		seq_printf(m, "*WARNING* lock debugging disabled!! - possibly due to a lockdep warning\n");
 
-	seq_line(m, '-', 0, 40 + 1 + 12 * (14 + 1));
+	seq_line(m, '-', 0, 40 + 1 + 13 * (14 + 1));
 	seq_printf(m, "%40s %14s %14s %14s %14s %14s %14s %14s %14s %14s %14s "
-			"%14s %14s\n",
+			"%14s %14s %14s\n",
 			"class name",
 			"con-bounces",
 			"contentions",
@@ -546,8 +548,9 @@ static void seq_header(struct seq_file *m)
 			"holdtime-min",
 			"holdtime-max",
 			"holdtime-total",
-			"holdtime-avg");
-	seq_line(m, '-', 0, 40 + 1 + 12 * (14 + 1));
+			"holdtime-avg",
+			"sleeps");
+	seq_line(m, '-', 0, 40 + 1 + 13 * (14 + 1));
 	seq_printf(m, "\n");
 }
 
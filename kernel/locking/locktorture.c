@@ -26,7 +26,9 @@
 #include <linux/spinlock.h>
 #include <linux/rwlock.h>
 #include <linux/mutex.h>
+#include <linux/ww_mutex.h>
 #include <linux/rwsem.h>
+#include <linux/combining_lock.h>
 #include <linux/smp.h>
 #include <linux/interrupt.h>
 #include <linux/sched.h>
@@ -35,6 +37,11 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/torture.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
+#include <linux/topology.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Paul E. McKenney <paulmck@us.ibm.com>");
@@ -43,6 +50,25 @@ torture_param(int, nwriters_stress, -1,
 	     "Number of write-locking stress-test threads");
 torture_param(int, nreaders_stress, -1,
 	     "Number of read-locking stress-test threads");
+torture_param(bool, handoff_lat, false,
+	     "Measure the writer lock handoff latency");
+torture_param(bool, bench, false,
+	     "Benchmark mode: wait/hold time histograms and acquisition rates");
+torture_param(int, cs_ns, 0,
+	     "Critical section length in benchmark mode (ns)");
+torture_param(int, think_ns, 0,
+	     "Time between two acquisitions in benchmark mode (ns)");
+torture_param(int, nhogs, 0,
+	     "Number of busy-looping threads to keep the SMT siblings busy");
+torture_param(int, nlocks, 1, "Number of locks in the lock array");
+torture_param(bool, nested, false,
+	     "Take two locks of the lock array in index order");
+torture_param(bool, payload, false,
+	     "Update a cacheline of payload with each lock of the lock array");
+torture_param(int, ww_nlocks, 16,
+	     "Number of w/w mutexes taken by each ww_mutex_lock writer");
+torture_param(bool, ww_many, true,
+	     "Take the w/w mutexes with ww_mutex_lock_many()");
 torture_param(int, onoff_holdoff, 0, "Time after boot before CPU hotplugs (s)");
 torture_param(int, onoff_interval, 0,
 	     "Time between CPU hotplugs (s), 0=disable");
@@ -60,18 +86,63 @@ module_param(torture_type, charp, 0444);
 MODULE_PARM_DESC(torture_type,
 		 "Type of lock to torture (spin_lock, spin_lock_irq, mutex_lock, ...)");
 
+static char *lock_dist = "uniform";
+module_param(lock_dist, charp, 0444);
+MODULE_PARM_DESC(lock_dist,
+		 "Lock array access distribution (uniform, zipf, node)");
+
 static struct task_struct *stats_task;
 static struct task_struct **writer_tasks;
 static struct task_struct **reader_tasks;
+static struct task_struct **hog_tasks;
 
 static bool lock_is_write_held;
 static bool lock_is_read_held;
+static u64 lock_release_ns;	/* Time of the last write unlock */
+
+#define LOCK_BENCH_BUCKETS	32	/* log2 ns buckets, up to 2s */
+
+static DEFINE_PER_CPU(unsigned long, lock_bench_acquired);
+static DEFINE_PER_CPU(unsigned long, lock_hog_loops);
+static u64 lock_bench_start_ns;
 
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	long n_handoff;		/* # of waits ended by a release */
+	u64 handoff_ns;		/* Total release to acquire time */
+	u64 handoff_max_ns;	/* Maximum release to acquire time */
+	u32 wait_histo[LOCK_BENCH_BUCKETS];	/* Benchmark lock wait times */
+	u32 hold_histo[LOCK_BENCH_BUCKETS];	/* Benchmark lock hold times */
+};
+
+/*
+ * With nlocks > 1, the writers of the lock types that support it pick one
+ * (or two nested) locks of an array of locks, each with a cacheline of
+ * payload, like the buckets of a hash table.
+ */
+struct lock_torture_slot {
+	union {
+		spinlock_t	spin;
+		arch_spinlock_t	arch;
+	} lock;
+	bool		held;
+	unsigned long	n_acquired;
+	unsigned long	payload[L1_CACHE_BYTES / sizeof(unsigned long)]
+			____cacheline_aligned_in_smp;
+} ____cacheline_aligned_in_smp;
+
+enum lock_torture_dist {
+	LOCK_DIST_UNIFORM,
+	LOCK_DIST_ZIPF,		/* Zipfian with s = 1, lock 0 is the hottest */
+	LOCK_DIST_NODE,		/* Uniform among the locks of the local node */
 };
 
+static struct lock_torture_slot *lock_slots;
+static u32 *lock_zipf_cdf;	/* Cumulative distribution scaled to U32_MAX */
+static enum lock_torture_dist lock_array_dist;
+static DEFINE_PER_CPU(int [2], lock_array_held);
+
 #if defined(MODULE)
 #define LOCKTORTURE_RUNNABLE_INIT 1
 #else
@@ -83,6 +154,8 @@ MODULE_PARM_DESC(torture_runnable, "Start locktorture at module init");
 
 /* Forward reference. */
 static void lock_torture_cleanup(void);
+static void lock_torture_write_cs(struct lock_stress_stats *lwsp, u64 start,
+				  struct torture_random_state *trsp);
 
 /*
  * Operations vector for selecting different types of tests.
@@ -95,6 +168,16 @@ struct lock_torture_ops {
 	int (*readlock)(void);
 	void (*read_delay)(struct torture_random_state *trsp);
 	void (*readunlock)(void);
+	/* Lock array support, the lock is held with preemption disabled */
+	void (*init_idx)(int idx);
+	void (*writelock_idx)(int idx, int subclass);
+	void (*writeunlock_idx)(int idx);
+	/* Run the write critical section as an operation of a combining lock */
+	void (*writecombine)(struct lock_stress_stats *lwsp, u64 start,
+			     struct torture_random_state *trsp);
+	/* Take a set of locks around the write critical section */
+	void (*writemany)(struct lock_stress_stats *lwsp, u64 start,
+			  struct torture_random_state *trsp);
 	unsigned long flags;
 	const char *name;
 };
@@ -182,6 +265,21 @@ static void torture_spin_lock_write_unlock(void) __releases(torture_spinlock)
 	spin_unlock(&torture_spinlock);
 }
 
+static void torture_spin_lock_init_idx(int idx)
+{
+	spin_lock_init(&lock_slots[idx].lock.spin);
+}
+
+static void torture_spin_lock_write_lock_idx(int idx, int subclass)
+{
+	spin_lock_nested(&lock_slots[idx].lock.spin, subclass);
+}
+
+static void torture_spin_lock_write_unlock_idx(int idx)
+{
+	spin_unlock(&lock_slots[idx].lock.spin);
+}
+
 static struct lock_torture_ops spin_lock_ops = {
 	.writelock	= torture_spin_lock_write_lock,
 	.write_delay	= torture_spin_lock_write_delay,
@@ -189,6 +287,9 @@ static struct lock_torture_ops spin_lock_ops = {
 	.readlock       = NULL,
 	.read_delay     = NULL,
 	.readunlock     = NULL,
+	.init_idx	= torture_spin_lock_init_idx,
+	.writelock_idx	= torture_spin_lock_write_lock_idx,
+	.writeunlock_idx = torture_spin_lock_write_unlock_idx,
 	.name		= "spin_lock"
 };
 
@@ -218,6 +319,426 @@ static struct lock_torture_ops spin_lock_irq_ops = {
 	.name		= "spin_lock_irq"
 };
 
+/*
+ * The raw lock types below call the lock algorithms directly, without the
+ * debugging and lockdep of the spin_lock() API, to measure the algorithms
+ * themselves. They only disable preemption around the critical section.
+ */
+static arch_spinlock_t torture_arch_spinlock = __ARCH_SPIN_LOCK_UNLOCKED;
+
+static int torture_arch_spin_lock_write_lock(void)
+{
+	preempt_disable();
+	arch_spin_lock(&torture_arch_spinlock);
+	return 0;
+}
+
+static void torture_arch_spin_lock_write_unlock(void)
+{
+	arch_spin_unlock(&torture_arch_spinlock);
+	preempt_enable();
+}
+
+static void torture_arch_spin_lock_init_idx(int idx)
+{
+	lock_slots[idx].lock.arch = (arch_spinlock_t)__ARCH_SPIN_LOCK_UNLOCKED;
+}
+
+static void torture_arch_spin_lock_write_lock_idx(int idx, int subclass)
+{
+	preempt_disable();
+	arch_spin_lock(&lock_slots[idx].lock.arch);
+}
+
+static void torture_arch_spin_lock_write_unlock_idx(int idx)
+{
+	arch_spin_unlock(&lock_slots[idx].lock.arch);
+	preempt_enable();
+}
+
+static struct lock_torture_ops arch_spin_lock_ops = {
+	.writelock	= torture_arch_spin_lock_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.writeunlock	= torture_arch_spin_lock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.init_idx	= torture_arch_spin_lock_init_idx,
+	.writelock_idx	= torture_arch_spin_lock_write_lock_idx,
+	.writeunlock_idx = torture_arch_spin_lock_write_unlock_idx,
+	.name		= "arch_spin_lock"
+};
+
+#ifdef CONFIG_QUEUE_SPINLOCK
+static struct qspinlock torture_qspinlock = __ARCH_SPIN_LOCK_UNLOCKED;
+
+static int torture_qspinlock_write_lock(void)
+{
+	preempt_disable();
+	queue_spin_lock(&torture_qspinlock);
+	return 0;
+}
+
+static void torture_qspinlock_write_unlock(void)
+{
+	queue_spin_unlock(&torture_qspinlock);
+	preempt_enable();
+}
+
+static void torture_qspinlock_write_lock_idx(int idx, int subclass)
+{
+	preempt_disable();
+	queue_spin_lock(&lock_slots[idx].lock.arch);
+}
+
+static void torture_qspinlock_write_unlock_idx(int idx)
+{
+	queue_spin_unlock(&lock_slots[idx].lock.arch);
+	preempt_enable();
+}
+
+static struct lock_torture_ops qspinlock_ops = {
+	.writelock	= torture_qspinlock_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.writeunlock	= torture_qspinlock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.init_idx	= torture_arch_spin_lock_init_idx,
+	.writelock_idx	= torture_qspinlock_write_lock_idx,
+	.writeunlock_idx = torture_qspinlock_write_unlock_idx,
+	.name		= "qspinlock"
+};
+
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+/*
+ * Always go to the PV slowpath after a failed fastpath. The PV lock hash
+ * is only set up by a hypervisor backend, so the native slowpath is used
+ * instead when the PV spinlocks aren't enabled.
+ */
+static void torture_pv_qspinlock_init(void)
+{
+	if (!static_key_false(&paravirt_spinlocks_enabled))
+		pr_alert("lock-torture: PV spinlocks disabled, pv_qspinlock uses the native slowpath\n");
+}
+
+static int torture_pv_qspinlock_write_lock(void)
+{
+	u32 val;
+
+	preempt_disable();
+	val = atomic_cmpxchg(&torture_qspinlock.val, 0, _Q_LOCKED_VAL);
+	if (likely(val == 0))
+		return 0;
+	if (static_key_false(&paravirt_spinlocks_enabled))
+		pv_queue_spin_lock_slowpath(&torture_qspinlock, val);
+	else
+		queue_spin_lock_slowpath(&torture_qspinlock, val);
+	return 0;
+}
+
+static struct lock_torture_ops pv_qspinlock_ops = {
+	.init		= torture_pv_qspinlock_init,
+	.writelock	= torture_pv_qspinlock_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.writeunlock	= torture_qspinlock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "pv_qspinlock"
+};
+#endif /* CONFIG_PARAVIRT_SPINLOCKS */
+#endif /* CONFIG_QUEUE_SPINLOCK */
+
+/*
+ * A plain ticket lock and a test-and-test-and-set lock as the baselines of
+ * the spinlock algorithms, whatever the arch spinlock is.
+ */
+static atomic_t torture_ticket_next = ATOMIC_INIT(0);
+static int torture_ticket_owner;
+
+static int torture_ticket_lock_write_lock(void)
+{
+	int ticket;
+
+	preempt_disable();
+	ticket = atomic_inc_return(&torture_ticket_next) - 1;
+	while (smp_load_acquire(&torture_ticket_owner) != ticket)
+		cpu_relax();
+	return 0;
+}
+
+static void torture_ticket_lock_write_unlock(void)
+{
+	smp_store_release(&torture_ticket_owner, torture_ticket_owner + 1);
+	preempt_enable();
+}
+
+static struct lock_torture_ops ticket_lock_ops = {
+	.writelock	= torture_ticket_lock_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.writeunlock	= torture_ticket_lock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "ticket_lock"
+};
+
+static int torture_tas_lock_word;
+
+static int torture_tas_lock_write_lock(void)
+{
+	preempt_disable();
+	while (xchg(&torture_tas_lock_word, 1)) {
+		while (ACCESS_ONCE(torture_tas_lock_word))
+			cpu_relax();
+	}
+	return 0;
+}
+
+static void torture_tas_lock_write_unlock(void)
+{
+	smp_store_release(&torture_tas_lock_word, 0);
+	preempt_enable();
+}
+
+static struct lock_torture_ops tas_lock_ops = {
+	.writelock	= torture_tas_lock_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.writeunlock	= torture_tas_lock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "tas_lock"
+};
+
+/*
+ * The write critical sections are operations of a combining lock, run by
+ * whichever writer holds the lock. In benchmark mode, the acquisitions are
+ * then counted on the CPU that runs them.
+ */
+static DEFINE_COMBINING_LOCK(torture_combining_lock);
+
+struct torture_combining_op {
+	struct combining_op op;
+	struct lock_stress_stats *lwsp;
+	u64 start;
+	struct torture_random_state *trsp;
+};
+
+static void torture_combining_lock_op(struct combining_op *op)
+{
+	struct torture_combining_op *top =
+		container_of(op, struct torture_combining_op, op);
+
+	lock_torture_write_cs(top->lwsp, top->start, top->trsp);
+}
+
+static void
+torture_combining_lock_write_combine(struct lock_stress_stats *lwsp, u64 start,
+				     struct torture_random_state *trsp)
+{
+	struct torture_combining_op top = {
+		.op.func	= torture_combining_lock_op,
+		.lwsp		= lwsp,
+		.start		= start,
+		.trsp		= trsp,
+	};
+
+	combining_lock_run(&torture_combining_lock, &top.op);
+}
+
+static struct lock_torture_ops combining_lock_ops = {
+	.writelock	= NULL,
+	.write_delay	= torture_spin_lock_write_delay,
+	.writeunlock	= NULL,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.writecombine	= torture_combining_lock_write_combine,
+	.name		= "combining_lock"
+};
+
+/*
+ * Lock array torture: the lock type operations are wrapped by ones that
+ * pick the lock(s) to take according to lock_dist.
+ */
+static struct lock_torture_ops *lock_array_base_ops;
+static struct lock_torture_ops lock_array_ops;
+
+static int lock_array_pick(struct torture_random_state *trsp)
+{
+	u32 r = torture_random(trsp);
+	int lo, hi, mid, per_node;
+
+	switch (lock_array_dist) {
+	case LOCK_DIST_ZIPF:
+		lo = 0;
+		hi = nlocks - 1;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (lock_zipf_cdf[mid] < r)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	case LOCK_DIST_NODE:
+		per_node = max(nlocks / nr_node_ids, 1);
+		return (numa_node_id() * per_node + r % per_node) % nlocks;
+	default:
+		return r % nlocks;
+	}
+}
+
+/*
+ * Check the exclusion with the held flag and with the payload, whose words
+ * are all updated together, and account for the acquisition.
+ */
+static void lock_array_acquired(int idx)
+{
+	struct lock_torture_slot *slot = &lock_slots[idx];
+	int i;
+
+	if (WARN_ON_ONCE(slot->held))
+		atomic_inc(&cxt.n_lock_torture_errors);
+	slot->held = true;
+	slot->n_acquired++;
+	if (!payload)
+		return;
+	for (i = 0; i < ARRAY_SIZE(slot->payload); i++) {
+		if (WARN_ON_ONCE(slot->payload[i] != slot->payload[0]))
+			atomic_inc(&cxt.n_lock_torture_errors);
+	}
+	for (i = 0; i < ARRAY_SIZE(slot->payload); i++)
+		slot->payload[i]++;
+}
+
+static int lock_array_write_lock(void)
+{
+	static DEFINE_TORTURE_RANDOM(rand);
+	int first, second = -1;
+
+	first = lock_array_pick(&rand);
+	if (nested) {
+		second = lock_array_pick(&rand);
+		if (second == first)
+			second = (first + 1) % nlocks;
+		if (second < first)
+			swap(first, second);
+	}
+
+	lock_array_base_ops->writelock_idx(first, 0);
+	lock_array_acquired(first);
+	if (second >= 0) {
+		lock_array_base_ops->writelock_idx(second,
+						   SINGLE_DEPTH_NESTING);
+		lock_array_acquired(second);
+	}
+
+	/* Preemption is disabled until the unlock */
+	this_cpu_write(lock_array_held[0], first);
+	this_cpu_write(lock_array_held[1], second);
+	return 0;
+}
+
+static void lock_array_write_unlock(void)
+{
+	int first = this_cpu_read(lock_array_held[0]);
+	int second = this_cpu_read(lock_array_held[1]);
+
+	if (second >= 0) {
+		lock_slots[second].held = false;
+		lock_array_base_ops->writeunlock_idx(second);
+	}
+	lock_slots[first].held = false;
+	lock_array_base_ops->writeunlock_idx(first);
+}
+
+static int lock_array_init(void)
+{
+	u64 total = 0, cum = 0;
+	int i;
+
+	if (!cxt.cur_ops->writelock_idx) {
+		pr_alert("lock-torture: %s doesn't support nlocks\n",
+			 cxt.cur_ops->name);
+		return -EINVAL;
+	}
+	if (nested && nlocks < 2) {
+		pr_alert("lock-torture: nested needs 2 locks or more\n");
+		return -EINVAL;
+	}
+	if (!strcmp(lock_dist, "uniform")) {
+		lock_array_dist = LOCK_DIST_UNIFORM;
+	} else if (!strcmp(lock_dist, "zipf")) {
+		lock_array_dist = LOCK_DIST_ZIPF;
+	} else if (!strcmp(lock_dist, "node")) {
+		lock_array_dist = LOCK_DIST_NODE;
+	} else {
+		pr_alert("lock-torture: invalid lock_dist: \"%s\"\n",
+			 lock_dist);
+		return -EINVAL;
+	}
+
+	lock_slots = kcalloc(nlocks, sizeof(*lock_slots), GFP_KERNEL);
+	if (!lock_slots)
+		return -ENOMEM;
+	for (i = 0; i < nlocks; i++)
+		cxt.cur_ops->init_idx(i);
+
+	if (lock_array_dist == LOCK_DIST_ZIPF) {
+		lock_zipf_cdf = kcalloc(nlocks, sizeof(*lock_zipf_cdf),
+					GFP_KERNEL);
+		if (!lock_zipf_cdf)
+			return -ENOMEM;
+		for (i = 0; i < nlocks; i++)
+			total += div_u64(1ULL << 32, i + 1);
+		for (i = 0; i < nlocks; i++) {
+			cum += div_u64(1ULL << 32, i + 1);
+			lock_zipf_cdf[i] = div64_u64(cum * U32_MAX, total);
+		}
+		lock_zipf_cdf[nlocks - 1] = U32_MAX;
+	}
+
+	lock_array_base_ops = cxt.cur_ops;
+	lock_array_ops = *cxt.cur_ops;
+	lock_array_ops.writelock = lock_array_write_lock;
+	lock_array_ops.writeunlock = lock_array_write_unlock;
+	cxt.cur_ops = &lock_array_ops;
+	return 0;
+}
+
+static void lock_array_cleanup(void)
+{
+	kfree(lock_zipf_cdf);
+	lock_zipf_cdf = NULL;
+	kfree(lock_slots);
+	lock_slots = NULL;
+}
+
+/*
+ * Print how the acquisitions are spread over the lock array.
+ */
+static void lock_array_print_stats(void)
+{
+	unsigned long n, min = ULONG_MAX, max = 0, sum = 0;
+	int i, hottest = 0;
+
+	for (i = 0; i < nlocks; i++) {
+		n = ACCESS_ONCE(lock_slots[i].n_acquired);
+		if (n > max) {
+			max = n;
+			hottest = i;
+		}
+		min = min(min, n);
+		sum += n;
+	}
+	pr_alert("Lock array: %d locks (%s%s)  Total: %lu  Min/Max: %lu/%lu  Hottest: %d\n",
+		 nlocks, lock_dist, nested ? ", nested" : "", sum, min, max,
+		 hottest);
+}
+
 static DEFINE_RWLOCK(torture_rwlock);
 
 static int torture_rwlock_write_lock(void) __acquires(torture_rwlock)
@@ -426,6 +947,172 @@ static struct lock_torture_ops rwsem_lock_ops = {
 	.name		= "rwsem_lock"
 };
 
+/*
+ * The writers take ww_nlocks w/w mutexes each, starting at a random one so
+ * that they wound each other, like the buffer objects of GPU submissions.
+ * In benchmark mode, the cost per mutex is the acquisition rate times
+ * ww_nlocks, with or without ww_many.
+ */
+#define TORTURE_WW_MAX_LOCKS	32	/* lockdep tracks up to 48 held locks */
+
+static DEFINE_WW_CLASS(torture_ww_class);
+static struct ww_mutex torture_ww_mutex[TORTURE_WW_MAX_LOCKS];
+
+static void torture_ww_mutex_init(void)
+{
+	int i;
+
+	for (i = 0; i < TORTURE_WW_MAX_LOCKS; i++)
+		ww_mutex_init(&torture_ww_mutex[i], &torture_ww_class);
+}
+
+/* One ww_mutex_lock() per mutex, with the usual backoff on -EDEADLK */
+static void torture_ww_mutex_lock_each(struct ww_mutex **locks, int n,
+				       struct ww_acquire_ctx *ctx)
+{
+	struct ww_mutex *contended = NULL;
+	int i, j;
+
+retry:
+	for (i = 0; i < n; i++) {
+		if (locks[i] == contended)
+			continue;
+		if (!ww_mutex_lock(locks[i], ctx))
+			continue;
+
+		for (j = 0; j < i; j++)
+			ww_mutex_unlock(locks[j]);
+		for (j = i + 1; j < n; j++)
+			if (locks[j] == contended)
+				ww_mutex_unlock(contended);
+		contended = locks[i];
+		ww_mutex_lock_slow(contended, ctx);
+		goto retry;
+	}
+}
+
+static void torture_ww_mutex_write_many(struct lock_stress_stats *lwsp,
+					u64 start,
+					struct torture_random_state *trsp)
+{
+	struct ww_mutex *locks[TORTURE_WW_MAX_LOCKS];
+	struct ww_acquire_ctx ctx;
+	int n = clamp(ww_nlocks, 1, TORTURE_WW_MAX_LOCKS);
+	int first = torture_random(trsp) % n;
+	int i;
+
+	for (i = 0; i < n; i++)
+		locks[i] = &torture_ww_mutex[(first + i) % n];
+
+	ww_acquire_init(&ctx, &torture_ww_class);
+	if (ww_many) {
+		if (WARN_ON_ONCE(ww_mutex_lock_many(locks, n, &ctx)))
+			lwsp->n_lock_fail++;
+	} else {
+		torture_ww_mutex_lock_each(locks, n, &ctx);
+	}
+	ww_acquire_done(&ctx);
+
+	lock_torture_write_cs(lwsp, start, trsp);
+
+	for (i = 0; i < n; i++)
+		ww_mutex_unlock(locks[i]);
+	ww_acquire_fini(&ctx);
+}
+
+static struct lock_torture_ops ww_mutex_lock_ops = {
+	.init		= torture_ww_mutex_init,
+	.writelock	= NULL,
+	.write_delay	= torture_mutex_delay,
+	.writeunlock	= NULL,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.writemany	= torture_ww_mutex_write_many,
+	.name		= "ww_mutex_lock"
+};
+
+/*
+ * Account for the time between the release of the lock by the previous
+ * writer and its acquisition by this one, if this writer had to wait for
+ * that release. This is the handoff (or wakeup) latency of the lock.
+ */
+static void lock_torture_handoff(struct lock_stress_stats *lwsp, u64 start)
+{
+	u64 release = ACCESS_ONCE(lock_release_ns);
+	u64 delta;
+
+	if (release <= start)
+		return;
+	delta = local_clock() - release;
+	if ((s64)delta < 0)
+		return;
+	lwsp->n_handoff++;
+	lwsp->handoff_ns += delta;
+	if (delta > lwsp->handoff_max_ns)
+		lwsp->handoff_max_ns = delta;
+}
+
+static void lock_bench_histo(u32 *histo, u64 delta)
+{
+	histo[min_t(u32, delta ? ilog2(delta) : 0, LOCK_BENCH_BUCKETS - 1)]++;
+}
+
+/*
+ * Busy wait for the given time, the critical section or the think time of
+ * the benchmark mode.
+ */
+static void lock_bench_delay(int ns)
+{
+	if (ns >= 1000)
+		udelay(ns / 1000);
+	ndelay(ns % 1000);
+}
+
+/*
+ * Account for an acquisition in benchmark mode and return the time of
+ * the acquisition.
+ */
+static u64 lock_bench_acquired_at(struct lock_stress_stats *lsp, u64 start)
+{
+	u64 now = local_clock();
+
+	lock_bench_histo(lsp->wait_histo, now - start);
+	this_cpu_inc(lock_bench_acquired);
+	return now;
+}
+
+/*
+ * The write critical section, checking for duplicate acquisitions.
+ */
+static void lock_torture_write_cs(struct lock_stress_stats *lwsp, u64 start,
+				  struct torture_random_state *trsp)
+{
+	u64 acquired = 0;
+
+	if (handoff_lat)
+		lock_torture_handoff(lwsp, start);
+	if (bench)
+		acquired = lock_bench_acquired_at(lwsp, start);
+	/* The lock array does its own checks */
+	if (WARN_ON_ONCE(lock_is_write_held && !lock_slots))
+		lwsp->n_lock_fail++;
+	lock_is_write_held = 1;
+	if (WARN_ON_ONCE(lock_is_read_held))
+		lwsp->n_lock_fail++; /* rare, but... */
+
+	lwsp->n_lock_acquired++;
+	if (bench)
+		lock_bench_delay(cs_ns);
+	else
+		cxt.cur_ops->write_delay(trsp);
+	lock_is_write_held = 0;
+	if (bench)
+		lock_bench_histo(lwsp->hold_histo, local_clock() - acquired);
+	if (handoff_lat)
+		ACCESS_ONCE(lock_release_ns) = local_clock();
+}
+
 /*
  * Lock torture writer kthread.  Repeatedly acquires and releases
  * the lock, checking for duplicate acquisitions.
@@ -434,6 +1121,7 @@ static int lock_torture_writer(void *arg)
 {
 	struct lock_stress_stats *lwsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start = 0;
 
 	VERBOSE_TOROUT_STRING("lock_torture_writer task started");
 	set_user_nice(current, MAX_NICE);
@@ -442,17 +1130,19 @@ static int lock_torture_writer(void *arg)
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
-		cxt.cur_ops->writelock();
-		if (WARN_ON_ONCE(lock_is_write_held))
-			lwsp->n_lock_fail++;
-		lock_is_write_held = 1;
-		if (WARN_ON_ONCE(lock_is_read_held))
-			lwsp->n_lock_fail++; /* rare, but... */
-
-		lwsp->n_lock_acquired++;
-		cxt.cur_ops->write_delay(&rand);
-		lock_is_write_held = 0;
-		cxt.cur_ops->writeunlock();
+		if (handoff_lat || bench)
+			start = local_clock();
+		if (cxt.cur_ops->writecombine) {
+			cxt.cur_ops->writecombine(lwsp, start, &rand);
+		} else if (cxt.cur_ops->writemany) {
+			cxt.cur_ops->writemany(lwsp, start, &rand);
+		} else {
+			cxt.cur_ops->writelock();
+			lock_torture_write_cs(lwsp, start, &rand);
+			cxt.cur_ops->writeunlock();
+		}
+		if (bench && think_ns)
+			lock_bench_delay(think_ns);
 
 		stutter_wait("lock_torture_writer");
 	} while (!torture_must_stop());
@@ -468,6 +1158,7 @@ static int lock_torture_reader(void *arg)
 {
 	struct lock_stress_stats *lrsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start = 0, acquired = 0;
 
 	VERBOSE_TOROUT_STRING("lock_torture_reader task started");
 	set_user_nice(current, MAX_NICE);
@@ -476,15 +1167,27 @@ static int lock_torture_reader(void *arg)
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
+		if (bench)
+			start = local_clock();
 		cxt.cur_ops->readlock();
+		if (bench)
+			acquired = lock_bench_acquired_at(lrsp, start);
 		lock_is_read_held = 1;
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lrsp->n_lock_fail++; /* rare, but... */
 
 		lrsp->n_lock_acquired++;
-		cxt.cur_ops->read_delay(&rand);
+		if (bench)
+			lock_bench_delay(cs_ns);
+		else
+			cxt.cur_ops->read_delay(&rand);
 		lock_is_read_held = 0;
+		if (bench)
+			lock_bench_histo(lrsp->hold_histo,
+					 local_clock() - acquired);
 		cxt.cur_ops->readunlock();
+		if (bench && think_ns)
+			lock_bench_delay(think_ns);
 
 		stutter_wait("lock_torture_reader");
 	} while (!torture_must_stop());
@@ -492,6 +1195,30 @@ static int lock_torture_reader(void *arg)
 	return 0;
 }
 
+/*
+ * Print the non-empty buckets of a benchmark histogram summed over all the
+ * stress-test threads.
+ */
+static char *lock_bench_print_histo(char *page, struct lock_stress_stats *statp,
+				    int n_stress, bool hold)
+{
+	u32 histo[LOCK_BENCH_BUCKETS] = { 0 };
+	int i, b;
+
+	for (i = 0; i < n_stress; i++)
+		for (b = 0; b < LOCK_BENCH_BUCKETS; b++)
+			histo[b] += hold ? statp[i].hold_histo[b]
+					 : statp[i].wait_histo[b];
+
+	page += sprintf(page, "%s time histogram (ns):\n",
+			hold ? "Hold" : "Wait");
+	for (b = 0; b < LOCK_BENCH_BUCKETS; b++)
+		if (histo[b])
+			page += sprintf(page, "\t%10llu: %u\n", 1ULL << b,
+					histo[b]);
+	return page;
+}
+
 /*
  * Create an lock-torture-statistics message in the specified buffer.
  */
@@ -503,6 +1230,8 @@ static void __torture_print_stats(char *page,
 	long max = 0;
 	long min = statp[0].n_lock_acquired;
 	long long sum = 0;
+	long n_handoff = 0;
+	u64 handoff_ns = 0, handoff_max_ns = 0;
 
 	n_stress = write ? cxt.nrealwriters_stress : cxt.nrealreaders_stress;
 	for (i = 0; i < n_stress; i++) {
@@ -513,16 +1242,260 @@ static void __torture_print_stats(char *page,
 			max = statp[i].n_lock_fail;
 		if (min > statp[i].n_lock_fail)
 			min = statp[i].n_lock_fail;
+		n_handoff += statp[i].n_handoff;
+		handoff_ns += statp[i].handoff_ns;
+		if (handoff_max_ns < statp[i].handoff_max_ns)
+			handoff_max_ns = statp[i].handoff_max_ns;
 	}
 	page += sprintf(page,
 			"%s:  Total: %lld  Max/Min: %ld/%ld %s  Fail: %d %s\n",
 			write ? "Writes" : "Reads ",
 			sum, max, min, max / 2 > min ? "???" : "",
 			fail, fail ? "!!!" : "");
+	if (write && handoff_lat)
+		page += sprintf(page,
+				"Handoffs: %ld  Avg/Max: %llu/%llu ns\n",
+				n_handoff, n_handoff ?
+				div64_u64(handoff_ns, n_handoff) : 0,
+				handoff_max_ns);
+	if (bench) {
+		page = lock_bench_print_histo(page, statp, n_stress, false);
+		page = lock_bench_print_histo(page, statp, n_stress, true);
+	}
 	if (fail)
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
 
+/*
+ * Print the acquisition rates of the benchmark mode per cpu and per node,
+ * and the fairness across the online cpus.
+ */
+struct lock_bench_rates {
+	u64 elapsed_ms;
+	u64 total;	/* acq/s of all the cpus */
+	u64 min;	/* Per cpu minimum acq/s */
+	u64 max;	/* Per cpu maximum acq/s */
+	unsigned long stddev;
+};
+
+static u64 lock_bench_cpu_rate(int cpu, u64 elapsed_ms)
+{
+	return div64_u64((u64)per_cpu(lock_bench_acquired, cpu) * MSEC_PER_SEC,
+			 elapsed_ms);
+}
+
+/*
+ * Compute the total rate and its spread across the online cpus since the
+ * start of the test. Return false if no time has elapsed yet.
+ */
+static bool lock_bench_get_rates(struct lock_bench_rates *r)
+{
+	u64 rate, sumsq = 0, mean;
+	int cpu, n = 0;
+
+	r->elapsed_ms = div_u64(local_clock() - lock_bench_start_ns,
+				NSEC_PER_MSEC);
+	if (!r->elapsed_ms)
+		return false;
+
+	r->total = r->max = 0;
+	r->min = ULLONG_MAX;
+	for_each_online_cpu(cpu) {
+		rate = lock_bench_cpu_rate(cpu, r->elapsed_ms);
+		r->min = min(r->min, rate);
+		r->max = max(r->max, rate);
+		r->total += rate;
+		sumsq += rate * rate;
+		n++;
+	}
+	mean = div_u64(r->total, n);
+	r->stddev = int_sqrt(div_u64(sumsq, n) - mean * mean);
+	return true;
+}
+
+static void lock_bench_print_rates(void)
+{
+	struct lock_bench_rates r;
+	u64 rate, *node_rate;
+	int cpu, node;
+	char *buf, *page;
+
+	if (!lock_bench_get_rates(&r))
+		return;
+
+	buf = kmalloc((nr_cpu_ids + nr_node_ids) * 48 + 256, GFP_KERNEL);
+	node_rate = kcalloc(nr_node_ids, sizeof(*node_rate), GFP_KERNEL);
+	if (!buf || !node_rate) {
+		pr_err("lock_bench_print_rates: Out of memory");
+		goto out;
+	}
+
+	page = buf;
+	for_each_online_cpu(cpu) {
+		rate = lock_bench_cpu_rate(cpu, r.elapsed_ms);
+		page += sprintf(page, "CPU %d: %llu acq/s\n", cpu, rate);
+		node_rate[cpu_to_node(cpu)] += rate;
+	}
+	for_each_online_node(node)
+		page += sprintf(page, "Node %d: %llu acq/s\n", node,
+				node_rate[node]);
+
+	page += sprintf(page,
+			"Total: %llu acq/s  Min/Max/Stddev per CPU: %llu/%llu/%lu\n",
+			r.total, r.min, r.max, r.stddev);
+	pr_alert("%s", buf);
+out:
+	kfree(node_rate);
+	kfree(buf);
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * The locktorture/bench debugfs file gives the benchmark results as
+ * "key value" lines for the userspace tools that drive the benchmark
+ * mode (e.g. perf bench locking).
+ */
+static struct dentry *lock_bench_dir;
+
+static void lock_bench_sum(struct lock_stress_stats *statp, int n_stress,
+			   u64 *acquired, u64 *histo)
+{
+	int i, b;
+
+	for (i = 0; i < n_stress; i++) {
+		*acquired += statp[i].n_lock_acquired;
+		for (b = 0; b < LOCK_BENCH_BUCKETS; b++)
+			histo[b] += statp[i].wait_histo[b];
+	}
+}
+
+/*
+ * Return the upper bound of the histogram bucket that holds the given
+ * percentile of the samples.
+ */
+static u64 lock_bench_percentile(u64 *histo, int pct)
+{
+	u64 total = 0, sum = 0, target;
+	int b;
+
+	for (b = 0; b < LOCK_BENCH_BUCKETS; b++)
+		total += histo[b];
+	target = div_u64(total * pct + 99, 100);
+	for (b = 0; b < LOCK_BENCH_BUCKETS; b++) {
+		sum += histo[b];
+		if (sum && sum >= target)
+			return 2ULL << b;
+	}
+	return 0;
+}
+
+static int lock_bench_show(struct seq_file *m, void *v)
+{
+	u64 histo[LOCK_BENCH_BUCKETS] = { 0 };
+	u64 writes = 0, reads = 0;
+	struct lock_bench_rates r = { 0 };
+
+	lock_bench_get_rates(&r);
+	lock_bench_sum(cxt.lwsa, cxt.nrealwriters_stress, &writes, histo);
+	if (cxt.lrsa)
+		lock_bench_sum(cxt.lrsa, cxt.nrealreaders_stress, &reads,
+			       histo);
+
+	seq_printf(m, "type %s\n", cxt.cur_ops->name);
+	seq_printf(m, "nwriters %d\n", cxt.nrealwriters_stress);
+	seq_printf(m, "nreaders %d\n", cxt.nrealreaders_stress);
+	seq_printf(m, "cs_ns %d\n", cs_ns);
+	seq_printf(m, "think_ns %d\n", think_ns);
+	seq_printf(m, "nlocks %d\n", nlocks);
+	seq_printf(m, "elapsed_ms %llu\n", r.elapsed_ms);
+	seq_printf(m, "writes %llu\n", writes);
+	seq_printf(m, "reads %llu\n", reads);
+	seq_printf(m, "acq_per_sec %llu\n", r.total);
+	seq_printf(m, "cpu_min_acq_per_sec %llu\n", r.min);
+	seq_printf(m, "cpu_max_acq_per_sec %llu\n", r.max);
+	seq_printf(m, "cpu_stddev_acq_per_sec %lu\n", r.stddev);
+	seq_printf(m, "wait_p50_ns %llu\n", lock_bench_percentile(histo, 50));
+	seq_printf(m, "wait_p99_ns %llu\n", lock_bench_percentile(histo, 99));
+	seq_printf(m, "errors %d\n", atomic_read(&cxt.n_lock_torture_errors));
+	return 0;
+}
+
+static int lock_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lock_bench_show, NULL);
+}
+
+static const struct file_operations lock_bench_fops = {
+	.open		= lock_bench_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void lock_bench_debugfs_init(void)
+{
+	lock_bench_dir = debugfs_create_dir("locktorture", NULL);
+	if (lock_bench_dir &&
+	    !debugfs_create_file("bench", 0444, lock_bench_dir, NULL,
+				 &lock_bench_fops)) {
+		debugfs_remove_recursive(lock_bench_dir);
+		lock_bench_dir = NULL;
+	}
+}
+
+static void lock_bench_debugfs_exit(void)
+{
+	debugfs_remove_recursive(lock_bench_dir);
+	lock_bench_dir = NULL;
+}
+#else
+static inline void lock_bench_debugfs_init(void) { }
+static inline void lock_bench_debugfs_exit(void) { }
+#endif /* CONFIG_DEBUG_FS */
+
+/*
+ * Hog kthread. Runs an ALU-bound loop at the lowest priority, so that it
+ * mostly takes the SMT siblings of the lock waiters that would otherwise
+ * be idle. Its loop rate shows how much the lock waiters slow down their
+ * siblings.
+ */
+static int lock_torture_hog(void *arg)
+{
+	unsigned long x = 1;
+	int i;
+
+	VERBOSE_TOROUT_STRING("lock_torture_hog task started");
+	set_user_nice(current, MAX_NICE);
+
+	do {
+		for (i = 0; i < 1000; i++) {
+			x = x * 1103515245 + 12345;
+			OPTIMIZER_HIDE_VAR(x);
+		}
+		this_cpu_inc(lock_hog_loops);
+		cond_resched();
+	} while (!torture_must_stop());
+	torture_kthread_stopping("lock_torture_hog");
+	return 0;
+}
+
+static void lock_hog_print_rate(void)
+{
+	unsigned long loops = 0;
+	u64 elapsed_ms;
+	int cpu;
+
+	elapsed_ms = div_u64(local_clock() - lock_bench_start_ns,
+			     NSEC_PER_MSEC);
+	if (!elapsed_ms)
+		return;
+
+	for_each_possible_cpu(cpu)
+		loops += per_cpu(lock_hog_loops, cpu);
+	pr_alert("Hogs: %d  Total: %lu  Rate: %llu kloops/s\n", nhogs, loops,
+		 div64_u64((u64)loops * MSEC_PER_SEC, elapsed_ms));
+}
+
 /*
  * Print torture statistics.  Caller must ensure that there is only one
  * call to this function at a given time!!!  This is normally accomplished
@@ -562,6 +1535,13 @@ static void lock_torture_stats_print(void)
 		pr_alert("%s", buf);
 		kfree(buf);
 	}
+
+	if (bench)
+		lock_bench_print_rates();
+	if (nhogs > 0)
+		lock_hog_print_rate();
+	if (lock_slots)
+		lock_array_print_stats();
 }
 
 /*
@@ -588,9 +1568,11 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d handoff_lat=%d bench=%d cs_ns=%d think_ns=%d nhogs=%d nlocks=%d lock_dist=%s nested=%d payload=%d ww_nlocks=%d ww_many=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
-		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
+		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, handoff_lat,
+		 bench, cs_ns, think_ns, nhogs, nlocks, lock_dist, nested, payload,
+		 ww_nlocks, ww_many, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
 		 onoff_interval, onoff_holdoff);
 }
@@ -602,6 +1584,8 @@ static void lock_torture_cleanup(void)
 	if (torture_cleanup_begin())
 		return;
 
+	lock_bench_debugfs_exit();
+
 	if (writer_tasks) {
 		for (i = 0; i < cxt.nrealwriters_stress; i++)
 			torture_stop_kthread(lock_torture_writer,
@@ -618,8 +1602,16 @@ static void lock_torture_cleanup(void)
 		reader_tasks = NULL;
 	}
 
+	if (hog_tasks) {
+		for (i = 0; i < nhogs; i++)
+			torture_stop_kthread(lock_torture_hog, hog_tasks[i]);
+		kfree(hog_tasks);
+		hog_tasks = NULL;
+	}
+
 	torture_stop_kthread(lock_torture_stats, stats_task);
 	lock_torture_stats_print();  /* -After- the stats thread is stopped! */
+	lock_array_cleanup();
 
 	if (atomic_read(&cxt.n_lock_torture_errors))
 		lock_torture_print_module_parms(cxt.cur_ops,
@@ -640,8 +1632,17 @@ static int __init lock_torture_init(void)
 	static struct lock_torture_ops *torture_ops[] = {
 		&lock_busted_ops,
 		&spin_lock_ops, &spin_lock_irq_ops,
+		&arch_spin_lock_ops,
+#ifdef CONFIG_QUEUE_SPINLOCK
+		&qspinlock_ops,
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+		&pv_qspinlock_ops,
+#endif
+#endif
+		&ticket_lock_ops, &tas_lock_ops,
+		&combining_lock_ops,
 		&rw_lock_ops, &rw_lock_irq_ops,
-		&mutex_lock_ops,
+		&mutex_lock_ops, &ww_mutex_lock_ops,
 		&rwsem_lock_ops,
 	};
 
@@ -673,7 +1674,8 @@ static int __init lock_torture_init(void)
 		cxt.nrealwriters_stress = 2 * num_online_cpus();
 
 #ifdef CONFIG_DEBUG_MUTEXES
-	if (strncmp(torture_type, "mutex", 5) == 0)
+	if ((strncmp(torture_type, "mutex", 5) == 0) ||
+	    (strncmp(torture_type, "ww_mutex", 8) == 0))
 		cxt.debug_lock = true;
 #endif
 #ifdef CONFIG_DEBUG_SPINLOCK
@@ -685,16 +1687,17 @@ static int __init lock_torture_init(void)
 	/* Initialize the statistics so that each run gets its own numbers. */
 
 	lock_is_write_held = 0;
-	cxt.lwsa = kmalloc(sizeof(*cxt.lwsa) * cxt.nrealwriters_stress, GFP_KERNEL);
+	for_each_possible_cpu(i) {
+		per_cpu(lock_bench_acquired, i) = 0;
+		per_cpu(lock_hog_loops, i) = 0;
+	}
+	lock_bench_start_ns = local_clock();
+	cxt.lwsa = kzalloc(sizeof(*cxt.lwsa) * cxt.nrealwriters_stress, GFP_KERNEL);
 	if (cxt.lwsa == NULL) {
 		VERBOSE_TOROUT_STRING("cxt.lwsa: Out of memory");
 		firsterr = -ENOMEM;
 		goto unwind;
 	}
-	for (i = 0; i < cxt.nrealwriters_stress; i++) {
-		cxt.lwsa[i].n_lock_fail = 0;
-		cxt.lwsa[i].n_lock_acquired = 0;
-	}
 
 	if (cxt.cur_ops->readlock) {
 		if (nreaders_stress >= 0)
@@ -711,21 +1714,22 @@ static int __init lock_torture_init(void)
 		}
 
 		lock_is_read_held = 0;
-		cxt.lrsa = kmalloc(sizeof(*cxt.lrsa) * cxt.nrealreaders_stress, GFP_KERNEL);
+		cxt.lrsa = kzalloc(sizeof(*cxt.lrsa) * cxt.nrealreaders_stress, GFP_KERNEL);
 		if (cxt.lrsa == NULL) {
 			VERBOSE_TOROUT_STRING("cxt.lrsa: Out of memory");
 			firsterr = -ENOMEM;
 			kfree(cxt.lwsa);
 			goto unwind;
 		}
-
-		for (i = 0; i < cxt.nrealreaders_stress; i++) {
-			cxt.lrsa[i].n_lock_fail = 0;
-			cxt.lrsa[i].n_lock_acquired = 0;
-		}
 	}
 	lock_torture_print_module_parms(cxt.cur_ops, "Start of test");
 
+	if (nlocks > 1) {
+		firsterr = lock_array_init();
+		if (firsterr)
+			goto unwind;
+	}
+
 	/* Prepare torture context. */
 	if (onoff_interval > 0) {
 		firsterr = torture_onoff_init(onoff_holdoff * HZ,
@@ -796,12 +1800,28 @@ static int __init lock_torture_init(void)
 		if (firsterr)
 			goto unwind;
 	}
+	if (nhogs > 0) {
+		hog_tasks = kcalloc(nhogs, sizeof(hog_tasks[0]), GFP_KERNEL);
+		if (hog_tasks == NULL) {
+			VERBOSE_TOROUT_ERRSTRING("hog_tasks: Out of memory");
+			firsterr = -ENOMEM;
+			goto unwind;
+		}
+		for (i = 0; i < nhogs; i++) {
+			firsterr = torture_create_kthread(lock_torture_hog, NULL,
+							  hog_tasks[i]);
+			if (firsterr)
+				goto unwind;
+		}
+	}
 	if (stat_interval > 0) {
 		firsterr = torture_create_kthread(lock_torture_stats, NULL,
 						  stats_task);
 		if (firsterr)
 			goto unwind;
 	}
+	if (bench)
+		lock_bench_debugfs_init();
 	torture_init_end();
 	return 0;
 
@@ -23,6 +23,11 @@ static inline int encode_cpu(int cpu_nr)
 	return cpu_nr + 1;
 }
 
+static inline int node_cpu(struct optimistic_spin_node *node)
+{
+	return node->cpu - 1;
+}
+
 static inline struct optimistic_spin_node *decode_cpu(int encoded_cpu_val)
 {
 	int cpu_nr = encoded_cpu_val - 1;
@@ -113,9 +118,12 @@ bool osq_lock(struct optimistic_spin_queue *lock)
 
 	while (!smp_load_acquire(&node->locked)) {
 		/*
-		 * If we need to reschedule bail... so we can block.
+		 * If we need to reschedule bail... so we can block. Also
+		 * bail if the vCPU of the previous node has been preempted
+		 * as the lock won't be passed on any time soon.
 		 */
-		if (need_resched())
+		if (need_resched() ||
+		    vcpu_is_preempted(node_cpu(ACCESS_ONCE(node->prev))))
 			goto unqueue;
 
 		cpu_relax_lowlatency();
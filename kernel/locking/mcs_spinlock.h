@@ -12,12 +12,14 @@
 #ifndef __LINUX_MCS_SPINLOCK_H
 #define __LINUX_MCS_SPINLOCK_H
 
+#include <linux/prefetch.h>
 #include <asm/mcs_spinlock.h>
 
 struct mcs_spinlock {
 	struct mcs_spinlock *next;
 	int locked; /* 1 if lock acquired */
-	int count;  /* nesting count, see qspinlock.c */
+	short count; /* nesting count, see qspinlock.c */
+	short pos;   /* approximate queue position, see qspinlock.c */
 };
 
 #ifndef arch_mcs_spin_lock_contended
@@ -42,6 +44,22 @@ do {									\
 	smp_store_release((l), 1)
 #endif
 
+#ifndef arch_mcs_prefetch_node
+/*
+ * Prefetch the next queue node for writing before the lock is passed to
+ * it, as the node cacheline is usually remote and cold.
+ */
+#define arch_mcs_prefetch_node(n)	prefetchw(n)
+#endif
+
+#ifndef arch_mcs_prefetch_lock
+/*
+ * Prefetch the lock word for writing when a waiter becomes the queue head
+ * so as to avoid a shared to exclusive upgrade when it grabs the lock.
+ */
+#define arch_mcs_prefetch_lock(l)	prefetchw(l)
+#endif
+
 /*
  * Note: the smp_load_acquire/smp_store_release pair is not
  * sufficient to form a full memory barrier across
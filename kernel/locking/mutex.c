@@ -55,6 +55,7 @@ __mutex_init(struct mutex *lock, const char *name, struct lock_class_key *key)
 	mutex_clear_owner(lock);
 #ifdef CONFIG_MUTEX_SPIN_ON_OWNER
 	osq_lock_init(&lock->osq);
+	lock->handoff = NULL;
 #endif
 
 	debug_mutex_init(lock, name, key);
@@ -153,26 +154,11 @@ static __always_inline void ww_mutex_lock_acquired(struct ww_mutex *ww,
  * This function is never called when CONFIG_DEBUG_LOCK_ALLOC is set,
  * as the fastpath and opportunistic spinning are disabled in that case.
  */
-static __always_inline void
-ww_mutex_set_context_fastpath(struct ww_mutex *lock,
-			       struct ww_acquire_ctx *ctx)
+static __always_inline void ww_mutex_wake_contended(struct ww_mutex *lock)
 {
 	unsigned long flags;
 	struct mutex_waiter *cur;
 
-	ww_mutex_lock_acquired(lock, ctx);
-
-	lock->ctx = ctx;
-
-	/*
-	 * The lock->ctx update should be visible on all cores before
-	 * the atomic read is done, otherwise contended waiters might be
-	 * missed. The contended waiters will either see ww_ctx == NULL
-	 * and keep spinning, or it will acquire wait_lock, add itself
-	 * to waiter list and sleep.
-	 */
-	smp_mb(); /* ^^^ */
-
 	/*
 	 * Check if lock is contended, if not there is nobody to wake up
 	 */
@@ -191,8 +177,112 @@ ww_mutex_set_context_fastpath(struct ww_mutex *lock,
 	spin_unlock_mutex(&lock->base.wait_lock, flags);
 }
 
+static __always_inline void
+ww_mutex_set_context_fastpath(struct ww_mutex *lock,
+			       struct ww_acquire_ctx *ctx)
+{
+	ww_mutex_lock_acquired(lock, ctx);
+
+	lock->ctx = ctx;
+
+	/*
+	 * The lock->ctx update should be visible on all cores before
+	 * the atomic read is done, otherwise contended waiters might be
+	 * missed. The contended waiters will either see ww_ctx == NULL
+	 * and keep spinning, or it will acquire wait_lock, add itself
+	 * to waiter list and sleep.
+	 */
+	smp_mb(); /* ^^^ */
+
+	ww_mutex_wake_contended(lock);
+}
+
+
+#ifdef CONFIG_MUTEX_STAT
+#include "mutex_stat.h"
+#else
+#define mstat_start()		0
+#define mstat_end(path, start)	((void)(start))
+#endif
 
 #ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+/*
+ * Lock handoff.
+ *
+ * A woken up waiter has to compete with the optimistic spinners and the
+ * fastpath lockers for the mutex, and can keep losing under heavy
+ * contention. After MUTEX_HANDOFF_ATTEMPTS failed attempts, the top waiter
+ * sets lock->handoff to MUTEX_HANDOFF_WANTED. The next unlocker then keeps
+ * the mutex locked, records the top waiter in lock->handoff and wakes it
+ * up; the ownership passes directly to that waiter. The spinners back off
+ * while lock->handoff is set.
+ *
+ * The handoff only works with the architectures whose unlock fastpath
+ * leaves the mutex locked when going into the slowpath, i.e. when
+ * __mutex_slowpath_needs_to_unlock() is true. lock->handoff is changed
+ * under the wait_lock only.
+ */
+#define MUTEX_HANDOFF_ATTEMPTS	4
+#define MUTEX_HANDOFF_WANTED	((struct task_struct *)1UL)
+
+static inline bool mutex_handoff_pending(struct mutex *lock)
+{
+	return ACCESS_ONCE(lock->handoff) != NULL;
+}
+
+/*
+ * Called by a waiter that failed to get the lock.
+ */
+static inline void
+mutex_want_handoff(struct mutex *lock, struct mutex_waiter *waiter)
+{
+	if (++waiter->attempts < MUTEX_HANDOFF_ATTEMPTS || lock->handoff ||
+	    !__mutex_slowpath_needs_to_unlock())
+		return;
+	if (list_first_entry(&lock->wait_list, struct mutex_waiter, list)
+	    == waiter)
+		ACCESS_ONCE(lock->handoff) = MUTEX_HANDOFF_WANTED;
+}
+
+static inline bool mutex_handed_off(struct mutex *lock, struct task_struct *task)
+{
+	return lock->handoff == task;
+}
+
+/*
+ * Called by a waiter that got the lock or stops waiting.
+ */
+static inline void
+mutex_handoff_done(struct mutex *lock, struct mutex_waiter *waiter)
+{
+	if (lock->handoff == waiter->task ||
+	    (lock->handoff == MUTEX_HANDOFF_WANTED &&
+	     waiter->attempts >= MUTEX_HANDOFF_ATTEMPTS))
+		ACCESS_ONCE(lock->handoff) = NULL;
+}
+
+/*
+ * Called by the unlocker with the wait_lock held when the handoff is
+ * wanted. Return: true if the lock is handed over to the top waiter.
+ */
+static inline bool mutex_handoff(struct mutex *lock)
+{
+	struct mutex_waiter *waiter;
+
+	if (list_empty(&lock->wait_list)) {
+		lock->handoff = NULL;
+		return false;
+	}
+	waiter = list_first_entry(&lock->wait_list, struct mutex_waiter, list);
+	/*
+	 * Keep the lock locked with waiters so that the new owner goes
+	 * through the unlock slowpath.
+	 */
+	atomic_set(&lock->count, -1);
+	ACCESS_ONCE(lock->handoff) = waiter->task;
+	return true;
+}
+
 /*
  * In order to avoid a stampede of mutex spinners from acquiring the mutex
  * more or less simultaneously, the spinners need to acquire a MCS lock
@@ -217,7 +307,7 @@ static inline bool owner_running(struct mutex *lock, struct task_struct *owner)
 	 */
 	barrier();
 
-	return owner->on_cpu;
+	return owner->on_cpu && !vcpu_is_preempted(task_cpu(owner));
 }
 
 /*
@@ -252,13 +342,13 @@ static inline int mutex_can_spin_on_owner(struct mutex *lock)
 	struct task_struct *owner;
 	int retval = 1;
 
-	if (need_resched())
+	if (need_resched() || mutex_handoff_pending(lock))
 		return 0;
 
 	rcu_read_lock();
 	owner = ACCESS_ONCE(lock->owner);
 	if (owner)
-		retval = owner->on_cpu;
+		retval = owner->on_cpu && !vcpu_is_preempted(task_cpu(owner));
 	rcu_read_unlock();
 	/*
 	 * if lock->owner is not set, the mutex owner may have just acquired
@@ -329,6 +419,13 @@ static bool mutex_optimistic_spin(struct mutex *lock,
 				break;
 		}
 
+		/*
+		 * Back off while the lock is being handed over to the top
+		 * waiter.
+		 */
+		if (mutex_handoff_pending(lock))
+			break;
+
 		/*
 		 * If there's an owner, wait for it to either
 		 * release the lock or go to sleep.
@@ -389,6 +486,27 @@ static bool mutex_optimistic_spin(struct mutex *lock,
 {
 	return false;
 }
+
+static inline bool mutex_handoff_pending(struct mutex *lock)
+{
+	return false;
+}
+
+static inline void
+mutex_want_handoff(struct mutex *lock, struct mutex_waiter *waiter) { }
+
+static inline bool mutex_handed_off(struct mutex *lock, struct task_struct *task)
+{
+	return false;
+}
+
+static inline void
+mutex_handoff_done(struct mutex *lock, struct mutex_waiter *waiter) { }
+
+static inline bool mutex_handoff(struct mutex *lock)
+{
+	return false;
+}
 #endif
 
 __visible __used noinline
@@ -497,6 +615,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	struct task_struct *task = current;
 	struct mutex_waiter waiter;
 	unsigned long flags;
+	u64 wait_start;
 	int ret;
 
 	preempt_disable();
@@ -523,10 +642,20 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	/* add waiting tasks to the end of the waitqueue (FIFO): */
 	list_add_tail(&waiter.list, &lock->wait_list);
 	waiter.task = task;
+	waiter.attempts = 0;
+	wait_start = mstat_start();
 
 	lock_contended(&lock->dep_map, ip);
 
 	for (;;) {
+		/*
+		 * The unlocker may have handed the lock over to us.
+		 */
+		if (mutex_handed_off(lock, task)) {
+			mstat_end(MSTAT_HANDOFF, wait_start);
+			break;
+		}
+
 		/*
 		 * Lets try to take the lock again - this is needed even if
 		 * we get here for the first time (shortly after failing to
@@ -538,8 +667,10 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 		 * non-negative in order to avoid unnecessary xchg operations:
 		 */
 		if (atomic_read(&lock->count) >= 0 &&
-		    (atomic_xchg(&lock->count, -1) == 1))
+		    (atomic_xchg(&lock->count, -1) == 1)) {
+			mstat_end(MSTAT_WOKEN, wait_start);
 			break;
+		}
 
 		/*
 		 * got a signal? (This code gets eliminated in the
@@ -556,6 +687,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 				goto err;
 		}
 
+		mutex_want_handoff(lock, &waiter);
 		__set_task_state(task, state);
 
 		/* didn't get the lock, go to sleep: */
@@ -563,6 +695,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 		schedule_preempt_disabled();
 		spin_lock_mutex(&lock->wait_lock, flags);
 	}
+	mutex_handoff_done(lock, &waiter);
 	mutex_remove_waiter(lock, &waiter, current_thread_info());
 	/* set it to 0 if there are no waiters left: */
 	if (likely(list_empty(&lock->wait_list)))
@@ -600,6 +733,7 @@ skip_wait:
 	return 0;
 
 err:
+	mutex_handoff_done(lock, &waiter);
 	mutex_remove_waiter(lock, &waiter, task_thread_info(task));
 	spin_unlock_mutex(&lock->wait_lock, flags);
 	debug_mutex_free_waiter(&waiter);
@@ -714,6 +848,8 @@ static inline void
 __mutex_unlock_common_slowpath(struct mutex *lock, int nested)
 {
 	unsigned long flags;
+	bool handoff = false;
+	WAKE_Q(wake_q);
 
 	/*
 	 * As a performance measurement, release the lock before doing other
@@ -726,14 +862,23 @@ __mutex_unlock_common_slowpath(struct mutex *lock, int nested)
 	 * Some architectures leave the lock unlocked in the fastpath failure
 	 * case, others need to leave it locked. In the later case we have to
 	 * unlock it here - as the lock counter is currently 0 or negative.
+	 * If the top waiter wants a handoff, the decision is made under
+	 * the wait_lock instead.
 	 */
-	if (__mutex_slowpath_needs_to_unlock())
-		atomic_set(&lock->count, 1);
+	if (__mutex_slowpath_needs_to_unlock()) {
+		if (unlikely(mutex_handoff_pending(lock)))
+			handoff = true;
+		else
+			atomic_set(&lock->count, 1);
+	}
 
 	spin_lock_mutex(&lock->wait_lock, flags);
 	mutex_release(&lock->dep_map, nested, _RET_IP_);
 	debug_mutex_unlock(lock);
 
+	if (handoff && !mutex_handoff(lock))
+		atomic_set(&lock->count, 1);
+
 	if (!list_empty(&lock->wait_list)) {
 		/* get the first entry from the wait-list: */
 		struct mutex_waiter *waiter =
@@ -742,10 +887,16 @@ __mutex_unlock_common_slowpath(struct mutex *lock, int nested)
 
 		debug_mutex_wake_waiter(lock, waiter);
 
-		wake_up_process(waiter->task);
+		/*
+		 * The wakeup is issued once the wait_lock is released, so
+		 * that neither the unlocker's hold time covers it nor the
+		 * woken waiter finds the wait_lock still held.
+		 */
+		wake_q_add(&wake_q, waiter->task);
 	}
 
 	spin_unlock_mutex(&lock->wait_lock, flags);
+	wake_up_q(&wake_q);
 }
 
 /*
@@ -946,6 +1097,144 @@ EXPORT_SYMBOL(__ww_mutex_lock_interruptible);
 
 #endif
 
+/*
+ * Set the context of the w/w mutexes locks[first..last) taken with a
+ * trylock by __ww_mutex_lock_many(), then wake up the waiters that raced
+ * with the trylocks as ww_mutex_set_context_fastpath() does, with a single
+ * barrier for all of them.
+ */
+static void ww_mutex_set_context_many(struct ww_mutex **locks,
+				      unsigned int first, unsigned int last,
+				      struct ww_acquire_ctx *ctx)
+{
+	unsigned int i;
+
+	if (first >= last)
+		return;
+
+	for (i = first; i < last; i++) {
+		ww_mutex_lock_acquired(locks[i], ctx);
+		locks[i]->ctx = ctx;
+	}
+
+	smp_mb(); /* See ww_mutex_set_context_fastpath() */
+
+	for (i = first; i < last; i++)
+		ww_mutex_wake_contended(locks[i]);
+}
+
+static int __sched
+__ww_mutex_lock_many(struct ww_mutex **locks, unsigned int count,
+		     struct ww_acquire_ctx *ctx, bool interruptible)
+{
+	struct ww_mutex *contended = NULL;
+	unsigned int i, j, first;
+	int ret;
+
+	might_sleep();
+retry:
+	for (i = 0, first = 0; i < count; i++) {
+		struct ww_mutex *lock = locks[i];
+
+		if (lock == contended) {
+			ww_mutex_set_context_many(locks, first, i, ctx);
+			first = i + 1;
+			continue;
+		}
+#ifndef CONFIG_DEBUG_LOCK_ALLOC
+		/*
+		 * Without lockdep, the free mutexes are taken with a plain
+		 * trylock and their context is set in batches. The batch
+		 * must be complete before sleeping on a mutex, else its
+		 * waiters could not tell that we hold it.
+		 */
+		if (mutex_trylock(&lock->base))
+			continue;
+#endif
+		ww_mutex_set_context_many(locks, first, i, ctx);
+		first = i + 1;
+
+		if (interruptible)
+			ret = __ww_mutex_lock_interruptible(lock, ctx);
+		else
+			ret = __ww_mutex_lock(lock, ctx);
+		if (ret)
+			goto backoff;
+	}
+	ww_mutex_set_context_many(locks, first, count, ctx);
+	return 0;
+
+backoff:
+	for (j = 0; j < i; j++)
+		ww_mutex_unlock(locks[j]);
+	for (j = i + 1; j < count; j++) {
+		if (locks[j] == contended)
+			ww_mutex_unlock(contended);
+	}
+
+	/*
+	 * Back off on our own only if the context holds no other mutex,
+	 * the caller has to release those otherwise.
+	 */
+	if (ret != -EDEADLK || ctx->acquired)
+		return ret;
+
+	contended = locks[i];
+	if (interruptible) {
+		ret = ww_mutex_lock_slow_interruptible(contended, ctx);
+		if (ret)
+			return ret;
+	} else {
+		ww_mutex_lock_slow(contended, ctx);
+	}
+	goto retry;
+}
+
+/**
+ * ww_mutex_lock_many - acquire an array of w/w mutexes
+ * @locks: the mutexes to be acquired
+ * @count: number of mutexes in @locks
+ * @ctx: w/w acquire context
+ *
+ * Lock all the w/w mutexes of @locks, which must be distinct and not held
+ * by @ctx yet, as a series of ww_mutex_lock() would. The free mutexes are
+ * taken with a trylock and their context is published in batches, which
+ * saves the per-mutex barrier and slowpath entry of ww_mutex_lock().
+ *
+ * The wound case is handled here when @ctx holds no other mutex: all the
+ * mutexes of @locks are released, the contending one is waited for and the
+ * acquisition starts over. Otherwise, or if a mutex of @locks is already
+ * held by @ctx, the mutexes taken by this call are released and -EDEADLK or
+ * -EALREADY is returned, to be handled as for ww_mutex_lock().
+ *
+ * Returns 0 once all the mutexes are held.
+ */
+int __sched
+ww_mutex_lock_many(struct ww_mutex **locks, unsigned int count,
+		   struct ww_acquire_ctx *ctx)
+{
+	return __ww_mutex_lock_many(locks, count, ctx, false);
+}
+EXPORT_SYMBOL_GPL(ww_mutex_lock_many);
+
+/**
+ * ww_mutex_lock_many_interruptible - acquire an array of w/w mutexes,
+ *				      interruptible
+ * @locks: the mutexes to be acquired
+ * @count: number of mutexes in @locks
+ * @ctx: w/w acquire context
+ *
+ * As ww_mutex_lock_many(), but returns -EINTR with none of the mutexes of
+ * @locks held if a signal arrives while waiting for one of them.
+ */
+int __sched
+ww_mutex_lock_many_interruptible(struct ww_mutex **locks, unsigned int count,
+				 struct ww_acquire_ctx *ctx)
+{
+	return __ww_mutex_lock_many(locks, count, ctx, true);
+}
+EXPORT_SYMBOL_GPL(ww_mutex_lock_many_interruptible);
+
 /**
  * atomic_dec_and_mutex_lock - return holding mutex if we dec to 0
  * @cnt: the atomic which we are to dec
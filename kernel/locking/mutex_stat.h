@@ -0,0 +1,55 @@
+#ifndef __LINUX_MUTEX_STAT_H
+#define __LINUX_MUTEX_STAT_H
+
+/*
+ *	Mutex Wait Statistics
+ *
+ * Per-cpu counts, total wait times and log2 histograms of the wait time in
+ * ns of the mutex acquisitions that had to sleep, broken down by the way
+ * the lock is finally acquired:
+ *  1) woken   - the woken up waiter takes the free mutex itself
+ *  2) handoff - the unlocker hands the mutex over to the top waiter
+ *
+ * The wait time is measured from the queuing on the wait list. The
+ * statistics are exposed under the mutex debugfs directory, see
+ * wait_stat.h.
+ */
+#include "wait_stat.h"
+
+enum mstat_path {
+	MSTAT_WOKEN,		/* Acquired after a wakeup	*/
+	MSTAT_HANDOFF,		/* Handed over by the unlocker	*/
+	MSTAT_NR_PATHS
+};
+
+static const char * const mstat_names[MSTAT_NR_PATHS] = {
+	[MSTAT_WOKEN]   = "woken",
+	[MSTAT_HANDOFF] = "handoff",
+};
+
+DEFINE_WSTAT(mstat, mstat_names);
+
+static inline u64 mstat_start(void)
+{
+	return sched_clock();
+}
+
+/**
+ * mstat_end - account for a mutex acquisition that had to sleep
+ * @path : The path the mutex is acquired through
+ * @start: The start time returned by mstat_start()
+ *
+ * Called with the wait_lock held and preemption disabled.
+ */
+static inline void mstat_end(enum mstat_path path, u64 start)
+{
+	wstat_wait(&mstat, path, start);
+}
+
+static int __init mstat_debugfs_init(void)
+{
+	return wstat_debugfs_init(&mstat, "mutex", NULL) ? 0 : -ENOMEM;
+}
+fs_initcall(mstat_debugfs_init);
+
+#endif /* __LINUX_MUTEX_STAT_H */
@@ -15,12 +15,29 @@
  *
  * Authors: Waiman Long <waiman.long@hp.com>
  */
+#ifndef _GEN_PV_RWLOCK_SLOWPATH
 #include <linux/smp.h>
 #include <linux/bug.h>
 #include <linux/cpumask.h>
 #include <linux/percpu.h>
 #include <linux/hardirq.h>
+#include <linux/slab.h>
 #include <asm/qrwlock.h>
+#include <asm-generic/qrwlock_numa.h>
+
+#ifdef CONFIG_QUEUE_RWLOCK_STAT
+#include "qrwlock_stat.h"
+#else
+#define qrwstat_reader(type)	do { } while (0)
+#define qrwstat_start()		0
+#define qrwstat_writer(start)	((void)(start))
+#endif
+
+/*
+ * The number of loops an interrupt context reader of a QRW_POLICY_WRITER
+ * lock waits for a waiting writer to be done before getting ahead of it.
+ */
+#define QRW_READER_YIELD_LOOPS	(1 << 10)
 
 /**
  * rspin_until_writer_unlock - inc reader count & spin until writer is gone
@@ -40,32 +57,169 @@ rspin_until_writer_unlock(struct qrwlock *lock, u32 cnts)
 }
 
 /**
- * queue_read_lock_slowpath - acquire read lock of a queue rwlock
- * @lock: Pointer to queue rwlock structure
+ * rgrant_revoke - take back the reader counts of the unused advance grants
+ * @plock : Pointer to policy queue rwlock structure
+ *
+ * Called with the internal lock held. The queued readers that find no
+ * grant left just go through the normal queue head path.
  */
-void queue_read_lock_slowpath(struct qrwlock *lock)
+static inline void rgrant_revoke(struct policy_qrwlock *plock)
 {
+	smp_mb__before_atomic();
+	atomic_sub(plock->rgrant * _QR_BIAS, &plock->rwlock.cnts);
+	plock->rgrant = 0;
+}
+
+/**
+ * ryield_to_writer - let a waiting writer through for a bounded time
+ * @lock  : Pointer to queue rwlock structure
+ * Return: The lock value before the reader count is incremented again
+ *
+ * The reader count is dropped for the waiting writer to get the lock if
+ * this reader was the last one in its way. As this reader may be nested in
+ * another reader of the same cpu that the writer will wait for forever, the
+ * wait is bounded.
+ */
+static noinline u32 ryield_to_writer(struct qrwlock *lock)
+{
+	int loop = QRW_READER_YIELD_LOOPS;
 	u32 cnts;
 
+	qrwstat_reader(QRWSTAT_YIELD);
+	queue_read_unlock(lock);
+	do {
+		cpu_relax_lowlatency();
+		cnts = atomic_read(&lock->cnts);
+	} while ((cnts & _QW_WMASK) && --loop);
+
+	return atomic_add_return(_QR_BIAS, &lock->cnts) - _QR_BIAS;
+}
+
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUE_SPINLOCK)
+#include <asm/pvqrwlock.h>
+
+extern void pv_queue_read_lock_slowpath(struct qrwlock *lock);
+extern void pv_queue_write_lock_slowpath(struct qrwlock *lock);
+extern void pv_queue_read_lock_policy_slowpath(struct policy_qrwlock *lock);
+extern void pv_queue_write_lock_policy_slowpath(struct policy_qrwlock *lock);
+
+/*
+ * Redirect to the PV slowpath functions when the PV spinlocks are enabled
+ */
+static __always_inline bool
+nonpv_read_redirect(struct qrwlock *lock, struct policy_qrwlock *plock)
+{
+	if (!static_key_false(&paravirt_spinlocks_enabled))
+		return false;
+	if (plock)
+		pv_queue_read_lock_policy_slowpath(plock);
+	else
+		pv_queue_read_lock_slowpath(lock);
+	return true;
+}
+
+static __always_inline bool
+nonpv_write_redirect(struct qrwlock *lock, struct policy_qrwlock *plock)
+{
+	if (!static_key_false(&paravirt_spinlocks_enabled))
+		return false;
+	if (plock)
+		pv_queue_write_lock_policy_slowpath(plock);
+	else
+		pv_queue_write_lock_slowpath(lock);
+	return true;
+}
+#else
+static inline bool
+nonpv_read_redirect(struct qrwlock *lock, struct policy_qrwlock *plock)
+{
+	return false;
+}
+
+static inline bool
+nonpv_write_redirect(struct qrwlock *lock, struct policy_qrwlock *plock)
+{
+	return false;
+}
+#endif
+
+/*
+ * Non-PV functions for bare-metal slowpath code
+ */
+static __always_inline void
+nonpv_rwlock_wait(struct qrwlock *lock, u32 cnts, int *count)
+{
+	cpu_relax_lowlatency();
+}
+
+#define pv_read_redirect	nonpv_read_redirect
+#define pv_write_redirect	nonpv_write_redirect
+#define pv_rwlock_wait		nonpv_rwlock_wait
+
+#endif	/* _GEN_PV_RWLOCK_SLOWPATH */
+
+/*
+ * The slowpaths are shared by the plain and the policy queue rwlocks. @plock
+ * is NULL for a plain lock, which then behaves as QRW_POLICY_FAIR and admits
+ * its queued readers one at a time.
+ */
+static __always_inline void
+__queue_read_lock_slowpath(struct qrwlock *lock, struct policy_qrwlock *plock)
+{
+	u32 cnts, nr;
+	int loop = 0;
+	u8 policy;
+
+	if (pv_read_redirect(lock, plock))
+		return;
+
 	/*
 	 * Readers come here when they cannot get the lock without waiting
 	 */
-	if (unlikely(in_interrupt())) {
+	policy = plock ? ACCESS_ONCE(plock->policy) : QRW_POLICY_FAIR;
+	if (unlikely(in_interrupt() || policy == QRW_POLICY_READER)) {
 		/*
 		 * Readers in interrupt context will spin until the lock is
-		 * available without waiting in the queue.
+		 * available without waiting in the queue. Unless the policy
+		 * prefers the writers, they get ahead of a waiting writer.
 		 */
 		cnts = smp_load_acquire((u32 *)&lock->cnts);
+		if ((cnts & _QW_WMASK) == _QW_WAITING &&
+		    policy == QRW_POLICY_WRITER)
+			cnts = ryield_to_writer(lock);
+		if ((cnts & _QW_WMASK) == _QW_WAITING)
+			qrwstat_reader(QRWSTAT_BYPASS);
 		rspin_until_writer_unlock(lock, cnts);
 		return;
 	}
-	atomic_sub(_QR_BIAS, &lock->cnts);
+	/*
+	 * Drop the reader count the same way as an unlock does as it may be
+	 * the last reader that a halted writer is waiting for.
+	 */
+	queue_read_unlock(lock);
 
 	/*
 	 * Put the reader into the wait queue
 	 */
+	if (plock)
+		atomic_inc(&plock->rwaiting);
 	arch_spin_lock(&lock->lock);
 
+	/*
+	 * The readers queued behind a reader queue head of a policy lock are
+	 * admitted as a group: the head adds the reader counts of all the
+	 * readers that have arrived in the queue at once. These readers then
+	 * just take one of the grants, without incrementing the reader count
+	 * again, when they get to the head of the queue. A writer that gets
+	 * to the head first takes the remaining grants back, so do the
+	 * readers if there is no one left in the queue.
+	 */
+	if (plock && plock->rgrant) {
+		plock->rgrant--;
+		cnts = smp_load_acquire((u32 *)&lock->cnts);
+		goto granted;
+	}
+
 	/*
 	 * At the head of the wait queue now, wait until the writer state
 	 * goes to 0 and then try to increment the reader count and get
@@ -73,30 +227,52 @@ void queue_read_lock_slowpath(struct qrwlock *lock)
 	 * lock in the interim, so it is necessary to check the writer byte
 	 * to make sure that the write lock isn't taken.
 	 */
-	while (atomic_read(&lock->cnts) & _QW_WMASK)
-		cpu_relax_lowlatency();
+	while ((cnts = atomic_read(&lock->cnts)) & _QW_WMASK)
+		pv_rwlock_wait(lock, cnts, &loop);
 
-	cnts = atomic_add_return(_QR_BIAS, &lock->cnts) - _QR_BIAS;
+	nr = plock ? atomic_xchg(&plock->rwaiting, 0) : 1;
+	nr = clamp_t(u32, nr, 1, U16_MAX);
+	cnts = atomic_add_return(nr * _QR_BIAS, &lock->cnts) - nr * _QR_BIAS;
+	if (plock)
+		plock->rgrant = nr - 1;
+
+	/* Clear the halted flag that only the queue head will set */
+	if (unlikely(cnts & _QW_PVHALT))
+		atomic_sub(_QW_PVHALT, &lock->cnts);
+granted:
+	/*
+	 * A writer may have stolen the lock before the reader counts are
+	 * incremented.
+	 */
 	rspin_until_writer_unlock(lock, cnts);
+	if (plock && plock->rgrant && !arch_spin_is_contended(&lock->lock))
+		rgrant_revoke(plock);
 
 	/*
 	 * Signal the next one in queue to become queue head
 	 */
 	arch_spin_unlock(&lock->lock);
 }
-EXPORT_SYMBOL(queue_read_lock_slowpath);
 
-/**
- * queue_write_lock_slowpath - acquire write lock of a queue rwlock
- * @lock : Pointer to queue rwlock structure
- */
-void queue_write_lock_slowpath(struct qrwlock *lock)
+static __always_inline void
+__queue_write_lock_slowpath(struct qrwlock *lock, struct policy_qrwlock *plock)
 {
 	u32 cnts;
+	int loop = 0;
+	u64 start;
+
+	if (pv_write_redirect(lock, plock))
+		return;
+
+	start = qrwstat_start();
 
 	/* Put the writer into the wait queue */
 	arch_spin_lock(&lock->lock);
 
+	/* The readers admitted in advance are behind this writer */
+	if (plock && unlikely(plock->rgrant))
+		rgrant_revoke(plock);
+
 	/* Try to acquire the lock directly if no reader is present */
 	if (!atomic_read(&lock->cnts) &&
 	    (atomic_cmpxchg(&lock->cnts, 0, _QW_LOCKED) == 0))
@@ -104,29 +280,313 @@ void queue_write_lock_slowpath(struct qrwlock *lock)
 
 	/*
 	 * Set the waiting flag to notify readers that a writer is pending,
-	 * or wait for a previous writer to go away.
+	 * or wait for a previous writer to go away. The halted flag, if set,
+	 * is cleared at the same time.
 	 */
 	for (;;) {
 		cnts = atomic_read(&lock->cnts);
 		if (!(cnts & _QW_WMASK) &&
 		    (atomic_cmpxchg(&lock->cnts, cnts,
-				    cnts | _QW_WAITING) == cnts))
+			(cnts & ~_QW_PVHALT) | _QW_WAITING) == cnts))
 			break;
 
-		cpu_relax_lowlatency();
+		pv_rwlock_wait(lock, cnts, &loop);
 	}
 
 	/* When no more readers, set the locked flag */
+	loop = 0;
 	for (;;) {
 		cnts = atomic_read(&lock->cnts);
-		if ((cnts == _QW_WAITING) &&
-		    (atomic_cmpxchg(&lock->cnts, _QW_WAITING,
-				    _QW_LOCKED) == _QW_WAITING))
+		if (((cnts & ~_QW_PVHALT) == _QW_WAITING) &&
+		    (atomic_cmpxchg(&lock->cnts, cnts, _QW_LOCKED) == cnts))
 			break;
 
-		cpu_relax_lowlatency();
+		pv_rwlock_wait(lock, cnts, &loop);
 	}
 unlock:
+	qrwstat_writer(start);
 	arch_spin_unlock(&lock->lock);
 }
+
+/**
+ * queue_read_lock_slowpath - acquire read lock of a queue rwlock
+ * @lock: Pointer to queue rwlock structure
+ */
+void queue_read_lock_slowpath(struct qrwlock *lock)
+{
+	__queue_read_lock_slowpath(lock, NULL);
+}
+EXPORT_SYMBOL(queue_read_lock_slowpath);
+
+/**
+ * queue_write_lock_slowpath - acquire write lock of a queue rwlock
+ * @lock : Pointer to queue rwlock structure
+ */
+void queue_write_lock_slowpath(struct qrwlock *lock)
+{
+	__queue_write_lock_slowpath(lock, NULL);
+}
 EXPORT_SYMBOL(queue_write_lock_slowpath);
+
+/**
+ * queue_read_lock_policy_slowpath - acquire read lock of a policy qrwlock
+ * @lock: Pointer to policy queue rwlock structure
+ */
+void queue_read_lock_policy_slowpath(struct policy_qrwlock *lock)
+{
+	__queue_read_lock_slowpath(&lock->rwlock, lock);
+}
+EXPORT_SYMBOL(queue_read_lock_policy_slowpath);
+
+/**
+ * queue_write_lock_policy_slowpath - acquire write lock of a policy qrwlock
+ * @lock : Pointer to policy queue rwlock structure
+ */
+void queue_write_lock_policy_slowpath(struct policy_qrwlock *lock)
+{
+	__queue_write_lock_slowpath(&lock->rwlock, lock);
+}
+EXPORT_SYMBOL(queue_write_lock_policy_slowpath);
+
+#ifndef _GEN_PV_RWLOCK_SLOWPATH
+/**
+ * queue_read_lock_percpu_slowpath - acquire read lock of a percpu qrwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ *
+ * A writer is present. Holding the embedded rwlock for read keeps the next
+ * writer out until the per-cpu count is raised.
+ */
+void queue_read_lock_percpu_slowpath(struct percpu_qrwlock *lock)
+{
+	queue_read_lock(&lock->rwlock);
+	this_cpu_inc(*lock->readers);
+	queue_read_unlock(&lock->rwlock);
+}
+EXPORT_SYMBOL(queue_read_lock_percpu_slowpath);
+
+/**
+ * queue_read_trylock_percpu_slowpath - try to read lock a percpu qrwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ * Return: 1 if lock acquired, 0 if failed
+ */
+int queue_read_trylock_percpu_slowpath(struct percpu_qrwlock *lock)
+{
+	if (!queue_read_trylock(&lock->rwlock))
+		return 0;
+
+	this_cpu_inc(*lock->readers);
+	queue_read_unlock(&lock->rwlock);
+	return 1;
+}
+EXPORT_SYMBOL(queue_read_trylock_percpu_slowpath);
+
+/*
+ * Return true if all the per-cpu reader counts are 0.
+ */
+static bool queue_percpu_readers_gone(struct percpu_qrwlock *lock)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (ACCESS_ONCE(*per_cpu_ptr(lock->readers, cpu)))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * queue_write_lock_percpu - acquire write lock of a percpu queue rwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ */
+void queue_write_lock_percpu(struct percpu_qrwlock *lock)
+{
+	int cpu;
+
+	queue_write_lock(&lock->rwlock);
+	ACCESS_ONCE(lock->writer) = 1;
+	smp_mb();
+
+	for_each_possible_cpu(cpu) {
+		while (ACCESS_ONCE(*per_cpu_ptr(lock->readers, cpu)))
+			cpu_relax_lowlatency();
+	}
+	smp_mb();
+}
+EXPORT_SYMBOL(queue_write_lock_percpu);
+
+/**
+ * queue_write_trylock_percpu - try to write lock a percpu queue rwlock
+ * @lock : Pointer to percpu queue rwlock structure
+ * Return: 1 if lock acquired, 0 if failed
+ */
+int queue_write_trylock_percpu(struct percpu_qrwlock *lock)
+{
+	if (!queue_write_trylock(&lock->rwlock))
+		return 0;
+
+	ACCESS_ONCE(lock->writer) = 1;
+	smp_mb();
+	if (likely(queue_percpu_readers_gone(lock))) {
+		smp_mb();
+		return 1;
+	}
+
+	queue_write_unlock_percpu(lock);
+	return 0;
+}
+EXPORT_SYMBOL(queue_write_trylock_percpu);
+
+/**
+ * numa_qrwlock_init - initialize a numa queue rwlock
+ * @lock: Pointer to numa queue rwlock structure
+ * @gfp : Allocation flags of the node reader counts
+ * Return: 0 on success, -ENOMEM if the reader counts can't be allocated
+ */
+int numa_qrwlock_init(struct numa_qrwlock *lock, gfp_t gfp)
+{
+	lock->rwlock = (struct qrwlock)__ARCH_RW_LOCK_UNLOCKED;
+	lock->writer = 0;
+	lock->nodes  = kcalloc(nr_node_ids, sizeof(*lock->nodes), gfp);
+
+	return lock->nodes ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL(numa_qrwlock_init);
+
+/**
+ * numa_qrwlock_free - free the node reader counts of a numa queue rwlock
+ * @lock: Pointer to numa queue rwlock structure
+ */
+void numa_qrwlock_free(struct numa_qrwlock *lock)
+{
+	kfree(lock->nodes);
+	lock->nodes = NULL;
+}
+EXPORT_SYMBOL(numa_qrwlock_free);
+
+/**
+ * queue_read_lock_numa_slowpath - acquire read lock of a numa qrwlock
+ * @lock : Pointer to numa queue rwlock structure
+ *
+ * A reader in process context waits on the embedded rwlock, which keeps
+ * the next writer out until the node count is raised. A reader in interrupt
+ * context only waits for a writer that has drained the node counts.
+ */
+void queue_read_lock_numa_slowpath(struct numa_qrwlock *lock)
+{
+	if (unlikely(in_interrupt())) {
+		do {
+			while (ACCESS_ONCE(lock->writer) == NQRW_LOCKED)
+				cpu_relax_lowlatency();
+		} while (!queue_read_lock_numa_fast(lock));
+		return;
+	}
+
+	queue_read_lock(&lock->rwlock);
+	atomic_inc(numa_qrwlock_readers(lock));
+	queue_read_unlock(&lock->rwlock);
+}
+EXPORT_SYMBOL(queue_read_lock_numa_slowpath);
+
+/**
+ * queue_read_trylock_numa_slowpath - try to read lock a numa qrwlock
+ * @lock : Pointer to numa queue rwlock structure
+ * Return: 1 if lock acquired, 0 if failed
+ */
+int queue_read_trylock_numa_slowpath(struct numa_qrwlock *lock)
+{
+	if (in_interrupt() || !queue_read_trylock(&lock->rwlock))
+		return 0;
+
+	atomic_inc(numa_qrwlock_readers(lock));
+	queue_read_unlock(&lock->rwlock);
+	return 1;
+}
+EXPORT_SYMBOL(queue_read_trylock_numa_slowpath);
+
+/*
+ * Return true if all the node reader counts are 0.
+ */
+static bool queue_numa_readers_gone(struct numa_qrwlock *lock)
+{
+	int node;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		if (atomic_read(&lock->nodes[node].readers))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * queue_write_lock_numa - acquire write lock of a numa queue rwlock
+ * @lock : Pointer to numa queue rwlock structure
+ */
+void queue_write_lock_numa(struct numa_qrwlock *lock)
+{
+	int node;
+
+	queue_write_lock(&lock->rwlock);
+	for (;;) {
+		ACCESS_ONCE(lock->writer) = NQRW_WAITING;
+		smp_mb();
+		for (node = 0; node < nr_node_ids; node++) {
+			while (atomic_read(&lock->nodes[node].readers))
+				cpu_relax_lowlatency();
+		}
+
+		/* Recheck for the interrupt context readers that came in */
+		ACCESS_ONCE(lock->writer) = NQRW_LOCKED;
+		smp_mb();
+		if (queue_numa_readers_gone(lock))
+			break;
+	}
+	smp_mb();
+}
+EXPORT_SYMBOL(queue_write_lock_numa);
+
+/**
+ * queue_write_trylock_numa - try to write lock a numa queue rwlock
+ * @lock : Pointer to numa queue rwlock structure
+ * Return: 1 if lock acquired, 0 if failed
+ */
+int queue_write_trylock_numa(struct numa_qrwlock *lock)
+{
+	if (!queue_write_trylock(&lock->rwlock))
+		return 0;
+
+	ACCESS_ONCE(lock->writer) = NQRW_LOCKED;
+	smp_mb();
+	if (likely(queue_numa_readers_gone(lock))) {
+		smp_mb();
+		return 1;
+	}
+
+	queue_write_unlock_numa(lock);
+	return 0;
+}
+EXPORT_SYMBOL(queue_write_trylock_numa);
+#endif /* !_GEN_PV_RWLOCK_SLOWPATH */
+
+#if !defined(_GEN_PV_RWLOCK_SLOWPATH) && \
+     defined(CONFIG_PARAVIRT_SPINLOCKS) && defined(CONFIG_QUEUE_SPINLOCK)
+/*
+ * Generate the PV version of the queue rwlock slowpath functions by
+ * enabling all the PV specific code paths.
+ */
+#undef	pv_read_redirect
+#undef	pv_write_redirect
+#undef	pv_rwlock_wait
+
+#define _GEN_PV_RWLOCK_SLOWPATH
+#define pv_read_redirect(lock, plock)	false
+#define pv_write_redirect(lock, plock)	false
+#define __queue_read_lock_slowpath	__pv_queue_read_lock_slowpath
+#define __queue_write_lock_slowpath	__pv_queue_write_lock_slowpath
+#define queue_read_lock_slowpath	pv_queue_read_lock_slowpath
+#define queue_write_lock_slowpath	pv_queue_write_lock_slowpath
+#define queue_read_lock_policy_slowpath	pv_queue_read_lock_policy_slowpath
+#define queue_write_lock_policy_slowpath pv_queue_write_lock_policy_slowpath
+
+#include "qrwlock.c"
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __LINUX_QRWLOCK_STAT_H
+#define __LINUX_QRWLOCK_STAT_H
+
+/*
+ *	Queue rwlock Reader Bypass & Writer Wait Statistics
+ *
+ * Per-cpu counts of the readers in interrupt context that
+ *  1) reader_bypass - get the lock ahead of a waiting writer
+ *  2) reader_yield  - drop their count to let a waiting writer through
+ *		       first
+ * and the count, total & maximum wait times and log2 histogram of the wait
+ * time in ns of the writers that go into the slowpath. The statistics are
+ * exposed under the qrwlock debugfs directory, see wait_stat.h.
+ */
+#include "wait_stat.h"
+
+enum qrwstat_path {
+	QRWSTAT_BYPASS,		/* Got ahead of a waiting writer	*/
+	QRWSTAT_YIELD,		/* Let a waiting writer through		*/
+	QRWSTAT_WRITER,		/* Writer in the slowpath		*/
+	QRWSTAT_NR_PATHS
+};
+
+static const char * const qrwstat_names[QRWSTAT_NR_PATHS] = {
+	[QRWSTAT_BYPASS] = "reader_bypass",
+	[QRWSTAT_YIELD]  = "reader_yield",
+	[QRWSTAT_WRITER] = "writer",
+};
+
+DEFINE_WSTAT(qrwstat, qrwstat_names);
+
+static inline void qrwstat_reader(enum qrwstat_path type)
+{
+	wstat_count(&qrwstat, type);
+}
+
+static inline u64 qrwstat_start(void)
+{
+	return sched_clock();
+}
+
+/**
+ * qrwstat_writer - account for a writer that went into the slowpath
+ * @start: The start time returned by qrwstat_start()
+ *
+ * Called with preemption disabled.
+ */
+static inline void qrwstat_writer(u64 start)
+{
+	wstat_wait(&qrwstat, QRWSTAT_WRITER, start);
+}
+
+static int __init qrwstat_debugfs_init(void)
+{
+	return wstat_debugfs_init(&qrwstat, "qrwlock", NULL) ? 0 : -ENOMEM;
+}
+fs_initcall(qrwstat_debugfs_init);
+
+#endif /* __LINUX_QRWLOCK_STAT_H */
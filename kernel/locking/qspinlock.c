@@ -23,9 +23,18 @@
 #include <linux/percpu.h>
 #include <linux/hardirq.h>
 #include <linux/mutex.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <linux/hash.h>
 #include <asm/byteorder.h>
 #include <asm/qspinlock.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/qspinlock.h>
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(qspinlock_slowpath);
+EXPORT_TRACEPOINT_SYMBOL_GPL(qspinlock_acquired);
+
 /*
  * The basic principle of a queue-based spinlock can best be understood
  * by studying a classic queue-based spinlock implementation called the
@@ -64,21 +73,74 @@
 
 #include "mcs_spinlock.h"
 
-#ifdef CONFIG_PARAVIRT_SPINLOCKS
-#define MAX_NODES	8
-#else
-#define MAX_NODES	4
-#endif
+/*
+ * The number of queue nodes that can be encoded in the tail, one for each
+ * of the nested contexts: task, softirq, hardirq, nmi.
+ */
+#define MAX_QNODES	4
 
 /*
- * Per-CPU queue node structures; we can never have more than 4 nested
- * contexts: task, softirq, hardirq, nmi.
+ * Per-CPU queue node structures; we normally never have more than 4
+ * nested contexts: task, softirq, hardirq, nmi. Deeper nesting, e.g. a
+ * machine check within an NMI, will spin on the lock without queuing.
  *
  * Exactly fits one 64-byte cacheline on a 64-bit architecture.
  *
- * PV doubles the storage and uses the second cacheline for PV states.
+ * PV keeps its per-node states in a separate per-CPU array indexed by the
+ * nesting level, qnode_states, which takes the next cacheline. So does
+ * the NUMA cohort mode for its secondary queue states. The MCS fields
+ * that the queue neighbours write to stay in the MCS node line, and the
+ * states have the same stride as the MCS nodes so that the state of any
+ * node, local or remote, is found at a constant offset from it.
+ *
+ * With CONFIG_QUEUE_SPINLOCK_TILED_NODES, each nested context has a whole
+ * cacheline instead, with the PV or NUMA states right after its MCS node.
+ * The stores of the neighbours in the queues of a context, to the next
+ * pointer or the locked flag of its node, then no longer hit the node a
+ * nested context spins on, at the cost of 4 cachelines per CPU.
  */
-static DEFINE_PER_CPU_ALIGNED(struct mcs_spinlock, mcs_nodes[MAX_NODES]);
+struct qnode_state {
+	long	__state[sizeof(struct mcs_spinlock) / sizeof(long)];
+};
+
+#ifdef CONFIG_QUEUE_SPINLOCK_TILED_NODES
+struct qnode {
+	struct mcs_spinlock mcs;
+	struct qnode_state  state;
+} ____cacheline_aligned;
+
+#define MCS_NODE(idx)	qnodes[idx].mcs
+
+static DEFINE_PER_CPU_ALIGNED(struct qnode, qnodes[MAX_QNODES]);
+
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) || defined(CONFIG_QUEUE_SPINLOCK_NUMA)
+static __always_inline void *qnode_state(struct mcs_spinlock *node)
+{
+	return &container_of(node, struct qnode, mcs)->state;
+}
+#endif
+#else
+#define MCS_NODE(idx)	mcs_nodes[idx]
+
+static DEFINE_PER_CPU_ALIGNED(struct mcs_spinlock, mcs_nodes[MAX_QNODES]);
+
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) || defined(CONFIG_QUEUE_SPINLOCK_NUMA)
+static DEFINE_PER_CPU_ALIGNED(struct qnode_state, qnode_states[MAX_QNODES]);
+
+/*
+ * The per-CPU areas are copies of the same layout, so the distance
+ * between two per-CPU variables is the same on every CPU.
+ */
+static __always_inline void *qnode_state(struct mcs_spinlock *node)
+{
+	BUILD_BUG_ON(sizeof(struct qnode_state) !=
+		     sizeof(struct mcs_spinlock));
+
+	return (void *)node + ((__force unsigned long)&qnode_states[0] -
+			       (__force unsigned long)&mcs_nodes[0]);
+}
+#endif
+#endif
 
 /*
  * We must be able to distinguish between no-tail and the tail at 0:0,
@@ -103,11 +165,50 @@ static inline struct mcs_spinlock *decode_tail(u32 tail)
 	int cpu = (tail >> _Q_TAIL_CPU_OFFSET) - 1;
 	int idx = (tail &  _Q_TAIL_IDX_MASK) >> _Q_TAIL_IDX_OFFSET;
 
-	return per_cpu_ptr(&mcs_nodes[idx], cpu);
+	return per_cpu_ptr(&MCS_NODE(idx), cpu);
+}
+
+/*
+ * The queue position of a node is 0 at the queue head and one more than
+ * the position of the previous node when linked behind it. The queue head
+ * resets its position to 0, but the nodes behind it don't learn about
+ * their own progress, so the position is exact when queuing right behind
+ * the head and may overestimate the depth of a queue that never drains.
+ * It lets the deeper waiters use lower power waits sooner, e.g. PV halt.
+ *
+ * The previous node is prefetched for writing, as we are going to link
+ * ourself into it.
+ */
+#define QNODE_POS_MAX	0x7fff
+
+static __always_inline short qnode_next_pos(struct mcs_spinlock *prev)
+{
+	short pos = ACCESS_ONCE(prev->pos);
+
+	return (pos < QNODE_POS_MAX) ? pos + 1 : QNODE_POS_MAX;
+}
+
+static __always_inline void
+qnode_link_pos(struct mcs_spinlock *node, struct mcs_spinlock *prev)
+{
+	arch_mcs_prefetch_node(prev);
+	node->pos = qnode_next_pos(prev);
 }
 
 #define _Q_LOCKED_PENDING_MASK (_Q_LOCKED_MASK | _Q_PENDING_MASK)
 
+/*
+ * With CONFIG_QUEUE_SPINLOCK_LOCKREF, the lockref count next to the lock
+ * word can be changed by a cmpxchg while there are waiters. A waiter that
+ * takes the lock with a plain store must not read the count before its
+ * store is visible, or it could miss such a change.
+ */
+#ifdef CONFIG_QUEUE_SPINLOCK_LOCKREF
+#define lockref_mb()	smp_mb()
+#else
+#define lockref_mb()	do { } while (0)
+#endif
+
 /*
  * By using the whole 2nd least significant byte for the pending bit, we
  * can allow better optimization of the lock acquisition for the pending
@@ -154,6 +255,7 @@ clear_pending_set_locked(struct qspinlock *lock, u32 val)
 	struct __qspinlock *l = (void *)lock;
 
 	ACCESS_ONCE(l->locked_pending) = _Q_LOCKED_VAL;
+	lockref_mb();
 }
 
 /*
@@ -165,12 +267,18 @@ clear_pending_set_locked(struct qspinlock *lock, u32 val)
  * xchg(lock, tail)
  *
  * p,*,* -> n,*,* ; prev = xchg(lock, node)
+ *
+ * Architectures without a halfword xchg provide queue_spin_xchg_tail().
  */
 static __always_inline u32 xchg_tail(struct qspinlock *lock, u32 tail)
 {
+#ifdef queue_spin_xchg_tail
+	return queue_spin_xchg_tail(lock, tail);
+#else
 	struct __qspinlock *l = (void *)lock;
 
 	return (u32)xchg(&l->tail, tail >> _Q_TAIL_OFFSET) << _Q_TAIL_OFFSET;
+#endif
 }
 
 #else /* _Q_PENDING_BITS == 8 */
@@ -235,10 +343,11 @@ static __always_inline void set_locked(struct qspinlock *lock)
 	struct __qspinlock *l = (void *)lock;
 
 	ACCESS_ONCE(l->locked) = _Q_LOCKED_VAL;
+	lockref_mb();
 }
 
 #ifdef CONFIG_PARAVIRT_SPINLOCKS
-#include <asm/pvqspinlock.h>
+#include "qspinlock_paravirt.h"
 #endif
 
 /*
@@ -253,6 +362,7 @@ static inline bool nonpv_link_and_wait_node(u32 old, struct mcs_spinlock *node)
 static inline int  nonpv_wait_head(struct qspinlock *lock,
 				struct mcs_spinlock *node)
 		   { return smp_load_acquire(&lock->val.counter); }
+static inline void nonpv_lock_acquired(struct qspinlock *lock)	{ }
 static inline bool return_true(void)	{ return true;  }
 static inline bool return_false(void)	{ return false; }
 
@@ -260,14 +370,167 @@ static inline bool return_false(void)	{ return false; }
 #define pv_wait_check		nonpv_wait_check
 #define pv_link_and_wait_node	nonpv_link_and_wait_node
 #define pv_wait_head		nonpv_wait_head
+#define pv_lock_acquired	nonpv_lock_acquired
 #define pv_enabled		return_false
 
+#ifdef CONFIG_QUEUE_SPINLOCK_NUMA
+#include "qspinlock_numa.h"
+#else
+static inline void numa_init_node(struct mcs_spinlock *node, u32 tail) { }
+static inline u32  numa_tail_val(struct mcs_spinlock *node)
+		   { return _Q_LOCKED_VAL; }
+static inline void numa_splice_tail(struct mcs_spinlock *node) { }
+static inline struct mcs_spinlock *
+numa_find_successor(struct mcs_spinlock *node, struct mcs_spinlock *next)
+		   { return next; }
+#endif
+
+#ifdef virt_queue_spin_steal
+#include "qspinlock_steal.h"
+#else
+static inline bool virt_steal_lock(struct qspinlock *lock)	{ return false; }
+static inline bool virt_steal_head(struct qspinlock *lock, u32 *pval)
+		   { return false; }
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_OWNER
+#include "qspinlock_owner.h"
+#else
+static inline void qowner_set(struct qspinlock *lock) { }
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_STAT
+#include "qspinlock_stat.h"
+#else
+#define qstat_start()			0
+#define qstat_end(lock, path, start)	((void)(start))
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_LOCKSTAT
+#include "qspinlock_lockstat.h"
+#else
+#define qlockstat_start()		0
+#define qlockstat_end(lock, start)	((void)(start))
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_LONGSPIN
+#include "qspinlock_longspin.h"
+#else
+#define qlongspin_start()		0
+#define qlongspin_head(lock, pos)	do { } while (0)
+#define qlongspin_end(lock, start)	((void)(start))
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_TIMEOUT
+#include "qspinlock_timeout.h"
+#else
+/*
+ * The queue nodes are used in the LIFO order of the nested contexts, so
+ * the count of the contexts in the slowpath is the index of the next
+ * free node.
+ */
+static __always_inline int qnode_get(void)
+{
+	return this_cpu_ptr(&MCS_NODE(0))->count++;
+}
+
+static __always_inline void qnode_put(int idx)
+{
+	this_cpu_dec(MCS_NODE(0).count);
+}
+
+static __always_inline struct mcs_spinlock *
+queue_pass_head(struct qspinlock *lock, struct mcs_spinlock *next)
+{
+	arch_mcs_spin_unlock_contended(&next->locked);
+	return next;
+}
+#endif
+
+#ifdef CONFIG_QUEUE_SPINLOCK_IRQ_WAIT
+#include "qspinlock_irq.h"
+#else
+static inline void qirq_wait_node(struct qspinlock *lock,
+				  struct mcs_spinlock *node, int idx,
+				  unsigned long flags)	{ }
+static inline bool qirq_wait_nested(struct qspinlock *lock)
+		   { return false; }
+#endif
+
+/*
+ * The pending bit only helps when there is a single waiter; with more,
+ * it is one more cacheline transfer before the waiters queue up anyway.
+ * The locks defined with DEFINE_CONTENDED_SPINLOCK(), or all the locks
+ * with "qspinlock_pending=off", get a slowpath without the pending code
+ * whose waiters queue right away.
+ */
+extern char __start_contended_spinlocks[], __stop_contended_spinlocks[];
+
+static bool qspinlock_pending __read_mostly = true;
+
+static int __init qspinlock_pending_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+	if (!strcmp(str, "off"))
+		qspinlock_pending = false;
+	else if (!strcmp(str, "on"))
+		qspinlock_pending = true;
+	else
+		return -EINVAL;
+	return 0;
+}
+early_param("qspinlock_pending", qspinlock_pending_setup);
+
+static __always_inline bool queue_spin_pending(struct qspinlock *lock)
+{
+	return qspinlock_pending &&
+	       ((char *)lock <  __start_contended_spinlocks ||
+		(char *)lock >= __stop_contended_spinlocks);
+}
+
+/*
+ * The other locks skip the pending code while they are found with a
+ * queue most of the time. Each CPU keeps a saturating score for a small
+ * hash of the locks it has been waiting for: it goes up whenever the CPU
+ * queues behind another waiter and down whenever it gets the lock via
+ * the trylock or the pending bit, or queues on an empty queue. The locks
+ * scoring QPEND_SKIP or more are taken by the pure queue slowpath. The
+ * scores are only touched in the slowpath, on the CPU's own cacheline.
+ */
+#define QPEND_HASH_BITS		6
+#define QPEND_SCORE_MAX		15
+#define QPEND_SKIP		8
+
+static DEFINE_PER_CPU(u8, qpend_score[1 << QPEND_HASH_BITS]);
+
+static __always_inline bool qpend_queue_likely(struct qspinlock *lock)
+{
+	return this_cpu_read(qpend_score[hash_ptr(lock, QPEND_HASH_BITS)]) >=
+	       QPEND_SKIP;
+}
+
+static __always_inline void qpend_update(struct qspinlock *lock, bool queued)
+{
+	u8 *score = this_cpu_ptr(&qpend_score[hash_ptr(lock, QPEND_HASH_BITS)]);
+
+	if (queued) {
+		if (*score < QPEND_SCORE_MAX)
+			(*score)++;
+	} else if (*score) {
+		(*score)--;
+	}
+}
+
 #endif	/* _GEN_PV_LOCK_SLOWPATH */
 
 /**
- * queue_spin_lock_slowpath - acquire the queue spinlock
+ * __queue_spin_lock_slowpath - acquire the queue spinlock
  * @lock: Pointer to queue spinlock structure
  * @val: Current value of the queue spinlock 32-bit word
+ * @pending: Try the pending bit before queuing
+ * @irq_wait: Wait in the queue with interrupts enabled
+ * @flags: The interrupt state to wait with if @irq_wait
  *
  * (queue tail, pending bit, lock value)
  *
@@ -285,19 +548,36 @@ static inline bool return_false(void)	{ return false; }
  * contended             :    (*,x,y) +--> (*,0,0) ---> (*,0,1) -'  :
  *   queue               :         ^--'                             :
  */
-void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val)
+static __always_inline void
+__queue_spin_lock_slowpath(struct qspinlock *lock, u32 val, bool pending,
+			   bool irq_wait, unsigned long flags)
 {
 	struct mcs_spinlock *prev, *next, *node;
 	u32 new, old, tail;
+	u64 start;
 	int idx;
 
 	BUILD_BUG_ON(CONFIG_NR_CPUS >= (1U << _Q_TAIL_CPU_BITS));
+	BUILD_BUG_ON(MAX_QNODES > (1U << _Q_TAIL_IDX_BITS));
 
+	start = qstat_start();
+	trace_qspinlock_slowpath(lock, val);
 	if (pv_enabled())
 		goto queue;
 
-	if (virt_queue_spin_lock(lock))
+	if (virt_queue_spin_lock(lock)) {
+		trace_qspinlock_acquired(lock);
+		return;
+	}
+
+	if (virt_steal_lock(lock)) {
+		qstat_end(lock, QSTAT_TRYLOCK, start);
+		trace_qspinlock_acquired(lock);
 		return;
+	}
+
+	if (!pending)
+		goto queue;
 
 	/*
 	 * wait for in-progress pending->locked hand-overs
@@ -333,11 +613,17 @@ void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 		val = old;
 	}
 
+	qpend_update(lock, false);
+
 	/*
 	 * we won the trylock
 	 */
-	if (new == _Q_LOCKED_VAL)
+	if (new == _Q_LOCKED_VAL) {
+		qstat_end(lock, QSTAT_TRYLOCK, start);
+		trace_qspinlock_acquired(lock);
 		return;
+	}
+	trace_qspinlock_pending(lock);
 
 	/*
 	 * we're pending, wait for the owner to go away.
@@ -349,8 +635,7 @@ void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 * sequentiality; this is because not all clear_pending_set_locked()
 	 * implementations imply full barriers.
 	 */
-	while ((val = smp_load_acquire(&lock->val.counter)) & _Q_LOCKED_MASK)
-		cpu_relax();
+	val = queue_spin_wait_clear(lock, _Q_LOCKED_MASK);
 
 	/*
 	 * take ownership and clear the pending bit.
@@ -358,6 +643,8 @@ void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 * *,1,0 -> *,0,1
 	 */
 	clear_pending_set_locked(lock, val);
+	qstat_end(lock, QSTAT_PENDING, start);
+	trace_qspinlock_acquired(lock);
 	return;
 
 	/*
@@ -365,22 +652,49 @@ void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 * queuing.
 	 */
 queue:
-	node = this_cpu_ptr(&mcs_nodes[0]);
-	idx = node->count++;
+	/*
+	 * We have interrupted a waiter of this CPU queued on the same lock
+	 * with interrupts enabled, take the lock in its place.
+	 */
+	if (qirq_wait_nested(lock)) {
+		trace_qspinlock_acquired(lock);
+		qowner_set(lock);
+		return;
+	}
+
+	idx = qnode_get();
+
+	/*
+	 * All the queue nodes of this CPU are in use by the nested contexts
+	 * that we have interrupted. Fall back to spinning on the lock with
+	 * trylock without queuing. This is unfair, but is rare enough that
+	 * the extra latency doesn't matter and the queue stays intact.
+	 */
+	if (unlikely(idx >= MAX_QNODES)) {
+		while (!queue_spin_trylock(lock))
+			cpu_relax();
+		qstat_end(lock, QSTAT_NESTED, start);
+		goto release;
+	}
+
 	tail = encode_tail(smp_processor_id(), idx);
 
-	node += idx;
+	node = this_cpu_ptr(&MCS_NODE(idx));
 	node->locked = 0;
 	node->next = NULL;
+	node->pos = 0;
 	pv_init_node(node);
+	numa_init_node(node, tail);
 
 	/*
 	 * We touched a (possibly) cold cacheline in the per-cpu queue node;
 	 * attempt the trylock once more in the hope someone let go while we
 	 * weren't watching.
 	 */
-	if (queue_spin_trylock(lock))
+	if (queue_spin_trylock(lock)) {
+		qstat_end(lock, QSTAT_TRYLOCK, start);
 		goto release;
+	}
 
 	/*
 	 * We have already touched the queueing cacheline; don't bother with
@@ -389,16 +703,29 @@ queue:
 	 * p,*,* -> n,*,*
 	 */
 	old = xchg_tail(lock, tail);
+	if (!pv_enabled())
+		qpend_update(lock, old & _Q_TAIL_MASK);
+	prev = NULL;
+	if (old & _Q_TAIL_MASK) {
+		prev = decode_tail(old);
+		qnode_link_pos(node, prev);
+	}
+	trace_qspinlock_queued(lock, idx, prev ?
+			       (int)(old >> _Q_TAIL_CPU_OFFSET) - 1 : -1,
+			       node->pos);
 
 	/*
 	 * if there was a previous node; link it and wait until reaching the
 	 * head of the waitqueue.
 	 */
-	if (!pv_link_and_wait_node(old, node) && (old & _Q_TAIL_MASK)) {
-		prev = decode_tail(old);
+	if (!pv_link_and_wait_node(old, node) && prev) {
 		ACCESS_ONCE(prev->next) = node;
 
-		arch_mcs_spin_lock_contended(&node->locked);
+		if (irq_wait)
+			qirq_wait_node(lock, node, idx, flags);
+		else
+			arch_mcs_spin_lock_contended(&node->locked);
+		arch_mcs_prefetch_lock(lock);
 	}
 
 	/*
@@ -409,10 +736,22 @@ queue:
 	 *
 	 * *,x,y -> *,0,0
 	 */
+	qlongspin_head(lock, node->pos);
+	ACCESS_ONCE(node->pos) = 0;
+	trace_qspinlock_head(lock);
 	val = pv_wait_head(lock, node);
-	while (val & _Q_LOCKED_PENDING_MASK) {
-		cpu_relax();
-		val = smp_load_acquire(&lock->val.counter);
+	if (!pv_enabled() && virt_steal_head(lock, &val))
+		goto locked;
+
+	if (val & _Q_LOCKED_PENDING_MASK) {
+		/*
+		 * Get the cacheline of the successor, if there is one,
+		 * ready for the handoff while waiting.
+		 */
+		next = ACCESS_ONCE(node->next);
+		if (next)
+			arch_mcs_prefetch_node(next);
+		val = queue_spin_wait_clear(lock, _Q_LOCKED_PENDING_MASK);
 	}
 
 	/*
@@ -424,36 +763,182 @@ queue:
 	 * If the queue head is the only one in the queue (lock value == tail),
 	 * clear the tail code and grab the lock. Otherwise, we only need
 	 * to grab the lock.
+	 *
+	 * In the NUMA cohort mode, a non-empty secondary queue takes over
+	 * the tail code instead and its head is given the lock.
 	 */
 	for (;;) {
 		if (val != tail) {
 			set_locked(lock);
 			break;
 		}
-		old = atomic_cmpxchg(&lock->val, val, _Q_LOCKED_VAL);
-		if (old == val)
+		old = atomic_cmpxchg(&lock->val, val, numa_tail_val(node));
+		if (old == val) {
+			numa_splice_tail(node);
+			qstat_end(lock, QSTAT_UQUEUE, start);
 			goto release;	/* No contention */
+		}
+
+		val = old;
+	}
+	goto contended;
 
+locked:
+	/*
+	 * The lock has been acquired in the lock stealing mode, clear the
+	 * tail code if we are the only one in the queue.
+	 *
+	 * n,0,1 -> 0,0,1
+	 */
+	while (val == (tail | _Q_LOCKED_VAL)) {
+		old = atomic_cmpxchg(&lock->val, val, numa_tail_val(node));
+		if (old == val) {
+			numa_splice_tail(node);
+			qstat_end(lock, QSTAT_UQUEUE, start);
+			goto release;
+		}
 		val = old;
 	}
 
 	/*
 	 * contended path; wait for next, release.
 	 */
+contended:
 	while (!(next = ACCESS_ONCE(node->next)))
 		cpu_relax();
 
-	arch_mcs_spin_unlock_contended(&next->locked);
-	pv_wait_check(lock, node, next);
+	next = numa_find_successor(node, next);
+
+	next = queue_pass_head(lock, next);
+	if (next)
+		pv_wait_check(lock, node, next);
+	qstat_end(lock, QSTAT_CQUEUE, start);
 
 release:
+	trace_qspinlock_acquired(lock);
+	qowner_set(lock);
+
 	/*
 	 * release the node
 	 */
-	this_cpu_dec(mcs_nodes[0].count);
+	qnode_put(idx);
+}
+
+/*
+ * The arguments of __queue_spin_lock_slowpath() are constants in each of
+ * its calls, so that each one gets its own specialized copy.
+ */
+void queue_spin_lock_slowpath(struct qspinlock *lock, u32 val)
+{
+	u64 start = qlockstat_start();
+	u64 lstart = qlongspin_start();
+
+	if (pv_enabled() ||
+	    (queue_spin_pending(lock) && !qpend_queue_likely(lock)))
+		__queue_spin_lock_slowpath(lock, val, true, false, 0);
+	else
+		__queue_spin_lock_slowpath(lock, val, false, false, 0);
+	qlongspin_end(lock, lstart);
+	qlockstat_end(lock, start);
+	pv_lock_acquired(lock);
 }
 EXPORT_SYMBOL(queue_spin_lock_slowpath);
 
+#ifndef _GEN_PV_LOCK_SLOWPATH
+/**
+ * queue_spin_unlock_wait - wait until the current lock holder is gone
+ * @lock: Pointer to queue spinlock structure
+ *
+ * The locked byte can be passed from waiter to waiter without ever
+ * reading as clear, so under steady contention waiting for it to clear
+ * may never end. Wait for one handoff instead:
+ *
+ * A pending waiter only clears the pending bit once the locked byte has
+ * been released, so if the pending bit is set, its clearing is as good as
+ * the release. Otherwise take the pending bit ourselves, which keeps the
+ * queue head from taking the lock, and give it back once the holder has
+ * released the locked byte. Either way the wait is bounded by the hold
+ * time of the current holder.
+ *
+ * *,0,1 -> *,1,1 -> *,1,0 -> *,0,0
+ */
+void queue_spin_unlock_wait(struct qspinlock *lock)
+{
+	u32 old, val;
+
+	val = atomic_read(&lock->val);
+	if (!(val & _Q_LOCKED_MASK))
+		goto done;
+
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+	/*
+	 * A halted PV queue head is only kicked by the unlock, it would not
+	 * notice the pending bit going away again.
+	 */
+	if (static_key_false(&paravirt_spinlocks_enabled)) {
+		queue_spin_wait_clear(lock, _Q_LOCKED_MASK);
+		goto done;
+	}
+#endif
+
+	for (;;) {
+		if (val & _Q_PENDING_MASK) {
+			while ((val = atomic_read(&lock->val)) &
+			       _Q_LOCKED_MASK && val & _Q_PENDING_MASK)
+				cpu_relax();
+			goto done;
+		}
+
+		old = atomic_cmpxchg(&lock->val, val, val | _Q_PENDING_VAL);
+		if (old == val)
+			break;
+		val = old;
+		if (!(val & _Q_LOCKED_MASK))
+			goto done;
+	}
+
+	queue_spin_wait_clear(lock, _Q_LOCKED_MASK);
+	atomic_sub(_Q_PENDING_VAL, &lock->val);
+done:
+	/* Order the caller's accesses after the critical section */
+	smp_mb();
+}
+EXPORT_SYMBOL(queue_spin_unlock_wait);
+#endif
+
+#if !defined(_GEN_PV_LOCK_SLOWPATH) && defined(CONFIG_QUEUE_SPINLOCK_IRQ_WAIT)
+/**
+ * queue_spin_lock_flags_slowpath - acquire the queue spinlock
+ * @lock: Pointer to queue spinlock structure
+ * @val: Current value of the queue spinlock 32-bit word
+ * @flags: The interrupt state saved by spin_lock_irqsave()
+ *
+ * Called with interrupts disabled and @flags having them enabled. The PV
+ * waiters may halt, so they always wait with interrupts disabled.
+ */
+void queue_spin_lock_flags_slowpath(struct qspinlock *lock, u32 val,
+				    unsigned long flags)
+{
+	u64 start, lstart;
+
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+	if (static_key_false(&paravirt_spinlocks_enabled)) {
+		pv_queue_spin_lock_slowpath(lock, val);
+		return;
+	}
+#endif
+	start = qlockstat_start();
+	lstart = qlongspin_start();
+	if (queue_spin_pending(lock) && !qpend_queue_likely(lock))
+		__queue_spin_lock_slowpath(lock, val, true, true, flags);
+	else
+		__queue_spin_lock_slowpath(lock, val, false, true, flags);
+	qlongspin_end(lock, lstart);
+	qlockstat_end(lock, start);
+}
+EXPORT_SYMBOL(queue_spin_lock_flags_slowpath);
+#endif
+
 #if !defined(_GEN_PV_LOCK_SLOWPATH) && defined(CONFIG_PARAVIRT_SPINLOCKS)
 /*
  * Generate the PV version of the queue_spin_lock_slowpath function by
@@ -463,10 +948,12 @@ EXPORT_SYMBOL(queue_spin_lock_slowpath);
 #undef	pv_wait_check
 #undef	pv_link_and_wait_node
 #undef	pv_wait_head
+#undef	pv_lock_acquired
 
 #define _GEN_PV_LOCK_SLOWPATH
 #define pv_enabled			return_true
 #define queue_spin_lock_slowpath	pv_queue_spin_lock_slowpath
+#define __queue_spin_lock_slowpath	__pv_queue_spin_lock_slowpath
 
 #include "qspinlock.c"
 
@@ -0,0 +1,206 @@
+/*
+ * 64-bit queue spinlock
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The slowpath follows the one of the 32-bit queue spinlock in qspinlock.c
+ * without the PV, NUMA and lock stealing variations. See the comments over
+ * there for the details. As the locked and pending fields are always whole
+ * bytes and the tail is a whole 32-bit word, no cmpxchg loop is needed for
+ * the pending to locked handoff and the tail exchange.
+ */
+#include <linux/smp.h>
+#include <linux/bug.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/hardirq.h>
+#include <linux/qspinlock64.h>
+#include <asm/byteorder.h>
+
+#include "mcs_spinlock.h"
+
+#define MAX_NODES	(1 << _Q64_TAIL_IDX_BITS)
+
+/*
+ * Per-CPU queue node structures, separate from the ones of the 32-bit
+ * queue spinlock as the two lock types can be nested.
+ */
+static DEFINE_PER_CPU_ALIGNED(struct mcs_spinlock, mcs_nodes64[MAX_NODES]);
+
+struct __qspinlock64 {
+	union {
+		atomic64_t val;
+#ifdef __LITTLE_ENDIAN
+		u8	 locked;
+		struct {
+			u16	locked_pending;
+			u16	__unused;
+			u32	tail;
+		};
+#else
+		struct {
+			u32	tail;
+			u16	__unused;
+			u16	locked_pending;
+		};
+		struct {
+			u8	reserved[7];
+			u8	locked;
+		};
+#endif
+	};
+};
+
+#define _Q64_LOCKED_PENDING_MASK (_Q64_LOCKED_MASK | _Q64_PENDING_MASK)
+
+/*
+ * We must be able to distinguish between no-tail and the tail at 0:0,
+ * therefore increment the cpu number by one.
+ */
+static inline u32 encode_tail64(int cpu, int idx)
+{
+	return ((cpu + 1) << _Q64_TAIL_IDX_BITS) | idx;
+}
+
+static inline struct mcs_spinlock *decode_tail64(u32 tail)
+{
+	int cpu = (tail >> _Q64_TAIL_IDX_BITS) - 1;
+	int idx = tail & ((1 << _Q64_TAIL_IDX_BITS) - 1);
+
+	return per_cpu_ptr(&mcs_nodes64[idx], cpu);
+}
+
+/**
+ * queue_spin_lock64_slowpath - acquire the 64-bit queue spinlock
+ * @lock: Pointer to the 64-bit queue spinlock structure
+ * @val : Current value of the lock word
+ */
+void queue_spin_lock64_slowpath(struct qspinlock64 *lock, u64 val)
+{
+	struct __qspinlock64 *l = (void *)lock;
+	struct mcs_spinlock *prev, *next, *node;
+	u64 new, old;
+	u32 tail;
+	int idx;
+
+	/*
+	 * wait for in-progress pending->locked hand-overs
+	 */
+	if (val == _Q64_PENDING_VAL) {
+		while ((val = atomic64_read(&lock->val)) == _Q64_PENDING_VAL)
+			cpu_relax();
+	}
+
+	/*
+	 * trylock || pending
+	 */
+	for (;;) {
+		if (val & ~_Q64_LOCKED_MASK)
+			goto queue;
+
+		new = _Q64_LOCKED_VAL;
+		if (val == new)
+			new |= _Q64_PENDING_VAL;
+
+		old = atomic64_cmpxchg(&lock->val, val, new);
+		if (old == val)
+			break;
+
+		val = old;
+	}
+
+	if (new == _Q64_LOCKED_VAL)
+		return;
+
+	/*
+	 * we're pending, wait for the owner to go away and take ownership
+	 * with a plain halfword store.
+	 */
+	while (smp_load_acquire(&l->locked))
+		cpu_relax();
+
+	ACCESS_ONCE(l->locked_pending) = _Q64_LOCKED_VAL;
+	return;
+
+queue:
+	node = this_cpu_ptr(&mcs_nodes64[0]);
+	idx = node->count++;
+
+	/*
+	 * Out of queue nodes in deeply nested contexts, spin without queuing.
+	 */
+	if (unlikely(idx >= MAX_NODES)) {
+		while (!queue_spin_trylock64(lock))
+			cpu_relax();
+		goto release;
+	}
+
+	tail = encode_tail64(smp_processor_id(), idx);
+
+	node += idx;
+	node->locked = 0;
+	node->next = NULL;
+
+	if (queue_spin_trylock64(lock))
+		goto release;
+
+	/*
+	 * p,*,* -> n,*,*
+	 *
+	 * The tail is a whole word; no need to preserve the other fields.
+	 */
+	old = xchg(&l->tail, tail);
+
+	if (old) {
+		prev = decode_tail64(old);
+		ACCESS_ONCE(prev->next) = node;
+
+		arch_mcs_spin_lock_contended(&node->locked);
+	}
+
+	/*
+	 * we're at the head of the waitqueue, wait for the owner & pending to
+	 * go away.
+	 */
+	while ((val = smp_load_acquire(&lock->val.counter)) &
+		_Q64_LOCKED_PENDING_MASK)
+		cpu_relax();
+
+	/*
+	 * claim the lock; clear the tail as well if we are the last one.
+	 */
+	for (;;) {
+		if (val != ((u64)tail << _Q64_TAIL_OFFSET)) {
+			ACCESS_ONCE(l->locked) = _Q64_LOCKED_VAL;
+			break;
+		}
+		old = atomic64_cmpxchg(&lock->val, val, _Q64_LOCKED_VAL);
+		if (old == val)
+			goto release;	/* No contention */
+
+		val = old;
+	}
+
+	/*
+	 * contended path; wait for next, release.
+	 */
+	while (!(next = ACCESS_ONCE(node->next)))
+		cpu_relax();
+
+	arch_mcs_spin_unlock_contended(&next->locked);
+
+release:
+	/*
+	 * release the node
+	 */
+	this_cpu_dec(mcs_nodes64[0].count);
+}
+EXPORT_SYMBOL(queue_spin_lock64_slowpath);
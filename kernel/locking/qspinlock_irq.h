@@ -0,0 +1,96 @@
+#ifndef __LINUX_QSPINLOCK_IRQ_H
+#define __LINUX_QSPINLOCK_IRQ_H
+
+#include <linux/irqflags.h>
+
+/*
+ *	Queue Spinlock Waiting with Interrupts Enabled
+ *
+ * spin_lock_irqsave() waiters whose saved flags have interrupts enabled
+ * enable them again while they wait in the queue behind another waiter.
+ * They are disabled again as soon as the waiter sees it has become the
+ * queue head, before it touches the lock word, so the lock is still only
+ * ever taken and held with interrupts disabled.
+ *
+ * An interrupt taken while waiting queues on the next nesting node of
+ * the CPU like any other nested context, except when it goes for the
+ * same lock: it would then queue behind the node it has interrupted and
+ * never get the lock. Instead, the nested context waits for the
+ * interrupted node to become the queue head and takes the lock in its
+ * place, leaving the queue untouched. The interrupted waiter finds
+ * itself at the head when the nested context is done and takes the lock
+ * as usual.
+ *
+ * The locks waited for with interrupts enabled are recorded per node so
+ * that the nested contexts can find them.
+ */
+
+struct qirq_wait {
+	int			nr;
+	struct qspinlock	*lock[MAX_QNODES];
+};
+
+static DEFINE_PER_CPU(struct qirq_wait, qirq_wait);
+
+/*
+ * Wait with interrupts enabled until @node becomes the queue head.
+ */
+static noinline void
+qirq_wait_node(struct qspinlock *lock, struct mcs_spinlock *node, int idx,
+	       unsigned long flags)
+{
+	this_cpu_write(qirq_wait.lock[idx], lock);
+	this_cpu_inc(qirq_wait.nr);
+	local_irq_restore(flags);
+
+	while (!smp_load_acquire(&node->locked))
+		cpu_relax();
+
+	local_irq_disable();
+	this_cpu_dec(qirq_wait.nr);
+	this_cpu_write(qirq_wait.lock[idx], NULL);
+}
+
+/*
+ * Take @lock on behalf of a waiter of this CPU interrupted in
+ * qirq_wait_node(), if there is one. The tail code can't be ours, so
+ * only the locked byte is set, with a cmpxchg as the lock may be stolen
+ * in the virt hybrid mode.
+ *
+ * *,0,0 -> *,0,1
+ */
+static noinline bool __qirq_wait_nested(struct qspinlock *lock)
+{
+	struct mcs_spinlock *node;
+	u32 old, val;
+	int idx;
+
+	for (idx = 0; idx < MAX_QNODES; idx++) {
+		if (this_cpu_read(qirq_wait.lock[idx]) == lock)
+			break;
+	}
+	if (idx == MAX_QNODES)
+		return false;
+
+	node = this_cpu_ptr(&MCS_NODE(idx));
+	while (!smp_load_acquire(&node->locked))
+		cpu_relax();
+
+	val = queue_spin_wait_clear(lock, _Q_LOCKED_PENDING_MASK);
+	for (;;) {
+		old = atomic_cmpxchg(&lock->val, val, val | _Q_LOCKED_VAL);
+		if (old == val)
+			break;
+		val = queue_spin_wait_clear(lock, _Q_LOCKED_PENDING_MASK);
+	}
+	return true;
+}
+
+static __always_inline bool qirq_wait_nested(struct qspinlock *lock)
+{
+	if (likely(!this_cpu_read(qirq_wait.nr)))
+		return false;
+	return __qirq_wait_nested(lock);
+}
+
+#endif /* __LINUX_QSPINLOCK_IRQ_H */
@@ -0,0 +1,522 @@
+#ifndef __LINUX_QSPINLOCK_LOCKSTAT_H
+#define __LINUX_QSPINLOCK_LOCKSTAT_H
+
+/*
+ *	Sampled Queue Spinlock Lock Statistics
+ *
+ * A lockdep-free subset of CONFIG_LOCK_STAT for the queue spinlocks. One
+ * out of every kernel.lock_stat slowpath entries of a CPU is sampled: its
+ * wait time, the time the lock is then held for and the caller are
+ * accounted into a per-cpu bucket hashed on the lock address and the
+ * caller. A sampled lock is recorded in a per-cpu slot, which the release
+ * of that lock on the same CPU picks up for the hold time. The releases
+ * only check the slot while the sampling is on, through a static key.
+ *
+ * The buckets are only written by their CPU with interrupts disabled, a
+ * sample that finds its bucket used by another lock and caller is
+ * dropped. A lock released on another CPU, or by a context nested inside
+ * a sampled one, loses its hold time.
+ *
+ * The statistics are shown in /proc/lock_stat in the lock_stat format,
+ * with the lock symbol or address as the class name and the caller as
+ * its only contention point. The bounce and sleep counts are not kept.
+ * Writing 0 to it clears the statistics.
+ *
+ * The debugfs lock_sharing file lists the sampled locks that share their
+ * cacheline, with another sampled lock or with the fields before them,
+ * as candidates for spinlock_padded_t.
+ */
+#include <linux/debugfs.h>
+#include <linux/ftrace.h>
+#include <linux/irqflags.h>
+#include <linux/jump_label.h>
+#include <linux/kallsyms.h>
+#include <linux/math64.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/sysctl.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#define QLOCKSTAT_BITS		8
+#define QLOCKSTAT_BUCKETS	(1 << QLOCKSTAT_BITS)
+
+struct qlockstat_time {
+	unsigned long	nr;
+	u64		min;
+	u64		max;
+	u64		total;
+};
+
+struct qlockstat_bucket {
+	struct qspinlock	*lock;
+	unsigned long		caller;
+	struct qlockstat_time	wait;
+	struct qlockstat_time	hold;
+};
+
+struct qlockstat_cpu {
+	struct qlockstat_bucket	bucket[QLOCKSTAT_BUCKETS];
+	unsigned int		sample;
+	unsigned long		dropped;
+	struct qspinlock	*held;		/* The sampled lock held */
+	struct qlockstat_bucket	*held_bucket;
+	u64			held_start;
+};
+
+static DEFINE_PER_CPU(struct qlockstat_cpu, qlockstat_cpu);
+static int qlockstat_period;
+static DEFINE_MUTEX(qlockstat_mutex);
+
+struct static_key queue_lockstat_key = STATIC_KEY_INIT_FALSE;
+EXPORT_SYMBOL(queue_lockstat_key);
+
+static void qlockstat_time(struct qlockstat_time *lt, u64 delta)
+{
+	if (!lt->nr || delta < lt->min)
+		lt->min = delta;
+	if (delta > lt->max)
+		lt->max = delta;
+	lt->total += delta;
+	lt->nr++;
+}
+
+/**
+ * qlockstat_start - start timing a sampled slowpath lock acquisition
+ * Return: the start time, or 0 if the acquisition isn't sampled
+ */
+static __always_inline u64 qlockstat_start(void)
+{
+	int period;
+
+	if (!static_key_false(&queue_lockstat_key))
+		return 0;
+
+	period = ACCESS_ONCE(qlockstat_period);
+	if (period <= 0 ||
+	    (this_cpu_inc_return(qlockstat_cpu.sample) % period))
+		return 0;
+	return sched_clock();
+}
+
+static noinline void
+__qlockstat_end(struct qspinlock *lock, unsigned long caller, u64 start)
+{
+	struct qlockstat_cpu *qs;
+	struct qlockstat_bucket *b;
+	unsigned long flags;
+	u64 now = sched_clock();
+
+	local_irq_save(flags);
+	qs = this_cpu_ptr(&qlockstat_cpu);
+	b  = &qs->bucket[hash_long((unsigned long)lock ^ caller,
+				   QLOCKSTAT_BITS)];
+	if (!b->lock) {
+		b->lock   = lock;
+		b->caller = caller;
+	} else if (b->lock != lock || b->caller != caller) {
+		qs->dropped++;
+		goto out;
+	}
+	qlockstat_time(&b->wait, now - start);
+	qs->held	= lock;
+	qs->held_bucket	= b;
+	qs->held_start	= sched_clock();
+out:
+	local_irq_restore(flags);
+}
+
+/**
+ * qlockstat_end - account for a sampled slowpath lock acquisition
+ * @lock : Pointer to queue spinlock structure
+ * @start: The start time returned by qlockstat_start()
+ */
+static __always_inline void qlockstat_end(struct qspinlock *lock, u64 start)
+{
+	if (start)
+		__qlockstat_end(lock, CALLER_ADDR1 ? CALLER_ADDR1
+						   : CALLER_ADDR0, start);
+}
+
+/**
+ * __queue_lockstat_release - account for the hold time of a sampled lock
+ * @lock: Pointer to queue spinlock structure being released
+ */
+void __queue_lockstat_release(struct qspinlock *lock)
+{
+	struct qlockstat_cpu *qs;
+	unsigned long flags;
+
+	if (likely(this_cpu_read(qlockstat_cpu.held) != lock))
+		return;
+
+	local_irq_save(flags);
+	qs = this_cpu_ptr(&qlockstat_cpu);
+	if (qs->held == lock) {
+		qlockstat_time(&qs->held_bucket->hold,
+			       sched_clock() - qs->held_start);
+		qs->held = NULL;
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(__queue_lockstat_release);
+
+/*
+ * The sample period, 0 turns the sampling off
+ */
+static int qlockstat_sysctl(struct ctl_table *table, int write,
+			    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct ctl_table t = *table;
+	int period, ret;
+
+	mutex_lock(&qlockstat_mutex);
+	period = qlockstat_period;
+	t.data = &period;
+	ret = proc_dointvec_minmax(&t, write, buffer, lenp, ppos);
+	if (ret || !write || period == qlockstat_period)
+		goto out;
+
+	/* qlockstat_start() copes with a zero period with the key on */
+	if (!qlockstat_period)
+		static_key_slow_inc(&queue_lockstat_key);
+	else if (!period)
+		static_key_slow_dec(&queue_lockstat_key);
+	ACCESS_ONCE(qlockstat_period) = period;
+out:
+	mutex_unlock(&qlockstat_mutex);
+	return ret;
+}
+
+static int qlockstat_zero;
+
+static struct ctl_table qlockstat_table[] = {
+	{
+		.procname	= "lock_stat",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= qlockstat_sysctl,
+		.extra1		= &qlockstat_zero,
+	},
+	{ }
+};
+
+struct qlockstat_seq {
+	int			nr;
+	struct qlockstat_bucket	stats[];
+};
+
+static int qlockstat_key_cmp(const void *l, const void *r)
+{
+	const struct qlockstat_bucket *bl = l, *br = r;
+
+	if (bl->lock != br->lock)
+		return bl->lock < br->lock ? -1 : 1;
+	if (bl->caller != br->caller)
+		return bl->caller < br->caller ? -1 : 1;
+	return 0;
+}
+
+static int qlockstat_contention_cmp(const void *l, const void *r)
+{
+	const struct qlockstat_bucket *bl = l, *br = r;
+
+	if (bl->wait.nr != br->wait.nr)
+		return bl->wait.nr > br->wait.nr ? -1 : 1;
+	return 0;
+}
+
+static void qlockstat_time_merge(struct qlockstat_time *dst,
+				 struct qlockstat_time *src)
+{
+	if (!src->nr)
+		return;
+	if (!dst->nr || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->total += src->total;
+	dst->nr	   += src->nr;
+}
+
+/*
+ * Gather the used buckets of all the CPUs, merge those of the same lock
+ * and caller, and sort them by the number of sampled contentions.
+ */
+static void qlockstat_gather(struct qlockstat_seq *data)
+{
+	struct qlockstat_bucket *s = data->stats;
+	int cpu, i, n = 0;
+
+	for_each_possible_cpu(cpu) {
+		struct qlockstat_cpu *qs = per_cpu_ptr(&qlockstat_cpu, cpu);
+
+		for (i = 0; i < QLOCKSTAT_BUCKETS; i++) {
+			if (ACCESS_ONCE(qs->bucket[i].lock))
+				s[n++] = qs->bucket[i];
+		}
+	}
+
+	sort(s, n, sizeof(*s), qlockstat_key_cmp, NULL);
+	for (i = 1, data->nr = n ? 1 : 0; i < n; i++) {
+		struct qlockstat_bucket *last = &s[data->nr - 1];
+
+		if (!qlockstat_key_cmp(last, &s[i])) {
+			qlockstat_time_merge(&last->wait, &s[i].wait);
+			qlockstat_time_merge(&last->hold, &s[i].hold);
+		} else {
+			s[data->nr++] = s[i];
+		}
+	}
+	sort(s, data->nr, sizeof(*s), qlockstat_contention_cmp, NULL);
+}
+
+#define QLOCKSTAT_LINE	(40 + 1 + 13 * (14 + 1))
+
+static void qlockstat_seq_line(struct seq_file *m, char c, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		seq_putc(m, c);
+	seq_putc(m, '\n');
+}
+
+static void qlockstat_seq_time(struct seq_file *m, u64 time)
+{
+	char num[15];
+	u32 rem;
+
+	time = div_u64_rem(time + 5, 1000, &rem);
+	snprintf(num, sizeof(num), "%llu.%02u", time, rem / 10);
+	seq_printf(m, " %14s", num);
+}
+
+static void qlockstat_seq_lock_time(struct seq_file *m,
+				    struct qlockstat_time *lt)
+{
+	seq_printf(m, "%14lu", lt->nr);
+	qlockstat_seq_time(m, lt->min);
+	qlockstat_seq_time(m, lt->max);
+	qlockstat_seq_time(m, lt->total);
+	qlockstat_seq_time(m, lt->nr ? div_u64(lt->total, lt->nr) : 0);
+}
+
+static int qlockstat_show(struct seq_file *m, void *v)
+{
+	struct qlockstat_seq *data = m->private;
+	unsigned long dropped = 0;
+	char name[KSYM_SYMBOL_LEN], ip[32];
+	int cpu, i;
+
+	for_each_possible_cpu(cpu)
+		dropped += per_cpu(qlockstat_cpu, cpu).dropped;
+
+	seq_puts(m, "lock_stat version 0.4\n");
+	seq_printf(m, "sample period %d, dropped samples %lu\n",
+		   qlockstat_period, dropped);
+	qlockstat_seq_line(m, '-', QLOCKSTAT_LINE);
+	seq_printf(m, "%40s %14s %14s %14s %14s %14s %14s %14s %14s %14s %14s "
+		      "%14s %14s %14s\n",
+		   "class name", "con-bounces", "contentions",
+		   "waittime-min", "waittime-max", "waittime-total",
+		   "waittime-avg", "acq-bounces", "acquisitions",
+		   "holdtime-min", "holdtime-max", "holdtime-total",
+		   "holdtime-avg", "sleeps");
+	qlockstat_seq_line(m, '-', QLOCKSTAT_LINE);
+	seq_putc(m, '\n');
+
+	for (i = 0; i < data->nr; i++) {
+		struct qlockstat_bucket *b = &data->stats[i];
+
+		sprint_symbol_no_offset(name, (unsigned long)b->lock);
+		name[38] = '\0';
+		seq_printf(m, "%40s:%14lu ", name, 0UL);
+		qlockstat_seq_lock_time(m, &b->wait);
+		seq_printf(m, " %14lu ", 0UL);
+		qlockstat_seq_lock_time(m, &b->hold);
+		seq_printf(m, " %14lu\n", 0UL);
+
+		qlockstat_seq_line(m, '-', 40);
+		snprintf(ip, sizeof(ip), "[<%p>]", (void *)b->caller);
+		seq_printf(m, "%40s %14lu %29s %pS\n", name, b->wait.nr, ip,
+			   (void *)b->caller);
+		seq_putc(m, '\n');
+		qlockstat_seq_line(m, '.', QLOCKSTAT_LINE);
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+static int qlockstat_open(struct inode *inode, struct file *file)
+{
+	struct qlockstat_seq *data;
+	int ret;
+
+	data = vmalloc(sizeof(*data) + sizeof(struct qlockstat_bucket) *
+		       num_possible_cpus() * QLOCKSTAT_BUCKETS);
+	if (!data)
+		return -ENOMEM;
+
+	qlockstat_gather(data);
+	ret = single_open(file, qlockstat_show, data);
+	if (ret)
+		vfree(data);
+	return ret;
+}
+
+static ssize_t qlockstat_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	int cpu;
+	char c;
+
+	if (count) {
+		if (get_user(c, buf))
+			return -EFAULT;
+
+		if (c != '0')
+			return count;
+
+		for_each_possible_cpu(cpu) {
+			struct qlockstat_cpu *qs = per_cpu_ptr(&qlockstat_cpu,
+								cpu);
+
+			qs->held = NULL;
+			memset(qs->bucket, 0, sizeof(qs->bucket));
+			qs->dropped = 0;
+		}
+	}
+	return count;
+}
+
+static int qlockstat_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq = file->private_data;
+
+	vfree(seq->private);
+	return single_release(inode, file);
+}
+
+static const struct file_operations qlockstat_fops = {
+	.open		= qlockstat_open,
+	.write		= qlockstat_write,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= qlockstat_release,
+};
+
+/*
+ * Merge the gathered statistics of each lock over its callers, in the
+ * lock address order so that the locks of a cacheline are adjacent.
+ */
+static void qlockstat_gather_locks(struct qlockstat_seq *data)
+{
+	struct qlockstat_bucket *s = data->stats;
+	int i, n;
+
+	qlockstat_gather(data);
+	sort(s, data->nr, sizeof(*s), qlockstat_key_cmp, NULL);
+	for (i = 1, n = data->nr ? 1 : 0; i < data->nr; i++) {
+		if (s[n - 1].lock == s[i].lock) {
+			qlockstat_time_merge(&s[n - 1].wait, &s[i].wait);
+			qlockstat_time_merge(&s[n - 1].hold, &s[i].hold);
+		} else {
+			s[n++] = s[i];
+		}
+	}
+	data->nr = n;
+}
+
+#define QLOCKSTAT_LINE_MASK	(~((unsigned long)SMP_CACHE_BYTES - 1))
+
+static inline unsigned long qlockstat_line(struct qlockstat_bucket *b)
+{
+	return (unsigned long)b->lock & QLOCKSTAT_LINE_MASK;
+}
+
+/*
+ * A cacheline is listed if it has more than one sampled lock, or a lock
+ * that isn't at its start. A lock at the start of its line may still
+ * share it with the fields after it, that can't be told from its address.
+ */
+static int qlockstat_sharing_show(struct seq_file *m, void *v)
+{
+	struct qlockstat_seq *data = m->private;
+	char name[KSYM_SYMBOL_LEN];
+	int i, j, k;
+
+	seq_printf(m, "sample period %d, cacheline size %d\n",
+		   qlockstat_period, SMP_CACHE_BYTES);
+	seq_printf(m, "%40s %18s %6s %14s %14s %14s\n", "lock", "address",
+		   "offset", "contentions", "waittime-avg", "holdtime-avg");
+
+	for (i = 0; i < data->nr; i = j) {
+		struct qlockstat_bucket *b = &data->stats[i];
+		bool shared = (unsigned long)b->lock & ~QLOCKSTAT_LINE_MASK;
+
+		for (j = i + 1; j < data->nr &&
+		     qlockstat_line(&data->stats[j]) == qlockstat_line(b); j++)
+			shared = true;
+		if (!shared)
+			continue;
+
+		seq_putc(m, '\n');
+		for (k = i; k < j; k++) {
+			b = &data->stats[k];
+			sprint_symbol_no_offset(name, (unsigned long)b->lock);
+			name[38] = '\0';
+			seq_printf(m, "%40s %18p %6lu %14lu", name, b->lock,
+				   (unsigned long)b->lock & ~QLOCKSTAT_LINE_MASK,
+				   b->wait.nr);
+			qlockstat_seq_time(m, b->wait.nr ?
+				div_u64(b->wait.total, b->wait.nr) : 0);
+			qlockstat_seq_time(m, b->hold.nr ?
+				div_u64(b->hold.total, b->hold.nr) : 0);
+			seq_putc(m, '\n');
+		}
+	}
+	return 0;
+}
+
+static int qlockstat_sharing_open(struct inode *inode, struct file *file)
+{
+	struct qlockstat_seq *data;
+	int ret;
+
+	data = vmalloc(sizeof(*data) + sizeof(struct qlockstat_bucket) *
+		       num_possible_cpus() * QLOCKSTAT_BUCKETS);
+	if (!data)
+		return -ENOMEM;
+
+	qlockstat_gather_locks(data);
+	ret = single_open(file, qlockstat_sharing_show, data);
+	if (ret)
+		vfree(data);
+	return ret;
+}
+
+static const struct file_operations qlockstat_sharing_fops = {
+	.open		= qlockstat_sharing_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= qlockstat_release,
+};
+
+static int __init qlockstat_init(void)
+{
+	if (!register_sysctl("kernel", qlockstat_table))
+		return -ENOMEM;
+	if (!proc_create("lock_stat", S_IRUSR | S_IWUSR, NULL,
+			 &qlockstat_fops))
+		return -ENOMEM;
+	/* The report is optional, the statistics work without debugfs */
+	debugfs_create_file("lock_sharing", 0400, NULL, NULL,
+			    &qlockstat_sharing_fops);
+	return 0;
+}
+fs_initcall(qlockstat_init);
+
+#endif /* __LINUX_QSPINLOCK_LOCKSTAT_H */
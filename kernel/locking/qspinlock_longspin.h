@@ -0,0 +1,242 @@
+#ifndef __LINUX_QSPINLOCK_LONGSPIN_H
+#define __LINUX_QSPINLOCK_LONGSPIN_H
+
+/*
+ *	Queue Spinlock Long Spin Records
+ *
+ * Catch the slowpath waits that are far too short for the lockup
+ * detectors but long enough to hurt the latencies. With a threshold set,
+ * the slowpath reads the cycle counter on entry and exit, and any wait of
+ * at least the threshold is recorded with the lock, the stack of the
+ * waiter, its position in the queue and the last recorded holder of the
+ * lock. Nothing but the static key is checked with no threshold set.
+ *
+ * The threshold is in get_cycles() units, TSC cycles on x86. The queue
+ * position is the number of waiters ahead when queuing, 0 for a pending or
+ * trylock acquisition. The holder is read from the owner table when
+ * reaching the queue head, it is -1 without CONFIG_QUEUE_SPINLOCK_OWNER.
+ * Both are saved in per-cpu variables, a nested context taking the
+ * slowpath while we are waiting may overwrite them, they are only hints.
+ *
+ * The records are kept in per-cpu rings of the last QLONGSPIN_RING long
+ * spins. A writer reserves its slot with a per-cpu increment, so that the
+ * nested contexts get their own, and publishes it with a sequence number.
+ * The reader skips the slots being written.
+ *
+ * The debugfs files are in the qspinlock_longspin directory:
+ *  threshold - the threshold in cycles, 0 (the default) turns it off
+ *  records   - the records of all the CPUs, writing to it clears them
+ */
+#include <linux/debugfs.h>
+#include <linux/jump_label.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/stacktrace.h>
+#include <linux/timex.h>
+#include <linux/uaccess.h>
+
+#define QLONGSPIN_RING		32	/* Must be a power of 2 */
+#define QLONGSPIN_STACK		12
+
+struct qlongspin_rec {
+	unsigned long		seq;	/* 0 while being written */
+	u64			time;	/* local_clock() of the record */
+	u64			cycles;
+	struct qspinlock	*lock;
+	int			depth;
+	int			holder;
+	unsigned int		nr_entries;
+	unsigned long		stack[QLONGSPIN_STACK];
+};
+
+struct qlongspin_cpu {
+	unsigned long		head;
+	int			depth;
+	int			holder;
+	struct qlongspin_rec	ring[QLONGSPIN_RING];
+};
+
+static DEFINE_PER_CPU(struct qlongspin_cpu, qlongspin_cpu);
+static cycles_t qlongspin_threshold __read_mostly;
+static DEFINE_MUTEX(qlongspin_mutex);
+
+static struct static_key qlongspin_key = STATIC_KEY_INIT_FALSE;
+
+/**
+ * qlongspin_start - start timing a slowpath lock acquisition
+ * Return: the cycle count, or 0 if the long spins aren't recorded
+ */
+static __always_inline u64 qlongspin_start(void)
+{
+	if (!static_key_false(&qlongspin_key))
+		return 0;
+
+	this_cpu_write(qlongspin_cpu.depth, 0);
+	this_cpu_write(qlongspin_cpu.holder, -1);
+	return get_cycles() ? : 1;
+}
+
+/**
+ * qlongspin_head - note the queue position and the holder at the head
+ * @lock: Pointer to queue spinlock structure
+ * @pos : The number of waiters that were queued ahead
+ */
+static __always_inline void qlongspin_head(struct qspinlock *lock, int pos)
+{
+	if (!static_key_false(&qlongspin_key))
+		return;
+
+	this_cpu_write(qlongspin_cpu.depth, pos);
+	this_cpu_write(qlongspin_cpu.holder, queue_spin_owner(lock));
+}
+
+static noinline void __qlongspin_record(struct qspinlock *lock, u64 cycles)
+{
+	struct qlongspin_cpu *lc = this_cpu_ptr(&qlongspin_cpu);
+	struct qlongspin_rec *r;
+	struct stack_trace trace;
+	unsigned long seq;
+
+	seq = this_cpu_inc_return(qlongspin_cpu.head);
+	r = &lc->ring[seq & (QLONGSPIN_RING - 1)];
+	ACCESS_ONCE(r->seq) = 0;
+	smp_wmb();
+
+	r->time	  = local_clock();
+	r->cycles = cycles;
+	r->lock	  = lock;
+	r->depth  = lc->depth;
+	r->holder = lc->holder;
+
+	trace.nr_entries  = 0;
+	trace.max_entries = QLONGSPIN_STACK;
+	trace.entries	  = r->stack;
+	trace.skip	  = 2;	/* This function and the slowpath wrapper */
+	save_stack_trace(&trace);
+	r->nr_entries = trace.nr_entries;
+
+	smp_wmb();
+	ACCESS_ONCE(r->seq) = seq;
+}
+
+/**
+ * qlongspin_end - record a slowpath lock acquisition if it took too long
+ * @lock : Pointer to queue spinlock structure
+ * @start: The cycle count returned by qlongspin_start()
+ */
+static __always_inline void qlongspin_end(struct qspinlock *lock, u64 start)
+{
+	u64 cycles;
+
+	if (!start)
+		return;
+	cycles = get_cycles() - start;
+	if (cycles >= ACCESS_ONCE(qlongspin_threshold))
+		__qlongspin_record(lock, cycles);
+}
+
+static int qlongspin_threshold_get(void *data, u64 *val)
+{
+	*val = qlongspin_threshold;
+	return 0;
+}
+
+static int qlongspin_threshold_set(void *data, u64 val)
+{
+	mutex_lock(&qlongspin_mutex);
+	if (val && !qlongspin_threshold)
+		static_key_slow_inc(&qlongspin_key);
+	else if (!val && qlongspin_threshold)
+		static_key_slow_dec(&qlongspin_key);
+	ACCESS_ONCE(qlongspin_threshold) = val;
+	mutex_unlock(&qlongspin_mutex);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(qlongspin_threshold_fops, qlongspin_threshold_get,
+			qlongspin_threshold_set, "%llu\n");
+
+static int qlongspin_show(struct seq_file *m, void *v)
+{
+	struct qlongspin_rec rec;
+	unsigned long seq;
+	int cpu, i, j;
+
+	seq_printf(m, "threshold %llu cycles\n",
+		   (unsigned long long)qlongspin_threshold);
+
+	for_each_possible_cpu(cpu) {
+		struct qlongspin_cpu *lc = per_cpu_ptr(&qlongspin_cpu, cpu);
+
+		for (i = 0; i < QLONGSPIN_RING; i++) {
+			struct qlongspin_rec *r = &lc->ring[i];
+
+			seq = ACCESS_ONCE(r->seq);
+			smp_rmb();
+			rec = *r;
+			smp_rmb();
+			if (!seq || ACCESS_ONCE(r->seq) != seq)
+				continue;
+
+			seq_printf(m, "\ncpu %d seq %lu time %llu cycles %llu "
+				   "depth %d holder %d lock %pS\n",
+				   cpu, seq, rec.time, rec.cycles, rec.depth,
+				   rec.holder, rec.lock);
+			for (j = 0; j < min_t(unsigned int, rec.nr_entries,
+					      QLONGSPIN_STACK); j++) {
+				if (rec.stack[j] == ULONG_MAX)
+					break;
+				seq_printf(m, "  %pS\n", (void *)rec.stack[j]);
+			}
+		}
+	}
+	return 0;
+}
+
+static int qlongspin_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, qlongspin_show, NULL);
+}
+
+static ssize_t qlongspin_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct qlongspin_cpu *lc = per_cpu_ptr(&qlongspin_cpu, cpu);
+		int i;
+
+		for (i = 0; i < QLONGSPIN_RING; i++)
+			ACCESS_ONCE(lc->ring[i].seq) = 0;
+	}
+	return count;
+}
+
+static const struct file_operations qlongspin_fops = {
+	.open		= qlongspin_open,
+	.write		= qlongspin_write,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init qlongspin_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("qspinlock_longspin", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("threshold", 0600, dir, NULL,
+				 &qlongspin_threshold_fops) ||
+	    !debugfs_create_file("records", 0600, dir, NULL,
+				 &qlongspin_fops)) {
+		debugfs_remove_recursive(dir);
+		return -ENOMEM;
+	}
+	return 0;
+}
+fs_initcall(qlongspin_debugfs_init);
+
+#endif /* __LINUX_QSPINLOCK_LONGSPIN_H */
@@ -0,0 +1,388 @@
+#ifndef __LINUX_QSPINLOCK_NUMA_H
+#define __LINUX_QSPINLOCK_NUMA_H
+
+#include <linux/cpu.h>
+#include <linux/init.h>
+#include <linux/string.h>
+#include <linux/topology.h>
+
+/*
+ *	Queue Spinlock NUMA Cohort Support
+ *
+ * In the plain MCS queue, the lock is handed over to the next waiter in
+ * strict FIFO order irrespective of where that waiter is running. On large
+ * multi-socket systems, this means that the lock cacheline as well as the
+ * data protected by the lock will travel across the interconnect on almost
+ * every lock handoff.
+ *
+ * In the NUMA cohort mode, the lock holder will look for a waiter in the
+ * MCS queue that runs close to itself and pass the lock to it. The remote
+ * waiters skipped over are moved to a secondary queue which is passed
+ * along from one lock holder to the next. The secondary queue is spliced
+ * back in front of the main queue when either there is no more local
+ * waiter left or a bounded number of intra-node handoffs have been done
+ * so as to prevent starvation of the remote waiters.
+ *
+ * Closeness is hierarchical: a waiter on an SMT sibling of the holder
+ * shares its L1, one in the same last level cache domain its LLC, and one
+ * on the same NUMA node at least its memory. The holder picks the first
+ * waiter of the closest level whose batch of consecutive handoffs within
+ * that level isn't used up yet. A handoff at one level counts against the
+ * batches of that level and the wider ones and starts new batches for the
+ * narrower ones, so that the lock moves on to the next core or LLC of the
+ * node every so often. The core and LLC batch limits are derived from the
+ * number of CPUs sharing them.
+ *
+ * The additional fields needed are kept in the per-CPU qnode_states array,
+ * in the cacheline after the MCS nodes, just like what the PV code does.
+ * To fit into the size of an mcs_spinlock, the secondary queue is tracked
+ * by the encoded tail codes of its first and last nodes rather than by
+ * pointers, and the location of a waiter is looked up from the CPU number
+ * in its tail code.
+ *
+ * +-------------+-------------+-------------+-------------+
+ * | MCS Node  0 | MCS Node  1 | MCS Node  2 | MCS Node  3 |
+ * +-------------+-------------+-------------+-------------+
+ * | NUMA Node 0 | NUMA Node 1 | NUMA Node 2 | NUMA Node 3 |
+ * +-------------+-------------+-------------+-------------+
+ *
+ * With the tiled node layout, the fields directly follow the MCS node in
+ * its own cacheline instead.
+ *
+ * The cohort mode is on by default. It can be turned off at boot time
+ * with the "numa_spinlock=off" kernel parameter, or limited to the NUMA
+ * node level with "numa_spinlock=node".
+ */
+
+/*
+ * The levels of closeness, QNUMA_NONE meaning a different NUMA node.
+ */
+enum {
+	QNUMA_CORE,
+	QNUMA_LLC,
+	QNUMA_NODE,
+	QNUMA_LEVELS,
+	QNUMA_NONE = QNUMA_LEVELS,
+};
+
+/*
+ * Maximum number of consecutive intra-node lock handoffs before the
+ * secondary queue is given the lock.
+ */
+#define QNUMA_BATCH_MAX		64
+
+struct numa_qnode {
+	u8		     batch[QNUMA_LEVELS]; /* # of handoffs per level */
+	u32		     tail;	/* Encoded tail of this node	*/
+	u32		     sec_head;	/* Secondary queue head tail code */
+	u32		     sec_tail;	/* Secondary queue tail tail code */
+};
+
+static __always_inline struct numa_qnode *numa_qnode(struct mcs_spinlock *node)
+{
+	BUILD_BUG_ON(sizeof(struct numa_qnode) > sizeof(struct qnode_state));
+
+	return qnode_state(node);
+}
+
+/*
+ * The core and LLC of a CPU are identified by the first CPU sharing them.
+ * Until the topology is known, or with "numa_spinlock=node", every CPU is
+ * its own core and LLC.
+ */
+struct qnuma_cpu {
+	u32		     id[QNUMA_LEVELS];
+};
+
+static DEFINE_PER_CPU_READ_MOSTLY(struct qnuma_cpu, qnuma_cpu);
+
+static u8 qnuma_batch_max[QNUMA_LEVELS] __read_mostly = {
+	[QNUMA_CORE] = 0,
+	[QNUMA_LLC]  = 0,
+	[QNUMA_NODE] = QNUMA_BATCH_MAX,
+};
+
+static bool qnuma_enabled __read_mostly = true;
+static bool qnuma_node_only __read_mostly;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+	if (!strcmp(str, "off"))
+		qnuma_enabled = false;
+	else if (!strcmp(str, "on"))
+		qnuma_enabled = true;
+	else if (!strcmp(str, "node"))
+		qnuma_node_only = true;
+	else
+		return -EINVAL;
+	return 0;
+}
+early_param("numa_spinlock", numa_spinlock_setup);
+
+static inline const struct cpumask *qnuma_llc_mask(int cpu)
+{
+#ifdef CONFIG_SCHED_MC
+	return cpu_coregroup_mask(cpu);
+#else
+	return topology_thread_cpumask(cpu);
+#endif
+}
+
+/*
+ * Give the lock 2 handoffs per sharing CPU within a core or an LLC before
+ * moving on. A level shared by no other CPU gets no batch and is skipped.
+ */
+static u8 qnuma_level_batch(const struct cpumask *mask)
+{
+	unsigned int weight = cpumask_weight(mask);
+
+	if (weight <= 1)
+		return 0;
+	return min(2 * weight, (unsigned int)QNUMA_BATCH_MAX);
+}
+
+/*
+ * Refresh the core and LLC ids of all the online CPUs as well as the batch
+ * limits after the topology has changed. A lock holder may see a mix of
+ * old and new ids meanwhile, which only affects the choice of waiter.
+ */
+static void qnuma_update_topology(void)
+{
+	int cpu;
+
+	if (!qnuma_enabled || qnuma_node_only)
+		return;
+
+	for_each_online_cpu(cpu) {
+		struct qnuma_cpu *qc = &per_cpu(qnuma_cpu, cpu);
+
+		qc->id[QNUMA_CORE] = cpumask_first(topology_thread_cpumask(cpu));
+		qc->id[QNUMA_LLC]  = cpumask_first(qnuma_llc_mask(cpu));
+		qc->id[QNUMA_NODE] = cpu_to_node(cpu);
+	}
+
+	cpu = smp_processor_id();
+	qnuma_batch_max[QNUMA_CORE] =
+		qnuma_level_batch(topology_thread_cpumask(cpu));
+	qnuma_batch_max[QNUMA_LLC] = qnuma_level_batch(qnuma_llc_mask(cpu));
+}
+
+static int qnuma_cpu_notify(struct notifier_block *self,
+			    unsigned long action, void *hcpu)
+{
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+	case CPU_DEAD:
+		preempt_disable();
+		qnuma_update_topology();
+		preempt_enable();
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init qnuma_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct qnuma_cpu *qc = &per_cpu(qnuma_cpu, cpu);
+
+		qc->id[QNUMA_CORE] = cpu;
+		qc->id[QNUMA_LLC]  = cpu;
+		qc->id[QNUMA_NODE] = cpu_to_node(cpu);
+	}
+
+	cpu_notifier_register_begin();
+	preempt_disable();
+	qnuma_update_topology();
+	preempt_enable();
+	__hotcpu_notifier(qnuma_cpu_notify, 0);
+	cpu_notifier_register_done();
+	return 0;
+}
+early_initcall(qnuma_init);
+
+/*
+ * The closest level shared by the CPUs of the two tail codes.
+ */
+static inline int qnuma_level(u32 tail1, u32 tail2)
+{
+	struct qnuma_cpu *qc1, *qc2;
+	int level;
+
+	qc1 = &per_cpu(qnuma_cpu, (tail1 >> _Q_TAIL_CPU_OFFSET) - 1);
+	qc2 = &per_cpu(qnuma_cpu, (tail2 >> _Q_TAIL_CPU_OFFSET) - 1);
+	for (level = 0; level < QNUMA_LEVELS; level++) {
+		if (qc1->id[level] == qc2->id[level])
+			break;
+	}
+	return level;
+}
+
+/**
+ * numa_init_node - initialize fields in struct numa_qnode
+ * @node: pointer to struct mcs_spinlock
+ * @tail: the encoded tail of the node
+ */
+static inline void numa_init_node(struct mcs_spinlock *node, u32 tail)
+{
+	struct numa_qnode *qn = numa_qnode(node);
+
+	qn->tail      = tail;
+	memset(qn->batch, 0, sizeof(qn->batch));
+	qn->sec_head  = 0;
+	qn->sec_tail  = 0;
+}
+
+/**
+ * numa_tail_val - the lock value to use when clearing our own tail code
+ * @node: pointer to the mcs_spinlock structure of the lock holder
+ * Return: the new lock value with the tail of the secondary queue, if any
+ *
+ * If the main queue is going to be empty, the secondary queue becomes the
+ * main queue and so its tail has to be put into the lock word.
+ */
+static inline u32 numa_tail_val(struct mcs_spinlock *node)
+{
+	struct numa_qnode *qn = numa_qnode(node);
+
+	return qn->sec_tail | _Q_LOCKED_VAL;
+}
+
+/**
+ * numa_splice_tail - hand the lock to the secondary queue head
+ * @node: pointer to the mcs_spinlock structure of the lock holder
+ *
+ * Called after the tail code of the lock has been successfully changed
+ * to that of the secondary queue by numa_tail_val().
+ */
+static inline void numa_splice_tail(struct mcs_spinlock *node)
+{
+	struct numa_qnode *qn = numa_qnode(node);
+	struct mcs_spinlock *head;
+
+	if (!qn->sec_head)
+		return;
+
+	head = decode_tail(qn->sec_head);
+	arch_mcs_spin_unlock_contended(&head->locked);
+}
+
+/**
+ * numa_find_successor - find the next lock holder in the queue
+ * @node: pointer to the mcs_spinlock structure of the lock holder
+ * @next: pointer to the mcs_spinlock structure of the next queue node
+ * Return: pointer to the mcs_spinlock structure of the new lock holder
+ *
+ * Only the links that have been set up already are followed so that the
+ * queue tail, which may be concurrently linked to by a new waiter, is
+ * never changed.
+ */
+static inline struct mcs_spinlock *
+numa_find_successor(struct mcs_spinlock *node, struct mcs_spinlock *next)
+{
+	struct numa_qnode *qn = numa_qnode(node);
+	struct mcs_spinlock *first[QNUMA_LEVELS] = { NULL };
+	struct mcs_spinlock *prev[QNUMA_LEVELS] = { NULL };
+	struct mcs_spinlock *last = NULL, *cur = next;
+	struct numa_qnode *succ;
+	u32 sec_head = qn->sec_head;
+	u32 sec_tail = qn->sec_tail;
+	u8 batch[QNUMA_LEVELS];
+	int level, want, i;
+
+	if (!qnuma_enabled)
+		return next;
+
+	if (qn->batch[QNUMA_NODE] + 1 >= QNUMA_BATCH_MAX) {
+		if (sec_head)
+			goto flush;
+		level = QNUMA_NONE;
+		goto fifo;
+	}
+
+	/*
+	 * The closest level we may still hand the lock over within.
+	 */
+	for (want = 0; want < QNUMA_NODE; want++) {
+		if (qn->batch[want] < qnuma_batch_max[want])
+			break;
+	}
+
+	/*
+	 * Find the first waiter of each level down to @want, stopping as
+	 * soon as there can't be a better one. A waiter sharing a core
+	 * also shares the LLC and the node and so on.
+	 */
+	do {
+		level = qnuma_level(qn->tail, numa_qnode(cur)->tail);
+		for (i = max(level, want); i < QNUMA_LEVELS && !first[i]; i++) {
+			first[i] = cur;
+			prev[i]  = last;
+		}
+		if (first[want])
+			break;
+		last = cur;
+		cur  = ACCESS_ONCE(cur->next);
+	} while (cur);
+
+	for (level = want; level < QNUMA_LEVELS; level++) {
+		if (first[level])
+			break;
+	}
+
+fifo:
+	if (level == QNUMA_NONE) {
+		/*
+		 * No local waiter, the lock goes to the remote node. The
+		 * secondary queue goes along with it.
+		 */
+		cur = next;
+		memset(batch, 0, sizeof(batch));
+		goto out;
+	}
+
+	cur = first[level];
+	if (prev[level]) {
+		/*
+		 * Move the waiters skipped [next, prev] to the end of the
+		 * secondary queue.
+		 */
+		if (sec_tail)
+			ACCESS_ONCE(decode_tail(sec_tail)->next) = next;
+		else
+			sec_head = numa_qnode(next)->tail;
+		sec_tail = numa_qnode(prev[level])->tail;
+		ACCESS_ONCE(prev[level]->next) = NULL;
+	}
+
+	for (i = 0; i < QNUMA_LEVELS; i++)
+		batch[i] = (i < level) ? 0 : qn->batch[i] + 1;
+	goto out;
+
+flush:
+	/*
+	 * Batch limit reached; put the secondary queue back in front of the
+	 * main queue and give it the lock.
+	 */
+	ACCESS_ONCE(decode_tail(sec_tail)->next) = next;
+	cur = decode_tail(sec_head);
+	sec_head = sec_tail = 0;
+	memset(batch, 0, sizeof(batch));
+
+out:
+	/*
+	 * The store-release in arch_mcs_spin_unlock_contended() will make
+	 * those visible to the successor.
+	 */
+	succ = numa_qnode(cur);
+	succ->sec_head = sec_head;
+	succ->sec_tail = sec_tail;
+	memcpy(succ->batch, batch, sizeof(batch));
+	return cur;
+}
+
+#endif /* __LINUX_QSPINLOCK_NUMA_H */
@@ -0,0 +1,94 @@
+#ifndef __LINUX_QSPINLOCK_OWNER_H
+#define __LINUX_QSPINLOCK_OWNER_H
+
+#include <linux/bootmem.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+
+/*
+ *	Queue Spinlock Owner Recording
+ *
+ * The 32-bit lock word has no room for the lock holder. So the CPU number
+ * of the holder is recorded in a hashed side table when the lock is
+ * acquired in the slowpath, i.e. only when there is contention. The lock
+ * fastpath is not touched at all.
+ *
+ * As the fastpath doesn't record the holder, the unlock path doesn't clear
+ * it and different locks may share the same slot, the recorded owner is
+ * only a hint. It can be read with queue_spin_owner() for diagnostics or
+ * by the PV code to find a preempted lock holder.
+ *
+ * The table is sized at 8 entries per possible CPU. It is allocated by
+ * the PV init code early, or in an early initcall otherwise. Nothing is
+ * recorded before that.
+ */
+struct qowner_entry {
+	struct qspinlock *lock;
+	int		 cpu;
+};
+
+static struct qowner_entry *qowner_table;
+static unsigned int qowner_bits __read_mostly;
+
+/**
+ * queue_spin_init_owner - allocate the lock owner table
+ */
+void __init queue_spin_init_owner(void)
+{
+	unsigned long size = roundup_pow_of_two(8 * nr_cpu_ids);
+
+	if (qowner_table)
+		return;
+	qowner_table = alloc_large_system_hash("qspinlock owner",
+					       sizeof(struct qowner_entry),
+					       size, 0,
+					       slab_is_available() ? 0 : HASH_EARLY,
+					       &qowner_bits, NULL, size, size);
+}
+
+static int __init qowner_init(void)
+{
+	queue_spin_init_owner();
+	return 0;
+}
+early_initcall(qowner_init);
+
+/**
+ * qowner_set - record the current CPU as the lock holder
+ * @lock: Pointer to queue spinlock structure
+ *
+ * The CPU number is written before the lock so that a reader that sees
+ * the lock will also see the matching CPU number in most cases.
+ */
+static inline void qowner_set(struct qspinlock *lock)
+{
+	struct qowner_entry *oe;
+
+	if (!qowner_table)
+		return;
+	oe = &qowner_table[hash_ptr(lock, qowner_bits)];
+	ACCESS_ONCE(oe->cpu)  = smp_processor_id();
+	smp_wmb();
+	ACCESS_ONCE(oe->lock) = lock;
+}
+
+/**
+ * queue_spin_owner - get the last recorded holder of a locked spinlock
+ * @lock: Pointer to queue spinlock structure
+ * Return: the CPU number, or -1 if the lock is free or the owner unknown
+ */
+int queue_spin_owner(struct qspinlock *lock)
+{
+	struct qowner_entry *oe;
+
+	if (!qowner_table || !(atomic_read(&lock->val) & _Q_LOCKED_MASK))
+		return -1;
+	oe = &qowner_table[hash_ptr(lock, qowner_bits)];
+	if (ACCESS_ONCE(oe->lock) != lock)
+		return -1;
+	smp_rmb();
+	return ACCESS_ONCE(oe->cpu);
+}
+EXPORT_SYMBOL(queue_spin_owner);
+
+#endif /* __LINUX_QSPINLOCK_OWNER_H */
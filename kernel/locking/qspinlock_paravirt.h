@@ -0,0 +1,978 @@
+#ifndef __LINUX_QSPINLOCK_PARAVIRT_H
+#define __LINUX_QSPINLOCK_PARAVIRT_H
+
+/*
+ *	Queue Spinlock Para-Virtualization (PV) Support
+ *
+ * The PV support code for queue spinlock is roughly the same as that
+ * of the ticket spinlock. Each CPU waiting for the lock will spin until it
+ * reaches a threshold. When that happens, it will put itself to a halt state
+ * so that the hypervisor can reuse the CPU cycles in some other guests as
+ * well as returning other hold-up CPUs faster.
+ *
+ * Auxillary fields in the pv_qnode structure are used to hold information
+ * relevant to the PV support so that it won't impact on the behavior and
+ * performance of the bare metal code.
+ *
+ * There are 2 places where races can happen:
+ *  1) Halting of the queue head CPU (in pv_wait_head) and the CPU
+ *     kicking by the lock holder in the unlock path (in pv_kick_node).
+ *  2) Halting of the queue node CPU (in pv_link_and_wait_node) and the
+ *     the status check by the previous queue head (in pv_wait_check).
+ *
+ * See the comments on those functions to see how the races are being
+ * addressed.
+ *
+ * The lock holder finds the halted queue head through a lock to node hash
+ * table. An entry is added before the _Q_LOCKED_SLOWPATH flag is set and
+ * is removed by the unlocker that clears the flag. So there is at most one
+ * entry for each lock and the unlocker can always find it with a single
+ * bounded lookup.
+ *
+ * The code is architecture and hypervisor neutral. The hypervisor specific
+ * parts are reached through the pv_lock_ops hooks (see
+ * asm-generic/qspinlock_paravirt.h):
+ *  pv_lockwait()	   - halt the CPU until kicked
+ *  pv_kick_cpu()	   - wake up a halted CPU
+ *  pv_lockstat()	   - account the halt and wakeup events
+ *  pv_vcpu_is_preempted() - check if the vCPU of a CPU is running
+ *  pv_yield_to_cpu()	   - directed yield to a preempted vCPU
+ *  pv_wait_for_cpu()	   - publish the CPU being waited for and
+ *			     whether we are the queue head
+ *  pv_lock_held()	   - publish the number of contended locks held
+ * Only word sized atomic operations are used on the lock word and the
+ * queue node, so architectures without byte or halfword cmpxchg are fine.
+ */
+#include <linux/bootmem.h>
+#include <linux/hash.h>
+#include <linux/sched.h>
+
+/*
+ * Spin thresholds for queue spinlock
+ *
+ * QSPIN_THRESHOLD is the initial spin threshold of each CPU. It is then
+ * adapted within the [QSPIN_THRESHOLD_MIN, QSPIN_THRESHOLD_MAX] range
+ * according to the outcome of the halts (see pv_adapt_threshold()).
+ * MAYHALT_THRESHOLD is the number of iterations left before halting that
+ * the mayhalt flag is set and is independent of the spin threshold.
+ */
+#ifdef SPIN_THRESHOLD
+#define	QSPIN_THRESHOLD		SPIN_THRESHOLD
+#else
+#define	QSPIN_THRESHOLD		(1 << 15)
+#endif
+#define	QSPIN_THRESHOLD_MIN	(QSPIN_THRESHOLD >> 5)
+#define	QSPIN_THRESHOLD_MAX	(QSPIN_THRESHOLD << 3)
+#define MAYHALT_THRESHOLD	0x10
+
+/*
+ * The queue nodes behind the queue head wait for at least one more lock
+ * hold time and handoff, they halt after spinning for 1/4 of the spin
+ * threshold of the queue head. Each further queue position halves it
+ * again, up to QNODE_POS_SHIFT_MAX times.
+ */
+#define QNODE_SPIN_SHIFT	2
+#define QNODE_POS_SHIFT_MAX	3
+
+/*
+ * The spin loop relaxation of the queue nodes behind the queue head. The
+ * architecture may provide one that doesn't trap into the hypervisor as
+ * the nodes are going to halt anyway, see asm/qspinlock.h.
+ */
+#ifndef pv_queue_relax
+#define pv_queue_relax()	cpu_relax()
+#endif
+
+/*
+ * The vCPU preempted state of the previous queue node or the lock holder
+ * is checked once every PREEMPT_CHECK_MASK+1 iterations of spinning.
+ */
+#define PREEMPT_CHECK_MASK	0xff
+
+/*
+ * The bounds, in cpu_relax() iterations, of the exponential back-off
+ * between the polls of a waiter in NMI context, see pv_nmi_backoff().
+ */
+#define PV_NMI_BACKOFF_MIN	0x10
+#define PV_NMI_BACKOFF_MAX	0x1000
+
+/*
+ * CPU state flags
+ */
+#define PV_CPU_ACTIVE	1	/* This CPU is active		 */
+#define PV_CPU_KICKED   2	/* This CPU is being kicked	 */
+#define PV_CPU_HALTED	-1	/* This CPU is halted		 */
+
+/*
+ * PV state of a queue node
+ *
+ * The PV fields of the queue nodes are kept in the per-CPU qnode_states
+ * array, in the cacheline after the MCS nodes, and are found from the MCS
+ * node with pv_qnode(). Each state has the size of an mcs_spinlock, 16
+ * bytes for x64 and 12 bytes for i386.
+ *
+ * +------------+------------+------------+------------+
+ * | MCS Node 0 | MCS Node 1 | MCS Node 2 | MCS Node 3 |
+ * +------------+------------+------------+------------+
+ * | PV  Node 0 | PV  Node 1 | PV  Node 2 | PV  Node 3 |
+ * +------------+------------+------------+------------+
+ *
+ * With the tiled node layout, the PV fields directly follow the MCS node
+ * in its own cacheline instead.
+ *
+ * The CPU state is an int as it is changed with xchg() and cmpxchg(). To
+ * still fit into 12 bytes, the CPU numbers are 16-bit as long as the tail
+ * code limits NR_CPUS to less than 16K.
+ */
+#if _Q_PENDING_BITS == 8
+typedef s16 pv_cpu_t;
+#else
+typedef int pv_cpu_t;
+#endif
+
+struct pv_qnode {
+	int		     cpustate;	/* CPU status flag		*/
+	pv_cpu_t	     mycpu;	/* CPU number of this node	*/
+	pv_cpu_t	     prevcpu;	/* CPU number of previous node	*/
+	s8		     mayhalt;	/* May be halted soon		*/
+};
+
+static __always_inline struct pv_qnode *pv_qnode(struct mcs_spinlock *node)
+{
+	BUILD_BUG_ON(sizeof(struct pv_qnode) > sizeof(struct qnode_state));
+
+	return qnode_state(node);
+}
+
+/*
+ * Lock to queue head node hash table
+ *
+ * Only the queue head of a lock or the lock holder on behalf of the next
+ * queue head can add an entry. As a CPU can be the queue head of at most
+ * 4 locks (one per nesting context), the table is sized to be at least
+ * twice of the maximum number of entries so that the linear probing will
+ * always be short.
+ */
+struct pv_hash_entry {
+	struct qspinlock *lock;
+	struct pv_qnode  *node;
+};
+
+static struct pv_hash_entry *pv_lock_hash;
+static unsigned int pv_lock_hash_bits __read_mostly;
+
+/**
+ * pv_init_lock_hash - allocate the lock to node hash and lock owner tables
+ *
+ * It has to be called by the hypervisor specific PV spinlock init code
+ * before the PV spinlock slowpath is enabled.
+ */
+void __init pv_init_lock_hash(void)
+{
+	unsigned long size = roundup_pow_of_two(8 * nr_cpu_ids);
+
+	pv_lock_hash = alloc_large_system_hash("PV qspinlock",
+					       sizeof(struct pv_hash_entry),
+					       size, 0, HASH_EARLY,
+					       &pv_lock_hash_bits, NULL,
+					       size, size);
+	queue_spin_init_owner();
+}
+
+/**
+ * pv_lock_owner - the CPU that the queue head waits for
+ * @lock: pointer to the qspinlock structure
+ * @pn  : pointer to the pv_qnode structure of the queue head
+ * Return: the CPU number or -1 if unknown
+ *
+ * The recorded owner is used if available. Otherwise, the previous queue
+ * node, which should have acquired the lock before passing the queue head
+ * down, is used.
+ */
+static inline int pv_lock_owner(struct qspinlock *lock, struct pv_qnode *pn)
+{
+	int owner = queue_spin_owner(lock);
+
+	if (owner < 0)
+		owner = pn->prevcpu;
+	return (owner == pn->mycpu) ? -1 : owner;
+}
+
+/**
+ * pv_yield_to_owner - yield to the lock holder if preempted
+ * @lock: pointer to the qspinlock structure
+ * @pn  : pointer to the pv_qnode structure of the queue head
+ * Return: true if yielded, false otherwise
+ */
+static inline bool pv_yield_to_owner(struct qspinlock *lock,
+				     struct pv_qnode *pn)
+{
+	int owner = pv_lock_owner(lock, pn);
+
+	if ((owner < 0) || !pv_vcpu_is_preempted(owner))
+		return false;
+	return pv_yield_to_cpu(owner);
+}
+
+/**
+ * pv_hash - add the given lock and queue head node into the hash table
+ * @lock: pointer to the qspinlock structure
+ * @node: pointer to the pv_qnode structure of the queue head
+ * Return: pointer to the hash table entry used
+ */
+static struct pv_hash_entry *
+pv_hash(struct qspinlock *lock, struct pv_qnode *node)
+{
+	unsigned long mask = (1UL << pv_lock_hash_bits) - 1;
+	unsigned long idx  = hash_ptr(lock, pv_lock_hash_bits);
+	struct pv_hash_entry *he;
+
+	for (;; idx = (idx + 1) & mask) {
+		he = &pv_lock_hash[idx];
+		if (!ACCESS_ONCE(he->lock) && !cmpxchg(&he->lock, NULL, lock))
+			break;
+	}
+	/*
+	 * The node pointer will be made visible by the barrier implied in
+	 * the setting of the _Q_LOCKED_SLOWPATH flag afterward.
+	 */
+	he->node = node;
+	return he;
+}
+
+/**
+ * pv_unhash - remove the hash table entry of the given lock
+ * @lock: pointer to the qspinlock structure
+ * Return: pointer to the pv_qnode structure of the queue head
+ *
+ * It is only called when the _Q_LOCKED_SLOWPATH flag is set and so the
+ * hash entry must be there.
+ */
+static struct pv_qnode *pv_unhash(struct qspinlock *lock)
+{
+	unsigned long mask = (1UL << pv_lock_hash_bits) - 1;
+	unsigned long idx  = hash_ptr(lock, pv_lock_hash_bits);
+	unsigned long i;
+	struct pv_hash_entry *he;
+	struct pv_qnode *node;
+
+	for (i = 0; i <= mask; i++, idx = (idx + 1) & mask) {
+		he = &pv_lock_hash[idx];
+		if (ACCESS_ONCE(he->lock) != lock)
+			continue;
+		node = ACCESS_ONCE(he->node);
+		smp_store_release(&he->lock, NULL);
+		return node;
+	}
+	WARN_ON_ONCE(1);
+	return NULL;
+}
+
+/*
+ * Per-cpu adaptive spin threshold
+ */
+static DEFINE_PER_CPU(struct pv_spin_adapt, pv_spin_adapt);
+
+/**
+ * pv_get_spin_adapt - get a copy of the adaptive spin threshold data
+ * @cpu: the CPU number
+ * @sa : pointer to the pv_spin_adapt structure to be filled in
+ */
+void pv_get_spin_adapt(int cpu, struct pv_spin_adapt *sa)
+{
+	*sa = per_cpu(pv_spin_adapt, cpu);
+	if (!sa->threshold)
+		sa->threshold = QSPIN_THRESHOLD;
+}
+
+/**
+ * pv_spin_threshold - the current spin threshold of this CPU
+ */
+static inline unsigned int pv_spin_threshold(void)
+{
+	unsigned int threshold = this_cpu_read(pv_spin_adapt.threshold);
+
+	return threshold ? threshold : QSPIN_THRESHOLD;
+}
+
+/**
+ * pv_adapt_threshold - adapt the spin threshold after a halt
+ * @spin_ns: the time spent in spinning before the halt
+ * @halt_ns: the time from halting to wakeup
+ * @kicked : true if woken up by a kick
+ *
+ * The spin threshold is adjusted as follows:
+ *  1) A kick that comes shortly after halting means that the lock would
+ *     have been acquired by spinning a bit longer without paying for the
+ *     halt & wakeup. So the threshold is doubled.
+ *  2) A kick that comes much later than the spinning time means that the
+ *     lock holder had likely been preempted and spinning is just wasting
+ *     CPU cycles. So the threshold is halved.
+ *  3) A spurious wakeup means that the cost of the halt is paid without
+ *     any gain. So the threshold is increased by 1/8 to halt less often.
+ */
+static void pv_adapt_threshold(u64 spin_ns, u64 halt_ns, bool kicked)
+{
+	struct pv_spin_adapt *sa = this_cpu_ptr(&pv_spin_adapt);
+	unsigned int old = pv_spin_threshold();
+	unsigned int new = old;
+
+	if (!kicked)
+		new += old >> 3;
+	else if (halt_ns < (spin_ns >> 1))
+		new <<= 1;
+	else if (halt_ns > (spin_ns << 2))
+		new >>= 1;
+
+	new = clamp_t(unsigned int, new, QSPIN_THRESHOLD_MIN,
+		      QSPIN_THRESHOLD_MAX);
+	if (new > old)
+		sa->grow++;
+	else if (new < old)
+		sa->shrink++;
+	sa->threshold = new;
+
+	/*
+	 * Exponential moving average of the halt to wakeup latency
+	 */
+	sa->wake_ns += ((s64)halt_ns - (s64)sa->wake_ns) >> 3;
+}
+
+/**
+ * pv_halt - halt the current CPU & adapt the spin threshold afterward
+ * @lockbyte  : the lock byte to check before halting or NULL
+ * @pn        : pointer to the pv_qnode structure of the current CPU
+ * @spin_start: the time the spinning before the halt started
+ *
+ * Only the queue head, which passes the lock byte, adapts the threshold.
+ * The other nodes spin for a fraction of it and their wait time includes
+ * the ones of the nodes ahead, which would only make it shrink.
+ */
+static inline void pv_halt(u8 *lockbyte, struct pv_qnode *pn, u64 spin_start)
+{
+	u64 halt_start = sched_clock();
+	u64 halt_ns;
+	bool kicked;
+
+	trace_qspinlock_pv_halt(lockbyte != NULL);
+	pv_lockwait(lockbyte);
+	kicked = (ACCESS_ONCE(pn->cpustate) == PV_CPU_KICKED);
+	pv_lockstat(kicked ? PV_WAKE_KICKED : PV_WAKE_SPURIOUS);
+	halt_ns = sched_clock() - halt_start;
+	trace_qspinlock_pv_wake(kicked, halt_ns);
+	if (lockbyte)
+		pv_adapt_threshold(halt_start - spin_start, halt_ns, kicked);
+}
+
+/**
+ * pv_init_node - initialize fields in struct pv_qnode
+ * @node: pointer to struct mcs_spinlock
+ * @cpu : current CPU number
+ */
+static inline void pv_init_node(struct mcs_spinlock *node)
+{
+	struct pv_qnode *pn = pv_qnode(node);
+
+	pn->cpustate = PV_CPU_ACTIVE;
+	pn->mayhalt  = false;
+	pn->mycpu    = smp_processor_id();
+	pn->prevcpu  = -1;
+}
+
+/**
+ * pv_prev_preempted - check if the vCPU of the previous node is preempted
+ * @pn   : pointer to the pv_qnode structure of the current CPU
+ * @count: the remaining spin count
+ * Return: true if it is time to check and the previous vCPU is preempted
+ *
+ * The previous node is the lock holder when the current node is the queue
+ * head. For the other nodes, the lock can't be passed down before the
+ * previous vCPU runs again. In both cases, there is no point in spinning
+ * while the previous vCPU is preempted.
+ */
+static inline bool pv_prev_preempted(struct pv_qnode *pn, unsigned int count)
+{
+	if ((count & PREEMPT_CHECK_MASK) || (pn->prevcpu < 0))
+		return false;
+	return pv_vcpu_is_preempted(pn->prevcpu);
+}
+
+/*
+ * NMI waiters
+ *
+ * A waiter in NMI context, e.g. a perf NMI handler, can't halt: the
+ * backends return from pv_lockwait() right away in NMI context. Spinning
+ * for the whole threshold over and over would burn the host CPU while the
+ * vCPU it waits for may be preempted. So it never goes through the halt
+ * handshake. It backs off exponentially between polls instead, and yields
+ * to the vCPU it waits for when that vCPU is preempted. The yield is a
+ * single hypercall and needs no wakeup.
+ *
+ * Nothing is published with pv_wait_for_cpu() either, as that would
+ * overwrite the hint of a waiter in the interrupted context.
+ */
+
+/**
+ * pv_nmi_backoff - back off between two polls of a waiter in NMI context
+ * @delay: the current back-off in cpu_relax() iterations
+ * @cpu  : the CPU waited for or -1 if unknown
+ * Return: the next back-off
+ */
+static inline unsigned int pv_nmi_backoff(unsigned int delay, int cpu)
+{
+	unsigned int loop;
+
+	if ((cpu >= 0) && pv_vcpu_is_preempted(cpu) && pv_yield_to_cpu(cpu))
+		return delay;
+
+	for (loop = delay; loop; loop--)
+		cpu_relax();
+	return min_t(unsigned int, delay << 1, PV_NMI_BACKOFF_MAX);
+}
+
+/**
+ * pv_nmi_wait_node - wait in NMI context to become the queue head
+ * @node: pointer to the mcs_spinlock structure
+ * @pn  : pointer to the pv_qnode structure of the current CPU
+ */
+static inline void pv_nmi_wait_node(struct mcs_spinlock *node,
+				    struct pv_qnode *pn)
+{
+	unsigned int delay = PV_NMI_BACKOFF_MIN;
+
+	pv_lockstat(PV_NMI_WAIT);
+	while (!smp_load_acquire(&node->locked))
+		delay = pv_nmi_backoff(delay, pn->prevcpu);
+}
+
+/**
+ * pv_nmi_wait_head - wait in NMI context for the lock holder to go away
+ * @lock: pointer to the qspinlock structure
+ * @pn  : pointer to the pv_qnode structure of the queue head
+ * Return: the current lock value
+ */
+static inline int pv_nmi_wait_head(struct qspinlock *lock, struct pv_qnode *pn)
+{
+	unsigned int delay = PV_NMI_BACKOFF_MIN;
+	int val;
+
+	pv_lockstat(PV_NMI_WAIT);
+	while ((val = smp_load_acquire(&lock->val.counter)) &
+	       _Q_LOCKED_PENDING_MASK)
+		delay = pv_nmi_backoff(delay, pv_lock_owner(lock, pn));
+	return val;
+}
+
+/**
+ * pv_link_and_wait_node - perform para-virtualization checks for queue member
+ * @old  : the old lock value
+ * @node : pointer to the mcs_spinlock structure
+ * Return: true if PV spinlock is enabled, false otherwise.
+ */
+static inline bool pv_link_and_wait_node(u32 old, struct mcs_spinlock *node)
+{
+	struct pv_qnode *ppn, *pn = pv_qnode(node);
+	struct mcs_spinlock *prev;
+	unsigned int count;
+	u64 spin_start;
+
+	if (!(old & _Q_TAIL_MASK)) {
+		node->locked = true;	/* At queue head now */
+		goto ret;
+	}
+
+	prev = decode_tail(old);
+	ppn  = pv_qnode(prev);
+	pn->prevcpu = ppn->mycpu;
+	ACCESS_ONCE(prev->next) = node;
+
+	if (in_nmi()) {
+		pv_nmi_wait_node(node, pn);
+		goto ret;
+	}
+
+	/*
+	 * Let the hypervisor know whom we wait for, so that a pause loop
+	 * exit can boost the previous vCPU rather than a random one. It is
+	 * updated in pv_wait_head() and cleared when the lock is ours.
+	 */
+	pv_wait_for_cpu(pn->prevcpu, false);
+
+	for (;;) {
+		/*
+		 * Refresh our queue position from the previous node, which
+		 * may have moved up the queue since we last looked.
+		 */
+		node->pos = qnode_next_pos(prev);
+		count = pv_spin_threshold() >> (QNODE_SPIN_SHIFT +
+			min_t(int, node->pos - 1, QNODE_POS_SHIFT_MAX));
+		spin_start = sched_clock();
+
+		while (count--) {
+			if (smp_load_acquire(&node->locked))
+				goto ret;
+			if (count == MAYHALT_THRESHOLD) {
+				pn->mayhalt = true;
+				/*
+				 * Make sure that the mayhalt flag is visible
+				 * to others.
+				 */
+				smp_mb();
+			} else if ((count > MAYHALT_THRESHOLD) &&
+				    pv_prev_preempted(pn, count)) {
+				/*
+				 * Skip to the mayhalt stage so that the
+				 * halting handshake stays the same.
+				 */
+				count = MAYHALT_THRESHOLD + 1;
+			}
+			pv_queue_relax();
+		}
+		/*
+		 * Halt oneself after spinning for the threshold
+		 */
+		ACCESS_ONCE(pn->cpustate) = PV_CPU_HALTED;
+
+		/*
+		 * One way to avoid the racing between pv_wait_check()
+		 * and pv_link_and_wait_node() is to use memory barrier or
+		 * atomic instruction to synchronize between the two competing
+		 * threads. However, that will slow down the queue spinlock
+		 * slowpath. One way to eliminate this overhead for normal
+		 * cases is to use another flag (mayhalt) to indicate that
+		 * racing condition may happen. This flag is set when the
+		 * loop count is getting close to the halting threshold.
+		 *
+		 * When that happens, a 2 variables (cpustate & node->locked
+		 * handshake is used to make sure that pv_wait_check() won't
+		 * miss setting the _Q_LOCKED_SLOWPATH when the CPU is about
+		 * to be halted.
+		 *
+		 * pv_wait_check		pv_link_and_wait_node
+		 * -------------		---------------------
+		 * [1] node->locked = true	[3] cpustate = PV_CPU_HALTED
+		 *     smp_mb()			    smp_mb()
+		 * [2] if (cpustate		[4] if (node->locked)
+		 *        == PV_CPU_HALTED)
+		 *
+		 * Sequence:
+		 * *,1,*,4,* - halt is aborted as the node->locked flag is set,
+		 *	       _Q_LOCKED_SLOWPATH may or may not be set
+		 * 3,4,1,2 - the CPU is halt and _Q_LOCKED_SLOWPATH is set
+		 */
+		smp_mb();
+		if (!ACCESS_ONCE(node->locked)) {
+			/*
+			 * Halt the CPU only if it is not the queue head
+			 */
+			pv_halt(NULL, pn, spin_start);
+		}
+		ACCESS_ONCE(pn->cpustate) = PV_CPU_ACTIVE;
+		pn->mayhalt = false;
+
+		if (smp_load_acquire(&node->locked))
+			break;
+	}
+ret:
+	return true;
+}
+
+/**
+ * pv_set_slowpath - hash the queue head & set the _Q_LOCKED_SLOWPATH flag
+ * @lock: pointer to the qspinlock structure
+ * @pn  : pointer to the pv_qnode structure of the queue head
+ * Return: the previous value of the lock byte
+ *
+ * The hash entry is removed again if the flag isn't set by us, either
+ * because the lock is free or the flag had been set in pv_wait_check().
+ */
+static inline u8 pv_set_slowpath(struct qspinlock *lock, struct pv_qnode *pn)
+{
+	struct __qspinlock *l = (void *)lock;
+	struct pv_hash_entry *he;
+	u32 old, val;
+
+	if (ACCESS_ONCE(l->locked) == _Q_LOCKED_SLOWPATH)
+		return _Q_LOCKED_SLOWPATH;
+
+	/*
+	 * The lock byte is changed with a cmpxchg of the whole lock word
+	 * that retries on changes of the pending bit and the tail.
+	 */
+	he  = pv_hash(lock, pn);
+	val = atomic_read(&lock->val);
+	while ((val & _Q_LOCKED_MASK) == _Q_LOCKED_VAL) {
+		old = atomic_cmpxchg(&lock->val, val,
+				     (val & ~_Q_LOCKED_MASK) | _Q_LOCKED_SLOWPATH);
+		if (old == val)
+			return _Q_LOCKED_VAL;
+		val = old;
+	}
+	ACCESS_ONCE(he->lock) = NULL;
+	return val & _Q_LOCKED_MASK;
+}
+
+/**
+ * pv_wait_head - para-virtualization waiting loop for the queue head
+ * @lock : pointer to the qspinlock structure
+ * @node : pointer to the mcs_spinlock structure
+ * Return: the current lock value
+ *
+ * This function will halt itself if lock is still not available after
+ * spinning for the adaptive spin threshold.
+ */
+static inline int
+pv_wait_head(struct qspinlock *lock, struct mcs_spinlock *node)
+{
+	struct __qspinlock *l = (void *)lock;
+	struct pv_qnode *pn = pv_qnode(node);
+
+	if (in_nmi())
+		return pv_nmi_wait_head(lock, pn);
+
+	for (;;) {
+		unsigned int count;
+		u64 spin_start;
+		int oldstate;
+		int val;
+
+reset:
+		count = pv_spin_threshold();
+		spin_start = sched_clock();
+		ACCESS_ONCE(pn->cpustate) = PV_CPU_ACTIVE;
+		pv_wait_for_cpu(pv_lock_owner(lock, pn), true);
+
+		while (count--) {
+			val = smp_load_acquire(&lock->val.counter);
+			if (!(val & _Q_LOCKED_PENDING_MASK)) {
+				pv_wait_for_cpu(-1, false);
+				return val;
+			}
+			if (pn->cpustate == PV_CPU_KICKED)
+				/*
+				 * Reset count and flag
+				 */
+				goto reset;
+			if (pv_prev_preempted(pn, count))
+				break;	/* Lock holder preempted, halt now */
+			cpu_relax();
+		}
+
+		/*
+		 * Set the lock byte to _Q_LOCKED_SLOWPATH before
+		 * trying to halt itself. It is possible that the
+		 * lock byte had been set to _Q_LOCKED_SLOWPATH
+		 * already (spurious wakeup of queue head after a halt
+		 * or opportunistic setting in pv_wait_check()).
+		 * In this case, just proceeds to sleeping.
+		 *
+		 *     queue head		    lock holder
+		 *     ----------		    -----------
+		 *     cpustate = PV_CPU_HALTED
+		 * [1] cmpxchg(_Q_LOCKED_VAL	[2] cmpxchg(_Q_LOCKED_VAL => 0)
+		 * => _Q_LOCKED_SLOWPATH)	    if (cmpxchg fails &&
+		 *     if (cmpxchg succeeds)	    cpustate == PV_CPU_HALTED)
+		 *        halt()		       kick()
+		 *
+		 * Sequence:
+		 * 1,2 - slowpath flag set, queue head halted & lock holder
+		 *	 will call slowpath
+		 * 2,1 - queue head cmpxchg fails, halt is aborted
+		 *
+		 * If the queue head CPU is woken up by a spurious interrupt
+		 * at the same time as the lock holder check the cpustate,
+		 * it is possible that the lock holder will try to kick
+		 * the queue head CPU which isn't halted.
+		 */
+		/*
+		 * Halting won't make a preempted lock holder run again.
+		 * Yield to it directly and spin again afterward. The queue
+		 * head will only halt when the lock holder is running.
+		 */
+		if (pv_yield_to_owner(lock, pn))
+			continue;
+
+		oldstate = cmpxchg(&pn->cpustate, PV_CPU_ACTIVE, PV_CPU_HALTED);
+		if (oldstate == PV_CPU_KICKED)
+			continue;	/* Reset count & flag */
+
+		/*
+		 * The hash entry has to be added before setting the
+		 * _Q_LOCKED_SLOWPATH flag so that the unlocker will always
+		 * find it. It is redone on every halt attempt, as the unlocker
+		 * removes the entry together with the flag: the holder of a
+		 * lock stolen after that has to find them both again to kick
+		 * the queue head. pv_set_slowpath() does nothing if the flag
+		 * is still set.
+		 */
+		if (!pv_set_slowpath(lock, pn)) {
+			/*
+			 * The lock is free and no halting is needed
+			 */
+			ACCESS_ONCE(pn->cpustate) = PV_CPU_ACTIVE;
+			pv_wait_for_cpu(-1, false);
+			return smp_load_acquire(&lock->val.counter);
+		}
+
+		if (ACCESS_ONCE(l->locked) != _Q_LOCKED_SLOWPATH)
+			continue;	/* Lock stolen, keep spinning */
+
+		pv_halt(&l->locked, pn, spin_start);
+	}
+	/* Unreachable */
+	return 0;
+}
+
+/**
+ * pv_wait_check - check if the CPU has been halted & set _Q_LOCKED_SLOWPATH
+ * @lock: pointer to the qspinlock structure
+ * @node: pointer to the mcs_spinlock structure of lock holder
+ * @next: pointer to the mcs_spinlock structure of new queue head
+ *
+ * The current CPU should have gotten the lock before calling this function.
+ */
+static inline void pv_wait_check(struct qspinlock *lock,
+		   struct mcs_spinlock *node, struct mcs_spinlock *next)
+{
+	struct __qspinlock *l = (void *)lock;
+	struct pv_qnode *pnxt = pv_qnode(next);
+
+	/*
+	 * Clear the locked value of lock holder
+	 */
+	node->locked = false;
+
+	/*
+	 * Halt state checking will only be done if the mayhalt flag is set
+	 * to avoid the overhead of the memory barrier in normal cases.
+	 * It is highly unlikely that the actual writing to the node->locked
+	 * flag will be more than 0x10 iterations later than the reading of
+	 * the mayhalt flag so that it misses seeing the PV_CPU_HALTED state
+	 * which causes lost wakeup.
+	 */
+	if (!ACCESS_ONCE(pnxt->mayhalt))
+		return;
+
+	/*
+	 * A memory barrier is used here to make sure that the setting
+	 * of node->locked flag prior to this function call is visible
+	 * to others before checking the cpustate flag.
+	 */
+	smp_mb();
+	if (pnxt->cpustate != PV_CPU_HALTED)
+		return;
+
+	pv_hash(lock, pnxt);
+	ACCESS_ONCE(l->locked) = _Q_LOCKED_SLOWPATH;
+}
+
+/*
+ * Per-cpu list of the kicks deferred by pv_kick_batch_start()
+ */
+#define PV_KICK_BATCH_MAX	16
+
+struct pv_kick_batch {
+	int depth;
+	int nr;
+	int cpus[PV_KICK_BATCH_MAX];
+};
+
+static DEFINE_PER_CPU(struct pv_kick_batch, pv_kick_batch);
+
+static void pv_kick_batch_flush(struct pv_kick_batch *kb)
+{
+	if (kb->nr) {
+		pv_kick_cpus(kb->cpus, kb->nr);
+		kb->nr = 0;
+	}
+}
+
+/**
+ * pv_kick_batch_start - start deferring the kicks of the current CPU
+ *
+ * The calls can be nested. Preemption has to be disabled until the
+ * matching pv_kick_batch_end().
+ */
+void pv_kick_batch_start(void)
+{
+	this_cpu_inc(pv_kick_batch.depth);
+}
+EXPORT_SYMBOL(pv_kick_batch_start);
+
+/**
+ * pv_kick_batch_end - issue the deferred kicks of the current CPU
+ */
+void pv_kick_batch_end(void)
+{
+	struct pv_kick_batch *kb = this_cpu_ptr(&pv_kick_batch);
+
+	if (--kb->depth)
+		return;
+	pv_kick_batch_flush(kb);
+}
+EXPORT_SYMBOL(pv_kick_batch_end);
+
+/**
+ * pv_kick_or_defer - kick the given CPU now or add it to the batch
+ * @cpu: the CPU to be kicked
+ *
+ * Kicks from interrupt context are never deferred as the interrupted
+ * task may be in the middle of a batch. A full batch is flushed first.
+ */
+static inline void pv_kick_or_defer(int cpu)
+{
+	struct pv_kick_batch *kb = this_cpu_ptr(&pv_kick_batch);
+
+	if (likely(!kb->depth) || in_interrupt()) {
+		pv_kick_cpu(cpu);
+		return;
+	}
+	if (kb->nr == PV_KICK_BATCH_MAX)
+		pv_kick_batch_flush(kb);
+	kb->cpus[kb->nr++] = cpu;
+}
+
+/**
+ * pv_kick_node - kick up the CPU of the given node
+ * @pn : pointer to the pv_qnode structure of the node to be kicked
+ */
+static inline void pv_kick_node(struct pv_qnode *pn)
+{
+	int oldstate;
+
+	if (!pn)
+		return;
+
+	oldstate = xchg(&pn->cpustate, PV_CPU_KICKED);
+	/*
+	 * Kick the CPU only if the state was set to PV_CPU_HALTED
+	 */
+	if (oldstate != PV_CPU_HALTED) {
+		pv_lockstat(PV_KICK_NOHALT);
+	} else {
+		trace_qspinlock_pv_kick(pn->mycpu);
+		pv_kick_or_defer(pn->mycpu);
+	}
+}
+
+/**
+ * queue_spin_unlock_slowpath - kick up the CPU of the queue head
+ * @lock : Pointer to queue spinlock structure
+ *
+ * The lock is released after finding the queue head to avoid racing
+ * condition between the queue head and the lock holder.
+ */
+void queue_spin_unlock_slowpath(struct qspinlock *lock)
+{
+	struct pv_qnode *pn = pv_unhash(lock);
+
+	/*
+	 * Found the queue head, now release the lock before waking it up
+	 */
+	native_spin_unlock(lock);
+	pv_kick_node(pn);
+}
+EXPORT_SYMBOL(queue_spin_unlock_slowpath);
+
+/*
+ * Contended lock holder hint
+ *
+ * A vCPU preempted while holding a lock that others wait for stalls all
+ * of them. With the hint enabled by the hypervisor code, the locks taken
+ * in the PV slowpath are recorded in a per-cpu table and their number is
+ * published with pv_lock_held(), so that the hypervisor can hold off
+ * preempting the vCPU for a little while. The uncontended locks aren't
+ * tracked, there is nobody to stall. The architecture unlock calls
+ * pv_lock_released() while the per-cpu count is non-zero.
+ *
+ * A lock is held by the CPU that took it, but the table is shared by the
+ * nested contexts, so it is only changed with interrupts disabled. More
+ * than PV_HELD_LOCKS contended locks at once aren't tracked.
+ */
+#define PV_HELD_LOCKS	4
+
+static bool pv_lock_hint __read_mostly;
+DEFINE_PER_CPU(unsigned int, pv_locks_held);
+EXPORT_PER_CPU_SYMBOL(pv_locks_held);
+static DEFINE_PER_CPU(struct qspinlock *, pv_held_locks[PV_HELD_LOCKS]);
+
+void __init pv_init_lock_hint(void)
+{
+	pv_lock_hint = true;
+}
+
+static void pv_lock_acquired(struct qspinlock *lock)
+{
+	unsigned long flags;
+	int i;
+
+	if (!pv_lock_hint)
+		return;
+
+	local_irq_save(flags);
+	for (i = 0; i < PV_HELD_LOCKS; i++) {
+		if (!__this_cpu_read(pv_held_locks[i])) {
+			__this_cpu_write(pv_held_locks[i], lock);
+			pv_lock_held(__this_cpu_inc_return(pv_locks_held));
+			break;
+		}
+	}
+	local_irq_restore(flags);
+}
+
+void __pv_lock_released(struct qspinlock *lock)
+{
+	unsigned long flags;
+	int i;
+
+	local_irq_save(flags);
+	for (i = 0; i < PV_HELD_LOCKS; i++) {
+		if (__this_cpu_read(pv_held_locks[i]) == lock) {
+			__this_cpu_write(pv_held_locks[i], NULL);
+			pv_lock_held(__this_cpu_dec_return(pv_locks_held));
+			break;
+		}
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(__pv_lock_released);
+
+#ifdef CONFIG_DEBUG_FS
+#include "qspinlock_pvstat.h"
+#endif
+
+#ifndef CONFIG_PARAVIRT
+/*
+ * The function table of the architectures without paravirt patching,
+ * filled in by the hypervisor specific code at boot time.
+ */
+static void native_lockwait(u8 *lockbyte)		{ }
+static void native_kick_cpu(int cpu)			{ }
+static void native_kick_cpus(int *cpus, int nr)
+{
+	while (nr--)
+		pv_kick_cpu(*cpus++);
+}
+static void native_lockstat(enum pv_lock_stats type)	{ }
+static bool native_vcpu_is_preempted(int cpu)		{ return false; }
+static bool native_yield_to_cpu(int cpu)		{ return false; }
+static void native_wait_for_cpu(int cpu, bool qhead)	{ }
+static void native_lock_held(int nr)			{ }
+
+struct pv_lock_ops pv_lock_ops = {
+	.lockwait	   = native_lockwait,
+	.kick_cpu	   = native_kick_cpu,
+	.kick_cpus	   = native_kick_cpus,
+	.lockstat	   = native_lockstat,
+	.vcpu_is_preempted = native_vcpu_is_preempted,
+	.yield_to_cpu	   = native_yield_to_cpu,
+	.wait_for_cpu	   = native_wait_for_cpu,
+	.lock_held	   = native_lock_held,
+};
+EXPORT_SYMBOL(pv_lock_ops);
+
+struct static_key paravirt_spinlocks_enabled = STATIC_KEY_INIT_FALSE;
+EXPORT_SYMBOL(paravirt_spinlocks_enabled);
+#endif /* !CONFIG_PARAVIRT */
+
+#endif /* __LINUX_QSPINLOCK_PARAVIRT_H */
@@ -0,0 +1,168 @@
+#ifndef __LINUX_QSPINLOCK_PVSTAT_H
+#define __LINUX_QSPINLOCK_PVSTAT_H
+
+/*
+ *	Queue Spinlock PV Halt & Wakeup Statistics
+ *
+ * Per-cpu u64 counts of the pv_lock_stats events and the total & log2
+ * histogram of the time spent halted, kept for the hypervisor backends so
+ * that they all have the same debugfs layout. The backend calls
+ * pv_lockstat_inc() from its lockstat hook and halt function and
+ * pv_lockstat_blocked() after each halt. The counters are only summed up
+ * when read, so that halting and kicking don't bounce a shared cacheline
+ * between the vCPUs.
+ *
+ * pv_lockstat_debugfs() creates in the given directory one file for each
+ * event, which can be written with 0 to clear it, a time_blocked file and
+ * a histo_blocked file with the non-empty buckets.
+ */
+#include <linux/debugfs.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+
+#define PV_LOCKSTAT_BUCKETS	32
+
+struct pv_lockstat_cpu {
+	u64	count[PV_NR_LOCK_STATS];
+	u64	blocked_ns;
+	u64	histo[PV_LOCKSTAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct pv_lockstat_cpu, pv_lockstat_cpu);
+
+static const char * const pv_lockstat_names[PV_NR_LOCK_STATS] = {
+	[PV_HALT_QHEAD]    = "halt_qhead_stats",
+	[PV_HALT_QNODE]    = "halt_qnode_stats",
+	[PV_HALT_ABORT]    = "halt_abort_stats",
+	[PV_HALT_REPOLL]   = "halt_repoll_stats",
+	[PV_WAKE_KICKED]   = "wake_kick_stats",
+	[PV_WAKE_SPURIOUS] = "wake_spur_stats",
+	[PV_KICK_NOHALT]   = "kick_nohlt_stats",
+	[PV_NMI_WAIT]      = "nmi_wait_stats",
+};
+
+/**
+ * pv_lockstat_inc - count a PV halt or wakeup event
+ * @type: The event type
+ */
+void pv_lockstat_inc(enum pv_lock_stats type)
+{
+	this_cpu_inc(pv_lockstat_cpu.count[type]);
+}
+EXPORT_SYMBOL(pv_lockstat_inc);
+
+/**
+ * pv_lockstat_blocked - account for the time spent in a halt
+ * @ns: The halt duration in ns
+ *
+ * Called with interrupts disabled.
+ */
+void pv_lockstat_blocked(u64 ns)
+{
+	struct pv_lockstat_cpu *ps = this_cpu_ptr(&pv_lockstat_cpu);
+
+	ps->blocked_ns += ns;
+	ps->histo[min_t(u32, ns ? ilog2(ns) : 0, PV_LOCKSTAT_BUCKETS - 1)]++;
+}
+EXPORT_SYMBOL(pv_lockstat_blocked);
+
+static int pv_lockstat_get(void *data, u64 *val)
+{
+	long type = (long)data;
+	int cpu;
+
+	*val = 0;
+	for_each_possible_cpu(cpu)
+		*val += per_cpu(pv_lockstat_cpu, cpu).count[type];
+	return 0;
+}
+
+static int pv_lockstat_set(void *data, u64 val)
+{
+	long type = (long)data;
+	int cpu;
+
+	if (val)
+		return -EINVAL;
+	for_each_possible_cpu(cpu)
+		per_cpu(pv_lockstat_cpu, cpu).count[type] = 0;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(pv_lockstat_fops, pv_lockstat_get, pv_lockstat_set,
+			"%llu\n");
+
+static int pv_lockstat_blocked_get(void *data, u64 *val)
+{
+	int cpu;
+
+	*val = 0;
+	for_each_possible_cpu(cpu)
+		*val += per_cpu(pv_lockstat_cpu, cpu).blocked_ns;
+	return 0;
+}
+
+static int pv_lockstat_blocked_set(void *data, u64 val)
+{
+	int cpu;
+
+	if (val)
+		return -EINVAL;
+	for_each_possible_cpu(cpu) {
+		struct pv_lockstat_cpu *ps = per_cpu_ptr(&pv_lockstat_cpu, cpu);
+
+		ps->blocked_ns = 0;
+		memset(ps->histo, 0, sizeof(ps->histo));
+	}
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(pv_lockstat_blocked_fops, pv_lockstat_blocked_get,
+			pv_lockstat_blocked_set, "%llu\n");
+
+static int pv_lockstat_histo_show(struct seq_file *m, void *v)
+{
+	u64 histo[PV_LOCKSTAT_BUCKETS] = { 0 };
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct pv_lockstat_cpu *ps = per_cpu_ptr(&pv_lockstat_cpu, cpu);
+
+		for (i = 0; i < PV_LOCKSTAT_BUCKETS; i++)
+			histo[i] += ps->histo[i];
+	}
+	for (i = 0; i < PV_LOCKSTAT_BUCKETS; i++) {
+		if (histo[i])
+			seq_printf(m, "%14llu ns: %llu\n", 1ULL << i, histo[i]);
+	}
+	return 0;
+}
+
+static int pv_lockstat_histo_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pv_lockstat_histo_show, NULL);
+}
+
+static const struct file_operations pv_lockstat_histo_fops = {
+	.open		= pv_lockstat_histo_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/**
+ * pv_lockstat_debugfs - create the PV lock statistics files
+ * @dir: The debugfs directory of the backend
+ */
+void __init pv_lockstat_debugfs(struct dentry *dir)
+{
+	long type;
+
+	for (type = 0; type < PV_NR_LOCK_STATS; type++)
+		debugfs_create_file(pv_lockstat_names[type], 0644, dir,
+				    (void *)type, &pv_lockstat_fops);
+	debugfs_create_file("time_blocked", 0644, dir, NULL,
+			    &pv_lockstat_blocked_fops);
+	debugfs_create_file("histo_blocked", 0444, dir, NULL,
+			    &pv_lockstat_histo_fops);
+}
+
+#endif /* __LINUX_QSPINLOCK_PVSTAT_H */
@@ -0,0 +1,237 @@
+#ifndef __LINUX_QSPINLOCK_STAT_H
+#define __LINUX_QSPINLOCK_STAT_H
+
+/*
+ *	Queue Spinlock Contention Statistics
+ *
+ * Low overhead, per-cpu statistics of the queue spinlock slowpath that can
+ * be left compiled in on production kernels. Nothing is collected until the
+ * statistics are enabled via the qspinlock/enable debugfs file, which flips
+ * a static key. With the key off, the only cost is a patched-out jump in the
+ * slowpath; the lock fastpath is not touched at all.
+ *
+ * The slowpath acquisitions are broken down by the way the lock is finally
+ * acquired:
+ *  1) trylock    - the lock became free by the time the slowpath is entered
+ *  2) pending    - acquired through the pending bit
+ *  3) uqueue     - queued, but the queue is empty when the lock is acquired
+ *  4) cqueue     - queued, and there are other waiters behind us
+ *  5) nested     - spinning without queuing as all the queue nodes are used
+ *
+ * For each of them, a count, the total & maximum wait times and a log2
+ * histogram of the wait time in ns are kept, see wait_stat.h. In addition,
+ * one out of every
+ * QSTAT_SAMPLE_RATE queued acquisitions on a CPU is sampled into a small
+ * hashed table of lock addresses and callers so that the most contended
+ * locks can be identified. The sample table is updated locklessly and its
+ * content is approximate.
+ *
+ * All the statistics are exposed under the qspinlock debugfs directory:
+ *  enable - write 1/0 to turn the statistics on/off
+ *  reset  - write anything to clear the statistics
+ *  stats  - the per path counts, wait times & histograms
+ *  top    - the sampled contended lock addresses and callers
+ */
+#include <linux/ftrace.h>
+#include <linux/hash.h>
+#include <linux/jump_label.h>
+#include <linux/uaccess.h>
+#include "wait_stat.h"
+
+enum qstat_path {
+	QSTAT_TRYLOCK,		/* Acquired by trylock		*/
+	QSTAT_PENDING,		/* Acquired via the pending bit	*/
+	QSTAT_UQUEUE,		/* Queued, uncontended		*/
+	QSTAT_CQUEUE,		/* Queued, contended		*/
+	QSTAT_NESTED,		/* Out of queue nodes		*/
+	QSTAT_NR_PATHS
+};
+
+static const char * const qstat_names[QSTAT_NR_PATHS] = {
+	[QSTAT_TRYLOCK] = "trylock",
+	[QSTAT_PENDING] = "pending",
+	[QSTAT_UQUEUE]  = "uqueue",
+	[QSTAT_CQUEUE]  = "cqueue",
+	[QSTAT_NESTED]  = "nested",
+};
+
+#define QSTAT_SAMPLE_RATE	64
+#define QSTAT_TOP_BITS		6
+#define QSTAT_TOP_SIZE		(1 << QSTAT_TOP_BITS)
+
+struct qstat_top {
+	struct qspinlock *lock;		/* Sampled lock address		*/
+	unsigned long	 caller;	/* Last sampled caller		*/
+	unsigned long	 hits;		/* Number of samples		*/
+	u64		 wait_ns;	/* Sampled wait time		*/
+};
+
+DEFINE_WSTAT(qstat, qstat_names);
+static DEFINE_PER_CPU(unsigned int, qstat_sample_cnt);
+static struct qstat_top qstat_top[QSTAT_TOP_SIZE];
+static struct static_key qstat_key = STATIC_KEY_INIT_FALSE;
+static bool qstat_enabled;
+static DEFINE_MUTEX(qstat_mutex);
+
+/**
+ * qstat_start - start timing a slowpath lock acquisition
+ * Return: the start time, or 0 if the statistics are off
+ */
+static __always_inline u64 qstat_start(void)
+{
+	if (static_key_false(&qstat_key))
+		return sched_clock();
+	return 0;
+}
+
+/*
+ * Sample the contended lock into the top table. A slot that is taken by
+ * another lock is aged on each collision and is taken over once its hit
+ * count drops to zero, so that the frequently sampled locks stay.
+ */
+static noinline void
+qstat_sample(struct qspinlock *lock, unsigned long caller, u64 delta)
+{
+	struct qstat_top *top = &qstat_top[hash_ptr(lock, QSTAT_TOP_BITS)];
+	struct qspinlock *old = ACCESS_ONCE(top->lock);
+
+	if (old != lock) {
+		if (old && top->hits && --top->hits)
+			return;
+		if (cmpxchg(&top->lock, old, lock) != old)
+			return;
+		top->hits    = 0;
+		top->wait_ns = 0;
+	}
+	top->caller   = caller;
+	top->hits++;
+	top->wait_ns += delta;
+}
+
+/**
+ * qstat_end - account for a slowpath lock acquisition
+ * @lock : Pointer to queue spinlock structure
+ * @path : The path the lock is acquired through
+ * @start: The start time returned by qstat_start()
+ */
+static __always_inline void
+qstat_end(struct qspinlock *lock, enum qstat_path path, u64 start)
+{
+	u64 delta;
+
+	if (!static_key_false(&qstat_key) || !start)
+		return;
+
+	delta = wstat_wait(&qstat, path, start);
+	if (path >= QSTAT_UQUEUE &&
+	    !(__this_cpu_inc_return(qstat_sample_cnt) % QSTAT_SAMPLE_RATE))
+		qstat_sample(lock, CALLER_ADDR1 ? CALLER_ADDR1 : CALLER_ADDR0,
+			     delta);
+}
+
+static int qstat_top_show(struct seq_file *m, void *v)
+{
+	int i;
+
+	seq_printf(m, "%-18s %10s %14s  %s\n",
+		   "lock", "samples", "wait_ns", "caller");
+	for (i = 0; i < QSTAT_TOP_SIZE; i++) {
+		struct qstat_top *top = &qstat_top[i];
+		struct qspinlock *lock = ACCESS_ONCE(top->lock);
+
+		if (!lock || !top->hits)
+			continue;
+		seq_printf(m, "%p %10lu %14llu  %pS\n", lock,
+			   top->hits, top->wait_ns, (void *)top->caller);
+	}
+	return 0;
+}
+
+static int qstat_top_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, qstat_top_show, NULL);
+}
+
+static const struct file_operations qstat_top_fops = {
+	.open		= qstat_top_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t qstat_enable_read(struct file *file, char __user *user_buf,
+				 size_t count, loff_t *ppos)
+{
+	char buf[2];
+
+	buf[0] = qstat_enabled ? '1' : '0';
+	buf[1] = '\n';
+	return simple_read_from_buffer(user_buf, count, ppos, buf, 2);
+}
+
+static ssize_t qstat_enable_write(struct file *file,
+		const char __user *user_buf, size_t count, loff_t *ppos)
+{
+	char buf[32];
+	size_t buf_size;
+	bool enable;
+
+	buf_size = min(count, (sizeof(buf)-1));
+	if (copy_from_user(buf, user_buf, buf_size))
+		return -EFAULT;
+
+	buf[buf_size] = '\0';
+	if (strtobool(buf, &enable))
+		return -EINVAL;
+
+	mutex_lock(&qstat_mutex);
+	if (enable != qstat_enabled) {
+		if (enable)
+			static_key_slow_inc(&qstat_key);
+		else
+			static_key_slow_dec(&qstat_key);
+		qstat_enabled = enable;
+	}
+	mutex_unlock(&qstat_mutex);
+	return count;
+}
+
+static const struct file_operations qstat_enable_fops = {
+	.read		= qstat_enable_read,
+	.write		= qstat_enable_write,
+	.llseek		= default_llseek,
+};
+
+static ssize_t qstat_reset_write(struct file *file,
+		const char __user *user_buf, size_t count, loff_t *ppos)
+{
+	wstat_reset(&qstat);
+	memset(qstat_top, 0, sizeof(qstat_top));
+	return count;
+}
+
+static const struct file_operations qstat_reset_fops = {
+	.write		= qstat_reset_write,
+	.llseek		= default_llseek,
+};
+
+static int __init qstat_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = wstat_debugfs_init(&qstat, "qspinlock", &qstat_reset_fops);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("enable", 0600, dir, NULL,
+				 &qstat_enable_fops) ||
+	    !debugfs_create_file("top", 0400, dir, NULL,
+				 &qstat_top_fops)) {
+		debugfs_remove_recursive(dir);
+		return -ENOMEM;
+	}
+	return 0;
+}
+fs_initcall(qstat_debugfs_init);
+
+#endif /* __LINUX_QSPINLOCK_STAT_H */
@@ -0,0 +1,143 @@
+#ifndef __LINUX_QSPINLOCK_STEAL_H
+#define __LINUX_QSPINLOCK_STEAL_H
+
+#include <linux/init.h>
+#include <linux/string.h>
+
+/*
+ *	Queue Spinlock Bounded Lock Stealing for Virtualized Guests
+ *
+ * Without PV spinlock support, a guest has to choose between the unfair
+ * test-and-set lock and the strictly fair queue spinlock. The fair lock
+ * performs badly when the vCPU of the next waiter in line isn't running,
+ * as nobody else can get the lock until that vCPU is scheduled in again.
+ *
+ * In the hybrid mode, the waiters that are not yet queued may steal the
+ * lock whenever it is free and the queue head hasn't taken it yet. When
+ * the queue head is running, it will normally win the race right after
+ * the lock is released. When the queue head vCPU is preempted, the lock
+ * stays free and so will be taken by one of the stealers instead.
+ *
+ * To bound the starvation of the queue head, it will set the pending bit
+ * once it has spun VIRT_STEAL_HEAD_SPINS times without getting the lock.
+ * Lock stealing is turned off while the pending bit is set, so the queue
+ * head can take the lock with clear_pending_set_locked() as soon as the
+ * lock holder releases it.
+ *
+ * The mode is selected at boot time with the "virt_spinlock" parameter:
+ *  unfair - the test-and-set lock (default)
+ *  hybrid - queue spinlock with bounded lock stealing
+ *  fair   - plain queue spinlock
+ */
+
+/*
+ * The number of times a waiter will try to steal the lock before queuing
+ * and the number of times the queue head will spin before turning lock
+ * stealing off.
+ */
+#define VIRT_STEAL_SPINS	(1 << 8)
+#define VIRT_STEAL_HEAD_SPINS	(1 << 12)
+
+enum virt_spin_mode virt_spin_mode __read_mostly = VIRT_SPIN_UNFAIR;
+
+static int __init virt_spinlock_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+	if (!strcmp(str, "unfair"))
+		virt_spin_mode = VIRT_SPIN_UNFAIR;
+	else if (!strcmp(str, "hybrid"))
+		virt_spin_mode = VIRT_SPIN_HYBRID;
+	else if (!strcmp(str, "fair"))
+		virt_spin_mode = VIRT_SPIN_FAIR;
+	else
+		return -EINVAL;
+	return 0;
+}
+early_param("virt_spinlock", virt_spinlock_setup);
+
+/**
+ * virt_steal_lock - try to steal the lock before queuing
+ * @lock: Pointer to queue spinlock structure
+ * Return: true if the lock has been stolen, false otherwise
+ *
+ * Stealing is only done when there is a queue. Otherwise, the normal
+ * trylock and pending code path is good enough.
+ */
+static inline bool virt_steal_lock(struct qspinlock *lock)
+{
+	int loop = VIRT_STEAL_SPINS;
+	u32 val;
+
+	if (!virt_queue_spin_steal())
+		return false;
+
+	while (loop--) {
+		val = atomic_read(&lock->val);
+		if (!(val & _Q_TAIL_MASK) || (val & _Q_PENDING_MASK))
+			break;
+		if (!(val & _Q_LOCKED_MASK) &&
+		   (atomic_cmpxchg(&lock->val, val, val | _Q_LOCKED_VAL) == val))
+			return true;
+		cpu_relax();
+	}
+	return false;
+}
+
+/**
+ * virt_steal_head - acquire the lock as the queue head in the hybrid mode
+ * @lock: Pointer to queue spinlock structure
+ * @pval: Pointer to the current lock value, updated on return
+ * Return: true if the lock has been acquired, false if not in hybrid mode
+ *
+ * As the lock can be stolen, the locked byte has to be set atomically.
+ * The lock value with the locked byte set is returned through @pval.
+ *
+ * *,x,y -> *,0,1 ; lock
+ * *,0,1 -> *,1,1 -> *,1,0 -> *,0,1 ; stealing off and lock
+ */
+static inline bool virt_steal_head(struct qspinlock *lock, u32 *pval)
+{
+	int loop = 0;
+	u32 old, val = *pval;
+
+	if (!virt_queue_spin_steal())
+		return false;
+
+	for (;;) {
+		if (!(val & _Q_LOCKED_PENDING_MASK)) {
+			old = atomic_cmpxchg(&lock->val, val,
+					     val | _Q_LOCKED_VAL);
+			if (old == val)
+				break;
+			val = old;
+			continue;
+		}
+
+		/*
+		 * Only a waiter that came before the queue was created could
+		 * own the pending bit when it is already set.
+		 */
+		if ((++loop >= VIRT_STEAL_HEAD_SPINS) &&
+		    !(val & _Q_PENDING_MASK)) {
+			old = atomic_cmpxchg(&lock->val, val,
+					     val | _Q_PENDING_VAL);
+			if (old == val) {
+				while ((val = smp_load_acquire(&lock->val.counter))
+						& _Q_LOCKED_MASK)
+					cpu_relax();
+				clear_pending_set_locked(lock, val);
+				val = atomic_read(&lock->val);
+				break;
+			}
+			val = old;
+			continue;
+		}
+		cpu_relax();
+		val = smp_load_acquire(&lock->val.counter);
+	}
+	*pval = val | _Q_LOCKED_VAL;
+	return true;
+}
+
+#endif /* __LINUX_QSPINLOCK_STEAL_H */
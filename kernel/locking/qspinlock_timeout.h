@@ -0,0 +1,295 @@
+#ifndef __LINUX_QSPINLOCK_TIMEOUT_H
+#define __LINUX_QSPINLOCK_TIMEOUT_H
+
+#include <linux/bitops.h>
+#include <linux/timex.h>
+
+/*
+ *	Queue Spinlock Acquisition with a Timeout
+ *
+ * queue_spin_trylock_for() waits in the MCS queue like any other waiter,
+ * but gives up after the given number of get_cycles() cycles. The queue
+ * order of the other waiters is kept, so a bounded waiter never gets the
+ * lock ahead of those queued before it.
+ *
+ * A waiter that times out at the head of the queue takes itself off it:
+ * it clears the tail code if it is the last one, or makes its successor
+ * the head otherwise, just like a lock holder passing the lock on except
+ * that the lock isn't taken.
+ *
+ * A waiter that times out before reaching the head can't unlink itself,
+ * as the MCS queue has no back pointers and its predecessor may already
+ * be reading its next pointer. Instead, it abandons its node by writing
+ * the node's tail code into node->locked with a cmpxchg that races with
+ * the one of its predecessor granting it the queue head. The node stays
+ * in the queue and whoever makes it the head later leaves it on behalf
+ * of its owner, then gives the node back by setting node->locked to
+ * _Q_NODE_RELEASED.
+ *
+ * An abandoned node can't be reused by its CPU until it is given back,
+ * so the per-cpu queue nodes are taken from a busy mask here rather than
+ * with the count of the nested contexts. The abandoned nodes are
+ * reclaimed when a new one is needed. While all of them are in use, the
+ * waiters spin with trylock without queuing like they do for deeply
+ * nested contexts.
+ *
+ * The PV waiters expect to be kicked by their predecessor, so with PV
+ * spinlocks enabled the bounded waiters never queue and only spin with
+ * trylock until the timeout.
+ */
+
+#define _Q_NODE_RELEASED	1
+
+static DEFINE_PER_CPU(unsigned long, qnode_busy);
+static DEFINE_PER_CPU(unsigned long, qnode_abandoned);
+
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+#define qtimeout_may_queue()	(!static_key_false(&paravirt_spinlocks_enabled))
+#else
+#define qtimeout_may_queue()	true
+#endif
+
+/*
+ * The masks are only changed by their own CPU, from any context, and the
+ * changes are single per-cpu cmpxchg operations so that they are safe
+ * against the nested contexts.
+ */
+static __always_inline void qnode_set_bit(unsigned long __percpu *mask,
+					 int idx)
+{
+	unsigned long old;
+
+	do {
+		old = this_cpu_read(*mask);
+	} while (this_cpu_cmpxchg(*mask, old, old | (1UL << idx)) != old);
+}
+
+static __always_inline bool qnode_clear_bit(unsigned long __percpu *mask,
+					   int idx)
+{
+	unsigned long old;
+
+	do {
+		old = this_cpu_read(*mask);
+		if (!(old & (1UL << idx)))
+			return false;
+	} while (this_cpu_cmpxchg(*mask, old, old & ~(1UL << idx)) != old);
+	return true;
+}
+
+/*
+ * Free the abandoned nodes which have been given back. A nested context
+ * may race with us for the same node, only the one which clears the
+ * abandoned bit frees it.
+ */
+static noinline void qnode_reclaim(void)
+{
+	unsigned long abandoned = this_cpu_read(qnode_abandoned);
+	int idx;
+
+	for (idx = 0; idx < MAX_QNODES; idx++) {
+		struct mcs_spinlock *node = this_cpu_ptr(&MCS_NODE(idx));
+
+		if (!(abandoned & (1UL << idx)) ||
+		    smp_load_acquire(&node->locked) != _Q_NODE_RELEASED)
+			continue;
+		if (qnode_clear_bit(&qnode_abandoned, idx))
+			qnode_clear_bit(&qnode_busy, idx);
+	}
+}
+
+/*
+ * Get a free queue node of this CPU. Returns its index, which is
+ * MAX_QNODES or more if there is none left.
+ */
+static __always_inline int qnode_get(void)
+{
+	unsigned long busy;
+	int idx;
+
+	if (unlikely(this_cpu_read(qnode_abandoned)))
+		qnode_reclaim();
+
+	do {
+		busy = this_cpu_read(qnode_busy);
+		idx = ffz(busy);
+		if (unlikely(idx >= MAX_QNODES))
+			return idx;
+	} while (this_cpu_cmpxchg(qnode_busy, busy, busy | (1UL << idx)) != busy);
+
+	return idx;
+}
+
+static __always_inline void qnode_put(int idx)
+{
+	if (idx < MAX_QNODES)
+		qnode_clear_bit(&qnode_busy, idx);
+}
+
+/*
+ * Take @node, which has just become the queue head, off the queue of
+ * @lock without taking the lock. Returns the next node, which has to be
+ * made the head, or NULL if @node was the last one.
+ *
+ * n,*,* -> 0,*,*
+ */
+static struct mcs_spinlock *
+queue_leave(struct qspinlock *lock, struct mcs_spinlock *node, u32 tail)
+{
+	struct mcs_spinlock *next;
+	u32 old, val = atomic_read(&lock->val);
+
+	while ((val & _Q_TAIL_MASK) == tail) {
+		old = atomic_cmpxchg(&lock->val, val, val & ~_Q_TAIL_MASK);
+		if (old == val)
+			return NULL;
+		val = old;
+	}
+
+	while (!(next = ACCESS_ONCE(node->next)))
+		cpu_relax();
+	return next;
+}
+
+/**
+ * queue_pass_head - make the next waiter the queue head
+ * @lock: Pointer to queue spinlock structure
+ * @next: The successor of the current queue head
+ * Return: the new queue head, or NULL if the queue has been emptied
+ *
+ * The abandoned nodes are left on behalf of their owner and given back.
+ */
+static struct mcs_spinlock *
+queue_pass_head(struct qspinlock *lock, struct mcs_spinlock *next)
+{
+	int tail;
+
+	while ((tail = cmpxchg(&next->locked, 0, 1))) {
+		struct mcs_spinlock *node = next;
+
+		next = queue_leave(lock, node, tail);
+		smp_store_release(&node->locked, _Q_NODE_RELEASED);
+		if (!next)
+			return NULL;
+	}
+	return next;
+}
+
+/* Has the waiter been spinning for more than @cycles since @start? */
+static __always_inline bool qtimeout_expired(cycles_t start, u64 cycles)
+{
+	return (u64)(get_cycles() - start) >= cycles;
+}
+
+/**
+ * queue_spin_trylock_for_slowpath - acquire the queue spinlock or time out
+ * @lock  : Pointer to queue spinlock structure
+ * @cycles: The maximum number of get_cycles() cycles to wait
+ * Return: 1 if the lock is acquired, 0 if the wait timed out
+ *
+ * The pending bit and the lock stealing modes are not used, the waiter
+ * queues right away.
+ */
+int queue_spin_trylock_for_slowpath(struct qspinlock *lock, u64 cycles)
+{
+	struct mcs_spinlock *prev, *next, *node;
+	cycles_t start = get_cycles();
+	u32 old, val, tail;
+	int idx;
+
+	if (!qtimeout_may_queue())
+		goto spin;
+
+	idx = qnode_get();
+	if (unlikely(idx >= MAX_QNODES))
+		goto spin;
+
+	node = this_cpu_ptr(&MCS_NODE(idx));
+	tail = encode_tail(smp_processor_id(), idx);
+	node->locked = 0;
+	node->next = NULL;
+	node->pos = 0;
+
+	if (queue_spin_trylock(lock))
+		goto release;
+
+	old = xchg_tail(lock, tail);
+	prev = NULL;
+	if (old & _Q_TAIL_MASK) {
+		prev = decode_tail(old);
+		qnode_link_pos(node, prev);
+	}
+	trace_qspinlock_queued(lock, idx, prev ?
+			       (int)(old >> _Q_TAIL_CPU_OFFSET) - 1 : -1,
+			       node->pos);
+
+	if (prev) {
+		ACCESS_ONCE(prev->next) = node;
+
+		while (!smp_load_acquire(&node->locked)) {
+			/*
+			 * Abandon the node, unless the predecessor has made
+			 * us the head meanwhile.
+			 */
+			if (qtimeout_expired(start, cycles) &&
+			    !cmpxchg(&node->locked, 0, (int)tail)) {
+				qnode_set_bit(&qnode_abandoned, idx);
+				trace_qspinlock_timeout(lock);
+				return 0;
+			}
+			cpu_relax();
+		}
+	}
+
+	trace_qspinlock_head(lock);
+	while ((val = smp_load_acquire(&lock->val.counter)) &
+	       _Q_LOCKED_PENDING_MASK) {
+		if (qtimeout_expired(start, cycles)) {
+			next = queue_leave(lock, node, tail);
+			if (next)
+				queue_pass_head(lock, next);
+			qnode_put(idx);
+			trace_qspinlock_timeout(lock);
+			return 0;
+		}
+		cpu_relax();
+	}
+
+	/* Claim the lock, see queue_spin_lock_slowpath() */
+	for (;;) {
+		if (val != tail) {
+			set_locked(lock);
+			break;
+		}
+		old = atomic_cmpxchg(&lock->val, val, _Q_LOCKED_VAL);
+		if (old == val)
+			goto release;
+		val = old;
+	}
+
+	while (!(next = ACCESS_ONCE(node->next)))
+		cpu_relax();
+	queue_pass_head(lock, next);
+
+release:
+	qnode_put(idx);
+	trace_qspinlock_acquired(lock);
+	qowner_set(lock);
+	return 1;
+
+spin:
+	do {
+		if (queue_spin_trylock(lock)) {
+			trace_qspinlock_acquired(lock);
+			qowner_set(lock);
+			return 1;
+		}
+		cpu_relax();
+	} while (!qtimeout_expired(start, cycles));
+
+	trace_qspinlock_timeout(lock);
+	return 0;
+}
+EXPORT_SYMBOL(queue_spin_trylock_for_slowpath);
+
+#endif /* __LINUX_QSPINLOCK_TIMEOUT_H */
@@ -0,0 +1,233 @@
+/*
+ * Range locks, see include/linux/range_lock.h
+ *
+ * Every queued or granted range sits in an interval tree keyed by its
+ * address range.  When a range is queued it counts the conflicting ranges
+ * already in the tree and sleeps until that count drops to zero; when a
+ * range is released it decrements the count of every conflicting range
+ * queued after it and wakes those which are no longer blocked.
+ *
+ * This file is released under the GPL v2.
+ */
+#include <linux/range_lock.h>
+#include <linux/interval_tree_generic.h>
+#include <linux/sched.h>
+#include <linux/export.h>
+#include <linux/errno.h>
+
+static inline unsigned long range_lock_start(struct range_lock *lock)
+{
+	return lock->start;
+}
+
+static inline unsigned long range_lock_last(struct range_lock *lock)
+{
+	return lock->last;
+}
+
+INTERVAL_TREE_DEFINE(struct range_lock, node, unsigned long, __subtree_last,
+		     range_lock_start, range_lock_last, static, range_it)
+
+static inline bool range_conflict(struct range_lock *a, struct range_lock *b)
+{
+	return !a->reader || !b->reader;
+}
+
+#define range_for_each_overlap(it, tree, lock)				\
+	for (it = range_it_iter_first(&(tree)->root, (lock)->start,	\
+				      (lock)->last);			\
+	     it; it = range_it_iter_next(it, (lock)->start, (lock)->last))
+
+/*
+ * Take @lock out of the tree and let every conflicting range queued after
+ * it know that it no longer has to wait for @lock.
+ *
+ * Called with tree->lock held.
+ */
+static void __range_unlock(struct range_lock_tree *tree,
+			   struct range_lock *lock)
+{
+	struct range_lock *it;
+
+	range_it_remove(lock, &tree->root);
+
+	range_for_each_overlap(it, tree, lock) {
+		if (it->seq < lock->seq || !range_conflict(it, lock))
+			continue;
+		if (!--it->blocking)
+			wake_up_process(it->task);
+	}
+}
+
+static int __range_lock(struct range_lock_tree *tree, struct range_lock *lock,
+			bool reader, long state)
+{
+	struct range_lock *it;
+
+	might_sleep();
+
+	lock->reader = reader;
+	lock->blocking = 0;
+	lock->task = current;
+
+	spin_lock(&tree->lock);
+	lock->seq = tree->seq++;
+	range_for_each_overlap(it, tree, lock) {
+		if (range_conflict(it, lock))
+			lock->blocking++;
+	}
+	range_it_insert(lock, &tree->root);
+	spin_unlock(&tree->lock);
+
+	for (;;) {
+		set_current_state(state);
+		if (!ACCESS_ONCE(lock->blocking))
+			break;
+
+		if (unlikely(signal_pending_state(state, current))) {
+			int ret = 0;
+
+			spin_lock(&tree->lock);
+			/* We may have been granted the range meanwhile */
+			if (lock->blocking) {
+				__range_unlock(tree, lock);
+				ret = -EINTR;
+			}
+			spin_unlock(&tree->lock);
+			__set_current_state(TASK_RUNNING);
+			return ret;
+		}
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int __range_trylock(struct range_lock_tree *tree,
+			   struct range_lock *lock, bool reader)
+{
+	struct range_lock *it;
+	int ret = 0;
+
+	lock->reader = reader;
+	lock->blocking = 0;
+	lock->task = current;
+
+	spin_lock(&tree->lock);
+	range_for_each_overlap(it, tree, lock) {
+		if (range_conflict(it, lock))
+			goto out;
+	}
+	lock->seq = tree->seq++;
+	range_it_insert(lock, &tree->root);
+	ret = 1;
+out:
+	spin_unlock(&tree->lock);
+	return ret;
+}
+
+static void range_unlock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	spin_lock(&tree->lock);
+	__range_unlock(tree, lock);
+	spin_unlock(&tree->lock);
+}
+
+/**
+ * range_read_lock - lock a range for reading
+ * @tree: the tree of ranges to lock in
+ * @lock: the range, initialised with range_lock_init()
+ *
+ * Sleeps until no writer holds or waits for an overlapping range that
+ * was queued before @lock.
+ */
+void range_read_lock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	__range_lock(tree, lock, true, TASK_UNINTERRUPTIBLE);
+}
+EXPORT_SYMBOL_GPL(range_read_lock);
+
+/**
+ * range_read_lock_killable - lock a range for reading unless killed
+ * @tree: the tree of ranges to lock in
+ * @lock: the range, initialised with range_lock_init()
+ *
+ * Returns 0 once the range is locked, or -EINTR if a fatal signal
+ * arrived while waiting, in which case the range is not locked.
+ */
+int range_read_lock_killable(struct range_lock_tree *tree,
+			     struct range_lock *lock)
+{
+	return __range_lock(tree, lock, true, TASK_KILLABLE);
+}
+EXPORT_SYMBOL_GPL(range_read_lock_killable);
+
+/**
+ * range_read_trylock - try to lock a range for reading
+ * @tree: the tree of ranges to lock in
+ * @lock: the range, initialised with range_lock_init()
+ *
+ * Returns 1 if the range was locked, 0 if an overlapping writer is
+ * queued.
+ */
+int range_read_trylock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	return __range_trylock(tree, lock, true);
+}
+EXPORT_SYMBOL_GPL(range_read_trylock);
+
+void range_read_unlock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	range_unlock(tree, lock);
+}
+EXPORT_SYMBOL_GPL(range_read_unlock);
+
+/**
+ * range_write_lock - lock a range for writing
+ * @tree: the tree of ranges to lock in
+ * @lock: the range, initialised with range_lock_init()
+ *
+ * Sleeps until no overlapping range queued before @lock is held or
+ * waited for.
+ */
+void range_write_lock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	__range_lock(tree, lock, false, TASK_UNINTERRUPTIBLE);
+}
+EXPORT_SYMBOL_GPL(range_write_lock);
+
+/**
+ * range_write_lock_killable - lock a range for writing unless killed
+ * @tree: the tree of ranges to lock in
+ * @lock: the range, initialised with range_lock_init()
+ *
+ * Returns 0 once the range is locked, or -EINTR if a fatal signal
+ * arrived while waiting, in which case the range is not locked.
+ */
+int range_write_lock_killable(struct range_lock_tree *tree,
+			      struct range_lock *lock)
+{
+	return __range_lock(tree, lock, false, TASK_KILLABLE);
+}
+EXPORT_SYMBOL_GPL(range_write_lock_killable);
+
+/**
+ * range_write_trylock - try to lock a range for writing
+ * @tree: the tree of ranges to lock in
+ * @lock: the range, initialised with range_lock_init()
+ *
+ * Returns 1 if the range was locked, 0 if any overlapping range is
+ * queued.
+ */
+int range_write_trylock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	return __range_trylock(tree, lock, false);
+}
+EXPORT_SYMBOL_GPL(range_write_trylock);
+
+void range_write_unlock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	range_unlock(tree, lock);
+}
+EXPORT_SYMBOL_GPL(range_write_unlock);
@@ -384,6 +384,7 @@ static inline struct rt_mutex *task_blocked_on_lock(struct task_struct *p)
  *	again:
  *	  loop_sanity_check();
  *	retry:
+ * [0]	  check_exit_conditions_0();		[R]
  * [1]	  lock(task->pi_lock);			[R] acquire [P]
  * [2]	  waiter = task->pi_blocked_on;		[P]
  * [3]	  check_exit_conditions_1();		[P]
@@ -458,6 +459,25 @@ static int rt_mutex_adjust_prio_chain(struct task_struct *task,
 	 * locks.
 	 */
  retry:
+	/*
+	 * [0] Peek at the exit conditions which can be checked without
+	 * holding any lock, so that a chain which ended or changed
+	 * while we dropped the locks is left without taking
+	 * task->pi_lock, and without another round of wait_lock
+	 * trylocks after a failed one in [5].
+	 *
+	 * @task is pinned by our refcount and @orig_lock by @top_task
+	 * being blocked on it, so both can be read. If @task blocks
+	 * again right after we saw it unblocked, it enqueues its
+	 * waiter with the priority we already propagated to it, and
+	 * walks the new chain itself. The checks are redone under
+	 * the locks in [3], so a stale non-NULL value is harmless.
+	 */
+	if (!ACCESS_ONCE(task->pi_blocked_on))
+		goto out_put_task;
+	if (orig_waiter && !rt_mutex_owner(orig_lock))
+		goto out_put_task;
+
 	/*
 	 * [1] Task cannot go away as we did a get_task() before !
 	 */
@@ -116,9 +116,12 @@ enum rwsem_wake_type {
  * - the spinlock must be held by the caller
  * - woken process blocks are discarded from the list after having task zeroed
  * - writers are only woken if downgrading is false
+ * - the tasks are queued on wake_q, to be woken up once the spinlock is
+ *   released
  */
 static struct rw_semaphore *
-__rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
+__rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type,
+		struct wake_q_head *wake_q)
 {
 	struct rwsem_waiter *waiter;
 	struct task_struct *tsk;
@@ -133,7 +136,7 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 			 * to be able to steal it.  Readers, on the other hand,
 			 * will block as they will notice the queued writer.
 			 */
-			wake_up_process(waiter->task);
+			wake_q_add(wake_q, waiter->task);
 		goto out;
 	}
 
@@ -186,9 +189,14 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 		waiter = list_entry(next, struct rwsem_waiter, list);
 		next = waiter->list.next;
 		tsk = waiter->task;
+		/*
+		 * The wake-queue holds its own reference on the task, which
+		 * may return from rwsem_down_read_failed() as soon as it sees
+		 * the cleared waiter->task, before the wakeup.
+		 */
+		wake_q_add(wake_q, tsk);
 		smp_mb();
 		waiter->task = NULL;
-		wake_up_process(tsk);
 		put_task_struct(tsk);
 	} while (--loop);
 
@@ -199,6 +207,8 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 	return sem;
 }
 
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool writer);
+
 /*
  * Wait for the read lock to be granted
  */
@@ -208,6 +218,25 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
+	bool first;
+	WAKE_Q(wake_q);
+
+	/*
+	 * Spin for the lock if it is owned by a running writer. The read
+	 * bias is dropped first so as not to hold up the writers. If that
+	 * leaves no active lockers, go straight to the wait queue which
+	 * will do the wakeup that the last unlocker may have skipped
+	 * because of our bias.
+	 */
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	if (ACCESS_ONCE(sem->owner)) {
+		count = rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+		adjustment = 0;
+		if ((count & RWSEM_ACTIVE_MASK) &&
+		    rwsem_optimistic_spin(sem, false))
+			return sem;
+	}
+#endif
 
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
@@ -215,7 +244,8 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	get_task_struct(tsk);
 
 	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
+	first = list_empty(&sem->wait_list);
+	if (first)
 		adjustment += RWSEM_WAITING_BIAS;
 	list_add_tail(&waiter.list, &sem->wait_list);
 
@@ -228,13 +258,15 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	 * wake our own waiter to join the existing active readers !
 	 */
 	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
+	    (count > RWSEM_WAITING_BIAS && first))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
+	wake_up_q(&wake_q);
 
 	/* wait to be given the lock */
+	if (waiter.task)
+		lock_slept(&sem->dep_map);
 	while (true) {
 		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 		if (!waiter.task)
@@ -285,7 +317,34 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
-static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+/*
+ * Try to acquire the read lock before the reader has been put on the wait
+ * queue. It is only done when there is neither a writer nor a waiter so
+ * that the spinning readers don't jump the queue.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+	return false;
+}
+
+/*
+ * The readers don't record themselves as owner, so a writer that finds no
+ * owner may be facing a reader owned lock that it can't tell when will be
+ * released. It only spins on it for a bounded number of loops.
+ */
+#define RWSEM_READER_SPIN_LOOPS	1024
+
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem,
+					   bool writer)
 {
 	struct task_struct *owner;
 	bool on_cpu = false;
@@ -296,15 +355,16 @@ static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 	rcu_read_lock();
 	owner = ACCESS_ONCE(sem->owner);
 	if (owner)
-		on_cpu = owner->on_cpu;
+		on_cpu = owner->on_cpu && !vcpu_is_preempted(task_cpu(owner));
 	rcu_read_unlock();
 
 	/*
 	 * If sem->owner is not set, yet we have just recently entered the
 	 * slowpath, then there is a possibility reader(s) may have the lock.
-	 * To be safe, avoid spinning in these situations.
+	 * Only the writers spin in this case, for a bounded time, as the
+	 * readers would just join the queue behind the writers anyway.
 	 */
-	return on_cpu;
+	return owner ? on_cpu : writer;
 }
 
 static inline bool owner_running(struct rw_semaphore *sem,
@@ -321,7 +381,7 @@ static inline bool owner_running(struct rw_semaphore *sem,
 	 */
 	barrier();
 
-	return owner->on_cpu;
+	return owner->on_cpu && !vcpu_is_preempted(task_cpu(owner));
 }
 
 static noinline
@@ -344,15 +404,20 @@ bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
 	return sem->owner == NULL;
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+/*
+ * Spin for the read (@writer false) or the write lock while the owner is
+ * running. The readers only spin on a writer owner.
+ */
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool writer)
 {
 	struct task_struct *owner;
+	int loops = 0;
 	bool taken = false;
 
 	preempt_disable();
 
 	/* sem->wait_lock should not be held when doing optimistic spinning */
-	if (!rwsem_can_spin_on_owner(sem))
+	if (!rwsem_can_spin_on_owner(sem, writer))
 		goto done;
 
 	if (!osq_lock(&sem->osq))
@@ -364,7 +429,8 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 			break;
 
 		/* wait_lock will be acquired if write_lock is obtained */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (writer ? rwsem_try_write_lock_unqueued(sem)
+			   : rwsem_try_read_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
@@ -373,9 +439,11 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
 		 * we're an RT task that will live-lock because we won't let
-		 * the owner complete.
+		 * the owner complete. The lock may also be reader owned, so
+		 * the spinning is bounded.
 		 */
-		if (!owner && (need_resched() || rt_task(current)))
+		if (!owner && (!writer || need_resched() || rt_task(current) ||
+			       ++loops > RWSEM_READER_SPIN_LOOPS))
 			break;
 
 		/*
@@ -393,7 +461,7 @@ done:
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool writer)
 {
 	return false;
 }
@@ -407,13 +475,14 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 {
 	long count;
 	bool waiting = true; /* any queued threads before us */
+	bool slept = false;
 	struct rwsem_waiter waiter;
 
 	/* undo write bias from down_write operation, stop active locking */
 	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, true))
 		return sem;
 
 	/*
@@ -440,8 +509,17 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 		 * no active writers, the lock must be read owned; so we try to
 		 * wake any read locks that were queued ahead of us.
 		 */
-		if (count > RWSEM_WAITING_BIAS)
-			sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS);
+		if (count > RWSEM_WAITING_BIAS) {
+			WAKE_Q(wake_q);
+
+			sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS, &wake_q);
+			/*
+			 * Wake them up right away rather than after dropping
+			 * the wait_lock, which is only released to sleep
+			 * once the write lock attempt below has failed.
+			 */
+			wake_up_q(&wake_q);
+		}
 
 	} else
 		count = rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
@@ -453,6 +531,11 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 			break;
 		raw_spin_unlock_irq(&sem->wait_lock);
 
+		if (!slept) {
+			slept = true;
+			lock_slept(&sem->dep_map);
+		}
+
 		/* Block until there are no active lockers. */
 		do {
 			schedule();
@@ -478,14 +561,16 @@ __visible
 struct rw_semaphore *rwsem_wake(struct rw_semaphore *sem)
 {
 	unsigned long flags;
+	WAKE_Q(wake_q);
 
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 
 	raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
+	wake_up_q(&wake_q);
 
 	return sem;
 }
@@ -500,14 +585,16 @@ __visible
 struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem)
 {
 	unsigned long flags;
+	WAKE_Q(wake_q);
 
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED, &wake_q);
 
 	raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
+	wake_up_q(&wake_q);
 
 	return sem;
 }
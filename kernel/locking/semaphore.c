@@ -13,31 +13,105 @@
 /*
  * Some notes on the implementation:
  *
- * The spinlock controls access to the other members of the semaphore.
- * down_trylock() and up() can be called from interrupt context, so we
- * have to disable interrupts when taking the lock.  It turns out various
- * parts of the kernel expect to be able to use down() on a semaphore in
- * interrupt context when they know it will succeed, so we have to use
- * irqsave variants for down(), down_interruptible() and down_killable()
- * too.
- *
  * The ->count variable represents how many more tasks can acquire this
- * semaphore.  If it's zero, there may be tasks waiting on the wait_list.
+ * semaphore.  It never goes negative: down() decrements it with cmpxchg
+ * as long as it is positive, and up() increments it, both without taking
+ * the spinlock.  down_trylock() and up() can be called from interrupt
+ * context, and various parts of the kernel expect to be able to use
+ * down() on a semaphore in interrupt context when they know it will
+ * succeed, which the lockless fast paths allow.
+ *
+ * The spinlock protects the wait_list, and is only taken when the count
+ * is zero.  It has to be taken with interrupts disabled as up() takes it
+ * when there are waiters.  A waiter adds itself to the wait_list before
+ * checking the count one last time, and up() checks the wait_list after
+ * incrementing the count, with a full barrier on both sides: either the
+ * waiter sees the new count or up() sees the waiter and hands the count
+ * over to the first waiter under the spinlock.
+ *
+ * With CONFIG_SEMAPHORE_SPIN, a task finding the count at zero first
+ * spins for a bit waiting for an up(), one spinner at a time.
  */
 
 #include <linux/compiler.h>
 #include <linux/kernel.h>
 #include <linux/export.h>
 #include <linux/sched.h>
+#include <linux/sched/rt.h>
 #include <linux/semaphore.h>
 #include <linux/spinlock.h>
 #include <linux/ftrace.h>
 
+#include "mcs_spinlock.h"
+
 static noinline void __down(struct semaphore *sem);
 static noinline int __down_interruptible(struct semaphore *sem);
 static noinline int __down_killable(struct semaphore *sem);
 static noinline int __down_timeout(struct semaphore *sem, long timeout);
-static noinline void __up(struct semaphore *sem);
+static noinline void __up(struct semaphore *sem,
+			   struct wake_q_head *wake_q);
+
+/*
+ * Take one from the count unless it is zero, returns true on success
+ */
+static inline bool sem_try_dec(struct semaphore *sem)
+{
+	int count = atomic_read(&sem->count);
+
+	while (count > 0) {
+		int old = atomic_cmpxchg(&sem->count, count, count - 1);
+
+		if (old == count)
+			return true;
+		count = old;
+	}
+	return false;
+}
+
+#ifdef CONFIG_SEMAPHORE_SPIN
+/*
+ * Number of cpu_relax() iterations a spinner waits for the count to
+ * become positive before going to sleep, as there is no owner to tell
+ * whether the semaphore is going to be released soon
+ */
+#define SEM_SPIN_LOOPS	(1 << 10)
+
+/*
+ * Returns true when the semaphore was acquired while spinning
+ */
+static bool sem_optimistic_spin(struct semaphore *sem)
+{
+	bool taken = false;
+	int loops;
+
+	if (in_interrupt() || irqs_disabled())
+		return false;
+
+	preempt_disable();
+	if (!osq_lock(&sem->osq))
+		goto done;
+
+	for (loops = 0; loops < SEM_SPIN_LOOPS; loops++) {
+		if (sem_try_dec(sem)) {
+			taken = true;
+			break;
+		}
+		/* Leave the CPU to whoever is going to call up() */
+		if (need_resched() || rt_task(current))
+			break;
+		cpu_relax_lowlatency();
+	}
+	osq_unlock(&sem->osq);
+done:
+	preempt_enable();
+	return taken;
+}
+#else
+static inline bool sem_optimistic_spin(struct semaphore *sem)
+{
+	return false;
+}
+#endif
 
 /**
  * down - acquire the semaphore
@@ -54,11 +128,11 @@ void down(struct semaphore *sem)
 {
 	unsigned long flags;
 
+	if (likely(sem_try_dec(sem)) || sem_optimistic_spin(sem))
+		return;
+
 	raw_spin_lock_irqsave(&sem->lock, flags);
-	if (likely(sem->count > 0))
-		sem->count--;
-	else
-		__down(sem);
+	__down(sem);
 	raw_spin_unlock_irqrestore(&sem->lock, flags);
 }
 EXPORT_SYMBOL(down);
@@ -75,13 +149,13 @@ EXPORT_SYMBOL(down);
 int down_interruptible(struct semaphore *sem)
 {
 	unsigned long flags;
-	int result = 0;
+	int result;
+
+	if (likely(sem_try_dec(sem)) || sem_optimistic_spin(sem))
+		return 0;
 
 	raw_spin_lock_irqsave(&sem->lock, flags);
-	if (likely(sem->count > 0))
-		sem->count--;
-	else
-		result = __down_interruptible(sem);
+	result = __down_interruptible(sem);
 	raw_spin_unlock_irqrestore(&sem->lock, flags);
 
 	return result;
@@ -101,13 +175,13 @@ EXPORT_SYMBOL(down_interruptible);
 int down_killable(struct semaphore *sem)
 {
 	unsigned long flags;
-	int result = 0;
+	int result;
+
+	if (likely(sem_try_dec(sem)) || sem_optimistic_spin(sem))
+		return 0;
 
 	raw_spin_lock_irqsave(&sem->lock, flags);
-	if (likely(sem->count > 0))
-		sem->count--;
-	else
-		result = __down_killable(sem);
+	result = __down_killable(sem);
 	raw_spin_unlock_irqrestore(&sem->lock, flags);
 
 	return result;
@@ -129,16 +203,7 @@ EXPORT_SYMBOL(down_killable);
  */
 int down_trylock(struct semaphore *sem)
 {
-	unsigned long flags;
-	int count;
-
-	raw_spin_lock_irqsave(&sem->lock, flags);
-	count = sem->count - 1;
-	if (likely(count >= 0))
-		sem->count = count;
-	raw_spin_unlock_irqrestore(&sem->lock, flags);
-
-	return (count < 0);
+	return !sem_try_dec(sem);
 }
 EXPORT_SYMBOL(down_trylock);
 
@@ -155,13 +220,13 @@ EXPORT_SYMBOL(down_trylock);
 int down_timeout(struct semaphore *sem, long timeout)
 {
 	unsigned long flags;
-	int result = 0;
+	int result;
+
+	if (likely(sem_try_dec(sem)) || sem_optimistic_spin(sem))
+		return 0;
 
 	raw_spin_lock_irqsave(&sem->lock, flags);
-	if (likely(sem->count > 0))
-		sem->count--;
-	else
-		result = __down_timeout(sem, timeout);
+	result = __down_timeout(sem, timeout);
 	raw_spin_unlock_irqrestore(&sem->lock, flags);
 
 	return result;
@@ -178,13 +243,18 @@ EXPORT_SYMBOL(down_timeout);
 void up(struct semaphore *sem)
 {
 	unsigned long flags;
+	WAKE_Q(wake_q);
 
-	raw_spin_lock_irqsave(&sem->lock, flags);
+	atomic_inc(&sem->count);
+	/* Pairs with the barrier in __down_common() */
+	smp_mb__after_atomic();
 	if (likely(list_empty(&sem->wait_list)))
-		sem->count++;
-	else
-		__up(sem);
+		return;
+
+	raw_spin_lock_irqsave(&sem->lock, flags);
+	__up(sem, &wake_q);
 	raw_spin_unlock_irqrestore(&sem->lock, flags);
+	wake_up_q(&wake_q);
 }
 EXPORT_SYMBOL(up);
 
@@ -210,8 +280,14 @@ static inline int __sched __down_common(struct semaphore *sem, long state,
 	list_add_tail(&waiter.list, &sem->wait_list);
 	waiter.task = task;
 	waiter.up = false;
+	/* Pairs with the barrier in up(), see the notes at the top */
+	smp_mb();
 
 	for (;;) {
+		if (sem_try_dec(sem)) {
+			list_del(&waiter.list);
+			return 0;
+		}
 		if (signal_pending_state(state, task))
 			goto interrupted;
 		if (unlikely(timeout <= 0))
@@ -253,11 +329,23 @@ static noinline int __sched __down_timeout(struct semaphore *sem, long timeout)
 	return __down_common(sem, TASK_UNINTERRUPTIBLE, timeout);
 }
 
-static noinline void __sched __up(struct semaphore *sem)
+/*
+ * Hand the count over to the first waiter, unless it has already been
+ * taken by someone else, or there is no longer any waiter. The waiter
+ * only checks waiter->up under the spinlock, so it is woken up once the
+ * spinlock is released.
+ */
+static noinline void __sched __up(struct semaphore *sem,
+				  struct wake_q_head *wake_q)
 {
-	struct semaphore_waiter *waiter = list_first_entry(&sem->wait_list,
-						struct semaphore_waiter, list);
+	struct semaphore_waiter *waiter;
+
+	if (list_empty(&sem->wait_list) || !sem_try_dec(sem))
+		return;
+
+	waiter = list_first_entry(&sem->wait_list,
+				  struct semaphore_waiter, list);
 	list_del(&waiter->list);
 	waiter->up = true;
-	wake_up_process(waiter->task);
+	wake_q_add(wake_q, waiter->task);
 }
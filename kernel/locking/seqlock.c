@@ -0,0 +1,99 @@
+/*
+ * Call site accounting of the adaptive seqlock readers, see
+ * include/linux/seqlock.h
+ *
+ * A site is put on the list of the sites the first time one of its reads
+ * retries, and stays there. The decaying average of the retries is updated
+ * without atomics: two reads racing on it lose one of the updates, which
+ * only delays the adaptation by a read.
+ *
+ * This file is released under the GPL v2.
+ */
+#include <linux/seqlock.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/seq_file.h>
+
+static struct seqlock_site *seqlock_sites;
+
+static void seqlock_site_register(struct seqlock_site *site)
+{
+	struct seqlock_site *first;
+
+	if (ACCESS_ONCE(site->registered) || xchg(&site->registered, 1))
+		return;
+	do {
+		first = ACCESS_ONCE(seqlock_sites);
+		site->next = first;
+	} while (cmpxchg(&seqlock_sites, first, site) != first);
+}
+
+/*
+ * Called by done_seqretry_adaptive() for the reads that retried, and for all
+ * the reads of the site while its average isn't back to zero. A read that
+ * took the lock counts as SEQLOCK_READ_MAX_RETRIES retries, so that the site
+ * keeps taking the lock at the first retry until its reads mostly succeed
+ * again.
+ */
+void seqlock_site_account(struct seqlock_site *site, struct seqlock_read *sr)
+{
+	unsigned int rate = ACCESS_ONCE(site->rate);
+	unsigned int retries = sr->retries;
+
+	if (seqlock_read_locked(sr)) {
+		retries = SEQLOCK_READ_MAX_RETRIES;
+		atomic_long_inc(&site->locked);
+	}
+	if (sr->retries) {
+		seqlock_site_register(site);
+		atomic_long_inc(&site->retried);
+		atomic_long_add(sr->retries, &site->retries);
+	}
+
+	/* Round the decay up, for the average to get back to zero */
+	rate -= (rate + (1 << SEQLOCK_RATE_SHIFT) - 1) >> SEQLOCK_RATE_SHIFT;
+	ACCESS_ONCE(site->rate) = rate + retries;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int seqlock_sites_show(struct seq_file *m, void *v)
+{
+	struct seqlock_site *site;
+
+	seq_puts(m, "site retried retries locked rate\n");
+	for (site = ACCESS_ONCE(seqlock_sites); site; site = site->next) {
+		unsigned int rate = ACCESS_ONCE(site->rate);
+
+		seq_printf(m, "%s:%d %ld %ld %ld %u.%02u\n",
+			   site->func, site->line,
+			   atomic_long_read(&site->retried),
+			   atomic_long_read(&site->retries),
+			   atomic_long_read(&site->locked),
+			   rate >> SEQLOCK_RATE_SHIFT,
+			   (rate & ((1 << SEQLOCK_RATE_SHIFT) - 1)) * 100 >>
+			   SEQLOCK_RATE_SHIFT);
+	}
+	return 0;
+}
+
+static int seqlock_sites_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, seqlock_sites_show, NULL);
+}
+
+static const struct file_operations seqlock_sites_fops = {
+	.open		= seqlock_sites_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init seqlock_debugfs_init(void)
+{
+	if (!debugfs_create_file("seqlock_sites", 0444, NULL, NULL,
+				 &seqlock_sites_fops))
+		return -ENOMEM;
+	return 0;
+}
+fs_initcall(seqlock_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
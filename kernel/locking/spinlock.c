@@ -20,6 +20,7 @@
 #include <linux/interrupt.h>
 #include <linux/debug_locks.h>
 #include <linux/export.h>
+#include <linux/timex.h>
 
 /*
  * If lockdep is enabled then we use the non-preemption spin-ops
@@ -122,8 +123,14 @@ void __lockfunc __raw_##op##_lock_bh(locktype##_t *lock)		\
  *         __[spin|read|write]_lock_irq()
  *         __[spin|read|write]_lock_irqsave()
  *         __[spin|read|write]_lock_bh()
+ *
+ * Queue spinlocks keep the queued __spin_lock*() from
+ * spinlock_api_smp.h: a trylock loop would bypass the MCS queue, and
+ * spin_is_contended() reads the queue tail instead of ->break_lock.
  */
+#ifdef CONFIG_SPIN_LOCKBREAK
 BUILD_LOCK_OPS(spin, raw_spinlock);
+#endif
 BUILD_LOCK_OPS(read, rwlock);
 BUILD_LOCK_OPS(write, rwlock);
 
@@ -145,6 +152,54 @@ int __lockfunc _raw_spin_trylock_bh(raw_spinlock_t *lock)
 EXPORT_SYMBOL(_raw_spin_trylock_bh);
 #endif
 
+int __lockfunc _raw_spin_lock_timeout(raw_spinlock_t *lock, u64 cycles)
+{
+	return __raw_spin_lock_timeout(lock, cycles);
+}
+EXPORT_SYMBOL(_raw_spin_lock_timeout);
+
+/*
+ * Take the lock of lower address first, but don't wait for the other one
+ * while holding it: if that one is busy, wait for it alone in its queue
+ * and try to add the first one then. Only when both attempts fail do we
+ * wait for the second lock with the first one held.
+ */
+void __lockfunc _raw_spin_lock_pair(raw_spinlock_t *l1, raw_spinlock_t *l2)
+{
+	if (l1 > l2)
+		swap(l1, l2);
+
+	raw_spin_lock(l1);
+	if (likely(raw_spin_trylock(l2)))
+		return;
+	raw_spin_unlock(l1);
+
+	raw_spin_lock(l2);
+	if (raw_spin_trylock(l1))
+		return;
+	raw_spin_unlock(l2);
+
+	raw_spin_lock(l1);
+	raw_spin_lock_nested(l2, SINGLE_DEPTH_NESTING);
+}
+EXPORT_SYMBOL(_raw_spin_lock_pair);
+
+#ifdef GENERIC_SPIN_TRYLOCK_FOR
+int generic_spin_trylock_for(arch_spinlock_t *lock, u64 cycles)
+{
+	cycles_t start = get_cycles();
+
+	do {
+		if (arch_spin_trylock(lock))
+			return 1;
+		cpu_relax();
+	} while ((u64)(get_cycles() - start) < cycles);
+
+	return 0;
+}
+EXPORT_SYMBOL(generic_spin_trylock_for);
+#endif
+
 #ifndef CONFIG_INLINE_SPIN_LOCK
 void __lockfunc _raw_spin_lock(raw_spinlock_t *lock)
 {
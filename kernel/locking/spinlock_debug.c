@@ -103,6 +103,20 @@ static inline void debug_spin_unlock(raw_spinlock_t *lock)
 	lock->owner_cpu = -1;
 }
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+/*
+ * A trylock loop would bypass the queue and make the queue spinlocks
+ * unfair, with nothing like their contention behaviour, so they are
+ * taken through their queue like without the lock debugging. The lockups
+ * are left to the hard and soft lockup detectors.
+ */
+void do_raw_spin_lock(raw_spinlock_t *lock)
+{
+	debug_spin_lock_before(lock);
+	arch_spin_lock(&lock->raw_lock);
+	debug_spin_lock_after(lock);
+}
+#else
 static void __spin_lock_debug(raw_spinlock_t *lock)
 {
 	u64 i;
@@ -137,6 +151,7 @@ void do_raw_spin_lock(raw_spinlock_t *lock)
 		__spin_lock_debug(lock);
 	debug_spin_lock_after(lock);
 }
+#endif
 
 int do_raw_spin_trylock(raw_spinlock_t *lock)
 {
@@ -153,6 +168,17 @@ int do_raw_spin_trylock(raw_spinlock_t *lock)
 	return ret;
 }
 
+int do_raw_spin_lock_timeout(raw_spinlock_t *lock, u64 cycles)
+{
+	int ret;
+
+	debug_spin_lock_before(lock);
+	ret = arch_spin_trylock_for(&lock->raw_lock, cycles);
+	if (ret)
+		debug_spin_lock_after(lock);
+	return ret;
+}
+
 void do_raw_spin_unlock(raw_spinlock_t *lock)
 {
 	debug_spin_unlock(lock);
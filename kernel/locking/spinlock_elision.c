@@ -0,0 +1,171 @@
+/*
+ * Elided spinlock
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The transactional part of elided_spin_lock(), see elided_spinlock.h.
+ *
+ * The abort statistics are per-cpu counts, read from the spin_elision
+ * debugfs file. They are only updated outside of the transactions, so
+ * that they don't add to their write sets.
+ */
+#include <linux/debugfs.h>
+#include <linux/elided_spinlock.h>
+#include <linux/export.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <asm/rtm.h>
+
+/*
+ * The number of transaction attempts when the aborts can be retried and
+ * the number of acquisitions without elision after a failed one.
+ */
+#define ELISION_RETRIES		3
+#define ELISION_SKIP		64
+
+/* Explicit abort code of a transaction that found the lock held */
+#define ELISION_LOCK_BUSY	0xff
+
+enum elision_stat {
+	ELISION_STARTED,	/* Transactions started		*/
+	ELISION_COMMITTED,	/* Transactions committed	*/
+	ELISION_ABORT_BUSY,	/* Aborted, lock held		*/
+	ELISION_ABORT_CONFLICT,	/* Aborted on a data conflict	*/
+	ELISION_ABORT_CAPACITY,	/* Aborted, too large		*/
+	ELISION_ABORT_OTHER,	/* Aborted, other reasons	*/
+	ELISION_SKIPPED,	/* Not tried after a failure	*/
+	ELISION_NR_STATS
+};
+
+static const char * const elision_stat_names[ELISION_NR_STATS] = {
+	[ELISION_STARTED]	 = "started",
+	[ELISION_COMMITTED]	 = "committed",
+	[ELISION_ABORT_BUSY]	 = "abort_busy",
+	[ELISION_ABORT_CONFLICT] = "abort_conflict",
+	[ELISION_ABORT_CAPACITY] = "abort_capacity",
+	[ELISION_ABORT_OTHER]	 = "abort_other",
+	[ELISION_SKIPPED]	 = "skipped",
+};
+
+static DEFINE_PER_CPU(unsigned long [ELISION_NR_STATS], elision_stats);
+
+static void elision_count_abort(unsigned int status)
+{
+	enum elision_stat stat;
+
+	if ((status & _XABORT_EXPLICIT) &&
+	    _XABORT_CODE(status) == ELISION_LOCK_BUSY)
+		stat = ELISION_ABORT_BUSY;
+	else if (status & _XABORT_CONFLICT)
+		stat = ELISION_ABORT_CONFLICT;
+	else if (status & _XABORT_CAPACITY)
+		stat = ELISION_ABORT_CAPACITY;
+	else
+		stat = ELISION_ABORT_OTHER;
+	this_cpu_inc(elision_stats[stat]);
+}
+
+/**
+ * __elided_spin_begin - start an elided critical section
+ * @lock: Pointer to the elided spinlock
+ * Return: true if running as a transaction, false if the lock has to be
+ *	   taken
+ *
+ * Called with preemption disabled. A lock found held isn't retried as
+ * its holder isn't going away soon, the caller queues up for it instead.
+ */
+bool __elided_spin_begin(elided_spinlock_t *lock)
+{
+	unsigned int status;
+	int retries;
+
+	if (!arch_has_rtm())
+		return false;
+
+	if (unlikely(ACCESS_ONCE(lock->skip))) {
+		ACCESS_ONCE(lock->skip)--;
+		this_cpu_inc(elision_stats[ELISION_SKIPPED]);
+		return false;
+	}
+
+	for (retries = 0; retries < ELISION_RETRIES; retries++) {
+		this_cpu_inc(elision_stats[ELISION_STARTED]);
+		status = rtm_xbegin();
+		if (status == _XBEGIN_STARTED) {
+			if (!spin_is_locked(&lock->lock))
+				return true;
+			rtm_xabort(ELISION_LOCK_BUSY);
+		}
+
+		elision_count_abort(status);
+		if (!(status & _XABORT_RETRY) || (status & _XABORT_EXPLICIT))
+			break;
+	}
+
+	ACCESS_ONCE(lock->skip) = ELISION_SKIP;
+	return false;
+}
+EXPORT_SYMBOL(__elided_spin_begin);
+
+/**
+ * __elided_spin_end - commit an elided critical section
+ */
+void __elided_spin_end(void)
+{
+	rtm_xend();
+	this_cpu_inc(elision_stats[ELISION_COMMITTED]);
+}
+EXPORT_SYMBOL(__elided_spin_end);
+
+static int elision_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long sum[ELISION_NR_STATS] = { 0 };
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		for (i = 0; i < ELISION_NR_STATS; i++)
+			sum[i] += per_cpu(elision_stats, cpu)[i];
+	}
+	for (i = 0; i < ELISION_NR_STATS; i++)
+		seq_printf(m, "%-16s %lu\n", elision_stat_names[i], sum[i]);
+	if (sum[ELISION_STARTED]) {
+		unsigned long committed = min(sum[ELISION_COMMITTED],
+					      sum[ELISION_STARTED]);
+
+		seq_printf(m, "%-16s %lu%%\n", "abort_rate",
+			   100 - committed * 100 / sum[ELISION_STARTED]);
+	}
+	return 0;
+}
+
+static int elision_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, elision_stats_show, NULL);
+}
+
+static const struct file_operations elision_stats_fops = {
+	.open		= elision_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init elision_debugfs_init(void)
+{
+	if (!arch_has_rtm())
+		return 0;
+	if (!debugfs_create_file("spin_elision", 0400, NULL, NULL,
+				 &elision_stats_fops))
+		return -ENOMEM;
+	return 0;
+}
+fs_initcall(elision_debugfs_init);
@@ -0,0 +1,173 @@
+#ifndef __LINUX_WAIT_STAT_H
+#define __LINUX_WAIT_STAT_H
+
+/*
+ *	Lock Wait Statistics
+ *
+ * The per-cpu wait statistics shared by the lock types. Each lock type has
+ * a table of the paths through which a waiter finally gets the lock, and
+ * keeps per cpu a count, the total & maximum wait times and a log2
+ * histogram of the wait time in ns for each of them. A path may also just
+ * be counted, without a wait time.
+ *
+ * The lock type defines its statistics with DEFINE_WSTAT() from its table
+ * of path names, and creates its debugfs directory with
+ * wstat_debugfs_init():
+ *  reset - write anything to clear the statistics
+ *  stats - the per path counts, wait times & histograms
+ */
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+
+#define WSTAT_HISTO_BUCKETS	40
+
+struct wstat_path {
+	unsigned long	count;
+	u64		wait_ns;
+	u64		max_ns;
+	u32		histo[WSTAT_HISTO_BUCKETS];
+};
+
+struct wstat {
+	struct wstat_path __percpu	*paths;
+	const char * const		*names;
+	int				nr_paths;
+};
+
+#define DEFINE_WSTAT(name, path_names)					\
+	static DEFINE_PER_CPU(struct wstat_path,			\
+			      name ## _paths[ARRAY_SIZE(path_names)]);	\
+	static struct wstat name = {					\
+		.paths	  = name ## _paths,				\
+		.names	  = path_names,					\
+		.nr_paths = ARRAY_SIZE(path_names),			\
+	}
+
+/**
+ * wstat_count - count a path without a wait time
+ * @ws  : Pointer to the statistics of the lock type
+ * @path: The path taken
+ */
+static __always_inline void wstat_count(struct wstat *ws, int path)
+{
+	this_cpu_inc(ws->paths[path].count);
+}
+
+/**
+ * wstat_wait - account for a lock acquisition that had to wait
+ * @ws   : Pointer to the statistics of the lock type
+ * @path : The path the lock is acquired through
+ * @start: The sched_clock() time at which the wait started
+ * Return: the wait time in ns
+ *
+ * Called with preemption disabled.
+ */
+static __always_inline u64 wstat_wait(struct wstat *ws, int path, u64 start)
+{
+	struct wstat_path *wp = this_cpu_ptr(&ws->paths[path]);
+	u64 delta = sched_clock() - start;
+
+	wp->count++;
+	wp->wait_ns += delta;
+	if (delta > wp->max_ns)
+		wp->max_ns = delta;
+	wp->histo[min_t(u32, delta ? ilog2(delta) : 0,
+			WSTAT_HISTO_BUCKETS - 1)]++;
+	return delta;
+}
+
+static void wstat_reset(struct wstat *ws)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(ws->paths, cpu), 0,
+		       ws->nr_paths * sizeof(struct wstat_path));
+}
+
+static int wstat_stats_show(struct seq_file *m, void *v)
+{
+	struct wstat *ws = m->private;
+	int cpu, path, i;
+
+	for (path = 0; path < ws->nr_paths; path++) {
+		unsigned long count = 0;
+		u64 wait_ns = 0, max_ns = 0;
+		u32 histo[WSTAT_HISTO_BUCKETS] = { 0 };
+
+		for_each_possible_cpu(cpu) {
+			struct wstat_path *wp = per_cpu_ptr(&ws->paths[path],
+							    cpu);
+
+			count   += wp->count;
+			wait_ns += wp->wait_ns;
+			max_ns   = max(max_ns, wp->max_ns);
+			for (i = 0; i < WSTAT_HISTO_BUCKETS; i++)
+				histo[i] += wp->histo[i];
+		}
+		seq_printf(m, "%-13s count %lu wait_ns %llu max_ns %llu\n",
+			   ws->names[path], count, wait_ns, max_ns);
+		for (i = 0; i < WSTAT_HISTO_BUCKETS; i++) {
+			if (histo[i])
+				seq_printf(m, "\t%14llu ns: %u\n",
+					   1ULL << i, histo[i]);
+		}
+	}
+	return 0;
+}
+
+static int wstat_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wstat_stats_show, inode->i_private);
+}
+
+static const struct file_operations wstat_stats_fops = {
+	.open		= wstat_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t wstat_reset_write(struct file *file,
+		const char __user *user_buf, size_t count, loff_t *ppos)
+{
+	wstat_reset(file_inode(file)->i_private);
+	return count;
+}
+
+static const struct file_operations wstat_reset_fops = {
+	.write		= wstat_reset_write,
+	.llseek		= default_llseek,
+};
+
+/**
+ * wstat_debugfs_init - create the debugfs directory of a lock type
+ * @ws        : Pointer to the statistics of the lock type
+ * @name      : The name of the directory
+ * @reset_fops: The reset file operations if more than @ws is to be reset
+ * Return: the directory, for the lock type to add its own files, or NULL
+ */
+static struct dentry * __init
+wstat_debugfs_init(struct wstat *ws, const char *name,
+		   const struct file_operations *reset_fops)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir(name, NULL);
+	if (!dir)
+		return NULL;
+
+	if (!debugfs_create_file("reset", 0200, dir, ws,
+				 reset_fops ? reset_fops : &wstat_reset_fops) ||
+	    !debugfs_create_file("stats", 0400, dir, ws, &wstat_stats_fops)) {
+		debugfs_remove_recursive(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+#endif /* __LINUX_WAIT_STAT_H */
@@ -659,6 +659,21 @@ static int already_uses(struct module *a, struct module *b)
 	return 0;
 }
 
+/*
+ * Does a already hold a reference to b?  Only the loader of a adds to
+ * a->target_list, so it may check it without module_mutex.
+ */
+static bool already_targets(struct module *a, struct module *b)
+{
+	struct module_use *use;
+
+	list_for_each_entry(use, &a->target_list, target_list) {
+		if (use->target == b)
+			return true;
+	}
+	return false;
+}
+
 /*
  * Module a uses b
  *  - we add 'a' as a "source", 'b' as a "target" of module use
@@ -985,6 +1000,11 @@ static inline void module_unload_free(struct module *mod)
 {
 }
 
+static inline bool already_targets(struct module *a, struct module *b)
+{
+	return false;
+}
+
 int ref_module(struct module *a, struct module *b)
 {
 	return strong_try_module_get(b);
@@ -1232,7 +1252,13 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 	const unsigned long *crc;
 	int err;
 
-	mutex_lock(&module_mutex);
+	/*
+	 * Look the symbol up with preemption disabled rather than under
+	 * module_mutex, which is only needed to record a new use of the
+	 * owner: most symbols come from the kernel or from a module we
+	 * already hold a reference to.
+	 */
+	preempt_disable();
 	sym = find_symbol(name, &owner, &crc,
 			  !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE)), true);
 	if (!sym)
@@ -1244,17 +1270,30 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 		goto getname;
 	}
 
-	err = ref_module(mod, owner);
-	if (err) {
-		sym = ERR_PTR(err);
+	if (!owner || already_targets(mod, owner))
+		goto getname;
+
+	/* Keep the owner around while we sleep on module_mutex. */
+	if (!try_module_get(owner)) {
+		sym = ERR_PTR(-ENOENT);
 		goto getname;
 	}
+	preempt_enable();
+
+	mutex_lock(&module_mutex);
+	err = ref_module(mod, owner);
+	mutex_unlock(&module_mutex);
+	if (err)
+		sym = ERR_PTR(err);
+	strncpy(ownername, module_name(owner), MODULE_NAME_LEN);
+	module_put(owner);
+	return sym;
 
 getname:
-	/* We must make copy under the lock if we failed to get ref. */
+	/* We must make copy before reenabling preemption. */
 	strncpy(ownername, module_name(owner), MODULE_NAME_LEN);
 unlock:
-	mutex_unlock(&module_mutex);
+	preempt_enable();
 	return sym;
 }
 
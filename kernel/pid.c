@@ -9,9 +9,9 @@
  * against. There is very little to them aside from hashing them and
  * parking tasks using given ID's on a list.
  *
- * The hash is always changed with the tasklist_lock write-acquired,
- * and the hash is only accessed with the tasklist_lock at least
- * read-acquired, so there's no additional SMP locking needed here.
+ * The hash buckets are changed under their bit lock and looked up under
+ * RCU. The pid namespace counts of hashed pids are atomic, so neither the
+ * allocation nor the freeing of a pid takes a global lock.
  *
  * We have a list of bitmap pages, which bitmaps represent the PID space.
  * Allocating and freeing PIDs is completely lockless. The worst-case
@@ -31,6 +31,7 @@
 #include <linux/slab.h>
 #include <linux/init.h>
 #include <linux/rculist.h>
+#include <linux/rculist_bl.h>
 #include <linux/bootmem.h>
 #include <linux/hash.h>
 #include <linux/pid_namespace.h>
@@ -41,7 +42,7 @@
 
 #define pid_hashfn(nr, ns)	\
 	hash_long((unsigned long)nr + (unsigned long)ns, pidhash_shift)
-static struct hlist_head *pid_hash;
+static struct hlist_bl_head *pid_hash;
 static unsigned int pidhash_shift = 4;
 struct pid init_struct_pid = INIT_STRUCT_PID;
 
@@ -75,7 +76,7 @@ struct pid_namespace init_pid_ns = {
 		[ 0 ... PIDMAP_ENTRIES-1] = { ATOMIC_INIT(BITS_PER_PAGE), NULL }
 	},
 	.last_pid = 0,
-	.nr_hashed = PIDNS_HASH_ADDING,
+	.nr_hashed = ATOMIC_INIT(PIDNS_HASH_ADDING),
 	.level = 0,
 	.child_reaper = &init_task,
 	.user_ns = &init_user_ns,
@@ -84,20 +85,56 @@ struct pid_namespace init_pid_ns = {
 EXPORT_SYMBOL_GPL(init_pid_ns);
 
 /*
- * Note: disable interrupts while the pidmap_lock is held as an
+ * Note: disable interrupts while a pid hash bucket lock is held as an
  * interrupt might come in and do read_lock(&tasklist_lock).
  *
  * If we don't disable interrupts there is a nasty deadlock between
- * detach_pid()->free_pid() and another cpu that does
- * spin_lock(&pidmap_lock) followed by an interrupt routine that does
- * read_lock(&tasklist_lock);
+ * detach_pid()->free_pid() and another cpu that takes the bucket lock
+ * followed by an interrupt routine that does read_lock(&tasklist_lock);
  *
  * After we clean up the tasklist_lock and know there are no
  * irq handlers that take it we can leave the interrupts enabled.
  * For now it is easier to be safe than to prove it can't happen.
  */
+static void pid_hash_add(struct upid *upid)
+{
+	struct hlist_bl_head *b = &pid_hash[pid_hashfn(upid->nr, upid->ns)];
+
+	local_irq_disable();
+	hlist_bl_lock(b);
+	hlist_bl_add_head_rcu(&upid->pid_chain, b);
+	hlist_bl_unlock(b);
+	local_irq_enable();
+}
+
+static void pid_hash_del(struct upid *upid)
+{
+	struct hlist_bl_head *b = &pid_hash[pid_hashfn(upid->nr, upid->ns)];
+	unsigned long flags;
 
-static  __cacheline_aligned_in_smp DEFINE_SPINLOCK(pidmap_lock);
+	local_irq_save(flags);
+	hlist_bl_lock(b);
+	hlist_bl_del_rcu(&upid->pid_chain);
+	hlist_bl_unlock(b);
+	local_irq_restore(flags);
+}
+
+/*
+ * Count a pid hashed in @ns if the namespace still allows the allocations,
+ * see disable_pid_allocation().
+ */
+static bool pidns_hash_adding_inc(struct pid_namespace *ns)
+{
+	int old, nr = atomic_read(&ns->nr_hashed);
+
+	do {
+		if (!(nr & PIDNS_HASH_ADDING))
+			return false;
+		old = nr;
+		nr = atomic_cmpxchg(&ns->nr_hashed, old, old + 1);
+	} while (nr != old);
+	return true;
+}
 
 static void free_pidmap(struct upid *upid)
 {
@@ -171,13 +208,8 @@ static int alloc_pidmap(struct pid_namespace *pid_ns)
 			 * Free the page if someone raced with us
 			 * installing it:
 			 */
-			spin_lock_irq(&pidmap_lock);
-			if (!map->page) {
-				map->page = page;
-				page = NULL;
-			}
-			spin_unlock_irq(&pidmap_lock);
-			kfree(page);
+			if (page && cmpxchg(&map->page, NULL, page))
+				kfree(page);
 			if (unlikely(!map->page))
 				break;
 		}
@@ -257,14 +289,12 @@ void free_pid(struct pid *pid)
 {
 	/* We can be called with write_lock_irq(&tasklist_lock) held */
 	int i;
-	unsigned long flags;
 
-	spin_lock_irqsave(&pidmap_lock, flags);
 	for (i = 0; i <= pid->level; i++) {
 		struct upid *upid = pid->numbers + i;
 		struct pid_namespace *ns = upid->ns;
-		hlist_del_rcu(&upid->pid_chain);
-		switch(--ns->nr_hashed) {
+		pid_hash_del(upid);
+		switch ((unsigned int)atomic_dec_return(&ns->nr_hashed)) {
 		case 2:
 		case 1:
 			/* When all that is left in the pid namespace
@@ -274,16 +304,20 @@ void free_pid(struct pid *pid)
 			wake_up_process(ns->child_reaper);
 			break;
 		case PIDNS_HASH_ADDING:
-			/* Handle a fork failure of the first process */
+			/*
+			 * Handle a fork failure of the first process, unless
+			 * another one got hashed meanwhile
+			 */
 			WARN_ON(ns->child_reaper);
-			ns->nr_hashed = 0;
+			if (atomic_cmpxchg(&ns->nr_hashed, PIDNS_HASH_ADDING,
+					   0) != PIDNS_HASH_ADDING)
+				break;
 			/* fall through */
 		case 0:
 			schedule_work(&ns->proc_work);
 			break;
 		}
 	}
-	spin_unlock_irqrestore(&pidmap_lock, flags);
 
 	for (i = 0; i <= pid->level; i++)
 		free_pidmap(pid->numbers + i);
@@ -326,21 +360,19 @@ struct pid *alloc_pid(struct pid_namespace *ns)
 		INIT_HLIST_HEAD(&pid->tasks[type]);
 
 	upid = pid->numbers + ns->level;
-	spin_lock_irq(&pidmap_lock);
-	if (!(ns->nr_hashed & PIDNS_HASH_ADDING))
-		goto out_unlock;
-	for ( ; upid >= pid->numbers; --upid) {
-		hlist_add_head_rcu(&upid->pid_chain,
-				&pid_hash[pid_hashfn(upid->nr, upid->ns)]);
-		upid->ns->nr_hashed++;
+	if (!pidns_hash_adding_inc(ns))
+		goto out_put;
+	pid_hash_add(upid);
+	while (--upid >= pid->numbers) {
+		atomic_inc(&upid->ns->nr_hashed);
+		pid_hash_add(upid);
 	}
-	spin_unlock_irq(&pidmap_lock);
 
 out:
 	return pid;
 
-out_unlock:
-	spin_unlock_irq(&pidmap_lock);
+out_put:
+	put_pid_ns(ns);
 out_free:
 	while (++i <= ns->level)
 		free_pidmap(pid->numbers + i);
@@ -352,16 +384,21 @@ out_free:
 
 void disable_pid_allocation(struct pid_namespace *ns)
 {
-	spin_lock_irq(&pidmap_lock);
-	ns->nr_hashed &= ~PIDNS_HASH_ADDING;
-	spin_unlock_irq(&pidmap_lock);
+	int old, nr = atomic_read(&ns->nr_hashed);
+
+	do {
+		old = nr;
+		nr = atomic_cmpxchg(&ns->nr_hashed, old,
+				    old & ~PIDNS_HASH_ADDING);
+	} while (nr != old);
 }
 
 struct pid *find_pid_ns(int nr, struct pid_namespace *ns)
 {
+	struct hlist_bl_node *node;
 	struct upid *pnr;
 
-	hlist_for_each_entry_rcu(pnr,
+	hlist_bl_for_each_entry_rcu(pnr, node,
 			&pid_hash[pid_hashfn(nr, ns)], pid_chain)
 		if (pnr->nr == nr && pnr->ns == ns)
 			return container_of(pnr, struct pid,
@@ -578,7 +615,7 @@ void __init pidhash_init(void)
 	pidhash_size = 1U << pidhash_shift;
 
 	for (i = 0; i < pidhash_size; i++)
-		INIT_HLIST_HEAD(&pid_hash[i]);
+		INIT_HLIST_BL_HEAD(&pid_hash[i]);
 }
 
 void __init pidmap_init(void)
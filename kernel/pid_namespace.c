@@ -113,7 +113,7 @@ static struct pid_namespace *create_pid_namespace(struct user_namespace *user_ns
 	ns->level = level;
 	ns->parent = get_pid_ns(parent_pid_ns);
 	ns->user_ns = get_user_ns(user_ns);
-	ns->nr_hashed = PIDNS_HASH_ADDING;
+	atomic_set(&ns->nr_hashed, PIDNS_HASH_ADDING);
 	INIT_WORK(&ns->proc_work, proc_cleanup_work);
 
 	set_bit(0, ns->pidmap[0].page);
@@ -235,7 +235,7 @@ void zap_pid_ns_processes(struct pid_namespace *pid_ns)
 	 */
 	for (;;) {
 		set_current_state(TASK_UNINTERRUPTIBLE);
-		if (pid_ns->nr_hashed == init_pids)
+		if (atomic_read(&pid_ns->nr_hashed) == init_pids)
 			break;
 		schedule();
 	}
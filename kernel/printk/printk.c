@@ -1613,6 +1613,221 @@ static size_t cont_print_text(char *text, size_t size)
 	return textlen;
 }
 
+/*
+ * Strip the trailing newline and the kernel syslog prefix of a formatted
+ * message, filling in the level and the log flags they carry. Returns the
+ * start of the remaining text.
+ */
+static char *printk_parse_text(int facility, char *text, size_t *text_len,
+			       int *level, enum log_flags *lflags)
+{
+	/* mark and strip a trailing newline */
+	if (*text_len && text[*text_len-1] == '\n') {
+		(*text_len)--;
+		*lflags |= LOG_NEWLINE;
+	}
+
+	/* strip kernel syslog prefix and extract log level or control flags */
+	if (facility == 0) {
+		int kern_level = printk_get_level(text);
+
+		if (kern_level) {
+			const char *end_of_header = printk_skip_level(text);
+			switch (kern_level) {
+			case '0' ... '7':
+				if (*level == -1)
+					*level = kern_level - '0';
+			case 'd':	/* KERN_DEFAULT */
+				*lflags |= LOG_PREFIX;
+			}
+			/*
+			 * No need to check length here because vscnprintf
+			 * put '\0' at the end of the string. Only valid and
+			 * newly printed level is detected.
+			 */
+			*text_len -= end_of_header - text;
+			text = (char *)end_of_header;
+		}
+	}
+
+	if (*level == -1)
+		*level = default_message_loglevel;
+
+	return text;
+}
+
+/*
+ * Per-cpu staging of messages printed from interrupt context.
+ *
+ * An interrupt handler that finds logbuf_lock taken does not spin on it:
+ * the message is formatted into this CPU's staging buffer and published
+ * with a cmpxchg of the buffer length. The record is formatted before its
+ * space is reserved, so nothing else may stage on this CPU meanwhile:
+ * interrupts are disabled, and NMIs never stage. Whoever next holds
+ * logbuf_lock (the console owner in console_unlock(), the next printk()
+ * or the irq_work queued here) merges the staged records into the log
+ * buffer in CPU order, keeping the timestamps taken at staging time.
+ *
+ * Only the merger resets the length, and only with a cmpxchg from the
+ * length it has read up to, so a writer racing with the merge simply
+ * retries at the start of the buffer.
+ */
+#define PRINTK_STAGE_LEN	4096
+
+struct printk_stage_rec {
+	u64		ts_nsec;
+	u16		size;		/* whole record, aligned */
+	u16		text_len;
+	u16		dict_len;
+	u8		facility;
+	u8		level;
+	u8		flags;		/* enum log_flags */
+};
+
+struct printk_stage {
+	atomic_t	len;
+	char		buf[PRINTK_STAGE_LEN] __aligned(8);
+};
+
+static DEFINE_PER_CPU(struct printk_stage, printk_stage);
+static atomic_t printk_stage_pending;
+static atomic_t printk_stage_dropped;
+
+static void printk_stage_work_func(struct irq_work *work);
+
+static struct irq_work printk_stage_work = {
+	.func = printk_stage_work_func,
+	.flags = IRQ_WORK_LAZY,
+};
+
+/* Called with interrupts disabled, not in NMI and without logbuf_lock. */
+static int printk_stage(int facility, int level,
+			const char *dict, size_t dictlen,
+			const char *fmt, va_list args)
+{
+	struct printk_stage *s = this_cpu_ptr(&printk_stage);
+	struct printk_stage_rec *rec;
+	enum log_flags lflags;
+	size_t text_len;
+	char *buf, *text;
+	int len, room, size, lvl;
+	va_list ap;
+
+again:
+	len = atomic_read(&s->len);
+	room = PRINTK_STAGE_LEN - len - (int)sizeof(*rec);
+	if (dict)
+		room -= dictlen;
+	if (room < 2) {
+		atomic_inc(&printk_stage_dropped);
+		return 0;
+	}
+
+	rec = (struct printk_stage_rec *)(s->buf + len);
+	buf = (char *)(rec + 1);
+	lflags = 0;
+	lvl = level;
+
+	va_copy(ap, args);
+	text_len = vscnprintf(buf, min(room, LOG_LINE_MAX), fmt, ap);
+	va_end(ap);
+
+	text = printk_parse_text(facility, buf, &text_len, &lvl, &lflags);
+	if (text != buf)
+		memmove(buf, text, text_len);
+	if (dict) {
+		lflags |= LOG_PREFIX|LOG_NEWLINE;
+		memcpy(buf + text_len, dict, dictlen);
+	}
+
+	size = ALIGN(sizeof(*rec) + text_len + (dict ? dictlen : 0), 8);
+	rec->ts_nsec = local_clock();
+	rec->size = size;
+	rec->text_len = text_len;
+	rec->dict_len = dict ? dictlen : 0;
+	rec->facility = facility;
+	rec->level = lvl;
+	rec->flags = lflags;
+
+	/* full barrier: the record is visible before the new length */
+	if (atomic_cmpxchg(&s->len, len, len + size) != len)
+		goto again;
+
+	atomic_set(&printk_stage_pending, 1);
+	irq_work_queue(&printk_stage_work);
+
+	return text_len;
+}
+
+/* Called with logbuf_lock held. */
+static void printk_stage_merge(void)
+{
+	unsigned int dropped;
+	int cpu;
+
+	if (!atomic_read(&printk_stage_pending) ||
+	    !atomic_xchg(&printk_stage_pending, 0))
+		return;
+
+	/* staged records end any continuation line in progress */
+	if (cont.len)
+		cont_flush(LOG_NEWLINE);
+
+	for_each_possible_cpu(cpu) {
+		struct printk_stage *s = per_cpu_ptr(&printk_stage, cpu);
+		int i = 0, len;
+
+		do {
+			len = atomic_read(&s->len);
+			smp_rmb();
+			while (i < len) {
+				struct printk_stage_rec *rec;
+				char *text;
+
+				rec = (struct printk_stage_rec *)(s->buf + i);
+				text = (char *)(rec + 1);
+				log_store(rec->facility, rec->level,
+					  rec->flags & LOG_NEWLINE ?
+						rec->flags :
+						rec->flags | LOG_CONT,
+					  rec->ts_nsec,
+					  text + rec->text_len, rec->dict_len,
+					  text, rec->text_len);
+				i += rec->size;
+			}
+		} while (atomic_cmpxchg(&s->len, len, 0) != len);
+	}
+
+	dropped = atomic_xchg(&printk_stage_dropped, 0);
+	if (dropped) {
+		char msg[64];
+		int len;
+
+		len = scnprintf(msg, sizeof(msg),
+				"** %u printk messages dropped in interrupt **",
+				dropped);
+		log_store(0, 4, LOG_PREFIX|LOG_NEWLINE, 0,
+			  NULL, 0, msg, len);
+	}
+}
+
+static void printk_stage_work_func(struct irq_work *work)
+{
+	unsigned long flags;
+
+	if (!raw_spin_trylock_irqsave(&logbuf_lock, flags)) {
+		/* try again on the next tick rather than spin here */
+		irq_work_queue(work);
+		return;
+	}
+	printk_stage_merge();
+	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+
+	/* If trylock fails, someone else is doing the printing */
+	if (console_trylock())
+		console_unlock();
+}
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1661,8 +1876,23 @@ asmlinkage int vprintk_emit(int facility, int level,
 	}
 
 	lockdep_off();
-	raw_spin_lock(&logbuf_lock);
+
+	/*
+	 * Interrupt handlers must not pile up behind logbuf_lock; stage
+	 * the message on this CPU and let the lock holder merge it. An NMI
+	 * could overwrite the record of the handler it interrupted.
+	 */
+	if (!in_interrupt() || in_nmi() || oops_in_progress) {
+		raw_spin_lock(&logbuf_lock);
+	} else if (!raw_spin_trylock(&logbuf_lock)) {
+		printed_len = printk_stage(facility, level, dict, dictlen,
+					   fmt, args);
+		lockdep_on();
+		local_irq_restore(flags);
+		return printed_len;
+	}
 	logbuf_cpu = this_cpu;
+	printk_stage_merge();
 
 	if (unlikely(recursion_bug)) {
 		static const char recursion_msg[] =
@@ -1681,37 +1911,7 @@ asmlinkage int vprintk_emit(int facility, int level,
 	 */
 	text_len = vscnprintf(text, sizeof(textbuf), fmt, args);
 
-	/* mark and strip a trailing newline */
-	if (text_len && text[text_len-1] == '\n') {
-		text_len--;
-		lflags |= LOG_NEWLINE;
-	}
-
-	/* strip kernel syslog prefix and extract log level or control flags */
-	if (facility == 0) {
-		int kern_level = printk_get_level(text);
-
-		if (kern_level) {
-			const char *end_of_header = printk_skip_level(text);
-			switch (kern_level) {
-			case '0' ... '7':
-				if (level == -1)
-					level = kern_level - '0';
-			case 'd':	/* KERN_DEFAULT */
-				lflags |= LOG_PREFIX;
-			}
-			/*
-			 * No need to check length here because vscnprintf
-			 * put '\0' at the end of the string. Only valid and
-			 * newly printed level is detected.
-			 */
-			text_len -= end_of_header - text;
-			text = (char *)end_of_header;
-		}
-	}
-
-	if (level == -1)
-		level = default_message_loglevel;
+	text = printk_parse_text(facility, text, &text_len, &level, &lflags);
 
 	if (dict)
 		lflags |= LOG_PREFIX|LOG_NEWLINE;
@@ -2188,6 +2388,7 @@ again:
 		int level;
 
 		raw_spin_lock_irqsave(&logbuf_lock, flags);
+		printk_stage_merge();
 		if (seen_seq != log_next_seq) {
 			wake_klogd = true;
 			seen_seq = log_next_seq;
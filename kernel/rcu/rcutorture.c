@@ -149,6 +149,8 @@ static long n_rcu_torture_timers;
 static long n_barrier_attempts;
 static long n_barrier_successes;
 static atomic_long_t n_cbfloods;
+static atomic_long_t cbflood_drain_sum;	/* jiffies */
+static unsigned long cbflood_drain_max;	/* jiffies */
 static struct list_head rcu_torture_removed;
 
 static int rcu_torture_writer_state;
@@ -779,6 +781,7 @@ rcu_torture_cbflood(void *arg)
 	int err = 1;
 	int i;
 	int j;
+	unsigned long jdrain;
 	struct rcu_head *rhp;
 
 	if (cbflood_n_per_burst > 0 &&
@@ -809,7 +812,13 @@ rcu_torture_cbflood(void *arg)
 			schedule_timeout_interruptible(cbflood_intra_holdoff);
 			WARN_ON(signal_pending(current));
 		}
+		jdrain = jiffies;
 		cur_ops->cb_barrier();
+		jdrain = jiffies - jdrain;
+		/* Grace-period latency under the flood, for the stats */
+		atomic_long_add(jdrain, &cbflood_drain_sum);
+		if (jdrain > ACCESS_ONCE(cbflood_drain_max))
+			ACCESS_ONCE(cbflood_drain_max) = jdrain;
 		stutter_wait("rcu_torture_cbflood");
 	} while (!torture_must_stop());
 	torture_kthread_stopping("rcu_torture_cbflood");
@@ -1188,7 +1197,12 @@ rcu_torture_stats_print(void)
 		n_barrier_successes,
 		n_barrier_attempts,
 		n_rcu_torture_barrier_error);
-	pr_cont("cbflood: %ld\n", atomic_long_read(&n_cbfloods));
+	pr_cont("cbflood: %ld ", atomic_long_read(&n_cbfloods));
+	pr_cont("cbdrain: %u/%u ms\n",
+		atomic_long_read(&n_cbfloods) ?
+		jiffies_to_msecs(atomic_long_read(&cbflood_drain_sum) /
+				 atomic_long_read(&n_cbfloods)) : 0,
+		jiffies_to_msecs(ACCESS_ONCE(cbflood_drain_max)));
 
 	pr_alert("%s%s ", torture_type, TORTURE_FLAG);
 	if (atomic_read(&n_rcu_torture_mberror) != 0 ||
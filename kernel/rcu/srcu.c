@@ -101,6 +101,7 @@ static int init_srcu_struct_fields(struct srcu_struct *sp)
 	sp->completed = 0;
 	spin_lock_init(&sp->queue_lock);
 	sp->running = false;
+	sp->expedited = false;
 	rcu_batch_init(&sp->batch_queue);
 	rcu_batch_init(&sp->batch_check0);
 	rcu_batch_init(&sp->batch_check1);
@@ -419,16 +420,25 @@ static void wakeme_after_rcu(struct rcu_head *head)
 	complete(&rcu->completion);
 }
 
+static void srcu_collect_new(struct srcu_struct *sp);
 static void srcu_advance_batches(struct srcu_struct *sp, int trycount);
+static void srcu_invoke_callbacks(struct srcu_struct *sp);
 static void srcu_reschedule(struct srcu_struct *sp);
 
 /*
  * Helper function for synchronize_srcu() and synchronize_srcu_expedited().
+ *
+ * The caller that finds the state machine idle drives a grace period
+ * itself, on behalf of all the callbacks and waiters queued so far.  The
+ * others queue up for the next one, an expedited waiter making sure that
+ * it starts as soon as the current one ends, so that concurrent expedited
+ * updaters share grace periods instead of each waiting SRCU_INTERVAL.
  */
 static void __synchronize_srcu(struct srcu_struct *sp, int trycount)
 {
 	struct rcu_synchronize rcu;
 	struct rcu_head *head = &rcu.head;
+	bool expedited = trycount >= SYNCHRONIZE_SRCU_EXP_TRYCOUNT;
 	bool done = false;
 
 	rcu_lockdep_assert(!lock_is_held(&sp->dep_map) &&
@@ -446,19 +456,26 @@ static void __synchronize_srcu(struct srcu_struct *sp, int trycount)
 	if (!sp->running) {
 		/* steal the processing owner */
 		sp->running = true;
+		sp->expedited = expedited;
 		rcu_batch_queue(&sp->batch_check0, head);
 		spin_unlock_irq(&sp->queue_lock);
 
+		/* Take along the waiters that queued up meanwhile */
+		srcu_collect_new(sp);
 		srcu_advance_batches(sp, trycount);
 		if (!rcu_batch_empty(&sp->batch_done)) {
 			BUG_ON(sp->batch_done.head != head);
 			rcu_batch_dequeue(&sp->batch_done);
 			done = true;
+			/* and wake them up */
+			srcu_invoke_callbacks(sp);
 		}
 		/* give the processing owner to work_struct */
 		srcu_reschedule(sp);
 	} else {
 		rcu_batch_queue(&sp->batch_queue, head);
+		if (expedited)
+			sp->expedited = true;
 		spin_unlock_irq(&sp->queue_lock);
 	}
 
@@ -651,10 +668,13 @@ static void srcu_invoke_callbacks(struct srcu_struct *sp)
 /*
  * Finished one round of SRCU grace period.  Start another if there are
  * more SRCU callbacks queued, otherwise put SRCU into not-running state.
+ * The next round starts right away for expedited waiters, unless readers
+ * are still holding up the current grace period.
  */
 static void srcu_reschedule(struct srcu_struct *sp)
 {
 	bool pending = true;
+	unsigned long delay = SRCU_INTERVAL;
 
 	if (rcu_batch_empty(&sp->batch_done) &&
 	    rcu_batch_empty(&sp->batch_check1) &&
@@ -666,14 +686,20 @@ static void srcu_reschedule(struct srcu_struct *sp)
 		    rcu_batch_empty(&sp->batch_check0) &&
 		    rcu_batch_empty(&sp->batch_queue)) {
 			sp->running = false;
+			sp->expedited = false;
 			pending = false;
 		}
 		spin_unlock_irq(&sp->queue_lock);
 	}
 
-	if (pending)
+	if (pending) {
+		if (ACCESS_ONCE(sp->expedited) &&
+		    rcu_batch_empty(&sp->batch_check0) &&
+		    rcu_batch_empty(&sp->batch_check1))
+			delay = 0;
 		queue_delayed_work(system_power_efficient_wq,
-				   &sp->work, SRCU_INTERVAL);
+				   &sp->work, delay);
+	}
 }
 
 /*
@@ -686,7 +712,8 @@ void process_srcu(struct work_struct *work)
 	sp = container_of(work, struct srcu_struct, work.work);
 
 	srcu_collect_new(sp);
-	srcu_advance_batches(sp, 1);
+	srcu_advance_batches(sp, ACCESS_ONCE(sp->expedited) ?
+				 SYNCHRONIZE_SRCU_EXP_TRYCOUNT : 1);
 	srcu_invoke_callbacks(sp);
 	srcu_reschedule(sp);
 }
@@ -1025,6 +1025,136 @@ static void record_gp_stall_check_time(struct rcu_state *rsp)
 	rsp->jiffies_resched = j + j1 / 2;
 }
 
+#if BITS_PER_LONG == 64
+
+#define RCU_QSL_MASK	0xffffffffUL
+#define RCU_QSL_GP(gp)	((unsigned long)(gp) << 32)
+
+static bool rcu_qsl_gp_is(unsigned long qsl, unsigned long gpnum)
+{
+	return (qsl & ~RCU_QSL_MASK) == RCU_QSL_GP(gpnum);
+}
+
+/*
+ * Leaf ->qsmask bits of the CPUs that haven't reported a quiescent state
+ * yet, including the ones that reported it through ->qsmask_lockless
+ */
+static unsigned long rcu_rnp_qsmask(struct rcu_node *rnp)
+{
+	unsigned long qsmask = ACCESS_ONCE(rnp->qsmask);
+	unsigned long qsl = ACCESS_ONCE(rnp->qsmask_lockless);
+
+	if (rnp->qs_lockless && rcu_qsl_gp_is(qsl, ACCESS_ONCE(rnp->gpnum)))
+		qsmask &= qsl;
+	return qsmask;
+}
+
+/*
+ * Start a grace period for ->qsmask_lockless, rnp->lock held
+ */
+static void rcu_init_qs_lockless(struct rcu_node *rnp)
+{
+	if (rnp->qs_lockless)
+		ACCESS_ONCE(rnp->qsmask_lockless) =
+			RCU_QSL_GP(rnp->gpnum) | rnp->qsmask;
+}
+
+/*
+ * Clear @mask from ->qsmask_lockless and fold into ->qsmask the quiescent
+ * states reported locklessly, rnp->lock held.  ->qsmask_lockless only
+ * becomes empty here, so that ->qsmask never stays set when it is.
+ */
+static void rcu_fold_qs_lockless(struct rcu_node *rnp, unsigned long mask)
+{
+	unsigned long old, cur;
+
+	if (!rnp->qs_lockless)
+		return;
+
+	old = ACCESS_ONCE(rnp->qsmask_lockless);
+	while (rcu_qsl_gp_is(old, rnp->gpnum)) {
+		cur = cmpxchg(&rnp->qsmask_lockless, old, old & ~mask);
+		if (cur == old) {
+			rnp->qsmask &= old & ~mask;
+			break;
+		}
+		old = cur;
+	}
+}
+
+/*
+ * Report the quiescent state of the current CPU by clearing its bit in
+ * ->qsmask_lockless of its leaf, unless it is the last bit set: the last
+ * reporter takes rnp->lock and reports for all of them, so that the leaf
+ * lock is taken once per grace period by the reporters instead of once
+ * per CPU.  The callbacks waiting for a grace period number need the lock
+ * to be accelerated, so the CPUs with some stay on the locked path.
+ */
+static bool rcu_report_qs_lockless(struct rcu_data *rdp, struct rcu_node *rnp)
+{
+	unsigned long old, new, cur;
+
+	if (!rnp->qs_lockless || !rdp->passed_quiesce ||
+	    *rdp->nxttail[RCU_NEXT_READY_TAIL] ||
+	    rdp->gpnum != ACCESS_ONCE(rnp->gpnum))
+		return false;
+
+	old = ACCESS_ONCE(rnp->qsmask_lockless);
+	for (;;) {
+		if (!rcu_qsl_gp_is(old, rdp->gpnum) || !(old & rdp->grpmask))
+			return false;
+		new = old & ~rdp->grpmask;
+		if (!(new & RCU_QSL_MASK))
+			return false;
+		/* Full barrier, like the lock for the locked reporters */
+		cur = cmpxchg(&rnp->qsmask_lockless, old, new);
+		if (cur == old)
+			break;
+		old = cur;
+	}
+	rdp->qs_pending = 0;
+	rdp->n_qs_lockless++;
+	return true;
+}
+
+/*
+ * Use ->qsmask_lockless on the leaves spanning up to 32 CPUs, so that
+ * the grace period number fits along with the mask
+ */
+static void rcu_init_one_qs_lockless(struct rcu_node *rnp, bool leaf)
+{
+	rnp->qsmask_lockless = 0;
+	rnp->qs_lockless = leaf && rnp->grphi - rnp->grplo < 32;
+}
+
+#else /* #if BITS_PER_LONG == 64 */
+
+static unsigned long rcu_rnp_qsmask(struct rcu_node *rnp)
+{
+	return ACCESS_ONCE(rnp->qsmask);
+}
+
+static void rcu_init_qs_lockless(struct rcu_node *rnp)
+{
+}
+
+static void rcu_fold_qs_lockless(struct rcu_node *rnp, unsigned long mask)
+{
+}
+
+static bool rcu_report_qs_lockless(struct rcu_data *rdp, struct rcu_node *rnp)
+{
+	return false;
+}
+
+static void rcu_init_one_qs_lockless(struct rcu_node *rnp, bool leaf)
+{
+	rnp->qsmask_lockless = 0;
+	rnp->qs_lockless = false;
+}
+
+#endif /* #else #if BITS_PER_LONG == 64 */
+
 /*
  * Dump stacks of all tasks running on stalled CPUs.
  */
@@ -1036,6 +1166,7 @@ static void rcu_dump_cpu_stacks(struct rcu_state *rsp)
 
 	rcu_for_each_leaf_node(rsp, rnp) {
 		raw_spin_lock_irqsave(&rnp->lock, flags);
+		rcu_fold_qs_lockless(rnp, 0);
 		if (rnp->qsmask != 0) {
 			for (cpu = 0; cpu <= rnp->grphi - rnp->grplo; cpu++)
 				if (rnp->qsmask & (1UL << cpu))
@@ -1076,6 +1207,7 @@ static void print_other_cpu_stall(struct rcu_state *rsp)
 	rcu_for_each_leaf_node(rsp, rnp) {
 		raw_spin_lock_irqsave(&rnp->lock, flags);
 		ndetected += rcu_print_task_stall(rnp);
+		rcu_fold_qs_lockless(rnp, 0);
 		if (rnp->qsmask != 0) {
 			for (cpu = 0; cpu <= rnp->grphi - rnp->grplo; cpu++)
 				if (rnp->qsmask & (1UL << cpu)) {
@@ -1196,7 +1328,7 @@ static void check_cpu_stall(struct rcu_state *rsp, struct rcu_data *rdp)
 		return; /* No stall or GP completed since entering function. */
 	rnp = rdp->mynode;
 	if (rcu_gp_in_progress(rsp) &&
-	    (ACCESS_ONCE(rnp->qsmask) & rdp->grpmask)) {
+	    (rcu_rnp_qsmask(rnp) & rdp->grpmask)) {
 
 		/* We haven't checked in, so go dump stack. */
 		print_cpu_stall(rsp);
@@ -1651,6 +1783,7 @@ static int rcu_gp_init(struct rcu_state *rsp)
 		rcu_preempt_check_blocked_tasks(rnp);
 		rnp->qsmask = rnp->qsmaskinit;
 		ACCESS_ONCE(rnp->gpnum) = rsp->gpnum;
+		rcu_init_qs_lockless(rnp);
 		WARN_ON_ONCE(rnp->completed != rsp->completed);
 		ACCESS_ONCE(rnp->completed) = rsp->completed;
 		if (rnp == rdp->mynode)
@@ -1969,6 +2102,7 @@ rcu_report_qs_rnp(unsigned long mask, struct rcu_state *rsp,
 			return;
 		}
 		rnp->qsmask &= ~mask;
+		rcu_fold_qs_lockless(rnp, mask);
 		trace_rcu_quiescent_state_report(rsp->name, rnp->gpnum,
 						 mask, rnp->qsmask, rnp->level,
 						 rnp->grplo, rnp->grphi,
@@ -2020,6 +2154,8 @@ rcu_report_qs_rdp(int cpu, struct rcu_state *rsp, struct rcu_data *rdp)
 	struct rcu_node *rnp;
 
 	rnp = rdp->mynode;
+	if (rcu_report_qs_lockless(rdp, rnp))
+		return;
 	raw_spin_lock_irqsave(&rnp->lock, flags);
 	smp_mb__after_unlock_lock();
 	if (rdp->passed_quiesce == 0 || rdp->gpnum != rnp->gpnum ||
@@ -2454,6 +2590,7 @@ static void force_qs_rnp(struct rcu_state *rsp,
 			raw_spin_unlock_irqrestore(&rnp->lock, flags);
 			return;
 		}
+		rcu_fold_qs_lockless(rnp, 0);
 		if (rnp->qsmask == 0) {
 			rcu_initiate_boost(rnp, flags); /* releases rnp->lock */
 			continue;
@@ -3647,6 +3784,7 @@ static void __init rcu_init_one(struct rcu_state *rsp,
 					      j / rsp->levelspread[i - 1];
 			}
 			rnp->level = i;
+			rcu_init_one_qs_lockless(rnp, i == rcu_num_lvls - 1);
 			INIT_LIST_HEAD(&rnp->blkd_tasks);
 			rcu_init_one_nocb(rnp);
 		}
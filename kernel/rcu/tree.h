@@ -136,6 +136,11 @@ struct rcu_node {
 				/*  an rcu_data structure, otherwise, each */
 				/*  bit corresponds to a child rcu_node */
 				/*  structure. */
+	unsigned long qsmask_lockless;
+				/* Lockless copy of a leaf ->qsmask, with */
+				/*  the low 32 bits of ->gpnum on top, see */
+				/*  rcu_report_qs_lockless(). */
+	bool	qs_lockless;	/* Leaf with ->qsmask_lockless in use. */
 	unsigned long expmask;	/* Groups that have ->blkd_tasks */
 				/*  elements that need to drain to allow the */
 				/*  current expedited grace period to */
@@ -306,6 +311,7 @@ struct rcu_data {
 	unsigned long   n_cbs_adopted;  /* RCU cbs adopted from dying CPU */
 	unsigned long	n_force_qs_snap;
 					/* did other CPU force QS recently? */
+	unsigned long	n_qs_lockless;	/* QSes reported without the leaf lock */
 	long		blimit;		/* Upper limit on a processed batch */
 
 	/* 3) dynticks interface. */
@@ -125,7 +125,7 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 		   rdp->dynticks->dynticks_nesting,
 		   rdp->dynticks->dynticks_nmi_nesting,
 		   rdp->dynticks_fqs);
-	seq_printf(m, " of=%lu", rdp->offline_fqs);
+	seq_printf(m, " of=%lu qsl=%lu", rdp->offline_fqs, rdp->n_qs_lockless);
 	rcu_nocb_q_lengths(rdp, &ql, &qll);
 	qll += rdp->qlen_lazy;
 	ql += rdp->qlen;
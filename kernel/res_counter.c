@@ -17,36 +17,48 @@
 void res_counter_init(struct res_counter *counter, struct res_counter *parent)
 {
 	spin_lock_init(&counter->lock);
-	counter->limit = RES_COUNTER_MAX;
+	atomic64_set(&counter->usage, 0);
+	atomic64_set(&counter->limit, RES_COUNTER_MAX);
 	counter->soft_limit = RES_COUNTER_MAX;
 	counter->parent = parent;
 }
 
-static u64 res_counter_uncharge_locked(struct res_counter *counter,
-				       unsigned long val)
+static u64 res_counter_uncharge_one(struct res_counter *counter,
+				    unsigned long val)
 {
-	if (WARN_ON(counter->usage < val))
-		val = counter->usage;
+	s64 new = atomic64_sub_return(val, &counter->usage);
 
-	counter->usage -= val;
-	return counter->usage;
+	/* More was uncharged than charged, try to repair the damage */
+	if (WARN_ON_ONCE(new < 0)) {
+		atomic64_add(val, &counter->usage);
+		return 0;
+	}
+	return new;
 }
 
-static int res_counter_charge_locked(struct res_counter *counter,
-				     unsigned long val, bool force)
+/*
+ * Add @val to the usage of @counter, backing it out again if the limit
+ * would be exceeded and @force is not set.  The atomic add orders the new
+ * usage before the limit is read, which res_counter_set_limit() relies on.
+ * failcnt and max_usage are only statistics and updated racily.
+ */
+static int res_counter_charge_one(struct res_counter *counter,
+				  unsigned long val, bool force)
 {
+	u64 new = atomic64_add_return(val, &counter->usage);
 	int ret = 0;
 
-	if (counter->usage + val > counter->limit) {
+	if (new > (u64)atomic64_read(&counter->limit)) {
 		counter->failcnt++;
 		ret = -ENOMEM;
-		if (!force)
+		if (!force) {
+			atomic64_sub(val, &counter->usage);
 			return ret;
+		}
 	}
 
-	counter->usage += val;
-	if (counter->usage > counter->max_usage)
-		counter->max_usage = counter->usage;
+	if (new > ACCESS_ONCE(counter->max_usage))
+		ACCESS_ONCE(counter->max_usage) = new;
 	return ret;
 }
 
@@ -54,16 +66,12 @@ static int __res_counter_charge(struct res_counter *counter, unsigned long val,
 				struct res_counter **limit_fail_at, bool force)
 {
 	int ret, r;
-	unsigned long flags;
 	struct res_counter *c, *u;
 
 	r = ret = 0;
 	*limit_fail_at = NULL;
-	local_irq_save(flags);
 	for (c = counter; c != NULL; c = c->parent) {
-		spin_lock(&c->lock);
-		r = res_counter_charge_locked(c, val, force);
-		spin_unlock(&c->lock);
+		r = res_counter_charge_one(c, val, force);
 		if (r < 0 && !ret) {
 			ret = r;
 			*limit_fail_at = c;
@@ -73,13 +81,9 @@ static int __res_counter_charge(struct res_counter *counter, unsigned long val,
 	}
 
 	if (ret < 0 && !force) {
-		for (u = counter; u != c; u = u->parent) {
-			spin_lock(&u->lock);
-			res_counter_uncharge_locked(u, val);
-			spin_unlock(&u->lock);
-		}
+		for (u = counter; u != c; u = u->parent)
+			res_counter_uncharge_one(u, val);
 	}
-	local_irq_restore(flags);
 
 	return ret;
 }
@@ -100,20 +104,16 @@ u64 res_counter_uncharge_until(struct res_counter *counter,
 			       struct res_counter *top,
 			       unsigned long val)
 {
-	unsigned long flags;
 	struct res_counter *c;
 	u64 ret = 0;
 
-	local_irq_save(flags);
 	for (c = counter; c != top; c = c->parent) {
 		u64 r;
-		spin_lock(&c->lock);
-		r = res_counter_uncharge_locked(c, val);
+
+		r = res_counter_uncharge_one(c, val);
 		if (c == counter)
 			ret = r;
-		spin_unlock(&c->lock);
 	}
-	local_irq_restore(flags);
 	return ret;
 }
 
@@ -126,12 +126,8 @@ static inline unsigned long long *
 res_counter_member(struct res_counter *counter, int member)
 {
 	switch (member) {
-	case RES_USAGE:
-		return &counter->usage;
 	case RES_MAX_USAGE:
 		return &counter->max_usage;
-	case RES_LIMIT:
-		return &counter->limit;
 	case RES_FAILCNT:
 		return &counter->failcnt;
 	case RES_SOFT_LIMIT:
@@ -146,15 +142,15 @@ ssize_t res_counter_read(struct res_counter *counter, int member,
 		const char __user *userbuf, size_t nbytes, loff_t *pos,
 		int (*read_strategy)(unsigned long long val, char *st_buf))
 {
-	unsigned long long *val;
+	unsigned long long val;
 	char buf[64], *s;
 
 	s = buf;
-	val = res_counter_member(counter, member);
+	val = res_counter_read_u64(counter, member);
 	if (read_strategy)
-		s += read_strategy(*val, s);
+		s += read_strategy(val, s);
 	else
-		s += sprintf(s, "%llu\n", *val);
+		s += sprintf(s, "%llu\n", val);
 	return simple_read_from_buffer((void __user *)userbuf, nbytes,
 			pos, buf, s - buf);
 }
@@ -165,6 +161,13 @@ u64 res_counter_read_u64(struct res_counter *counter, int member)
 	unsigned long flags;
 	u64 ret;
 
+	switch (member) {
+	case RES_USAGE:
+		return atomic64_read(&counter->usage);
+	case RES_LIMIT:
+		return atomic64_read(&counter->limit);
+	}
+
 	spin_lock_irqsave(&counter->lock, flags);
 	ret = *res_counter_member(counter, member);
 	spin_unlock_irqrestore(&counter->lock, flags);
@@ -174,7 +177,14 @@ u64 res_counter_read_u64(struct res_counter *counter, int member)
 #else
 u64 res_counter_read_u64(struct res_counter *counter, int member)
 {
-	return *res_counter_member(counter, member);
+	switch (member) {
+	case RES_USAGE:
+		return atomic64_read(&counter->usage);
+	case RES_LIMIT:
+		return atomic64_read(&counter->limit);
+	}
+
+	return ACCESS_ONCE(*res_counter_member(counter, member));
 }
 #endif
 
@@ -321,8 +321,10 @@ static inline struct rq *__task_rq_lock(struct task_struct *p)
 			return rq;
 		raw_spin_unlock(&rq->lock);
 
-		while (unlikely(task_on_rq_migrating(p)))
+		while (unlikely(task_on_rq_migrating(p))) {
+			sched_migrate_pending(task_rq(p));
 			cpu_relax();
+		}
 	}
 }
 
@@ -344,8 +346,10 @@ static struct rq *task_rq_lock(struct task_struct *p, unsigned long *flags)
 		raw_spin_unlock(&rq->lock);
 		raw_spin_unlock_irqrestore(&p->pi_lock, *flags);
 
-		while (unlikely(task_on_rq_migrating(p)))
+		while (unlikely(task_on_rq_migrating(p))) {
+			sched_migrate_pending(task_rq(p));
 			cpu_relax();
+		}
 	}
 }
 
@@ -1568,6 +1572,49 @@ void sched_ttwu_pending(void)
 	raw_spin_unlock_irqrestore(&rq->lock, flags);
 }
 
+/*
+ * sched_migrate_queue - hand a task detached by the load balancer to @rq
+ *
+ * Instead of taking the remote rq->lock, the task is put on the inbox of
+ * @rq, which attaches it under its own lock from the scheduler IPI. The
+ * task stays TASK_ON_RQ_MIGRATING meanwhile, so its wake_entry is free.
+ */
+void sched_migrate_queue(struct rq *rq, struct task_struct *p)
+{
+	if (llist_add(&p->wake_entry, &rq->migrate_list))
+		smp_send_reschedule(cpu_of(rq));
+}
+
+/*
+ * sched_migrate_pending - attach the tasks on the inbox of @rq
+ *
+ * Called by the cpu of @rq, and by the task_rq_lock() waiters of a task on
+ * the inbox so that they can't wait forever on a cpu that has interrupts
+ * disabled.
+ */
+void sched_migrate_pending(struct rq *rq)
+{
+	struct llist_node *llist;
+	struct task_struct *p;
+	unsigned long flags;
+
+	if (llist_empty(&rq->migrate_list))
+		return;
+
+	raw_spin_lock_irqsave(&rq->lock, flags);
+	llist = llist_del_all(&rq->migrate_list);
+	while (llist) {
+		p = llist_entry(llist, struct task_struct, wake_entry);
+		llist = llist_next(llist);
+
+		BUG_ON(task_rq(p) != rq);
+		p->on_rq = TASK_ON_RQ_QUEUED;
+		activate_task(rq, p, 0);
+		check_preempt_curr(rq, p, 0);
+	}
+	raw_spin_unlock_irqrestore(&rq->lock, flags);
+}
+
 void scheduler_ipi(void)
 {
 	/*
@@ -1577,7 +1624,8 @@ void scheduler_ipi(void)
 	 */
 	preempt_fold_need_resched();
 
-	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick())
+	if (llist_empty(&this_rq()->wake_list) &&
+	    llist_empty(&this_rq()->migrate_list) && !got_nohz_idle_kick())
 		return;
 
 	/*
@@ -1595,6 +1643,7 @@ void scheduler_ipi(void)
 	 */
 	irq_enter();
 	sched_ttwu_pending();
+	sched_migrate_pending(this_rq());
 
 	/*
 	 * Check if someone kicked us for doing the nohz idle load balance.
@@ -1641,6 +1690,21 @@ bool cpus_share_cache(int this_cpu, int that_cpu)
 {
 	return per_cpu(sd_llc_id, this_cpu) == per_cpu(sd_llc_id, that_cpu);
 }
+
+/*
+ * Queue a remote wakeup on the wake_list of the target cpu when it doesn't
+ * share a cache with us, and also when its rq->lock already has waiters:
+ * queueing behind them costs more than the IPI, while the target cpu
+ * activates the whole wake_list under a single acquisition.
+ */
+static inline bool ttwu_queue_wakeup(int this_cpu, int cpu)
+{
+	if (!cpus_share_cache(this_cpu, cpu))
+		return true;
+
+	return sched_feat(TTWU_QUEUE_CONTENDED) && this_cpu != cpu &&
+	       raw_spin_is_contended(&cpu_rq(cpu)->lock);
+}
 #endif /* CONFIG_SMP */
 
 static void ttwu_queue(struct task_struct *p, int cpu)
@@ -1648,7 +1712,7 @@ static void ttwu_queue(struct task_struct *p, int cpu)
 	struct rq *rq = cpu_rq(cpu);
 
 #if defined(CONFIG_SMP)
-	if (sched_feat(TTWU_QUEUE) && !cpus_share_cache(smp_processor_id(), cpu)) {
+	if (sched_feat(TTWU_QUEUE) && ttwu_queue_wakeup(smp_processor_id(), cpu)) {
 		sched_clock_cpu(cpu); /* sync clocks x-cpu */
 		ttwu_queue_remote(p, cpu);
 		return;
@@ -1792,6 +1856,56 @@ int wake_up_state(struct task_struct *p, unsigned int state)
 	return try_to_wake_up(p, state, 0);
 }
 
+/**
+ * wake_q_add - queue a wakeup for a later wake_up_q()
+ * @head: the wake-queue
+ * @task: the task to wake up
+ *
+ * Typically called with a lock held that wake_up_q() is called after
+ * releasing. Takes a reference on @task unless it is already queued on
+ * some wake-queue, whose wakeup will then also do for this caller.
+ */
+void wake_q_add(struct wake_q_head *head, struct task_struct *task)
+{
+	struct wake_q_node *node = &task->wake_q;
+
+	/*
+	 * The cmpxchg() claims the node against concurrent wakers, and its
+	 * full barrier orders the caller's prior stores, which the wakee
+	 * checks, before the wakeup.
+	 */
+	if (cmpxchg(&node->next, NULL, WAKE_Q_TAIL))
+		return;
+
+	get_task_struct(task);
+
+	*head->lastp = node;
+	head->lastp = &node->next;
+}
+
+/**
+ * wake_up_q - wake up the tasks of a wake-queue
+ * @head: the wake-queue
+ *
+ * The tasks can be queued again as soon as they are off the queue, so
+ * the wakeup has to come after clearing their node.
+ */
+void wake_up_q(struct wake_q_head *head)
+{
+	struct wake_q_node *node = head->first;
+
+	while (node != WAKE_Q_TAIL) {
+		struct task_struct *task;
+
+		task = container_of(node, struct task_struct, wake_q);
+		node = node->next;
+		task->wake_q.next = NULL;
+
+		wake_up_process(task);
+		put_task_struct(task);
+	}
+}
+
 /*
  * This function clears the sched_dl_entity static params.
  */
@@ -3213,7 +3327,7 @@ int idle_cpu(int cpu)
 		return 0;
 
 #ifdef CONFIG_SMP
-	if (!llist_empty(&rq->wake_list))
+	if (!llist_empty(&rq->wake_list) || !llist_empty(&rq->migrate_list))
 		return 0;
 #endif
 
@@ -5201,6 +5315,7 @@ migration_call(struct notifier_block *nfb, unsigned long action, void *hcpu)
 #ifdef CONFIG_HOTPLUG_CPU
 	case CPU_DYING:
 		sched_ttwu_pending();
+		sched_migrate_pending(rq);
 		/* Update our root-domain */
 		raw_spin_lock_irqsave(&rq->lock, flags);
 		if (rq->rd) {
@@ -3,6 +3,11 @@
  *
  *  Global CPU deadline management
  *
+ *  The CPUs are split in groups, each with a max-heap of the deadlines of
+ *  its CPUs under its own lock, so that the updates on different groups
+ *  don't contend. The maximum of each heap is published when it changes,
+ *  the system-wide maximum is found by looking at those of all the groups.
+ *
  *  Author: Juri Lelli <j.lelli@sssup.it>
  *
  *  This program is free software; you can redistribute it and/or
@@ -14,6 +19,7 @@
 #include <linux/gfp.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/topology.h>
 #include "cpudeadline.h"
 
 static inline int parent(int i)
@@ -36,17 +42,18 @@ static inline int dl_time_before(u64 a, u64 b)
 	return (s64)(a - b) < 0;
 }
 
-static void cpudl_exchange(struct cpudl *cp, int a, int b)
+static void cpudl_exchange(struct cpudl *cp, struct cpudl_group *grp,
+			   int a, int b)
 {
-	int cpu_a = cp->elements[a].cpu, cpu_b = cp->elements[b].cpu;
+	int cpu_a = grp->heap[a].cpu, cpu_b = grp->heap[b].cpu;
 
-	swap(cp->elements[a].cpu, cp->elements[b].cpu);
-	swap(cp->elements[a].dl , cp->elements[b].dl );
+	swap(grp->heap[a].cpu, grp->heap[b].cpu);
+	swap(grp->heap[a].dl , grp->heap[b].dl );
 
 	swap(cp->elements[cpu_a].idx, cp->elements[cpu_b].idx);
 }
 
-static void cpudl_heapify(struct cpudl *cp, int idx)
+static void cpudl_heapify(struct cpudl *cp, struct cpudl_group *grp, int idx)
 {
 	int l, r, largest;
 
@@ -56,41 +63,98 @@ static void cpudl_heapify(struct cpudl *cp, int idx)
 		r = right_child(idx);
 		largest = idx;
 
-		if ((l < cp->size) && dl_time_before(cp->elements[idx].dl,
-							cp->elements[l].dl))
+		if ((l < grp->size) && dl_time_before(grp->heap[idx].dl,
+							grp->heap[l].dl))
 			largest = l;
-		if ((r < cp->size) && dl_time_before(cp->elements[largest].dl,
-							cp->elements[r].dl))
+		if ((r < grp->size) && dl_time_before(grp->heap[largest].dl,
+							grp->heap[r].dl))
 			largest = r;
 		if (largest == idx)
 			break;
 
 		/* Push idx down the heap one level and bump one up */
-		cpudl_exchange(cp, largest, idx);
+		cpudl_exchange(cp, grp, largest, idx);
 		idx = largest;
 	}
 }
 
-static void cpudl_change_key(struct cpudl *cp, int idx, u64 new_dl)
+static void cpudl_change_key(struct cpudl *cp, struct cpudl_group *grp,
+			     int idx, u64 new_dl)
 {
-	WARN_ON(idx == IDX_INVALID || !cpu_present(idx));
+	WARN_ON(idx == IDX_INVALID || idx >= grp->size);
 
-	if (dl_time_before(new_dl, cp->elements[idx].dl)) {
-		cp->elements[idx].dl = new_dl;
-		cpudl_heapify(cp, idx);
+	if (dl_time_before(new_dl, grp->heap[idx].dl)) {
+		grp->heap[idx].dl = new_dl;
+		cpudl_heapify(cp, grp, idx);
 	} else {
-		cp->elements[idx].dl = new_dl;
-		while (idx > 0 && dl_time_before(cp->elements[parent(idx)].dl,
-					cp->elements[idx].dl)) {
-			cpudl_exchange(cp, idx, parent(idx));
+		grp->heap[idx].dl = new_dl;
+		while (idx > 0 && dl_time_before(grp->heap[parent(idx)].dl,
+					grp->heap[idx].dl)) {
+			cpudl_exchange(cp, grp, idx, parent(idx));
 			idx = parent(idx);
 		}
 	}
 }
 
-static inline int cpudl_maximum(struct cpudl *cp)
+/*
+ * Publish the maximum of the group heap if it changed. Most updates don't
+ * change it, so the cache line read by cpudl_find() is left alone.
+ */
+static void cpudl_publish(struct cpudl_group *grp)
 {
-	return cp->elements[0].cpu;
+	int cpu = grp->size ? grp->heap[0].cpu : IDX_INVALID;
+	u64 dl = grp->size ? grp->heap[0].dl : 0;
+
+	if (cpu == grp->max_cpu && dl == grp->max_dl)
+		return;
+
+	ACCESS_ONCE(grp->max_cpu) = IDX_INVALID;
+	smp_wmb();
+	ACCESS_ONCE(grp->max_dl) = dl;
+	smp_wmb();
+	ACCESS_ONCE(grp->max_cpu) = cpu;
+}
+
+/*
+ * cpudl_maximum - find the latest deadline CPU the task can run on
+ * @cp: the cpudl max-heap context
+ * @p: the task
+ * @dl: the deadline of the selected CPU
+ *
+ * Only the maxima of the groups are looked at, without any lock. Like the
+ * push and pull code using it, the result is a hint that is checked again
+ * under the runqueue locks.
+ *
+ * Returns: int - the CPU, or -1 if there is none
+ */
+static int cpudl_maximum(struct cpudl *cp, struct task_struct *p, u64 *dl)
+{
+	int best_cpu = -1, cpu, i;
+	u64 best_dl = 0, max_dl;
+
+	for (i = 0; i < cp->nr_groups; i++) {
+		struct cpudl_group *grp = &cp->groups[i];
+
+		cpu = ACCESS_ONCE(grp->max_cpu);
+		if (cpu == IDX_INVALID)
+			continue;
+		smp_rmb();
+		max_dl = ACCESS_ONCE(grp->max_dl);
+		/* Pairs with the barriers of cpudl_publish() */
+		smp_rmb();
+		if (ACCESS_ONCE(grp->max_cpu) != cpu)
+			continue;
+
+		if (!cpumask_test_cpu(cpu, &p->cpus_allowed))
+			continue;
+		if (best_cpu == -1 || dl_time_before(best_dl, max_dl)) {
+			best_cpu = cpu;
+			best_dl = max_dl;
+		}
+	}
+
+	*dl = best_dl;
+	return best_cpu;
 }
 
 /*
@@ -104,15 +168,18 @@ static inline int cpudl_maximum(struct cpudl *cp)
 int cpudl_find(struct cpudl *cp, struct task_struct *p,
 	       struct cpumask *later_mask)
 {
-	int best_cpu = -1;
+	int best_cpu = -1, max_cpu;
 	const struct sched_dl_entity *dl_se = &p->dl;
+	u64 max_dl;
 
 	if (later_mask && cpumask_and(later_mask, later_mask, cp->free_cpus)) {
 		best_cpu = cpumask_any(later_mask);
 		goto out;
-	} else if (cpumask_test_cpu(cpudl_maximum(cp), &p->cpus_allowed) &&
-			dl_time_before(dl_se->deadline, cp->elements[0].dl)) {
-		best_cpu = cpudl_maximum(cp);
+	}
+
+	max_cpu = cpudl_maximum(cp, p, &max_dl);
+	if (max_cpu != -1 && dl_time_before(dl_se->deadline, max_dl)) {
+		best_cpu = max_cpu;
 		if (later_mask)
 			cpumask_set_cpu(best_cpu, later_mask);
 	}
@@ -129,18 +196,21 @@ out:
  * @cpu: the target cpu
  * @dl: the new earliest deadline for this cpu
  *
- * Notes: assumes cpu_rq(cpu)->lock is locked
+ * Notes: assumes cpu_rq(cpu)->lock is locked. Only the heap of the group
+ * of the cpu is locked and updated.
  *
  * Returns: (void)
  */
 void cpudl_set(struct cpudl *cp, int cpu, u64 dl, int is_valid)
 {
+	struct cpudl_group *grp;
 	int old_idx, new_cpu;
 	unsigned long flags;
 
 	WARN_ON(!cpu_present(cpu));
 
-	raw_spin_lock_irqsave(&cp->lock, flags);
+	grp = &cp->groups[cp->elements[cpu].group];
+	raw_spin_lock_irqsave(&grp->lock, flags);
 	old_idx = cp->elements[cpu].idx;
 	if (!is_valid) {
 		/* remove item */
@@ -152,37 +222,45 @@ void cpudl_set(struct cpudl *cp, int cpu, u64 dl, int is_valid)
 			 */
 			goto out;
 		}
-		new_cpu = cp->elements[cp->size - 1].cpu;
-		cp->elements[old_idx].dl = cp->elements[cp->size - 1].dl;
-		cp->elements[old_idx].cpu = new_cpu;
-		cp->size--;
+		new_cpu = grp->heap[grp->size - 1].cpu;
+		grp->heap[old_idx].dl = grp->heap[grp->size - 1].dl;
+		grp->heap[old_idx].cpu = new_cpu;
+		grp->size--;
 		cp->elements[new_cpu].idx = old_idx;
 		cp->elements[cpu].idx = IDX_INVALID;
 		while (old_idx > 0 && dl_time_before(
-				cp->elements[parent(old_idx)].dl,
-				cp->elements[old_idx].dl)) {
-			cpudl_exchange(cp, old_idx, parent(old_idx));
+				grp->heap[parent(old_idx)].dl,
+				grp->heap[old_idx].dl)) {
+			cpudl_exchange(cp, grp, old_idx, parent(old_idx));
 			old_idx = parent(old_idx);
 		}
 		cpumask_set_cpu(cpu, cp->free_cpus);
-                cpudl_heapify(cp, old_idx);
+		cpudl_heapify(cp, grp, old_idx);
 
 		goto out;
 	}
 
 	if (old_idx == IDX_INVALID) {
-		cp->size++;
-		cp->elements[cp->size - 1].dl = 0;
-		cp->elements[cp->size - 1].cpu = cpu;
-		cp->elements[cpu].idx = cp->size - 1;
-		cpudl_change_key(cp, cp->size - 1, dl);
+		grp->size++;
+		grp->heap[grp->size - 1].dl = 0;
+		grp->heap[grp->size - 1].cpu = cpu;
+		cp->elements[cpu].idx = grp->size - 1;
+		cpudl_change_key(cp, grp, grp->size - 1, dl);
 		cpumask_clear_cpu(cpu, cp->free_cpus);
 	} else {
-		cpudl_change_key(cp, old_idx, dl);
+		cpudl_change_key(cp, grp, old_idx, dl);
 	}
 
 out:
-	raw_spin_unlock_irqrestore(&cp->lock, flags);
+	cpudl_publish(grp);
+	raw_spin_unlock_irqrestore(&grp->lock, flags);
+}
+
+static int cpudl_node(int cpu)
+{
+	int node = cpu_to_node(cpu);
+
+	return node < 0 || node >= nr_node_ids ? 0 : node;
 }
 
 /*
@@ -191,11 +269,9 @@ out:
  */
 int cpudl_init(struct cpudl *cp)
 {
-	int i;
+	int i, node, nr, off;
 
 	memset(cp, 0, sizeof(*cp));
-	raw_spin_lock_init(&cp->lock);
-	cp->size = 0;
 
 	cp->elements = kcalloc(nr_cpu_ids,
 			       sizeof(struct cpudl_item),
@@ -203,17 +279,51 @@ int cpudl_init(struct cpudl *cp)
 	if (!cp->elements)
 		return -ENOMEM;
 
-	if (!alloc_cpumask_var(&cp->free_cpus, GFP_KERNEL)) {
-		kfree(cp->elements);
-		return -ENOMEM;
+	/* Group the CPUs of each node, CPUDL_GROUP_CPUS at most per group */
+	for (node = 0; node < nr_node_ids; node++) {
+		nr = 0;
+		for_each_possible_cpu(i) {
+			if (cpudl_node(i) != node)
+				continue;
+			if (nr++ % CPUDL_GROUP_CPUS == 0)
+				cp->nr_groups++;
+			cp->elements[i].group = cp->nr_groups - 1;
+		}
 	}
 
-	for_each_possible_cpu(i)
+	cp->groups = kcalloc(cp->nr_groups, sizeof(struct cpudl_group),
+			     GFP_KERNEL);
+	if (!cp->groups)
+		goto free_elements;
+
+	if (!alloc_cpumask_var(&cp->free_cpus, GFP_KERNEL))
+		goto free_groups;
+
+	for_each_possible_cpu(i) {
 		cp->elements[i].idx = IDX_INVALID;
+		cp->groups[cp->elements[i].group].size++;
+	}
+
+	/* Each group heap is a slice of the elements, as large as the group */
+	for (i = 0, off = 0; i < cp->nr_groups; i++) {
+		struct cpudl_group *grp = &cp->groups[i];
+
+		raw_spin_lock_init(&grp->lock);
+		grp->heap = cp->elements + off;
+		off += grp->size;
+		grp->size = 0;
+		grp->max_cpu = IDX_INVALID;
+	}
 
 	cpumask_setall(cp->free_cpus);
 
 	return 0;
+
+free_groups:
+	kfree(cp->groups);
+free_elements:
+	kfree(cp->elements);
+	return -ENOMEM;
 }
 
 /*
@@ -223,5 +333,6 @@ int cpudl_init(struct cpudl *cp)
 void cpudl_cleanup(struct cpudl *cp)
 {
 	free_cpumask_var(cp->free_cpus);
+	kfree(cp->groups);
 	kfree(cp->elements);
 }
@@ -5,15 +5,34 @@
 
 #define IDX_INVALID     -1
 
+/*
+ * Maximum number of CPUs sharing a heap and its lock. The CPUs of a node
+ * are split in groups of at most this size, about the size of an LLC.
+ */
+#define CPUDL_GROUP_CPUS	16
+
 struct cpudl_item {
 	u64 dl;
 	int cpu;
-	int idx;
+	int idx;	/* of the cpu, in the heap of its group */
+	int group;	/* of the cpu */
 };
 
-struct cpudl {
+/*
+ * The max-heap of the CPUs of a group, and its maximum published for
+ * cpudl_find(), which reads the maxima of all the groups locklessly.
+ */
+struct cpudl_group {
 	raw_spinlock_t lock;
 	int size;
+	struct cpudl_item *heap;
+	u64 max_dl;
+	int max_cpu;	/* IDX_INVALID if the heap is empty */
+} ____cacheline_aligned_in_smp;
+
+struct cpudl {
+	int nr_groups;
+	struct cpudl_group *groups;
 	cpumask_var_t free_cpus;
 	struct cpudl_item *elements;
 };
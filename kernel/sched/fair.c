@@ -5469,34 +5469,46 @@ static void attach_task(struct rq *rq, struct task_struct *p)
 
 /*
  * attach_one_task() -- attaches the task returned from detach_one_task() to
- * its new rq.
+ * its new rq. A contended remote rq->lock isn't waited for, the task goes
+ * to the inbox of the rq instead.
  */
 static void attach_one_task(struct rq *rq, struct task_struct *p)
 {
-	raw_spin_lock(&rq->lock);
+	if (!raw_spin_trylock(&rq->lock)) {
+		sched_migrate_queue(rq, p);
+		return;
+	}
 	attach_task(rq, p);
 	raw_spin_unlock(&rq->lock);
 }
 
 /*
  * attach_tasks() -- attaches all tasks detached by detach_tasks() to their
- * new rq.
+ * new rq, through its inbox if it is a remote rq with its lock contended.
  */
 static void attach_tasks(struct lb_env *env)
 {
 	struct list_head *tasks = &env->tasks;
 	struct task_struct *p;
+	bool queue = false;
 
-	raw_spin_lock(&env->dst_rq->lock);
+	if (env->dst_rq == this_rq())
+		raw_spin_lock(&env->dst_rq->lock);
+	else if (!raw_spin_trylock(&env->dst_rq->lock))
+		queue = true;
 
 	while (!list_empty(tasks)) {
 		p = list_first_entry(tasks, struct task_struct, se.group_node);
 		list_del_init(&p->se.group_node);
 
-		attach_task(env->dst_rq, p);
+		if (queue)
+			sched_migrate_queue(env->dst_rq, p);
+		else
+			attach_task(env->dst_rq, p);
 	}
 
-	raw_spin_unlock(&env->dst_rq->lock);
+	if (!queue)
+		raw_spin_unlock(&env->dst_rq->lock);
 }
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -6676,7 +6688,17 @@ redo:
 		env.loop_max  = min(sysctl_sched_nr_migrate, busiest->nr_running);
 
 more_balance:
-		raw_spin_lock_irqsave(&busiest->lock, flags);
+		/*
+		 * The newly idle cpus of a large machine tend to all go
+		 * for the same busiest rq at once. Don't queue up on its
+		 * lock; the next idle or periodic balance retries.
+		 */
+		if (idle == CPU_NEWLY_IDLE) {
+			if (!raw_spin_trylock_irqsave(&busiest->lock, flags))
+				goto out;
+		} else {
+			raw_spin_lock_irqsave(&busiest->lock, flags);
+		}
 
 		/*
 		 * cur_ld_moved - load moved in current iteration
@@ -56,6 +56,12 @@ SCHED_FEAT(NONTASK_CAPACITY, true)
  */
 SCHED_FEAT(TTWU_QUEUE, true)
 
+/*
+ * Also queue the remote wakeups on cpus sharing our cache when their
+ * rq->lock is contended.
+ */
+SCHED_FEAT(TTWU_QUEUE_CONTENDED, true)
+
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
@@ -643,6 +643,8 @@ struct rq {
 
 #ifdef CONFIG_SMP
 	struct llist_head wake_list;
+	/* Tasks detached by the load balancer, see sched_migrate_queue() */
+	struct llist_head migrate_list;
 #endif
 
 #ifdef CONFIG_CPU_IDLE
@@ -687,6 +689,8 @@ extern int migrate_swap(struct task_struct *, struct task_struct *);
 #ifdef CONFIG_SMP
 
 extern void sched_ttwu_pending(void);
+extern void sched_migrate_queue(struct rq *rq, struct task_struct *p);
+extern void sched_migrate_pending(struct rq *rq);
 
 #define rcu_dereference_check_sched_domain(p) \
 	rcu_dereference_check((p), \
@@ -808,6 +812,7 @@ extern int group_balance_cpu(struct sched_group *sg);
 #else
 
 static inline void sched_ttwu_pending(void) { }
+static inline void sched_migrate_pending(struct rq *rq) { }
 
 #endif /* CONFIG_SMP */
 
@@ -1360,9 +1365,7 @@ static inline int _double_lock_balance(struct rq *this_rq, struct rq *busiest)
 	if (unlikely(!raw_spin_trylock(&busiest->lock))) {
 		if (busiest < this_rq) {
 			raw_spin_unlock(&this_rq->lock);
-			raw_spin_lock(&busiest->lock);
-			raw_spin_lock_nested(&this_rq->lock,
-					      SINGLE_DEPTH_NESTING);
+			raw_spin_lock_pair(&this_rq->lock, &busiest->lock);
 			ret = 1;
 		} else
 			raw_spin_lock_nested(&busiest->lock,
@@ -1396,29 +1399,18 @@ static inline void double_unlock_balance(struct rq *this_rq, struct rq *busiest)
 
 static inline void double_lock(spinlock_t *l1, spinlock_t *l2)
 {
-	if (l1 > l2)
-		swap(l1, l2);
-
-	spin_lock(l1);
-	spin_lock_nested(l2, SINGLE_DEPTH_NESTING);
+	spin_lock_pair(l1, l2);
 }
 
 static inline void double_lock_irq(spinlock_t *l1, spinlock_t *l2)
 {
-	if (l1 > l2)
-		swap(l1, l2);
-
-	spin_lock_irq(l1);
-	spin_lock_nested(l2, SINGLE_DEPTH_NESTING);
+	local_irq_disable();
+	spin_lock_pair(l1, l2);
 }
 
 static inline void double_raw_lock(raw_spinlock_t *l1, raw_spinlock_t *l2)
 {
-	if (l1 > l2)
-		swap(l1, l2);
-
-	raw_spin_lock(l1);
-	raw_spin_lock_nested(l2, SINGLE_DEPTH_NESTING);
+	raw_spin_lock_pair(l1, l2);
 }
 
 /*
@@ -1436,13 +1428,7 @@ static inline void double_rq_lock(struct rq *rq1, struct rq *rq2)
 		raw_spin_lock(&rq1->lock);
 		__acquire(rq2->lock);	/* Fake it out ;) */
 	} else {
-		if (rq1 < rq2) {
-			raw_spin_lock(&rq1->lock);
-			raw_spin_lock_nested(&rq2->lock, SINGLE_DEPTH_NESTING);
-		} else {
-			raw_spin_lock(&rq2->lock);
-			raw_spin_lock_nested(&rq1->lock, SINGLE_DEPTH_NESTING);
-		}
+		raw_spin_lock_pair(&rq1->lock, &rq2->lock);
 	}
 }
 
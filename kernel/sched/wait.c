@@ -9,6 +9,8 @@
 #include <linux/mm.h>
 #include <linux/wait.h>
 #include <linux/hash.h>
+#include <linux/percpu.h>
+#include <linux/interrupt.h>
 
 void __init_waitqueue_head(wait_queue_head_t *q, const char *name, struct lock_class_key *key)
 {
@@ -27,6 +29,7 @@ void add_wait_queue(wait_queue_head_t *q, wait_queue_t *wait)
 	spin_lock_irqsave(&q->lock, flags);
 	__add_wait_queue(q, wait);
 	spin_unlock_irqrestore(&q->lock, flags);
+	smp_mb();	/* see wake_up_needed() */
 }
 EXPORT_SYMBOL(add_wait_queue);
 
@@ -38,6 +41,7 @@ void add_wait_queue_exclusive(wait_queue_head_t *q, wait_queue_t *wait)
 	spin_lock_irqsave(&q->lock, flags);
 	__add_wait_queue_tail(q, wait);
 	spin_unlock_irqrestore(&q->lock, flags);
+	smp_mb();	/* see wake_up_needed() */
 }
 EXPORT_SYMBOL(add_wait_queue_exclusive);
 
@@ -75,6 +79,25 @@ static void __wake_up_common(wait_queue_head_t *q, unsigned int mode,
 	}
 }
 
+/*
+ * Lockless check for waiters, so that the wakeups that find nobody to
+ * wake, the common case in completion paths, don't bounce q->lock.
+ *
+ * The smp_mb() orders the waker's store to the wait condition before the
+ * load of the list.  It pairs with the full barrier every waiter has
+ * between queueing itself and testing the condition: set_current_state()
+ * in prepare_to_wait*(), the smp_mb() in add_wait_queue*().  Either the
+ * waker sees the waiter queued, or the waiter sees the condition.  Code
+ * that open-codes __add_wait_queue() must provide the same barrier, or
+ * test the condition under q->lock with a waker that uses the _locked
+ * variants.
+ */
+static inline bool wake_up_needed(wait_queue_head_t *q)
+{
+	smp_mb();
+	return waitqueue_active(q);
+}
+
 /**
  * __wake_up - wake up threads blocked on a waitqueue.
  * @q: the waitqueue
@@ -90,6 +113,9 @@ void __wake_up(wait_queue_head_t *q, unsigned int mode,
 {
 	unsigned long flags;
 
+	if (!wake_up_needed(q))
+		return;
+
 	spin_lock_irqsave(&q->lock, flags);
 	__wake_up_common(q, mode, nr_exclusive, 0, key);
 	spin_unlock_irqrestore(&q->lock, flags);
@@ -140,12 +166,86 @@ void __wake_up_sync_key(wait_queue_head_t *q, unsigned int mode,
 	if (unlikely(nr_exclusive != 1))
 		wake_flags = 0;
 
+	if (!wake_up_needed(q))
+		return;
+
 	spin_lock_irqsave(&q->lock, flags);
 	__wake_up_common(q, mode, nr_exclusive, wake_flags, key);
 	spin_unlock_irqrestore(&q->lock, flags);
 }
 EXPORT_SYMBOL_GPL(__wake_up_sync_key);
 
+/*
+ * Wakeups queued by wake_up_many() during a softirq run.
+ */
+#define WAKE_UP_MANY_MAX	16
+
+struct wake_up_many_batch {
+	unsigned int		nr;
+	struct {
+		wait_queue_head_t	*q;
+		int			nr_exclusive;
+	} ent[WAKE_UP_MANY_MAX];
+};
+
+static DEFINE_PER_CPU(struct wake_up_many_batch, wake_up_many_batch);
+
+/**
+ * wake_up_many - wake up a waitqueue, batched over the softirq run
+ * @q: the waitqueue
+ *
+ * Like wake_up(), but when called from a softirq handler the wakeup is
+ * only recorded, and all the wakeups of the run are issued once it ends,
+ * from wake_up_many_flush().  Repeated calls for the same @q coalesce into
+ * one __wake_up() waking as many exclusive waiters as there were calls,
+ * so a completion path that wakes the same head for every packet or
+ * request takes q->lock once per softirq run.
+ *
+ * The caller must keep @q valid until the softirq run ends.  Outside
+ * softirq context this is a plain wake_up().
+ */
+void wake_up_many(wait_queue_head_t *q)
+{
+	struct wake_up_many_batch *b;
+	unsigned int i;
+
+	if (!in_serving_softirq() || in_irq() || in_nmi()) {
+		__wake_up(q, TASK_NORMAL, 1, NULL);
+		return;
+	}
+
+	b = this_cpu_ptr(&wake_up_many_batch);
+	for (i = 0; i < b->nr; i++) {
+		if (b->ent[i].q == q) {
+			b->ent[i].nr_exclusive++;
+			return;
+		}
+	}
+
+	if (b->nr == WAKE_UP_MANY_MAX)
+		wake_up_many_flush();
+
+	b->ent[b->nr].q = q;
+	b->ent[b->nr].nr_exclusive = 1;
+	b->nr++;
+}
+EXPORT_SYMBOL(wake_up_many);
+
+/*
+ * Issue the wakeups recorded by wake_up_many().  Called at the end of
+ * each softirq run, in softirq context.
+ */
+void wake_up_many_flush(void)
+{
+	struct wake_up_many_batch *b = this_cpu_ptr(&wake_up_many_batch);
+	unsigned int i;
+
+	for (i = 0; i < b->nr; i++)
+		__wake_up(b->ent[i].q, TASK_NORMAL, b->ent[i].nr_exclusive,
+			  NULL);
+	b->nr = 0;
+}
+
 /*
  * __wake_up_sync - see __wake_up_sync_key()
  */
@@ -132,6 +132,7 @@ static inline int has_pending_signals(sigset_t *signal, sigset_t *blocked)
 static int recalc_sigpending_tsk(struct task_struct *t)
 {
 	if ((t->jobctl & JOBCTL_PENDING_MASK) ||
+	    ACCESS_ONCE(t->sigfast_pending) ||
 	    PENDING(&t->pending, &t->blocked) ||
 	    PENDING(&t->signal->shared_pending, &t->blocked)) {
 		set_tsk_thread_flag(t, TIF_SIGPENDING);
@@ -157,9 +158,16 @@ void recalc_sigpending_and_wake(struct task_struct *t)
 
 void recalc_sigpending(void)
 {
-	if (!recalc_sigpending_tsk(current) && !freezing(current))
+	if (!recalc_sigpending_tsk(current) && !freezing(current)) {
 		clear_thread_flag(TIF_SIGPENDING);
-
+		/*
+		 * send_signal_fast() sets ->sigfast_pending before the flag
+		 * and does not take siglock, so recheck after clearing it.
+		 */
+		smp_mb__after_atomic();
+		if (ACCESS_ONCE(current->sigfast_pending))
+			set_thread_flag(TIF_SIGPENDING);
+	}
 }
 
 /* Given the mask, find the first available signal that should be serviced. */
@@ -419,6 +427,7 @@ void flush_sigqueue(struct sigpending *queue)
 void __flush_signals(struct task_struct *t)
 {
 	clear_tsk_thread_flag(t, TIF_SIGPENDING);
+	t->sigfast_pending = 0;
 	flush_sigqueue(&t->pending);
 	flush_sigqueue(&t->signal->shared_pending);
 }
@@ -601,6 +610,8 @@ static int __dequeue_signal(struct sigpending *pending, sigset_t *mask,
 	return sig;
 }
 
+static void sigfast_flush(struct task_struct *t);
+
 /*
  * Dequeue a signal and return the element to the caller, which is
  * expected to free it.
@@ -611,6 +622,8 @@ int dequeue_signal(struct task_struct *tsk, sigset_t *mask, siginfo_t *info)
 {
 	int signr;
 
+	sigfast_flush(tsk);
+
 	/* We only dequeue private signals from ourselves, we don't let
 	 * signalfd steal them
 	 */
@@ -1137,6 +1150,81 @@ static int send_signal(int sig, struct siginfo *info, struct task_struct *t,
 	return __send_signal(sig, info, t, group, from_ancestor_ns);
 }
 
+/*
+ * Fast path for thread-directed kernel signals (SEND_SIG_PRIV, e.g. a
+ * profiling timer sending SIGPROF to each thread).
+ *
+ * sighand->siglock is shared by every thread of the process, so with many
+ * threads receiving high-rate signals the senders serialise on it. When
+ * the signal has a user handler, has no side effects at generation time
+ * (stop, continue, kill) and the target is not traced or exiting, we only
+ * set a bit in the target's ->sigfast_pending and TIF_SIGPENDING. The
+ * target turns the bit into a regular pending signal with __send_signal()
+ * under its own siglock, on its way to get_signal(), so all the generation
+ * time rules are still applied, just on the receiving side.
+ *
+ * The handler is read under sighand->action_seq; a racing do_sigaction()
+ * sends us down the slow path.
+ */
+#define SIGFAST_MASK \
+	(~(sigmask(SIGKILL) | sigmask(SIGSTOP) | sigmask(SIGCONT) | \
+	   sigmask(SIGTSTP) | sigmask(SIGTTIN) | sigmask(SIGTTOU)))
+
+static bool send_signal_fast(int sig, struct siginfo *info,
+			     struct task_struct *t)
+{
+	struct sighand_struct *sighand;
+	__sighandler_t handler;
+	unsigned int seq;
+	bool ret = false;
+
+	if (info != SEND_SIG_PRIV || sig >= SIGRTMIN ||
+	    !(sigmask(sig) & SIGFAST_MASK))
+		return false;
+	if (t->ptrace || (t->flags & PF_EXITING))
+		return false;
+
+	rcu_read_lock();
+	sighand = rcu_dereference(t->sighand);
+	if (!sighand)
+		goto out;
+
+	seq = read_seqcount_begin(&sighand->action_seq);
+	handler = sighand->action[sig - 1].sa.sa_handler;
+	if (handler == SIG_DFL || handler == SIG_IGN)
+		goto out;
+	if (read_seqcount_retry(&sighand->action_seq, seq) ||
+	    sighand != ACCESS_ONCE(t->sighand))
+		goto out;
+
+	set_bit(sig - 1, &t->sigfast_pending);
+	smp_mb__after_atomic();
+	set_tsk_thread_flag(t, TIF_SIGPENDING);
+	if (!wake_up_state(t, TASK_INTERRUPTIBLE))
+		kick_process(t);
+	ret = true;
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+/*
+ * Turn the signals queued by send_signal_fast() into regular pending
+ * signals. Called by the target itself, with siglock held.
+ */
+static void sigfast_flush(struct task_struct *t)
+{
+	unsigned long pending;
+	int bit;
+
+	if (likely(!ACCESS_ONCE(t->sigfast_pending)))
+		return;
+
+	pending = xchg(&t->sigfast_pending, 0);
+	for_each_set_bit(bit, &pending, BITS_PER_LONG)
+		__send_signal(bit + 1, SEND_SIG_PRIV, t, 0, 0);
+}
+
 static void print_fatal_signal(int signr)
 {
 	struct pt_regs *regs = signal_pt_regs();
@@ -1188,6 +1276,9 @@ int do_send_sig_info(int sig, struct siginfo *info, struct task_struct *p,
 	unsigned long flags;
 	int ret = -ESRCH;
 
+	if (!group && send_signal_fast(sig, info, p))
+		return 0;
+
 	if (lock_task_sighand(p, &flags)) {
 		ret = send_signal(sig, info, p, group);
 		unlock_task_sighand(p, &flags);
@@ -2191,6 +2282,7 @@ int get_signal(struct ksignal *ksig)
 
 relock:
 	spin_lock_irq(&sighand->siglock);
+	sigfast_flush(current);
 	/*
 	 * Every stopped thread goes here after wakeup. Check to see if
 	 * we should notify the parent, prepare_signal(SIGCONT) encodes
@@ -2653,6 +2745,7 @@ static int do_sigpending(void *set, unsigned long sigsetsize)
 		return -EINVAL;
 
 	spin_lock_irq(&current->sighand->siglock);
+	sigfast_flush(current);
 	sigorsets(set, &current->pending.signal,
 		  &current->signal->shared_pending.signal);
 	spin_unlock_irq(&current->sighand->siglock);
@@ -3105,7 +3198,9 @@ int do_sigaction(int sig, struct k_sigaction *act, struct k_sigaction *oact)
 	if (act) {
 		sigdelsetmask(&act->sa.sa_mask,
 			      sigmask(SIGKILL) | sigmask(SIGSTOP));
+		write_seqcount_begin(&p->sighand->action_seq);
 		*k = *act;
+		write_seqcount_end(&p->sighand->action_seq);
 		/*
 		 * POSIX 3.3.1.3:
 		 *  "Setting a signal action to SIG_IGN for a signal that is
@@ -22,8 +22,20 @@ enum {
 	CSD_FLAG_WAIT		= 0x02,
 };
 
+/*
+ * Number of call_single_data slots a CPU keeps per target for
+ * asynchronous calls, so that back-to-back calls do not wait in
+ * csd_lock() for the previous one to be run.
+ */
+#define CSD_POOL_SIZE		4
+
+struct csd_pool {
+	struct call_single_data	csd[CSD_POOL_SIZE];
+	unsigned int		last;	/* slot handed out last */
+};
+
 struct call_function_data {
-	struct call_single_data	__percpu *csd;
+	struct csd_pool		__percpu *pool;
 	cpumask_var_t		cpumask;
 };
 
@@ -45,8 +57,8 @@ hotplug_cfd(struct notifier_block *nfb, unsigned long action, void *hcpu)
 		if (!zalloc_cpumask_var_node(&cfd->cpumask, GFP_KERNEL,
 				cpu_to_node(cpu)))
 			return notifier_from_errno(-ENOMEM);
-		cfd->csd = alloc_percpu(struct call_single_data);
-		if (!cfd->csd) {
+		cfd->pool = alloc_percpu(struct csd_pool);
+		if (!cfd->pool) {
 			free_cpumask_var(cfd->cpumask);
 			return notifier_from_errno(-ENOMEM);
 		}
@@ -60,7 +72,7 @@ hotplug_cfd(struct notifier_block *nfb, unsigned long action, void *hcpu)
 	case CPU_DEAD:
 	case CPU_DEAD_FROZEN:
 		free_cpumask_var(cfd->cpumask);
-		free_percpu(cfd->csd);
+		free_percpu(cfd->pool);
 		break;
 
 	case CPU_DYING:
@@ -136,7 +148,28 @@ static void csd_unlock(struct call_single_data *csd)
 	csd->flags &= ~CSD_FLAG_LOCK;
 }
 
-static DEFINE_PER_CPU_SHARED_ALIGNED(struct call_single_data, csd_data);
+/*
+ * Hand out the next slot of @pool, preferring one that is not in flight.
+ * When all of them are, the oldest one is returned and csd_lock() waits
+ * for it. Must be called with preemption disabled, from the CPU owning
+ * @pool.
+ */
+static struct call_single_data *csd_pool_get(struct csd_pool *pool)
+{
+	unsigned int i, idx;
+
+	for (i = 1; i <= CSD_POOL_SIZE; i++) {
+		idx = (pool->last + i) % CSD_POOL_SIZE;
+		if (!(pool->csd[idx].flags & CSD_FLAG_LOCK))
+			goto found;
+	}
+	idx = (pool->last + 1) % CSD_POOL_SIZE;
+found:
+	pool->last = idx;
+	return &pool->csd[idx];
+}
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct csd_pool, csd_data);
 
 /*
  * Insert a previously allocated call_single_data element
@@ -165,7 +198,7 @@ static int generic_exec_single(int cpu, struct call_single_data *csd,
 	if (!csd) {
 		csd = &csd_stack;
 		if (!wait)
-			csd = this_cpu_ptr(&csd_data);
+			csd = csd_pool_get(this_cpu_ptr(&csd_data));
 	}
 
 	csd_lock(csd);
@@ -328,6 +361,79 @@ int smp_call_function_single_async(int cpu, struct call_single_data *csd)
 }
 EXPORT_SYMBOL_GPL(smp_call_function_single_async);
 
+/**
+ * smp_call_function_batch(): Run several functions on a specific CPU
+ *			      with a single IPI.
+ * @cpu: The CPU to run on.
+ * @csd: Array of @nr data structures with ->func and ->info set up
+ * @nr: Number of entries in @csd
+ * @wait: If true, wait until all the functions have completed.
+ *
+ * The functions are queued on @cpu all at once and run there in array
+ * order, from the one IPI sent if its queue was empty. As with
+ * smp_call_function_single_async(), the caller owns @csd: without @wait
+ * it must not reuse the array before the calls have run. With @wait the
+ * array may live on the stack.
+ *
+ * Returns 0 on success, else a negative status code.
+ */
+int smp_call_function_batch(int cpu, struct call_single_data *csd,
+			    unsigned int nr, int wait)
+{
+	struct llist_node *first = NULL;
+	unsigned long flags;
+	unsigned int i;
+	int err = 0;
+
+	if (!nr)
+		return 0;
+
+	preempt_disable();
+
+	/* Same deadlock rule as smp_call_function_single(). */
+	WARN_ON_ONCE(wait && cpu_online(smp_processor_id()) &&
+		     irqs_disabled() && !oops_in_progress);
+
+	if (cpu == smp_processor_id()) {
+		local_irq_save(flags);
+		for (i = 0; i < nr; i++)
+			csd[i].func(csd[i].info);
+		local_irq_restore(flags);
+		goto out;
+	}
+
+	if ((unsigned)cpu >= nr_cpu_ids || !cpu_online(cpu)) {
+		err = -ENXIO;
+		goto out;
+	}
+
+	/*
+	 * Chain the entries newest first, the order llist_add() would
+	 * leave them in, so the queue flush runs them in array order.
+	 */
+	for (i = 0; i < nr; i++) {
+		csd_lock(&csd[i]);
+		if (wait)
+			csd[i].flags |= CSD_FLAG_WAIT;
+		csd[i].llist.next = first;
+		first = &csd[i].llist;
+	}
+
+	if (llist_add_batch(first, &csd[0].llist,
+			    &per_cpu(call_single_queue, cpu)))
+		arch_send_call_function_single_ipi(cpu);
+
+	if (wait) {
+		for (i = 0; i < nr; i++)
+			csd_lock_wait(&csd[i]);
+	}
+out:
+	preempt_enable();
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(smp_call_function_batch);
+
 /*
  * smp_call_function_any - Run a function on any of the given cpus
  * @mask: The mask of cpus it can run on.
@@ -430,8 +536,9 @@ void smp_call_function_many(const struct cpumask *mask,
 		return;
 
 	for_each_cpu(cpu, cfd->cpumask) {
-		struct call_single_data *csd = per_cpu_ptr(cfd->csd, cpu);
+		struct call_single_data *csd;
 
+		csd = csd_pool_get(per_cpu_ptr(cfd->pool, cpu));
 		csd_lock(csd);
 		csd->func = func;
 		csd->info = info;
@@ -443,10 +550,9 @@ void smp_call_function_many(const struct cpumask *mask,
 
 	if (wait) {
 		for_each_cpu(cpu, cfd->cpumask) {
-			struct call_single_data *csd;
+			struct csd_pool *pool = per_cpu_ptr(cfd->pool, cpu);
 
-			csd = per_cpu_ptr(cfd->csd, cpu);
-			csd_lock_wait(csd);
+			csd_lock_wait(&pool->csd[pool->last]);
 		}
 	}
 }
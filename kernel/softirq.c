@@ -278,6 +278,7 @@ restart:
 		pending >>= softirq_bit;
 	}
 
+	wake_up_many_flush();
 	rcu_bh_qs();
 	local_irq_disable();
 
@@ -41,6 +41,7 @@
 #include <linux/syscore_ops.h>
 #include <linux/version.h>
 #include <linux/ctype.h>
+#include <linux/futex.h>
 
 #include <linux/compat.h>
 #include <linux/syscalls.h>
@@ -2193,6 +2194,16 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			return -EINVAL;
 		error = !!(me->mm->def_flags & VM_NOHUGEPAGE);
 		break;
+	case PR_SET_FUTEX_HASH:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = futex_hash_set(arg2);
+		break;
+	case PR_GET_FUTEX_HASH:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = futex_hash_get();
+		break;
 	case PR_SET_THP_DISABLE:
 		if (arg3 || arg4 || arg5)
 			return -EINVAL;
@@ -916,6 +916,40 @@ remove_hrtimer(struct hrtimer *timer, struct hrtimer_clock_base *base)
 	return 0;
 }
 
+/*
+ * A timer restarted from its own callback can't be migrated nor expire
+ * before the callback returns, and the expiry code takes the base lock
+ * again right after it. The restart is only recorded in the cpu base,
+ * without the lock, and __run_hrtimer() enqueues the timer.
+ */
+static int hrtimer_start_running(struct hrtimer *timer, ktime_t tim,
+				 unsigned long delta_ns,
+				 const enum hrtimer_mode mode)
+{
+	struct hrtimer_cpu_base *cpu_base;
+	unsigned long flags;
+	int ret = 0;
+
+	local_irq_save(flags);
+	cpu_base = this_cpu_ptr(&hrtimer_bases);
+	if (cpu_base->running == timer) {
+		if (mode & HRTIMER_MODE_REL) {
+			tim = ktime_add_safe(tim, timer->base->get_time());
+#ifdef CONFIG_TIME_LOW_RES
+			tim = ktime_add_safe(tim, timer->base->resolution);
+#endif
+		}
+		timer_stats_hrtimer_set_start_info(timer);
+		cpu_base->rearm_expires = tim;
+		cpu_base->rearm_delta = delta_ns;
+		cpu_base->rearm = 1;
+		ret = 1;
+	}
+	local_irq_restore(flags);
+
+	return ret;
+}
+
 int __hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 		unsigned long delta_ns, const enum hrtimer_mode mode,
 		int wakeup)
@@ -924,6 +958,11 @@ int __hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 	unsigned long flags;
 	int ret, leftmost;
 
+	/* The timer is not queued while its callback runs, hence 0 */
+	if (hrtimer_callback_running(timer) &&
+	    hrtimer_start_running(timer, tim, delta_ns, mode))
+		return 0;
+
 	base = lock_hrtimer_base(timer, &flags);
 
 	/* Remove an active timer from the queue: */
@@ -1213,11 +1252,27 @@ static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
 	 * they get migrated to another cpu, therefore its safe to unlock
 	 * the timer base.
 	 */
+	cpu_base->running = timer;
+	cpu_base->rearm = 0;
 	raw_spin_unlock(&cpu_base->lock);
 	trace_hrtimer_expire_entry(timer, now);
 	restart = fn(timer);
 	trace_hrtimer_expire_exit(timer);
 	raw_spin_lock(&cpu_base->lock);
+	cpu_base->running = NULL;
+
+	/*
+	 * Restarted from the callback, see hrtimer_start_running(). A start
+	 * from another cpu meanwhile is overridden, as if this one came
+	 * right after it.
+	 */
+	if (cpu_base->rearm) {
+		if (timer->state & HRTIMER_STATE_ENQUEUED)
+			__remove_hrtimer(timer, base, HRTIMER_STATE_CALLBACK, 0);
+		hrtimer_set_expires_range_ns(timer, cpu_base->rearm_expires,
+					     cpu_base->rearm_delta);
+		enqueue_hrtimer(timer, base);
+	}
 
 	/*
 	 * Note: We clear the CALLBACK bit after enqueue_hrtimer and
@@ -41,6 +41,12 @@ DEFINE_PER_CPU(struct tick_sched, tick_cpu_sched);
  */
 static ktime_t last_jiffies_update;
 
+/*
+ * Set by the CPU elected to update jiffies. The other CPUs racing into the
+ * update return instead of queueing on jiffies_lock behind it.
+ */
+static atomic_t jiffies_updating = ATOMIC_INIT(0);
+
 struct tick_sched *tick_get_tick_sched(int cpu)
 {
 	return &per_cpu(tick_cpu_sched, cpu);
@@ -61,6 +67,14 @@ static void tick_do_update_jiffies64(ktime_t now)
 	if (delta.tv64 < tick_period.tv64)
 		return;
 
+	/*
+	 * Somebody else is doing the update. It may miss the last tick if
+	 * its time is a bit older than ours, the next update catches it up.
+	 */
+	if (atomic_read(&jiffies_updating) ||
+	    atomic_cmpxchg(&jiffies_updating, 0, 1))
+		return;
+
 	/* Reevalute with jiffies_lock held */
 	write_seqlock(&jiffies_lock);
 
@@ -86,10 +100,13 @@ static void tick_do_update_jiffies64(ktime_t now)
 		tick_next_period = ktime_add(last_jiffies_update, tick_period);
 	} else {
 		write_sequnlock(&jiffies_lock);
-		return;
+		goto out;
 	}
 	write_sequnlock(&jiffies_lock);
 	update_wall_time();
+out:
+	smp_mb__before_atomic();
+	atomic_set(&jiffies_updating, 0);
 }
 
 /*
@@ -570,7 +587,9 @@ EXPORT_SYMBOL_GPL(get_cpu_iowait_time_us);
 static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 					 ktime_t now, int cpu)
 {
-	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
+	static DEFINE_SEQLOCK_SITE(site);
+	struct seqlock_read sr = SEQLOCK_READ_INIT;
+	unsigned long last_jiffies, next_jiffies, delta_jiffies;
 	ktime_t last_update, expires, ret = { .tv64 = 0 };
 	unsigned long rcu_delta_jiffies;
 	struct clock_event_device *dev = __this_cpu_read(tick_cpu_device.evtdev);
@@ -578,12 +597,16 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 
 	time_delta = timekeeping_max_deferment();
 
-	/* Read jiffies and the time when jiffies were updated last */
+	/*
+	 * Read jiffies and the time when jiffies were updated last. Interrupts
+	 * are disabled, so the locked read can't deadlock with the tick.
+	 */
 	do {
-		seq = read_seqbegin(&jiffies_lock);
+		read_seqbegin_adaptive(&jiffies_lock, &sr);
 		last_update = last_jiffies_update;
 		last_jiffies = jiffies;
-	} while (read_seqretry(&jiffies_lock, seq));
+	} while (read_seqretry_adaptive(&jiffies_lock, &sr, &site));
+	done_seqretry_adaptive(&jiffies_lock, &sr, &site);
 
 	if (rcu_needs_cpu(cpu, &rcu_delta_jiffies) ||
 	    arch_needs_cpu() || irq_work_needs_cpu()) {
@@ -862,6 +862,39 @@ unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
 	return expires_limit;
 }
 
+/*
+ * Push the timeout of a timer pending on another CPU further out without
+ * taking the remote base lock: the new timeout is only stored in the timer
+ * and the owning CPU moves the timer when its old slot comes up, see
+ * requeue_lazy_timer(). This is what the networking timers, which are
+ * mostly pushed out by whichever CPU handles the next packet, need.
+ *
+ * Returns false, with the timeout possibly already updated, if the timer
+ * has to go through __mod_timer().
+ */
+static bool mod_timer_lazy(struct timer_list *timer, unsigned long expires)
+{
+	struct tvec_base *base = tbase_get_base(ACCESS_ONCE(timer->base));
+	unsigned long old = ACCESS_ONCE(timer->expires);
+
+	if (!base || base == raw_cpu_read(tvec_bases) ||
+	    !timer_pending(timer) || !time_after(expires, old))
+		return false;
+
+	if (cmpxchg(&timer->expires, old, expires) != old)
+		return false;
+	/*
+	 * Pairs with the smp_mb() in requeue_lazy_timer(): if the timer is
+	 * still pending, its owner will see the new timeout.
+	 */
+	if (!timer_pending(timer))
+		return false;
+
+	timer_stats_timer_set_start_info(timer);
+	trace_timer_start(timer, expires);
+	return true;
+}
+
 /**
  * mod_timer - modify a timer's timeout
  * @timer: the timer to be modified
@@ -894,6 +927,9 @@ int mod_timer(struct timer_list *timer, unsigned long expires)
 	if (timer_pending(timer) && timer->expires == expires)
 		return 1;
 
+	if (mod_timer_lazy(timer, expires))
+		return 1;
+
 	return __mod_timer(timer, expires, false, TIMER_NOT_PINNED);
 }
 EXPORT_SYMBOL(mod_timer);
@@ -1156,6 +1192,22 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
+/*
+ * Detach an expired timer and put it back into the wheel if mod_timer_lazy()
+ * has pushed its timeout past the slot being run.
+ */
+static bool requeue_lazy_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	detach_expired_timer(timer, base);
+	/* Pairs with the cmpxchg() in mod_timer_lazy() */
+	smp_mb();
+	if (time_before(ACCESS_ONCE(timer->expires), base->timer_jiffies))
+		return false;
+
+	internal_add_timer(base, timer);
+	return true;
+}
+
 #define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
 
 /**
@@ -1195,6 +1247,9 @@ static inline void __run_timers(struct tvec_base *base)
 			bool irqsafe;
 
 			timer = list_first_entry(head, struct timer_list,entry);
+			if (requeue_lazy_timer(base, timer))
+				continue;
+
 			fn = timer->function;
 			data = timer->data;
 			irqsafe = tbase_get_irqsafe(timer->base);
@@ -1202,7 +1257,6 @@ static inline void __run_timers(struct tvec_base *base)
 			timer_stats_account_timer(timer);
 
 			base->running_timer = timer;
-			detach_expired_timer(timer, base);
 
 			if (irqsafe) {
 				spin_unlock(&base->lock);
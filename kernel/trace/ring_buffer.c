@@ -3476,6 +3476,17 @@ rb_get_reader_page(struct ring_buffer_per_cpu *cpu_buffer)
 	int nr_loops = 0;
 	int ret;
 
+	/*
+	 * Most calls find events left on the current reader page. The
+	 * writer never takes cpu_buffer->lock, and only readers, which
+	 * reader_lock serializes, move the reader page or its read index,
+	 * so that case needs neither the lock nor irqs off. The lock is
+	 * only there to keep two readers from swapping pages at once.
+	 */
+	reader = cpu_buffer->reader_page;
+	if (reader->read < rb_page_size(reader))
+		return reader;
+
 	local_irq_save(flags);
 	arch_spin_lock(&cpu_buffer->lock);
 
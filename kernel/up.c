@@ -33,6 +33,20 @@ int smp_call_function_single_async(int cpu, struct call_single_data *csd)
 }
 EXPORT_SYMBOL(smp_call_function_single_async);
 
+int smp_call_function_batch(int cpu, struct call_single_data *csd,
+			    unsigned int nr, int wait)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	local_irq_save(flags);
+	for (i = 0; i < nr; i++)
+		csd[i].func(csd[i].info);
+	local_irq_restore(flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(smp_call_function_batch);
+
 int on_each_cpu(smp_call_func_t func, void *info, int wait)
 {
 	unsigned long flags;
@@ -45,6 +45,7 @@
 #include <linux/jhash.h>
 #include <linux/hashtable.h>
 #include <linux/rculist.h>
+#include <linux/llist.h>
 #include <linux/nodemask.h>
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
@@ -138,6 +139,8 @@ enum {
 
 struct worker_pool {
 	spinlock_t		lock;		/* the pool lock */
+	struct llist_head	queue_reqs;	/* contended queueing, see
+						   pool_queue_work() */
 	int			cpu;		/* I: the associated cpu */
 	int			node;		/* I: the associated node ID */
 	int			id;		/* I: pool ID */
@@ -1278,13 +1281,137 @@ static bool is_chained_work(struct workqueue_struct *wq)
 	return worker && worker->current_pwq->wq == wq;
 }
 
+/*
+ * Queue @work on @pwq with pwq->pool->lock held.  Returns %false if @pwq
+ * is an unbound pwq which died meanwhile and the pwq selection has to be
+ * repeated.
+ */
+static bool __queue_work_on_pwq(unsigned int req_cpu,
+				struct pool_workqueue *pwq,
+				struct work_struct *work)
+{
+	struct list_head *worklist;
+	unsigned int work_flags;
+
+	/*
+	 * pwq is determined and locked.  For unbound pools, we could have
+	 * raced with pwq release and it could already be dead.  If its
+	 * refcnt is zero, repeat pwq selection.  Note that pwqs never die
+	 * without another pwq replacing it in the numa_pwq_tbl or while
+	 * work items are executing on it, so the retrying is guaranteed to
+	 * make forward-progress.
+	 */
+	if (unlikely(!pwq->refcnt)) {
+		if (pwq->wq->flags & WQ_UNBOUND)
+			return false;
+		/* oops */
+		WARN_ONCE(true, "workqueue: per-cpu pwq for %s on cpu%d has 0 refcnt",
+			  pwq->wq->name, pwq->pool->cpu);
+	}
+
+	/* pwq determined, queue */
+	trace_workqueue_queue_work(req_cpu, pwq, work);
+
+	if (WARN_ON(!list_empty(&work->entry)))
+		return true;
+
+	pwq->nr_in_flight[pwq->work_color]++;
+	work_flags = work_color_to_flags(pwq->work_color);
+
+	if (likely(pwq->nr_active < pwq->max_active)) {
+		trace_workqueue_activate_work(work);
+		pwq->nr_active++;
+		worklist = &pwq->pool->worklist;
+	} else {
+		work_flags |= WORK_STRUCT_DELAYED;
+		worklist = &pwq->delayed_works;
+	}
+
+	insert_work(pwq, work, worklist, work_flags);
+	return true;
+}
+
+/*
+ * Queueing on the unbound pools, which all CPUs of a node or of the
+ * system share, is combined: a CPU finding pool->lock taken posts its
+ * request on pool->queue_reqs, and whoever holds the lock, the queueing
+ * CPUs and the pool's workers, queues all the posted work items in one go
+ * before letting it go.  The posting CPU keeps IRQ disabled and waits for
+ * its request to be done.  That keeps queue_work() returning only once
+ * the work item is queued, and the sched-RCU protected pwq and pool
+ * around until then.
+ */
+struct pool_queue_req {
+	struct llist_node	node;
+	struct pool_workqueue	*pwq;
+	struct work_struct	*work;
+	unsigned int		req_cpu;
+	bool			queued;
+	int			done;
+};
+
+/* Queue the posted work items, called with pool->lock held */
+static void pool_queue_combine(struct worker_pool *pool)
+{
+	struct pool_queue_req *req, *next;
+	struct llist_node *first;
+	int nr = 0;
+
+	if (llist_empty(&pool->queue_reqs))
+		return;
+
+	first = llist_reverse_order(llist_del_all(&pool->queue_reqs));
+	/* The request is gone as soon as it is marked done */
+	llist_for_each_entry_safe(req, next, first, node) {
+		req->queued = __queue_work_on_pwq(req->req_cpu, req->pwq,
+						  req->work);
+		smp_store_release(&req->done, 1);
+		nr++;
+	}
+	trace_workqueue_queue_combined(pool->id, nr);
+}
+
+/*
+ * Queue @work on the unbound @pwq, posting it to the lock holder if
+ * pwq->pool->lock is contended.  Returns %false if the pwq selection has
+ * to be repeated.
+ */
+static bool pool_queue_work(unsigned int req_cpu, struct pool_workqueue *pwq,
+			    struct work_struct *work)
+{
+	struct worker_pool *pool = pwq->pool;
+	struct pool_queue_req req;
+
+	if (spin_trylock(&pool->lock)) {
+		req.queued = __queue_work_on_pwq(req_cpu, pwq, work);
+		goto unlock;
+	}
+
+	trace_workqueue_queue_contended(req_cpu, pwq, work);
+	req.pwq = pwq;
+	req.work = work;
+	req.req_cpu = req_cpu;
+	req.done = 0;
+	llist_add(&req.node, &pool->queue_reqs);
+	for (;;) {
+		if (smp_load_acquire(&req.done))
+			return req.queued;
+		if (!spin_is_locked(&pool->lock) && spin_trylock(&pool->lock))
+			break;
+		cpu_relax();
+	}
+	/* Got the lock first, queue ours along with the others */
+unlock:
+	pool_queue_combine(pool);
+	spin_unlock(&pool->lock);
+	return req.queued;
+}
+
 static void __queue_work(int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
 	struct pool_workqueue *pwq;
 	struct worker_pool *last_pool;
-	struct list_head *worklist;
-	unsigned int work_flags;
 	unsigned int req_cpu = cpu;
 
 	/*
@@ -1331,51 +1458,23 @@ retry:
 			spin_unlock(&last_pool->lock);
 			spin_lock(&pwq->pool->lock);
 		}
-	} else {
-		spin_lock(&pwq->pool->lock);
-	}
-
-	/*
-	 * pwq is determined and locked.  For unbound pools, we could have
-	 * raced with pwq release and it could already be dead.  If its
-	 * refcnt is zero, repeat pwq selection.  Note that pwqs never die
-	 * without another pwq replacing it in the numa_pwq_tbl or while
-	 * work items are executing on it, so the retrying is guaranteed to
-	 * make forward-progress.
-	 */
-	if (unlikely(!pwq->refcnt)) {
-		if (wq->flags & WQ_UNBOUND) {
-			spin_unlock(&pwq->pool->lock);
+	} else if (wq->flags & WQ_UNBOUND) {
+		if (!pool_queue_work(req_cpu, pwq, work)) {
 			cpu_relax();
 			goto retry;
 		}
-		/* oops */
-		WARN_ONCE(true, "workqueue: per-cpu pwq for %s on cpu%d has 0 refcnt",
-			  wq->name, cpu);
-	}
-
-	/* pwq determined, queue */
-	trace_workqueue_queue_work(req_cpu, pwq, work);
-
-	if (WARN_ON(!list_empty(&work->entry))) {
-		spin_unlock(&pwq->pool->lock);
 		return;
-	}
-
-	pwq->nr_in_flight[pwq->work_color]++;
-	work_flags = work_color_to_flags(pwq->work_color);
-
-	if (likely(pwq->nr_active < pwq->max_active)) {
-		trace_workqueue_activate_work(work);
-		pwq->nr_active++;
-		worklist = &pwq->pool->worklist;
 	} else {
-		work_flags |= WORK_STRUCT_DELAYED;
-		worklist = &pwq->delayed_works;
+		spin_lock(&pwq->pool->lock);
 	}
 
-	insert_work(pwq, work, worklist, work_flags);
+	if (unlikely(!__queue_work_on_pwq(req_cpu, pwq, work))) {
+		spin_unlock(&pwq->pool->lock);
+		cpu_relax();
+		goto retry;
+	}
 
+	pool_queue_combine(pwq->pool);
 	spin_unlock(&pwq->pool->lock);
 }
 
@@ -2049,6 +2148,7 @@ __acquires(&pool->lock)
 	cond_resched_rcu_qs();
 
 	spin_lock_irq(&pool->lock);
+	pool_queue_combine(pool);
 
 	/* clear cpu intensive status */
 	if (unlikely(cpu_intensive))
@@ -2105,6 +2205,7 @@ static int worker_thread(void *__worker)
 	worker->task->flags |= PF_WQ_WORKER;
 woke_up:
 	spin_lock_irq(&pool->lock);
+	pool_queue_combine(pool);
 
 	/* am I supposed to die? */
 	if (unlikely(worker->flags & WORKER_DIE)) {
@@ -3338,6 +3439,7 @@ static bool wqattrs_equal(const struct workqueue_attrs *a,
 static int init_worker_pool(struct worker_pool *pool)
 {
 	spin_lock_init(&pool->lock);
+	init_llist_head(&pool->queue_reqs);
 	pool->id = -1;
 	pool->cpu = -1;
 	pool->node = NUMA_NO_NODE;
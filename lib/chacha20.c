@@ -0,0 +1,56 @@
+/*
+ * ChaCha20 block function, as specified in RFC 7539.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <linux/bitops.h>
+#include <asm/byteorder.h>
+#include <crypto/chacha20.h>
+
+#define QUARTERROUND(x, a, b, c, d)				\
+do {								\
+	x[a] += x[b]; x[d] = rol32(x[d] ^ x[a], 16);		\
+	x[c] += x[d]; x[b] = rol32(x[b] ^ x[c], 12);		\
+	x[a] += x[b]; x[d] = rol32(x[d] ^ x[a], 8);		\
+	x[c] += x[d]; x[b] = rol32(x[b] ^ x[c], 7);		\
+} while (0)
+
+/**
+ * chacha20_block - generate one block of the ChaCha20 key stream
+ * @state:  the 16 words of the state: the constants, the key, the block
+ *	    counter and the nonce. The block counter, word 12, is incremented.
+ * @stream: the CHACHA20_BLOCK_SIZE bytes of output
+ */
+void chacha20_block(u32 *state, void *stream)
+{
+	u32 x[16];
+	__le32 *out = stream;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(x); i++)
+		x[i] = state[i];
+
+	for (i = 0; i < 20; i += 2) {
+		QUARTERROUND(x, 0, 4,  8, 12);
+		QUARTERROUND(x, 1, 5,  9, 13);
+		QUARTERROUND(x, 2, 6, 10, 14);
+		QUARTERROUND(x, 3, 7, 11, 15);
+
+		QUARTERROUND(x, 0, 5, 10, 15);
+		QUARTERROUND(x, 1, 6, 11, 12);
+		QUARTERROUND(x, 2, 7,  8, 13);
+		QUARTERROUND(x, 3, 4,  9, 14);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(x); i++)
+		out[i] = cpu_to_le32(x[i] + state[i]);
+
+	state[12]++;
+}
+EXPORT_SYMBOL(chacha20_block);
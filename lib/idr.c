@@ -44,7 +44,7 @@
 static struct kmem_cache *idr_layer_cache;
 static DEFINE_PER_CPU(struct idr_layer *, idr_preload_head);
 static DEFINE_PER_CPU(int, idr_preload_cnt);
-static DEFINE_SPINLOCK(simple_ida_lock);
+static DEFINE_PER_CPU(struct ida_bitmap *, ida_bitmap_preload);
 
 /* the maximum ID which can be allocated given idr->layers */
 static int idr_max(int layers)
@@ -915,22 +915,13 @@ int ida_pre_get(struct ida *ida, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL(ida_pre_get);
 
-/**
- * ida_get_new_above - allocate new ID above or equal to a start id
- * @ida:	ida handle
- * @starting_id: id to start search at
- * @p_id:	pointer to the allocated handle
- *
- * Allocate new ID above or equal to @starting_id.  It should be called
- * with any required locks.
- *
- * If memory is required, it will return %-EAGAIN, you should unlock
- * and go back to the ida_pre_get() call.  If the ida is full, it will
- * return %-ENOSPC.
- *
- * @p_id returns a value in the range @starting_id ... %0x7fffffff.
+/*
+ * With @preloaded, the idr_layers and the ida_bitmap come from the per-cpu
+ * preload buffers filled by ida_preload(), instead of the buffers of the
+ * ida filled by ida_pre_get() under its idr lock.
  */
-int ida_get_new_above(struct ida *ida, int starting_id, int *p_id)
+static int __ida_get_new_above(struct ida *ida, int starting_id, int *p_id,
+			       bool preloaded)
 {
 	struct idr_layer *pa[MAX_IDR_LEVEL + 1];
 	struct ida_bitmap *bitmap;
@@ -941,7 +932,10 @@ int ida_get_new_above(struct ida *ida, int starting_id, int *p_id)
 
  restart:
 	/* get vacant slot */
-	t = idr_get_empty_slot(&ida->idr, idr_id, pa, 0, &ida->idr);
+	if (preloaded)
+		t = idr_get_empty_slot(&ida->idr, idr_id, pa, GFP_NOWAIT, NULL);
+	else
+		t = idr_get_empty_slot(&ida->idr, idr_id, pa, 0, &ida->idr);
 	if (t < 0)
 		return t == -ENOMEM ? -EAGAIN : t;
 
@@ -955,10 +949,15 @@ int ida_get_new_above(struct ida *ida, int starting_id, int *p_id)
 	/* if bitmap isn't there, create a new one */
 	bitmap = (void *)pa[0]->ary[idr_id & IDR_MASK];
 	if (!bitmap) {
-		spin_lock_irqsave(&ida->idr.lock, flags);
-		bitmap = ida->free_bitmap;
-		ida->free_bitmap = NULL;
-		spin_unlock_irqrestore(&ida->idr.lock, flags);
+		if (preloaded) {
+			bitmap = __this_cpu_read(ida_bitmap_preload);
+			__this_cpu_write(ida_bitmap_preload, NULL);
+		} else {
+			spin_lock_irqsave(&ida->idr.lock, flags);
+			bitmap = ida->free_bitmap;
+			ida->free_bitmap = NULL;
+			spin_unlock_irqrestore(&ida->idr.lock, flags);
+		}
 
 		if (!bitmap)
 			return -EAGAIN;
@@ -993,7 +992,7 @@ int ida_get_new_above(struct ida *ida, int starting_id, int *p_id)
 	 * Throw away extra resources one by one after each successful
 	 * allocation.
 	 */
-	if (ida->idr.id_free_cnt || ida->free_bitmap) {
+	if (!preloaded && (ida->idr.id_free_cnt || ida->free_bitmap)) {
 		struct idr_layer *p = get_from_free_list(&ida->idr);
 		if (p)
 			kmem_cache_free(idr_layer_cache, p);
@@ -1001,6 +1000,26 @@ int ida_get_new_above(struct ida *ida, int starting_id, int *p_id)
 
 	return 0;
 }
+
+/**
+ * ida_get_new_above - allocate new ID above or equal to a start id
+ * @ida:	ida handle
+ * @starting_id: id to start search at
+ * @p_id:	pointer to the allocated handle
+ *
+ * Allocate new ID above or equal to @starting_id.  It should be called
+ * with any required locks.
+ *
+ * If memory is required, it will return %-EAGAIN, you should unlock
+ * and go back to the ida_pre_get() call.  If the ida is full, it will
+ * return %-ENOSPC.
+ *
+ * @p_id returns a value in the range @starting_id ... %0x7fffffff.
+ */
+int ida_get_new_above(struct ida *ida, int starting_id, int *p_id)
+{
+	return __ida_get_new_above(ida, starting_id, p_id, false);
+}
 EXPORT_SYMBOL(ida_get_new_above);
 
 /**
@@ -1064,6 +1083,28 @@ void ida_destroy(struct ida *ida)
 }
 EXPORT_SYMBOL(ida_destroy);
 
+/*
+ * Like idr_preload(), also preloads an ida_bitmap. Returns with preemption
+ * disabled, to be ended with idr_preload_end().
+ */
+static void ida_preload(gfp_t gfp_mask)
+{
+	struct ida_bitmap *bitmap;
+
+	idr_preload(gfp_mask);
+	if (__this_cpu_read(ida_bitmap_preload))
+		return;
+
+	preempt_enable();
+	bitmap = kmalloc(sizeof(struct ida_bitmap), gfp_mask);
+	preempt_disable();
+
+	if (__this_cpu_read(ida_bitmap_preload))
+		kfree(bitmap);
+	else
+		__this_cpu_write(ida_bitmap_preload, bitmap);
+}
+
 /**
  * ida_simple_get - get a new id.
  * @ida: the (initialized) ida.
@@ -1082,6 +1123,7 @@ int ida_simple_get(struct ida *ida, unsigned int start, unsigned int end,
 	int ret, id;
 	unsigned int max;
 	unsigned long flags;
+	bool preloaded;
 
 	BUG_ON((int)start < 0);
 	BUG_ON((int)end < 0);
@@ -1093,12 +1135,17 @@ int ida_simple_get(struct ida *ida, unsigned int start, unsigned int end,
 		max = end - 1;
 	}
 
+	/* The per-cpu preload buffers can't be used from interrupts */
+	preloaded = !in_interrupt();
+
 again:
-	if (!ida_pre_get(ida, gfp_mask))
+	if (preloaded)
+		ida_preload(gfp_mask);
+	else if (!ida_pre_get(ida, gfp_mask))
 		return -ENOMEM;
 
-	spin_lock_irqsave(&simple_ida_lock, flags);
-	ret = ida_get_new_above(ida, start, &id);
+	spin_lock_irqsave(&ida->simple_lock, flags);
+	ret = __ida_get_new_above(ida, start, &id, preloaded);
 	if (!ret) {
 		if (id > max) {
 			ida_remove(ida, id);
@@ -1107,7 +1154,14 @@ again:
 			ret = id;
 		}
 	}
-	spin_unlock_irqrestore(&simple_ida_lock, flags);
+	spin_unlock_irqrestore(&ida->simple_lock, flags);
+
+	if (preloaded) {
+		idr_preload_end();
+		/* The preload holds all an allocation may need */
+		if (unlikely(ret == -EAGAIN))
+			ret = -ENOMEM;
+	}
 
 	if (unlikely(ret == -EAGAIN))
 		goto again;
@@ -1126,9 +1180,9 @@ void ida_simple_remove(struct ida *ida, unsigned int id)
 	unsigned long flags;
 
 	BUG_ON((int)id < 0);
-	spin_lock_irqsave(&simple_ida_lock, flags);
+	spin_lock_irqsave(&ida->simple_lock, flags);
 	ida_remove(ida, id);
-	spin_unlock_irqrestore(&simple_ida_lock, flags);
+	spin_unlock_irqrestore(&ida->simple_lock, flags);
 }
 EXPORT_SYMBOL(ida_simple_remove);
 
@@ -1143,6 +1197,7 @@ void ida_init(struct ida *ida)
 {
 	memset(ida, 0, sizeof(struct ida));
 	idr_init(&ida->idr);
+	spin_lock_init(&ida->simple_lock);
 
 }
 EXPORT_SYMBOL(ida_init);
@@ -11,6 +11,15 @@
 # define cmpxchg64_relaxed cmpxchg64
 #endif
 
+/*
+ * The lock values that the count can be changed locklessly with, by
+ * default only the unlocked one. An architecture may also allow the ones
+ * with waiters but no lock holder.
+ */
+#ifndef arch_spin_value_lockref
+# define arch_spin_value_lockref(l) arch_spin_value_unlocked(l)
+#endif
+
 /*
  * Note that the "cmpxchg()" reloads the "old" value for the
  * failure case.
@@ -19,7 +28,7 @@
 	struct lockref old;							\
 	BUILD_BUG_ON(sizeof(old) != 8);						\
 	old.lock_count = ACCESS_ONCE(lockref->lock_count);			\
-	while (likely(arch_spin_value_unlocked(old.lock.rlock.raw_lock))) {  	\
+	while (likely(arch_spin_value_lockref(old.lock.rlock.raw_lock))) {  	\
 		struct lockref new = old, prev = old;				\
 		CODE								\
 		old.lock_count = cmpxchg64_relaxed(&lockref->lock_count,	\
@@ -136,6 +145,78 @@ int lockref_put_or_lock(struct lockref *lockref)
 }
 EXPORT_SYMBOL(lockref_put_or_lock);
 
+/**
+ * lockref_put_return - decrements count unless the lock is held
+ * @lockref: pointer to lockref structure
+ * Return: the new count, or -1 if the lockref is locked, dead or at zero
+ *
+ * The count may be decremented down to zero, the caller has to cope with
+ * the object being freed by someone else from then on. Without the cmpxchg
+ * lockref this always fails.
+ */
+int lockref_put_return(struct lockref *lockref)
+{
+	CMPXCHG_LOOP(
+		new.count--;
+		if ((int)old.count <= 0)
+			return -1;
+	,
+		return new.count;
+	);
+	return -1;
+}
+EXPORT_SYMBOL(lockref_put_return);
+
+/**
+ * lockref_get_many - Increments reference count by @n unconditionally
+ * @lockref: pointer to lockref structure
+ * @n: number of references to take
+ *
+ * This operation is only valid if you already hold a reference
+ * to the object, so you know the count cannot be zero.
+ */
+void lockref_get_many(struct lockref *lockref, unsigned int n)
+{
+	CMPXCHG_LOOP(
+		new.count += n;
+	,
+		return;
+	);
+
+	spin_lock(&lockref->lock);
+	lockref->count += n;
+	spin_unlock(&lockref->lock);
+}
+EXPORT_SYMBOL(lockref_get_many);
+
+/**
+ * lockref_put_many_or_lock - decrements count by @n unless count <= @n
+ * @lockref: pointer to lockref structure
+ * @n: number of references to drop
+ * Return: 1 if count updated successfully or 0 if count <= @n and lock taken
+ *
+ * The caller drops the last reference(s) with the lock held on failure, as
+ * with lockref_put_or_lock().
+ */
+int lockref_put_many_or_lock(struct lockref *lockref, unsigned int n)
+{
+	CMPXCHG_LOOP(
+		new.count -= n;
+		if (old.count <= n)
+			break;
+	,
+		return 1;
+	);
+
+	spin_lock(&lockref->lock);
+	if (lockref->count <= n)
+		return 0;
+	lockref->count -= n;
+	spin_unlock(&lockref->lock);
+	return 1;
+}
+EXPORT_SYMBOL(lockref_put_many_or_lock);
+
 /**
  * lockref_mark_dead - mark lockref dead
  * @lockref: pointer to lockref structure
@@ -174,3 +255,59 @@ int lockref_get_not_dead(struct lockref *lockref)
 	return retval;
 }
 EXPORT_SYMBOL(lockref_get_not_dead);
+
+/**
+ * lockref_get_many_not_dead - Increments count by @n unless the ref is dead
+ * @lockref: pointer to lockref structure
+ * @n: number of references to take
+ * Return: 1 if count updated successfully or 0 if lockref was dead
+ */
+int lockref_get_many_not_dead(struct lockref *lockref, unsigned int n)
+{
+	int retval;
+
+	CMPXCHG_LOOP(
+		new.count += n;
+		if ((int)old.count < 0)
+			return 0;
+	,
+		return 1;
+	);
+
+	spin_lock(&lockref->lock);
+	retval = 0;
+	if ((int) lockref->count >= 0) {
+		lockref->count += n;
+		retval = 1;
+	}
+	spin_unlock(&lockref->lock);
+	return retval;
+}
+EXPORT_SYMBOL(lockref_get_many_not_dead);
+
+/**
+ * lockref_get_not_dead_chain - take a reference on each lockref of a chain
+ * @refs: array of pointers to the lockrefs, in the order to take them
+ * @nr: number of entries in @refs
+ * Return: the number of leading entries of @refs that got a reference
+ *
+ * The references on consecutive entries for the same lockref are taken
+ * with a single count update. The walk stops at the first lockref that is
+ * dead; the caller has to drop the references taken on the entries before
+ * it with its own put function, as dropping the last one may need more
+ * than a count update.
+ */
+int lockref_get_not_dead_chain(struct lockref **refs, int nr)
+{
+	int i = 0, n;
+
+	while (i < nr) {
+		for (n = 1; i + n < nr && refs[i + n] == refs[i]; n++)
+			;
+		if (!lockref_get_many_not_dead(refs[i], n))
+			break;
+		i += n;
+	}
+	return i;
+}
+EXPORT_SYMBOL(lockref_get_not_dead_chain);
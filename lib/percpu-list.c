@@ -0,0 +1,114 @@
+/*
+ * Per-cpu list
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See percpu-list.h for the description of the list.
+ */
+#include <linux/export.h>
+#include <linux/percpu-list.h>
+
+/*
+ * All the sublist locks share one lockdep class, they are never nested.
+ */
+static struct lock_class_key pcpu_list_key;
+
+/**
+ * alloc_pcpu_list_head - allocate and initialize a per-cpu list
+ * @phead: where to store the per-cpu list
+ * Return: 0 or -ENOMEM
+ */
+int alloc_pcpu_list_head(struct pcpu_list_head __percpu **phead)
+{
+	struct pcpu_list_head __percpu *head;
+	int cpu;
+
+	head = alloc_percpu(struct pcpu_list_head);
+	if (!head)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct pcpu_list_head *ph = per_cpu_ptr(head, cpu);
+
+		INIT_LIST_HEAD(&ph->list);
+		spin_lock_init(&ph->lock);
+		lockdep_set_class(&ph->lock, &pcpu_list_key);
+	}
+	*phead = head;
+	return 0;
+}
+EXPORT_SYMBOL(alloc_pcpu_list_head);
+
+void free_pcpu_list_head(struct pcpu_list_head __percpu **phead)
+{
+	free_percpu(*phead);
+	*phead = NULL;
+}
+EXPORT_SYMBOL(free_pcpu_list_head);
+
+/**
+ * pcpu_list_empty - check if a per-cpu list is empty
+ * @head: the per-cpu list
+ *
+ * Unlocked, the result is only stable if nothing is added concurrently.
+ */
+bool pcpu_list_empty(struct pcpu_list_head __percpu *head)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (!list_empty(&per_cpu_ptr(head, cpu)->list))
+			return false;
+	}
+	return true;
+}
+EXPORT_SYMBOL(pcpu_list_empty);
+
+/**
+ * pcpu_list_add - add an entry to the sublist of the current CPU
+ * @node: the entry to add, not on a list
+ * @head: the per-cpu list
+ *
+ * The CPU may change under us, the entry is then on the sublist of the
+ * previous one, which is just as good.
+ */
+void pcpu_list_add(struct pcpu_list_node *node,
+		   struct pcpu_list_head __percpu *head)
+{
+	struct pcpu_list_head *ph = raw_cpu_ptr(head);
+
+	spin_lock(&ph->lock);
+	list_add(&node->list, &ph->list);
+	node->lockptr = &ph->lock;
+	spin_unlock(&ph->lock);
+}
+EXPORT_SYMBOL(pcpu_list_add);
+
+/**
+ * pcpu_list_del - delete an entry from its sublist
+ * @node: the entry to delete
+ *
+ * Nothing is done if the entry isn't on a list. The entry can't be added
+ * concurrently, so its lock pointer can't change under us.
+ */
+void pcpu_list_del(struct pcpu_list_node *node)
+{
+	spinlock_t *lock = ACCESS_ONCE(node->lockptr);
+
+	if (!lock)
+		return;
+
+	spin_lock(lock);
+	list_del_init(&node->list);
+	node->lockptr = NULL;
+	spin_unlock(lock);
+}
+EXPORT_SYMBOL(pcpu_list_del);
@@ -57,33 +57,115 @@ static inline void debug_percpu_counter_deactivate(struct percpu_counter *fbc)
 { }
 #endif	/* CONFIG_DEBUG_OBJECTS_PERCPU_COUNTER */
 
-void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
-{
+/*
+ * The updates of fbc->count are operations of the combining lock fbc->lock,
+ * so that the CPU holding it folds the counts of all the CPUs waiting for
+ * it. A fold updates the per-cpu count of the CPU that queued it, which
+ * waits with interrupts disabled and can't touch it meanwhile.
+ */
+struct percpu_counter_op {
+	struct combining_op op;
+	struct percpu_counter *fbc;
 	int cpu;
+	s64 count;
+	s64 amount;
+};
+
+static void percpu_counter_run(struct percpu_counter_op *pop,
+			       void (*func)(struct combining_op *op))
+{
 	unsigned long flags;
 
-	raw_spin_lock_irqsave(&fbc->lock, flags);
+	pop->op.func = func;
+	local_irq_save(flags);
+	combining_lock_run(&pop->fbc->lock, &pop->op);
+	local_irq_restore(flags);
+}
+
+static void percpu_counter_set_op(struct combining_op *op)
+{
+	struct percpu_counter_op *pop =
+		container_of(op, struct percpu_counter_op, op);
+	struct percpu_counter *fbc = pop->fbc;
+	int cpu;
+
 	for_each_possible_cpu(cpu) {
 		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
 		*pcount = 0;
 	}
-	fbc->count = amount;
-	raw_spin_unlock_irqrestore(&fbc->lock, flags);
+	fbc->count = pop->amount;
+}
+
+void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
+{
+	struct percpu_counter_op pop = {
+		.fbc	= fbc,
+		.amount	= amount,
+	};
+
+	percpu_counter_run(&pop, percpu_counter_set_op);
 }
 EXPORT_SYMBOL(percpu_counter_set);
 
+/* Uncontended folds after which the batch is scaled back down a step */
+#define PERCPU_COUNTER_CALM_FOLDS	64
+
+static inline s32 percpu_counter_scale(s32 batch, unsigned int shift)
+{
+	if (shift && batch < (S32_MAX >> (shift + 1)))
+		batch <<= shift;
+	return batch;
+}
+
+/*
+ * Adapt the batch to the contention of the fold, called under fbc->lock.
+ * A larger batch folds less often, at the cost of a less accurate
+ * percpu_counter_read().
+ */
+static void percpu_counter_adapt(struct percpu_counter *fbc, bool contended)
+{
+	if (contended) {
+		fbc->folds_uncontended = 0;
+		if (fbc->batch_shift < PERCPU_COUNTER_SHIFT_MAX) {
+			ACCESS_ONCE(fbc->batch_shift) = fbc->batch_shift + 1;
+			if (fbc->batch_shift > fbc->batch_shift_max)
+				ACCESS_ONCE(fbc->batch_shift_max) =
+					fbc->batch_shift;
+		}
+	} else if (fbc->batch_shift &&
+		   ++fbc->folds_uncontended >= PERCPU_COUNTER_CALM_FOLDS) {
+		fbc->folds_uncontended = 0;
+		ACCESS_ONCE(fbc->batch_shift) = fbc->batch_shift - 1;
+	}
+}
+
+static void percpu_counter_fold_op(struct combining_op *op)
+{
+	struct percpu_counter_op *pop =
+		container_of(op, struct percpu_counter_op, op);
+	struct percpu_counter *fbc = pop->fbc;
+
+	percpu_counter_adapt(fbc, op->contended);
+	fbc->count += pop->count;
+	*per_cpu_ptr(fbc->counters, pop->cpu) -= pop->count - pop->amount;
+}
+
 void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch)
 {
 	s64 count;
 
 	preempt_disable();
+	batch = percpu_counter_scale(batch, ACCESS_ONCE(fbc->batch_shift));
 	count = __this_cpu_read(*fbc->counters) + amount;
 	if (count >= batch || count <= -batch) {
-		unsigned long flags;
-		raw_spin_lock_irqsave(&fbc->lock, flags);
-		fbc->count += count;
-		__this_cpu_sub(*fbc->counters, count - amount);
-		raw_spin_unlock_irqrestore(&fbc->lock, flags);
+		struct percpu_counter_op pop = {
+			.fbc	= fbc,
+			.cpu	= smp_processor_id(),
+			.count	= count,
+			.amount	= amount,
+		};
+
+		percpu_counter_run(&pop, percpu_counter_fold_op);
 	} else {
 		this_cpu_add(*fbc->counters, amount);
 	}
@@ -95,31 +177,61 @@ EXPORT_SYMBOL(__percpu_counter_add);
  * Add up all the per-cpu counts, return the result.  This is a more accurate
  * but much slower version of percpu_counter_read_positive()
  */
-s64 __percpu_counter_sum(struct percpu_counter *fbc)
+static void percpu_counter_sum_op(struct combining_op *op)
 {
+	struct percpu_counter_op *pop =
+		container_of(op, struct percpu_counter_op, op);
+	struct percpu_counter *fbc = pop->fbc;
 	s64 ret;
 	int cpu;
-	unsigned long flags;
 
-	raw_spin_lock_irqsave(&fbc->lock, flags);
 	ret = fbc->count;
 	for_each_online_cpu(cpu) {
 		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
 		ret += *pcount;
 	}
-	raw_spin_unlock_irqrestore(&fbc->lock, flags);
-	return ret;
+	pop->count = ret;
+}
+
+s64 __percpu_counter_sum(struct percpu_counter *fbc)
+{
+	struct percpu_counter_op pop = {
+		.fbc	= fbc,
+	};
+
+	percpu_counter_run(&pop, percpu_counter_sum_op);
+	return pop.count;
 }
 EXPORT_SYMBOL(__percpu_counter_sum);
 
+/*
+ * Add up all the per-cpu counts without fbc->lock. A fold running
+ * concurrently may be counted twice or not at all, so the result is off by
+ * up to the scaled batch per cpu, like percpu_counter_read(), but much
+ * closer to the sum most of the time.
+ */
+s64 percpu_counter_sum_approx(struct percpu_counter *fbc)
+{
+	s64 ret;
+	int cpu;
+
+	ret = ACCESS_ONCE(fbc->count);
+	for_each_online_cpu(cpu)
+		ret += ACCESS_ONCE(*per_cpu_ptr(fbc->counters, cpu));
+	return ret;
+}
+EXPORT_SYMBOL(percpu_counter_sum_approx);
+
 int __percpu_counter_init(struct percpu_counter *fbc, s64 amount, gfp_t gfp,
 			  struct lock_class_key *key)
 {
 	unsigned long flags __maybe_unused;
 
-	raw_spin_lock_init(&fbc->lock);
-	lockdep_set_class(&fbc->lock, key);
+	__combining_lock_init(&fbc->lock, "&fbc->lock", key);
 	fbc->count = amount;
+	fbc->batch_shift = 0;
+	fbc->batch_shift_max = 0;
+	fbc->folds_uncontended = 0;
 	fbc->counters = alloc_percpu_gfp(s32, gfp);
 	if (!fbc->counters)
 		return -ENOMEM;
@@ -165,6 +277,18 @@ static void compute_batch_value(void)
 	percpu_counter_batch = max(32, nr*2);
 }
 
+#ifdef CONFIG_HOTPLUG_CPU
+static void percpu_counter_dead_op(struct combining_op *op)
+{
+	struct percpu_counter_op *pop =
+		container_of(op, struct percpu_counter_op, op);
+	s32 *pcount = per_cpu_ptr(pop->fbc->counters, pop->cpu);
+
+	pop->fbc->count += *pcount;
+	*pcount = 0;
+}
+#endif
+
 static int percpu_counter_hotcpu_callback(struct notifier_block *nb,
 					unsigned long action, void *hcpu)
 {
@@ -179,14 +303,12 @@ static int percpu_counter_hotcpu_callback(struct notifier_block *nb,
 	cpu = (unsigned long)hcpu;
 	spin_lock_irq(&percpu_counters_lock);
 	list_for_each_entry(fbc, &percpu_counters, list) {
-		s32 *pcount;
-		unsigned long flags;
+		struct percpu_counter_op pop = {
+			.fbc	= fbc,
+			.cpu	= cpu,
+		};
 
-		raw_spin_lock_irqsave(&fbc->lock, flags);
-		pcount = per_cpu_ptr(fbc->counters, cpu);
-		fbc->count += *pcount;
-		*pcount = 0;
-		raw_spin_unlock_irqrestore(&fbc->lock, flags);
+		percpu_counter_run(&pop, percpu_counter_dead_op);
 	}
 	spin_unlock_irq(&percpu_counters_lock);
 #endif
@@ -200,10 +322,14 @@ static int percpu_counter_hotcpu_callback(struct notifier_block *nb,
 int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 {
 	s64	count;
+	s32	batch;
 
+	/* The per-cpu counts may still be of the largest batch ever used */
+	batch = percpu_counter_scale(percpu_counter_batch,
+				     ACCESS_ONCE(fbc->batch_shift_max));
 	count = percpu_counter_read(fbc);
 	/* Check to see if rough count will be sufficient for comparison */
-	if (abs(count - rhs) > (percpu_counter_batch*num_online_cpus())) {
+	if (abs(count - rhs) > ((s64)batch * num_online_cpus())) {
 		if (count > rhs)
 			return 1;
 		else
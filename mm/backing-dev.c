@@ -10,6 +10,7 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/rculist.h>
 #include <trace/events/writeback.h>
 
 static atomic_long_t bdi_seq = ATOMIC_LONG_INIT(0);
@@ -386,12 +387,12 @@ static void bdi_prune_sb(struct backing_dev_info *bdi)
 {
 	struct super_block *sb;
 
-	spin_lock(&sb_lock);
-	list_for_each_entry(sb, &super_blocks, s_list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(sb, &super_blocks, s_list) {
 		if (sb->s_bdi == bdi)
 			sb->s_bdi = &default_backing_dev_info;
 	}
-	spin_unlock(&sb_lock);
+	rcu_read_unlock();
 }
 
 void bdi_unregister(struct backing_dev_info *bdi)
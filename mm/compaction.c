@@ -234,18 +234,35 @@ static void update_pageblock_skip(struct compact_control *cc,
 static bool compact_trylock_irqsave(spinlock_t *lock, unsigned long *flags,
 						struct compact_control *cc)
 {
+	if (spin_trylock_irqsave(lock, *flags))
+		return true;
+
+	if (lock == &cc->zone->lock)
+		cc->zone_lock_contended++;
+	else
+		cc->lru_lock_contended++;
+
 	if (cc->mode == MIGRATE_ASYNC) {
-		if (!spin_trylock_irqsave(lock, *flags)) {
-			cc->contended = COMPACT_CONTENDED_LOCK;
-			return false;
-		}
-	} else {
-		spin_lock_irqsave(lock, *flags);
+		cc->contended = COMPACT_CONTENDED_LOCK;
+		return false;
 	}
-
+	spin_lock_irqsave(lock, *flags);
 	return true;
 }
 
+/*
+ * The allocators that find zone->lock taken for their bulk pcp operations
+ * post them to be run by the lock holder. Run them before releasing the
+ * lock, they are then served in our hold instead of each taking the lock.
+ */
+static void compact_unlock_irqrestore(spinlock_t *lock, unsigned long flags,
+						struct compact_control *cc)
+{
+	if (lock == &cc->zone->lock)
+		cc->zone_lock_combined += zone_bulk_combine(cc->zone);
+	spin_unlock_irqrestore(lock, flags);
+}
+
 /*
  * Compaction requires the taking of some coarse locks that are potentially
  * very heavily contended. The lock should be periodically unlocked to avoid
@@ -265,7 +282,7 @@ static bool compact_unlock_should_abort(spinlock_t *lock,
 		unsigned long flags, bool *locked, struct compact_control *cc)
 {
 	if (*locked) {
-		spin_unlock_irqrestore(lock, flags);
+		compact_unlock_irqrestore(lock, flags, cc);
 		*locked = false;
 	}
 
@@ -331,6 +348,13 @@ static bool suitable_migration_target(struct page *page)
 	return false;
 }
 
+/*
+ * Number of pfns the free scanner scans under one hold of zone->lock. The
+ * waiting allocators are served by the combining when it is released, so
+ * the holds can be longer than those of the migration scanner.
+ */
+#define COMPACT_FREE_LOCK_BATCH		(4 * SWAP_CLUSTER_MAX)
+
 /*
  * Isolate free pages onto a private freelist. If @strict is true, will abort
  * returning 0 on any invalid PFNs or non-free pages inside of the pageblock
@@ -360,7 +384,7 @@ static unsigned long isolate_freepages_block(struct compact_control *cc,
 		 * contention, to give chance to IRQs. Abort if fatal signal
 		 * pending or async compaction detects need_resched()
 		 */
-		if (!(blockpfn % SWAP_CLUSTER_MAX)
+		if (!(blockpfn % COMPACT_FREE_LOCK_BATCH)
 		    && compact_unlock_should_abort(&cc->zone->lock, flags,
 								&locked, cc))
 			break;
@@ -437,7 +461,7 @@ isolate_fail:
 		total_isolated = 0;
 
 	if (locked)
-		spin_unlock_irqrestore(&cc->zone->lock, flags);
+		compact_unlock_irqrestore(&cc->zone->lock, flags, cc);
 
 	/* Update the pageblock-skip if the whole pageblock was scanned */
 	if (blockpfn == end_pfn)
@@ -1184,6 +1208,10 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		zone->compact_cached_migrate_pfn[1] = cc->migrate_pfn;
 	}
 
+	cc->zone_lock_contended = 0;
+	cc->zone_lock_combined = 0;
+	cc->lru_lock_contended = 0;
+
 	trace_mm_compaction_begin(start_pfn, cc->migrate_pfn, cc->free_pfn, end_pfn);
 
 	migrate_prep_local();
@@ -1231,7 +1259,11 @@ out:
 	cc->nr_freepages -= release_freepages(&cc->freepages);
 	VM_BUG_ON(cc->nr_freepages != 0);
 
-	trace_mm_compaction_end(ret);
+	count_compact_events(COMPACTLOCKCONTENDED, cc->zone_lock_contended +
+						   cc->lru_lock_contended);
+	count_compact_events(COMPACTLOCKCOMBINED, cc->zone_lock_combined);
+	trace_mm_compaction_end(ret, cc->zone_lock_contended,
+				cc->zone_lock_combined, cc->lru_lock_contended);
 
 	return ret;
 }
@@ -542,6 +542,21 @@ static int page_cache_tree_insert(struct address_space *mapping,
 	return 0;
 }
 
+/*
+ * Whether a page is in the page cache at @offset, looked up locklessly.
+ * A page found may be on its way out of the page cache already.
+ */
+static bool page_cache_tree_present(struct address_space *mapping,
+				    pgoff_t offset)
+{
+	void *p;
+
+	rcu_read_lock();
+	p = radix_tree_lookup(&mapping->page_tree, offset);
+	rcu_read_unlock();
+	return p && !radix_tree_exception(p);
+}
+
 static int __add_to_page_cache_locked(struct page *page,
 				      struct address_space *mapping,
 				      pgoff_t offset, gfp_t gfp_mask,
@@ -554,6 +569,16 @@ static int __add_to_page_cache_locked(struct page *page,
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 	VM_BUG_ON_PAGE(PageSwapBacked(page), page);
 
+	/*
+	 * Parallel readers of a file race to read ahead the same pages,
+	 * and the writers to create them. The losers see the winner's page
+	 * without charging, preloading and taking the tree_lock for an
+	 * -EEXIST. A page seen while it is removed only makes them look it
+	 * up again, as they do for the -EEXIST of a lost race.
+	 */
+	if (page_cache_tree_present(mapping, offset))
+		return -EEXIST;
+
 	if (!huge) {
 		error = mem_cgroup_try_charge(page, current->mm,
 					      gfp_mask, &memcg);
@@ -57,9 +57,16 @@ DEFINE_SPINLOCK(hugetlb_lock);
 /*
  * Serializes faults on the same logical page.  This is used to
  * prevent spurious OOMs when the hugepage pool is fully utilized.
+ * Each mutex has its own cacheline, the faults on different pages
+ * would otherwise bounce the lines of the neighbouring mutexes.
  */
+struct hugetlb_fault_mutex {
+	struct mutex mutex;
+} ____cacheline_aligned_in_smp;
+
 static int num_fault_mutexes;
-static struct mutex *htlb_fault_mutex_table ____cacheline_aligned_in_smp;
+static struct hugetlb_fault_mutex *htlb_fault_mutex_table
+	____cacheline_aligned_in_smp;
 
 static inline void unlock_or_release_subpool(struct hugepage_subpool *spool)
 {
@@ -549,6 +556,11 @@ static inline gfp_t htlb_alloc_mask(struct hstate *h)
 		return GFP_HIGHUSER;
 }
 
+/*
+ * Called without hugetlb_lock, returns with it held. The memory policy
+ * and cpuset of the allocation are looked up before taking the lock, so
+ * that the parallel faults only serialize on the freelist updates.
+ */
 static struct page *dequeue_huge_page_vma(struct hstate *h,
 				struct vm_area_struct *vma,
 				unsigned long address, int avoid_reserve,
@@ -562,6 +574,12 @@ static struct page *dequeue_huge_page_vma(struct hstate *h,
 	struct zoneref *z;
 	unsigned int cpuset_mems_cookie;
 
+retry_cpuset:
+	cpuset_mems_cookie = read_mems_allowed_begin();
+	zonelist = huge_zonelist(vma, address,
+					htlb_alloc_mask(h), &mpol, &nodemask);
+
+	spin_lock(&hugetlb_lock);
 	/*
 	 * A child process with MAP_PRIVATE mappings created by their parent
 	 * have no page reserves. This check ensures that reservations are
@@ -569,16 +587,11 @@ static struct page *dequeue_huge_page_vma(struct hstate *h,
 	 */
 	if (!vma_has_reserves(vma, chg) &&
 			h->free_huge_pages - h->resv_huge_pages == 0)
-		goto err;
+		goto out;
 
 	/* If reserves cannot be used, ensure enough pages are in the pool */
 	if (avoid_reserve && h->free_huge_pages - h->resv_huge_pages == 0)
-		goto err;
-
-retry_cpuset:
-	cpuset_mems_cookie = read_mems_allowed_begin();
-	zonelist = huge_zonelist(vma, address,
-					htlb_alloc_mask(h), &mpol, &nodemask);
+		goto out;
 
 	for_each_zone_zonelist_nodemask(zone, z, zonelist,
 						MAX_NR_ZONES - 1, nodemask) {
@@ -597,13 +610,14 @@ retry_cpuset:
 		}
 	}
 
-	mpol_cond_put(mpol);
-	if (unlikely(!page && read_mems_allowed_retry(cpuset_mems_cookie)))
+	if (unlikely(!page && read_mems_allowed_retry(cpuset_mems_cookie))) {
+		spin_unlock(&hugetlb_lock);
+		mpol_cond_put(mpol);
 		goto retry_cpuset;
+	}
+out:
+	mpol_cond_put(mpol);
 	return page;
-
-err:
-	return NULL;
 }
 
 /*
@@ -1391,7 +1405,6 @@ static struct page *alloc_huge_page(struct vm_area_struct *vma,
 	if (ret)
 		goto out_subpool_put;
 
-	spin_lock(&hugetlb_lock);
 	page = dequeue_huge_page_vma(h, vma, addr, avoid_reserve, chg);
 	if (!page) {
 		spin_unlock(&hugetlb_lock);
@@ -2161,11 +2174,12 @@ static int __init hugetlb_init(void)
 	num_fault_mutexes = 1;
 #endif
 	htlb_fault_mutex_table =
-		kmalloc(sizeof(struct mutex) * num_fault_mutexes, GFP_KERNEL);
+		kmalloc(sizeof(struct hugetlb_fault_mutex) * num_fault_mutexes,
+			GFP_KERNEL);
 	BUG_ON(!htlb_fault_mutex_table);
 
 	for (i = 0; i < num_fault_mutexes; i++)
-		mutex_init(&htlb_fault_mutex_table[i]);
+		mutex_init(&htlb_fault_mutex_table[i].mutex);
 	return 0;
 }
 module_init(hugetlb_init);
@@ -3155,7 +3169,7 @@ int hugetlb_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * the same page in the page cache.
 	 */
 	hash = fault_mutex_hash(h, mm, vma, mapping, idx, address);
-	mutex_lock(&htlb_fault_mutex_table[hash]);
+	mutex_lock(&htlb_fault_mutex_table[hash].mutex);
 
 	entry = huge_ptep_get(ptep);
 	if (huge_pte_none(entry)) {
@@ -3228,7 +3242,7 @@ out_ptl:
 	put_page(page);
 
 out_mutex:
-	mutex_unlock(&htlb_fault_mutex_table[hash]);
+	mutex_unlock(&htlb_fault_mutex_table[hash].mutex);
 	return ret;
 }
 
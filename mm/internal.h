@@ -114,6 +114,7 @@ extern void prep_compound_page(struct page *page, unsigned long order);
 extern bool is_free_buddy_page(struct page *page);
 #endif
 extern int user_min_free_kbytes;
+extern int zone_bulk_combine(struct zone *zone);
 
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
 
@@ -148,6 +149,10 @@ struct compact_control {
 					 * contention detected during
 					 * compaction
 					 */
+	/* Lock statistics of the compaction of the zone */
+	unsigned long zone_lock_contended;	/* zone->lock found taken */
+	unsigned long zone_lock_combined;	/* Requests run in our holds */
+	unsigned long lru_lock_contended;	/* lru_lock found taken */
 };
 
 unsigned long
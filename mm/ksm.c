@@ -33,7 +33,8 @@
 #include <linux/mmu_notifier.h>
 #include <linux/swap.h>
 #include <linux/ksm.h>
-#include <linux/hashtable.h>
+#include <linux/hash.h>
+#include <linux/list_bl.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
 #include <linux/numa.h>
@@ -90,36 +91,56 @@
  *
  * If the merge_across_nodes tunable is unset, then KSM maintains multiple
  * stable trees and multiple unstable trees: one of each for each NUMA node.
+ *
+ * The mms to scan are on one list per NUMA node, that of the CPU they entered
+ * KSM from, each list scanned by its own ksmd thread bound to the node.  The
+ * threads walk the mms in parallel but serialize on ksm_tree_mutex to search
+ * and update the trees; a full scan is complete, and the unstable trees are
+ * flushed, once every thread went through its list.
  */
 
 /**
  * struct mm_slot - ksm information per mm that is being scanned
  * @link: link to the mm_slots hash list
- * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
+ * @mm_list: link into the mm_slots list, rooted in the mm_head of its scan
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @scan: the ksm_scan whose list the mm_slot is on
  */
 struct mm_slot {
-	struct hlist_node link;
+	struct hlist_bl_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	struct ksm_scan *scan;
 };
 
 /**
  * struct ksm_scan - cursor for scanning
+ * @mm_head: head of the list of mm_slots to scan
+ * @lock: protects the list and the mm_slot cursor
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
- * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @stale_rmap_items: rmap_items taken off their rmap_list, to be removed
+ *	from the trees once mmap_sem is dropped
+ * @seqnr: count of completed full scans, counting the current one once
+ *	this cursor went through its list
+ * @nid: the NUMA node of the list and of its ksmd thread
+ * @thread: the ksmd thread scanning the list
  *
- * There is only the one ksm_scan instance of this cursor structure.
+ * There is one ksm_scan instance of this cursor structure per NUMA node.
  */
 struct ksm_scan {
+	struct mm_slot mm_head;
+	spinlock_t lock;
 	struct mm_slot *mm_slot;
 	unsigned long address;
 	struct rmap_item **rmap_list;
+	struct rmap_item *stale_rmap_items;
 	unsigned long seqnr;
+	int nid;
+	struct task_struct *thread;
 };
 
 /**
@@ -192,14 +213,13 @@ static struct rb_root *root_unstable_tree = one_unstable_tree;
 static LIST_HEAD(migrate_nodes);
 
 #define MM_SLOTS_HASH_BITS 10
-static DEFINE_HASHTABLE(mm_slots_hash, MM_SLOTS_HASH_BITS);
+static struct hlist_bl_head mm_slots_hash[1 << MM_SLOTS_HASH_BITS];
 
-static struct mm_slot ksm_mm_head = {
-	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
-};
-static struct ksm_scan ksm_scan = {
-	.mm_slot = &ksm_mm_head,
-};
+/* The scan cursors, one per NUMA node */
+static struct ksm_scan *ksm_scans;
+
+/* Count of completed full scans (needed when removing unstable node) */
+static unsigned long ksm_seqnr;
 
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
@@ -215,9 +235,9 @@ static unsigned long ksm_pages_sharing;
 static unsigned long ksm_pages_unshared;
 
 /* The number of rmap_items in use: to calculate pages_volatile */
-static unsigned long ksm_rmap_items;
+static atomic_long_t ksm_rmap_items = ATOMIC_LONG_INIT(0);
 
-/* Number of pages ksmd should scan in one batch */
+/* Number of pages each ksmd thread should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
 /* Milliseconds ksmd should sleep between batches */
@@ -238,10 +258,16 @@ static int ksm_nr_node_ids = 1;
 #define KSM_RUN_OFFLINE	4
 static unsigned long ksm_run = KSM_RUN_STOP;
 static void wait_while_offlining(void);
+static void ksmd_wait_while_offlining(void);
 
 static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
-static DEFINE_MUTEX(ksm_thread_mutex);
-static DEFINE_SPINLOCK(ksm_mmlist_lock);
+/* Taken for read by the ksmd threads, for write to keep them out */
+static DECLARE_RWSEM(ksm_thread_sem);
+/*
+ * Serializes the ksmd threads on the stable and unstable trees, the
+ * migrate_nodes list and the counts of pages in the trees.
+ */
+static DEFINE_MUTEX(ksm_tree_mutex);
 
 #define KSM_KMEM_CACHE(__struct, __flags) kmem_cache_create("ksm_"#__struct,\
 		sizeof(struct __struct), __alignof__(struct __struct),\
@@ -285,13 +311,13 @@ static inline struct rmap_item *alloc_rmap_item(void)
 
 	rmap_item = kmem_cache_zalloc(rmap_item_cache, GFP_KERNEL);
 	if (rmap_item)
-		ksm_rmap_items++;
+		atomic_long_inc(&ksm_rmap_items);
 	return rmap_item;
 }
 
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
-	ksm_rmap_items--;
+	atomic_long_dec(&ksm_rmap_items);
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -318,11 +344,21 @@ static inline void free_mm_slot(struct mm_slot *mm_slot)
 	kmem_cache_free(mm_slot_cache, mm_slot);
 }
 
+static inline struct hlist_bl_head *mm_slots_bucket(struct mm_struct *mm)
+{
+	return &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_BITS)];
+}
+
+/*
+ * The mm_slots hash bucket of an mm is locked with hlist_bl_lock(), before
+ * the lock of the scan.
+ */
 static struct mm_slot *get_mm_slot(struct mm_struct *mm)
 {
+	struct hlist_bl_node *node;
 	struct mm_slot *slot;
 
-	hash_for_each_possible(mm_slots_hash, slot, link, (unsigned long)mm)
+	hlist_bl_for_each_entry(slot, node, mm_slots_bucket(mm), link)
 		if (slot->mm == mm)
 			return slot;
 
@@ -333,7 +369,7 @@ static void insert_to_mm_slots_hash(struct mm_struct *mm,
 				    struct mm_slot *mm_slot)
 {
 	mm_slot->mm = mm;
-	hash_add(mm_slots_hash, &mm_slot->link, (unsigned long)mm);
+	hlist_bl_add_head(&mm_slot->link, mm_slots_bucket(mm));
 }
 
 /*
@@ -609,6 +645,7 @@ stale:
 /*
  * Removing rmap_item from stable or unstable tree.
  * This function will clean the information from the stable/unstable tree.
+ * Called with ksm_tree_mutex held, or with the ksmd threads kept out.
  */
 static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 {
@@ -642,7 +679,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
+		age = (unsigned char)(ksm_seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
 			rb_erase(&rmap_item->node,
@@ -654,14 +691,42 @@ out:
 	cond_resched();		/* we're called from many long loops */
 }
 
+/*
+ * Removing an rmap_item from the trees needs ksm_tree_mutex, which is taken
+ * before mmap_sem when merging pages: so the scan, holding mmap_sem, only
+ * queues the rmap_items it drops, and removes them after releasing it.
+ */
+static inline void stale_rmap_item(struct ksm_scan *scan,
+				   struct rmap_item *rmap_item)
+{
+	rmap_item->rmap_list = scan->stale_rmap_items;
+	scan->stale_rmap_items = rmap_item;
+}
+
+static void free_stale_rmap_items(struct ksm_scan *scan)
+{
+	struct rmap_item *rmap_item;
+
+	if (!scan->stale_rmap_items)
+		return;
+
+	mutex_lock(&ksm_tree_mutex);
+	while (scan->stale_rmap_items) {
+		rmap_item = scan->stale_rmap_items;
+		scan->stale_rmap_items = rmap_item->rmap_list;
+		remove_rmap_item_from_tree(rmap_item);
+		free_rmap_item(rmap_item);
+	}
+	mutex_unlock(&ksm_tree_mutex);
+}
+
 static void remove_trailing_rmap_items(struct mm_slot *mm_slot,
 				       struct rmap_item **rmap_list)
 {
 	while (*rmap_list) {
 		struct rmap_item *rmap_item = *rmap_list;
 		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		stale_rmap_item(mm_slot->scan, rmap_item);
 	}
 }
 
@@ -764,20 +829,21 @@ static int remove_all_stable_nodes(void)
 	return err;
 }
 
-static int unmerge_and_remove_all_rmap_items(void)
+static int unmerge_and_remove_scan_rmap_items(struct ksm_scan *scan)
 {
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
+	struct hlist_bl_head *bucket;
 	int err = 0;
 
-	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
+	spin_lock(&scan->lock);
+	scan->mm_slot = list_entry(scan->mm_head.mm_list.next,
 						struct mm_slot, mm_list);
-	spin_unlock(&ksm_mmlist_lock);
+	spin_unlock(&scan->lock);
 
-	for (mm_slot = ksm_scan.mm_slot;
-			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+	for (mm_slot = scan->mm_slot;
+			mm_slot != &scan->mm_head; mm_slot = scan->mm_slot) {
 		mm = mm_slot->mm;
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
@@ -793,36 +859,59 @@ static int unmerge_and_remove_all_rmap_items(void)
 
 		remove_trailing_rmap_items(mm_slot, &mm_slot->rmap_list);
 
-		spin_lock(&ksm_mmlist_lock);
-		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
-						struct mm_slot, mm_list);
 		if (ksm_test_exit(mm)) {
-			hash_del(&mm_slot->link);
+			bucket = mm_slots_bucket(mm);
+			hlist_bl_lock(bucket);
+			spin_lock(&scan->lock);
+			scan->mm_slot = list_entry(mm_slot->mm_list.next,
+						struct mm_slot, mm_list);
+			hlist_bl_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
-			spin_unlock(&ksm_mmlist_lock);
+			spin_unlock(&scan->lock);
+			hlist_bl_unlock(bucket);
 
 			free_mm_slot(mm_slot);
 			clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(scan);
 			mmdrop(mm);
 		} else {
-			spin_unlock(&ksm_mmlist_lock);
+			spin_lock(&scan->lock);
+			scan->mm_slot = list_entry(mm_slot->mm_list.next,
+						struct mm_slot, mm_list);
+			spin_unlock(&scan->lock);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(scan);
 		}
 	}
-
-	/* Clean up stable nodes, but don't worry if some are still busy */
-	remove_all_stable_nodes();
-	ksm_scan.seqnr = 0;
 	return 0;
 
 error:
 	up_read(&mm->mmap_sem);
-	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = &ksm_mm_head;
-	spin_unlock(&ksm_mmlist_lock);
+	free_stale_rmap_items(scan);
+	spin_lock(&scan->lock);
+	scan->mm_slot = &scan->mm_head;
+	spin_unlock(&scan->lock);
 	return err;
 }
+
+static int unmerge_and_remove_all_rmap_items(void)
+{
+	int nid, err;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		err = unmerge_and_remove_scan_rmap_items(&ksm_scans[nid]);
+		if (err)
+			return err;
+	}
+
+	/* Clean up stable nodes, but don't worry if some are still busy */
+	remove_all_stable_nodes();
+	ksm_seqnr = 0;
+	for (nid = 0; nid < nr_node_ids; nid++)
+		ksm_scans[nid].seqnr = 0;
+	return 0;
+}
 #endif /* CONFIG_SYSFS */
 
 static u32 calc_checksum(struct page *page)
@@ -1376,7 +1465,7 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
-	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->address |= (ksm_seqnr & SEQNR_MASK);
 	DO_NUMA(rmap_item->nid = nid);
 	rb_link_node(&rmap_item->node, parent, new);
 	rb_insert_color(&rmap_item->node, root);
@@ -1418,9 +1507,21 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
 	struct page *kpage;
-	unsigned int checksum;
+	unsigned int checksum = 0;
+	bool checksummed = false;
 	int err;
 
+	/*
+	 * The checksum only needs the page: compute it before serializing
+	 * with the other ksmd threads.  A ksm page is found in the stable
+	 * tree, and seldom needs it.
+	 */
+	if (!PageKsm(page)) {
+		checksum = calc_checksum(page);
+		checksummed = true;
+	}
+
+	mutex_lock(&ksm_tree_mutex);
 	stable_node = page_stable_node(page);
 	if (stable_node) {
 		if (stable_node->head != &migrate_nodes &&
@@ -1432,14 +1533,14 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		}
 		if (stable_node->head != &migrate_nodes &&
 		    rmap_item->head == stable_node)
-			return;
+			goto out;
 	}
 
 	/* We first start with searching the page inside the stable tree */
 	kpage = stable_tree_search(page);
 	if (kpage == page && rmap_item->head == stable_node) {
 		put_page(kpage);
-		return;
+		goto out;
 	}
 
 	remove_rmap_item_from_tree(rmap_item);
@@ -1456,7 +1557,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			unlock_page(kpage);
 		}
 		put_page(kpage);
-		return;
+		goto out;
 	}
 
 	/*
@@ -1465,10 +1566,11 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
+	if (!checksummed)
+		checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
-		return;
+		goto out;
 	}
 
 	tree_rmap_item =
@@ -1502,6 +1604,8 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			}
 		}
 	}
+out:
+	mutex_unlock(&ksm_tree_mutex);
 }
 
 static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
@@ -1517,8 +1621,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 		if (rmap_item->address > addr)
 			break;
 		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		stale_rmap_item(mm_slot->scan, rmap_item);
 	}
 
 	rmap_item = alloc_rmap_item();
@@ -1532,68 +1635,106 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * ksm_start_pass - called by a ksmd thread at the head of its list.
+ *
+ * The unstable trees are shared by the ksmd threads: they are flushed, and
+ * the next full scan started, once every thread went through its list.  A
+ * thread done with its list waits for the others here, this returns false
+ * meanwhile.
+ */
+static bool ksm_start_pass(struct ksm_scan *scan)
+{
+	bool complete = true;
+	int nid;
+
+	mutex_lock(&ksm_tree_mutex);
+	if (scan->seqnr <= ksm_seqnr)
+		goto out;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		struct ksm_scan *other = &ksm_scans[nid];
+
+		if (other->seqnr <= ksm_seqnr &&
+		    !list_empty(&other->mm_head.mm_list)) {
+			complete = false;
+			goto out;
+		}
+	}
+
+	/*
+	 * Whereas stale stable_nodes on the stable_tree itself
+	 * get pruned in the regular course of stable_tree_search(),
+	 * those moved out to the migrate_nodes list can accumulate:
+	 * so prune them once before each full scan.
+	 */
+	if (!ksm_merge_across_nodes) {
+		struct stable_node *stable_node;
+		struct list_head *this, *next;
+		struct page *page;
+
+		list_for_each_safe(this, next, &migrate_nodes) {
+			stable_node = list_entry(this,
+					struct stable_node, list);
+			page = get_ksm_page(stable_node, false);
+			if (page)
+				put_page(page);
+			cond_resched();
+		}
+	}
+
+	for (nid = 0; nid < ksm_nr_node_ids; nid++)
+		root_unstable_tree[nid] = RB_ROOT;
+	ksm_seqnr++;
+	mutex_unlock(&ksm_tree_mutex);
+
+	/*
+	 * A number of pages can hang around indefinitely on per-cpu
+	 * pagevecs, raised page count preventing write_protect_page
+	 * from merging them.  Though it doesn't really matter much,
+	 * it is puzzling to see some stuck in pages_volatile until
+	 * other activity jostles them out, and they also prevented
+	 * LTP's KSM test from succeeding deterministically; so drain
+	 * them here (here rather than on entry to ksm_do_scan(),
+	 * so we don't IPI too often when pages_to_scan is set low).
+	 */
+	lru_add_drain_all();
+	return true;
+out:
+	mutex_unlock(&ksm_tree_mutex);
+	return complete;
+}
+
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scan *scan,
+						 struct page **page)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
-	int nid;
+	struct hlist_bl_head *bucket;
 
-	if (list_empty(&ksm_mm_head.mm_list))
+	if (list_empty(&scan->mm_head.mm_list))
 		return NULL;
 
-	slot = ksm_scan.mm_slot;
-	if (slot == &ksm_mm_head) {
-		/*
-		 * A number of pages can hang around indefinitely on per-cpu
-		 * pagevecs, raised page count preventing write_protect_page
-		 * from merging them.  Though it doesn't really matter much,
-		 * it is puzzling to see some stuck in pages_volatile until
-		 * other activity jostles them out, and they also prevented
-		 * LTP's KSM test from succeeding deterministically; so drain
-		 * them here (here rather than on entry to ksm_do_scan(),
-		 * so we don't IPI too often when pages_to_scan is set low).
-		 */
-		lru_add_drain_all();
-
-		/*
-		 * Whereas stale stable_nodes on the stable_tree itself
-		 * get pruned in the regular course of stable_tree_search(),
-		 * those moved out to the migrate_nodes list can accumulate:
-		 * so prune them once before each full scan.
-		 */
-		if (!ksm_merge_across_nodes) {
-			struct stable_node *stable_node;
-			struct list_head *this, *next;
-			struct page *page;
-
-			list_for_each_safe(this, next, &migrate_nodes) {
-				stable_node = list_entry(this,
-						struct stable_node, list);
-				page = get_ksm_page(stable_node, false);
-				if (page)
-					put_page(page);
-				cond_resched();
-			}
-		}
-
-		for (nid = 0; nid < ksm_nr_node_ids; nid++)
-			root_unstable_tree[nid] = RB_ROOT;
+	slot = scan->mm_slot;
+	if (slot == &scan->mm_head) {
+		if (!ksm_start_pass(scan))
+			return NULL;
 
-		spin_lock(&ksm_mmlist_lock);
+		spin_lock(&scan->lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
-		spin_unlock(&ksm_mmlist_lock);
+		scan->mm_slot = slot;
+		spin_unlock(&scan->lock);
 		/*
 		 * Although we tested list_empty() above, a racing __ksm_exit
 		 * of the last mm on the list may have removed it since then.
 		 */
-		if (slot == &ksm_mm_head)
+		if (slot == &scan->mm_head)
 			return NULL;
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 
 	mm = slot->mm;
@@ -1601,60 +1742,58 @@ next_mm:
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (IS_ERR_OR_NULL(*page)) {
-				ksm_scan.address += PAGE_SIZE;
+				scan->address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
 			if (PageAnon(*page) ||
 			    page_trans_compound_anon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
 				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+					scan->rmap_list, scan->address);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
+				free_stale_rmap_items(scan);
 				return rmap_item;
 			}
 			put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	remove_trailing_rmap_items(slot, scan->rmap_list);
 
-	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
-						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -1664,40 +1803,54 @@ next_mm:
 		 * or when all VM_MERGEABLE areas have been unmapped (and
 		 * mmap_sem then protects against race with MADV_MERGEABLE).
 		 */
-		hash_del(&slot->link);
+		bucket = mm_slots_bucket(mm);
+		hlist_bl_lock(bucket);
+		spin_lock(&scan->lock);
+		scan->mm_slot = list_entry(slot->mm_list.next,
+						struct mm_slot, mm_list);
+		hlist_bl_del(&slot->link);
 		list_del(&slot->mm_list);
-		spin_unlock(&ksm_mmlist_lock);
+		spin_unlock(&scan->lock);
+		hlist_bl_unlock(bucket);
 
 		free_mm_slot(slot);
 		clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(scan);
 		mmdrop(mm);
 	} else {
-		spin_unlock(&ksm_mmlist_lock);
+		spin_lock(&scan->lock);
+		scan->mm_slot = list_entry(slot->mm_list.next,
+						struct mm_slot, mm_list);
+		spin_unlock(&scan->lock);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(scan);
 	}
 
 	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
-	if (slot != &ksm_mm_head)
+	slot = scan->mm_slot;
+	if (slot != &scan->mm_head)
 		goto next_mm;
 
-	ksm_scan.seqnr++;
+	mutex_lock(&ksm_tree_mutex);
+	scan->seqnr = ksm_seqnr + 1;
+	mutex_unlock(&ksm_tree_mutex);
 	return NULL;
 }
 
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scan - the cursor of the list to scan.
  * @scan_npages - number of pages we want to scan before we return.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scan *scan, unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(scan, &page);
 		if (!rmap_item)
 			return;
 		cmp_and_merge_page(page, rmap_item);
@@ -1705,31 +1858,37 @@ static void ksm_do_scan(unsigned int scan_npages)
 	}
 }
 
-static int ksmd_should_run(void)
+static int ksmd_should_run(struct ksm_scan *scan)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	return (ksm_run & KSM_RUN_MERGE) &&
+	       !list_empty(&scan->mm_head.mm_list);
 }
 
-static int ksm_scan_thread(void *nothing)
+static int ksm_scan_thread(void *data)
 {
+	struct ksm_scan *scan = data;
+	const struct cpumask *cpumask = cpumask_of_node(scan->nid);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
-		mutex_lock(&ksm_thread_mutex);
-		wait_while_offlining();
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
-		mutex_unlock(&ksm_thread_mutex);
+		down_read(&ksm_thread_sem);
+		ksmd_wait_while_offlining();
+		if (ksmd_should_run(scan))
+			ksm_do_scan(scan, ksm_thread_pages_to_scan);
+		up_read(&ksm_thread_sem);
 
 		try_to_freeze();
 
-		if (ksmd_should_run()) {
+		if (ksmd_should_run(scan)) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
-				ksmd_should_run() || kthread_should_stop());
+				ksmd_should_run(scan) || kthread_should_stop());
 		}
 	}
 	return 0;
@@ -1784,6 +1943,8 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 
 int __ksm_enter(struct mm_struct *mm)
 {
+	struct hlist_bl_head *bucket = mm_slots_bucket(mm);
+	struct ksm_scan *scan;
 	struct mm_slot *mm_slot;
 	int needs_wakeup;
 
@@ -1791,10 +1952,15 @@ int __ksm_enter(struct mm_struct *mm)
 	if (!mm_slot)
 		return -ENOMEM;
 
+	/* Scanned from the node the mm is being used on */
+	scan = &ksm_scans[numa_node_id()];
+	mm_slot->scan = scan;
+
 	/* Check ksm_run too?  Would need tighter locking */
-	needs_wakeup = list_empty(&ksm_mm_head.mm_list);
+	needs_wakeup = list_empty(&scan->mm_head.mm_list);
 
-	spin_lock(&ksm_mmlist_lock);
+	hlist_bl_lock(bucket);
+	spin_lock(&scan->lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
 	/*
 	 * When KSM_RUN_MERGE (or KSM_RUN_STOP),
@@ -1807,10 +1973,11 @@ int __ksm_enter(struct mm_struct *mm)
 	 * missed: then we might as well insert at the end of the list.
 	 */
 	if (ksm_run & KSM_RUN_UNMERGE)
-		list_add_tail(&mm_slot->mm_list, &ksm_mm_head.mm_list);
+		list_add_tail(&mm_slot->mm_list, &scan->mm_head.mm_list);
 	else
-		list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
-	spin_unlock(&ksm_mmlist_lock);
+		list_add_tail(&mm_slot->mm_list, &scan->mm_slot->mm_list);
+	spin_unlock(&scan->lock);
+	hlist_bl_unlock(bucket);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
 	atomic_inc(&mm->mm_count);
@@ -1823,6 +1990,8 @@ int __ksm_enter(struct mm_struct *mm)
 
 void __ksm_exit(struct mm_struct *mm)
 {
+	struct hlist_bl_head *bucket = mm_slots_bucket(mm);
+	struct ksm_scan *scan;
 	struct mm_slot *mm_slot;
 	int easy_to_free = 0;
 
@@ -1835,19 +2004,24 @@ void __ksm_exit(struct mm_struct *mm)
 	 * Beware: ksm may already have noticed it exiting and freed the slot.
 	 */
 
-	spin_lock(&ksm_mmlist_lock);
+	hlist_bl_lock(bucket);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
-		if (!mm_slot->rmap_list) {
-			hash_del(&mm_slot->link);
-			list_del(&mm_slot->mm_list);
-			easy_to_free = 1;
-		} else {
-			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+	if (mm_slot) {
+		scan = mm_slot->scan;
+		spin_lock(&scan->lock);
+		if (scan->mm_slot != mm_slot) {
+			if (!mm_slot->rmap_list) {
+				hlist_bl_del(&mm_slot->link);
+				list_del(&mm_slot->mm_list);
+				easy_to_free = 1;
+			} else {
+				list_move(&mm_slot->mm_list,
+					  &scan->mm_slot->mm_list);
+			}
 		}
+		spin_unlock(&scan->lock);
 	}
-	spin_unlock(&ksm_mmlist_lock);
+	hlist_bl_unlock(bucket);
 
 	if (easy_to_free) {
 		free_mm_slot(mm_slot);
@@ -1981,10 +2155,21 @@ void ksm_migrate_page(struct page *newpage, struct page *oldpage)
 static void wait_while_offlining(void)
 {
 	while (ksm_run & KSM_RUN_OFFLINE) {
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		wait_on_bit(&ksm_run, ilog2(KSM_RUN_OFFLINE),
 			    TASK_UNINTERRUPTIBLE);
-		mutex_lock(&ksm_thread_mutex);
+		down_write(&ksm_thread_sem);
+	}
+}
+
+/* The same for the ksmd threads, which hold ksm_thread_sem for read */
+static void ksmd_wait_while_offlining(void)
+{
+	while (ksm_run & KSM_RUN_OFFLINE) {
+		up_read(&ksm_thread_sem);
+		wait_on_bit(&ksm_run, ilog2(KSM_RUN_OFFLINE),
+			    TASK_UNINTERRUPTIBLE);
+		down_read(&ksm_thread_sem);
 	}
 }
 
@@ -2034,11 +2219,11 @@ static int ksm_memory_callback(struct notifier_block *self,
 		 * and remove_all_stable_nodes() while memory is going offline:
 		 * it is unsafe for them to touch the stable tree at this time.
 		 * But unmerge_ksm_pages(), rmap lookups and other entry points
-		 * which do not need the ksm_thread_mutex are all safe.
+		 * which do not need the ksm_thread_sem are all safe.
 		 */
-		mutex_lock(&ksm_thread_mutex);
+		down_write(&ksm_thread_sem);
 		ksm_run |= KSM_RUN_OFFLINE;
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		break;
 
 	case MEM_OFFLINE:
@@ -2054,9 +2239,9 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/* fallthrough */
 
 	case MEM_CANCEL_OFFLINE:
-		mutex_lock(&ksm_thread_mutex);
+		down_write(&ksm_thread_sem);
 		ksm_run &= ~KSM_RUN_OFFLINE;
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 
 		smp_mb();	/* wake_up_bit advises this */
 		wake_up_bit(&ksm_run, ilog2(KSM_RUN_OFFLINE));
@@ -2068,6 +2253,10 @@ static int ksm_memory_callback(struct notifier_block *self,
 static void wait_while_offlining(void)
 {
 }
+
+static void ksmd_wait_while_offlining(void)
+{
+}
 #endif /* CONFIG_MEMORY_HOTREMOVE */
 
 #ifdef CONFIG_SYSFS
@@ -2152,7 +2341,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 * on the list for when ksmd may be set running again).
 	 */
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	wait_while_offlining();
 	if (ksm_run != flags) {
 		ksm_run = flags;
@@ -2166,7 +2355,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 			}
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	if (flags & KSM_RUN_MERGE)
 		wake_up_interruptible(&ksm_thread_wait);
@@ -2195,7 +2384,7 @@ static ssize_t merge_across_nodes_store(struct kobject *kobj,
 	if (knob > 1)
 		return -EINVAL;
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	wait_while_offlining();
 	if (ksm_merge_across_nodes != knob) {
 		if (ksm_pages_shared || remove_all_stable_nodes())
@@ -2226,7 +2415,7 @@ static ssize_t merge_across_nodes_store(struct kobject *kobj,
 			ksm_nr_node_ids = knob ? 1 : nr_node_ids;
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	return err ? err : count;
 }
@@ -2259,8 +2448,9 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 {
 	long ksm_pages_volatile;
 
-	ksm_pages_volatile = ksm_rmap_items - ksm_pages_shared
-				- ksm_pages_sharing - ksm_pages_unshared;
+	ksm_pages_volatile = atomic_long_read(&ksm_rmap_items)
+				- ksm_pages_shared - ksm_pages_sharing
+				- ksm_pages_unshared;
 	/*
 	 * It was not worth any locking to calculate that statistic,
 	 * but it might therefore sometimes be negative: conceal that.
@@ -2274,7 +2464,7 @@ KSM_ATTR_RO(pages_volatile);
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_scan.seqnr);
+	return sprintf(buf, "%lu\n", ksm_seqnr);
 }
 KSM_ATTR_RO(full_scans);
 
@@ -2299,28 +2489,67 @@ static struct attribute_group ksm_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
-static int __init ksm_init(void)
+static void __init ksm_stop_threads(void)
+{
+	int nid;
+
+	for_each_node(nid) {
+		if (ksm_scans[nid].thread)
+			kthread_stop(ksm_scans[nid].thread);
+	}
+}
+
+static int __init ksm_start_threads(void)
 {
 	struct task_struct *ksm_thread;
-	int err;
+	int nid;
+
+	for_each_node(nid) {
+		ksm_thread = kthread_create_on_node(ksm_scan_thread,
+				&ksm_scans[nid], nid,
+				nr_node_ids > 1 ? "ksmd/%d" : "ksmd", nid);
+		if (IS_ERR(ksm_thread)) {
+			pr_err("ksm: creating kthread failed\n");
+			ksm_stop_threads();
+			return PTR_ERR(ksm_thread);
+		}
+		ksm_scans[nid].thread = ksm_thread;
+		wake_up_process(ksm_thread);
+	}
+	return 0;
+}
+
+static int __init ksm_init(void)
+{
+	struct ksm_scan *scan;
+	int nid, err;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
-	if (IS_ERR(ksm_thread)) {
-		pr_err("ksm: creating kthread failed\n");
-		err = PTR_ERR(ksm_thread);
+	err = -ENOMEM;
+	ksm_scans = kcalloc(nr_node_ids, sizeof(*ksm_scans), GFP_KERNEL);
+	if (!ksm_scans)
 		goto out_free;
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		scan = &ksm_scans[nid];
+		INIT_LIST_HEAD(&scan->mm_head.mm_list);
+		spin_lock_init(&scan->lock);
+		scan->mm_slot = &scan->mm_head;
+		scan->nid = nid;
 	}
 
+	err = ksm_start_threads();
+	if (err)
+		goto out_free_scans;
+
 #ifdef CONFIG_SYSFS
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
 	if (err) {
 		pr_err("ksm: register sysfs failed\n");
-		kthread_stop(ksm_thread);
-		goto out_free;
+		ksm_stop_threads();
+		goto out_free_scans;
 	}
 #else
 	ksm_run = KSM_RUN_MERGE;	/* no way for user to start it */
@@ -2333,6 +2562,8 @@ static int __init ksm_init(void)
 #endif
 	return 0;
 
+out_free_scans:
+	kfree(ksm_scans);
 out_free:
 	ksm_slab_free();
 out:
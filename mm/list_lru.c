@@ -8,13 +8,107 @@
 #include <linux/module.h>
 #include <linux/mm.h>
 #include <linux/list_lru.h>
+#include <linux/percpu.h>
+#include <linux/poison.h>
 #include <linux/slab.h>
 
+/* Move the items of a per-cpu cache to their node lists */
+static void list_lru_pcp_drain(struct list_lru *lru, struct list_lru_pcp *pcp)
+{
+	struct list_lru_node *nlru = NULL;
+	unsigned int i;
+
+	for (i = 0; i < pcp->nr; i++) {
+		struct list_head *item = pcp->items[i];
+		int nid = page_to_nid(virt_to_page(item));
+
+		if (nlru != &lru->node[nid]) {
+			if (nlru)
+				spin_unlock(&nlru->lock);
+			nlru = &lru->node[nid];
+			spin_lock(&nlru->lock);
+		}
+		list_add_tail(item, &nlru->list);
+		if (nlru->nr_items++ == 0)
+			node_set(nid, lru->active_nodes);
+	}
+	if (nlru)
+		spin_unlock(&nlru->lock);
+	pcp->nr = 0;
+}
+
+static void list_lru_pcp_drain_all(struct list_lru *lru)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct list_lru_pcp *pcp = per_cpu_ptr(lru->pcp, cpu);
+
+		if (!ACCESS_ONCE(pcp->nr))
+			continue;
+		spin_lock(&pcp->lock);
+		list_lru_pcp_drain(lru, pcp);
+		spin_unlock(&pcp->lock);
+	}
+}
+
+/*
+ * The caller serializes the add and del of an item, so an empty item can't
+ * be put on a list behind our back.
+ */
+static void list_lru_pcp_add(struct list_lru *lru, struct list_head *item)
+{
+	struct list_lru_pcp *pcp = get_cpu_ptr(lru->pcp);
+
+	spin_lock(&pcp->lock);
+	if (pcp->nr == LIST_LRU_PCP_BATCH)
+		list_lru_pcp_drain(lru, pcp);
+	pcp->items[pcp->nr++] = item;
+	item->prev = (void *)(unsigned long)smp_processor_id();
+	item->next = LIST_LRU_PCP_POISON;
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(lru->pcp);
+}
+
+/*
+ * Remove an item from the cache of its cpu, unless it has been drained to
+ * its node list meanwhile.
+ */
+static bool list_lru_pcp_del(struct list_lru *lru, struct list_head *item)
+{
+	int cpu = (unsigned long)ACCESS_ONCE(item->prev);
+	struct list_lru_pcp *pcp = per_cpu_ptr(lru->pcp, cpu);
+	unsigned int i;
+	bool found = false;
+
+	spin_lock(&pcp->lock);
+	if (item->next == LIST_LRU_PCP_POISON) {
+		for (i = 0; i < pcp->nr; i++) {
+			if (pcp->items[i] == item) {
+				pcp->items[i] = pcp->items[--pcp->nr];
+				INIT_LIST_HEAD(item);
+				found = true;
+				break;
+			}
+		}
+		WARN_ON_ONCE(!found);
+	}
+	spin_unlock(&pcp->lock);
+	return found;
+}
+
 bool list_lru_add(struct list_lru *lru, struct list_head *item)
 {
 	int nid = page_to_nid(virt_to_page(item));
 	struct list_lru_node *nlru = &lru->node[nid];
 
+	if (lru->pcp) {
+		if (!list_empty(item))
+			return false;
+		list_lru_pcp_add(lru, item);
+		return true;
+	}
+
 	spin_lock(&nlru->lock);
 	WARN_ON_ONCE(nlru->nr_items < 0);
 	if (list_empty(item)) {
@@ -34,6 +128,10 @@ bool list_lru_del(struct list_lru *lru, struct list_head *item)
 	int nid = page_to_nid(virt_to_page(item));
 	struct list_lru_node *nlru = &lru->node[nid];
 
+	if (lru->pcp && ACCESS_ONCE(item->next) == LIST_LRU_PCP_POISON &&
+	    list_lru_pcp_del(lru, item))
+		return true;
+
 	spin_lock(&nlru->lock);
 	if (!list_empty(item)) {
 		list_del_init(item);
@@ -72,6 +170,9 @@ list_lru_walk_node(struct list_lru *lru, int nid, list_lru_walk_cb isolate,
 	struct list_head *item, *n;
 	unsigned long isolated = 0;
 
+	if (lru->pcp)
+		list_lru_pcp_drain_all(lru);
+
 	spin_lock(&nlru->lock);
 restart:
 	list_for_each_safe(item, n, &nlru->list) {
@@ -124,15 +225,27 @@ restart:
 }
 EXPORT_SYMBOL_GPL(list_lru_walk_node);
 
-int list_lru_init_key(struct list_lru *lru, struct lock_class_key *key)
+int __list_lru_init(struct list_lru *lru, struct lock_class_key *key,
+		    bool pcp)
 {
-	int i;
+	int i, cpu;
 	size_t size = sizeof(*lru->node) * nr_node_ids;
 
 	lru->node = kzalloc(size, GFP_KERNEL);
 	if (!lru->node)
 		return -ENOMEM;
 
+	lru->pcp = NULL;
+	if (pcp) {
+		lru->pcp = alloc_percpu(struct list_lru_pcp);
+		if (!lru->pcp) {
+			kfree(lru->node);
+			return -ENOMEM;
+		}
+		for_each_possible_cpu(cpu)
+			spin_lock_init(&per_cpu_ptr(lru->pcp, cpu)->lock);
+	}
+
 	nodes_clear(lru->active_nodes);
 	for (i = 0; i < nr_node_ids; i++) {
 		spin_lock_init(&lru->node[i].lock);
@@ -143,10 +256,11 @@ int list_lru_init_key(struct list_lru *lru, struct lock_class_key *key)
 	}
 	return 0;
 }
-EXPORT_SYMBOL_GPL(list_lru_init_key);
+EXPORT_SYMBOL_GPL(__list_lru_init);
 
 void list_lru_destroy(struct list_lru *lru)
 {
+	free_percpu(lru->pcp);
 	kfree(lru->node);
 }
 EXPORT_SYMBOL_GPL(list_lru_destroy);
@@ -2280,12 +2280,16 @@ void mem_cgroup_update_page_stat(struct page *page,
 
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
- * TODO: maybe necessary to use big numbers in big irons.
+ * A cpu that keeps running out of stock for the same memcg doubles its
+ * batch, up to CHARGE_BATCH_MAX, as long as the memcg is far enough from
+ * its limit; see stock_batch().
  */
 #define CHARGE_BATCH	32U
+#define CHARGE_BATCH_MAX	512U
 struct memcg_stock_pcp {
 	struct mem_cgroup *cached; /* this never be root cgroup */
 	unsigned int nr_pages;
+	unsigned int batch;	/* pages to charge ahead for cached */
 	struct work_struct work;
 	unsigned long flags;
 #define FLUSHING_CACHED_CHARGE	0
@@ -2309,7 +2313,7 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	struct memcg_stock_pcp *stock;
 	bool ret = true;
 
-	if (nr_pages > CHARGE_BATCH)
+	if (nr_pages > CHARGE_BATCH_MAX)
 		return false;
 
 	stock = &get_cpu_var(memcg_stock);
@@ -2337,6 +2341,7 @@ static void drain_stock(struct memcg_stock_pcp *stock)
 		stock->nr_pages = 0;
 	}
 	stock->cached = NULL;
+	stock->batch = CHARGE_BATCH;
 }
 
 /*
@@ -2358,9 +2363,43 @@ static void __init memcg_stock_init(void)
 		struct memcg_stock_pcp *stock =
 					&per_cpu(memcg_stock, cpu);
 		INIT_WORK(&stock->work, drain_local_stock);
+		stock->batch = CHARGE_BATCH;
 	}
 }
 
+/*
+ * How many pages to charge ahead when the stock of this cpu cannot
+ * satisfy a charge to @memcg.  If the stock already belongs to @memcg it
+ * simply ran dry, so charge twice as much as last time unless that would
+ * bring all cpus' stocks close to the limit.
+ */
+static unsigned int stock_batch(struct mem_cgroup *memcg)
+{
+	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+	unsigned int batch = CHARGE_BATCH;
+
+	if (stock->cached == memcg) {
+		batch = stock->batch;
+		if (batch < CHARGE_BATCH_MAX &&
+		    res_counter_margin(&memcg->res) >> PAGE_SHIFT >
+		    4UL * batch * num_online_cpus())
+			batch *= 2;
+		stock->batch = batch;
+	}
+	put_cpu_var(memcg_stock);
+	return batch;
+}
+
+/* The memcg is close to its limit, go back to charging small batches */
+static void shrink_stock_batch(struct mem_cgroup *memcg)
+{
+	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+
+	if (stock->cached == memcg)
+		stock->batch = CHARGE_BATCH;
+	put_cpu_var(memcg_stock);
+}
+
 /*
  * Cache charges(val) which is from res_counter, to local per_cpu area.
  * This will be consumed by consume_stock() function, later.
@@ -2494,7 +2533,7 @@ static int memcg_cpu_hotplug_callback(struct notifier_block *nb,
 static int try_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 		      unsigned int nr_pages)
 {
-	unsigned int batch = max(CHARGE_BATCH, nr_pages);
+	unsigned int batch = 0;
 	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct mem_cgroup *mem_over_limit;
 	struct res_counter *fail_res;
@@ -2510,6 +2549,8 @@ retry:
 	if (consume_stock(memcg, nr_pages))
 		goto done;
 
+	if (!batch)
+		batch = max(stock_batch(memcg), nr_pages);
 	size = batch * PAGE_SIZE;
 	if (!do_swap_account ||
 	    !res_counter_charge(&memcg->memsw, size, &fail_res)) {
@@ -2524,6 +2565,7 @@ retry:
 	}
 
 	if (batch > nr_pages) {
+		shrink_stock_batch(memcg);
 		batch = nr_pages;
 		goto retry;
 	}
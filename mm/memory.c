@@ -3410,12 +3410,19 @@ int __pud_alloc(struct mm_struct *mm, pgd_t *pgd, unsigned long address)
 int __pmd_alloc(struct mm_struct *mm, pud_t *pud, unsigned long address)
 {
 	pmd_t *new = pmd_alloc_one(mm, address);
+	spinlock_t *ptl;
+
 	if (!new)
 		return -ENOMEM;
 
 	smp_wmb(); /* See comment in __pte_alloc */
 
-	spin_lock(&mm->page_table_lock);
+	/* The kernel pud tables have no split lock, see pud_lockptr() */
+	if (mm == &init_mm)
+		ptl = &mm->page_table_lock;
+	else
+		ptl = pud_lockptr(mm, pud);
+	spin_lock(ptl);
 #ifndef __ARCH_HAS_4LEVEL_HACK
 	if (pud_present(*pud))		/* Another has populated it */
 		pmd_free(mm, new);
@@ -3427,7 +3434,7 @@ int __pmd_alloc(struct mm_struct *mm, pud_t *pud, unsigned long address)
 	else
 		pgd_populate(mm, pud, new);
 #endif /* __ARCH_HAS_4LEVEL_HACK */
-	spin_unlock(&mm->page_table_lock);
+	spin_unlock(ptl);
 	return 0;
 }
 #endif /* __PAGETABLE_PMD_FOLDED */
@@ -662,6 +662,82 @@ static inline int free_pages_check(struct page *page)
 	return 0;
 }
 
+/*
+ * The bulk operations on zone->lock are combined: a CPU that finds the lock
+ * taken posts its request on zone->lock_requests, and whoever gets the lock
+ * runs all the posted requests before releasing it. A single lock hold then
+ * serves all the waiting CPUs instead of handing the lock over to each of
+ * them in turn. The posting CPU has interrupts disabled and waits for its
+ * request to be done, so its pcp lists can be worked on meanwhile.
+ */
+struct zone_bulk_req {
+	struct llist_node	node;
+	struct per_cpu_pages	*pcp;		/* Free from these pcp lists */
+	struct list_head	*list;		/* Or refill this list */
+	unsigned int		order;
+	int			migratetype;
+	bool			cold;
+	int			count;		/* Pages to move, then moved */
+	int			done;
+};
+
+static void __free_pcppages_bulk(struct zone *zone, int count,
+				 struct per_cpu_pages *pcp);
+static int __rmqueue_bulk(struct zone *zone, unsigned int order,
+			  unsigned long count, struct list_head *list,
+			  int migratetype, bool cold);
+
+static void zone_bulk_run(struct zone *zone, struct zone_bulk_req *req)
+{
+	if (req->pcp)
+		__free_pcppages_bulk(zone, req->count, req->pcp);
+	else
+		req->count = __rmqueue_bulk(zone, req->order, req->count,
+					    req->list, req->migratetype,
+					    req->cold);
+}
+
+/*
+ * Run the posted requests, called with zone->lock held. Returns the number
+ * of requests run. The other holders of zone->lock, e.g. compaction, call
+ * it before releasing the lock so that the waiting CPUs are served too.
+ */
+int zone_bulk_combine(struct zone *zone)
+{
+	struct llist_node *first = llist_del_all(&zone->lock_requests);
+	struct zone_bulk_req *req, *next;
+	int nr = 0;
+
+	/* The request is gone as soon as it is marked done */
+	llist_for_each_entry_safe(req, next, first, node) {
+		zone_bulk_run(zone, req);
+		smp_store_release(&req->done, 1);
+		nr++;
+	}
+	return nr;
+}
+
+static void zone_bulk(struct zone *zone, struct zone_bulk_req *req)
+{
+	if (spin_trylock(&zone->lock)) {
+		zone_bulk_run(zone, req);
+		goto unlock;
+	}
+
+	req->done = 0;
+	llist_add(&req->node, &zone->lock_requests);
+	for (;;) {
+		if (smp_load_acquire(&req->done))
+			return;
+		if (!spin_is_locked(&zone->lock) && spin_trylock(&zone->lock))
+			break;
+		cpu_relax();
+	}
+unlock:
+	zone_bulk_combine(zone);
+	spin_unlock(&zone->lock);
+}
+
 /*
  * Frees a number of pages from the PCP lists
  * Assumes all pages on list are in same zone, and of same order.
@@ -675,13 +751,23 @@ static inline int free_pages_check(struct page *page)
  */
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
+{
+	struct zone_bulk_req req = {
+		.pcp	= pcp,
+		.count	= count,
+	};
+
+	zone_bulk(zone, &req);
+}
+
+static void __free_pcppages_bulk(struct zone *zone, int count,
+				 struct per_cpu_pages *pcp)
 {
 	int migratetype = 0;
 	int batch_free = 0;
 	int to_free = count;
 	unsigned long nr_scanned;
 
-	spin_lock(&zone->lock);
 	nr_scanned = zone_page_state(zone, NR_PAGES_SCANNED);
 	if (nr_scanned)
 		__mod_zone_page_state(zone, NR_PAGES_SCANNED, -nr_scanned);
@@ -725,7 +811,6 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			}
 		} while (--to_free && --batch_free && !list_empty(list));
 	}
-	spin_unlock(&zone->lock);
 }
 
 static void free_one_page(struct zone *zone,
@@ -1218,10 +1303,25 @@ retry_reserve:
 static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			unsigned long count, struct list_head *list,
 			int migratetype, bool cold)
+{
+	struct zone_bulk_req req = {
+		.list		= list,
+		.order		= order,
+		.migratetype	= migratetype,
+		.cold		= cold,
+		.count		= count,
+	};
+
+	zone_bulk(zone, &req);
+	return req.count;
+}
+
+static int __rmqueue_bulk(struct zone *zone, unsigned int order,
+			  unsigned long count, struct list_head *list,
+			  int migratetype, bool cold)
 {
 	int i;
 
-	spin_lock(&zone->lock);
 	for (i = 0; i < count; ++i) {
 		struct page *page = __rmqueue(zone, order, migratetype);
 		if (unlikely(page == NULL))
@@ -1246,7 +1346,6 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 					      -(1 << order));
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
-	spin_unlock(&zone->lock);
 	return i;
 }
 
@@ -4901,7 +5000,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 #endif
 		zone->name = zone_names[j];
 		spin_lock_init(&zone->lock);
+		init_llist_head(&zone->lock_requests);
 		spin_lock_init(&zone->lru_lock);
+		init_llist_head(&zone->lru_requests);
 		zone_seqlock_init(zone);
 		zone->zone_pgdat = pgdat;
 		zone_pcp_init(zone);
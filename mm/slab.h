@@ -333,6 +333,10 @@ struct kmem_cache_node {
 #ifdef CONFIG_SLUB
 	unsigned long nr_partial;
 	struct list_head partial;
+	atomic_t nr_deferred_empty;	/* Empty slabs left on partial */
+	unsigned long list_lock_contended;
+	unsigned int window_locked;	/* Acquisitions in this window */
+	unsigned int window_contended;
 #ifdef CONFIG_SLUB_DEBUG
 	atomic_long_t nr_slabs;
 	atomic_long_t total_objects;
@@ -72,7 +72,9 @@
  *   much as possible. As long as SLUB does not have to handle partial
  *   slabs, operations can continue without any centralized lock. F.e.
  *   allocating a long series of objects that fill up slabs does not require
- *   the list lock.
+ *   the list lock. The slabs emptied by remote frees are left on the
+ *   partial list without it and trimmed in batches, and the contention on
+ *   the list_lock raises the per cpu partial limit, see lock_node().
  *   Interrupts are disabled during allocation and deallocation in order to
  *   make the slab allocator safe to use in the context of an irq. In addition
  *   interrupts are disabled to ensure that the processor does not change
@@ -1486,6 +1488,16 @@ static void discard_slab(struct kmem_cache *s, struct page *page)
 	free_slab(s, page);
 }
 
+static void discard_slabs(struct kmem_cache *s, struct list_head *discard)
+{
+	struct page *page, *t;
+
+	list_for_each_entry_safe(page, t, discard, lru) {
+		stat(s, FREE_SLAB);
+		discard_slab(s, page);
+	}
+}
+
 /*
  * Management of partially allocated slabs.
  */
@@ -1520,6 +1532,93 @@ static inline void remove_partial(struct kmem_cache_node *n,
 	__remove_partial(n, page);
 }
 
+/*
+ * The list_lock acquisitions of lock_node() are counted per node in windows
+ * of SLUB_LOCK_WINDOW. A window where more than 1/8 of them was contended
+ * doubles the per cpu partial limit of the cache, up to 8 times cpu_partial,
+ * so that the processors go to the node lists less often. A window without
+ * contention halves it back.
+ */
+#define SLUB_LOCK_WINDOW		256
+#define SLUB_MAX_CPU_PARTIAL_SHIFT	3
+
+static inline int slub_cpu_partial(struct kmem_cache *s)
+{
+	return s->cpu_partial << ACCESS_ONCE(s->cpu_partial_shift);
+}
+
+static void slub_adapt_cpu_partial(struct kmem_cache *s,
+				   struct kmem_cache_node *n)
+{
+	int shift = s->cpu_partial_shift;
+
+	if (n->window_contended * 8 > n->window_locked) {
+		if (shift < SLUB_MAX_CPU_PARTIAL_SHIFT)
+			ACCESS_ONCE(s->cpu_partial_shift) = shift + 1;
+	} else if (!n->window_contended && shift) {
+		ACCESS_ONCE(s->cpu_partial_shift) = shift - 1;
+	}
+	n->window_locked = 0;
+	n->window_contended = 0;
+}
+
+/*
+ * Take the list_lock of a node from the hot paths, counting the contended
+ * acquisitions for the list_lock_contended file and the partial limit.
+ */
+static inline void lock_node(struct kmem_cache *s, struct kmem_cache_node *n)
+{
+	if (unlikely(!spin_trylock(&n->list_lock))) {
+		spin_lock(&n->list_lock);
+		n->list_lock_contended++;
+		n->window_contended++;
+	}
+	if (unlikely(++n->window_locked >= SLUB_LOCK_WINDOW))
+		slub_adapt_cpu_partial(s, n);
+}
+
+#define lock_node_irqsave(s, n, flags)		\
+do {						\
+	local_irq_save(flags);			\
+	lock_node(s, n);			\
+} while (0)
+
+/*
+ * A slab emptied by __slab_free() while on the partial list is left there
+ * without taking the list_lock, up to min_partial of them per node.
+ */
+static inline bool slab_defer_empty(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_node *n = get_node(s, page_to_nid(page));
+
+	return !kmem_cache_debug(s) &&
+	       atomic_read(&n->nr_deferred_empty) < s->min_partial;
+}
+
+/*
+ * Discard the empty slabs left on the partial list beyond min_partial.
+ * Called with the list_lock held, the slabs are moved to @discard to be
+ * freed once it has been dropped. Concurrent frees can only lower
+ * page->inuse, so an empty slab on the partial list stays empty.
+ */
+static void trim_deferred_empty(struct kmem_cache *s,
+				struct kmem_cache_node *n,
+				struct list_head *discard)
+{
+	int nr = atomic_xchg(&n->nr_deferred_empty, 0);
+	struct page *page, *t;
+
+	list_for_each_entry_safe(page, t, &n->partial, lru) {
+		if (!nr || n->nr_partial <= s->min_partial)
+			break;
+		if (page->inuse)
+			continue;
+		remove_partial(n, page);
+		list_add(&page->lru, discard);
+		nr--;
+	}
+}
+
 /*
  * Remove slab from the partial list, freeze it and
  * return the pointer to the freelist.
@@ -1589,7 +1688,7 @@ static void *get_partial_node(struct kmem_cache *s, struct kmem_cache_node *n,
 	if (!n || !n->nr_partial)
 		return NULL;
 
-	spin_lock(&n->list_lock);
+	lock_node(s, n);
 	list_for_each_entry_safe(page, page2, &n->partial, lru) {
 		void *t;
 
@@ -1610,7 +1709,7 @@ static void *get_partial_node(struct kmem_cache *s, struct kmem_cache_node *n,
 			stat(s, CPU_PARTIAL_NODE);
 		}
 		if (!kmem_cache_has_cpu_partial(s)
-			|| available > s->cpu_partial / 2)
+			|| available > slub_cpu_partial(s) / 2)
 			break;
 
 	}
@@ -1860,7 +1959,7 @@ redo:
 			 * that acquire_slab() will see a slab page that
 			 * is frozen
 			 */
-			spin_lock(&n->list_lock);
+			lock_node(s, n);
 		}
 	} else {
 		m = M_FULL;
@@ -1871,7 +1970,7 @@ redo:
 			 * slabs from diagnostic functions will not see
 			 * any frozen slabs.
 			 */
-			spin_lock(&n->list_lock);
+			lock_node(s, n);
 		}
 	}
 
@@ -1941,7 +2040,7 @@ static void unfreeze_partials(struct kmem_cache *s,
 				spin_unlock(&n->list_lock);
 
 			n = n2;
-			spin_lock(&n->list_lock);
+			lock_node(s, n);
 		}
 
 		do {
@@ -2007,7 +2106,7 @@ static void put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
 		if (oldpage) {
 			pobjects = oldpage->pobjects;
 			pages = oldpage->pages;
-			if (drain && pobjects > s->cpu_partial) {
+			if (drain && pobjects > slub_cpu_partial(s)) {
 				unsigned long flags;
 				/*
 				 * partial array is full. Move the existing
@@ -2522,6 +2621,8 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 	unsigned long counters;
 	struct kmem_cache_node *n = NULL;
 	unsigned long uninitialized_var(flags);
+	bool deferred;
+	LIST_HEAD(discard);
 
 	stat(s, FREE_SLOWPATH);
 
@@ -2540,6 +2641,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 		new.counters = counters;
 		was_frozen = new.frozen;
 		new.inuse--;
+		deferred = false;
 		if ((!new.inuse || !prior) && !was_frozen) {
 
 			if (kmem_cache_has_cpu_partial(s) && !prior) {
@@ -2552,6 +2654,14 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 				 */
 				new.frozen = 1;
 
+			} else if (prior && slab_defer_empty(s, page)) {
+
+				/*
+				 * The slab is now empty and stays on the
+				 * partial list until trim_deferred_empty().
+				 */
+				deferred = true;
+
 			} else { /* Needs to be taken off a list */
 
 	                        n = get_node(s, page_to_nid(page));
@@ -2563,7 +2673,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 				 * Otherwise the list_lock will synchronize with
 				 * other processors updating the list of slabs.
 				 */
-				spin_lock_irqsave(&n->list_lock, flags);
+				lock_node_irqsave(s, n, flags);
 
 			}
 		}
@@ -2575,6 +2685,12 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	if (likely(!n)) {
 
+		if (deferred) {
+			n = get_node(s, page_to_nid(page));
+			atomic_inc(&n->nr_deferred_empty);
+			return;
+		}
+
 		/*
 		 * If we just froze the page then put it onto the
 		 * per cpu partial list.
@@ -2592,6 +2708,9 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
                 return;
         }
 
+	if (atomic_read(&n->nr_deferred_empty))
+		trim_deferred_empty(s, n, &discard);
+
 	if (unlikely(!new.inuse && n->nr_partial >= s->min_partial))
 		goto slab_empty;
 
@@ -2606,6 +2725,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 		stat(s, FREE_ADD_PARTIAL);
 	}
 	spin_unlock_irqrestore(&n->list_lock, flags);
+	discard_slabs(s, &discard);
 	return;
 
 slab_empty:
@@ -2623,6 +2743,7 @@ slab_empty:
 	spin_unlock_irqrestore(&n->list_lock, flags);
 	stat(s, FREE_SLAB);
 	discard_slab(s, page);
+	discard_slabs(s, &discard);
 }
 
 /*
@@ -2818,6 +2939,10 @@ init_kmem_cache_node(struct kmem_cache_node *n)
 	n->nr_partial = 0;
 	spin_lock_init(&n->list_lock);
 	INIT_LIST_HEAD(&n->partial);
+	atomic_set(&n->nr_deferred_empty, 0);
+	n->list_lock_contended = 0;
+	n->window_locked = 0;
+	n->window_contended = 0;
 #ifdef CONFIG_SLUB_DEBUG
 	atomic_long_set(&n->nr_slabs, 0);
 	atomic_long_set(&n->total_objects, 0);
@@ -3374,6 +3499,7 @@ int __kmem_cache_shrink(struct kmem_cache *s)
 			INIT_LIST_HEAD(slabs_by_inuse + i);
 
 		spin_lock_irqsave(&n->list_lock, flags);
+		atomic_set(&n->nr_deferred_empty, 0);
 
 		/*
 		 * Build lists indexed by the items in use in each slab.
@@ -4381,6 +4507,39 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t list_lock_contended_show(struct kmem_cache *s, char *buf)
+{
+	struct kmem_cache_node *n;
+	unsigned long sum = 0;
+	int node, len;
+
+	for_each_kmem_cache_node(s, node, n)
+		sum += n->list_lock_contended;
+	len = sprintf(buf, "%lu", sum);
+#ifdef CONFIG_NUMA
+	for_each_kmem_cache_node(s, node, n) {
+		if (n->list_lock_contended)
+			len += sprintf(buf + len, " N%d=%lu", node,
+				       n->list_lock_contended);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+
+static ssize_t list_lock_contended_store(struct kmem_cache *s,
+					 const char *buf, size_t length)
+{
+	struct kmem_cache_node *n;
+	int node;
+
+	if (buf[0] != '0')
+		return -EINVAL;
+	for_each_kmem_cache_node(s, node, n)
+		n->list_lock_contended = 0;
+	return length;
+}
+SLAB_ATTR(list_lock_contended);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4796,6 +4955,7 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&list_lock_contended_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -40,7 +40,22 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec, lru_add_pvec);
+/*
+ * The pages added to the LRU are batched per CPU. The batch starts at
+ * PAGEVEC_SIZE and doubles up to LRU_ADD_BATCH_MAX while the drains find
+ * zone->lru_lock contended, then goes back down once it isn't anymore.
+ */
+#define LRU_ADD_BATCH_MAX	(4 * PAGEVEC_SIZE)
+
+struct lru_add_batch {
+	unsigned int	nr;
+	unsigned int	limit;
+	struct page	*pages[LRU_ADD_BATCH_MAX];
+};
+
+static DEFINE_PER_CPU(struct lru_add_batch, lru_add_batch) = {
+	.limit	= PAGEVEC_SIZE,
+};
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
 
@@ -407,31 +422,116 @@ int get_kernel_page(unsigned long start, int write, struct page **pages)
 }
 EXPORT_SYMBOL_GPL(get_kernel_page);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
-	void (*move_fn)(struct page *page, struct lruvec *lruvec, void *arg),
-	void *arg)
+typedef void (*lru_move_fn_t)(struct page *page, struct lruvec *lruvec,
+			      void *arg);
+
+/*
+ * The moves of a run of pages of the same zone are combined: a CPU that
+ * finds zone->lru_lock taken posts its run on zone->lru_requests, and the
+ * next CPU that gets the lock here moves all the posted runs before
+ * releasing it. The posting CPU waits with interrupts disabled for its run
+ * to be done, so the run and the move_fn argument can be on its stack.
+ */
+struct lru_move_req {
+	struct llist_node	node;
+	struct page		**pages;
+	int			nr;
+	lru_move_fn_t		move_fn;
+	void			*arg;
+	int			done;
+};
+
+static void lru_move_run(struct zone *zone, struct lru_move_req *req)
 {
 	int i;
-	struct zone *zone = NULL;
-	struct lruvec *lruvec;
-	unsigned long flags = 0;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
-		struct zone *pagezone = page_zone(page);
+	for (i = 0; i < req->nr; i++) {
+		struct page *page = req->pages[i];
 
-		if (pagezone != zone) {
-			if (zone)
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-			zone = pagezone;
-			spin_lock_irqsave(&zone->lru_lock, flags);
-		}
+		(*req->move_fn)(page, mem_cgroup_page_lruvec(page, zone),
+				req->arg);
+	}
+}
 
-		lruvec = mem_cgroup_page_lruvec(page, zone);
-		(*move_fn)(page, lruvec, arg);
+/* Move the posted runs, called with zone->lru_lock held */
+static void lru_move_combine(struct zone *zone)
+{
+	struct llist_node *first = llist_del_all(&zone->lru_requests);
+	struct lru_move_req *req, *next;
+
+	/* The request is gone as soon as it is marked done */
+	llist_for_each_entry_safe(req, next, first, node) {
+		lru_move_run(zone, req);
+		__count_vm_event(LRU_LOCK_COMBINED);
+		smp_store_release(&req->done, 1);
 	}
-	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+}
+
+/* Returns true if zone->lru_lock was contended */
+static bool zone_lru_move(struct zone *zone, struct page **pages, int nr,
+			  lru_move_fn_t move_fn, void *arg)
+{
+	struct lru_move_req req = {
+		.pages		= pages,
+		.nr		= nr,
+		.move_fn	= move_fn,
+		.arg		= arg,
+	};
+	unsigned long flags;
+	bool contended = false;
+
+	local_irq_save(flags);
+	if (spin_trylock(&zone->lru_lock)) {
+		lru_move_run(zone, &req);
+		goto unlock;
+	}
+
+	contended = true;
+	__count_vm_event(LRU_LOCK_CONTENDED);
+	llist_add(&req.node, &zone->lru_requests);
+	for (;;) {
+		if (smp_load_acquire(&req.done))
+			goto out;
+		if (!spin_is_locked(&zone->lru_lock) &&
+		    spin_trylock(&zone->lru_lock))
+			break;
+		cpu_relax();
+	}
+unlock:
+	lru_move_combine(zone);
+	spin_unlock(&zone->lru_lock);
+out:
+	local_irq_restore(flags);
+	return contended;
+}
+
+/*
+ * Move the pages with move_fn under the lru_lock of their zone, one hold
+ * for each run of pages of the same zone. Returns true if any lru_lock
+ * was contended.
+ */
+static bool lru_move_pages(struct page **pages, int nr,
+			   lru_move_fn_t move_fn, void *arg)
+{
+	bool contended = false;
+	int i, start = 0;
+
+	for (i = 1; i <= nr; i++) {
+		struct zone *zone = page_zone(pages[start]);
+
+		if (i < nr && page_zone(pages[i]) == zone)
+			continue;
+		contended |= zone_lru_move(zone, pages + start, i - start,
+					   move_fn, arg);
+		start = i;
+	}
+	return contended;
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec, lru_move_fn_t move_fn,
+				void *arg)
+{
+	lru_move_pages(pvec->pages, pagevec_count(pvec), move_fn, arg);
 	release_pages(pvec->pages, pvec->nr, pvec->cold);
 	pagevec_reinit(pvec);
 }
@@ -559,29 +659,27 @@ void activate_page(struct page *page)
 
 static void __lru_cache_activate_page(struct page *page)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvec);
+	struct lru_add_batch *batch = &get_cpu_var(lru_add_batch);
 	int i;
 
 	/*
 	 * Search backwards on the optimistic assumption that the page being
-	 * activated has just been added to this pagevec. Note that only
-	 * the local pagevec is examined as a !PageLRU page could be in the
+	 * activated has just been added to this batch. Note that only
+	 * the local batch is examined as a !PageLRU page could be in the
 	 * process of being released, reclaimed, migrated or on a remote
 	 * pagevec that is currently being drained. Furthermore, marking
 	 * a remote pagevec's page PageActive potentially hits a race where
 	 * a page is marked PageActive just after it is added to the inactive
 	 * list causing accounting errors and BUG_ON checks to trigger.
 	 */
-	for (i = pagevec_count(pvec) - 1; i >= 0; i--) {
-		struct page *pagevec_page = pvec->pages[i];
-
-		if (pagevec_page == page) {
+	for (i = batch->nr - 1; i >= 0; i--) {
+		if (batch->pages[i] == page) {
 			SetPageActive(page);
 			break;
 		}
 	}
 
-	put_cpu_var(lru_add_pvec);
+	put_cpu_var(lru_add_batch);
 }
 
 /*
@@ -618,15 +716,31 @@ void mark_page_accessed(struct page *page)
 }
 EXPORT_SYMBOL(mark_page_accessed);
 
+static void __pagevec_lru_add_fn(struct page *page, struct lruvec *lruvec,
+				 void *arg);
+
+static void lru_add_batch_drain(struct lru_add_batch *batch)
+{
+	if (lru_move_pages(batch->pages, batch->nr, __pagevec_lru_add_fn,
+			   NULL))
+		batch->limit = min_t(unsigned int, 2 * batch->limit,
+				     LRU_ADD_BATCH_MAX);
+	else
+		batch->limit = max_t(unsigned int, batch->limit / 2,
+				     PAGEVEC_SIZE);
+	release_pages(batch->pages, batch->nr, false);
+	batch->nr = 0;
+}
+
 static void __lru_cache_add(struct page *page)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvec);
+	struct lru_add_batch *batch = &get_cpu_var(lru_add_batch);
 
 	page_cache_get(page);
-	if (!pagevec_space(pvec))
-		__pagevec_lru_add(pvec);
-	pagevec_add(pvec, page);
-	put_cpu_var(lru_add_pvec);
+	if (batch->nr >= batch->limit)
+		lru_add_batch_drain(batch);
+	batch->pages[batch->nr++] = page;
+	put_cpu_var(lru_add_batch);
 }
 
 /**
@@ -796,10 +910,11 @@ static void lru_deactivate_fn(struct page *page, struct lruvec *lruvec,
  */
 void lru_add_drain_cpu(int cpu)
 {
-	struct pagevec *pvec = &per_cpu(lru_add_pvec, cpu);
+	struct lru_add_batch *batch = &per_cpu(lru_add_batch, cpu);
+	struct pagevec *pvec;
 
-	if (pagevec_count(pvec))
-		__pagevec_lru_add(pvec);
+	if (batch->nr)
+		lru_add_batch_drain(batch);
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
 	if (pagevec_count(pvec)) {
@@ -870,7 +985,7 @@ void lru_add_drain_all(void)
 	for_each_online_cpu(cpu) {
 		struct work_struct *work = &per_cpu(lru_add_drain_work, cpu);
 
-		if (pagevec_count(&per_cpu(lru_add_pvec, cpu)) ||
+		if (per_cpu(lru_add_batch, cpu).nr ||
 		    pagevec_count(&per_cpu(lru_rotate_pvecs, cpu)) ||
 		    pagevec_count(&per_cpu(lru_deactivate_pvecs, cpu)) ||
 		    need_activate_page_drain(cpu)) {
@@ -0,0 +1,219 @@
+/*
+ *  linux/mm/swap_slots.c
+ *
+ *  Per-cpu caches of swap slots
+ *
+ * get_swap_page() takes swap_avail_lock and the device lock for each page
+ * swapped out, and freeing a slot takes the device lock again to update
+ * its bookkeeping. Each CPU instead keeps a batch of slots allocated with
+ * get_swap_pages() to swap out to, and a batch of slots to free, returned
+ * with swapcache_free_entries(). The common swap-out takes no swap lock
+ * and the slots are freed SWAP_SLOTS_CACHE_SIZE at a time.
+ *
+ * The cached slots are allocated, so the caches are only active while
+ * there is plenty of free swap space: with less, they are drained so that
+ * the last slots aren't stranded on other CPUs. swapoff disables them
+ * too, as try_to_unuse() can't free the slots that sit in a cache.
+ */
+#include <linux/cpu.h>
+#include <linux/init.h>
+#include <linux/mutex.h>
+#include <linux/notifier.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+
+#define SWAP_SLOTS_CACHE_SIZE		64
+
+/* Free slots per online CPU needed to (re)activate and keep the caches */
+#define THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE	(5 * SWAP_SLOTS_CACHE_SIZE)
+#define THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE	(2 * SWAP_SLOTS_CACHE_SIZE)
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* Protects slots, cur and nr */
+	int		cur;
+	int		nr;
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+	spinlock_t	free_lock;	/* Protects slots_ret and n_ret */
+	int		n_ret;
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+
+/* Serializes the changes of the two flags below */
+static DEFINE_MUTEX(swap_slots_cache_mutex);
+static bool swap_slot_cache_enabled;	/* Initialized and not in swapoff */
+static bool swap_slot_cache_active;	/* Enough free swap space */
+
+#define use_swap_slot_cache() \
+	(ACCESS_ONCE(swap_slot_cache_active) && \
+	 ACCESS_ONCE(swap_slot_cache_enabled))
+
+/*
+ * Return the slots of a cache to the swap devices
+ */
+static void drain_slots_cache_cpu(int cpu)
+{
+	struct swap_slots_cache *cache = per_cpu_ptr(&swp_slots, cpu);
+
+	mutex_lock(&cache->alloc_lock);
+	swapcache_free_entries(cache->slots + cache->cur, cache->nr);
+	cache->cur = 0;
+	cache->nr = 0;
+	mutex_unlock(&cache->alloc_lock);
+
+	spin_lock(&cache->free_lock);
+	swapcache_free_entries(cache->slots_ret, cache->n_ret);
+	cache->n_ret = 0;
+	spin_unlock(&cache->free_lock);
+}
+
+/*
+ * Called with swap_slots_cache_mutex held, after one of the flags has been
+ * cleared. The online CPUs are stable as the hotplug notifier drains the
+ * cache of a dead CPU itself.
+ */
+static void __drain_swap_slots_caches(void)
+{
+	int cpu;
+
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		drain_slots_cache_cpu(cpu);
+	put_online_cpus();
+}
+
+/*
+ * Disable the caches for swapoff and return all the cached slots, until
+ * reenable_swap_slots_cache_unlock()
+ */
+void disable_swap_slots_cache_lock(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	ACCESS_ONCE(swap_slot_cache_enabled) = false;
+	__drain_swap_slots_caches();
+}
+
+void reenable_swap_slots_cache_unlock(void)
+{
+	ACCESS_ONCE(swap_slot_cache_enabled) = true;
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+/*
+ * Activate or deactivate the caches depending on the free swap space and
+ * return whether they can be used
+ */
+static bool check_cache_active(void)
+{
+	long pages;
+
+	if (!ACCESS_ONCE(swap_slot_cache_enabled))
+		return false;
+
+	pages = get_nr_swap_pages();
+	if (!ACCESS_ONCE(swap_slot_cache_active)) {
+		if (pages > num_online_cpus() *
+			    THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE) {
+			mutex_lock(&swap_slots_cache_mutex);
+			if (swap_slot_cache_enabled)
+				ACCESS_ONCE(swap_slot_cache_active) = true;
+			mutex_unlock(&swap_slots_cache_mutex);
+		}
+	} else if (pages < num_online_cpus() *
+			   THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE) {
+		mutex_lock(&swap_slots_cache_mutex);
+		if (swap_slot_cache_active) {
+			ACCESS_ONCE(swap_slot_cache_active) = false;
+			__drain_swap_slots_caches();
+		}
+		mutex_unlock(&swap_slots_cache_mutex);
+	}
+	return use_swap_slot_cache();
+}
+
+/*
+ * Called with cache->alloc_lock held. The flags are checked again under it
+ * so that a cache can't be refilled after having been drained.
+ */
+static int refill_swap_slots_cache(struct swap_slots_cache *cache)
+{
+	if (!use_swap_slot_cache())
+		return 0;
+
+	cache->cur = 0;
+	cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE, cache->slots);
+	return cache->nr;
+}
+
+/*
+ * Free a swap slot left with only SWAP_HAS_CACHE, through the per-cpu
+ * cache if it is in use. The free_lock is never taken from interrupts.
+ */
+void free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache = raw_cpu_ptr(&swp_slots);
+
+	spin_lock(&cache->free_lock);
+	if (!use_swap_slot_cache()) {
+		spin_unlock(&cache->free_lock);
+		swapcache_free_entries(&entry, 1);
+		return;
+	}
+	if (cache->n_ret >= SWAP_SLOTS_CACHE_SIZE) {
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	cache->slots_ret[cache->n_ret++] = entry;
+	spin_unlock(&cache->free_lock);
+}
+
+swp_entry_t get_swap_page(void)
+{
+	swp_entry_t entry = { 0 };
+
+	if (check_cache_active()) {
+		/*
+		 * The CPU may change under us, its cache is locked anyway
+		 * so that any cache will do.
+		 */
+		struct swap_slots_cache *cache = raw_cpu_ptr(&swp_slots);
+
+		mutex_lock(&cache->alloc_lock);
+		if (cache->nr || refill_swap_slots_cache(cache)) {
+			entry = cache->slots[cache->cur++];
+			cache->nr--;
+		}
+		mutex_unlock(&cache->alloc_lock);
+		if (entry.val)
+			return entry;
+	}
+
+	get_swap_pages(1, &entry);
+	return entry;
+}
+
+static int swap_slots_cpu_callback(struct notifier_block *nfb,
+				   unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		drain_slots_cache_cpu((long)hcpu);
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = per_cpu_ptr(&swp_slots, cpu);
+
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->free_lock);
+	}
+	hotcpu_notifier(swap_slots_cpu_callback, 0);
+	swap_slot_cache_enabled = true;
+	return 0;
+}
+subsys_initcall(swap_slots_init);
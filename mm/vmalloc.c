@@ -270,6 +270,7 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 #define VM_LAZY_FREE	0x01
 #define VM_LAZY_FREEING	0x02
 #define VM_VM_AREA	0x04
+#define VM_VMAP_BLOCK	0x08
 
 static DEFINE_SPINLOCK(vmap_area_lock);
 /* Export for kexec only */
@@ -762,11 +763,30 @@ struct vmap_block {
 	struct vmap_area *va;
 	unsigned long free, dirty;
 	DECLARE_BITMAP(dirty_map, VMAP_BBMAP_BITS);
+	struct vm_struct **vm;		/* by first page, see vb_vm_area() */
 	struct list_head free_list;
 	struct rcu_head rcu_head;
 	struct list_head purge;
 };
 
+/*
+ * The small vm areas of the vmalloc range are carved out of the per-cpu
+ * vmap blocks too, with their vm_struct kept in vb->vm, so that vmalloc()
+ * and vfree() of up to VMAP_MAX_ALLOC pages only take vmap_area_lock to
+ * create or retire a block. Only on 64 bit: a long lived area pins the
+ * whole block, which the 32 bit vmalloc space can't afford. The ioremap
+ * areas are left out for set_iounmap_nonlazy() to keep working.
+ */
+static inline bool vb_vm_area(unsigned long size, unsigned long align,
+			      unsigned long flags, unsigned long start,
+			      unsigned long end)
+{
+	return IS_ENABLED(CONFIG_64BIT) && vmap_initialized &&
+		size <= VMAP_MAX_ALLOC * PAGE_SIZE && align <= PAGE_SIZE &&
+		!(flags & VM_IOREMAP) &&
+		start == VMALLOC_START && end == VMALLOC_END;
+}
+
 /* Queue of free and dirty vmap blocks, for allocation and flushing purposes */
 static DEFINE_PER_CPU(struct vmap_block_queue, vmap_block_queue);
 
@@ -815,8 +835,20 @@ static struct vmap_block *new_vmap_block(gfp_t gfp_mask)
 		return ERR_CAST(va);
 	}
 
+	vb->vm = NULL;
+	if (IS_ENABLED(CONFIG_64BIT)) {
+		vb->vm = kzalloc_node(VMAP_BBMAP_BITS * sizeof(*vb->vm),
+				      gfp_mask & GFP_RECLAIM_MASK, node);
+		if (unlikely(!vb->vm)) {
+			kfree(vb);
+			free_vmap_area(va);
+			return ERR_PTR(-ENOMEM);
+		}
+	}
+
 	err = radix_tree_preload(gfp_mask);
 	if (unlikely(err)) {
+		kfree(vb->vm);
 		kfree(vb);
 		free_vmap_area(va);
 		return ERR_PTR(err);
@@ -836,6 +868,11 @@ static struct vmap_block *new_vmap_block(gfp_t gfp_mask)
 	BUG_ON(err);
 	radix_tree_preload_end();
 
+	/* For /proc/vmallocinfo to show the vm areas of the block */
+	spin_lock(&vmap_area_lock);
+	va->flags |= VM_VMAP_BLOCK;
+	spin_unlock(&vmap_area_lock);
+
 	vbq = &get_cpu_var(vmap_block_queue);
 	spin_lock(&vbq->lock);
 	list_add_rcu(&vb->free_list, &vbq->free);
@@ -845,6 +882,14 @@ static struct vmap_block *new_vmap_block(gfp_t gfp_mask)
 	return vb;
 }
 
+static void free_vmap_block_rcu(struct rcu_head *head)
+{
+	struct vmap_block *vb = container_of(head, struct vmap_block, rcu_head);
+
+	kfree(vb->vm);
+	kfree(vb);
+}
+
 static void free_vmap_block(struct vmap_block *vb)
 {
 	struct vmap_block *tmp;
@@ -857,7 +902,7 @@ static void free_vmap_block(struct vmap_block *vb)
 	BUG_ON(tmp != vb);
 
 	free_vmap_area_noflush(vb->va);
-	kfree_rcu(vb, rcu_head);
+	call_rcu(&vb->rcu_head, free_vmap_block_rcu);
 }
 
 static void purge_fragmented_blocks(int cpu)
@@ -984,8 +1029,15 @@ static void vb_free(const void *addr, unsigned long size)
 
 	vunmap_page_range((unsigned long)addr, (unsigned long)addr + size);
 
+	/*
+	 * vb_alloc() packs the allocations of different orders, which leaves
+	 * them unaligned: bitmap_allocate_region() can't be used.
+	 */
+	offset >>= PAGE_SHIFT;
 	spin_lock(&vb->lock);
-	BUG_ON(bitmap_allocate_region(vb->dirty_map, offset >> PAGE_SHIFT, order));
+	BUG_ON(find_next_bit(vb->dirty_map, offset + (1UL << order), offset) <
+	       offset + (1UL << order));
+	bitmap_set(vb->dirty_map, offset, 1UL << order);
 
 	vb->dirty += 1UL << order;
 	if (vb->dirty == VMAP_BBMAP_BITS) {
@@ -996,6 +1048,42 @@ static void vb_free(const void *addr, unsigned long size)
 		spin_unlock(&vb->lock);
 }
 
+/*
+ * Find the vmap block of an address, called under rcu_read_lock().
+ */
+static struct vmap_block *vb_find(unsigned long addr)
+{
+	if (!IS_ENABLED(CONFIG_64BIT) ||
+	    addr < VMALLOC_START || addr >= VMALLOC_END)
+		return NULL;
+	return radix_tree_lookup(&vmap_block_tree, addr_to_vb_idx(addr));
+}
+
+static inline unsigned long vb_page(struct vmap_block *vb, unsigned long addr)
+{
+	return (addr - vb->va->va_start) >> PAGE_SHIFT;
+}
+
+static void setup_vb_vm(struct vm_struct *vm, unsigned long addr,
+			unsigned long size, unsigned long flags,
+			const void *caller)
+{
+	struct vmap_block *vb;
+
+	vm->flags = flags;
+	vm->addr = (void *)addr;
+	vm->size = size;
+	vm->caller = caller;
+
+	rcu_read_lock();
+	vb = vb_find(addr);
+	BUG_ON(!vb);
+	spin_lock(&vb->lock);
+	vb->vm[vb_page(vb, addr)] = vm;
+	spin_unlock(&vb->lock);
+	rcu_read_unlock();
+}
+
 /**
  * vm_unmap_aliases - unmap outstanding lazy aliases in the vmap layer
  *
@@ -1330,6 +1418,16 @@ static struct vm_struct *__get_vm_area_node(unsigned long size,
 	 */
 	size += PAGE_SIZE;
 
+	if (vb_vm_area(size, align, flags, start, end)) {
+		void *addr = vb_alloc(size, gfp_mask);
+
+		if (!IS_ERR(addr)) {
+			setup_vb_vm(area, (unsigned long)addr, size, flags,
+				    caller);
+			return area;
+		}
+	}
+
 	va = alloc_vmap_area(size, align, start, end, node, gfp_mask);
 	if (IS_ERR(va)) {
 		kfree(area);
@@ -1390,8 +1488,20 @@ struct vm_struct *get_vm_area_caller(unsigned long size, unsigned long flags,
  */
 struct vm_struct *find_vm_area(const void *addr)
 {
+	struct vmap_block *vb;
 	struct vmap_area *va;
 
+	rcu_read_lock();
+	vb = vb_find((unsigned long)addr);
+	if (vb) {
+		struct vm_struct *vm;
+
+		vm = ACCESS_ONCE(vb->vm[vb_page(vb, (unsigned long)addr)]);
+		rcu_read_unlock();
+		return vm;
+	}
+	rcu_read_unlock();
+
 	va = find_vmap_area((unsigned long)addr);
 	if (va && va->flags & VM_VM_AREA)
 		return va->vm;
@@ -1409,8 +1519,31 @@ struct vm_struct *find_vm_area(const void *addr)
  */
 struct vm_struct *remove_vm_area(const void *addr)
 {
+	struct vmap_block *vb;
 	struct vmap_area *va;
 
+	rcu_read_lock();
+	vb = vb_find((unsigned long)addr);
+	if (vb) {
+		unsigned long i = vb_page(vb, (unsigned long)addr);
+		struct vm_struct *vm;
+
+		spin_lock(&vb->lock);
+		vm = vb->vm[i];
+		vb->vm[i] = NULL;
+		spin_unlock(&vb->lock);
+		rcu_read_unlock();
+
+		if (vm) {
+			vmap_debug_free_range((unsigned long)addr,
+					      (unsigned long)addr + vm->size);
+			vb_free(addr, vm->size);
+			vm->size -= PAGE_SIZE;
+		}
+		return vm;
+	}
+	rcu_read_unlock();
+
 	va = find_vmap_area((unsigned long)addr);
 	if (va && va->flags & VM_VM_AREA) {
 		struct vm_struct *vm = va->vm;
@@ -2591,20 +2724,8 @@ static void show_numa_info(struct seq_file *m, struct vm_struct *v)
 	}
 }
 
-static int s_show(struct seq_file *m, void *p)
+static void show_vm_area(struct seq_file *m, struct vm_struct *v)
 {
-	struct vmap_area *va = p;
-	struct vm_struct *v;
-
-	/*
-	 * s_show can encounter race with remove_vm_area, !VM_VM_AREA on
-	 * behalf of vmap area is being tear down or vm_map_ram allocation.
-	 */
-	if (!(va->flags & VM_VM_AREA))
-		return 0;
-
-	v = va->vm;
-
 	seq_printf(m, "0x%pK-0x%pK %7ld",
 		v->addr, v->addr + v->size, v->size);
 
@@ -2634,6 +2755,44 @@ static int s_show(struct seq_file *m, void *p)
 
 	show_numa_info(m, v);
 	seq_putc(m, '\n');
+}
+
+/* The vm areas of a vmap block, removed under vb->lock */
+static void show_vmap_block(struct seq_file *m, struct vmap_area *va)
+{
+	struct vmap_block *vb;
+	int i;
+
+	rcu_read_lock();
+	vb = vb_find(va->va_start);
+	if (vb && vb->vm) {
+		spin_lock(&vb->lock);
+		for (i = 0; i < VMAP_BBMAP_BITS; i++) {
+			if (vb->vm[i])
+				show_vm_area(m, vb->vm[i]);
+		}
+		spin_unlock(&vb->lock);
+	}
+	rcu_read_unlock();
+}
+
+static int s_show(struct seq_file *m, void *p)
+{
+	struct vmap_area *va = p;
+
+	if (va->flags & VM_VMAP_BLOCK) {
+		show_vmap_block(m, va);
+		return 0;
+	}
+
+	/*
+	 * s_show can encounter race with remove_vm_area, !VM_VM_AREA on
+	 * behalf of vmap area is being tear down or vm_map_ram allocation.
+	 */
+	if (!(va->flags & VM_VM_AREA))
+		return 0;
+
+	show_vm_area(m, va->vm);
 	return 0;
 }
 
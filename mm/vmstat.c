@@ -834,6 +834,8 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"lru_lock_contended",
+	"lru_lock_combined",
 
 	"drop_pagecache",
 	"drop_slab",
@@ -856,6 +858,8 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_lock_contended",
+	"compact_lock_combined",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
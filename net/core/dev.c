@@ -2782,17 +2782,34 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 
 	qdisc_pkt_len_init(skb);
 	qdisc_calculate_pkt_len(skb, q);
+	contended = qdisc_is_running(q);
+	if (unlikely(contended) && sysctl_qdisc_combining) {
+		/*
+		 * Leave the skb to the running owner, which enqueues it
+		 * under the root lock it already holds, see qdisc_defer_skb().
+		 */
+		qdisc_defer_skb(q, skb);
+		if (qdisc_is_running(q))
+			return NET_XMIT_SUCCESS;
+
+		spin_lock(root_lock);
+		qdisc_enqueue_deferred(q);
+		if (qdisc_run_begin(q))
+			__qdisc_run(q);
+		spin_unlock(root_lock);
+		return NET_XMIT_SUCCESS;
+	}
 	/*
 	 * Heuristic to force contended enqueues to serialize on a
 	 * separate lock before trying to get qdisc main lock.
 	 * This permits __QDISC___STATE_RUNNING owner to get the lock more
 	 * often and dequeue packets faster.
 	 */
-	contended = qdisc_is_running(q);
 	if (unlikely(contended))
 		spin_lock(&q->busylock);
 
 	spin_lock(root_lock);
+	qdisc_enqueue_deferred(q);
 	if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
 		kfree_skb(skb);
 		rc = NET_XMIT_DROP;
@@ -3016,6 +3033,7 @@ EXPORT_SYMBOL(netdev_max_backlog);
 int netdev_tstamp_prequeue __read_mostly = 1;
 int netdev_budget __read_mostly = 300;
 int weight_p __read_mostly = 64;            /* old backlog weight */
+int sysctl_qdisc_combining __read_mostly = 1;
 
 /* Called with irq disabled */
 static inline void ____napi_schedule(struct softnet_data *sd,
@@ -3246,6 +3264,66 @@ static int rps_ipi_queued(struct softnet_data *sd)
 	return 0;
 }
 
+#ifdef CONFIG_RPS
+/*
+ * Push an skb on the inbox of a remote CPU. Returns true if the inbox was
+ * empty, its backlog NAPI may then have to be scheduled.
+ */
+static bool rps_inbox_push(struct softnet_data *sd, struct sk_buff *skb)
+{
+	struct sk_buff *first, *old = ACCESS_ONCE(sd->rps_inbox);
+
+	do {
+		first = old;
+		skb->next = first;
+		old = cmpxchg(&sd->rps_inbox, first, skb);
+	} while (old != first);
+
+	return !first;
+}
+
+/* Move the whole inbox to the tail of list, in the arrival order */
+static void rps_inbox_splice(struct softnet_data *sd, struct sk_buff_head *list)
+{
+	struct sk_buff *skb, *next, *fifo = NULL;
+
+	if (!ACCESS_ONCE(sd->rps_inbox))
+		return;
+
+	for (skb = xchg(&sd->rps_inbox, NULL); skb; skb = next) {
+		next = skb->next;
+		skb->next = fifo;
+		fifo = skb;
+	}
+	for (skb = fifo; skb; skb = next) {
+		next = skb->next;
+		__skb_queue_tail(list, skb);
+	}
+}
+
+/*
+ * Called with interrupts disabled after the backlog NAPI was completed. A
+ * steering CPU that pushed on the inbox meanwhile may have found it still
+ * scheduled, schedule it again for that packet.
+ */
+static void rps_inbox_recheck(struct softnet_data *sd)
+{
+	smp_mb();
+	if (ACCESS_ONCE(sd->rps_inbox) &&
+	    !test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state))
+		____napi_schedule(sd, &sd->backlog);
+}
+#else
+static inline void rps_inbox_splice(struct softnet_data *sd,
+				    struct sk_buff_head *list)
+{
+}
+
+static inline void rps_inbox_recheck(struct softnet_data *sd)
+{
+}
+#endif /* CONFIG_RPS */
+
 #ifdef CONFIG_NET_FLOW_LIMIT
 int netdev_flow_limit_table_len __read_mostly = (1 << 12);
 #endif
@@ -3286,6 +3364,44 @@ static bool skb_flow_limit(struct sk_buff *skb, unsigned int qlen)
 	return false;
 }
 
+#ifdef CONFIG_RPS
+/*
+ * Queue an skb to the backlog of a remote CPU. Rather than on the lock of
+ * its input_pkt_queue, the steering CPUs only contend on the cmpxchg of
+ * its inbox and the increment of the tail counter on the same line. The
+ * length checked against netdev_max_backlog is the number of packets not
+ * processed yet, from the tail and head counters. The drops are counted
+ * on the steering CPU.
+ */
+static int enqueue_to_inbox(struct sk_buff *skb, struct softnet_data *sd,
+			    unsigned int *qtail)
+{
+	unsigned long flags;
+	unsigned int qlen;
+
+	local_irq_save(flags);
+
+	qlen = atomic_read(&sd->input_queue_tail) -
+	       ACCESS_ONCE(sd->input_queue_head);
+	if (qlen > netdev_max_backlog || skb_flow_limit(skb, qlen)) {
+		__this_cpu_inc(softnet_data.dropped);
+		local_irq_restore(flags);
+
+		atomic_long_inc(&skb->dev->rx_dropped);
+		kfree_skb(skb);
+		return NET_RX_DROP;
+	}
+
+	input_queue_tail_incr_save(sd, qtail);
+	if (rps_inbox_push(sd, skb) &&
+	    !test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state))
+		rps_ipi_queued(sd);
+
+	local_irq_restore(flags);
+	return NET_RX_SUCCESS;
+}
+#endif
+
 /*
  * enqueue_to_backlog is called to queue an skb to a per CPU backlog
  * queue (may be a remote CPU queue).
@@ -3299,6 +3415,11 @@ static int enqueue_to_backlog(struct sk_buff *skb, int cpu,
 
 	sd = &per_cpu(softnet_data, cpu);
 
+#ifdef CONFIG_RPS
+	if (cpu != smp_processor_id())
+		return enqueue_to_inbox(skb, sd, qtail);
+#endif
+
 	local_irq_save(flags);
 
 	rps_lock(sd);
@@ -3314,9 +3435,10 @@ enqueue:
 		}
 
 		/* Schedule NAPI for backlog device
-		 * We can use non atomic operation since we own the queue lock
+		 * The remote CPUs may set the bit for their inbox
+		 * without the queue lock, so this must be atomic.
 		 */
-		if (!__test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state)) {
+		if (!test_and_set_bit(NAPI_STATE_SCHED, &sd->backlog.state)) {
 			if (!rps_ipi_queued(sd))
 				____napi_schedule(sd, &sd->backlog);
 		}
@@ -3835,6 +3957,8 @@ static void flush_backlog(void *arg)
 	struct softnet_data *sd = this_cpu_ptr(&softnet_data);
 	struct sk_buff *skb, *tmp;
 
+	rps_inbox_splice(sd, &sd->process_queue);
+
 	rps_lock(sd);
 	skb_queue_walk_safe(&sd->input_pkt_queue, skb, tmp) {
 		if (skb->dev == dev) {
@@ -4342,6 +4466,10 @@ static int process_backlog(struct napi_struct *napi, int quota)
 			}
 		}
 
+		rps_inbox_splice(sd, &sd->process_queue);
+		if (!skb_queue_empty(&sd->process_queue))
+			continue;
+
 		rps_lock(sd);
 		if (skb_queue_empty(&sd->input_pkt_queue)) {
 			/*
@@ -4350,11 +4478,12 @@ static int process_backlog(struct napi_struct *napi, int quota)
 			 * and NAPI_STATE_SCHED is the only possible flag set
 			 * on backlog.
 			 * We can use a plain write instead of clear_bit(),
-			 * and we dont need an smp_mb() memory barrier.
+			 * the inbox is then checked again after a barrier.
 			 */
 			list_del(&napi->poll_list);
 			napi->state = 0;
 			rps_unlock(sd);
+			rps_inbox_recheck(sd);
 
 			break;
 		}
@@ -6987,6 +7116,7 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	local_irq_enable();
 
 	/* Process offline CPU's input_pkt_queue */
+	rps_inbox_splice(oldsd, &oldsd->process_queue);
 	while ((skb = __skb_dequeue(&oldsd->process_queue))) {
 		netif_rx_internal(skb);
 		input_queue_head_incr(oldsd);
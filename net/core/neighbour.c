@@ -62,10 +62,19 @@ static const struct file_operations neigh_stat_seq_fops;
 #endif
 
 /*
-   Neighbour hash table buckets are protected with rwlock tbl->lock.
-
-   - All the scans/updates to hash buckets MUST be made under this lock.
-   - NOTHING clever should be made under this lock: no callbacks
+   Neighbour hash table lookups run under RCU only. The buckets are
+   updated under the spinlock tbl->hash_locks[] of the bucket index,
+   BH disabled, taken with neigh_bucket_lock().
+
+   rwlock tbl->lock is left to the rare table wide operations: it
+   is held as a writer to resize the hash table and to flush it, and
+   protects the parms list and the proxy hash chains.
+
+   - All the updates to hash buckets MUST be made under the bucket lock.
+   - A resize marks the old table as moving and waits for the bucket
+     locks to be released, neigh_bucket_lock() then fails until the
+     new table is installed and the caller looks it up again.
+   - NOTHING clever should be made under these locks: no callbacks
      to protocol backends, no attempts to send something to network.
      It will result in deadlocks, if backend/driver wants to use neighbour
      cache.
@@ -122,24 +131,55 @@ unsigned long neigh_rand_reach_time(unsigned long base)
 EXPORT_SYMBOL(neigh_rand_reach_time);
 
 
+static inline spinlock_t *neigh_hash_lock(struct neigh_table *tbl,
+					  unsigned int hash_val)
+{
+	return &tbl->hash_locks[hash_val & (NEIGH_HASH_LOCKS - 1)];
+}
+
+/*
+ * Lock bucket hash_val of nht, in a RCU BH read side section. Fails once
+ * nht has been replaced by a resize, the caller must then look up tbl->nht
+ * again.
+ */
+static bool neigh_bucket_lock(struct neigh_table *tbl,
+			      struct neigh_hash_table *nht,
+			      unsigned int hash_val)
+{
+	spinlock_t *lock = neigh_hash_lock(tbl, hash_val);
+
+	spin_lock(lock);
+	if (likely(!nht->moving))
+		return true;
+	spin_unlock(lock);
+
+	while (rcu_access_pointer(tbl->nht) == nht)
+		cpu_relax();
+	return false;
+}
+
 static int neigh_forced_gc(struct neigh_table *tbl)
 {
 	int shrunk = 0;
-	int i;
+	int i = 0;
 	struct neigh_hash_table *nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, forced_gc_runs);
 
-	write_lock_bh(&tbl->lock);
-	nht = rcu_dereference_protected(tbl->nht,
-					lockdep_is_held(&tbl->lock));
-	for (i = 0; i < (1 << nht->hash_shift); i++) {
+	rcu_read_lock_bh();
+	nht = rcu_dereference_bh(tbl->nht);
+	while (i < (1 << nht->hash_shift)) {
+		spinlock_t *lock = neigh_hash_lock(tbl, i);
 		struct neighbour *n;
 		struct neighbour __rcu **np;
 
+		if (!neigh_bucket_lock(tbl, nht, i)) {
+			nht = rcu_dereference_bh(tbl->nht);
+			continue;
+		}
 		np = &nht->hash_buckets[i];
 		while ((n = rcu_dereference_protected(*np,
-					lockdep_is_held(&tbl->lock))) != NULL) {
+					lockdep_is_held(lock))) != NULL) {
 			/* Neighbour record may be discarded if:
 			 * - nobody refers to it.
 			 * - it is not permanent
@@ -149,7 +189,7 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 			    !(n->nud_state & NUD_PERMANENT)) {
 				rcu_assign_pointer(*np,
 					rcu_dereference_protected(n->next,
-						  lockdep_is_held(&tbl->lock)));
+						  lockdep_is_held(lock)));
 				n->dead = 1;
 				shrunk	= 1;
 				write_unlock(&n->lock);
@@ -159,11 +199,13 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 			write_unlock(&n->lock);
 			np = &n->next;
 		}
+		spin_unlock(lock);
+		i++;
 	}
 
 	tbl->last_flush = jiffies;
 
-	write_unlock_bh(&tbl->lock);
+	rcu_read_unlock_bh();
 
 	return shrunk;
 }
@@ -207,18 +249,20 @@ static void neigh_flush_dev(struct neigh_table *tbl, struct net_device *dev)
 					lockdep_is_held(&tbl->lock));
 
 	for (i = 0; i < (1 << nht->hash_shift); i++) {
+		spinlock_t *lock = neigh_hash_lock(tbl, i);
 		struct neighbour *n;
 		struct neighbour __rcu **np = &nht->hash_buckets[i];
 
+		spin_lock(lock);
 		while ((n = rcu_dereference_protected(*np,
-					lockdep_is_held(&tbl->lock))) != NULL) {
+					lockdep_is_held(lock))) != NULL) {
 			if (dev && n->dev != dev) {
 				np = &n->next;
 				continue;
 			}
 			rcu_assign_pointer(*np,
 				   rcu_dereference_protected(n->next,
-						lockdep_is_held(&tbl->lock)));
+						lockdep_is_held(lock)));
 			write_lock(&n->lock);
 			neigh_del_timer(n);
 			n->dead = 1;
@@ -245,6 +289,7 @@ static void neigh_flush_dev(struct neigh_table *tbl, struct net_device *dev)
 			write_unlock(&n->lock);
 			neigh_cleanup_and_release(n);
 		}
+		spin_unlock(lock);
 	}
 }
 
@@ -338,6 +383,7 @@ static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift)
 	}
 	ret->hash_buckets = buckets;
 	ret->hash_shift = shift;
+	ret->moving = false;
 	for (i = 0; i < NEIGH_NUM_HASH_RND; i++)
 		neigh_get_hash_rnd(&ret->hash_rnd[i]);
 	return ret;
@@ -358,19 +404,35 @@ static void neigh_hash_free_rcu(struct rcu_head *head)
 	kfree(nht);
 }
 
-static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
-						unsigned long new_shift)
+static void neigh_hash_grow(struct neigh_table *tbl, unsigned int new_shift)
 {
 	unsigned int i, hash;
 	struct neigh_hash_table *new_nht, *old_nht;
 
-	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
-
+	write_lock_bh(&tbl->lock);
 	old_nht = rcu_dereference_protected(tbl->nht,
 					    lockdep_is_held(&tbl->lock));
+	/* Another CPU grew it first */
+	if (old_nht->hash_shift >= new_shift)
+		goto out;
+
 	new_nht = neigh_hash_alloc(new_shift);
 	if (!new_nht)
-		return old_nht;
+		goto out;
+
+	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
+
+	/*
+	 * Turn the bucket writers away from the old table and wait for those
+	 * already in it, the entries can then be moved without the bucket
+	 * locks. Lookups walk the chains as they are relinked, a miss just
+	 * sends them to __neigh_create().
+	 */
+	old_nht->moving = true;
+	for (i = 0; i < NEIGH_HASH_LOCKS; i++) {
+		spin_lock(&tbl->hash_locks[i]);
+		spin_unlock(&tbl->hash_locks[i]);
+	}
 
 	for (i = 0; i < (1 << old_nht->hash_shift); i++) {
 		struct neighbour *n, *next;
@@ -396,7 +458,8 @@ static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
 
 	rcu_assign_pointer(tbl->nht, new_nht);
 	call_rcu(&old_nht->rcu, neigh_hash_free_rcu);
-	return new_nht;
+out:
+	write_unlock_bh(&tbl->lock);
 }
 
 struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
@@ -468,6 +531,7 @@ struct neighbour *__neigh_create(struct neigh_table *tbl, const void *pkey,
 	int error;
 	struct neighbour *n1, *rc, *n = neigh_alloc(tbl, dev);
 	struct neigh_hash_table *nht;
+	spinlock_t *lock;
 
 	if (!n) {
 		rc = ERR_PTR(-ENOBUFS);
@@ -501,30 +565,32 @@ struct neighbour *__neigh_create(struct neigh_table *tbl, const void *pkey,
 
 	n->confirmed = jiffies - (NEIGH_VAR(n->parms, BASE_REACHABLE_TIME) << 1);
 
-	write_lock_bh(&tbl->lock);
-	nht = rcu_dereference_protected(tbl->nht,
-					lockdep_is_held(&tbl->lock));
-
+	rcu_read_lock_bh();
+	nht = rcu_dereference_bh(tbl->nht);
 	if (atomic_read(&tbl->entries) > (1 << nht->hash_shift))
-		nht = neigh_hash_grow(tbl, nht->hash_shift + 1);
-
+		neigh_hash_grow(tbl, nht->hash_shift + 1);
+retry:
+	nht = rcu_dereference_bh(tbl->nht);
 	hash_val = tbl->hash(pkey, dev, nht->hash_rnd) >> (32 - nht->hash_shift);
+	if (!neigh_bucket_lock(tbl, nht, hash_val))
+		goto retry;
+	lock = neigh_hash_lock(tbl, hash_val);
 
 	if (n->parms->dead) {
 		rc = ERR_PTR(-EINVAL);
-		goto out_tbl_unlock;
+		goto out_bucket_unlock;
 	}
 
 	for (n1 = rcu_dereference_protected(nht->hash_buckets[hash_val],
-					    lockdep_is_held(&tbl->lock));
+					    lockdep_is_held(lock));
 	     n1 != NULL;
 	     n1 = rcu_dereference_protected(n1->next,
-			lockdep_is_held(&tbl->lock))) {
+			lockdep_is_held(lock))) {
 		if (dev == n1->dev && !memcmp(n1->primary_key, pkey, key_len)) {
 			if (want_ref)
 				neigh_hold(n1);
 			rc = n1;
-			goto out_tbl_unlock;
+			goto out_bucket_unlock;
 		}
 	}
 
@@ -533,15 +599,17 @@ struct neighbour *__neigh_create(struct neigh_table *tbl, const void *pkey,
 		neigh_hold(n);
 	rcu_assign_pointer(n->next,
 			   rcu_dereference_protected(nht->hash_buckets[hash_val],
-						     lockdep_is_held(&tbl->lock)));
+						     lockdep_is_held(lock)));
 	rcu_assign_pointer(nht->hash_buckets[hash_val], n);
-	write_unlock_bh(&tbl->lock);
+	spin_unlock(lock);
+	rcu_read_unlock_bh();
 	neigh_dbg(2, "neigh %p is created\n", n);
 	rc = n;
 out:
 	return rc;
-out_tbl_unlock:
-	write_unlock_bh(&tbl->lock);
+out_bucket_unlock:
+	spin_unlock(lock);
+	rcu_read_unlock_bh();
 out_neigh_release:
 	neigh_release(n);
 	goto out;
@@ -569,18 +637,19 @@ static struct pneigh_entry *__pneigh_lookup_1(struct pneigh_entry *n,
 		    net_eq(pneigh_net(n), net) &&
 		    (n->dev == dev || !n->dev))
 			return n;
-		n = n->next;
+		n = rcu_dereference_bh(n->next);
 	}
 	return NULL;
 }
 
+/* Called under rcu_read_lock_bh(), the entry is only valid until the unlock */
 struct pneigh_entry *__pneigh_lookup(struct neigh_table *tbl,
 		struct net *net, const void *pkey, struct net_device *dev)
 {
 	int key_len = tbl->key_len;
 	u32 hash_val = pneigh_hash(pkey, key_len);
 
-	return __pneigh_lookup_1(tbl->phash_buckets[hash_val],
+	return __pneigh_lookup_1(rcu_dereference_bh(tbl->phash_buckets[hash_val]),
 				 net, pkey, key_len, dev);
 }
 EXPORT_SYMBOL_GPL(__pneigh_lookup);
@@ -593,10 +662,10 @@ struct pneigh_entry * pneigh_lookup(struct neigh_table *tbl,
 	int key_len = tbl->key_len;
 	u32 hash_val = pneigh_hash(pkey, key_len);
 
-	read_lock_bh(&tbl->lock);
-	n = __pneigh_lookup_1(tbl->phash_buckets[hash_val],
+	rcu_read_lock_bh();
+	n = __pneigh_lookup_1(rcu_dereference_bh(tbl->phash_buckets[hash_val]),
 			      net, pkey, key_len, dev);
-	read_unlock_bh(&tbl->lock);
+	rcu_read_unlock_bh();
 
 	if (n || !creat)
 		goto out;
@@ -623,8 +692,10 @@ struct pneigh_entry * pneigh_lookup(struct neigh_table *tbl,
 	}
 
 	write_lock_bh(&tbl->lock);
-	n->next = tbl->phash_buckets[hash_val];
-	tbl->phash_buckets[hash_val] = n;
+	RCU_INIT_POINTER(n->next,
+			 rcu_dereference_protected(tbl->phash_buckets[hash_val],
+						   lockdep_is_held(&tbl->lock)));
+	rcu_assign_pointer(tbl->phash_buckets[hash_val], n);
 	write_unlock_bh(&tbl->lock);
 out:
 	return n;
@@ -635,23 +706,27 @@ EXPORT_SYMBOL(pneigh_lookup);
 int pneigh_delete(struct neigh_table *tbl, struct net *net, const void *pkey,
 		  struct net_device *dev)
 {
-	struct pneigh_entry *n, **np;
+	struct pneigh_entry *n;
+	struct pneigh_entry __rcu **np;
 	int key_len = tbl->key_len;
 	u32 hash_val = pneigh_hash(pkey, key_len);
 
 	write_lock_bh(&tbl->lock);
-	for (np = &tbl->phash_buckets[hash_val]; (n = *np) != NULL;
+	for (np = &tbl->phash_buckets[hash_val];
+	     (n = rcu_dereference_protected(*np,
+				lockdep_is_held(&tbl->lock))) != NULL;
 	     np = &n->next) {
 		if (!memcmp(n->key, pkey, key_len) && n->dev == dev &&
 		    net_eq(pneigh_net(n), net)) {
-			*np = n->next;
+			RCU_INIT_POINTER(*np, rcu_dereference_protected(n->next,
+						lockdep_is_held(&tbl->lock)));
 			write_unlock_bh(&tbl->lock);
 			if (tbl->pdestructor)
 				tbl->pdestructor(n);
 			if (n->dev)
 				dev_put(n->dev);
 			release_net(pneigh_net(n));
-			kfree(n);
+			kfree_rcu(n, rcu);
 			return 0;
 		}
 	}
@@ -661,20 +736,24 @@ int pneigh_delete(struct neigh_table *tbl, struct net *net, const void *pkey,
 
 static int pneigh_ifdown(struct neigh_table *tbl, struct net_device *dev)
 {
-	struct pneigh_entry *n, **np;
+	struct pneigh_entry *n;
+	struct pneigh_entry __rcu **np;
 	u32 h;
 
 	for (h = 0; h <= PNEIGH_HASHMASK; h++) {
 		np = &tbl->phash_buckets[h];
-		while ((n = *np) != NULL) {
+		while ((n = rcu_dereference_protected(*np,
+				lockdep_is_held(&tbl->lock))) != NULL) {
 			if (!dev || n->dev == dev) {
-				*np = n->next;
+				RCU_INIT_POINTER(*np,
+					rcu_dereference_protected(n->next,
+						lockdep_is_held(&tbl->lock)));
 				if (tbl->pdestructor)
 					tbl->pdestructor(n);
 				if (n->dev)
 					dev_put(n->dev);
 				release_net(pneigh_net(n));
-				kfree(n);
+				kfree_rcu(n, rcu);
 				continue;
 			}
 			np = &n->next;
@@ -759,33 +838,41 @@ static void neigh_periodic_work(struct work_struct *work)
 	struct neighbour __rcu **np;
 	unsigned int i;
 	struct neigh_hash_table *nht;
+	spinlock_t *lock;
 
 	NEIGH_CACHE_STAT_INC(tbl, periodic_gc_runs);
 
-	write_lock_bh(&tbl->lock);
-	nht = rcu_dereference_protected(tbl->nht,
-					lockdep_is_held(&tbl->lock));
-
 	/*
 	 *	periodically recompute ReachableTime from random function
 	 */
 
 	if (time_after(jiffies, tbl->last_rand + 300 * HZ)) {
 		struct neigh_parms *p;
+
+		write_lock_bh(&tbl->lock);
 		tbl->last_rand = jiffies;
 		for (p = &tbl->parms; p; p = p->next)
 			p->reachable_time =
 				neigh_rand_reach_time(NEIGH_VAR(p, BASE_REACHABLE_TIME));
+		write_unlock_bh(&tbl->lock);
 	}
 
 	if (atomic_read(&tbl->entries) < tbl->gc_thresh1)
 		goto out;
 
-	for (i = 0 ; i < (1 << nht->hash_shift); i++) {
+	i = 0;
+	rcu_read_lock_bh();
+	nht = rcu_dereference_bh(tbl->nht);
+	while (i < (1 << nht->hash_shift)) {
+		if (!neigh_bucket_lock(tbl, nht, i)) {
+			nht = rcu_dereference_bh(tbl->nht);
+			continue;
+		}
+		lock = neigh_hash_lock(tbl, i);
 		np = &nht->hash_buckets[i];
 
 		while ((n = rcu_dereference_protected(*np,
-				lockdep_is_held(&tbl->lock))) != NULL) {
+				lockdep_is_held(lock))) != NULL) {
 			unsigned int state;
 
 			write_lock(&n->lock);
@@ -813,16 +900,18 @@ static void neigh_periodic_work(struct work_struct *work)
 next_elt:
 			np = &n->next;
 		}
+		spin_unlock(lock);
 		/*
-		 * It's fine to release lock here, even if hash table
+		 * It's fine to leave the table here, even if it
 		 * grows while we are preempted.
 		 */
-		write_unlock_bh(&tbl->lock);
+		rcu_read_unlock_bh();
 		cond_resched();
-		write_lock_bh(&tbl->lock);
-		nht = rcu_dereference_protected(tbl->nht,
-						lockdep_is_held(&tbl->lock));
+		rcu_read_lock_bh();
+		nht = rcu_dereference_bh(tbl->nht);
+		i++;
 	}
+	rcu_read_unlock_bh();
 out:
 	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks.
 	 * ARP entry timeouts range from 1/2 BASE_REACHABLE_TIME to 3/2
@@ -830,7 +919,6 @@ out:
 	 */
 	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
 			      NEIGH_VAR(&tbl->parms, BASE_REACHABLE_TIME) >> 1);
-	write_unlock_bh(&tbl->lock);
 }
 
 static __inline__ int neigh_max_probes(struct neighbour *n)
@@ -1534,6 +1622,7 @@ static void neigh_table_init_no_netlink(struct neigh_table *tbl)
 {
 	unsigned long now = jiffies;
 	unsigned long phsize;
+	int i;
 
 	write_pnet(&tbl->parms.net, &init_net);
 	atomic_set(&tbl->parms.refcnt, 1);
@@ -1565,6 +1654,8 @@ static void neigh_table_init_no_netlink(struct neigh_table *tbl)
 		WARN_ON(tbl->entry_size % NEIGH_PRIV_ALIGN);
 
 	rwlock_init(&tbl->lock);
+	for (i = 0; i < NEIGH_HASH_LOCKS; i++)
+		spin_lock_init(&tbl->hash_locks[i]);
 	INIT_DEFERRABLE_WORK(&tbl->gc_work, neigh_periodic_work);
 	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
 			tbl->parms.reachable_time);
@@ -2318,12 +2409,14 @@ static int pneigh_dump_table(struct neigh_table *tbl, struct sk_buff *skb,
 	int rc, h, s_h = cb->args[3];
 	int idx, s_idx = idx = cb->args[4];
 
-	read_lock_bh(&tbl->lock);
+	rcu_read_lock_bh();
 
 	for (h = s_h; h <= PNEIGH_HASHMASK; h++) {
 		if (h > s_h)
 			s_idx = 0;
-		for (n = tbl->phash_buckets[h], idx = 0; n; n = n->next) {
+		for (n = rcu_dereference_bh(tbl->phash_buckets[h]), idx = 0;
+		     n;
+		     n = rcu_dereference_bh(n->next)) {
 			if (dev_net(n->dev) != net)
 				continue;
 			if (idx < s_idx)
@@ -2332,7 +2425,7 @@ static int pneigh_dump_table(struct neigh_table *tbl, struct sk_buff *skb,
 					    cb->nlh->nlmsg_seq,
 					    RTM_NEWNEIGH,
 					    NLM_F_MULTI, tbl) <= 0) {
-				read_unlock_bh(&tbl->lock);
+				rcu_read_unlock_bh();
 				rc = -1;
 				goto out;
 			}
@@ -2341,7 +2434,7 @@ static int pneigh_dump_table(struct neigh_table *tbl, struct sk_buff *skb,
 		}
 	}
 
-	read_unlock_bh(&tbl->lock);
+	rcu_read_unlock_bh();
 	rc = skb->len;
 out:
 	cb->args[3] = h;
@@ -2421,12 +2514,14 @@ void __neigh_for_each_release(struct neigh_table *tbl,
 	nht = rcu_dereference_protected(tbl->nht,
 					lockdep_is_held(&tbl->lock));
 	for (chain = 0; chain < (1 << nht->hash_shift); chain++) {
+		spinlock_t *lock = neigh_hash_lock(tbl, chain);
 		struct neighbour *n;
 		struct neighbour __rcu **np;
 
+		spin_lock(lock);
 		np = &nht->hash_buckets[chain];
 		while ((n = rcu_dereference_protected(*np,
-					lockdep_is_held(&tbl->lock))) != NULL) {
+					lockdep_is_held(lock))) != NULL) {
 			int release;
 
 			write_lock(&n->lock);
@@ -2434,7 +2529,7 @@ void __neigh_for_each_release(struct neigh_table *tbl,
 			if (release) {
 				rcu_assign_pointer(*np,
 					rcu_dereference_protected(n->next,
-						lockdep_is_held(&tbl->lock)));
+						lockdep_is_held(lock)));
 				n->dead = 1;
 			} else
 				np = &n->next;
@@ -2442,6 +2537,7 @@ void __neigh_for_each_release(struct neigh_table *tbl,
 			if (release)
 				neigh_cleanup_and_release(n);
 		}
+		spin_unlock(lock);
 	}
 }
 EXPORT_SYMBOL(__neigh_for_each_release);
@@ -2560,9 +2656,9 @@ static struct pneigh_entry *pneigh_get_first(struct seq_file *seq)
 
 	state->flags |= NEIGH_SEQ_IS_PNEIGH;
 	for (bucket = 0; bucket <= PNEIGH_HASHMASK; bucket++) {
-		pn = tbl->phash_buckets[bucket];
+		pn = rcu_dereference_bh(tbl->phash_buckets[bucket]);
 		while (pn && !net_eq(pneigh_net(pn), net))
-			pn = pn->next;
+			pn = rcu_dereference_bh(pn->next);
 		if (pn)
 			break;
 	}
@@ -2580,15 +2676,15 @@ static struct pneigh_entry *pneigh_get_next(struct seq_file *seq,
 	struct neigh_table *tbl = state->tbl;
 
 	do {
-		pn = pn->next;
+		pn = rcu_dereference_bh(pn->next);
 	} while (pn && !net_eq(pneigh_net(pn), net));
 
 	while (!pn) {
 		if (++state->bucket > PNEIGH_HASHMASK)
 			break;
-		pn = tbl->phash_buckets[state->bucket];
+		pn = rcu_dereference_bh(tbl->phash_buckets[state->bucket]);
 		while (pn && !net_eq(pneigh_net(pn), net))
-			pn = pn->next;
+			pn = rcu_dereference_bh(pn->next);
 		if (pn)
 			break;
 	}
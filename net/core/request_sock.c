@@ -42,11 +42,16 @@ int reqsk_queue_alloc(struct request_sock_queue *queue,
 {
 	size_t lopt_size = sizeof(struct listen_sock);
 	struct listen_sock *lopt = NULL;
+	unsigned int i, nr_locks;
 
 	nr_table_entries = min_t(u32, nr_table_entries, sysctl_max_syn_backlog);
 	nr_table_entries = max_t(u32, nr_table_entries, 8);
 	nr_table_entries = roundup_pow_of_two(nr_table_entries + 1);
 	lopt_size += nr_table_entries * sizeof(struct request_sock *);
+	/* A few bucket locks per cpu keep the SYNs of all the cpus apart */
+	nr_locks = min_t(u32, nr_table_entries,
+			 4 * roundup_pow_of_two(nr_cpu_ids));
+	lopt_size += nr_locks * sizeof(spinlock_t);
 
 	if (lopt_size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER))
 		lopt = kzalloc(lopt_size, GFP_KERNEL |
@@ -62,6 +67,10 @@ int reqsk_queue_alloc(struct request_sock_queue *queue,
 	queue->rskq_accept_head = NULL;
 	lopt->nr_table_entries = nr_table_entries;
 	lopt->max_qlen_log = ilog2(nr_table_entries);
+	lopt->syn_locks = (spinlock_t *)&lopt->syn_table[nr_table_entries];
+	lopt->syn_locks_mask = nr_locks - 1;
+	for (i = 0; i < nr_locks; i++)
+		spin_lock_init(&lopt->syn_locks[i]);
 
 	write_lock_bh(&queue->syn_wait_lock);
 	queue->listen_opt = lopt;
@@ -91,10 +100,14 @@ static inline struct listen_sock *reqsk_queue_yank_listen_sk(
 
 void reqsk_queue_destroy(struct request_sock_queue *queue)
 {
-	/* make all the listen_opt local to us */
+	/*
+	 * make all the listen_opt local to us, the SYNs processed without the
+	 * listener lock hold the syn_wait_lock and those that start later
+	 * find no listen_opt.
+	 */
 	struct listen_sock *lopt = reqsk_queue_yank_listen_sk(queue);
 
-	if (lopt->qlen != 0) {
+	if (atomic_read(&lopt->qlen) != 0) {
 		unsigned int i;
 
 		for (i = 0; i < lopt->nr_table_entries; i++) {
@@ -102,13 +115,13 @@ void reqsk_queue_destroy(struct request_sock_queue *queue)
 
 			while ((req = lopt->syn_table[i]) != NULL) {
 				lopt->syn_table[i] = req->dl_next;
-				lopt->qlen--;
+				atomic_dec(&lopt->qlen);
 				reqsk_free(req);
 			}
 		}
 	}
 
-	WARN_ON(lopt->qlen != 0);
+	WARN_ON(atomic_read(&lopt->qlen) != 0);
 	kvfree(lopt);
 }
 
@@ -1385,6 +1385,16 @@ EXPORT_SYMBOL(sk_alloc);
 static void __sk_free(struct sock *sk)
 {
 	struct sk_filter *filter;
+	struct sk_buff *skb;
+
+	/* No more references, thus no one can defer an skb anymore */
+	skb = xchg(&sk->sk_rx_defer.head, NULL);
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		kfree_skb(skb);
+		skb = next;
+	}
 
 	if (sk->sk_destruct)
 		sk->sk_destruct(sk);
@@ -1472,6 +1482,8 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 		bh_lock_sock(newsk);
 		newsk->sk_backlog.head	= newsk->sk_backlog.tail = NULL;
 		newsk->sk_backlog.len = 0;
+		newsk->sk_rx_defer.head = NULL;
+		atomic_set(&newsk->sk_rx_defer.len, 0);
 
 		atomic_set(&newsk->sk_rmem_alloc, 0);
 		/*
@@ -1496,6 +1508,7 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 
 		sock_reset_flag(newsk, SOCK_DONE);
 		skb_queue_head_init(&newsk->sk_error_queue);
+		RCU_INIT_POINTER(newsk->sk_reuseport_cb, NULL);
 
 		filter = rcu_dereference_protected(newsk->sk_filter, 1);
 		if (filter != NULL)
@@ -1920,6 +1933,100 @@ static void __release_sock(struct sock *sk)
 	sk->sk_backlog.len = 0;
 }
 
+/**
+ * sk_defer_rcv_skb - queue an skb without the per-socket spinlock
+ * @sk: socket
+ * @skb: skb received in softirq context
+ * @limit: receive queues limit, as for sk_add_backlog()
+ *
+ * For the receive paths that found the spinlock busy with spin_trylock():
+ * rather than spinning on it, the skb is pushed on a lockless stack that
+ * the holder of the spinlock processes, as if the skb had been received
+ * when it was released. The pushers and the holders have to call
+ * sk_rx_defer_flush() after releasing or failing to take the spinlock,
+ * whichever happens last processes the skbs. The socket must have the
+ * SOCK_RX_DEFER flag set before it can be found by the receive path.
+ */
+int sk_defer_rcv_skb(struct sock *sk, struct sk_buff *skb, unsigned int limit)
+{
+	struct sk_buff *head;
+
+	if (sk_rcvqueues_full(sk, limit))
+		return -ENOBUFS;
+
+	/* We are going to leave the rcu lock, as for the backlog */
+	skb_dst_force(skb);
+	atomic_add(skb->truesize, &sk->sk_rx_defer.len);
+	do {
+		head = ACCESS_ONCE(sk->sk_rx_defer.head);
+		skb->next = head;
+	} while (cmpxchg(&sk->sk_rx_defer.head, head, skb) != head);
+	return 0;
+}
+EXPORT_SYMBOL(sk_defer_rcv_skb);
+
+/**
+ * __sk_rx_defer_flush - process the deferred skbs
+ * @sk: socket
+ *
+ * Called with the per-socket spinlock held and softirqs disabled. The
+ * skbs are received in their arrival order, or added to the backlog if
+ * the socket is owned by the user.
+ */
+void __sk_rx_defer_flush(struct sock *sk)
+{
+	struct sk_buff *skb = xchg(&sk->sk_rx_defer.head, NULL);
+	struct sk_buff *list = NULL;
+
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		skb->next = list;
+		list = skb;
+		skb = next;
+	}
+
+	while (list) {
+		skb = list;
+		list = skb->next;
+		skb->next = NULL;
+		atomic_sub(skb->truesize, &sk->sk_rx_defer.len);
+
+		if (!sock_owned_by_user(sk)) {
+			sk_backlog_rcv(sk, skb);
+		} else if (sk_add_backlog(sk, skb, sk->sk_rcvbuf)) {
+			atomic_inc(&sk->sk_drops);
+			kfree_skb(skb);
+		}
+	}
+}
+EXPORT_SYMBOL(__sk_rx_defer_flush);
+
+/**
+ * sk_rx_defer_trylock - process the skbs deferred while holding the spinlock
+ * @sk: socket
+ *
+ * Called through sk_rx_defer_flush() with softirqs disabled, after
+ * releasing the per-socket spinlock or failing to take it for
+ * sk_defer_rcv_skb(). The spinlock is only tried: its holder is going to
+ * call this function too.
+ */
+void sk_rx_defer_trylock(struct sock *sk)
+{
+	/*
+	 * Order the release or the push before the test, pairs with the
+	 * cmpxchg in sk_defer_rcv_skb() and the spin_trylock() below.
+	 */
+	smp_mb();
+	while (ACCESS_ONCE(sk->sk_rx_defer.head) &&
+	       spin_trylock(&sk->sk_lock.slock)) {
+		__sk_rx_defer_flush(sk);
+		spin_unlock(&sk->sk_lock.slock);
+		smp_mb();
+	}
+}
+EXPORT_SYMBOL(sk_rx_defer_trylock);
+
 /**
  * sk_wait_data - wait for data to arrive at sk_receive_queue
  * @sk:    sock to wait on
@@ -2325,8 +2432,11 @@ void lock_sock_nested(struct sock *sk, int subclass)
 	spin_lock_bh(&sk->sk_lock.slock);
 	if (sk->sk_lock.owned)
 		__lock_sock(sk);
+	if (sk->sk_rx_defer.head)
+		__sk_rx_defer_flush(sk);
 	sk->sk_lock.owned = 1;
 	spin_unlock(&sk->sk_lock.slock);
+	sk_rx_defer_flush(sk);
 	/*
 	 * The sk_lock has mutex_lock() semantics here:
 	 */
@@ -2343,6 +2453,8 @@ void release_sock(struct sock *sk)
 	mutex_release(&sk->sk_lock.dep_map, 1, _RET_IP_);
 
 	spin_lock_bh(&sk->sk_lock.slock);
+	if (sk->sk_rx_defer.head)
+		__sk_rx_defer_flush(sk);
 	if (sk->sk_backlog.tail)
 		__release_sock(sk);
 
@@ -2355,7 +2467,9 @@ void release_sock(struct sock *sk)
 	sock_release_ownership(sk);
 	if (waitqueue_active(&sk->sk_lock.wq))
 		wake_up(&sk->sk_lock.wq);
-	spin_unlock_bh(&sk->sk_lock.slock);
+	spin_unlock(&sk->sk_lock.slock);
+	sk_rx_defer_flush(sk);
+	local_bh_enable();
 }
 EXPORT_SYMBOL(release_sock);
 
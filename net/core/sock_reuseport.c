@@ -0,0 +1,181 @@
+/*
+ * To speed up the lookups of the SO_REUSEPORT sockets, those bound to the
+ * same port and address are kept in a group, an array of their socket
+ * pointers. The receive path picks a member with a hash of the flow, in a
+ * single access under RCU, instead of walking and scoring all the sockets
+ * of the port.
+ *
+ * The updates of a group are serialized by the caller, with a lock that
+ * covers all the sockets of the port. A full group is replaced by a copy
+ * twice its size, and freed after a grace period.
+ */
+
+#include <linux/export.h>
+#include <linux/slab.h>
+#include <net/sock_reuseport.h>
+
+#define INIT_SOCKS 128
+
+static struct sock_reuseport *__reuseport_alloc(u16 max_socks)
+{
+	size_t size = sizeof(struct sock_reuseport) +
+		      sizeof(struct sock *) * max_socks;
+	struct sock_reuseport *reuse = kzalloc(size, GFP_ATOMIC);
+
+	if (!reuse)
+		return NULL;
+
+	reuse->max_socks = max_socks;
+	return reuse;
+}
+
+/**
+ * reuseport_alloc - start a reuseport group with a socket
+ * @sk: the first socket of the group
+ * Return: 0 on success, or -ENOMEM
+ */
+int reuseport_alloc(struct sock *sk)
+{
+	struct sock_reuseport *reuse = __reuseport_alloc(INIT_SOCKS);
+
+	if (!reuse)
+		return -ENOMEM;
+
+	reuse->socks[0] = sk;
+	reuse->num_socks = 1;
+	rcu_assign_pointer(sk->sk_reuseport_cb, reuse);
+	return 0;
+}
+EXPORT_SYMBOL(reuseport_alloc);
+
+static struct sock_reuseport *reuseport_grow(struct sock_reuseport *reuse)
+{
+	struct sock_reuseport *more_reuse;
+	u32 more_socks_size, i;
+
+	more_socks_size = reuse->max_socks * 2U;
+	if (more_socks_size > U16_MAX)
+		return NULL;
+
+	more_reuse = __reuseport_alloc(more_socks_size);
+	if (!more_reuse)
+		return NULL;
+
+	more_reuse->num_socks = reuse->num_socks;
+	more_reuse->has_conns = reuse->has_conns;
+	memcpy(more_reuse->socks, reuse->socks,
+	       reuse->num_socks * sizeof(struct sock *));
+
+	for (i = 0; i < reuse->num_socks; ++i)
+		rcu_assign_pointer(reuse->socks[i]->sk_reuseport_cb,
+				   more_reuse);
+
+	/* Pairs with the barrier of __reuseport_set_conns() */
+	smp_mb();
+	if (ACCESS_ONCE(reuse->has_conns))
+		more_reuse->has_conns = true;
+
+	kfree_rcu(reuse, rcu);
+	return more_reuse;
+}
+
+/**
+ * reuseport_add_sock - add a socket to the reuseport group of another
+ * @sk:  the socket to add
+ * @sk2: a socket of the group
+ * Return: 0 on success, or -ENOMEM
+ */
+int reuseport_add_sock(struct sock *sk, struct sock *sk2)
+{
+	struct sock_reuseport *reuse;
+
+	reuse = rcu_dereference_protected(sk2->sk_reuseport_cb, 1);
+	if (reuse->num_socks == reuse->max_socks) {
+		reuse = reuseport_grow(reuse);
+		if (!reuse)
+			return -ENOMEM;
+	}
+
+	reuse->socks[reuse->num_socks] = sk;
+	/* The socket must be in the array before it is counted */
+	smp_wmb();
+	reuse->num_socks++;
+	rcu_assign_pointer(sk->sk_reuseport_cb, reuse);
+	return 0;
+}
+EXPORT_SYMBOL(reuseport_add_sock);
+
+/**
+ * reuseport_detach_sock - remove a socket from its reuseport group
+ * @sk: the socket to remove
+ *
+ * The last socket of the array takes the slot of the removed one, a
+ * concurrent lookup may still find the removed socket and has to check
+ * it once it holds a reference. The group is freed with its last socket.
+ */
+void reuseport_detach_sock(struct sock *sk)
+{
+	struct sock_reuseport *reuse;
+	int i;
+
+	reuse = rcu_dereference_protected(sk->sk_reuseport_cb, 1);
+	if (!reuse)
+		return;
+
+	RCU_INIT_POINTER(sk->sk_reuseport_cb, NULL);
+
+	for (i = 0; i < reuse->num_socks; i++) {
+		if (reuse->socks[i] == sk) {
+			reuse->socks[i] = reuse->socks[reuse->num_socks - 1];
+			reuse->num_socks--;
+			if (reuse->num_socks == 0)
+				kfree_rcu(reuse, rcu);
+			break;
+		}
+	}
+}
+EXPORT_SYMBOL(reuseport_detach_sock);
+
+/**
+ * reuseport_select_sock - select a socket from the reuseport group of sk
+ * @sk:   a socket of the group
+ * @hash: the hash of the flow
+ * Return: the selected socket, or NULL if the group can't be used
+ *
+ * Called under RCU. The selected socket is not referenced.
+ */
+struct sock *reuseport_select_sock(struct sock *sk, u32 hash)
+{
+	struct sock_reuseport *reuse;
+	u16 socks;
+
+	reuse = rcu_dereference(sk->sk_reuseport_cb);
+	if (!reuse || ACCESS_ONCE(reuse->has_conns))
+		return NULL;
+
+	socks = ACCESS_ONCE(reuse->num_socks);
+	if (!socks)
+		return NULL;
+	/* Pairs with the smp_wmb() of reuseport_add_sock() */
+	smp_rmb();
+	return ACCESS_ONCE(reuse->socks[reciprocal_scale(hash, socks)]);
+}
+EXPORT_SYMBOL(reuseport_select_sock);
+
+void __reuseport_set_conns(struct sock *sk)
+{
+	struct sock_reuseport *reuse, *new;
+
+	rcu_read_lock();
+	reuse = rcu_dereference(sk->sk_reuseport_cb);
+	if (reuse) {
+		reuse->has_conns = true;
+		/* The group may have been replaced by a larger copy meanwhile */
+		smp_mb();
+		new = rcu_dereference(sk->sk_reuseport_cb);
+		if (new && new != reuse)
+			new->has_conns = true;
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(__reuseport_set_conns);
@@ -484,10 +484,11 @@ struct request_sock *inet_csk_search_req(const struct sock *sk,
 {
 	const struct inet_connection_sock *icsk = inet_csk(sk);
 	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
+	const u32 h = inet_synq_hash(raddr, rport, lopt->hash_rnd,
+				     lopt->nr_table_entries);
 	struct request_sock *req, **prev;
 
-	for (prev = &lopt->syn_table[inet_synq_hash(raddr, rport, lopt->hash_rnd,
-						    lopt->nr_table_entries)];
+	for (prev = &lopt->syn_table[h];
 	     (req = *prev) != NULL;
 	     prev = &req->dl_next) {
 		const struct inet_request_sock *ireq = inet_rsk(req);
@@ -520,6 +521,32 @@ void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
 }
 EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_hash_add);
 
+/**
+ *	inet_csk_reqsk_queue_unlocked - may a SYN skip the listener lock?
+ *	@sk: the listener
+ *
+ *	A SYN that opens a new connection only adds a request to the syn_table,
+ *	which can be done without the listener lock, see struct listen_sock.
+ *	The caller holds the syn_wait_lock in read mode and must not touch an
+ *	existing request: it may only look them up, the removals wait for the
+ *	lock. The listener then keeps its listen_opt, as reqsk_queue_destroy()
+ *	takes the lock to yank it. The Fast Open listeners are left to the
+ *	locked path, a SYN may create a child on them.
+ */
+bool inet_csk_reqsk_queue_unlocked(struct sock *sk)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct fastopen_queue *fastopenq = ACCESS_ONCE(queue->fastopenq);
+
+	if (sk->sk_state != TCP_LISTEN || !queue->listen_opt)
+		return false;
+	if (fastopenq && ACCESS_ONCE(fastopenq->max_qlen))
+		return false;
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_unlocked);
+
 /* Only thing we need from tcp.h */
 extern int sysctl_tcp_synack_retries;
 
@@ -568,9 +595,9 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	int thresh = max_retries;
 	unsigned long now = jiffies;
 	struct request_sock **reqp, *req;
-	int i, budget;
+	int i, budget, qlen;
 
-	if (lopt == NULL || lopt->qlen == 0)
+	if (lopt == NULL || atomic_read(&lopt->qlen) == 0)
 		return;
 
 	/* Normally all the openreqs are young and become mature
@@ -590,11 +617,12 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 	 * embrions; and abort old ones without pity, if old
 	 * ones are about to clog our table.
 	 */
-	if (lopt->qlen>>(lopt->max_qlen_log-1)) {
-		int young = (lopt->qlen_young<<1);
+	qlen = atomic_read(&lopt->qlen);
+	if (qlen>>(lopt->max_qlen_log-1)) {
+		int young = (atomic_read(&lopt->qlen_young)<<1);
 
 		while (thresh > 2) {
-			if (lopt->qlen < young)
+			if (qlen < young)
 				break;
 			thresh--;
 			young <<= 1;
@@ -624,7 +652,7 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 					unsigned long timeo;
 
 					if (req->num_timeout++ == 0)
-						lopt->qlen_young--;
+						atomic_dec(&lopt->qlen_young);
 					timeo = min(timeout << req->num_timeout,
 						    max_rto);
 					req->expires = now + timeo;
@@ -647,7 +675,7 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 
 	lopt->clock_hand = i;
 
-	if (lopt->qlen)
+	if (atomic_read(&lopt->qlen))
 		inet_csk_reset_keepalive_timer(parent, interval);
 }
 EXPORT_SYMBOL_GPL(inet_csk_reqsk_queue_prune);
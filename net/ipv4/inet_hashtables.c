@@ -13,10 +13,15 @@
  *      2 of the License, or (at your option) any later version.
  */
 
+#include <linux/debugfs.h>
+#include <linux/log2.h>
 #include <linux/module.h>
 #include <linux/random.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <linux/wait.h>
 
 #include <net/inet_connection_sock.h>
@@ -339,7 +344,7 @@ static int __inet_check_established(struct inet_timewait_death_row *death_row,
 	struct inet_timewait_sock *tw = NULL;
 	int twrefcnt = 0;
 
-	spin_lock(lock);
+	inet_ehash_lock(hinfo, lock);
 
 	sk_nulls_for_each(sk2, node, &head->chain) {
 		if (sk2->sk_hash != hash)
@@ -411,7 +416,7 @@ int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw)
 	list = &head->chain;
 	lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 
-	spin_lock(lock);
+	inet_ehash_lock(hashinfo, lock);
 	__sk_nulls_add_node_rcu(sk, list);
 	if (tw) {
 		WARN_ON(sk->sk_hash != tw->tw_hash);
@@ -606,3 +611,199 @@ void inet_hashinfo_init(struct inet_hashinfo *h)
 		}
 }
 EXPORT_SYMBOL_GPL(inet_hashinfo_init);
+
+/*
+ * At most one ehash lock for every INET_EHASH_BUCKETS_PER_LOCK buckets, the
+ * size of the table standing for the expected number of connections.
+ */
+#define INET_EHASH_BUCKETS_PER_LOCK	64
+
+/*
+ * Size the ehash locks from the number of CPUs, two cachelines of locks
+ * for each, and from the size of the table, but with no more locks than
+ * buckets. On NUMA, an array of more than a page is vmalloc()ed: at boot,
+ * the interleave memory policy of the init task, which hashdist relies on
+ * for the hash tables themselves, spreads its pages over the nodes.
+ */
+int inet_ehash_locks_alloc(struct inet_hashinfo *hashinfo)
+{
+	unsigned int locksz = sizeof(spinlock_t);
+	unsigned int i, nblocks = 1;
+#if defined(CONFIG_PROVE_LOCKING)
+	unsigned int nr_pcpus = 2;
+#else
+	unsigned int nr_pcpus = num_possible_cpus();
+#endif
+
+	if (locksz != 0) {
+		nblocks = max(2U * L1_CACHE_BYTES / locksz, 1U) * nr_pcpus;
+		nblocks = max(nblocks, (hashinfo->ehash_mask + 1) /
+				       INET_EHASH_BUCKETS_PER_LOCK);
+		nblocks = roundup_pow_of_two(nblocks);
+		nblocks = min(nblocks, hashinfo->ehash_mask + 1);
+#ifdef CONFIG_NUMA
+		if (nblocks * locksz > PAGE_SIZE)
+			hashinfo->ehash_locks = vmalloc(nblocks * locksz);
+		else
+#endif
+		hashinfo->ehash_locks = kmalloc_array(nblocks, locksz,
+						      GFP_KERNEL);
+		if (!hashinfo->ehash_locks)
+			return -ENOMEM;
+		for (i = 0; i < nblocks; i++)
+			spin_lock_init(&hashinfo->ehash_locks[i]);
+	}
+	hashinfo->ehash_locks_mask = nblocks - 1;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_locks_alloc);
+
+void inet_ehash_locks_free(struct inet_hashinfo *hashinfo)
+{
+#ifdef INET_EHASH_LOCK_STAT
+	vfree(hashinfo->ehash_locks_contended);
+	hashinfo->ehash_locks_contended = NULL;
+#endif
+	kvfree(hashinfo->ehash_locks);
+	hashinfo->ehash_locks = NULL;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_locks_free);
+
+#ifdef INET_EHASH_LOCK_STAT
+#define INET_EHASH_LOCK_HISTO	32
+#define INET_EHASH_LOCK_TOP	16
+
+/*
+ * The number of ehash locks, the nodes of their pages, a log2 histogram
+ * of the locks by their contended acquisitions and the most contended
+ * locks. Writing 0 clears the counts.
+ */
+static int inet_ehash_locks_show(struct seq_file *m, void *v)
+{
+	struct inet_hashinfo *hashinfo = m->private;
+	unsigned int nlocks = hashinfo->ehash_locks_mask + 1;
+	unsigned int histo[INET_EHASH_LOCK_HISTO] = { 0 };
+	unsigned int top[INET_EHASH_LOCK_TOP], topc[INET_EHASH_LOCK_TOP];
+	unsigned long size = nlocks * sizeof(spinlock_t);
+	unsigned int i, j, n, ntop = 0;
+	unsigned long off;
+	int nid;
+
+	seq_printf(m, "locks %u buckets %u\n", nlocks,
+		   hashinfo->ehash_mask + 1);
+
+	if (is_vmalloc_addr(hashinfo->ehash_locks)) {
+		for_each_online_node(nid) {
+			for (n = 0, off = 0; off < size; off += PAGE_SIZE) {
+				struct page *page = vmalloc_to_page(
+					(void *)hashinfo->ehash_locks + off);
+
+				if (page && page_to_nid(page) == nid)
+					n++;
+			}
+			if (n)
+				seq_printf(m, "node %d: %u pages\n", nid, n);
+		}
+	} else {
+		seq_printf(m, "node %d: %lu bytes\n",
+			   page_to_nid(virt_to_page(hashinfo->ehash_locks)),
+			   size);
+	}
+
+	for (i = 0; i < nlocks; i++) {
+		unsigned int c = ACCESS_ONCE(hashinfo->ehash_locks_contended[i]);
+
+		histo[c ? min(ilog2(c) + 1, INET_EHASH_LOCK_HISTO - 1) : 0]++;
+		if (!c)
+			continue;
+
+		/* Keep the most contended locks sorted in top[] */
+		for (j = ntop; j > 0 && c > topc[j - 1]; j--)
+			;
+		if (j == INET_EHASH_LOCK_TOP)
+			continue;
+		if (ntop < INET_EHASH_LOCK_TOP)
+			ntop++;
+		memmove(&top[j + 1], &top[j], (ntop - j - 1) * sizeof(*top));
+		memmove(&topc[j + 1], &topc[j], (ntop - j - 1) * sizeof(*topc));
+		top[j] = i;
+		topc[j] = c;
+	}
+
+	seq_printf(m, "\n%12s %10s\n", "contended", "locks");
+	for (i = 0; i < INET_EHASH_LOCK_HISTO; i++) {
+		if (!histo[i])
+			continue;
+		if (!i)
+			seq_printf(m, "%12u %10u\n", 0, histo[i]);
+		else
+			seq_printf(m, "%11u+ %10u\n", 1U << (i - 1), histo[i]);
+	}
+
+	seq_printf(m, "\n%12s %10s\n", "lock", "contended");
+	for (j = 0; j < ntop; j++)
+		seq_printf(m, "%12u %10u\n", top[j], topc[j]);
+	return 0;
+}
+
+static int inet_ehash_locks_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, inet_ehash_locks_show, inode->i_private);
+}
+
+static ssize_t inet_ehash_locks_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct inet_hashinfo *hashinfo = file_inode(file)->i_private;
+	char c;
+
+	if (count) {
+		if (get_user(c, buf))
+			return -EFAULT;
+		if (c == '0')
+			memset(hashinfo->ehash_locks_contended, 0,
+			       (hashinfo->ehash_locks_mask + 1) *
+			       sizeof(unsigned int));
+	}
+	return count;
+}
+
+static const struct file_operations inet_ehash_locks_fops = {
+	.open		= inet_ehash_locks_open,
+	.write		= inet_ehash_locks_write,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/**
+ * inet_ehash_locks_debugfs - count the contention of the ehash locks
+ * @hashinfo: the hash table, whose ehash locks are allocated
+ * @name    : the name of its file in the inet_ehash_locks debugfs directory
+ *
+ * For a table that lives as long as the kernel, the file isn't removed.
+ */
+int inet_ehash_locks_debugfs(struct inet_hashinfo *hashinfo, const char *name)
+{
+	static struct dentry *dir;
+
+	if (!hashinfo->ehash_locks || hashinfo->ehash_locks_contended)
+		return 0;
+
+	hashinfo->ehash_locks_contended =
+		vzalloc((hashinfo->ehash_locks_mask + 1) * sizeof(unsigned int));
+	if (!hashinfo->ehash_locks_contended)
+		return -ENOMEM;
+
+	if (!dir)
+		dir = debugfs_create_dir("inet_ehash_locks", NULL);
+	if (!dir || !debugfs_create_file(name, 0600, dir, hashinfo,
+					 &inet_ehash_locks_fops)) {
+		vfree(hashinfo->ehash_locks_contended);
+		hashinfo->ehash_locks_contended = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+#endif /* INET_EHASH_LOCK_STAT */
@@ -75,7 +75,7 @@ static void __inet_twsk_kill(struct inet_timewait_sock *tw,
 	/* Unlink from established hashes. */
 	spinlock_t *lock = inet_ehash_lockp(hashinfo, tw->tw_hash);
 
-	spin_lock(lock);
+	inet_ehash_lock(hashinfo, lock);
 	refcnt = inet_twsk_unhash(tw);
 	spin_unlock(lock);
 
@@ -147,7 +147,7 @@ void __inet_twsk_hashdance(struct inet_timewait_sock *tw, struct sock *sk,
 	inet_twsk_add_bind_node(tw, &tw->tw_tb->owners);
 	spin_unlock(&bhead->lock);
 
-	spin_lock(lock);
+	inet_ehash_lock(hashinfo, lock);
 
 	/*
 	 * Step 2: Hash TW into tcp ehash chain.
@@ -255,8 +255,10 @@ bool tcp_try_fastopen(struct sock *sk, struct sk_buff *skb,
 	struct tcp_fastopen_cookie valid_foc = { .len = -1 };
 	bool syn_data = TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1;
 
+	/* The child is queued to the listener, which needs its lock */
 	if (!((sysctl_tcp_fastopen & TFO_SERVER_ENABLE) &&
 	      (syn_data || foc->len >= 0) &&
+	      !TCP_SKB_CB(skb)->syn_unlocked &&
 	      tcp_fastopen_queue_check(sk))) {
 		foc->len = -1;
 		return false;
@@ -1413,6 +1413,46 @@ static struct sock *tcp_v4_hnd_req(struct sock *sk, struct sk_buff *skb)
 	return sk;
 }
 
+/* A SYN that opens a new connection is processed without the lock of the
+ * listener, so that the SYNs received by all the cpus don't serialize on it.
+ * It is left to tcp_v4_do_rcv() if a request or a socket already exists for
+ * it, they are only stable under the listener lock. The syn_wait_lock keeps
+ * the requests from being removed or freed meanwhile.
+ */
+static bool tcp_v4_syn_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	const struct tcphdr *th = tcp_hdr(skb);
+	const struct iphdr *iph = ip_hdr(skb);
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct request_sock **prev;
+	struct sock *nsk;
+
+	read_lock(&queue->syn_wait_lock);
+	if (!tcp_syn_unlocked(sk, skb))
+		goto out;
+	if (skb->len < tcp_hdrlen(skb) || tcp_checksum_complete(skb))
+		goto out;
+	if (inet_csk_search_req(sk, &prev, th->source, iph->saddr, iph->daddr))
+		goto out;
+	nsk = inet_lookup_established(sock_net(sk), &tcp_hashinfo, iph->saddr,
+			th->source, iph->daddr, th->dest, inet_iif(skb));
+	if (nsk) {
+		sock_gen_put(nsk);
+		goto out;
+	}
+
+	TCP_SKB_CB(skb)->syn_unlocked = 1;
+	if (inet_csk(sk)->icsk_af_ops->conn_request(sk, skb) < 0)
+		tcp_v4_send_reset(sk, skb);
+	read_unlock(&queue->syn_wait_lock);
+	kfree_skb(skb);
+	return true;
+
+out:
+	read_unlock(&queue->syn_wait_lock);
+	return false;
+}
+
 /* The socket must have it's spinlock held when we get
  * here.
  *
@@ -1628,6 +1668,7 @@ int tcp_v4_rcv(struct sk_buff *skb)
 	TCP_SKB_CB(skb)->tcp_tw_isn = 0;
 	TCP_SKB_CB(skb)->ip_dsfield = ipv4_get_dsfield(iph);
 	TCP_SKB_CB(skb)->sacked	 = 0;
+	TCP_SKB_CB(skb)->syn_unlocked = 0;
 
 	sk = __inet_lookup_skb(&tcp_hashinfo, skb, th->source, th->dest);
 	if (!sk)
@@ -1664,6 +1705,11 @@ process:
 	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
+	if (sk->sk_state == TCP_LISTEN && tcp_v4_syn_rcv(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -112,6 +112,7 @@
 #include <linux/static_key.h>
 #include <trace/events/skb.h>
 #include <net/busy_poll.h>
+#include <net/sock_reuseport.h>
 #include "udp_impl.h"
 
 struct udp_table udp_table __read_mostly;
@@ -196,6 +197,44 @@ static int udp_lib_lport_inuse2(struct net *net, __u16 num,
 	return res;
 }
 
+/*
+ * A SO_REUSEPORT socket of the same owner bound to the same port, address
+ * and device, whose reuseport group sk can join without a conflict scan.
+ * Note: the primary hash chain lock is held, it also serializes the group.
+ */
+static struct sock *udp_reuseport_match(struct net *net, __u16 num,
+					const struct udp_hslot *hslot,
+					struct sock *sk)
+{
+	unsigned int hash2 = udp_sk(sk)->udp_portaddr_hash ^ num;
+	struct sock *sk2;
+	struct hlist_nulls_node *node;
+	kuid_t uid = sock_i_uid(sk);
+
+	sk_nulls_for_each(sk2, node, &hslot->head) {
+		if (!net_eq(sock_net(sk2), net) ||
+		    sk2 == sk ||
+		    udp_sk(sk2)->udp_port_hash != num ||
+		    udp_sk(sk2)->udp_portaddr_hash != hash2 ||
+		    sk2->sk_family != sk->sk_family ||
+		    !sk2->sk_reuseport ||
+		    !rcu_access_pointer(sk2->sk_reuseport_cb) ||
+		    sk2->sk_bound_dev_if != sk->sk_bound_dev_if ||
+		    !uid_eq(uid, sock_i_uid(sk2)) ||
+		    inet_sk(sk2)->inet_rcv_saddr != inet_sk(sk)->inet_rcv_saddr)
+			continue;
+#if IS_ENABLED(CONFIG_IPV6)
+		if (sk->sk_family == AF_INET6 &&
+		    (ipv6_only_sock(sk2) != ipv6_only_sock(sk) ||
+		     !ipv6_addr_equal(&sk2->sk_v6_rcv_saddr,
+				      &sk->sk_v6_rcv_saddr)))
+			continue;
+#endif
+		return sk2;
+	}
+	return NULL;
+}
+
 /**
  *  udp_lib_get_port  -  UDP/-Lite port lookup for IPv4 and IPv6
  *
@@ -257,6 +296,16 @@ int udp_lib_get_port(struct sock *sk, unsigned short snum,
 	} else {
 		hslot = udp_hashslot(udptable, net, snum);
 		spin_lock_bh(&hslot->lock);
+		if (sk->sk_reuseport) {
+			struct sock *sk2 = udp_reuseport_match(net, snum,
+							       hslot, sk);
+
+			if (sk2) {
+				if (reuseport_add_sock(sk, sk2))
+					goto fail_unlock;
+				goto found;
+			}
+		}
 		if (hslot->count > 10) {
 			int exist;
 			unsigned int slot2 = udp_sk(sk)->udp_portaddr_hash ^ snum;
@@ -290,6 +339,16 @@ found:
 	udp_sk(sk)->udp_port_hash = snum;
 	udp_sk(sk)->udp_portaddr_hash ^= snum;
 	if (sk_unhashed(sk)) {
+		if (sk->sk_reuseport &&
+		    !rcu_access_pointer(sk->sk_reuseport_cb) &&
+		    reuseport_alloc(sk)) {
+			inet_sk(sk)->inet_num = 0;
+			udp_sk(sk)->udp_portaddr_hash ^= snum;
+			goto fail_unlock;
+		}
+
+		/* Before the receive path can find it */
+		sock_set_flag(sk, SOCK_RX_DEFER);
 		sk_nulls_add_node_rcu(sk, &hslot->head);
 		hslot->count++;
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
@@ -445,6 +504,11 @@ begin:
 			if (reuseport) {
 				hash = udp_ehashfn(net, daddr, hnum,
 						   saddr, sport);
+				/* All the chain is of the same address */
+				result = reuseport_select_sock(sk, hash);
+				if (result)
+					goto found;
+				result = sk;
 				matches = 1;
 			}
 		} else if (score == badness && reuseport) {
@@ -461,6 +525,7 @@ begin:
 	 */
 	if (get_nulls_value(node) != slot2)
 		goto begin;
+found:
 	if (result) {
 		if (unlikely(!atomic_inc_not_zero_hint(&result->sk_refcnt, 2)))
 			result = NULL;
@@ -526,6 +591,16 @@ begin:
 			if (reuseport) {
 				hash = udp_ehashfn(net, daddr, hnum,
 						   saddr, sport);
+				/*
+				 * The group stands for the rest of its members
+				 * but a better match may still follow.
+				 */
+				result = reuseport_select_sock(sk, hash);
+				if (result) {
+					reuseport = 0;
+					continue;
+				}
+				result = sk;
 				matches = 1;
 			}
 		} else if (score == badness && reuseport) {
@@ -1380,6 +1455,7 @@ void udp_lib_unhash(struct sock *sk)
 		hslot2 = udp_hashslot2(udptable, udp_sk(sk)->udp_portaddr_hash);
 
 		spin_lock_bh(&hslot->lock);
+		reuseport_detach_sock(sk);
 		if (sk_nulls_del_node_init_rcu(sk)) {
 			hslot->count--;
 			inet_sk(sk)->inet_num = 0;
@@ -1407,22 +1483,27 @@ void udp_lib_rehash(struct sock *sk, u16 newhash)
 		hslot2 = udp_hashslot2(udptable, udp_sk(sk)->udp_portaddr_hash);
 		nhslot2 = udp_hashslot2(udptable, newhash);
 		udp_sk(sk)->udp_portaddr_hash = newhash;
-		if (hslot2 != nhslot2) {
+		if (hslot2 != nhslot2 ||
+		    rcu_access_pointer(sk->sk_reuseport_cb)) {
 			hslot = udp_hashslot(udptable, sock_net(sk),
 					     udp_sk(sk)->udp_port_hash);
 			/* we must lock primary chain too */
 			spin_lock_bh(&hslot->lock);
-
-			spin_lock(&hslot2->lock);
-			hlist_nulls_del_init_rcu(&udp_sk(sk)->udp_portaddr_node);
-			hslot2->count--;
-			spin_unlock(&hslot2->lock);
-
-			spin_lock(&nhslot2->lock);
-			hlist_nulls_add_head_rcu(&udp_sk(sk)->udp_portaddr_node,
-						 &nhslot2->head);
-			nhslot2->count++;
-			spin_unlock(&nhslot2->lock);
+			/* The group members are of the old address */
+			reuseport_detach_sock(sk);
+
+			if (hslot2 != nhslot2) {
+				spin_lock(&hslot2->lock);
+				hlist_nulls_del_init_rcu(&udp_sk(sk)->udp_portaddr_node);
+				hslot2->count--;
+				spin_unlock(&hslot2->lock);
+
+				spin_lock(&nhslot2->lock);
+				hlist_nulls_add_head_rcu(&udp_sk(sk)->udp_portaddr_node,
+							 &nhslot2->head);
+				nhslot2->count++;
+				spin_unlock(&nhslot2->lock);
+			}
 
 			spin_unlock_bh(&hslot->lock);
 		}
@@ -1577,14 +1658,27 @@ int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 	rc = 0;
 
 	ipv4_pktinfo_prepare(sk, skb);
-	bh_lock_sock(sk);
+	/*
+	 * Don't spin on the socket lock if it is busy, with many flows to
+	 * the one socket: its holder is going to receive the skb.
+	 */
+	if (!spin_trylock(&sk->sk_lock.slock)) {
+		if (sk_defer_rcv_skb(sk, skb, sk->sk_rcvbuf))
+			goto drop;
+		sk_rx_defer_flush(sk);
+		return 0;
+	}
+	if (sk->sk_rx_defer.head)
+		__sk_rx_defer_flush(sk);
 	if (!sock_owned_by_user(sk))
 		rc = __udp_queue_rcv_skb(sk, skb);
 	else if (sk_add_backlog(sk, skb, sk->sk_rcvbuf)) {
 		bh_unlock_sock(sk);
+		sk_rx_defer_flush(sk);
 		goto drop;
 	}
 	bh_unlock_sock(sk);
+	sk_rx_defer_flush(sk);
 
 	return rc;
 
@@ -31,6 +31,7 @@
 #include <net/ip6_route.h>
 #include <net/tcp_states.h>
 #include <net/dsfield.h>
+#include <net/sock_reuseport.h>
 
 #include <linux/errqueue.h>
 #include <asm/uaccess.h>
@@ -148,6 +149,7 @@ ipv4_connected:
 	np->flow_label = fl6.flowlabel;
 
 	inet->inet_dport = usin->sin6_port;
+	reuseport_set_conns(sk);
 
 	/*
 	 *	Check for a route to destination an obtain the
@@ -78,7 +78,7 @@ int __inet6_hash(struct sock *sk, struct inet_timewait_sock *tw)
 		sk->sk_hash = hash = inet6_sk_ehashfn(sk);
 		list = &inet_ehash_bucket(hashinfo, hash)->chain;
 		lock = inet_ehash_lockp(hashinfo, hash);
-		spin_lock(lock);
+		inet_ehash_lock(hashinfo, lock);
 		__sk_nulls_add_node_rcu(sk, list);
 		if (tw) {
 			WARN_ON(sk->sk_hash != tw->tw_hash);
@@ -259,7 +259,7 @@ static int __inet6_check_established(struct inet_timewait_death_row *death_row,
 	struct inet_timewait_sock *tw = NULL;
 	int twrefcnt = 0;
 
-	spin_lock(lock);
+	inet_ehash_lock(hinfo, lock);
 
 	sk_nulls_for_each(sk2, node, &head->chain) {
 		if (sk2->sk_hash != hash)
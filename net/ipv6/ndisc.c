@@ -678,11 +678,11 @@ static int pndisc_is_router(const void *pkey,
 	struct pneigh_entry *n;
 	int ret = -1;
 
-	read_lock_bh(&nd_tbl.lock);
+	rcu_read_lock_bh();
 	n = __pneigh_lookup(&nd_tbl, dev_net(dev), pkey, dev);
 	if (n)
 		ret = !!(n->flags & NTF_ROUTER);
-	read_unlock_bh(&nd_tbl.lock);
+	rcu_read_unlock_bh();
 
 	return ret;
 }
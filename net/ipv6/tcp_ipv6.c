@@ -1026,6 +1026,46 @@ static struct sock *tcp_v6_hnd_req(struct sock *sk, struct sk_buff *skb)
 	return sk;
 }
 
+/* The SYNs that open a new connection skip the listener lock, as in
+ * tcp_v4_syn_rcv().
+ */
+static bool tcp_v6_syn_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	const struct tcphdr *th = tcp_hdr(skb);
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct request_sock **prev;
+	struct sock *nsk;
+
+	read_lock(&queue->syn_wait_lock);
+	if (!tcp_syn_unlocked(sk, skb))
+		goto out;
+	if (skb->len < tcp_hdrlen(skb) || tcp_checksum_complete(skb))
+		goto out;
+	if (inet6_csk_search_req(sk, &prev, th->source,
+				 &ipv6_hdr(skb)->saddr,
+				 &ipv6_hdr(skb)->daddr, tcp_v6_iif(skb)))
+		goto out;
+	nsk = __inet6_lookup_established(sock_net(sk), &tcp_hashinfo,
+					 &ipv6_hdr(skb)->saddr, th->source,
+					 &ipv6_hdr(skb)->daddr, ntohs(th->dest),
+					 tcp_v6_iif(skb));
+	if (nsk) {
+		sock_gen_put(nsk);
+		goto out;
+	}
+
+	TCP_SKB_CB(skb)->syn_unlocked = 1;
+	if (inet_csk(sk)->icsk_af_ops->conn_request(sk, skb) < 0)
+		tcp_v6_send_reset(sk, skb);
+	read_unlock(&queue->syn_wait_lock);
+	kfree_skb(skb);
+	return true;
+
+out:
+	read_unlock(&queue->syn_wait_lock);
+	return false;
+}
+
 static int tcp_v6_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	if (skb->protocol == htons(ETH_P_IP))
@@ -1428,6 +1468,7 @@ static int tcp_v6_rcv(struct sk_buff *skb)
 	TCP_SKB_CB(skb)->tcp_tw_isn = 0;
 	TCP_SKB_CB(skb)->ip_dsfield = ipv6_get_dsfield(hdr);
 	TCP_SKB_CB(skb)->sacked = 0;
+	TCP_SKB_CB(skb)->syn_unlocked = 0;
 
 	sk = __inet6_lookup_skb(&tcp_hashinfo, skb, th->source, th->dest,
 				tcp_v6_iif(skb));
@@ -1457,6 +1498,11 @@ process:
 	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
+	if (sk->sk_state == TCP_LISTEN && tcp_v6_syn_rcv(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
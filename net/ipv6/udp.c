@@ -47,6 +47,7 @@
 #include <net/xfrm.h>
 #include <net/inet6_hashtables.h>
 #include <net/busy_poll.h>
+#include <net/sock_reuseport.h>
 
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
@@ -238,6 +239,11 @@ begin:
 			if (reuseport) {
 				hash = udp6_ehashfn(net, daddr, hnum,
 						    saddr, sport);
+				/* All the chain is of the same address */
+				result = reuseport_select_sock(sk, hash);
+				if (result)
+					goto exact_match;
+				result = sk;
 				matches = 1;
 			} else if (score == SCORE2_MAX)
 				goto exact_match;
@@ -319,6 +325,16 @@ begin:
 			if (reuseport) {
 				hash = udp6_ehashfn(net, daddr, hnum,
 						    saddr, sport);
+				/*
+				 * The group stands for the rest of its members
+				 * but a better match may still follow.
+				 */
+				result = reuseport_select_sock(sk, hash);
+				if (result) {
+					reuseport = 0;
+					continue;
+				}
+				result = sk;
 				matches = 1;
 			}
 		} else if (score == badness && reuseport) {
@@ -685,15 +701,25 @@ int udpv6_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	skb_dst_drop(skb);
 
-	bh_lock_sock(sk);
 	rc = 0;
+	/* Don't spin on a busy socket lock, see udp_queue_rcv_skb() */
+	if (!spin_trylock(&sk->sk_lock.slock)) {
+		if (sk_defer_rcv_skb(sk, skb, sk->sk_rcvbuf))
+			goto drop;
+		sk_rx_defer_flush(sk);
+		return 0;
+	}
+	if (sk->sk_rx_defer.head)
+		__sk_rx_defer_flush(sk);
 	if (!sock_owned_by_user(sk))
 		rc = __udpv6_queue_rcv_skb(sk, skb);
 	else if (sk_add_backlog(sk, skb, sk->sk_rcvbuf)) {
 		bh_unlock_sock(sk);
+		sk_rx_defer_flush(sk);
 		goto drop;
 	}
 	bh_unlock_sock(sk);
+	sk_rx_defer_flush(sk);
 
 	return rc;
 
@@ -60,16 +60,44 @@ int (*nfnetlink_parse_nat_setup_hook)(struct nf_conn *ct,
 				      const struct nlattr *attr) __read_mostly;
 EXPORT_SYMBOL_GPL(nfnetlink_parse_nat_setup_hook);
 
-__cacheline_aligned_in_smp spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
+/*
+ * The hash buckets are striped over nf_conntrack_locks, which serialize
+ * the insertions into and the removals from their buckets. The lookups
+ * don't take them: ____nf_conntrack_find() walks the hash chain under RCU
+ * and restarts if the nulls value at its end shows that it followed an
+ * entry moved to another chain. A lookup racing with a resize of the
+ * table may miss an entry, but the conntrack created for that false
+ * negative doesn't get inserted, as __nf_conntrack_confirm() checks the
+ * bucket again under the locks and the resize generation count. The
+ * number of stripes thus only matters to the insertions and removals.
+ *
+ * There are CONNTRACK_LOCKS_PER_CPU of them per possible CPU, at least
+ * CONNTRACK_LOCKS_MIN and at most CONNTRACK_LOCKS_MAX, unless set with
+ * the "locks" module parameter. nf_conntrack_all_lock() takes them all
+ * with a lockdep subclass each, so there are only 8 with lockdep.
+ */
+#define CONNTRACK_LOCKS_PER_CPU	64
+#define CONNTRACK_LOCKS_MIN	1024
+#define CONNTRACK_LOCKS_MAX	(1U << 16)
+#define CONNTRACK_LOCKS_LOCKDEP	8
+
+spinlock_t *nf_conntrack_locks __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_locks);
 
+unsigned int nf_conntrack_locks_mask __read_mostly;
+EXPORT_SYMBOL_GPL(nf_conntrack_locks_mask);
+
+static unsigned int nf_conntrack_nr_locks __read_mostly;
+module_param_named(locks, nf_conntrack_nr_locks, uint, 0444);
+MODULE_PARM_DESC(locks, "number of conntrack hash stripe locks");
+
 __cacheline_aligned_in_smp DEFINE_SPINLOCK(nf_conntrack_expect_lock);
 EXPORT_SYMBOL_GPL(nf_conntrack_expect_lock);
 
 static void nf_conntrack_double_unlock(unsigned int h1, unsigned int h2)
 {
-	h1 %= CONNTRACK_LOCKS;
-	h2 %= CONNTRACK_LOCKS;
+	h1 &= nf_conntrack_locks_mask;
+	h2 &= nf_conntrack_locks_mask;
 	spin_unlock(&nf_conntrack_locks[h1]);
 	if (h1 != h2)
 		spin_unlock(&nf_conntrack_locks[h2]);
@@ -79,8 +107,8 @@ static void nf_conntrack_double_unlock(unsigned int h1, unsigned int h2)
 static bool nf_conntrack_double_lock(struct net *net, unsigned int h1,
 				     unsigned int h2, unsigned int sequence)
 {
-	h1 %= CONNTRACK_LOCKS;
-	h2 %= CONNTRACK_LOCKS;
+	h1 &= nf_conntrack_locks_mask;
+	h2 &= nf_conntrack_locks_mask;
 	if (h1 <= h2) {
 		spin_lock(&nf_conntrack_locks[h1]);
 		if (h1 != h2)
@@ -102,7 +130,7 @@ static void nf_conntrack_all_lock(void)
 {
 	int i;
 
-	for (i = 0; i < CONNTRACK_LOCKS; i++)
+	for (i = 0; i < nf_conntrack_nr_locks; i++)
 		spin_lock_nested(&nf_conntrack_locks[i], i);
 }
 
@@ -110,7 +138,7 @@ static void nf_conntrack_all_unlock(void)
 {
 	int i;
 
-	for (i = 0; i < CONNTRACK_LOCKS; i++)
+	for (i = 0; i < nf_conntrack_nr_locks; i++)
 		spin_unlock(&nf_conntrack_locks[i]);
 }
 
@@ -734,7 +762,7 @@ restart:
 	sequence = read_seqcount_begin(&net->ct.generation);
 	hash = hash_bucket(_hash, net);
 	for (; i < net->ct.htable_size; i++) {
-		lockp = &nf_conntrack_locks[hash % CONNTRACK_LOCKS];
+		lockp = nf_conntrack_lockp(hash);
 		spin_lock(lockp);
 		if (read_seqcount_retry(&net->ct.generation, sequence)) {
 			spin_unlock(lockp);
@@ -1360,7 +1388,7 @@ get_next_corpse(struct net *net, int (*iter)(struct nf_conn *i, void *data),
 	spinlock_t *lockp;
 
 	for (; *bucket < net->ct.htable_size; (*bucket)++) {
-		lockp = &nf_conntrack_locks[*bucket % CONNTRACK_LOCKS];
+		lockp = nf_conntrack_lockp(*bucket);
 		local_bh_disable();
 		spin_lock(lockp);
 		if (*bucket < net->ct.htable_size) {
@@ -1470,6 +1498,7 @@ void nf_conntrack_cleanup_end(void)
 	nf_conntrack_tstamp_fini();
 	nf_conntrack_acct_fini();
 	nf_conntrack_expect_fini();
+	kvfree(nf_conntrack_locks);
 }
 
 /*
@@ -1619,13 +1648,40 @@ void nf_ct_untracked_status_or(unsigned long bits)
 }
 EXPORT_SYMBOL_GPL(nf_ct_untracked_status_or);
 
+static int nf_conntrack_locks_init(void)
+{
+	unsigned int i, n = nf_conntrack_nr_locks;
+
+#ifdef CONFIG_LOCKDEP
+	n = CONNTRACK_LOCKS_LOCKDEP;
+#else
+	if (!n)
+		n = max_t(unsigned int, CONNTRACK_LOCKS_MIN,
+			  CONNTRACK_LOCKS_PER_CPU * num_possible_cpus());
+	n = roundup_pow_of_two(min(n, CONNTRACK_LOCKS_MAX));
+#endif
+	nf_conntrack_locks = kmalloc_array(n, sizeof(spinlock_t),
+					   GFP_KERNEL | __GFP_NOWARN);
+	if (!nf_conntrack_locks)
+		nf_conntrack_locks = vmalloc(n * sizeof(spinlock_t));
+	if (!nf_conntrack_locks)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++)
+		spin_lock_init(&nf_conntrack_locks[i]);
+	nf_conntrack_nr_locks = n;
+	nf_conntrack_locks_mask = n - 1;
+	return 0;
+}
+
 int nf_conntrack_init_start(void)
 {
 	int max_factor = 8;
-	int i, ret, cpu;
+	int ret, cpu;
 
-	for (i = 0; i < CONNTRACK_LOCKS; i++)
-		spin_lock_init(&nf_conntrack_locks[i]);
+	ret = nf_conntrack_locks_init();
+	if (ret < 0)
+		return ret;
 
 	/* Idea from tcp.c: use 1/16384 of memory.  On i386: 32MB
 	 * machine has 512 buckets. >= 1GB machines have 16384 buckets. */
@@ -1646,9 +1702,9 @@ int nf_conntrack_init_start(void)
 	}
 	nf_conntrack_max = max_factor * nf_conntrack_htable_size;
 
-	printk(KERN_INFO "nf_conntrack version %s (%u buckets, %d max)\n",
+	printk(KERN_INFO "nf_conntrack version %s (%u buckets, %d max, %u locks)\n",
 	       NF_CONNTRACK_VERSION, nf_conntrack_htable_size,
-	       nf_conntrack_max);
+	       nf_conntrack_max, nf_conntrack_nr_locks);
 
 	ret = nf_conntrack_expect_init();
 	if (ret < 0)
@@ -1722,6 +1778,7 @@ err_tstamp:
 err_acct:
 	nf_conntrack_expect_fini();
 err_expect:
+	kvfree(nf_conntrack_locks);
 	return ret;
 }
 
@@ -777,7 +777,7 @@ ctnetlink_dump_table(struct sk_buff *skb, struct netlink_callback *cb)
 	local_bh_disable();
 	for (; cb->args[0] < net->ct.htable_size; cb->args[0]++) {
 restart:
-		lockp = &nf_conntrack_locks[cb->args[0] % CONNTRACK_LOCKS];
+		lockp = nf_conntrack_lockp(cb->args[0]);
 		spin_lock(lockp);
 		if (cb->args[0] >= net->ct.htable_size) {
 			spin_unlock(lockp);
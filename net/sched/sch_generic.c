@@ -228,12 +228,49 @@ static inline int qdisc_restart(struct Qdisc *q, int *packets)
 	return sch_direct_xmit(skb, q, dev, txq, root_lock, validate);
 }
 
+/*
+ * Enqueue the skbs deferred by the senders that found the qdisc running,
+ * in the order they came. Called with the root lock held.
+ */
+void qdisc_enqueue_deferred(struct Qdisc *q)
+{
+	struct sk_buff *skb, *next, *list = NULL;
+
+	if (likely(!ACCESS_ONCE(q->defer_list)))
+		return;
+
+	for (skb = xchg(&q->defer_list, NULL); skb; skb = next) {
+		next = skb->next;
+		skb->next = list;
+		list = skb;
+	}
+
+	for (skb = list; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state)))
+			kfree_skb(skb);
+		else
+			q->enqueue(skb, q);
+	}
+}
+
 void __qdisc_run(struct Qdisc *q)
 {
 	int quota = weight_p;
 	int packets;
 
-	while (qdisc_restart(q, &packets)) {
+	for (;;) {
+		qdisc_enqueue_deferred(q);
+		if (!qdisc_restart(q, &packets)) {
+			qdisc_run_end(q);
+			/* Pairs with the cmpxchg() in qdisc_defer_skb() */
+			smp_mb();
+			if (likely(!ACCESS_ONCE(q->defer_list)) ||
+			    !qdisc_run_begin(q))
+				return;
+			continue;
+		}
 		/*
 		 * Ordered by possible occurrence: Postpone processing if
 		 * 1. we've exceeded packet quota
@@ -659,6 +696,7 @@ void qdisc_reset(struct Qdisc *qdisc)
 		qdisc->gso_skb = NULL;
 		qdisc->q.qlen = 0;
 	}
+	kfree_skb_list(xchg(&qdisc->defer_list, NULL));
 }
 EXPORT_SYMBOL(qdisc_reset);
 
@@ -695,6 +733,7 @@ void qdisc_destroy(struct Qdisc *qdisc)
 	dev_put(qdisc_dev(qdisc));
 
 	kfree_skb_list(qdisc->gso_skb);
+	kfree_skb_list(qdisc->defer_list);
 	/*
 	 * gen_estimator est_timer() might access qdisc->q.lock,
 	 * wait a RCU grace period before freeing qdisc.
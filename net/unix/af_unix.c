@@ -118,21 +118,21 @@
 #include <linux/security.h>
 #include <linux/freezer.h>
 
-struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
+struct hlist_nulls_head unix_socket_table[2 * UNIX_HASH_SIZE];
 EXPORT_SYMBOL_GPL(unix_socket_table);
-DEFINE_SPINLOCK(unix_table_lock);
-EXPORT_SYMBOL_GPL(unix_table_lock);
+spinlock_t unix_table_locks[2 * UNIX_HASH_SIZE];
+EXPORT_SYMBOL_GPL(unix_table_locks);
 static atomic_long_t unix_nr_socks;
 
 
-static struct hlist_head *unix_sockets_unbound(void *addr)
+static unsigned int unix_unbound_slot(void *addr)
 {
 	unsigned long hash = (unsigned long)addr;
 
 	hash ^= hash >> 16;
 	hash ^= hash >> 8;
 	hash %= UNIX_HASH_SIZE;
-	return &unix_socket_table[UNIX_HASH_SIZE + hash];
+	return UNIX_HASH_SIZE + hash;
 }
 
 #define UNIX_ABSTRACT(sk)	(unix_sk(sk)->addr->hash < UNIX_HASH_SIZE)
@@ -157,7 +157,12 @@ static inline void unix_set_secdata(struct scm_cookie *scm, struct sk_buff *skb)
 
 /*
  *  SMP locking strategy:
- *    hash table is protected with spinlock unix_table_lock
+ *    each hash table slot is protected by its spinlock in unix_table_locks,
+ *    a socket moving to another slot at bind time takes the locks of both.
+ *    The lookups of bound sockets by name or inode walk the slot under RCU:
+ *    the sockets are SLAB_DESTROY_BY_RCU, a socket found is referenced and
+ *    checked again, and the walk is restarted if it ended up in another
+ *    slot. The addresses are freed after a grace period.
  *    each socket state is protected by separate spin lock.
  */
 
@@ -202,7 +207,7 @@ EXPORT_SYMBOL_GPL(unix_peer_get);
 static inline void unix_release_addr(struct unix_address *addr)
 {
 	if (atomic_dec_and_test(&addr->refcnt))
-		kfree(addr);
+		kfree_rcu(addr, rcu);
 }
 
 /*
@@ -237,82 +242,132 @@ static int unix_mkname(struct sockaddr_un *sunaddr, int len, unsigned int *hashp
 
 static void __unix_remove_socket(struct sock *sk)
 {
-	sk_del_node_init(sk);
+	sk_nulls_del_node_init_rcu(sk);
 }
 
-static void __unix_insert_socket(struct hlist_head *list, struct sock *sk)
+static void __unix_insert_socket(unsigned int slot, struct sock *sk)
 {
 	WARN_ON(!sk_unhashed(sk));
-	sk_add_node(sk, list);
+	unix_sk(sk)->slot = slot;
+	sk_nulls_add_node_rcu(sk, &unix_socket_table[slot]);
 }
 
 static inline void unix_remove_socket(struct sock *sk)
 {
-	spin_lock(&unix_table_lock);
+	spinlock_t *lock = &unix_table_locks[unix_sk(sk)->slot];
+
+	spin_lock(lock);
 	__unix_remove_socket(sk);
-	spin_unlock(&unix_table_lock);
+	spin_unlock(lock);
+}
+
+static inline void unix_insert_socket(unsigned int slot, struct sock *sk)
+{
+	spin_lock(&unix_table_locks[slot]);
+	__unix_insert_socket(slot, sk);
+	spin_unlock(&unix_table_locks[slot]);
 }
 
-static inline void unix_insert_socket(struct hlist_head *list, struct sock *sk)
+/* Lock the slots a socket moves between, in slot order */
+static void unix_table_double_lock(unsigned int slot1, unsigned int slot2)
 {
-	spin_lock(&unix_table_lock);
-	__unix_insert_socket(list, sk);
-	spin_unlock(&unix_table_lock);
+	if (slot1 > slot2)
+		swap(slot1, slot2);
+	spin_lock(&unix_table_locks[slot1]);
+	spin_lock_nested(&unix_table_locks[slot2], SINGLE_DEPTH_NESTING);
+}
+
+static void unix_table_double_unlock(unsigned int slot1, unsigned int slot2)
+{
+	spin_unlock(&unix_table_locks[slot1]);
+	spin_unlock(&unix_table_locks[slot2]);
+}
+
+static bool unix_match_name(struct sock *s, struct net *net,
+			    struct sockaddr_un *sunname, int len)
+{
+	struct unix_address *addr = ACCESS_ONCE(unix_sk(s)->addr);
+
+	return net_eq(sock_net(s), net) && addr && addr->len == len &&
+	       !memcmp(addr->name, sunname, len);
 }
 
+/* Called with the lock of the slot hash ^ type */
 static struct sock *__unix_find_socket_byname(struct net *net,
 					      struct sockaddr_un *sunname,
 					      int len, int type, unsigned int hash)
 {
+	struct hlist_nulls_node *node;
 	struct sock *s;
 
-	sk_for_each(s, &unix_socket_table[hash ^ type]) {
-		struct unix_sock *u = unix_sk(s);
+	sk_nulls_for_each(s, node, &unix_socket_table[hash ^ type]) {
+		if (unix_match_name(s, net, sunname, len))
+			return s;
+	}
+	return NULL;
+}
 
-		if (!net_eq(sock_net(s), net))
-			continue;
+static struct sock *unix_find_socket_byname(struct net *net,
+					    struct sockaddr_un *sunname,
+					    int len, int type, unsigned int hash)
+{
+	unsigned int slot = hash ^ type;
+	struct hlist_nulls_node *node;
+	struct sock *s;
 
-		if (u->addr->len == len &&
-		    !memcmp(u->addr->name, sunname, len))
-			goto found;
+	rcu_read_lock();
+begin:
+	sk_nulls_for_each_rcu(s, node, &unix_socket_table[slot]) {
+		if (!unix_match_name(s, net, sunname, len))
+			continue;
+		if (unlikely(!atomic_inc_not_zero(&s->sk_refcnt)))
+			goto begin;
+		/* The socket may have been freed and reused meanwhile */
+		if (unlikely(!unix_match_name(s, net, sunname, len))) {
+			sock_put(s);
+			goto begin;
+		}
+		goto found;
 	}
+	if (get_nulls_value(node) != slot)
+		goto begin;
 	s = NULL;
 found:
+	rcu_read_unlock();
 	return s;
 }
 
-static inline struct sock *unix_find_socket_byname(struct net *net,
-						   struct sockaddr_un *sunname,
-						   int len, int type,
-						   unsigned int hash)
+static bool unix_match_inode(struct sock *s, struct inode *i)
 {
-	struct sock *s;
+	struct dentry *dentry = ACCESS_ONCE(unix_sk(s)->path.dentry);
 
-	spin_lock(&unix_table_lock);
-	s = __unix_find_socket_byname(net, sunname, len, type, hash);
-	if (s)
-		sock_hold(s);
-	spin_unlock(&unix_table_lock);
-	return s;
+	return dentry && ACCESS_ONCE(dentry->d_inode) == i;
 }
 
 static struct sock *unix_find_socket_byinode(struct inode *i)
 {
+	unsigned int slot = i->i_ino & (UNIX_HASH_SIZE - 1);
+	struct hlist_nulls_node *node;
 	struct sock *s;
 
-	spin_lock(&unix_table_lock);
-	sk_for_each(s,
-		    &unix_socket_table[i->i_ino & (UNIX_HASH_SIZE - 1)]) {
-		struct dentry *dentry = unix_sk(s)->path.dentry;
-
-		if (dentry && dentry->d_inode == i) {
-			sock_hold(s);
-			goto found;
+	rcu_read_lock();
+begin:
+	sk_nulls_for_each_rcu(s, node, &unix_socket_table[slot]) {
+		if (!unix_match_inode(s, i))
+			continue;
+		if (unlikely(!atomic_inc_not_zero(&s->sk_refcnt)))
+			goto begin;
+		if (unlikely(!unix_match_inode(s, i))) {
+			sock_put(s);
+			goto begin;
 		}
+		goto found;
 	}
+	if (get_nulls_value(node) != slot)
+		goto begin;
 	s = NULL;
 found:
-	spin_unlock(&unix_table_lock);
+	rcu_read_unlock();
 	return s;
 }
 
@@ -615,6 +670,7 @@ static struct proto unix_proto = {
 	.name			= "UNIX",
 	.owner			= THIS_MODULE,
 	.obj_size		= sizeof(struct unix_sock),
+	.slab_flags		= SLAB_DESTROY_BY_RCU,
 };
 
 /*
@@ -653,7 +709,7 @@ static struct sock *unix_create1(struct net *net, struct socket *sock)
 	INIT_LIST_HEAD(&u->link);
 	mutex_init(&u->readlock); /* single task reading lock */
 	init_waitqueue_head(&u->peer_wait);
-	unix_insert_socket(unix_sockets_unbound(sk), sk);
+	unix_insert_socket(unix_unbound_slot(sk), sk);
 out:
 	if (sk == NULL)
 		atomic_long_dec(&unix_nr_socks);
@@ -716,6 +772,7 @@ static int unix_autobind(struct socket *sock)
 	struct unix_sock *u = unix_sk(sk);
 	static u32 ordernum = 1;
 	struct unix_address *addr;
+	unsigned int slot, old_slot;
 	int err;
 	unsigned int retries = 0;
 
@@ -738,13 +795,14 @@ static int unix_autobind(struct socket *sock)
 retry:
 	addr->len = sprintf(addr->name->sun_path+1, "%05x", ordernum) + 1 + sizeof(short);
 	addr->hash = unix_hash_fold(csum_partial(addr->name, addr->len, 0));
+	slot = addr->hash ^ sk->sk_type;
 
-	spin_lock(&unix_table_lock);
+	unix_table_double_lock(u->slot, slot);
 	ordernum = (ordernum+1)&0xFFFFF;
 
 	if (__unix_find_socket_byname(net, addr->name, addr->len, sock->type,
 				      addr->hash)) {
-		spin_unlock(&unix_table_lock);
+		unix_table_double_unlock(u->slot, slot);
 		/*
 		 * __unix_find_socket_byname() may take long time if many names
 		 * are already in use.
@@ -760,10 +818,11 @@ retry:
 	}
 	addr->hash ^= sk->sk_type;
 
+	old_slot = u->slot;
 	__unix_remove_socket(sk);
 	u->addr = addr;
-	__unix_insert_socket(&unix_socket_table[addr->hash], sk);
-	spin_unlock(&unix_table_lock);
+	__unix_insert_socket(slot, sk);
+	unix_table_double_unlock(old_slot, slot);
 	err = 0;
 
 out:	mutex_unlock(&u->readlock);
@@ -862,9 +921,8 @@ static int unix_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 	struct sockaddr_un *sunaddr = (struct sockaddr_un *)uaddr;
 	char *sun_path = sunaddr->sun_path;
 	int err;
-	unsigned int hash;
+	unsigned int hash, slot, old_slot;
 	struct unix_address *addr;
-	struct hlist_head *list;
 
 	err = -EINVAL;
 	if (sunaddr->sun_family != AF_UNIX)
@@ -887,6 +945,8 @@ static int unix_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 	err = -EINVAL;
 	if (u->addr)
 		goto out_up;
+	/* An unbound socket, its slot is stable under u->readlock */
+	old_slot = u->slot;
 
 	err = -ENOMEM;
 	addr = kmalloc(sizeof(*addr)+addr_len, GFP_KERNEL);
@@ -910,29 +970,27 @@ static int unix_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 			goto out_up;
 		}
 		addr->hash = UNIX_HASH_SIZE;
-		hash = path.dentry->d_inode->i_ino & (UNIX_HASH_SIZE-1);
-		spin_lock(&unix_table_lock);
+		slot = path.dentry->d_inode->i_ino & (UNIX_HASH_SIZE-1);
+		unix_table_double_lock(old_slot, slot);
 		u->path = path;
-		list = &unix_socket_table[hash];
 	} else {
-		spin_lock(&unix_table_lock);
+		slot = addr->hash;
+		unix_table_double_lock(old_slot, slot);
 		err = -EADDRINUSE;
 		if (__unix_find_socket_byname(net, sunaddr, addr_len,
 					      sk->sk_type, hash)) {
 			unix_release_addr(addr);
 			goto out_unlock;
 		}
-
-		list = &unix_socket_table[addr->hash];
 	}
 
 	err = 0;
 	__unix_remove_socket(sk);
 	u->addr = addr;
-	__unix_insert_socket(list, sk);
+	__unix_insert_socket(slot, sk);
 
 out_unlock:
-	spin_unlock(&unix_table_lock);
+	unix_table_double_unlock(old_slot, slot);
 out_up:
 	mutex_unlock(&u->readlock);
 out:
@@ -2273,6 +2331,7 @@ static unsigned int unix_dgram_poll(struct file *file, struct socket *sock,
 #define get_offset(x) ((x) & ((1L << BUCKET_SPACE) - 1))
 #define set_bucket_offset(b, o) ((b) << BUCKET_SPACE | (o))
 
+/* Return with the lock of the bucket held if a socket was found */
 static struct sock *unix_from_bucket(struct seq_file *seq, loff_t *pos)
 {
 	unsigned long offset = get_offset(*pos);
@@ -2280,14 +2339,17 @@ static struct sock *unix_from_bucket(struct seq_file *seq, loff_t *pos)
 	struct sock *sk;
 	unsigned long count = 0;
 
-	for (sk = sk_head(&unix_socket_table[bucket]); sk; sk = sk_next(sk)) {
+	spin_lock(&unix_table_locks[bucket]);
+	for (sk = sk_nulls_head(&unix_socket_table[bucket]); sk;
+	     sk = sk_nulls_next(sk)) {
 		if (sock_net(sk) != seq_file_net(seq))
 			continue;
 		if (++count == offset)
-			break;
+			return sk;
 	}
+	spin_unlock(&unix_table_locks[bucket]);
 
-	return sk;
+	return NULL;
 }
 
 static struct sock *unix_next_socket(struct seq_file *seq,
@@ -2297,9 +2359,13 @@ static struct sock *unix_next_socket(struct seq_file *seq,
 	unsigned long bucket;
 
 	while (sk > (struct sock *)SEQ_START_TOKEN) {
-		sk = sk_next(sk);
-		if (!sk)
+		struct sock *next = sk_nulls_next(sk);
+
+		if (!next) {
+			spin_unlock(&unix_table_locks[unix_sk(sk)->slot]);
 			goto next_bucket;
+		}
+		sk = next;
 		if (sock_net(sk) == seq_file_net(seq))
 			return sk;
 	}
@@ -2318,10 +2384,7 @@ next_bucket:
 }
 
 static void *unix_seq_start(struct seq_file *seq, loff_t *pos)
-	__acquires(unix_table_lock)
 {
-	spin_lock(&unix_table_lock);
-
 	if (!*pos)
 		return SEQ_START_TOKEN;
 
@@ -2338,9 +2401,11 @@ static void *unix_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 }
 
 static void unix_seq_stop(struct seq_file *seq, void *v)
-	__releases(unix_table_lock)
 {
-	spin_unlock(&unix_table_lock);
+	struct sock *sk = v;
+
+	if (sk && sk != SEQ_START_TOKEN)
+		spin_unlock(&unix_table_locks[unix_sk(sk)->slot]);
 }
 
 static int unix_seq_show(struct seq_file *seq, void *v)
@@ -2449,10 +2514,15 @@ static struct pernet_operations unix_net_ops = {
 
 static int __init af_unix_init(void)
 {
-	int rc = -1;
+	int rc = -1, i;
 
 	BUILD_BUG_ON(sizeof(struct unix_skb_parms) > FIELD_SIZEOF(struct sk_buff, cb));
 
+	for (i = 0; i < ARRAY_SIZE(unix_socket_table); i++) {
+		INIT_HLIST_NULLS_HEAD(&unix_socket_table[i], i);
+		spin_lock_init(&unix_table_locks[i]);
+	}
+
 	rc = proto_register(&unix_proto, 1);
 	if (rc != 0) {
 		pr_crit("%s: Cannot create unix_sock SLAB cache!\n", __func__);
@@ -0,0 +1,313 @@
+/*
+ * Aggregate the queue spinlock slowpath wait times in the kernel.
+ *
+ * The probes attached to the qspinlock_slowpath and qspinlock_acquired
+ * tracepoints time each slowpath acquisition and account it in per-cpu
+ * tables hashed on the lock address and the call site, with a log2
+ * histogram of the wait times. Only the aggregated tables are read from
+ * user space, which is much cheaper than streaming the events through
+ * the trace buffer on a busy machine.
+ *
+ * The call site is the first return address after the lock functions in
+ * a short stack trace taken when the lock is acquired, so the cost of a
+ * probe is a clock read on entry, a short stack walk and a table update.
+ * Pass callers=0 to aggregate on the lock address only, without the walk.
+ *
+ * Usage, as root:
+ *   insmod qspinlock_wait.ko [callers=0]
+ *   cat /sys/kernel/debug/qspinlock_wait
+ *   echo 0 > /sys/kernel/debug/qspinlock_wait	(clears the tables)
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/stacktrace.h>
+#include <linux/hash.h>
+#include <linux/vmalloc.h>
+#include <trace/events/qspinlock.h>
+
+#define WAIT_BITS	8
+#define WAIT_BUCKETS	(1 << WAIT_BITS)
+#define WAIT_HISTO	32	/* Power of 2 ns buckets */
+#define WAIT_NEST	4	/* Task, softirq, hardirq and NMI */
+#define WAIT_STACK	16
+
+struct wait_bucket {
+	void		*lock;
+	unsigned long	caller;
+	unsigned long	nr;
+	u64		total;
+	u64		max;
+	unsigned long	histo[WAIT_HISTO];
+};
+
+struct wait_cpu {
+	struct wait_bucket	bucket[WAIT_BUCKETS];
+	unsigned long		dropped;
+	int			depth;
+	struct {
+		void		*lock;
+		u64		start;
+	} nest[WAIT_NEST];
+};
+
+static DEFINE_PER_CPU(struct wait_cpu, wait_cpu);
+
+static bool callers = true;
+module_param(callers, bool, 0444);
+MODULE_PARM_DESC(callers, "Aggregate per call site as well as per lock");
+
+/*
+ * The slowpath and acquired events of the nested contexts are paired in
+ * LIFO order. The acquisitions by queue_spin_trylock_for() have no
+ * slowpath event, they are ignored as they don't match the top entry.
+ */
+static void probe_slowpath(void *ignore, struct qspinlock *lock, u32 val)
+{
+	struct wait_cpu *wc = this_cpu_ptr(&wait_cpu);
+	int depth = wc->depth;
+
+	if (depth >= WAIT_NEST) {
+		wc->dropped++;
+		return;
+	}
+	/* Claim the entry first, a nested context then uses the next one */
+	wc->depth = depth + 1;
+	barrier();
+	wc->nest[depth].lock  = lock;
+	wc->nest[depth].start = local_clock();
+}
+
+static unsigned long wait_caller(void)
+{
+	unsigned long entries[WAIT_STACK];
+	struct stack_trace trace = {
+		.max_entries	= WAIT_STACK,
+		.entries	= entries,
+	};
+	bool in_lock = false;
+	int i;
+
+	save_stack_trace(&trace);
+	for (i = 0; i < trace.nr_entries; i++) {
+		if (in_lock_functions(entries[i]))
+			in_lock = true;
+		else if (in_lock)
+			return entries[i];
+	}
+	return 0;
+}
+
+static void probe_acquired(void *ignore, struct qspinlock *lock)
+{
+	struct wait_cpu *wc = this_cpu_ptr(&wait_cpu);
+	struct wait_bucket *b;
+	unsigned long caller = 0, flags;
+	int depth = wc->depth;
+	u64 delta;
+
+	if (!depth || wc->nest[depth - 1].lock != lock)
+		return;
+	delta = local_clock() - wc->nest[depth - 1].start;
+	barrier();
+	wc->depth = depth - 1;
+
+	if (callers)
+		caller = wait_caller();
+
+	local_irq_save(flags);
+	b = &wc->bucket[hash_long((unsigned long)lock ^ caller, WAIT_BITS)];
+	if (!b->lock) {
+		b->lock	  = lock;
+		b->caller = caller;
+	} else if (b->lock != lock || b->caller != caller) {
+		wc->dropped++;
+		goto out;
+	}
+	b->nr++;
+	b->total += delta;
+	if (delta > b->max)
+		b->max = delta;
+	b->histo[delta ? min(ilog2(delta), WAIT_HISTO - 1) : 0]++;
+out:
+	local_irq_restore(flags);
+}
+
+struct wait_seq {
+	int			nr;
+	struct wait_bucket	stats[];
+};
+
+static int wait_key_cmp(const void *l, const void *r)
+{
+	const struct wait_bucket *bl = l, *br = r;
+
+	if (bl->lock != br->lock)
+		return bl->lock < br->lock ? -1 : 1;
+	if (bl->caller != br->caller)
+		return bl->caller < br->caller ? -1 : 1;
+	return 0;
+}
+
+static int wait_total_cmp(const void *l, const void *r)
+{
+	const struct wait_bucket *bl = l, *br = r;
+
+	if (bl->total != br->total)
+		return bl->total > br->total ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Gather the used buckets of all the CPUs, merge those of the same lock
+ * and caller, and sort them by the total wait time.
+ */
+static void wait_gather(struct wait_seq *data)
+{
+	struct wait_bucket *s = data->stats;
+	int cpu, i, j, n = 0;
+
+	for_each_possible_cpu(cpu) {
+		struct wait_cpu *wc = per_cpu_ptr(&wait_cpu, cpu);
+
+		for (i = 0; i < WAIT_BUCKETS; i++) {
+			if (ACCESS_ONCE(wc->bucket[i].lock))
+				s[n++] = wc->bucket[i];
+		}
+	}
+
+	sort(s, n, sizeof(*s), wait_key_cmp, NULL);
+	for (i = 1, data->nr = n ? 1 : 0; i < n; i++) {
+		struct wait_bucket *last = &s[data->nr - 1];
+
+		if (wait_key_cmp(last, &s[i])) {
+			s[data->nr++] = s[i];
+			continue;
+		}
+		last->nr    += s[i].nr;
+		last->total += s[i].total;
+		last->max    = max(last->max, s[i].max);
+		for (j = 0; j < WAIT_HISTO; j++)
+			last->histo[j] += s[i].histo[j];
+	}
+	sort(s, data->nr, sizeof(*s), wait_total_cmp, NULL);
+}
+
+static int wait_show(struct seq_file *m, void *v)
+{
+	struct wait_seq *data = m->private;
+	unsigned long dropped = 0;
+	int cpu, i, j;
+
+	for_each_possible_cpu(cpu)
+		dropped += per_cpu(wait_cpu, cpu).dropped;
+	seq_printf(m, "dropped %lu\n", dropped);
+
+	for (i = 0; i < data->nr; i++) {
+		struct wait_bucket *b = &data->stats[i];
+
+		seq_printf(m, "\nlock %pS caller %pS\n", b->lock,
+			   (void *)b->caller);
+		seq_printf(m, "  waits %lu total_ns %llu max_ns %llu\n",
+			   b->nr, b->total, b->max);
+		for (j = 0; j < WAIT_HISTO; j++) {
+			if (b->histo[j])
+				seq_printf(m, "  %12llu ns: %lu\n", 1ULL << j,
+					   b->histo[j]);
+		}
+	}
+	return 0;
+}
+
+static int wait_open(struct inode *inode, struct file *file)
+{
+	struct wait_seq *data;
+	int ret;
+
+	data = vmalloc(sizeof(*data) + sizeof(struct wait_bucket) *
+		       num_possible_cpus() * WAIT_BUCKETS);
+	if (!data)
+		return -ENOMEM;
+
+	wait_gather(data);
+	ret = single_open(file, wait_show, data);
+	if (ret)
+		vfree(data);
+	return ret;
+}
+
+static ssize_t wait_write(struct file *file, const char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct wait_cpu *wc = per_cpu_ptr(&wait_cpu, cpu);
+
+		memset(wc->bucket, 0, sizeof(wc->bucket));
+		wc->dropped = 0;
+	}
+	return count;
+}
+
+static int wait_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq = file->private_data;
+
+	vfree(seq->private);
+	return single_release(inode, file);
+}
+
+static const struct file_operations wait_fops = {
+	.open		= wait_open,
+	.write		= wait_write,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= wait_release,
+};
+
+static struct dentry *wait_file;
+
+static int __init qspinlock_wait_init(void)
+{
+	int ret;
+
+	wait_file = debugfs_create_file("qspinlock_wait", 0600, NULL, NULL,
+					&wait_fops);
+	if (!wait_file)
+		return -ENOMEM;
+
+	ret = register_trace_qspinlock_slowpath(probe_slowpath, NULL);
+	if (ret)
+		goto out_file;
+	ret = register_trace_qspinlock_acquired(probe_acquired, NULL);
+	if (ret)
+		goto out_slowpath;
+	return 0;
+
+out_slowpath:
+	unregister_trace_qspinlock_slowpath(probe_slowpath, NULL);
+	tracepoint_synchronize_unregister();
+out_file:
+	debugfs_remove(wait_file);
+	return ret;
+}
+
+static void __exit qspinlock_wait_exit(void)
+{
+	unregister_trace_qspinlock_acquired(probe_acquired, NULL);
+	unregister_trace_qspinlock_slowpath(probe_slowpath, NULL);
+	tracepoint_synchronize_unregister();
+	debugfs_remove(wait_file);
+}
+
+module_init(qspinlock_wait_init);
+module_exit(qspinlock_wait_exit);
+MODULE_LICENSE("GPL");
@@ -5,6 +5,10 @@
 # define __always_inline	inline __attribute__((always_inline))
 #endif
 
+#ifndef noinline
+# define noinline		__attribute__((noinline))
+#endif
+
 #define __user
 
 #ifndef __attribute_const__
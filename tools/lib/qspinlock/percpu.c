@@ -0,0 +1,36 @@
+#include <stdlib.h>
+#include <string.h>
+#include <linux/percpu.h>
+
+extern char __stop_qspinlock_percpu[];
+
+__thread int __qspinlock_cpu;
+char *__qspinlock_percpu_base;
+unsigned long __qspinlock_percpu_size;
+
+/*
+ * Set up a copy of the per-cpu section for each of the CONFIG_NR_CPUS cpus.
+ * Each copy is cacheline aligned like the kernel per-cpu areas.
+ */
+int qspinlock_percpu_init(void)
+{
+	unsigned long size = __stop_qspinlock_percpu - __start_qspinlock_percpu;
+	int cpu;
+
+	size = (size + SMP_CACHE_BYTES - 1) & ~(SMP_CACHE_BYTES - 1UL);
+	if (posix_memalign((void **)&__qspinlock_percpu_base, SMP_CACHE_BYTES,
+			   size * CONFIG_NR_CPUS))
+		return -1;
+
+	for (cpu = 0; cpu < CONFIG_NR_CPUS; cpu++)
+		memcpy(__qspinlock_percpu_base + cpu * size,
+		       __start_qspinlock_percpu,
+		       __stop_qspinlock_percpu - __start_qspinlock_percpu);
+	__qspinlock_percpu_size = size;
+	return 0;
+}
+
+void qspinlock_set_cpu(int cpu)
+{
+	__qspinlock_cpu = cpu;
+}
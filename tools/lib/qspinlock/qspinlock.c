@@ -0,0 +1,2 @@
+#include <linux/export.h>
+#include "../../../kernel/locking/qspinlock.c"
@@ -0,0 +1,427 @@
+/*
+ * qspinlock_bench: throughput and handoff latency of the kernel queue
+ * spinlock, built from kernel/locking/qspinlock.c as it is.
+ *
+ * Each thread is pinned to a CPU and repeatedly takes the lock, spends the
+ * critical section time in it and waits for the think time outside of it.
+ * The handoff latency is the time between a lock release and the next
+ * acquisition by a different thread. The threads are placed on the CPUs
+ * filling one NUMA node after the other (compact) or round robin across
+ * the nodes (spread). The lock itself is first touched by thread 0.
+ *
+ * With a TIMEOUT=1 build, -T makes the odd threads wait for the lock with
+ * queue_spin_trylock_for() and the given number of cycles, counting the
+ * timeouts.
+ *
+ * -Q uses a lock in the contended_spinlocks section instead, which gets
+ * the slowpath without the pending bit like DEFINE_CONTENDED_SPINLOCK().
+ *
+ * -I sends each thread a signal every given number of microseconds, whose
+ * handler takes a second lock for the critical section time. The handler
+ * stands for an interrupt: when it hits a queued waiter, it queues with
+ * the next node of the CPU while the queue neighbours of the interrupted
+ * waiter still store to its node. Comparing the runs of a TILED=1 build,
+ * which has a cacheline per node, with a default one shows the cost of
+ * the false sharing between the nodes against that of their footprint.
+ *
+ * Usage: qspinlock_bench [-t threads] [-d seconds] [-c cs_ns] [-w think_ns]
+ *			  [-p compact|spread] [-T cycles] [-Q] [-I irq_us]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <asm/qspinlock.h>
+#include <linux/percpu.h>
+
+#define HISTO_BUCKETS	32
+
+struct worker {
+	pthread_t	thread;
+	int		id;
+	int		cpu;
+	unsigned long	ops;
+	unsigned long	handoffs;
+	unsigned long	timeouts;
+	unsigned long	irq_ops;
+	u64		handoff_ns;
+	unsigned long	histo[HISTO_BUCKETS];
+} __attribute__((aligned(SMP_CACHE_BYTES)));
+
+static struct {
+	struct qspinlock lock;
+	int		last_owner;
+	u64		last_release;
+	unsigned long	counter;	/* Checks the mutual exclusion */
+} shared __attribute__((aligned(SMP_CACHE_BYTES)));
+
+static struct qspinlock contended_lock
+	__attribute__((section("contended_spinlocks"), aligned(SMP_CACHE_BYTES)));
+static struct qspinlock *bench_lock = &shared.lock;
+
+static struct {
+	struct qspinlock lock;
+	unsigned long	counter;
+} irq_shared __attribute__((aligned(SMP_CACHE_BYTES)));
+
+static __thread struct worker *this_worker;
+
+static unsigned int nthreads = 1, nsecs = 5, cs_ns, think_ns, irq_us;
+static u64 timeout_cycles;
+static bool spread;
+static volatile int start, done;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void delay_ns(unsigned int ns)
+{
+	u64 end;
+
+	if (!ns)
+		return;
+	end = now_ns() + ns;
+	while (now_ns() < end)
+		cpu_relax();
+}
+
+static int histo_bucket(u64 ns)
+{
+	int b = ns ? 63 - __builtin_clzll(ns) : 0;
+
+	return b < HISTO_BUCKETS ? b : HISTO_BUCKETS - 1;
+}
+
+static bool worker_lock(struct worker *w)
+{
+#ifdef CONFIG_QUEUE_SPINLOCK_TIMEOUT
+	if (timeout_cycles && (w->id & 1)) {
+		if (queue_spin_trylock_for(bench_lock, timeout_cycles))
+			return true;
+		w->timeouts++;
+		return false;
+	}
+#endif
+	arch_spin_lock(bench_lock);
+	return true;
+}
+
+static void irq_handler(int sig)
+{
+	arch_spin_lock(&irq_shared.lock);
+	irq_shared.counter++;
+	delay_ns(cs_ns);
+	arch_spin_unlock(&irq_shared.lock);
+	this_worker->irq_ops++;
+}
+
+static int irq_timer_create(timer_t *timer)
+{
+	struct itimerspec its = {
+		.it_interval.tv_sec  = irq_us / 1000000,
+		.it_interval.tv_nsec = (irq_us % 1000000) * 1000,
+	};
+	struct sigevent sev = {
+		.sigev_notify		= SIGEV_THREAD_ID,
+		.sigev_signo		= SIGRTMIN,
+	};
+
+	sev._sigev_un._tid = syscall(SYS_gettid);
+	if (timer_create(CLOCK_MONOTONIC, &sev, timer))
+		return -1;
+	its.it_value = its.it_interval;
+	return timer_settime(*timer, 0, &its, NULL);
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	timer_t timer;
+	cpu_set_t mask;
+	u64 t;
+
+	CPU_ZERO(&mask);
+	CPU_SET(w->cpu, &mask);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask))
+		fprintf(stderr, "thread %d: can't pin to CPU %d\n", w->id, w->cpu);
+
+	qspinlock_set_cpu(w->id);
+	this_worker = w;
+	if (irq_us && irq_timer_create(&timer)) {
+		perror("timer_create");
+		exit(EXIT_FAILURE);
+	}
+	if (!w->id) {
+		memset(&shared, 0, sizeof(shared));
+		shared.last_owner = -1;
+		__atomic_store_n(&start, 1, __ATOMIC_RELEASE);
+	}
+	while (!__atomic_load_n(&start, __ATOMIC_ACQUIRE))
+		cpu_relax();
+
+	while (!done) {
+		if (!worker_lock(w))
+			continue;
+		t = now_ns();
+		if (shared.last_owner >= 0 && shared.last_owner != w->id) {
+			w->handoffs++;
+			w->handoff_ns += t - shared.last_release;
+			w->histo[histo_bucket(t - shared.last_release)]++;
+		}
+		shared.counter++;
+		delay_ns(cs_ns);
+		shared.last_owner = w->id;
+		shared.last_release = now_ns();
+		arch_spin_unlock(bench_lock);
+
+		w->ops++;
+		delay_ns(think_ns);
+	}
+	if (irq_us)
+		timer_delete(timer);
+	return NULL;
+}
+
+/*
+ * Order the online CPUs for the thread placement, using the node cpulists
+ * in sysfs. Without them, the CPUs are used in the numeric order.
+ */
+static int get_cpus(int *cpus, int max)
+{
+	int nodes[CONFIG_NR_CPUS], n = 0, nr_nodes = 0, node, cpu, i, pass;
+	char path[64];
+	FILE *fp;
+
+	for (cpu = 0; cpu < max; cpu++)
+		nodes[cpu] = -1;
+	for (node = 0; node < CONFIG_NR_CPUS; node++) {
+		int lo, hi;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%d/cpulist", node);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		while (fscanf(fp, "%d", &lo) == 1) {
+			hi = lo;
+			if (fgetc(fp) == '-' && fscanf(fp, "%d", &hi) == 1)
+				fgetc(fp);
+			for (cpu = lo; cpu <= hi && cpu < max; cpu++)
+				nodes[cpu] = node;
+		}
+		fclose(fp);
+		nr_nodes = node + 1;
+	}
+
+	if (!nr_nodes) {
+		for (cpu = 0; cpu < max; cpu++)
+			cpus[n++] = cpu;
+		return n;
+	}
+
+	if (!spread) {
+		for (node = 0; node < nr_nodes; node++)
+			for (cpu = 0; cpu < max; cpu++)
+				if (nodes[cpu] == node)
+					cpus[n++] = cpu;
+		return n;
+	}
+
+	/* Round robin across the nodes, taking the pass-th CPU of each */
+	for (pass = 0; n < max; pass++) {
+		int added = 0;
+
+		for (node = 0; node < nr_nodes; node++) {
+			for (cpu = 0, i = 0; cpu < max; cpu++) {
+				if (nodes[cpu] != node)
+					continue;
+				if (i++ == pass) {
+					cpus[n++] = cpu;
+					added++;
+					break;
+				}
+			}
+		}
+		if (!added)
+			break;
+	}
+	return n;
+}
+
+static u64 histo_percentile(unsigned long *histo, unsigned long total, int pct)
+{
+	unsigned long sum = 0, target = (total * pct + 99) / 100;
+	int b;
+
+	for (b = 0; b < HISTO_BUCKETS; b++) {
+		sum += histo[b];
+		if (sum && sum >= target)
+			return 2ULL << b;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t threads] [-d seconds] [-c cs_ns] [-w think_ns] [-p compact|spread] [-T cycles] [-Q] [-I irq_us]\n",
+		prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long histo[HISTO_BUCKETS] = { 0 };
+	unsigned long total = 0, handoffs = 0, timeouts = 0, min = ~0UL, max = 0;
+	unsigned long irq_total = 0;
+	int cpus[CONFIG_NR_CPUS], ncpus, opt, i, b;
+	struct worker *workers;
+	u64 handoff_ns = 0;
+
+	while ((opt = getopt(argc, argv, "t:d:c:w:p:T:QI:")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			nsecs = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cs_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			think_ns = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			if (!strcmp(optarg, "spread"))
+				spread = true;
+			else if (strcmp(optarg, "compact"))
+				usage(argv[0]);
+			break;
+		case 'T':
+#ifndef CONFIG_QUEUE_SPINLOCK_TIMEOUT
+			fprintf(stderr, "-T needs a TIMEOUT=1 build\n");
+			return EXIT_FAILURE;
+#endif
+			timeout_cycles = strtoull(optarg, NULL, 0);
+			break;
+		case 'Q':
+			bench_lock = &contended_lock;
+			break;
+		case 'I':
+			irq_us = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!nthreads || nthreads > CONFIG_NR_CPUS) {
+		fprintf(stderr, "The number of threads must be 1-%d\n",
+			CONFIG_NR_CPUS);
+		return EXIT_FAILURE;
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus > CONFIG_NR_CPUS)
+		ncpus = CONFIG_NR_CPUS;
+	ncpus = get_cpus(cpus, ncpus);
+	if (nthreads > (unsigned int)ncpus)
+		fprintf(stderr, "Warning: %u threads on %d CPUs, the preempted queued waiters will stall the lock\n",
+			nthreads, ncpus);
+
+	if (qspinlock_percpu_init()) {
+		perror("qspinlock_percpu_init");
+		return EXIT_FAILURE;
+	}
+
+	if (irq_us) {
+		struct sigaction sa = {
+			.sa_handler	= irq_handler,
+			.sa_flags	= SA_RESTART,
+		};
+
+		if (sigaction(SIGRTMIN, &sa, NULL)) {
+			perror("sigaction");
+			return EXIT_FAILURE;
+		}
+	}
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < (int)nthreads; i++) {
+		workers[i].id = i;
+		workers[i].cpu = cpus[i % ncpus];
+		errno = pthread_create(&workers[i].thread, NULL, workerfn,
+				       &workers[i]);
+		if (errno) {
+			perror("pthread_create");
+			return EXIT_FAILURE;
+		}
+	}
+
+	sleep(nsecs);
+	done = 1;
+
+	for (i = 0; i < (int)nthreads; i++) {
+		struct worker *w = &workers[i];
+
+		pthread_join(w->thread, NULL);
+		printf("thread %3d CPU %3d: %lu acq/s\n", w->id, w->cpu,
+		       w->ops / nsecs);
+		total += w->ops;
+		handoffs += w->handoffs;
+		timeouts += w->timeouts;
+		irq_total += w->irq_ops;
+		handoff_ns += w->handoff_ns;
+		if (w->ops < min)
+			min = w->ops;
+		if (w->ops > max)
+			max = w->ops;
+		for (b = 0; b < HISTO_BUCKETS; b++)
+			histo[b] += w->histo[b];
+	}
+
+	printf("threads %u cs_ns %u think_ns %u placement %s%s\n", nthreads,
+	       cs_ns, think_ns, spread ? "spread" : "compact",
+	       bench_lock == &contended_lock ? " contended" : "");
+	printf("total %lu acq/s  min/max per thread %lu/%lu acq/s\n",
+	       total / nsecs, min / nsecs, max / nsecs);
+	if (handoffs)
+		printf("handoff avg %llu ns  p50 %llu ns  p99 %llu ns\n",
+		       (unsigned long long)(handoff_ns / handoffs),
+		       (unsigned long long)histo_percentile(histo, handoffs, 50),
+		       (unsigned long long)histo_percentile(histo, handoffs, 99));
+	if (timeout_cycles)
+		printf("timeouts %lu/s\n", timeouts / nsecs);
+	if (irq_us)
+		printf("irq every %u us: %lu acq/s\n", irq_us,
+		       irq_total / nsecs);
+#ifdef CONFIG_QUEUE_SPINLOCK_TILED_NODES
+	printf("queue nodes tiled, per-cpu area %lu bytes\n", __qspinlock_percpu_size);
+#else
+	printf("queue nodes packed, per-cpu area %lu bytes\n", __qspinlock_percpu_size);
+#endif
+
+	if (shared.counter != total || irq_shared.counter != irq_total) {
+		fprintf(stderr, "Mutual exclusion failure: %lu != %lu\n",
+			shared.counter + irq_shared.counter, total + irq_total);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
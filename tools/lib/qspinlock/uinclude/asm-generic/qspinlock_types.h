@@ -0,0 +1,6 @@
+#ifndef _LIBQSPINLOCK_ASM_GENERIC_QSPINLOCK_TYPES_H_
+#define _LIBQSPINLOCK_ASM_GENERIC_QSPINLOCK_TYPES_H_
+
+#include "../../../../../include/asm-generic/qspinlock_types.h"
+
+#endif
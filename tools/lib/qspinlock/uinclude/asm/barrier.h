@@ -0,0 +1,26 @@
+#ifndef _LIBQSPINLOCK_ASM_BARRIER_H_
+#define _LIBQSPINLOCK_ASM_BARRIER_H_
+
+#include <linux/compiler.h>
+
+#define barrier()		__asm__ __volatile__("" : : : "memory")
+#define smp_mb()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb()		__atomic_thread_fence(__ATOMIC_RELEASE)
+
+#define smp_load_acquire(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()		__asm__ __volatile__("rep; nop" : : : "memory")
+#elif defined(__aarch64__)
+#define cpu_relax()		__asm__ __volatile__("yield" : : : "memory")
+#elif defined(__powerpc__)
+#define cpu_relax()		__asm__ __volatile__("or 1,1,1; or 2,2,2" : : : "memory")
+#else
+#define cpu_relax()		barrier()
+#endif
+
+#define cpu_relax_lowlatency()	cpu_relax()
+
+#endif
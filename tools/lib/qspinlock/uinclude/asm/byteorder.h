@@ -0,0 +1,14 @@
+#ifndef _LIBQSPINLOCK_ASM_BYTEORDER_H_
+#define _LIBQSPINLOCK_ASM_BYTEORDER_H_
+
+/*
+ * The kernel defines __LITTLE_ENDIAN only on little endian machines while
+ * glibc always defines it to compare against __BYTE_ORDER.
+ */
+#include <endian.h>
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+#undef __LITTLE_ENDIAN
+#endif
+
+#endif
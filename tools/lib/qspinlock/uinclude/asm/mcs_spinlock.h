@@ -0,0 +1,4 @@
+#ifndef _LIBQSPINLOCK_ASM_MCS_SPINLOCK_H_
+#define _LIBQSPINLOCK_ASM_MCS_SPINLOCK_H_
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _LIBQSPINLOCK_ASM_QSPINLOCK_H_
+#define _LIBQSPINLOCK_ASM_QSPINLOCK_H_
+
+#include "../../../../../include/asm-generic/qspinlock.h"
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef _LIBQSPINLOCK_LINUX_BITOPS_H_
+#define _LIBQSPINLOCK_LINUX_BITOPS_H_
+
+/* Undefined if no zero exists, like the kernel one */
+#define ffz(x)		__builtin_ctzl(~(unsigned long)(x))
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _LIBQSPINLOCK_LINUX_BUG_H_
+#define _LIBQSPINLOCK_LINUX_BUG_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <asm/bug.h>
+
+#define BUILD_BUG_ON(condition) ((void)sizeof(char[1 - 2*!!(condition)]))
+
+#define BUG()		abort()
+#define BUG_ON(x)	do { if (unlikely(x)) BUG(); } while (0)
+#define WARN_ON(x)	WARN(x, "WARN_ON(%s)\n", #x)
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef _LIBQSPINLOCK_LINUX_CPUMASK_H_
+#define _LIBQSPINLOCK_LINUX_CPUMASK_H_
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _LIBQSPINLOCK_LINUX_HASH_H_
+#define _LIBQSPINLOCK_LINUX_HASH_H_
+
+#include <linux/types.h>
+
+/* The multiplicative hash of the kernel, for 64-bit pointers */
+#define GOLDEN_RATIO_PRIME_64	0x9e37fffffffc0001UL
+
+static inline unsigned long hash_ptr(const void *ptr, unsigned int bits)
+{
+	return ((u64)(unsigned long)ptr * GOLDEN_RATIO_PRIME_64) >> (64 - bits);
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef _LIBQSPINLOCK_LINUX_INIT_H_
+#define _LIBQSPINLOCK_LINUX_INIT_H_
+
+/* There is no kernel command line, the parameters keep their defaults */
+#define __init
+#define __read_mostly
+#define early_param(str, fn)						\
+	static int (*__early_param_##fn)(char *) __attribute__((unused)) = fn
+
+#endif
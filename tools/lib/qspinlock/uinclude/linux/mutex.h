@@ -0,0 +1,7 @@
+#ifndef _LIBQSPINLOCK_LINUX_MUTEX_H_
+#define _LIBQSPINLOCK_LINUX_MUTEX_H_
+
+/* For the osq_lock() declarations in mcs_spinlock.h */
+struct optimistic_spin_queue;
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _LIBQSPINLOCK_LINUX_PERCPU_H_
+#define _LIBQSPINLOCK_LINUX_PERCPU_H_
+
+#include <linux/smp.h>
+
+/*
+ * The per-cpu variables are put into their own section which serves as
+ * the template of the per-cpu areas set up by qspinlock_percpu_init(),
+ * one for each of the CONFIG_NR_CPUS cpus, just like the kernel does.
+ */
+#define SMP_CACHE_BYTES		64
+#define ____cacheline_aligned	__attribute__((aligned(SMP_CACHE_BYTES)))
+
+#define __percpu
+#define __PCPU_ATTRS		__attribute__((section("qspinlock_percpu")))
+
+#define DEFINE_PER_CPU(type, name)					\
+	__PCPU_ATTRS __typeof__(type) name
+#define DEFINE_PER_CPU_ALIGNED(type, name)				\
+	__PCPU_ATTRS __attribute__((aligned(SMP_CACHE_BYTES))) type name
+
+extern char __start_qspinlock_percpu[];
+extern char *__qspinlock_percpu_base;
+extern unsigned long __qspinlock_percpu_size;
+
+#define per_cpu_ptr(ptr, cpu)						\
+	((typeof(ptr))(__qspinlock_percpu_base +			\
+		       (cpu) * __qspinlock_percpu_size +		\
+		       ((char *)(ptr) - __start_qspinlock_percpu)))
+#define this_cpu_ptr(ptr)	per_cpu_ptr(ptr, smp_processor_id())
+#define per_cpu(var, cpu)	(*per_cpu_ptr(&(var), cpu))
+
+#define this_cpu_read(var)	(*this_cpu_ptr(&(var)))
+#define this_cpu_inc(var)	((*this_cpu_ptr(&(var)))++)
+#define this_cpu_dec(var)	((*this_cpu_ptr(&(var)))--)
+#define this_cpu_cmpxchg(var, old, new)	cmpxchg(this_cpu_ptr(&(var)), old, new)
+
+extern int qspinlock_percpu_init(void);
+extern void qspinlock_set_cpu(int cpu);
+
+#endif
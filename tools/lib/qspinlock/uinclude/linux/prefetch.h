@@ -0,0 +1,7 @@
+#ifndef _LIBQSPINLOCK_LINUX_PREFETCH_H_
+#define _LIBQSPINLOCK_LINUX_PREFETCH_H_
+
+#define prefetch(x)		__builtin_prefetch(x)
+#define prefetchw(x)		__builtin_prefetch(x, 1)
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _LIBQSPINLOCK_LINUX_SMP_H_
+#define _LIBQSPINLOCK_LINUX_SMP_H_
+
+/*
+ * The "cpu" of a thread is the slot it has been given with
+ * qspinlock_set_cpu(), which picks its queue nodes. It doesn't have to
+ * match the CPU the thread is pinned to.
+ */
+extern __thread int __qspinlock_cpu;
+
+#define smp_processor_id()	(__qspinlock_cpu)
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _LIBQSPINLOCK_LINUX_STRING_H_
+#define _LIBQSPINLOCK_LINUX_STRING_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+static inline int strtobool(const char *s, bool *res)
+{
+	switch (s ? s[0] : 0) {
+	case 'y': case 'Y': case '1':
+		*res = true;
+		return 0;
+	case 'n': case 'N': case '0':
+		*res = false;
+		return 0;
+	case 'o': case 'O':
+		if (s[1] == 'n' || s[1] == 'N') {
+			*res = true;
+			return 0;
+		}
+		if (s[1] == 'f' || s[1] == 'F') {
+			*res = false;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _LIBQSPINLOCK_LINUX_TIMEX_H_
+#define _LIBQSPINLOCK_LINUX_TIMEX_H_
+
+#include <time.h>
+
+/*
+ * The cycles are the TSC on x86 like in the kernel, and nanoseconds of
+ * the monotonic clock elsewhere.
+ */
+typedef unsigned long long cycles_t;
+
+static inline cycles_t get_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((cycles_t)hi << 32) | lo;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#endif
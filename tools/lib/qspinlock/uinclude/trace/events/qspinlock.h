@@ -0,0 +1,19 @@
+#ifndef _LIBQSPINLOCK_TRACE_EVENTS_QSPINLOCK_H_
+#define _LIBQSPINLOCK_TRACE_EVENTS_QSPINLOCK_H_
+
+/* No tracing in userspace, the events of the slowpath are no-ops */
+struct qspinlock;
+
+static inline void trace_qspinlock_slowpath(struct qspinlock *lock, u32 val) { }
+static inline void trace_qspinlock_pending(struct qspinlock *lock) { }
+static inline void trace_qspinlock_head(struct qspinlock *lock) { }
+static inline void trace_qspinlock_acquired(struct qspinlock *lock) { }
+static inline void trace_qspinlock_timeout(struct qspinlock *lock) { }
+static inline void trace_qspinlock_queued(struct qspinlock *lock, int idx,
+					  int prev_cpu, int pos) { }
+
+/* Nothing to export the events to */
+#define EXPORT_TRACEPOINT_SYMBOL_GPL(name)				\
+	extern int __qspinlock_tracepoint_##name __attribute__((unused))
+
+#endif
@@ -6,6 +6,11 @@
  * This program is particularly useful for measuring the kernel's futex hash
  * table/function implementation. In order for it to make sense, use with as
  * many threads and futexes as possible.
+ *
+ * With several processes, each one runs its own set of threads on private
+ * futexes, which shows the contention between unrelated processes on the
+ * global hash table, and how much a per-process private hash table
+ * (PR_SET_FUTEX_HASH) isolates them.
  */
 
 #include "../perf.h"
@@ -18,14 +23,23 @@
 
 #include <err.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <pthread.h>
 
+#ifndef PR_SET_FUTEX_HASH
+#define PR_SET_FUTEX_HASH	43
+#define PR_GET_FUTEX_HASH	44
+#endif
+
 static unsigned int nthreads = 0;
 static unsigned int nsecs    = 10;
 /* amount of futexes per thread */
 static unsigned int nfutexes = 1024;
-static bool fshared = false, done = false, silent = false;
+static unsigned int nprocs = 1;
+static bool fshared = false, done = false, silent = false, private_hash = false;
 static int futex_flag = 0;
 
 struct timeval start, end, runtime;
@@ -47,6 +61,8 @@ static const struct option options[] = {
 	OPT_UINTEGER('f', "futexes", &nfutexes, "Specify amount of futexes per threads"),
 	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &fshared,  "Use shared futexes instead of private ones"),
+	OPT_UINTEGER('p', "processes", &nprocs, "Specify amount of processes, each with its own threads"),
+	OPT_BOOLEAN( 'H', "hash",    &private_hash, "Use a private futex hash table in each process"),
 	OPT_END()
 };
 
@@ -106,40 +122,31 @@ static void print_summary(void)
 	       (int) runtime.tv_sec);
 }
 
-int bench_futex_hash(int argc, const char **argv,
-		     const char *prefix __maybe_unused)
+/*
+ * Run the threads of one process, on the CPUs starting at cpu_base. Returns
+ * the total operations/sec of its threads.
+ */
+static unsigned long run_threads(unsigned int ncpus, unsigned int cpu_base)
 {
 	int ret = 0;
 	cpu_set_t cpu;
-	struct sigaction act;
-	unsigned int i, ncpus;
+	unsigned int i;
+	unsigned long total = 0;
 	pthread_attr_t thread_attr;
 	struct worker *worker = NULL;
 
-	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
-	if (argc) {
-		usage_with_options(bench_futex_hash_usage, options);
-		exit(EXIT_FAILURE);
-	}
-
-	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
-
-	sigfillset(&act.sa_mask);
-	act.sa_sigaction = toggle_done;
-	sigaction(SIGINT, &act, NULL);
-
-	if (!nthreads) /* default to the number of CPUs */
-		nthreads = ncpus;
-
 	worker = calloc(nthreads, sizeof(*worker));
 	if (!worker)
 		goto errmem;
 
-	if (!fshared)
-		futex_flag = FUTEX_PRIVATE_FLAG;
-
-	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
-	       getpid(), nthreads, nfutexes, fshared ? "shared":"private", nsecs);
+	if (private_hash) {
+		ret = prctl(PR_SET_FUTEX_HASH, nthreads, 0, 0, 0);
+		if (ret)
+			err(EXIT_FAILURE, "prctl(PR_SET_FUTEX_HASH)");
+		if (!silent)
+			printf("[PID %d] private futex hash: %d buckets\n",
+			       getpid(), prctl(PR_GET_FUTEX_HASH, 0, 0, 0, 0));
+	}
 
 	init_stats(&throughput_stats);
 	pthread_mutex_init(&thread_lock, NULL);
@@ -156,7 +163,7 @@ int bench_futex_hash(int argc, const char **argv,
 			goto errmem;
 
 		CPU_ZERO(&cpu);
-		CPU_SET(i % ncpus, &cpu);
+		CPU_SET((cpu_base + i) % ncpus, &cpu);
 
 		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
 		if (ret)
@@ -193,7 +200,8 @@ int bench_futex_hash(int argc, const char **argv,
 	for (i = 0; i < nthreads; i++) {
 		unsigned long t = worker[i].ops/runtime.tv_sec;
 		update_stats(&throughput_stats, t);
-		if (!silent) {
+		total += t;
+		if (!silent && nprocs == 1) {
 			if (nfutexes == 1)
 				printf("[thread %2d] futex: %p [ %ld ops/sec ]\n",
 				       worker[i].tid, &worker[i].futex[0], t);
@@ -206,10 +214,92 @@ int bench_futex_hash(int argc, const char **argv,
 		free(worker[i].futex);
 	}
 
-	print_summary();
+	if (nprocs == 1)
+		print_summary();
 
 	free(worker);
-	return ret;
+	return total;
 errmem:
 	err(EXIT_FAILURE, "calloc");
 }
+
+/* Fork the processes and gather the throughput of each of them */
+static int run_processes(unsigned int ncpus)
+{
+	unsigned long *results, total = 0;
+	unsigned int i;
+	int status, ret = 0;
+	pid_t pid;
+
+	results = mmap(NULL, nprocs * sizeof(*results), PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	for (i = 0; i < nprocs; i++) {
+		pid = fork();
+		if (pid < 0)
+			err(EXIT_FAILURE, "fork");
+		if (!pid) {
+			results[i] = run_threads(ncpus, i * nthreads);
+			exit(EXIT_SUCCESS);
+		}
+	}
+
+	for (i = 0; i < nprocs; i++) {
+		if (wait(&status) < 0)
+			err(EXIT_FAILURE, "wait");
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = -1;
+	}
+
+	init_stats(&throughput_stats);
+	for (i = 0; i < nprocs; i++) {
+		update_stats(&throughput_stats, results[i]);
+		total += results[i];
+		if (!silent)
+			printf("[process %2d] %ld ops/sec\n", i, results[i]);
+	}
+	printf("%sTotal %ld operations/sec, averaged %.0f per process (+- %.2f%%)\n",
+	       !silent ? "\n" : "", total, avg_stats(&throughput_stats),
+	       rel_stddev_stats(stddev_stats(&throughput_stats),
+				avg_stats(&throughput_stats)));
+
+	munmap(results, nprocs * sizeof(*results));
+	return ret;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct sigaction act;
+	unsigned int ncpus;
+
+	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
+	if (argc || !nprocs) {
+		usage_with_options(bench_futex_hash_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = max(1U, ncpus / nprocs);
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	printf("Run summary [PID %d]: %d processes of %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
+	       getpid(), nprocs, nthreads, nfutexes,
+	       fshared ? "shared":"private", nsecs);
+
+	if (nprocs == 1) {
+		run_threads(ncpus, 0);
+		return 0;
+	}
+	return run_processes(ncpus);
+}
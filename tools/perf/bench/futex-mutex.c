@@ -0,0 +1,288 @@
+/*
+ * futex-mutex: Compare the throughput of two futex based mutexes under
+ * contention.
+ *
+ * The "wait" mutex is the classic 0/1/2 futex mutex: a short spin in user
+ * space, then FUTEX_WAIT, without knowing whether the owner runs. The "spin"
+ * mutex keeps the owner TID in the futex word and calls FUTEX_LOCK_SPIN,
+ * which spins in the kernel while the owner runs on a CPU and only blocks
+ * otherwise. Both are unlocked with FUTEX_WAKE when there are waiters.
+ *
+ * All the threads contend on the same mutex; the critical and non-critical
+ * sections are busy loops of the given number of iterations.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "../util/header.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+/* User space spins of the "wait" mutex before it blocks */
+#define WAIT_MUTEX_SPINS	100
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static unsigned int cs_loops = 100;
+static unsigned int ncs_loops = 100;
+static const char *lock_type;
+static bool fshared = false, done = false, silent = false;
+static int futex_flag = 0;
+
+static u_int32_t mutex;
+struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+struct mutex_ops {
+	const char *name;
+	void (*lock)(u_int32_t *m, u_int32_t tid);
+	void (*unlock)(u_int32_t *m);
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads",  &nthreads,  "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime",  &nsecs,     "Specify runtime (in seconds)"),
+	OPT_UINTEGER('c', "critical", &cs_loops,  "Specify the loops in the critical section"),
+	OPT_UINTEGER('n', "noncritical", &ncs_loops, "Specify the loops out of the critical section"),
+	OPT_STRING(  'l', "lock",     &lock_type, "type", "Mutex to test: wait or spin (default: both)"),
+	OPT_BOOLEAN( 's', "silent",   &silent,    "Silent mode: do not display data/details"),
+	OPT_BOOLEAN( 'S', "shared",   &fshared,   "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_mutex_usage[] = {
+	"perf bench futex mutex <options>",
+	NULL
+};
+
+static void wait_mutex_lock(u_int32_t *m, u_int32_t tid __maybe_unused)
+{
+	u_int32_t val;
+	int i;
+
+	for (i = 0; i < WAIT_MUTEX_SPINS; i++) {
+		val = __sync_val_compare_and_swap(m, 0, 1);
+		if (!val)
+			return;
+		if (val == 2)
+			break;
+	}
+
+	/* Mark the mutex contended and sleep until it is released */
+	while (__sync_lock_test_and_set(m, 2))
+		futex_wait(m, 2, NULL, futex_flag);
+}
+
+static void wait_mutex_unlock(u_int32_t *m)
+{
+	if (__sync_fetch_and_sub(m, 1) != 1) {
+		*m = 0;
+		__sync_synchronize();
+		futex_wake(m, 1, futex_flag);
+	}
+}
+
+static void spin_mutex_lock(u_int32_t *m, u_int32_t tid)
+{
+	if (__sync_bool_compare_and_swap(m, 0, tid))
+		return;
+
+	while (futex_lock_spin(m, NULL, futex_flag)) {
+		if (errno != EINTR)
+			err(EXIT_FAILURE, "futex_lock_spin");
+	}
+}
+
+static void spin_mutex_unlock(u_int32_t *m)
+{
+	if (__sync_lock_test_and_set(m, 0) & FUTEX_WAITERS)
+		futex_wake(m, 1, futex_flag);
+}
+
+static const struct mutex_ops mutexes[] = {
+	{ "wait", wait_mutex_lock, wait_mutex_unlock },
+	{ "spin", spin_mutex_lock, spin_mutex_unlock },
+};
+
+static const struct mutex_ops *cur_mutex;
+
+static void busy_loop(unsigned int loops)
+{
+	volatile unsigned int i;
+
+	for (i = 0; i < loops; i++)
+		;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	u_int32_t tid = syscall(SYS_gettid);
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		cur_mutex->lock(&mutex, tid);
+		busy_loop(cs_loops);
+		cur_mutex->unlock(&mutex);
+		busy_loop(ncs_loops);
+		w->ops++;
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void run_mutex(const struct mutex_ops *ops, unsigned int ncpus)
+{
+	int ret;
+	cpu_set_t cpu;
+	unsigned int i;
+	unsigned long total = 0;
+	pthread_attr_t thread_attr;
+	struct worker *worker;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	cur_mutex = ops;
+	mutex = 0;
+	done = false;
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops / runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		total += t;
+		if (!silent)
+			printf("[%s] [thread %2d] %ld ops/sec\n",
+			       ops->name, worker[i].tid, t);
+	}
+
+	printf("%s[%s] Total %ld operations/sec, averaged %.0f per thread (+- %.2f%%)\n",
+	       !silent ? "\n" : "", ops->name, total,
+	       avg_stats(&throughput_stats),
+	       rel_stddev_stats(stddev_stats(&throughput_stats),
+				avg_stats(&throughput_stats)));
+
+	free(worker);
+}
+
+int bench_futex_mutex(int argc, const char **argv,
+		      const char *prefix __maybe_unused)
+{
+	struct sigaction act;
+	unsigned int ncpus, i;
+	bool found = false;
+
+	argc = parse_options(argc, argv, options, bench_futex_mutex_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_mutex_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	printf("Run summary [PID %d]: %d threads contending on a [%s] futex mutex for %d secs, %d/%d loops in/out of the critical section.\n\n",
+	       getpid(), nthreads, fshared ? "shared" : "private", nsecs,
+	       cs_loops, ncs_loops);
+
+	for (i = 0; i < ARRAY_SIZE(mutexes); i++) {
+		if (lock_type && strcmp(lock_type, mutexes[i].name))
+			continue;
+		found = true;
+		run_mutex(&mutexes[i], ncpus);
+	}
+
+	if (!found) {
+		usage_with_options(bench_futex_mutex_usage, options);
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
@@ -12,6 +12,10 @@
 #include <sys/types.h>
 #include <linux/futex.h>
 
+#ifndef FUTEX_LOCK_SPIN
+#define FUTEX_LOCK_SPIN		13
+#endif
+
 /**
  * futex() - SYS_futex syscall wrapper
  * @uaddr:	address of first futex
@@ -68,4 +72,15 @@ futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2, int nr_wak
 		 val, opflags);
 }
 
+/**
+ * futex_lock_spin() - take the TID lock at uaddr, spinning while its owner
+ * runs and blocking otherwise
+ * @timeout:	absolute CLOCK_REALTIME timeout
+ */
+static inline int
+futex_lock_spin(u_int32_t *uaddr, struct timespec *timeout, int opflags)
+{
+	return futex(uaddr, FUTEX_LOCK_SPIN, 0, timeout, NULL, 0, opflags);
+}
+
 #endif /* _FUTEX_H */
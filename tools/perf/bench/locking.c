@@ -0,0 +1,230 @@
+/*
+ * locking: Sweep the in-kernel lock benchmark over thread counts and
+ * critical section sizes.
+ *
+ * The lock algorithms run in the kernel, so this drives the benchmark mode
+ * of the locktorture module (bench=1): for each point of the sweep the
+ * module is loaded with the matching parameters, left running for the
+ * given time, and the results are read back from the locktorture/bench
+ * debugfs file before unloading it. The rows are emitted as CSV or JSON
+ * so that they can be compared across kernel builds.
+ *
+ * Needs root, a kernel with CONFIG_LOCK_TORTURE_TEST=m and debugfs mounted
+ * at /sys/kernel/debug.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOCKING_BENCH_FILE	"/sys/kernel/debug/locktorture/bench"
+#define LOCKING_MAX_POINTS	64
+#define LOCKING_MAX_FIELDS	32
+
+static const char *lock_type;
+static const char *threads_str = "1,2,4,8";
+static const char *cs_str = "0,100,1000";
+static const char *output_str = "csv";
+static unsigned int nsecs = 5;
+static unsigned int think_ns;
+static unsigned int nlocks = 1;
+static bool readers, dry_run;
+
+static const struct option options[] = {
+	OPT_STRING('t', "type", &lock_type, "type",
+		   "locktorture torture_type to benchmark"),
+	OPT_STRING('T', "threads", &threads_str, "list",
+		   "Comma separated thread counts to sweep"),
+	OPT_STRING('c', "cs", &cs_str, "list",
+		   "Comma separated critical section sizes (ns) to sweep"),
+	OPT_UINTEGER('d', "think", &think_ns,
+		     "Delay (ns) between lock acquisitions"),
+	OPT_UINTEGER('l', "nlocks", &nlocks, "Number of locks in the lock array"),
+	OPT_UINTEGER('r', "runtime", &nsecs, "Runtime of each point (in seconds)"),
+	OPT_BOOLEAN('R', "readers", &readers,
+		    "Also start as many readers as writers"),
+	OPT_STRING('o', "output", &output_str, "csv|json", "Output format"),
+	OPT_BOOLEAN('n', "dry-run", &dry_run,
+		    "Only print the modprobe commands"),
+	OPT_END()
+};
+
+static const char * const bench_locking_spinlock_usage[] = {
+	"perf bench locking spinlock <options>",
+	NULL
+};
+
+static const char * const bench_locking_rwlock_usage[] = {
+	"perf bench locking rwlock <options>",
+	NULL
+};
+
+struct locking_field {
+	char	key[32];
+	char	val[64];
+};
+
+static int parse_list(const char *str, unsigned int *vals)
+{
+	char *buf, *tok, *saveptr = NULL;
+	int n = 0;
+
+	buf = strdup(str);
+	if (!buf)
+		err(EXIT_FAILURE, "strdup");
+
+	for (tok = strtok_r(buf, ",", &saveptr); tok;
+	     tok = strtok_r(NULL, ",", &saveptr)) {
+		if (n == LOCKING_MAX_POINTS)
+			errx(EXIT_FAILURE, "too many values in '%s'", str);
+		vals[n++] = strtoul(tok, NULL, 0);
+	}
+	free(buf);
+
+	if (!n)
+		errx(EXIT_FAILURE, "empty list '%s'", str);
+	return n;
+}
+
+static int read_results(struct locking_field *fields)
+{
+	char line[128];
+	FILE *fp;
+	int n = 0;
+
+	fp = fopen(LOCKING_BENCH_FILE, "r");
+	if (!fp) {
+		warn("open %s", LOCKING_BENCH_FILE);
+		return -1;
+	}
+	while (n < LOCKING_MAX_FIELDS && fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%31s %63s", fields[n].key, fields[n].val) == 2)
+			n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+static void print_row(struct locking_field *fields, int n, bool first)
+{
+	int i;
+
+	if (!strcmp(output_str, "json")) {
+		printf("%s  {", first ? "" : ",\n");
+		for (i = 0; i < n; i++) {
+			bool num = strspn(fields[i].val, "0123456789") ==
+				   strlen(fields[i].val);
+
+			printf("%s\"%s\": %s%s%s", i ? ", " : "", fields[i].key,
+			       num ? "" : "\"", fields[i].val, num ? "" : "\"");
+		}
+		printf("}");
+		return;
+	}
+
+	if (first) {
+		for (i = 0; i < n; i++)
+			printf("%s%s", i ? "," : "", fields[i].key);
+		printf("\n");
+	}
+	for (i = 0; i < n; i++)
+		printf("%s%s", i ? "," : "", fields[i].val);
+	printf("\n");
+}
+
+static int run_point(unsigned int nthreads, unsigned int cs,
+		     struct locking_field *fields)
+{
+	char cmd[512];
+	int n;
+
+	snprintf(cmd, sizeof(cmd),
+		 "modprobe locktorture torture_type=%s bench=1 "
+		 "nwriters_stress=%u nreaders_stress=%u cs_ns=%u think_ns=%u "
+		 "nlocks=%u stat_interval=0 stutter=0 shuffle_interval=0 "
+		 "onoff_interval=0 verbose=0",
+		 lock_type, nthreads, readers ? nthreads : 0, cs, think_ns,
+		 nlocks);
+
+	if (dry_run) {
+		printf("%s\n", cmd);
+		return 0;
+	}
+
+	if (system("modprobe -r locktorture 2>/dev/null") < 0 ||
+	    system(cmd)) {
+		warnx("'%s' failed", cmd);
+		return -1;
+	}
+	sleep(nsecs);
+	n = read_results(fields);
+	if (system("modprobe -r locktorture"))
+		warnx("unloading locktorture failed");
+	return n;
+}
+
+static int bench_locking(int argc, const char **argv,
+			 const char * const *usage, const char *def_type)
+{
+	unsigned int threads[LOCKING_MAX_POINTS], cs[LOCKING_MAX_POINTS];
+	struct locking_field fields[LOCKING_MAX_FIELDS];
+	int nthreads, ncs, i, j, n, ret = 0;
+	bool first = true;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+	if (strcmp(output_str, "csv") && strcmp(output_str, "json")) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+	if (!lock_type)
+		lock_type = def_type;
+
+	nthreads = parse_list(threads_str, threads);
+	ncs = parse_list(cs_str, cs);
+
+	if (!dry_run && !strcmp(output_str, "json"))
+		printf("[\n");
+
+	for (i = 0; i < nthreads; i++) {
+		for (j = 0; j < ncs; j++) {
+			n = run_point(threads[i], cs[j], fields);
+			if (n < 0) {
+				ret = -1;
+				goto out;
+			}
+			if (!n)
+				continue;
+			print_row(fields, n, first);
+			first = false;
+		}
+	}
+out:
+	if (!dry_run && !strcmp(output_str, "json"))
+		printf("\n]\n");
+	return ret;
+}
+
+int bench_locking_spinlock(int argc, const char **argv,
+			   const char *prefix __maybe_unused)
+{
+	return bench_locking(argc, argv, bench_locking_spinlock_usage,
+			     "qspinlock");
+}
+
+int bench_locking_rwlock(int argc, const char **argv,
+			 const char *prefix __maybe_unused)
+{
+	readers = true;
+	return bench_locking(argc, argv, bench_locking_rwlock_usage, "rw_lock");
+}
@@ -0,0 +1,216 @@
+/*
+ * sched-fork: Benchmark for the throughput of fork() and exit()
+ *
+ * Each thread loops creating a child that exits right away and reaping
+ * it: a process with fork() and waitpid() by default, a thread with
+ * pthread_create() and pthread_join() with -T. Every iteration takes the
+ * tasklist_lock for writing at fork and at exit, so the total rate shows
+ * how well the two scale with the number of forking threads.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <pthread.h>
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static bool threaded = false, done = false, silent = false;
+
+struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads",  &nthreads,  "Specify amount of forking threads"),
+	OPT_UINTEGER('r', "runtime",  &nsecs,     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN( 'T', "threaded", &threaded,  "Create threads instead of processes"),
+	OPT_BOOLEAN( 's', "silent",   &silent,    "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_sched_fork_usage[] = {
+	"perf bench sched fork <options>",
+	NULL
+};
+
+static void *child_thread(void *arg __maybe_unused)
+{
+	return NULL;
+}
+
+static void fork_child(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, "fork");
+	if (!pid)
+		_exit(0);
+
+	while (waitpid(pid, NULL, 0) < 0) {
+		if (errno != EINTR)
+			err(EXIT_FAILURE, "waitpid");
+	}
+}
+
+static void create_thread(void)
+{
+	pthread_t thread;
+	int ret;
+
+	ret = pthread_create(&thread, NULL, child_thread, NULL);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_create");
+	ret = pthread_join(thread, NULL);
+	if (ret)
+		err(EXIT_FAILURE, "pthread_join");
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		if (threaded)
+			create_thread();
+		else
+			fork_child();
+		w->ops++;
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+int bench_sched_fork(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	int ret;
+	cpu_set_t cpu;
+	unsigned int i, ncpus;
+	unsigned long total = 0;
+	struct sigaction act;
+	pthread_attr_t thread_attr;
+	struct worker *worker;
+
+	argc = parse_options(argc, argv, options, bench_sched_fork_usage, 0);
+	if (argc) {
+		usage_with_options(bench_sched_fork_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = ncpus;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %d threads creating and reaping %s for %d secs.\n\n",
+	       getpid(), nthreads, threaded ? "threads" : "processes", nsecs);
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops / runtime.tv_sec;
+
+		update_stats(&throughput_stats, t);
+		total += t;
+		if (!silent)
+			printf("[thread %2d] %ld forks/sec\n", worker[i].tid, t);
+	}
+
+	printf("%sTotal %ld forks/sec, averaged %.0f per thread (+- %.2f%%)\n",
+	       !silent ? "\n" : "", total, avg_stats(&throughput_stats),
+	       rel_stddev_stats(stddev_stats(&throughput_stats),
+				avg_stats(&throughput_stats)));
+
+	free(worker);
+	return 0;
+}
@@ -13,6 +13,7 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  locking ... In-kernel lock algorithm performance
  */
 #include "perf.h"
 #include "util/util.h"
@@ -44,6 +45,7 @@ static struct bench numa_benchmarks[] = {
 static struct bench sched_benchmarks[] = {
 	{ "messaging",	"Benchmark for scheduling and IPC",		bench_sched_messaging	},
 	{ "pipe",	"Benchmark for pipe() between two processes",	bench_sched_pipe	},
+	{ "fork",	"Benchmark for fork() and exit() throughput",	bench_sched_fork	},
 	{ "all",	"Test all scheduler benchmarks",		NULL			},
 	{ NULL,		NULL,						NULL			}
 };
@@ -59,10 +61,18 @@ static struct bench futex_benchmarks[] = {
 	{ "hash",	"Benchmark for futex hash table",               bench_futex_hash	},
 	{ "wake",	"Benchmark for futex wake calls",               bench_futex_wake	},
 	{ "requeue",	"Benchmark for futex requeue calls",            bench_futex_requeue	},
+	{ "mutex",	"Benchmark for futex based mutexes",		bench_futex_mutex	},
 	{ "all",	"Test all futex benchmarks",			NULL			},
 	{ NULL,		NULL,						NULL			}
 };
 
+static struct bench locking_benchmarks[] = {
+	{ "spinlock",	"Benchmark for kernel spinlock algorithms",	bench_locking_spinlock	},
+	{ "rwlock",	"Benchmark for kernel rwlock algorithms",	bench_locking_rwlock	},
+	{ "all",	"Test all locking benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 struct collection {
 	const char	*name;
 	const char	*summary;
@@ -76,6 +86,7 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+	{ "locking",	"Kernel lock algorithm benchmarks",		locking_benchmarks	},
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
 };
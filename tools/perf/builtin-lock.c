@@ -38,6 +38,9 @@ static struct list_head lockhash_table[LOCKHASH_SIZE];
 #define __lockhashfn(key)	hash_long((unsigned long)key, LOCKHASH_BITS)
 #define lockhashentry(key)	(lockhash_table + __lockhashfn((key)))
 
+/* log2 buckets of the qspinlock wait and hold time histograms, in ns */
+#define QLOCK_HIST_BUCKETS	32
+
 struct lock_stat {
 	struct list_head	hash_entry;
 	struct rb_node		rb;		/* used for sorting */
@@ -65,6 +68,26 @@ struct lock_stat {
 	u64			wait_time_max;
 
 	int			discard; /* flag of blacklist */
+
+	/* qspinlock tracepoints, see the qspinlock_* handlers below */
+	unsigned int		nr_pending;
+	unsigned int		nr_queued;
+	unsigned int		nr_timeout;
+	unsigned int		waiters;	/* CPUs in the slowpath now */
+	unsigned int		depth_max;
+	u64			depth_total;
+	u64			last_acquired;	/* time of the last acquire */
+	unsigned int		nr_hold;
+	u64			hold_time_total;
+	u64			hold_time_max;
+	unsigned int		nr_halt;
+	unsigned int		nr_kick;
+	unsigned int		nr_wake_kicked;
+	unsigned int		nr_wake_spurious;
+	u64			kick_wake_total;
+	u64			kick_wake_max;
+	unsigned int		wait_hist[QLOCK_HIST_BUCKETS];
+	unsigned int		hold_hist[QLOCK_HIST_BUCKETS];
 };
 
 /*
@@ -214,6 +237,9 @@ SINGLE_KEY(nr_contended)
 SINGLE_KEY(avg_wait_time)
 SINGLE_KEY(wait_time_total)
 SINGLE_KEY(wait_time_max)
+SINGLE_KEY(hold_time_total)
+SINGLE_KEY(hold_time_max)
+SINGLE_KEY(nr_halt)
 
 static int lock_stat_key_wait_time_min(struct lock_stat *one,
 					struct lock_stat *two)
@@ -252,6 +278,9 @@ struct lock_key keys[] = {
 	DEF_KEY_LOCK(wait_total, wait_time_total),
 	DEF_KEY_LOCK(wait_min, wait_time_min),
 	DEF_KEY_LOCK(wait_max, wait_time_max),
+	DEF_KEY_LOCK(hold_total, hold_time_total),
+	DEF_KEY_LOCK(hold_max, hold_time_max),
+	DEF_KEY_LOCK(halt, nr_halt),
 
 	/* extra comparisons much complicated should be here */
 
@@ -684,6 +713,237 @@ static int perf_evsel__process_lock_release(struct perf_evsel *evsel,
 	return 0;
 }
 
+/*
+ * qspinlock tracepoints
+ *
+ * They don't need CONFIG_LOCKDEP and are per CPU rather than per task, a
+ * spinlock waiter can't migrate. The locks have no name, the addresses
+ * are used instead.
+ *
+ * A contended acquisition is qspinlock_slowpath, then qspinlock_pending
+ * or qspinlock_queued (and qspinlock_head), then qspinlock_acquired or
+ * qspinlock_timeout. There is no release event, the unlock is inlined.
+ * The hold time is approximated by the time between two acquisitions of
+ * a lock when the second CPU was already waiting at the first one; it
+ * includes the handoff. The PV halt, kick and wake events are accounted
+ * to the lock that the CPU waits for.
+ */
+struct qlock_cpu_stat {
+	struct lock_stat	*ls;		/* lock waited for, or NULL */
+	u64			start;		/* slowpath entry time */
+	u64			kick_time;	/* time of the last kick */
+};
+
+static struct qlock_cpu_stat qlock_cpus[MAX_NR_CPUS];
+
+static bool qspinlock_mode;
+static bool qlock_histogram;
+
+static unsigned int nr_kvm_exit;
+static unsigned int nr_kvm_exit_reason[1024];
+
+static struct qlock_cpu_stat *qlock_cpu(struct perf_sample *sample)
+{
+	if (sample->cpu >= MAX_NR_CPUS) {
+		pr_debug("cpu %u out of range, skipping it.\n", sample->cpu);
+		return NULL;
+	}
+	return &qlock_cpus[sample->cpu];
+}
+
+static struct lock_stat *qlock_stat_findnew(struct perf_evsel *evsel,
+					    struct perf_sample *sample)
+{
+	u64 tmp = perf_evsel__intval(evsel, sample, "lock");
+	char name[20];
+	void *addr;
+
+	memcpy(&addr, &tmp, sizeof(void *));
+	scnprintf(name, sizeof(name), "%" PRIx64, tmp);
+	return lock_stat_findnew(addr, name);
+}
+
+static void qlock_hist_add(unsigned int *hist, u64 ns)
+{
+	int i = 0;
+
+	while (ns >>= 1)
+		i++;
+	hist[min(i, QLOCK_HIST_BUCKETS - 1)]++;
+}
+
+static int qspinlock_slowpath_event(struct perf_evsel *evsel,
+				    struct perf_sample *sample)
+{
+	struct qlock_cpu_stat *qc = qlock_cpu(sample);
+	struct lock_stat *ls;
+
+	if (!qc)
+		return 0;
+	ls = qlock_stat_findnew(evsel, sample);
+	if (!ls)
+		return -ENOMEM;
+
+	/* A lost acquired event, or a wait interrupted by an NMI */
+	if (qc->ls)
+		qc->ls->waiters--;
+
+	qc->ls = ls;
+	qc->start = sample->time;
+	ls->nr_contended++;
+	ls->waiters++;
+	ls->depth_total += ls->waiters;
+	if (ls->depth_max < ls->waiters)
+		ls->depth_max = ls->waiters;
+	return 0;
+}
+
+static int qspinlock_pending_event(struct perf_evsel *evsel __maybe_unused,
+				   struct perf_sample *sample)
+{
+	struct qlock_cpu_stat *qc = qlock_cpu(sample);
+
+	if (qc && qc->ls)
+		qc->ls->nr_pending++;
+	return 0;
+}
+
+static int qspinlock_queued_event(struct perf_evsel *evsel __maybe_unused,
+				  struct perf_sample *sample)
+{
+	struct qlock_cpu_stat *qc = qlock_cpu(sample);
+
+	if (qc && qc->ls)
+		qc->ls->nr_queued++;
+	return 0;
+}
+
+static int qspinlock_acquired_event(struct perf_evsel *evsel,
+				    struct perf_sample *sample)
+{
+	struct qlock_cpu_stat *qc = qlock_cpu(sample);
+	struct lock_stat *ls;
+	u64 wait;
+
+	if (!qc)
+		return 0;
+	ls = qlock_stat_findnew(evsel, sample);
+	if (!ls)
+		return -ENOMEM;
+
+	ls->nr_acquired++;
+	if (qc->ls != ls) {
+		/* orphan event */
+		ls->last_acquired = sample->time;
+		return 0;
+	}
+
+	wait = sample->time - qc->start;
+	ls->wait_time_total += wait;
+	if (wait < ls->wait_time_min)
+		ls->wait_time_min = wait;
+	if (ls->wait_time_max < wait)
+		ls->wait_time_max = wait;
+	ls->avg_wait_time = ls->wait_time_total / ls->nr_acquired;
+	qlock_hist_add(ls->wait_hist, wait);
+
+	if (ls->last_acquired && qc->start < ls->last_acquired) {
+		u64 hold = sample->time - ls->last_acquired;
+
+		ls->nr_hold++;
+		ls->hold_time_total += hold;
+		if (ls->hold_time_max < hold)
+			ls->hold_time_max = hold;
+		qlock_hist_add(ls->hold_hist, hold);
+	}
+	ls->last_acquired = sample->time;
+
+	ls->waiters--;
+	qc->ls = NULL;
+	return 0;
+}
+
+static int qspinlock_timeout_event(struct perf_evsel *evsel __maybe_unused,
+				   struct perf_sample *sample)
+{
+	struct qlock_cpu_stat *qc = qlock_cpu(sample);
+
+	if (qc && qc->ls) {
+		qc->ls->nr_timeout++;
+		qc->ls->waiters--;
+		qc->ls = NULL;
+	}
+	return 0;
+}
+
+static int qspinlock_pv_halt_event(struct perf_evsel *evsel __maybe_unused,
+				   struct perf_sample *sample)
+{
+	struct qlock_cpu_stat *qc = qlock_cpu(sample);
+
+	if (qc && qc->ls)
+		qc->ls->nr_halt++;
+	return 0;
+}
+
+static int qspinlock_pv_kick_event(struct perf_evsel *evsel,
+				   struct perf_sample *sample)
+{
+	u32 cpu = perf_evsel__intval(evsel, sample, "cpu");
+	struct qlock_cpu_stat *qc;
+
+	if (cpu >= MAX_NR_CPUS)
+		return 0;
+	qc = &qlock_cpus[cpu];
+	qc->kick_time = sample->time;
+	if (qc->ls)
+		qc->ls->nr_kick++;
+	return 0;
+}
+
+static int qspinlock_pv_wake_event(struct perf_evsel *evsel,
+				   struct perf_sample *sample)
+{
+	struct qlock_cpu_stat *qc = qlock_cpu(sample);
+	bool kicked = perf_evsel__intval(evsel, sample, "kicked");
+	struct lock_stat *ls;
+	u64 latency;
+
+	if (!qc || !qc->ls)
+		return 0;
+	ls = qc->ls;
+	if (!kicked) {
+		ls->nr_wake_spurious++;
+		return 0;
+	}
+
+	ls->nr_wake_kicked++;
+	if (!qc->kick_time || qc->kick_time > sample->time)
+		return 0;
+	latency = sample->time - qc->kick_time;
+	ls->kick_wake_total += latency;
+	if (ls->kick_wake_max < latency)
+		ls->kick_wake_max = latency;
+	qc->kick_time = 0;
+	return 0;
+}
+
+/*
+ * The host exits, when recorded on the host or merged into the guest
+ * trace. They carry no vCPU id to tie them to the guest CPUs, so they
+ * are only summed up by exit reason next to the lock statistics.
+ */
+static int qspinlock_kvm_exit_event(struct perf_evsel *evsel,
+				    struct perf_sample *sample)
+{
+	u64 reason = perf_evsel__intval(evsel, sample, "exit_reason");
+
+	nr_kvm_exit++;
+	if (reason < ARRAY_SIZE(nr_kvm_exit_reason))
+		nr_kvm_exit_reason[reason]++;
+	return 0;
+}
+
 static void print_bad_events(int bad, int total)
 {
 	/* Output for debug, this have to be removed */
@@ -753,6 +1013,80 @@ static void print_result(void)
 	print_bad_events(bad, total);
 }
 
+static void print_qlock_hist(const char *what, unsigned int *hist)
+{
+	int i;
+
+	for (i = 0; i < QLOCK_HIST_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		pr_info("%20s %5s %12" PRIu64 " - %12" PRIu64 " ns: %u\n", "",
+			what, i ? (u64)1 << i : 0, ((u64)2 << i) - 1, hist[i]);
+	}
+}
+
+static void print_qlock_result(void)
+{
+	struct lock_stat *st;
+	int i;
+
+	pr_info("%20s ", "Lock");
+	pr_info("%10s ", "acquired");
+	pr_info("%10s ", "contended");
+	pr_info("%10s ", "pending");
+	pr_info("%10s ", "queued");
+	pr_info("%6s ", "depth");
+	pr_info("%6s ", "max");
+	pr_info("%12s ", "avg wait");
+	pr_info("%12s ", "max wait");
+	pr_info("%12s ", "avg hold");
+	pr_info("%12s ", "max hold");
+	pr_info("%8s ", "halts");
+	pr_info("%8s ", "kicks");
+	pr_info("%8s ", "spurious");
+	pr_info("%12s ", "avg kick");
+	pr_info("%12s ", "max kick");
+	pr_info("\n");
+	pr_info("(all times in ns, the kick ones are from the kick to the wakeup)\n\n");
+
+	while ((st = pop_from_result())) {
+		pr_info("%20s ", st->name);
+		pr_info("%10u ", st->nr_acquired);
+		pr_info("%10u ", st->nr_contended);
+		pr_info("%10u ", st->nr_pending);
+		pr_info("%10u ", st->nr_queued);
+		pr_info("%6.1f ", st->nr_contended ?
+			(double)st->depth_total / st->nr_contended : 0.0);
+		pr_info("%6u ", st->depth_max);
+		pr_info("%12" PRIu64 " ", st->avg_wait_time);
+		pr_info("%12" PRIu64 " ", st->wait_time_max);
+		pr_info("%12" PRIu64 " ", st->nr_hold ?
+			st->hold_time_total / st->nr_hold : 0);
+		pr_info("%12" PRIu64 " ", st->hold_time_max);
+		pr_info("%8u ", st->nr_halt);
+		pr_info("%8u ", st->nr_kick);
+		pr_info("%8u ", st->nr_wake_spurious);
+		pr_info("%12" PRIu64 " ", st->nr_wake_kicked ?
+			st->kick_wake_total / st->nr_wake_kicked : 0);
+		pr_info("%12" PRIu64 " ", st->kick_wake_max);
+		pr_info("\n");
+
+		if (qlock_histogram) {
+			print_qlock_hist("wait", st->wait_hist);
+			print_qlock_hist("hold", st->hold_hist);
+		}
+	}
+
+	if (!nr_kvm_exit)
+		return;
+
+	pr_info("\n%u kvm exits, by exit reason:\n", nr_kvm_exit);
+	for (i = 0; i < (int)ARRAY_SIZE(nr_kvm_exit_reason); i++) {
+		if (nr_kvm_exit_reason[i])
+			pr_info(" %10d: %u\n", i, nr_kvm_exit_reason[i]);
+	}
+}
+
 static bool info_threads, info_map;
 
 static void dump_threads(void)
@@ -846,6 +1180,19 @@ static const struct perf_evsel_str_handler lock_tracepoints[] = {
 	{ "lock:lock_release",	 perf_evsel__process_lock_release,   }, /* CONFIG_LOCKDEP */
 };
 
+/* The first one is required, the others are recorded when available */
+static const struct perf_evsel_str_handler qspinlock_tracepoints[] = {
+	{ "qspinlock:qspinlock_slowpath", qspinlock_slowpath_event, },
+	{ "qspinlock:qspinlock_pending",  qspinlock_pending_event,  },
+	{ "qspinlock:qspinlock_queued",	  qspinlock_queued_event,   },
+	{ "qspinlock:qspinlock_acquired", qspinlock_acquired_event, },
+	{ "qspinlock:qspinlock_timeout",  qspinlock_timeout_event,  }, /* CONFIG_QUEUE_SPINLOCK_TIMEOUT */
+	{ "qspinlock:qspinlock_pv_halt",  qspinlock_pv_halt_event,  }, /* CONFIG_PARAVIRT_SPINLOCKS */
+	{ "qspinlock:qspinlock_pv_kick",  qspinlock_pv_kick_event,  }, /* CONFIG_PARAVIRT_SPINLOCKS */
+	{ "qspinlock:qspinlock_pv_wake",  qspinlock_pv_wake_event,  }, /* CONFIG_PARAVIRT_SPINLOCKS */
+	{ "kvm:kvm_exit",		  qspinlock_kvm_exit_event, }, /* KVM host */
+};
+
 static int __cmd_report(bool display_info)
 {
 	int err = -EINVAL;
@@ -870,7 +1217,15 @@ static int __cmd_report(bool display_info)
 	if (!perf_session__has_traces(session, "lock record"))
 		goto out_delete;
 
-	if (perf_session__set_tracepoints_handlers(session, lock_tracepoints)) {
+	if (perf_evlist__find_tracepoint_by_name(session->evlist,
+				qspinlock_tracepoints[0].name) &&
+	    !perf_evlist__find_tracepoint_by_name(session->evlist,
+				lock_tracepoints[0].name))
+		qspinlock_mode = true;
+
+	if (qspinlock_mode ?
+	    perf_session__set_tracepoints_handlers(session, qspinlock_tracepoints) :
+	    perf_session__set_tracepoints_handlers(session, lock_tracepoints)) {
 		pr_err("Initializing perf session tracepoint handlers failed\n");
 		goto out_delete;
 	}
@@ -885,7 +1240,10 @@ static int __cmd_report(bool display_info)
 	setup_pager();
 	if (display_info) /* used for info subcommand */
 		err = dump_info();
-	else {
+	else if (qspinlock_mode) {
+		sort_result();
+		print_qlock_result();
+	} else {
 		sort_result();
 		print_result();
 	}
@@ -900,21 +1258,35 @@ static int __cmd_record(int argc, const char **argv)
 	const char *record_args[] = {
 		"record", "-R", "-m", "1024", "-c", "1",
 	};
+	const struct perf_evsel_str_handler *tracepoints = lock_tracepoints;
+	unsigned int nr_tracepoints = ARRAY_SIZE(lock_tracepoints);
 	unsigned int rec_argc, i, j, ret;
 	const char **rec_argv;
 
-	for (i = 0; i < ARRAY_SIZE(lock_tracepoints); i++) {
-		if (!is_valid_tracepoint(lock_tracepoints[i].name)) {
+	if (qspinlock_mode) {
+		tracepoints = qspinlock_tracepoints;
+		nr_tracepoints = ARRAY_SIZE(qspinlock_tracepoints);
+		if (!is_valid_tracepoint(tracepoints[0].name)) {
+			pr_err("tracepoint %s is not enabled. "
+			       "Is CONFIG_QUEUE_SPINLOCK enabled?\n",
+			       tracepoints[0].name);
+			return 1;
+		}
+	} else {
+		for (i = 0; i < nr_tracepoints; i++) {
+			if (!is_valid_tracepoint(tracepoints[i].name)) {
 				pr_err("tracepoint %s is not enabled. "
-				       "Are CONFIG_LOCKDEP and CONFIG_LOCK_STAT enabled?\n",
-				       lock_tracepoints[i].name);
+				       "Are CONFIG_LOCKDEP and CONFIG_LOCK_STAT enabled? "
+				       "Otherwise, try perf lock -q record.\n",
+				       tracepoints[i].name);
 				return 1;
+			}
 		}
 	}
 
 	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
 	/* factor of 2 is for -e in front of each tracepoint */
-	rec_argc += 2 * ARRAY_SIZE(lock_tracepoints);
+	rec_argc += 2 * nr_tracepoints;
 
 	rec_argv = calloc(rec_argc + 1, sizeof(char *));
 	if (!rec_argv)
@@ -923,15 +1295,18 @@ static int __cmd_record(int argc, const char **argv)
 	for (i = 0; i < ARRAY_SIZE(record_args); i++)
 		rec_argv[i] = strdup(record_args[i]);
 
-	for (j = 0; j < ARRAY_SIZE(lock_tracepoints); j++) {
+	for (j = 0; j < nr_tracepoints; j++) {
+		/* The optional qspinlock ones that are not available */
+		if (qspinlock_mode && !is_valid_tracepoint(tracepoints[j].name))
+			continue;
 		rec_argv[i++] = "-e";
-		rec_argv[i++] = strdup(lock_tracepoints[j].name);
+		rec_argv[i++] = strdup(tracepoints[j].name);
 	}
 
 	for (j = 1; j < (unsigned int)argc; j++, i++)
 		rec_argv[i] = argv[j];
 
-	BUG_ON(i != rec_argc);
+	BUG_ON(i > rec_argc);
 
 	ret = cmd_record(i, rec_argv, NULL);
 	free(rec_argv);
@@ -951,11 +1326,16 @@ int cmd_lock(int argc, const char **argv, const char *prefix __maybe_unused)
 	OPT_STRING('i', "input", &input_name, "file", "input file name"),
 	OPT_INCR('v', "verbose", &verbose, "be more verbose (show symbol address, etc)"),
 	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace, "dump raw trace in ASCII"),
+	OPT_BOOLEAN('q', "qspinlock", &qspinlock_mode,
+		    "record the qspinlock tracepoints, no lockdep needed"),
 	OPT_END()
 	};
 	const struct option report_options[] = {
 	OPT_STRING('k', "key", &sort_key, "acquired",
-		    "key for sorting (acquired / contended / avg_wait / wait_total / wait_max / wait_min)"),
+		    "key for sorting (acquired / contended / avg_wait / wait_total / wait_max / wait_min"
+		    " / hold_total / hold_max / halt)"),
+	OPT_BOOLEAN('H', "histogram", &qlock_histogram,
+		    "show the wait and hold time histograms of the qspinlocks"),
 	/* TODO: type */
 	OPT_END()
 	};
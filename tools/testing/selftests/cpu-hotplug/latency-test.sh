@@ -0,0 +1,103 @@
+#!/bin/bash
+#
+# Measure the latency of offlining and onlining the hotpluggable cpus.
+#
+# Usage: latency-test.sh [-n iterations] [-c cpu]
+#
+# Each cpu is offlined and onlined again the given number of times (10 by
+# default), and the minimum, average and maximum latencies of both
+# operations are reported in microseconds.
+
+SYSFS=/sys/devices/system/cpu
+iterations=10
+only_cpu=
+
+check_prereqs()
+{
+	local msg="skip all tests:"
+
+	if [ $UID != 0 ]; then
+		echo $msg must be run as root >&2
+		exit 0
+	fi
+
+	if ! ls $SYSFS/cpu*/online > /dev/null 2>&1; then
+		echo $msg cpu hotplug is not supported >&2
+		exit 0
+	fi
+}
+
+now_us()
+{
+	echo $(( $(date +%s%N) / 1000 ))
+}
+
+# set_online <cpu> <0|1>, prints the latency in microseconds
+set_online()
+{
+	local start end
+
+	start=$(now_us)
+	echo $2 > $SYSFS/cpu$1/online || return 1
+	end=$(now_us)
+	echo $(( end - start ))
+}
+
+# measure <cpu>, prints the min/avg/max offline and online latencies
+measure()
+{
+	local cpu=$1 i t
+	local off_min= off_max=0 off_sum=0 on_min= on_max=0 on_sum=0
+
+	for (( i = 0; i < iterations; i++ )); do
+		t=$(set_online $cpu 0) || return 1
+		off_sum=$(( off_sum + t ))
+		[ -z "$off_min" -o "$t" -lt "${off_min:-0}" ] && off_min=$t
+		[ "$t" -gt $off_max ] && off_max=$t
+
+		t=$(set_online $cpu 1) || return 1
+		on_sum=$(( on_sum + t ))
+		[ -z "$on_min" -o "$t" -lt "${on_min:-0}" ] && on_min=$t
+		[ "$t" -gt $on_max ] && on_max=$t
+	done
+
+	printf "cpu%-4d offline us: min %8d avg %8d max %8d\n" $cpu \
+		$off_min $(( off_sum / iterations )) $off_max
+	printf "cpu%-4d online  us: min %8d avg %8d max %8d\n" $cpu \
+		$on_min $(( on_sum / iterations )) $on_max
+}
+
+while getopts n:c: opt; do
+	case $opt in
+	n)
+		iterations=$OPTARG
+		;;
+	c)
+		only_cpu=$OPTARG
+		;;
+	*)
+		echo "Usage: $0 [-n iterations] [-c cpu]" >&2
+		exit 1
+		;;
+	esac
+done
+
+check_prereqs
+
+rc=0
+for online in $SYSFS/cpu*/online; do
+	cpu=${online#$SYSFS/cpu}
+	cpu=${cpu%/online}
+
+	[ -n "$only_cpu" -a "$cpu" != "$only_cpu" ] && continue
+	# Leave the offline cpus alone
+	[ "$(cat $online)" = 1 ] || continue
+
+	if ! measure $cpu; then
+		echo "cpu$cpu: hotplug failed [FAIL]"
+		echo 1 > $online 2> /dev/null
+		rc=1
+	fi
+done
+
+exit $rc
@@ -0,0 +1,29 @@
+#!/bin/busybox sh
+#
+# /init of the guests booted by kvm-overcommit.sh
+#
+# locktorture is built in and started from the kernel command line, this
+# waits for lockbench_duration seconds, dumps the benchmark results and the
+# PV lock statistics on the console between markers, and powers off.
+
+/bin/busybox --install -s /bin
+export PATH=/bin
+
+mount -t proc proc /proc
+mount -t sysfs sysfs /sys
+mount -t debugfs debugfs /sys/kernel/debug
+
+duration=$(sed -n 's/.*lockbench_duration=\([0-9]*\).*/\1/p' /proc/cmdline)
+sleep ${duration:-30}
+
+echo "=== bench"
+cat /sys/kernel/debug/locktorture/bench
+echo "=== pvstat"
+for f in /sys/kernel/debug/kvm-guest/spinlocks/*; do
+	[ -f $f ] || continue
+	echo "--- ${f##*/}"
+	cat $f
+done
+echo "=== end"
+
+poweroff -f
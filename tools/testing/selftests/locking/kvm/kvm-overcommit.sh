@@ -0,0 +1,248 @@
+#!/bin/bash
+#
+# Run the locktorture benchmark in overcommitted KVM guests.
+#
+# Usage: kvm-overcommit.sh -k bzImage -b busybox [-m vcpus] [-c host_cpus]
+#			   [-g "guests ..."] [-d seconds] [-t type]
+#			   [-w cs_ns] [-T think_ns] [-o resdir]
+#
+# For each number of guests of the -g list (1 2 4 by default), boot that
+# many guests of -m vCPUs (4 by default) on the first -c host CPUs (4 by
+# default), for an overcommit ratio of guests * vcpus / host_cpus. Each
+# guest runs the locktorture benchmark mode with one writer per vCPU for
+# -d seconds (30 by default) on the -t lock type (spin_lock by default),
+# then dumps its results and the PV lock statistics of kvm-guest/spinlocks
+# in debugfs on its console.
+#
+# The guest kernel must be built with the options of config-guest, the
+# busybox binary must be static. The host counts of the KVM exits are read
+# from debugfs, which needs root, and are left out otherwise.
+#
+# The console logs and the reports of a run are kept in the result
+# directory (kvm-overcommit.<date> by default): one report per overcommit
+# ratio, and a summary with a line per ratio:
+#  ratio	  - vCPUs per host CPU
+#  acq/s	  - acquisitions per second, summed over the guests
+#  acq/s/vcpu	  - the same per vCPU
+#  p50/p99	  - lock wait percentiles in ns, the worst of the guests
+#  exits/s	  - KVM exits per second on the host
+#  halts/s	  - halt exits per second on the host
+
+BASEDIR=$(cd $(dirname $0) && pwd)
+KVM_DEBUGFS=/sys/kernel/debug/kvm
+KVM_STATS="exits halt_exits halt_wakeup hypercalls pv_halt_poll
+	   spin_waitfor_yield lock_holder_grace qhead_boost"
+kernel=
+busybox=
+vcpus=4
+host_cpus=4
+guests_list="1 2 4"
+duration=30
+type=spin_lock
+cs_ns=100
+think_ns=1000
+resdir=kvm-overcommit.$(date +%Y.%m.%d-%H.%M.%S)
+qemu=${QEMU:-qemu-system-x86_64}
+mem=512
+
+usage()
+{
+	echo "Usage: $0 -k bzImage -b busybox [-m vcpus] [-c host_cpus]" >&2
+	echo "	[-g \"guests ...\"] [-d seconds] [-t type] [-w cs_ns]" >&2
+	echo "	[-T think_ns] [-o resdir]" >&2
+	exit 1
+}
+
+# cpulist_expand <cpulist>, prints the cpus of a cpulist one per line
+cpulist_expand()
+{
+	local range
+
+	for range in ${1//,/ }; do
+		seq ${range%-*} ${range#*-}
+	done
+}
+
+# host_cpulist <n>, prints a cpulist of the first n online cpus
+host_cpulist()
+{
+	local cpus
+
+	cpus=$(cpulist_expand $(cat /sys/devices/system/cpu/online) | head -n $1)
+	if [ $(echo "$cpus" | wc -l) -lt $1 ]; then
+		echo "$0: less than $1 online cpus" >&2
+		exit 1
+	fi
+	echo $cpus | tr ' ' ','
+}
+
+# make_initrd <file>, packs busybox and guest-init.sh into an initramfs
+make_initrd()
+{
+	local dir=$(mktemp -d)
+
+	mkdir -p $dir/bin $dir/dev $dir/proc $dir/sys
+	cp $busybox $dir/bin/busybox
+	cp $BASEDIR/guest-init.sh $dir/init
+	chmod +x $dir/init $dir/bin/busybox
+	(cd $dir && find . | cpio -o -H newc --quiet | gzip) > $1
+	rm -rf $dir
+}
+
+# kvm_stats <file>, saves the host KVM counters, nothing without debugfs
+kvm_stats()
+{
+	local stat
+
+	: > $1
+	[ -r $KVM_DEBUGFS/exits ] || return 0
+	for stat in $KVM_STATS; do
+		[ -r $KVM_DEBUGFS/$stat ] &&
+			echo "$stat $(cat $KVM_DEBUGFS/$stat)"
+	done | sort > $1
+}
+
+# run_guests <nguests> <dir>, boots the guests and waits for them
+run_guests()
+{
+	local n=$1 dir=$2 i pid pids= alive timeout
+	local append="console=ttyS0 panic=-1 lockbench_duration=$duration
+		locktorture.torture_runnable=1 locktorture.torture_type=$type
+		locktorture.bench=1 locktorture.nwriters_stress=$vcpus
+		locktorture.cs_ns=$cs_ns locktorture.think_ns=$think_ns
+		locktorture.stutter=0 locktorture.shuffle_interval=0
+		locktorture.stat_interval=0"
+
+	for i in $(seq $n); do
+		taskset -c $cpulist $qemu -enable-kvm -cpu host -smp $vcpus \
+			-m $mem -nographic -no-reboot -kernel $kernel \
+			-initrd $initrd -append "$(echo $append)" \
+			< /dev/null > $dir/guest$i.log 2>&1 &
+		pids="$pids $!"
+	done
+
+	# Boot and shutdown take a while in an overcommitted host
+	timeout=$(( duration + 60 * n * vcpus / host_cpus + 120 ))
+	for (( i = 0; i < timeout; i++ )); do
+		alive=
+		for pid in $pids; do
+			kill -0 $pid 2> /dev/null && alive=1
+		done
+		[ -n "$alive" ] || break
+		sleep 1
+	done
+	for pid in $pids; do
+		if kill -0 $pid 2> /dev/null; then
+			echo "$dir: guest (pid $pid) timed out" >&2
+			kill $pid
+		fi
+	done
+	wait
+}
+
+# guest_section <log> <section>, prints a section of a guest console log
+guest_section()
+{
+	tr -d '\r' < $1 | awk -v s="=== $2" '
+		$0 == s { on = 1; next }
+		/^=== / { on = 0 }
+		on'
+}
+
+# report <dir> <nguests> <elapsed>, writes the report of a run, prints
+# its summary line
+report()
+{
+	local dir=$1 n=$2 elapsed=$3 log
+
+	for log in $dir/guest*.log; do
+		if ! grep -q "^=== end" $log; then
+			echo "$log: no results" >&2
+			continue
+		fi
+		guest_section $log bench > $log.bench
+		guest_section $log pvstat > $log.pvstat
+	done
+
+	{
+		echo "guests $n vcpus $vcpus host_cpus $host_cpus" \
+		     "type $type cs_ns $cs_ns think_ns $think_ns"
+		echo
+		echo "# guest bench"
+		for log in $dir/guest*.log.bench; do
+			echo "--- ${log##*/}"
+			cat $log
+		done
+		echo
+		echo "# guest pvstat, summed over the guests"
+		cat $dir/guest*.log.pvstat 2> /dev/null | awk '
+			/^--- / { name = $2; next }
+			NF == 1 && $1 ~ /^[0-9]+$/ { sum[name] += $1 }
+			END { for (s in sum) print s, sum[s] }' | sort
+		echo
+		echo "# host kvm, per second"
+		join $dir/kvm.before $dir/kvm.after 2> /dev/null |
+			awk -v t=$elapsed '{ print $1, int(($3 - $2) / t) }'
+	} > $dir/report
+
+	cat $dir/guest*.log.bench 2> /dev/null | awk \
+	    -v ratio=$(( n * vcpus * 100 / host_cpus )) -v nvcpus=$(( n * vcpus )) \
+	    -v exits="$(awk '$1 == "exits" { print $2 }' $dir/report)" \
+	    -v halts="$(awk '$1 == "halt_exits" { print $2 }' $dir/report)" '
+		$1 == "acq_per_sec" { acq += $2 }
+		$1 == "wait_p50_ns" && $2 > p50 { p50 = $2 }
+		$1 == "wait_p99_ns" && $2 > p99 { p99 = $2 }
+		END {
+			printf "%d.%02d\t%d\t%d\t%d\t%d\t%s\t%s\n",
+			       ratio / 100, ratio % 100, acq, acq / nvcpus,
+			       p50, p99, exits == "" ? "-" : exits,
+			       halts == "" ? "-" : halts
+		}'
+}
+
+while getopts "k:b:m:c:g:d:t:w:T:o:" opt; do
+	case $opt in
+	k) kernel=$OPTARG ;;
+	b) busybox=$OPTARG ;;
+	m) vcpus=$OPTARG ;;
+	c) host_cpus=$OPTARG ;;
+	g) guests_list=$OPTARG ;;
+	d) duration=$OPTARG ;;
+	t) type=$OPTARG ;;
+	w) cs_ns=$OPTARG ;;
+	T) think_ns=$OPTARG ;;
+	o) resdir=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+[ -r "$kernel" ] && [ -x "$busybox" ] || usage
+if [ ! -w /dev/kvm ]; then
+	echo "$0: /dev/kvm is not usable" >&2
+	exit 1
+fi
+for cmd in $qemu taskset cpio; do
+	if ! command -v $cmd > /dev/null; then
+		echo "$0: $cmd is not installed" >&2
+		exit 1
+	fi
+done
+
+cpulist=$(host_cpulist $host_cpus) || exit 1
+mkdir -p $resdir || exit 1
+initrd=$resdir/initramfs.cpio.gz
+make_initrd $initrd
+
+echo -e "ratio\tacq/s\tacq/s/vcpu\tp50\tp99\texits/s\thalts/s" |
+	tee $resdir/summary
+for n in $guests_list; do
+	dir=$resdir/guests-$n
+	mkdir -p $dir
+	kvm_stats $dir/kvm.before
+	start=$(date +%s)
+	run_guests $n $dir
+	elapsed=$(( $(date +%s) - start ))
+	kvm_stats $dir/kvm.after
+	report $dir $n $elapsed | tee -a $resdir/summary
+done
+echo "results in $resdir"
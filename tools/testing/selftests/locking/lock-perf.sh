@@ -0,0 +1,176 @@
+#!/bin/bash
+#
+# Check the lock throughput of fixed scenarios against a baseline.
+#
+# Usage: lock-perf.sh [-r] [-f baseline] [-t tolerance] [-d seconds]
+#
+# Each scenario is run with the userspace build of the queue spinlock in
+# tools/lib/qspinlock, and as root with the benchmark mode of locktorture
+# if it is available. The throughput, in acquisitions per second, is
+# compared to the one of the baseline file and a scenario fails if it got
+# slower by more than the tolerance (10% by default). The scenarios that
+# aren't in the baseline are only reported.
+#
+# -r records the results of the run as the new baseline instead. The
+# baseline only makes sense on the machine and the configuration it was
+# recorded on: record it with the kernel before a lock change, and check
+# the kernel with the change against it.
+#
+# The scenarios are:
+#  uncontended	 - one thread, the fastpath
+#  pending	 - two threads of the same node, the pending bit handoff
+#  socket	 - a thread per CPU of node 0, the full queue
+#  cross-socket	 - twice as many threads spread over the nodes (NUMA only)
+#  pv-overcommit - twice as many locktorture writers as CPUs on
+#		   pv_qspinlock (in a guest only)
+
+BASEDIR=$(dirname $0)
+QSPINLOCK_BENCH=$BASEDIR/../../../lib/qspinlock/qspinlock_bench
+DEBUGFS=/sys/kernel/debug
+baseline=$BASEDIR/lock-perf.baseline
+tolerance=10
+duration=5
+record=
+failed=0
+
+declare -A results
+
+usage()
+{
+	echo "Usage: $0 [-r] [-f baseline] [-t tolerance] [-d seconds]" >&2
+	exit 1
+}
+
+# cpulist_count <cpulist>, prints the number of cpus of a cpulist
+cpulist_count()
+{
+	local n=0 range lo hi
+
+	for range in ${1//,/ }; do
+		lo=${range%-*}
+		hi=${range#*-}
+		n=$(( n + hi - lo + 1 ))
+	done
+	echo $n
+}
+
+node_cpus()
+{
+	local list=/sys/devices/system/node/node0/cpulist
+
+	if [ -r $list ]; then
+		cpulist_count $(cat $list)
+	else
+		getconf _NPROCESSORS_ONLN
+	fi
+}
+
+nr_nodes()
+{
+	ls -d /sys/devices/system/node/node[0-9]* 2> /dev/null | wc -l
+}
+
+in_guest()
+{
+	grep -q '^flags.* hypervisor' /proc/cpuinfo
+}
+
+# run_user <args>, prints the acquisitions per second of qspinlock_bench
+run_user()
+{
+	$QSPINLOCK_BENCH -d $duration "$@" | awk '$1 == "total" { print $2 }'
+}
+
+# run_kernel <type> <nwriters> <cs_ns> <think_ns>, prints the acquisitions
+# per second of locktorture, nothing if it isn't available or had errors
+run_kernel()
+{
+	local file=$DEBUGFS/locktorture/bench acq errors
+
+	[ $UID = 0 ] || return 0
+	modprobe locktorture torture_type=$1 bench=1 nwriters_stress=$2 \
+		cs_ns=$3 think_ns=$4 stutter=0 shuffle_interval=0 \
+		stat_interval=0 > /dev/null 2>&1 || return 0
+	sleep $duration
+	acq=$(awk '$1 == "acq_per_sec" { print $2 }' $file)
+	errors=$(awk '$1 == "errors" { print $2 }' $file)
+	rmmod locktorture
+
+	if [ "${errors:-0}" != 0 ]; then
+		echo "locktorture $1: $errors errors" >&2
+		failed=1
+		return 0
+	fi
+	echo $acq
+}
+
+# check <scenario> <acq/s>
+check()
+{
+	local name=$1 acq=$2 base
+
+	if [ -z "$acq" ]; then
+		echo "$name: not run [SKIP]"
+		return
+	fi
+	results[$name]=$acq
+	[ -n "$record" ] && return
+
+	base=$(awk -v name=$name '$1 == name { print $2 }' $baseline \
+	       2> /dev/null)
+	if [ -z "$base" ]; then
+		echo "$name: $acq acq/s, no baseline"
+	elif (( acq * 100 < base * (100 - tolerance) )); then
+		echo "$name: $acq acq/s, baseline $base acq/s [FAIL]"
+		failed=1
+	else
+		echo "$name: $acq acq/s, baseline $base acq/s [PASS]"
+	fi
+}
+
+while getopts "rf:t:d:" opt; do
+	case $opt in
+	r) record=1 ;;
+	f) baseline=$OPTARG ;;
+	t) tolerance=$OPTARG ;;
+	d) duration=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+if [ ! -x $QSPINLOCK_BENCH ]; then
+	echo "skip all tests: $QSPINLOCK_BENCH is not built" >&2
+	exit 0
+fi
+
+ncpus=$(getconf _NPROCESSORS_ONLN)
+socket=$(node_cpus)
+
+check user-uncontended "$(run_user -t 1)"
+if [ $ncpus -ge 2 ]; then
+	check user-pending "$(run_user -t 2 -p compact -c 100 -w 100)"
+	check user-socket "$(run_user -t $socket -p compact -c 100 -w 1000)"
+fi
+if [ $(nr_nodes) -gt 1 ]; then
+	check user-cross-socket \
+		"$(run_user -t $(( 2 * socket )) -p spread -c 100 -w 1000)"
+fi
+
+check kernel-uncontended "$(run_kernel spin_lock 1 0 0)"
+if [ $ncpus -ge 2 ]; then
+	check kernel-pending "$(run_kernel spin_lock 2 100 100)"
+	check kernel-socket "$(run_kernel spin_lock $socket 100 1000)"
+fi
+if in_guest; then
+	check kernel-pv-overcommit \
+		"$(run_kernel pv_qspinlock $(( 2 * ncpus )) 100 1000)"
+fi
+
+if [ -n "$record" ]; then
+	for name in "${!results[@]}"; do
+		echo "$name ${results[$name]}"
+	done | sort > $baseline
+	echo "baseline recorded in $baseline"
+fi
+
+exit $failed
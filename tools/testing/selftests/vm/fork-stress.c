@@ -0,0 +1,120 @@
+/*
+ * Stress test for anon_vma handling in fork-heavy workloads.
+ *
+ * Models a pre-fork server: the parent populates an anonymous region,
+ * then keeps NR_CHILDREN workers alive.  Each worker dirties part of the
+ * region (forcing COW pages into its own anon_vma) and, after a number
+ * of rounds, replaces itself by forking a successor and exiting, the way
+ * workers get recycled.  Run it with a region larger than the memory
+ * available to it (e.g. in a memory cgroup) so that reclaim walks the
+ * anon rmap of these pages while children fork and exit.
+ *
+ * Usage: fork-stress [-n children] [-m region MB] [-r rounds] [-g generations]
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#define PAGE_SIZE 4096
+
+static char *region;
+static size_t region_len;
+
+static void dirty(size_t start, size_t len)
+{
+	size_t off;
+
+	for (off = start; off < start + len && off < region_len;
+	     off += PAGE_SIZE)
+		region[off]++;
+}
+
+static void worker(int id, int rounds, int generations)
+{
+	size_t chunk = region_len / 16;
+	int gen, r;
+
+	for (gen = 0; gen < generations; gen++) {
+		for (r = 0; r < rounds; r++)
+			dirty(((size_t)(id + r) % 16) * chunk, chunk);
+
+		/* recycle: hand over to a fresh child and exit */
+		switch (fork()) {
+		case -1:
+			err(2, "fork");
+		case 0:
+			continue;
+		default:
+			_exit(0);
+		}
+	}
+	_exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_children = 1000, rounds = 4, generations = 16;
+	size_t mb = 256;
+	struct timespec a, b;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "n:m:r:g:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_children = atoi(optarg);
+			break;
+		case 'm':
+			mb = atol(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'g':
+			generations = atoi(optarg);
+			break;
+		default:
+			errx(1, "usage: %s [-n children] [-m region MB] "
+			     "[-r rounds] [-g generations]", argv[0]);
+		}
+	}
+
+	region_len = mb << 20;
+	region = mmap(NULL, region_len, PROT_READ | PROT_WRITE,
+		      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (region == MAP_FAILED)
+		err(2, "mmap");
+	dirty(0, region_len);
+
+	/* recycled workers get reparented to us, so we can wait for them */
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1))
+		err(2, "PR_SET_CHILD_SUBREAPER");
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+
+	for (i = 0; i < nr_children; i++) {
+		switch (fork()) {
+		case -1:
+			err(2, "fork");
+		case 0:
+			worker(i, rounds, generations);
+		}
+	}
+
+	while (wait(NULL) > 0)
+		;
+
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	printf("%d children x %d generations, %zu MB: %.3f s\n",
+	       nr_children, generations, mb,
+	       (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9);
+
+	return 0;
+}
@@ -1860,6 +1860,10 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 	int i;
 
 	kvm_vcpu_set_in_spin_loop(me, true);
+	/*
+	 * The guest may tell us which vCPU it waits for, try that first.
+	 */
+	yielded = kvm_arch_vcpu_spin_yield(me);
 	/*
 	 * We boost the priority of a VCPU that is runnable but not
 	 * currently running, because it got preempted by something